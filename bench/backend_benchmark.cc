@@ -0,0 +1,147 @@
+// backend_benchmark.cc - Instruction selection, liveness and linear scan throughput on RISC-V
+#include "benchmark/benchmark.h"
+#include "bench/workload.h"
+#include "src/ir_generator.h"
+#include "src/isel.h"
+#include "src/lra.h"
+#include "src/parser.h"
+#include "src/reg_alloc/lsra.h"
+#include "src/targets/riscv_isel.h"
+#include "src/targets/riscv_target.h"
+#include "src/transforms/sroa.h"
+#include "src/type_checker.h"
+
+#include <memory>
+
+// Arguments are (shape, scale) as in frontend_benchmark. The IR for a
+// workload is built once, with its aggregate copies lowered as the driver
+// does; whatever a stage needs from the stages before it is redone with the
+// timer paused.
+namespace
+{
+    struct Lowered
+    {
+        Module module;
+        RISCV::RISCVRegisterInfo tri;
+        RISCV::RISCVTargetInstInfo tii;
+        RISCV::RISCVISelInfo target{&tii};
+    };
+
+    std::unique_ptr<Lowered> lower(benchmark::State &state)
+    {
+        const WorkloadShape shape = ALL_WORKLOAD_SHAPES[state.range(0)];
+        state.SetLabel(workload_shape_name(shape));
+        const std::string source = generate_workload(shape, static_cast<unsigned>(state.range(1)));
+
+        Parser parser{Lexer::borrowed(source)};
+        ast::Program program = parser.parse();
+        TypeChecker checker(&program);
+        if (!checker.check().ok)
+            state.SkipWithError("workload does not type check");
+
+        auto lowered = std::make_unique<Lowered>();
+        IRGenerator generator(&lowered->module);
+        generator.generate(program);
+        lower_aggregate_copies(lowered->module);
+        return lowered;
+    }
+
+    std::unique_ptr<MachineModule> select(Lowered &lowered, benchmark::State &state)
+    {
+        auto mm = std::make_unique<MachineModule>(&lowered.module);
+        mm->set_target_info(&lowered.tri, &lowered.tii);
+        std::vector<std::string> errors;
+        select_module(lowered.target, lowered.module, *mm, nullptr, &errors);
+        if (!errors.empty())
+            state.SkipWithError(errors.front().c_str());
+        return mm;
+    }
+
+    size_t count_instructions(const MachineModule &mm)
+    {
+        size_t count = 0;
+        for (const auto &mf : mm.functions())
+        {
+            for (const auto &mbb : mf->basic_blocks())
+                count += mbb->instructions().size();
+        }
+        return count;
+    }
+
+    void workload_args(benchmark::internal::Benchmark *b)
+    {
+        b->ArgNames({"shape", "scale"});
+        for (int64_t shape = 0; shape < int64_t(std::size(ALL_WORKLOAD_SHAPES)); ++shape)
+        {
+            for (int64_t scale : {64, 1024})
+                b->Args({shape, scale});
+        }
+    }
+}
+
+static void BM_InstructionSelection(benchmark::State &state)
+{
+    std::unique_ptr<Lowered> lowered = lower(state);
+    size_t instructions = 0;
+    for (auto _ : state)
+    {
+        std::unique_ptr<MachineModule> mm = select(*lowered, state);
+
+        state.PauseTiming();
+        instructions += count_instructions(*mm);
+        mm.reset();
+        state.ResumeTiming();
+    }
+    state.counters["instructions"] = benchmark::Counter(static_cast<double>(instructions), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_InstructionSelection)->Apply(workload_args);
+
+// The analyzer only reads the function, so one selection serves every run
+static void BM_LiveRangeAnalysis(benchmark::State &state)
+{
+    std::unique_ptr<Lowered> lowered = lower(state);
+    std::unique_ptr<MachineModule> mm = select(*lowered, state);
+    for (const auto &mf : mm->functions())
+        mf->build_cfg();
+
+    for (auto _ : state)
+    {
+        for (const auto &mf : mm->functions())
+        {
+            LiveRangeAnalyzer analyzer(*mf);
+            analyzer.compute();
+            benchmark::DoNotOptimize(analyzer);
+        }
+    }
+    state.counters["instructions"] = benchmark::Counter(
+        static_cast<double>(count_instructions(*mm) * state.iterations()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_LiveRangeAnalysis)->Apply(workload_args);
+
+static void BM_LinearScan(benchmark::State &state)
+{
+    std::unique_ptr<Lowered> lowered = lower(state);
+    size_t instructions = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::unique_ptr<MachineModule> mm = select(*lowered, state);
+        for (const auto &mf : mm->functions())
+            mf->build_cfg();
+        instructions += count_instructions(*mm);
+        state.ResumeTiming();
+
+        for (const auto &mf : mm->functions())
+        {
+            LinearScanRegisterAllocator allocator(*mf);
+            if (!allocator.allocate_registers().successful)
+                state.SkipWithError("allocation failed");
+        }
+
+        state.PauseTiming();
+        mm.reset();
+        state.ResumeTiming();
+    }
+    state.counters["instructions"] = benchmark::Counter(static_cast<double>(instructions), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_LinearScan)->Apply(workload_args);
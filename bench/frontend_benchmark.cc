@@ -0,0 +1,130 @@
+// frontend_benchmark.cc - Lexer, parser, type checker and IR generation throughput
+#include "benchmark/benchmark.h"
+#include "bench/workload.h"
+#include "src/ir_generator.h"
+#include "src/parser.h"
+#include "src/type_checker.h"
+
+#include <memory>
+
+// Every benchmark here takes (shape, scale), the shape as its index in
+// ALL_WORKLOAD_SHAPES, and labels its row with the shape's name. The
+// parsing and checking a stage needs but doesn't measure happen with the
+// timer paused.
+namespace
+{
+    WorkloadShape shape_of(const benchmark::State &state) { return ALL_WORKLOAD_SHAPES[state.range(0)]; }
+
+    std::string source_for(benchmark::State &state)
+    {
+        state.SetLabel(workload_shape_name(shape_of(state)));
+        return generate_workload(shape_of(state), static_cast<unsigned>(state.range(1)));
+    }
+
+    std::unique_ptr<ast::Program> parse(const std::string &source)
+    {
+        Parser parser{Lexer::borrowed(source)};
+        return std::make_unique<ast::Program>(parser.parse());
+    }
+
+    std::unique_ptr<ast::Program> parse_and_check(const std::string &source, benchmark::State &state)
+    {
+        std::unique_ptr<ast::Program> program = parse(source);
+        TypeChecker checker(program.get());
+        if (!checker.check().ok)
+            state.SkipWithError("workload does not type check");
+        return program;
+    }
+
+    void workload_args(benchmark::internal::Benchmark *b)
+    {
+        b->ArgNames({"shape", "scale"});
+        for (int64_t shape = 0; shape < int64_t(std::size(ALL_WORKLOAD_SHAPES)); ++shape)
+        {
+            for (int64_t scale : {64, 1024})
+                b->Args({shape, scale});
+        }
+    }
+}
+
+static void BM_Lex(benchmark::State &state)
+{
+    const std::string source = source_for(state);
+    size_t tokens = 0;
+    for (auto _ : state)
+    {
+        Lexer lexer = Lexer::borrowed(source);
+        while (lexer.next_token().type != TokenType::Eof)
+            ++tokens;
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.counters["tokens"] = benchmark::Counter(static_cast<double>(tokens), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Lex)->Apply(workload_args);
+
+static void BM_Parse(benchmark::State &state)
+{
+    const std::string source = source_for(state);
+    size_t nodes = 0;
+    for (auto _ : state)
+    {
+        std::unique_ptr<ast::Program> program = parse(source);
+        nodes += program->arena->num_allocations();
+        benchmark::DoNotOptimize(program);
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.counters["nodes"] = benchmark::Counter(static_cast<double>(nodes), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Parse)->Apply(workload_args);
+
+static void BM_TypeCheck(benchmark::State &state)
+{
+    const std::string source = source_for(state);
+    size_t nodes = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::unique_ptr<ast::Program> program = parse(source);
+        state.ResumeTiming();
+
+        TypeChecker checker(program.get());
+        benchmark::DoNotOptimize(checker.check().ok);
+        nodes += program->arena->num_allocations();
+    }
+    state.counters["nodes"] = benchmark::Counter(static_cast<double>(nodes), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_TypeCheck)->Apply(workload_args);
+
+static void BM_IRGeneration(benchmark::State &state)
+{
+    const std::string source = source_for(state);
+    size_t instructions = 0;
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::unique_ptr<ast::Program> program = parse_and_check(source, state);
+        auto module = std::make_unique<Module>();
+        state.ResumeTiming();
+
+        IRGenerator generator(module.get());
+        generator.generate(*program);
+
+        state.PauseTiming();
+        for (Function *func : module->functions())
+        {
+            for (BasicBlock *bb : func->basic_blocks())
+            {
+                for (Instruction &inst : *bb)
+                {
+                    (void)inst;
+                    ++instructions;
+                }
+            }
+        }
+        // Freeing the module isn't part of lowering
+        module.reset();
+        state.ResumeTiming();
+    }
+    state.counters["instructions"] = benchmark::Counter(static_cast<double>(instructions), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_IRGeneration)->Apply(workload_args);
@@ -0,0 +1,49 @@
+// generate_workload.cc - Writes a synthetic workload as a .mo file
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "workload.h"
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || argc > 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " <shape> <scale> [output.mo]" << std::endl;
+        std::cerr << "Shapes:";
+        for (WorkloadShape shape : ALL_WORKLOAD_SHAPES)
+            std::cerr << " " << workload_shape_name(shape);
+        std::cerr << std::endl;
+        return 1;
+    }
+
+    auto shape = parse_workload_shape(argv[1]);
+    if (!shape)
+    {
+        std::cerr << "Error: Unknown shape " << argv[1] << std::endl;
+        return 1;
+    }
+    char *end = nullptr;
+    unsigned long scale = std::strtoul(argv[2], &end, 10);
+    if (end == argv[2] || *end)
+    {
+        std::cerr << "Error: Scale must be a number, got " << argv[2] << std::endl;
+        return 1;
+    }
+
+    const std::string source = generate_workload(*shape, static_cast<unsigned>(scale));
+    if (argc == 3)
+    {
+        std::cout << source;
+        return 0;
+    }
+    std::ofstream file(argv[3]);
+    if (!file.is_open())
+    {
+        std::cerr << "Error: Could not open file " << argv[3] << std::endl;
+        return 1;
+    }
+    file << source;
+    return 0;
+}
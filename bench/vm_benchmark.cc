@@ -0,0 +1,98 @@
+// vm_benchmark.cc - ASIMOV interpreter throughput in guest instructions per second
+#include "benchmark/benchmark.h"
+#include "src/targets/asimov_target.h"
+#include "src/vm/asimov_profile.h"
+#include "src/vm/asimov_vm.h"
+
+#include <memory>
+#include <vector>
+
+// The ASIMOV selector has no compare patterns, so Mo loops can't be compiled
+// down to the VM yet; these kernels are assembled by hand instead. Each
+// takes its trip count in R2. How many instructions a run retires is
+// counted once with a profile attached, then the timed runs go through the
+// uninstrumented loop.
+namespace ASIMOV
+{
+    namespace
+    {
+        uint32_t r_type(Opcode op, unsigned rd, unsigned rs1, unsigned rs2)
+        {
+            return (op << 24) | (rd << 16) | (rs1 << 8) | rs2;
+        }
+        uint32_t movw(unsigned rd, unsigned imm) { return (MOVW << 24) | (rd << 16) | (imm & 0xFFFF); }
+        uint32_t mem(Opcode op, unsigned rd, unsigned rs1, unsigned offset)
+        {
+            return (op << 24) | (rd << 16) | (rs1 << 8) | (offset & 0xFF);
+        }
+        uint32_t jnz(unsigned rs, unsigned target) { return (JNZ << 24) | (rs << 16) | (target & 0xFFFF); }
+        constexpr uint32_t HALT_WORD = 0xFFFFFFFF;
+
+        constexpr uint32_t DATA_BASE = 4096;
+        constexpr size_t MEMORY_SIZE = 1 << 20;
+
+        // R0 = R0 * 3 + i, register to register only
+        std::vector<uint32_t> arithmetic_kernel()
+        {
+            return {
+                movw(R0, 0),             // 0
+                movw(R3, 1),             // 4
+                movw(R4, 3),             // 8
+                r_type(MUL, R0, R0, R4), // 12: loop
+                r_type(ADD, R0, R0, R2), // 16
+                r_type(SUB, R2, R2, R3), // 20
+                jnz(R2, 12),             // 24
+                HALT_WORD,
+            };
+        }
+
+        // Sums R2 words from DATA_BASE, then stores the sum after them
+        std::vector<uint32_t> memory_kernel()
+        {
+            return {
+                movw(R0, 0),             // 0
+                movw(R1, DATA_BASE),     // 4
+                movw(R3, 1),             // 8
+                movw(R4, 4),             // 12
+                mem(LOAD, R6, R1, 0),    // 16: loop
+                r_type(ADD, R0, R0, R6), // 20
+                r_type(ADD, R1, R1, R4), // 24
+                r_type(SUB, R2, R2, R3), // 28
+                jnz(R2, 16),             // 32
+                mem(STORE, R0, R1, 0),   // 36
+                HALT_WORD,
+            };
+        }
+
+        void run_kernel(benchmark::State &state, std::vector<uint32_t> words)
+        {
+            const auto trips = static_cast<int32_t>(state.range(0));
+            auto program = std::make_shared<const ASIMOVProgram>(std::move(words), 0, MEMORY_SIZE);
+            ASIMOVVM vm(program);
+
+            ASIMOVTargetInstInfo tii;
+            ASIMOVProfile profile(tii);
+            vm.set_profile(&profile);
+            vm.set_register(R2, trips);
+            vm.run();
+            vm.set_profile(nullptr);
+            const uint64_t per_run = profile.instructions();
+
+            for (auto _ : state)
+            {
+                vm.set_register(R2, trips);
+                vm.run();
+                benchmark::DoNotOptimize(vm.registers()[R0]);
+            }
+            state.counters["instructions"] =
+                benchmark::Counter(static_cast<double>(per_run * state.iterations()), benchmark::Counter::kIsRate);
+        }
+    }
+
+    static void BM_VMArithmetic(benchmark::State &state) { run_kernel(state, arithmetic_kernel()); }
+    BENCHMARK(BM_VMArithmetic)->ArgName("trips")->Arg(1 << 10)->Arg(1 << 16);
+
+    static void BM_VMMemory(benchmark::State &state) { run_kernel(state, memory_kernel()); }
+    BENCHMARK(BM_VMMemory)->ArgName("trips")->Arg(1 << 10)->Arg(1 << 16);
+
+} // namespace ASIMOV
@@ -0,0 +1,137 @@
+// workload.cc - Synthetic Mo programs that scale one dimension at a time
+#include "workload.h"
+
+#include <string>
+
+namespace
+{
+    void append_line(std::string &out, unsigned depth, const std::string &text)
+    {
+        out.append(4 * depth, ' ');
+        out += text;
+        out += '\n';
+    }
+
+    // An if chain `depth` deep around an assignment whose right-hand side is
+    // parenthesized `depth` levels deep, then a loop to leave a back edge
+    std::string deep_nesting(unsigned depth)
+    {
+        static const char *const OPS[] = {" + ", " * ", " - "};
+        std::string expr = "v";
+        for (unsigned i = 0; i < depth; ++i)
+            expr = "(" + expr + OPS[i % 3] + std::to_string(i % 9 + 1) + ")";
+
+        std::string out = "fn nested(x: i32) -> i32 {\n";
+        append_line(out, 1, "let v: i32 = x;");
+        for (unsigned i = 0; i < depth; ++i)
+            append_line(out, i + 1, "if (v > " + std::to_string(i) + ")");
+        append_line(out, depth + 1, "v = " + expr + ";");
+        append_line(out, 1, "while ((v = v - 1) > 1000) v = v / 2;");
+        append_line(out, 1, "return v;");
+        out += "}\n";
+        out += "fn main() -> i32 { return nested(7); }\n";
+        return out;
+    }
+
+    // A call chain, so every function names a signature declared before it
+    std::string many_functions(unsigned count)
+    {
+        std::string out = "fn step0(a: i32, b: i32) -> i32 { return a + b; }\n";
+        for (unsigned i = 1; i < count; ++i)
+        {
+            const std::string n = std::to_string(i);
+            out += "fn step" + n + "(a: i32, b: i32) -> i32 {\n";
+            append_line(out, 1, "let t: i32 = a * " + std::to_string(i % 7 + 2) + " + b;");
+            append_line(out, 1, "if (t > " + n + ") t = t - b;");
+            append_line(out, 1, "return step" + std::to_string(i - 1) + "(t, a);");
+            out += "}\n";
+        }
+        out += "fn main() -> i32 { return step" + std::to_string(count == 0 ? 0 : count - 1) + "(1, 2); }\n";
+        return out;
+    }
+
+    // A literal setting every field, then a sum reading every field back
+    std::string huge_struct(unsigned fields)
+    {
+        if (fields == 0)
+            fields = 1;
+        std::string out = "struct Wide {";
+        for (unsigned i = 0; i < fields; ++i)
+            out += (i ? ", m" : " m") + std::to_string(i) + ": i32";
+        out += " }\n";
+
+        out += "fn fill(seed: i32) -> i32 {\n";
+        std::string literal = "let w: Wide = Wide {";
+        for (unsigned i = 0; i < fields; ++i)
+            literal += (i ? ", m" : " m") + std::to_string(i) + ": seed + " + std::to_string(i);
+        append_line(out, 1, literal + " };");
+        std::string sum = "return w.m0";
+        for (unsigned i = 1; i < fields; ++i)
+            sum += " + w.m" + std::to_string(i);
+        append_line(out, 1, sum + ";");
+        out += "}\n";
+        out += "fn main() -> i32 { return fill(1); }\n";
+        return out;
+    }
+
+    // Loops in a row over their own counters, all feeding one accumulator
+    std::string long_loops(unsigned loops)
+    {
+        std::string out = "fn loops(n: i32) -> i32 {\n";
+        append_line(out, 1, "let acc: i32 = 0;");
+        for (unsigned i = 0; i < loops; ++i)
+        {
+            const std::string counter = "k" + std::to_string(i);
+            append_line(out, 1, "let " + counter + ": i32 = 0;");
+            append_line(out, 1,
+                        "while ((" + counter + " = " + counter + " + 1) < n) acc = acc + " + counter + " * " +
+                            std::to_string(i % 5 + 1) + ";");
+        }
+        append_line(out, 1, "return acc;");
+        out += "}\n";
+        out += "fn main() -> i32 { return loops(100); }\n";
+        return out;
+    }
+}
+
+const char *workload_shape_name(WorkloadShape shape)
+{
+    switch (shape)
+    {
+    case WorkloadShape::DeepNesting:
+        return "deep-nesting";
+    case WorkloadShape::ManyFunctions:
+        return "many-functions";
+    case WorkloadShape::HugeStruct:
+        return "huge-struct";
+    case WorkloadShape::LongLoops:
+        return "long-loops";
+    }
+    return "<invalid>";
+}
+
+std::optional<WorkloadShape> parse_workload_shape(std::string_view name)
+{
+    for (WorkloadShape shape : ALL_WORKLOAD_SHAPES)
+    {
+        if (name == workload_shape_name(shape))
+            return shape;
+    }
+    return std::nullopt;
+}
+
+std::string generate_workload(WorkloadShape shape, unsigned scale)
+{
+    switch (shape)
+    {
+    case WorkloadShape::DeepNesting:
+        return deep_nesting(scale);
+    case WorkloadShape::ManyFunctions:
+        return many_functions(scale);
+    case WorkloadShape::HugeStruct:
+        return huge_struct(scale);
+    case WorkloadShape::LongLoops:
+        return long_loops(scale);
+    }
+    return "";
+}
@@ -0,0 +1,38 @@
+// workload.h - Synthetic Mo programs that scale one dimension at a time
+#pragma once
+
+#include <optional>
+#include <string>
+#include <string_view>
+
+//===----------------------------------------------------------------------===//
+//                             Workloads
+//===----------------------------------------------------------------------===//
+//
+// Each shape stresses one thing the compiler's cost grows with, and `scale`
+// sets how much of it there is. The output depends on nothing but the shape
+// and the scale, so a benchmark run on one commit measures exactly the input
+// a run on another commit did. Every program parses, type checks, lowers
+// to IR and, once its aggregate copies are lowered, selects and allocates
+// on RISC-V.
+
+enum class WorkloadShape
+{
+    DeepNesting,   // statements and expressions nested `scale` levels deep
+    ManyFunctions, // `scale` small functions, each calling the one before it
+    HugeStruct,    // one struct of `scale` fields, built and summed field by field
+    LongLoops,     // one function with `scale` loops in a row
+};
+
+constexpr WorkloadShape ALL_WORKLOAD_SHAPES[] = {
+    WorkloadShape::DeepNesting,
+    WorkloadShape::ManyFunctions,
+    WorkloadShape::HugeStruct,
+    WorkloadShape::LongLoops,
+};
+
+// "deep-nesting", "many-functions", "huge-struct" or "long-loops"
+const char *workload_shape_name(WorkloadShape shape);
+std::optional<WorkloadShape> parse_workload_shape(std::string_view name);
+
+std::string generate_workload(WorkloadShape shape, unsigned scale);
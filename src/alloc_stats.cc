@@ -0,0 +1,31 @@
+// alloc_stats.cc -- Replaces global operator new/delete to feed the phase report
+//
+// Linked only into binaries that want allocation numbers in PhaseStats, since
+// it takes over the global allocator for the whole process. The array and
+// nothrow forms of operator new forward here by default; aligned allocations
+// are not counted.
+
+#include <cstdlib>
+#include <new>
+
+#include "phase_stats.h"
+
+void *operator new(std::size_t size)
+{
+    note_allocation(size);
+    if (void *ptr = std::malloc(size ? size : 1))
+    {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    std::free(ptr);
+}
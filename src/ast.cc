@@ -6,6 +6,34 @@
 #include <algorithm>
 
 using namespace ast;
+//===----------------------------------------------------------------------===//
+//                              Program Implementation
+//===----------------------------------------------------------------------===//
+
+Program &Program::operator=(Program &&other) noexcept
+{
+    if (this == &other)
+        return *this;
+    // Reverse declaration order, so nothing outlives what it points into
+    globals.clear();
+    functions.clear();
+    impl_blocks.clear();
+    structs.clear();
+    aliases.clear();
+    types.reset();
+    arena.reset();
+
+    arena = std::move(other.arena);
+    types = std::move(other.types);
+    symbols = std::move(other.symbols);
+    aliases = std::move(other.aliases);
+    structs = std::move(other.structs);
+    impl_blocks = std::move(other.impl_blocks);
+    functions = std::move(other.functions);
+    globals = std::move(other.globals);
+    return *this;
+}
+
 //===----------------------------------------------------------------------===//
 //                         StructLiteralExpr Implementation
 //===----------------------------------------------------------------------===//
@@ -36,6 +64,7 @@ void VarDeclStmt::swap(VarDeclStmt &a, VarDeclStmt &b) noexcept
     using std::swap;
     swap(a.is_const, b.is_const);
     swap(a.name, b.name);
+    swap(a.symbol, b.symbol);
     swap(a.type, b.type);
     swap(a.init_expr, b.init_expr);
 }
@@ -49,6 +78,7 @@ VarDeclStmt &VarDeclStmt::operator=(VarDeclStmt other) noexcept
 VarDeclStmt::VarDeclStmt(VarDeclStmt &&other) noexcept
     : is_const(std::move(other.is_const)),
       name(std::move(other.name)),
+      symbol(other.symbol),
       type(std::move(other.type)),
       init_expr(std::move(other.init_expr)) {}
 
@@ -116,7 +146,7 @@ Type *StructDecl::type() const
 //                          FunctionDecl Implementation
 //===----------------------------------------------------------------------===//
 
-void FunctionDecl::add_param(const std::string &name, std::unique_ptr<Type> type)
+void FunctionDecl::add_param(const std::string &name, TypePtr type)
 {
     params.emplace_back(name, std::move(type));
 }
@@ -9,7 +9,9 @@
 #include <utility>
 
 #include "lexer.h"
+#include "ast_arena.h"
 #include "ast_type.h"
+#include "ast_type_context.h"
 
 namespace ast
 {
@@ -26,21 +28,36 @@ namespace ast
     struct TypedField;
 
     using ExprPtr = std::unique_ptr<Expr>;
-    using TypePtr = std::unique_ptr<Type>;
     using StmtPtr = std::unique_ptr<Statement>;
 
     // Program Structure
     struct Program
     {
+        // Backs every node the parser creates for this program. Declared first so
+        // that it is destroyed after all nodes referring to it.
+        std::unique_ptr<Arena> arena;
+        // Canonical types the type checker shares between nodes; created on first
+        // check and, like the arena, outlives every node.
+        std::unique_ptr<TypeContext> types;
+        // Names the lexer interned; the `symbol` of an identifier node indexes
+        // it, so scopes can key on the id instead of hashing the name again
+        std::unique_ptr<SymbolTable> symbols;
+
         std::vector<std::unique_ptr<TypeAliasDecl>> aliases;
         std::vector<std::unique_ptr<StructDecl>> structs;
         std::vector<std::unique_ptr<ImplBlock>> impl_blocks;
         std::vector<std::unique_ptr<FunctionDecl>> functions;
         std::vector<std::unique_ptr<GlobalDecl>> globals;
+
+        Program() = default;
+        Program(Program &&) noexcept = default;
+        // Frees the nodes this program holds before the arena and types they
+        // refer to, as destruction does
+        Program &operator=(Program &&other) noexcept;
     };
 
     // Expressions
-    struct Expr
+    struct Expr : ArenaNode
     {
         enum class Category
         {
@@ -63,7 +80,9 @@ namespace ast
     struct VariableExpr : Expr
     {
         std::string identifier;
-        explicit VariableExpr(std::string name) : identifier(std::move(name)) {}
+        Symbol symbol = NO_SYMBOL; // `identifier` in the program's symbol table
+        explicit VariableExpr(std::string name, Symbol symbol = NO_SYMBOL)
+            : identifier(std::move(name)), symbol(symbol) {}
         std::string name() const override { return "VariableExpr"; }
     };
 
@@ -324,7 +343,7 @@ namespace ast
         std::string name() const override { return "FunctionPointerExpr"; }
     };
     // Statements
-    struct Statement
+    struct Statement : ArenaNode
     {
         virtual ~Statement() = default;
     };
@@ -348,6 +367,7 @@ namespace ast
     {
         bool is_const;
         std::string name;
+        Symbol symbol = NO_SYMBOL; // `name` in the program's symbol table
         TypePtr type;
         ExprPtr init_expr;
 
@@ -428,7 +448,7 @@ namespace ast
         Type* type() const;
     };
 
-    struct FunctionDecl
+    struct FunctionDecl : ArenaNode
     {
         std::string name;
         TypePtr return_type = nullptr;
@@ -462,7 +482,7 @@ namespace ast
               is_static(is_static) {}
     };
 
-    struct ImplBlock
+    struct ImplBlock : ArenaNode
     {
         TypePtr target_type;
         std::vector<std::unique_ptr<FunctionDecl>> methods;
@@ -476,7 +496,7 @@ namespace ast
         GlobalDecl(VarDeclStmt &&varDeclStmt, bool exported = false);
     };
 
-    struct TypeAliasDecl
+    struct TypeAliasDecl : ArenaNode
     {
         std::string name;
         TypePtr type;
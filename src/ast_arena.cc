@@ -0,0 +1,96 @@
+//===----------------------------------------------------------------------===//
+//                             Headers and Namespaces
+//===----------------------------------------------------------------------===//
+
+#include "ast_arena.h"
+#include <algorithm>
+#include <new>
+
+#include "mo_debug.h"
+
+using namespace ast;
+
+//===----------------------------------------------------------------------===//
+//                             Arena Implementation
+//===----------------------------------------------------------------------===//
+
+void *Arena::allocate(size_t size, size_t alignment)
+{
+    MO_ASSERT((alignment & (alignment - 1)) == 0, "Alignment %zu is not a power of two", alignment);
+
+    auto aligned = [&](std::byte *p)
+    {
+        auto addr = reinterpret_cast<uintptr_t>(p);
+        return reinterpret_cast<std::byte *>((addr + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    };
+
+    std::byte *start = cursor_ ? aligned(cursor_) : nullptr;
+    if (!start || start + size > end_)
+    {
+        // Oversized requests get a dedicated chunk so the regular chunk size stays small
+        size_t chunk = std::max(chunk_size_, size + alignment);
+        chunks_.push_back(std::make_unique<std::byte[]>(chunk));
+        cursor_ = chunks_.back().get();
+        end_ = cursor_ + chunk;
+        start = aligned(cursor_);
+    }
+
+    cursor_ = start + size;
+    bytes_allocated_ += size;
+    num_allocations_++;
+    return start;
+}
+
+//===----------------------------------------------------------------------===//
+//                             ArenaScope Implementation
+//===----------------------------------------------------------------------===//
+
+static thread_local Arena *current_arena = nullptr;
+
+ArenaScope::ArenaScope(Arena *arena) : previous_(current_arena)
+{
+    current_arena = arena;
+}
+
+ArenaScope::~ArenaScope()
+{
+    current_arena = previous_;
+}
+
+Arena *ArenaScope::current()
+{
+    return current_arena;
+}
+
+//===----------------------------------------------------------------------===//
+//                             ArenaNode Implementation
+//===----------------------------------------------------------------------===//
+
+// Every node is prefixed with a header recording where it came from, so that
+// delete knows whether to hand the memory back to the heap.
+namespace
+{
+    struct alignas(std::max_align_t) NodeHeader
+    {
+        bool in_arena;
+    };
+}
+
+void *ArenaNode::operator new(size_t size)
+{
+    const size_t total = sizeof(NodeHeader) + size;
+    void *raw = current_arena ? current_arena->allocate(total) : ::operator new(total);
+    auto *header = new (raw) NodeHeader{current_arena != nullptr};
+    return header + 1;
+}
+
+void ArenaNode::operator delete(void *ptr, size_t size) noexcept
+{
+    if (!ptr)
+        return;
+    auto *header = static_cast<NodeHeader *>(ptr) - 1;
+    if (!header->in_arena)
+    {
+        ::operator delete(header, sizeof(NodeHeader) + size);
+    }
+}
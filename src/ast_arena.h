@@ -0,0 +1,71 @@
+// ast_arena.h - Bump allocator backing AST nodes
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ast
+{
+    //===----------------------------------------------------------------------===//
+    //                             Arena
+    //===----------------------------------------------------------------------===//
+
+    // Chunked bump allocator. Individual deallocations are no-ops; all memory is
+    // released at once when the arena is destroyed.
+    class Arena
+    {
+    public:
+        static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+        explicit Arena(size_t chunk_size = DEFAULT_CHUNK_SIZE) : chunk_size_(chunk_size) {}
+        Arena(const Arena &) = delete;
+        Arena &operator=(const Arena &) = delete;
+
+        void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+        size_t bytes_allocated() const { return bytes_allocated_; }
+        size_t num_allocations() const { return num_allocations_; }
+        size_t num_chunks() const { return chunks_.size(); }
+
+    private:
+        size_t chunk_size_;
+        std::vector<std::unique_ptr<std::byte[]>> chunks_;
+        std::byte *cursor_ = nullptr;
+        std::byte *end_ = nullptr;
+        size_t bytes_allocated_ = 0;
+        size_t num_allocations_ = 0;
+    };
+
+    // Makes `arena` the allocation target for AST nodes created on this thread
+    // while the scope is alive. Scopes nest; the previous arena is restored on exit.
+    class ArenaScope
+    {
+    public:
+        explicit ArenaScope(Arena *arena);
+        ~ArenaScope();
+        ArenaScope(const ArenaScope &) = delete;
+        ArenaScope &operator=(const ArenaScope &) = delete;
+
+        static Arena *current();
+
+    private:
+        Arena *previous_;
+    };
+
+    //===----------------------------------------------------------------------===//
+    //                             ArenaNode
+    //===----------------------------------------------------------------------===//
+
+    // Base for AST node classes. `new` places the node in the current arena when
+    // one is active and falls back to the global heap otherwise, so nodes can still
+    // be owned by std::unique_ptr either way: deleting an arena node only runs its
+    // destructor and leaves the memory to the arena.
+    struct ArenaNode
+    {
+        static void *operator new(size_t size);
+        static void operator delete(void *ptr, size_t size) noexcept;
+    };
+
+}
@@ -135,7 +135,7 @@ std::string ASTPrinter::print(const Type& type) {
 
     if (const IntegerType* i = type.as_integer()) {
         auto bw = i->bit_width();
-        return "i" + std::to_string(bw);
+        return (i->is_unsigned() ? "u" : "i") + std::to_string(bw);
     }
     if (const FloatType* f = type.as_float()) {
         auto bw = static_cast<uint8_t>(f->bit_width());
@@ -6,14 +6,25 @@
 
 #include "ast_printer_yaml.h"
 #include "parser.h"
+#include "phase_stats.h"
 
 using namespace ast;
 
 int main(int argc, char *argv[])
 {
+    // --time-report[=json] may come first; it prints the phase report to stderr
+    std::string time_report;
+    if (argc > 1 && std::string(argv[1]).rfind("--time-report", 0) == 0)
+    {
+        time_report = argv[1];
+        argv++;
+        argc--;
+        PhaseStats::global().set_enabled(true);
+    }
+
     if (argc < 3)
     {
-        std::cerr << "Usage: " << argv[0] << " --program|--expr <filename|source_code>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [--time-report[=json]] --program|--expr <filename|source_code>" << std::endl;
         return 1;
     }
 
@@ -97,12 +108,22 @@ int main(int argc, char *argv[])
     ASTPrinter printer;
     if (program)
     {
-        std::cout << printer.print(*program) << std::endl;
+        printer.print(*program, std::cout);
+        std::cout << std::endl;
     }
     else if (expr)
     {
         std::cout << printer.print(*expr) << std::endl;
     }
 
+    if (time_report == "--time-report=json")
+    {
+        PhaseStats::global().export_to_json(std::cerr);
+    }
+    else if (!time_report.empty())
+    {
+        PhaseStats::global().print_table(std::cerr);
+    }
+
     return 0;
 }
@@ -1,76 +1,95 @@
 #include "ast_printer_yaml.h"
 #include <sstream>
-#include <iomanip>
-#include <cassert>
 
 using namespace std;
 using namespace ast;
 
-string ASTPrinter::escape_string(const string &str) const
+namespace
 {
-    ostringstream oss;
-    for (char c : str)
+    // Streams as the string with JSON escapes, so names print on one line
+    struct Escaped
     {
-        switch (c)
-        {
-        case '"':
-            oss << "\\\"";
-            break;
-        case '\\':
-            oss << "\\\\";
-            break;
-        case '\b':
-            oss << "\\b";
-            break;
-        case '\f':
-            oss << "\\f";
-            break;
-        case '\n':
-            oss << "\\n";
-            break;
-        case '\r':
-            oss << "\\r";
-            break;
-        case '\t':
-            oss << "\\t";
-            break;
-        default:
-            if (c >= 0x00 && c <= 0x1f)
-            {
-                oss << "\\u" << hex << setw(4) << setfill('0') << static_cast<int>(c);
-            }
-            else
-            {
-                oss << c;
-            }
-        }
+        const string &text;
+    };
+
+    OutputBuffer &operator<<(OutputBuffer &out, Escaped escaped)
+    {
+        out.write_json_escaped(escaped.text);
+        return out;
     }
-    return oss.str();
 }
 
-string ASTPrinter::indent() const
+OutputBuffer &ASTPrinter::line()
 {
-    return string(current_level * indent_size, ' ');
+    out_->spaces(current_level * indent_size);
+    return *out_;
 }
 
 void ASTPrinter::enter_scope() { current_level++; }
 void ASTPrinter::leave_scope() { current_level--; }
 
-string ASTPrinter::print(const Program &program)
+string_view ASTPrinter::token_name(TokenType type)
+{
+    auto [it, inserted] = token_names_.try_emplace(type);
+    if (inserted)
+        it->second = token_type_to_string(type);
+    return it->second;
+}
+
+//===----------------------------------------------------------------------===//
+//                             Entry Points
+//===----------------------------------------------------------------------===//
+
+void ASTPrinter::print(const Program &program, ostream &os)
+{
+    OutputBuffer out(os);
+    out_ = &out;
+    emit(program);
+    out_ = nullptr;
+}
+
+template <typename Node>
+string ASTPrinter::collect(const Node &node)
 {
     ostringstream oss;
-    oss << "program:\n";
+    {
+        OutputBuffer out(oss);
+        OutputBuffer *outer = out_;
+        out_ = &out;
+        emit(node);
+        out_ = outer;
+    }
+    return oss.str();
+}
+
+string ASTPrinter::print(const Program &program) { return collect(program); }
+string ASTPrinter::print(const Expr &expr) { return collect(expr); }
+string ASTPrinter::print(const Statement &stmt) { return collect(stmt); }
+string ASTPrinter::print(const TypeAliasDecl &type_alias_decl) { return collect(type_alias_decl); }
+string ASTPrinter::print(const StructDecl &struct_decl) { return collect(struct_decl); }
+string ASTPrinter::print(const FunctionDecl &func_decl) { return collect(func_decl); }
+string ASTPrinter::print(const ImplBlock &impl_block) { return collect(impl_block); }
+string ASTPrinter::print(const VarDeclStmt &var_decl) { return collect(var_decl); }
+string ASTPrinter::print(const GlobalDecl &global_decl) { return collect(global_decl); }
+
+//===----------------------------------------------------------------------===//
+//                             Visitors
+//===----------------------------------------------------------------------===//
+
+void ASTPrinter::emit(const Program &program)
+{
+    out() << "program:\n";
     enter_scope();
 
     if (!program.structs.empty())
     {
-        oss << indent() << "structs:\n";
+        line() << "structs:\n";
         enter_scope();
         for (const auto &s : program.structs)
         {
-            oss << indent() << "- \n";
+            line() << "- \n";
             enter_scope();
-            oss << print(*s);
+            emit(*s);
             leave_scope();
         }
         leave_scope();
@@ -78,13 +97,13 @@ string ASTPrinter::print(const Program &program)
 
     if (!program.impl_blocks.empty())
     {
-        oss << indent() << "impl_blocks:\n";
+        line() << "impl_blocks:\n";
         enter_scope();
         for (const auto &i : program.impl_blocks)
         {
-            oss << indent() << "- \n";
+            line() << "- \n";
             enter_scope();
-            oss << print(*i);
+            emit(*i);
             leave_scope();
         }
         leave_scope();
@@ -92,13 +111,13 @@ string ASTPrinter::print(const Program &program)
 
     if (!program.functions.empty())
     {
-        oss << indent() << "functions:\n";
+        line() << "functions:\n";
         enter_scope();
         for (const auto &f : program.functions)
         {
-            oss << indent() << "- \n";
+            line() << "- \n";
             enter_scope();
-            oss << print(*f);
+            emit(*f);
             leave_scope();
         }
         leave_scope();
@@ -106,89 +125,88 @@ string ASTPrinter::print(const Program &program)
 
     if (!program.globals.empty())
     {
-        oss << indent() << "globals:\n";
+        line() << "globals:\n";
         enter_scope();
         for (const auto &g : program.globals)
         {
-            oss << indent() << "- \n";
+            line() << "- \n";
             enter_scope();
-            oss << print(*g);
+            emit(*g);
             leave_scope();
         }
         leave_scope();
     }
 
     leave_scope();
-    return oss.str();
 }
 
-std::string ASTPrinter::print_type(const Type &type)
+void ASTPrinter::emit_type(const Type &type)
 {
-    std::ostringstream oss;
     enter_scope();
-    oss << "\n";
-    oss << indent() << "kind: ";
+    out() << "\n";
+    line() << "kind: ";
     switch (type.kind())
     {
     case Type::Kind::Placeholder:
-        oss << "Placeholder";
+        out() << "Placeholder";
         break;
     case Type::Kind::Void:
-        oss << "Void";
+        out() << "Void";
         break;
     case Type::Kind::Int:
     {
         auto &int_type = static_cast<const IntegerType &>(type);
-        oss << "Int\n";
-        oss << indent() << "bit_width: " << int_type.bit_width();
+        out() << "Int\n";
+        line() << "bit_width: " << int_type.bit_width();
         break;
     }
     case Type::Kind::Float:
     {
         auto &float_type = static_cast<const FloatType &>(type);
-        oss << "Float\n";
-        oss << indent() << "bit_width: ";
-        oss << float_type.bit_width();
+        out() << "Float\n";
+        line() << "bit_width: ";
+        out() << float_type.bit_width();
         break;
     }
     case Type::Kind::Bool:
-        oss << "Bool";
+        out() << "Bool";
         break;
     case Type::Kind::String:
-        oss << "String";
+        out() << "String";
         break;
     case Type::Kind::Pointer:
     {
         auto &pointer_type = static_cast<const PointerType &>(type);
-        oss << "Pointer\n";
-        oss << indent() << "pointee:";
+        out() << "Pointer\n";
+        line() << "pointee:";
         enter_scope();
-        oss << print_type(pointer_type.pointee());
+        emit_type(pointer_type.pointee());
         leave_scope();
         break;
     }
     case Type::Kind::Array:
     {
         auto &array_type = static_cast<const ArrayType &>(type);
-        oss << "Array\n";
-        oss << indent() << "element_type:";
+        out() << "Array\n";
+        line() << "element_type:";
         enter_scope();
-        oss << print_type(array_type.element_type()) << "\n";
+        emit_type(array_type.element_type());
+        out() << "\n";
         leave_scope();
-        oss << indent() << "size: " << array_type.size();
+        line() << "size: " << array_type.size();
         break;
     }
     case Type::Kind::Tuple:
     {
         auto &tuple_type = static_cast<const TupleType &>(type);
-        oss << "Tuple\n";
-        oss << indent() << "element_types:\n";
+        out() << "Tuple\n";
+        line() << "element_types:\n";
         enter_scope();
         for (const auto &t : tuple_type.element_types())
         {
-            oss << indent() << "- \n";
+            line() << "- \n";
             enter_scope();
-            oss << print_type(*t);
+            emit_type(*t);
             leave_scope();
         }
         break;
@@ -196,351 +214,340 @@ std::string ASTPrinter::print_type(const Type &type)
     case Type::Kind::Function:
     {
         auto &function_type = static_cast<const FunctionType &>(type);
-        oss << "Function\n";
-        oss << indent() << "params:";
+        out() << "Function\n";
+        line() << "params:";
         enter_scope();
         for (const auto &p : function_type.params())
         {
-            oss << indent() << "- \n";
+            line() << "- \n";
             enter_scope();
-            oss << print_type(*p);
+            emit_type(*p);
             leave_scope();
         }
         leave_scope();
-        oss << indent() << "return_type:";
+        line() << "return_type:";
         enter_scope();
-        oss << print_type(function_type.return_type());
+        emit_type(function_type.return_type());
         leave_scope();
         break;
     }
     case Type::Kind::Struct:
     {
         auto &struct_type = static_cast<const StructType &>(type);
-        oss << "Struct\n";
-        oss << indent() << "name: \"" << escape_string(struct_type.name()) << "\"";
+        out() << "Struct\n";
+        line() << "name: \"" << Escaped{struct_type.name()} << "\"";
         break;
     }
     case Type::Kind::Alias:
     {
         auto &alias_type = static_cast<const AliasType &>(type);
-        oss << "Alias\n";
-        oss << indent() << "name: \"" << escape_string(alias_type.name()) << "\"";
+        out() << "Alias\n";
+        line() << "name: \"" << Escaped{alias_type.name()} << "\"";
         break;
     }
     case Type::Kind::Qualified:
     {
         auto &qualified_type = static_cast<const QualifiedType &>(type);
-        oss << "Qualified\n";
-        oss << indent() << "qualifiers: ";
+        out() << "Qualified\n";
+        line() << "qualifiers: ";
         if ((qualified_type.qualifiers() & Qualifier::Const) != Qualifier(0))
-            oss << "Const ";
+            out() << "Const ";
         if ((qualified_type.qualifiers() & Qualifier::Volatile) != Qualifier(0))
-            oss << "Volatile ";
+            out() << "Volatile ";
         if ((qualified_type.qualifiers() & Qualifier::Restrict) != Qualifier(0))
-            oss << "Restrict ";
-        oss << "\n";
-        oss << indent() << "base_type:";
+            out() << "Restrict ";
+        out() << "\n";
+        line() << "base_type:";
         enter_scope();
-        oss << print_type(qualified_type.base_type());
+        emit_type(qualified_type.base_type());
         leave_scope();
         break;
     }
     }
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const Expr &expr)
+void ASTPrinter::emit(const Expr &expr)
 {
     if (auto e = dynamic_cast<const VariableExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const IntegerLiteralExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
         if (auto e = dynamic_cast<const BooleanLiteralExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const FloatLiteralExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const StringLiteralExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const BinaryExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const UnaryExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const CallExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const MemberAccessExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const ArrayAccessExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const CastExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const SizeofExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const InitListExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const FunctionPointerExpr *>(&expr))
-        return print(*e);
+        return emit(*e);
     if (auto e = dynamic_cast<const StructLiteralExpr *>(&expr))
-        return print(*e);
-    return indent() + "unknown_expr\n";
+        return emit(*e);
+    line() << "unknown_expr\n";
 }
 
-string ASTPrinter::print(const VariableExpr &expr)
+void ASTPrinter::emit(const VariableExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "variable_expr:\n";
+    line() << "variable_expr:\n";
     enter_scope();
-    oss << indent() << "name: \"" << escape_string(expr.identifier) << "\"\n";
+    line() << "name: \"" << Escaped{expr.identifier} << "\"\n";
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const BinaryExpr &expr)
+void ASTPrinter::emit(const BinaryExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "binary_expr:\n";
+    line() << "binary_expr:\n";
     enter_scope();
-    oss << indent() << "operator: " << token_type_to_string(expr.op) << "\n";
-    oss << indent() << "left:\n";
+    line() << "operator: " << token_name(expr.op) << "\n";
+    line() << "left:\n";
     enter_scope();
-    oss << print(*expr.left);
+    emit(*expr.left);
     leave_scope();
-    oss << indent() << "right:\n";
+    line() << "right:\n";
     enter_scope();
-    oss << print(*expr.right);
+    emit(*expr.right);
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const CallExpr &expr)
+void ASTPrinter::emit(const CallExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "call_expr:\n";
+    line() << "call_expr:\n";
     enter_scope();
-    oss << indent() << "callee:\n";
+    line() << "callee:\n";
     enter_scope();
-    oss << print(*expr.callee);
+    emit(*expr.callee);
     leave_scope();
-    oss << indent() << "arguments:\n";
+    line() << "arguments:\n";
     enter_scope();
     for (const auto &arg : expr.args)
     {
-        oss << print(*arg);
+        emit(*arg);
     }
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const MemberAccessExpr &expr)
+void ASTPrinter::emit(const MemberAccessExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "member_access_expr:\n";
+    line() << "member_access_expr:\n";
     enter_scope();
-    oss << indent() << "object:\n";
+    line() << "object:\n";
     enter_scope();
-    oss << print(*expr.object);
+    emit(*expr.object);
     leave_scope();
-    oss << indent() << "member: \"" << escape_string(expr.member) << "\"\n";
-    oss << indent() << "accessor: " << token_type_to_string(expr.accessor) << "\n";
+    line() << "member: \"" << Escaped{expr.member} << "\"\n";
+    line() << "accessor: " << token_name(expr.accessor) << "\n";
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const ArrayAccessExpr &expr)
+void ASTPrinter::emit(const ArrayAccessExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "array_access_expr:\n";
+    line() << "array_access_expr:\n";
     enter_scope();
-    oss << indent() << "array:\n";
+    line() << "array:\n";
     enter_scope();
-    oss << print(*expr.array);
+    emit(*expr.array);
     leave_scope();
-    oss << indent() << "index:\n";
+    line() << "index:\n";
     enter_scope();
-    oss << print(*expr.index);
+    emit(*expr.index);
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const TypeAliasDecl &type_alias_decl)
+void ASTPrinter::emit(const TypeAliasDecl &type_alias_decl)
 {
-    ostringstream oss;
-    oss << indent() << "type_alias_decl:\n";
+    line() << "type_alias_decl:\n";
     enter_scope();
-    oss << indent() << "name: \"" << escape_string(type_alias_decl.name) << "\"\n";
-    oss << indent() << "type: " << print_type(*type_alias_decl.type) << "\n";
+    line() << "name: \"" << Escaped{type_alias_decl.name} << "\"\n";
+    line() << "type: ";
+    emit_type(*type_alias_decl.type);
+    out() << "\n";
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const StructDecl &struct_decl)
+void ASTPrinter::emit(const StructDecl &struct_decl)
 {
-    ostringstream oss;
-    oss << indent() << "struct_decl:\n";
+    line() << "struct_decl:\n";
     enter_scope();
-    oss << indent() << "name: \"" << escape_string(struct_decl.name) << "\"\n";
-    oss << indent() << "fields:\n";
+    line() << "name: \"" << Escaped{struct_decl.name} << "\"\n";
+    line() << "fields:\n";
     enter_scope();
     for (const auto &field : struct_decl.fields)
     {
-        oss << indent() << "- field:\n";
+        line() << "- field:\n";
         enter_scope();
-        oss << indent() << "name: \"" << escape_string(field.name) << "\"\n";
-        oss << indent() << "type: " << print_type(*field.type) << "\n";
+        line() << "name: \"" << Escaped{field.name} << "\"\n";
+        line() << "type: ";
+        emit_type(*field.type);
+        out() << "\n";
         leave_scope();
     }
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const FunctionDecl &func_decl)
+void ASTPrinter::emit(const FunctionDecl &func_decl)
 {
-    ostringstream oss;
-    oss << indent() << "function_decl:\n";
+    line() << "function_decl:\n";
     enter_scope();
-    oss << indent() << "name: \"" << escape_string(func_decl.name) << "\"\n";
-    oss << indent() << "return_type: " << print_type(*func_decl.return_type) << "\n";
+    line() << "name: \"" << Escaped{func_decl.name} << "\"\n";
+    line() << "return_type: ";
+    emit_type(*func_decl.return_type);
+    out() << "\n";
 
-    oss << indent() << "parameters:\n";
+    line() << "parameters:\n";
     enter_scope();
     for (const auto &param : func_decl.params)
     {
-        oss << indent() << "- parameter:\n";
+        line() << "- parameter:\n";
         enter_scope();
-        oss << indent() << "name: \"" << escape_string(param.name) << "\"\n";
-        oss << indent() << "type: " << print_type(*param.type) << "\n";
+        line() << "name: \"" << Escaped{param.name} << "\"\n";
+        line() << "type: ";
+        emit_type(*param.type);
+        out() << "\n";
         leave_scope();
     }
     leave_scope();
 
     if (func_decl.is_method)
     {
-        oss << indent() << "receiver_type: " << print_type(*func_decl.receiver_type) << "\n";
+        line() << "receiver_type: ";
+        emit_type(*func_decl.receiver_type);
+        out() << "\n";
     }
 
-    oss << indent() << "body:\n";
+    line() << "body:\n";
     enter_scope();
     for (const auto &stmt : func_decl.body)
     {
-        oss << print(*stmt);
+        emit(*stmt);
     }
     leave_scope();
 
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const ImplBlock &impl_block)
+void ASTPrinter::emit(const ImplBlock &impl_block)
 {
-    ostringstream oss;
-    oss << indent() << "impl_block:\n";
+    line() << "impl_block:\n";
     enter_scope();
-    oss << indent() << "target_type: " << print_type(*impl_block.target_type) << "\n";
-    oss << indent() << "methods:\n";
+    line() << "target_type: ";
+    emit_type(*impl_block.target_type);
+    out() << "\n";
+    line() << "methods:\n";
     enter_scope();
     for (const auto &method : impl_block.methods)
     {
-        oss << indent() << "- \n";
+        line() << "- \n";
         enter_scope();
-        oss << print(*method);
+        emit(*method);
         leave_scope();
     }
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const VarDeclStmt &stmt)
+void ASTPrinter::emit(const VarDeclStmt &stmt)
 {
-    ostringstream oss;
-    oss << indent() << "var_decl:\n";
+    line() << "var_decl:\n";
     enter_scope();
-    oss << indent() << "name: \"" << escape_string(stmt.name) << "\"\n";
-    oss << indent() << "type: " << print_type(*stmt.type) << "\n";
-    oss << indent() << "is_const: " << (stmt.is_const ? "true" : "false") << "\n";
+    line() << "name: \"" << Escaped{stmt.name} << "\"\n";
+    line() << "type: ";
+    emit_type(*stmt.type);
+    out() << "\n";
+    line() << "is_const: " << (stmt.is_const ? "true" : "false") << "\n";
     if (stmt.init_expr)
     {
-        oss << indent() << "initializer:\n";
+        line() << "initializer:\n";
         enter_scope();
-        oss << print(*stmt.init_expr);
+        emit(*stmt.init_expr);
         leave_scope();
     }
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const IntegerLiteralExpr &expr)
+void ASTPrinter::emit(const GlobalDecl &global_decl)
 {
-    ostringstream oss;
-    oss << indent() << "integer_literal:\n";
+    emit(static_cast<const VarDeclStmt &>(global_decl));
+}
+
+void ASTPrinter::emit(const IntegerLiteralExpr &expr)
+{
+    line() << "integer_literal:\n";
     enter_scope();
-    oss << indent() << "value: " << expr.value << "\n";
+    line() << "value: " << expr.value << "\n";
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const BooleanLiteralExpr &expr)
+void ASTPrinter::emit(const BooleanLiteralExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "boolean_literal:\n";
+    line() << "boolean_literal:\n";
     enter_scope();
-    oss << indent() << "value: " << (expr.value ? "true" : "false") << "\n";
+    line() << "value: " << (expr.value ? "true" : "false") << "\n";
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const FloatLiteralExpr &expr)
+void ASTPrinter::emit(const FloatLiteralExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "float_literal:\n";
+    line() << "float_literal:\n";
     enter_scope();
-    oss << indent() << "value: " << expr.value << "\n";
+    line() << "value: " << expr.value << "\n";
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const StringLiteralExpr &expr)
+void ASTPrinter::emit(const StringLiteralExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "string_literal:\n";
+    line() << "string_literal:\n";
     enter_scope();
-    oss << indent() << "value: \"" << escape_string(expr.value) << "\"\n";
+    line() << "value: \"" << Escaped{expr.value} << "\"\n";
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const UnaryExpr &expr)
+void ASTPrinter::emit(const UnaryExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "unary_expr:\n";
+    line() << "unary_expr:\n";
     enter_scope();
-    oss << indent() << "operator: " << token_type_to_string(expr.op) << "\n";
-    oss << indent() << "operand:\n";
+    line() << "operator: " << token_name(expr.op) << "\n";
+    line() << "operand:\n";
     enter_scope();
-    oss << print(*expr.operand);
+    emit(*expr.operand);
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const SizeofExpr &expr)
+void ASTPrinter::emit(const SizeofExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "sizeof_expr:\n";
+    line() << "sizeof_expr:\n";
     enter_scope();
     if (expr.kind == SizeofExpr::Kind::Type)
     {
-        oss << indent() << "target_type: " << print_type(*expr.target_type) << "\n";
+        line() << "target_type: ";
+        emit_type(*expr.target_type);
+        out() << "\n";
     }
     else if (expr.kind == SizeofExpr::Kind::Expr)
     {
-        oss << indent() << "target_expr:\n";
+        line() << "target_expr:\n";
         enter_scope();
-        oss << print(*expr.target_expr);
+        emit(*expr.target_expr);
         leave_scope();
     }
     else
@@ -548,227 +555,208 @@ string ASTPrinter::print(const SizeofExpr &expr)
         unreachable();
     }
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const AddressOfExpr &expr)
+void ASTPrinter::emit(const AddressOfExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "address_of:\n";
+    line() << "address_of:\n";
     enter_scope();
-    oss << indent() << "operand:\n";
+    line() << "operand:\n";
     enter_scope();
-    oss << print(*expr.operand);
+    emit(*expr.operand);
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const DerefExpr &expr)
+void ASTPrinter::emit(const DerefExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "deref_expr:\n";
+    line() << "deref_expr:\n";
     enter_scope();
-    oss << indent() << "operand:\n";
+    line() << "operand:\n";
     enter_scope();
-    oss << print(*expr.operand);
+    emit(*expr.operand);
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const StructLiteralExpr &expr)
+void ASTPrinter::emit(const StructLiteralExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "struct_literal:\n";
+    line() << "struct_literal:\n";
     enter_scope();
     if (!expr.struct_name.empty())
     {
-        oss << indent() << "struct_name: \"" << escape_string(expr.struct_name) << "\"\n";
+        line() << "struct_name: \"" << Escaped{expr.struct_name} << "\"\n";
     }
-    oss << indent() << "members:\n";
+    line() << "members:\n";
     enter_scope();
     for (const auto &member : expr.members)
     {
-        oss << indent() << "- member:\n";
+        line() << "- member:\n";
         enter_scope();
-        oss << indent() << "name: \"" << escape_string(member.first) << "\"\n";
-        oss << indent() << "value:\n";
+        line() << "name: \"" << Escaped{member.first} << "\"\n";
+        line() << "value:\n";
         enter_scope();
-        oss << print(*member.second);
+        emit(*member.second);
         leave_scope();
         leave_scope();
     }
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const Statement &stmt)
+void ASTPrinter::emit(const Statement &stmt)
 {
     if (auto s = dynamic_cast<const BlockStmt *>(&stmt))
-        return print(*s);
+        return emit(*s);
     if (auto s = dynamic_cast<const ReturnStmt *>(&stmt))
-        return print(*s);
+        return emit(*s);
     if (auto s = dynamic_cast<const IfStmt *>(&stmt))
-        return print(*s);
+        return emit(*s);
     if (auto s = dynamic_cast<const WhileStmt *>(&stmt))
-        return print(*s);
+        return emit(*s);
     if (auto s = dynamic_cast<const BreakStmt *>(&stmt))
-        return print(*s);
+        return emit(*s);
     if (auto s = dynamic_cast<const ContinueStmt *>(&stmt))
-        return print(*s);
+        return emit(*s);
     if (auto s = dynamic_cast<const ExprStmt *>(&stmt))
-        return print(*s);
+        return emit(*s);
     if (auto s = dynamic_cast<const VarDeclStmt *>(&stmt))
-        return print(*s);
-    return indent() + "unknown_stmt\n";
+        return emit(*s);
+    line() << "unknown_stmt\n";
 }
 
-string ASTPrinter::print(const BlockStmt &stmt)
+void ASTPrinter::emit(const BlockStmt &stmt)
 {
-    ostringstream oss;
-    oss << indent() << "block_stmt:\n";
+    line() << "block_stmt:\n";
     enter_scope();
     for (const auto &stmt : stmt.statements)
     {
-        oss << print(*stmt);
+        emit(*stmt);
     }
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const BreakStmt &stmt)
+void ASTPrinter::emit(const BreakStmt &stmt)
 {
-    return indent() + "break_stmt\n";
+    line() << "break_stmt\n";
 }
 
-string ASTPrinter::print(const ContinueStmt &stmt)
+void ASTPrinter::emit(const ContinueStmt &stmt)
 {
-    return indent() + "continue_stmt\n";
+    line() << "continue_stmt\n";
 }
 
-string ASTPrinter::print(const ExprStmt &stmt)
+void ASTPrinter::emit(const ExprStmt &stmt)
 {
-    ostringstream oss;
-    oss << indent() << "expr_stmt:\n";
+    line() << "expr_stmt:\n";
     enter_scope();
-    oss << print(*stmt.expr);
+    emit(*stmt.expr);
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const IfStmt &stmt)
+void ASTPrinter::emit(const IfStmt &stmt)
 {
-    ostringstream oss;
-    oss << indent() << "if_stmt:\n";
+    line() << "if_stmt:\n";
     enter_scope();
 
-    oss << indent() << "condition:\n";
+    line() << "condition:\n";
     enter_scope();
-    oss << print(*stmt.condition);
+    emit(*stmt.condition);
     leave_scope();
 
-    oss << indent() << "then_branch:\n";
+    line() << "then_branch:\n";
     enter_scope();
-    oss << print(*stmt.then_branch);
+    emit(*stmt.then_branch);
     leave_scope();
 
     if (stmt.else_branch)
     {
-        oss << indent() << "else_branch:\n";
+        line() << "else_branch:\n";
         enter_scope();
-        oss << print(*stmt.else_branch);
+        emit(*stmt.else_branch);
         leave_scope();
     }
 
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const WhileStmt &stmt)
+void ASTPrinter::emit(const WhileStmt &stmt)
 {
-    ostringstream oss;
-    oss << indent() << "while_stmt:\n";
+    line() << "while_stmt:\n";
     enter_scope();
-    oss << indent() << "condition:\n";
+    line() << "condition:\n";
     enter_scope();
-    oss << print(*stmt.condition);
+    emit(*stmt.condition);
     leave_scope();
-    oss << indent() << "body:\n";
+    line() << "body:\n";
     enter_scope();
-    oss << print(*stmt.body);
+    emit(*stmt.body);
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const ReturnStmt &stmt)
+void ASTPrinter::emit(const ReturnStmt &stmt)
 {
-    ostringstream oss;
-    oss << indent() << "return_stmt:\n";
+    line() << "return_stmt:\n";
     enter_scope();
     if (stmt.value)
     {
-        oss << indent() << "value:\n";
+        line() << "value:\n";
         enter_scope();
-        oss << print(*stmt.value);
+        emit(*stmt.value);
         leave_scope();
     }
     else
     {
-        oss << indent() << "value: null\n";
+        line() << "value: null\n";
     }
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const CastExpr &expr)
+void ASTPrinter::emit(const CastExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "cast_expr:\n";
+    line() << "cast_expr:\n";
     enter_scope();
-    oss << indent() << "target_type: " << print_type(*expr.target_type) << "\n";
-    oss << indent() << "expression:\n";
+    line() << "target_type: ";
+    emit_type(*expr.target_type);
+    out() << "\n";
+    line() << "expression:\n";
     enter_scope();
-    oss << print(*expr.expr);
+    emit(*expr.expr);
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const InitListExpr &expr)
+void ASTPrinter::emit(const InitListExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "init_list:\n";
+    line() << "init_list:\n";
     enter_scope();
-    oss << indent() << "members:\n";
+    line() << "members:\n";
     enter_scope();
     for (const auto &member : expr.members)
     {
-        oss << print(*member);
+        emit(*member);
     }
     leave_scope();
     leave_scope();
-    return oss.str();
 }
 
-string ASTPrinter::print(const FunctionPointerExpr &expr)
+void ASTPrinter::emit(const FunctionPointerExpr &expr)
 {
-    ostringstream oss;
-    oss << indent() << "function_ptr:\n";
+    line() << "function_ptr:\n";
     enter_scope();
-    oss << indent() << "params:\n";
+    line() << "params:\n";
     enter_scope();
     for (const auto &param : expr.param_types)
     {
-        oss << indent() << "- \n";
+        line() << "- \n";
         enter_scope();
-        oss << print_type(*param);
+        emit_type(*param);
         leave_scope();
     }
     leave_scope();
-    oss << indent() << "return_type: " << print_type(*expr.return_type) << "\n";
+    line() << "return_type: ";
+    emit_type(*expr.return_type);
+    out() << "\n";
     leave_scope();
-    return oss.str();
 }
@@ -1,14 +1,23 @@
 #pragma once
 
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include "ast.h"
+#include "output_buffer.h"
 
+// Prints the AST as YAML. Everything is written straight into one
+// OutputBuffer as the tree is walked, so printing a program takes time and
+// memory in proportion to its output; the overloads returning a string
+// collect that output for callers that want it whole.
 class ASTPrinter {
 public:
+    void print(const ast::Program &program, std::ostream &os);
+
     std::string print(const ast::Program &program);
     std::string print(const ast::Expr &expr);
     std::string print(const ast::Statement &stmt);
-    std::string print(const ast::Type &type);
     std::string print(const ast::TypeAliasDecl &type_alias_decl);
     std::string print(const ast::StructDecl &struct_decl);
     std::string print(const ast::FunctionDecl &func_decl);
@@ -17,42 +26,57 @@ public:
     std::string print(const ast::GlobalDecl &global_decl);
 
 private:
+    template <typename Node>
+    std::string collect(const Node &node);
+
+    // Declarations
+    void emit(const ast::Program &program);
+    void emit(const ast::TypeAliasDecl &type_alias_decl);
+    void emit(const ast::StructDecl &struct_decl);
+    void emit(const ast::FunctionDecl &func_decl);
+    void emit(const ast::ImplBlock &impl_block);
+    void emit(const ast::VarDeclStmt &var_decl);
+    void emit(const ast::GlobalDecl &global_decl);
+
     // Expression visitors
-    std::string print(const ast::VariableExpr &expr);
-    std::string print(const ast::IntegerLiteralExpr &expr);
-    std::string print(const ast::BooleanLiteralExpr &expr);
-    std::string print(const ast::FloatLiteralExpr &expr);
-    std::string print(const ast::StringLiteralExpr &expr);
-    std::string print(const ast::BinaryExpr &expr);
-    std::string print(const ast::UnaryExpr &expr);
-    std::string print(const ast::CallExpr &expr);
-    std::string print(const ast::MemberAccessExpr &expr);
-    std::string print(const ast::ArrayAccessExpr &expr);
-    std::string print(const ast::CastExpr &expr);
-    std::string print(const ast::SizeofExpr &expr);
-    std::string print(const ast::AddressOfExpr &expr);
-    std::string print(const ast::DerefExpr &expr);
-    std::string print(const ast::InitListExpr &expr);
-    std::string print(const ast::FunctionPointerExpr &expr);
-    std::string print(const ast::StructLiteralExpr &expr);
+    void emit(const ast::Expr &expr);
+    void emit(const ast::VariableExpr &expr);
+    void emit(const ast::IntegerLiteralExpr &expr);
+    void emit(const ast::BooleanLiteralExpr &expr);
+    void emit(const ast::FloatLiteralExpr &expr);
+    void emit(const ast::StringLiteralExpr &expr);
+    void emit(const ast::BinaryExpr &expr);
+    void emit(const ast::UnaryExpr &expr);
+    void emit(const ast::CallExpr &expr);
+    void emit(const ast::MemberAccessExpr &expr);
+    void emit(const ast::ArrayAccessExpr &expr);
+    void emit(const ast::CastExpr &expr);
+    void emit(const ast::SizeofExpr &expr);
+    void emit(const ast::AddressOfExpr &expr);
+    void emit(const ast::DerefExpr &expr);
+    void emit(const ast::InitListExpr &expr);
+    void emit(const ast::FunctionPointerExpr &expr);
+    void emit(const ast::StructLiteralExpr &expr);
 
     // Statement visitors
-    std::string print(const ast::BlockStmt &stmt);
-    std::string print(const ast::ReturnStmt &stmt);
-    std::string print(const ast::IfStmt &stmt);
-    std::string print(const ast::WhileStmt &stmt);
-    std::string print(const ast::BreakStmt &stmt);
-    std::string print(const ast::ContinueStmt &stmt);
-    std::string print(const ast::ExprStmt &stmt);
+    void emit(const ast::Statement &stmt);
+    void emit(const ast::BlockStmt &stmt);
+    void emit(const ast::ReturnStmt &stmt);
+    void emit(const ast::IfStmt &stmt);
+    void emit(const ast::WhileStmt &stmt);
+    void emit(const ast::BreakStmt &stmt);
+    void emit(const ast::ContinueStmt &stmt);
+    void emit(const ast::ExprStmt &stmt);
 
     // Helpers
-    std::string indent() const;
+    OutputBuffer &out() { return *out_; }
+    OutputBuffer &line();
     void enter_scope();
     void leave_scope();
-    std::string escape_string(const std::string &str) const;
-    std::string print_type(const ast::Type &type);
-    std::string print_expr(const ast::Expr &expr);
-    std::string print_stmt(const ast::Statement &stmt);
+    std::string_view token_name(TokenType type);
+    void emit_type(const ast::Type &type);
+    OutputBuffer *out_ = nullptr;
+    std::unordered_map<TokenType, std::string> token_names_;
     int current_level = 0;
     int indent_size = 2;
 };
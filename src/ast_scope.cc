@@ -3,30 +3,50 @@
 
 using namespace ast;
 
-// Find a variable in the current or parent scopes
-TypePtr Scope::resolve_variable(const std::string &name) const
+Scope::Scope(const Scope &other)
+    : own_names_(std::make_unique<SymbolTable>(*other.names_)), names_(own_names_.get()),
+      variables_(other.variables_), types_(other.types_)
 {
-    if (name.empty())
-    {
-        throw std::invalid_argument("Cannot find empty name");
-    }
+}
 
-    auto var_it = variables_.find(name);
-    if (var_it != variables_.end())
+Scope &Scope::operator=(const Scope &other)
+{
+    if (this != &other)
     {
-        return var_it->second->clone();
+        own_names_ = std::make_unique<SymbolTable>(*other.names_);
+        names_ = own_names_.get();
+        variables_ = other.variables_;
+        types_ = other.types_;
     }
+    return *this;
+}
+
+void Scope::push()
+{
+    variables_.push_scope();
+    types_.push_scope();
+}
+
+void Scope::pop()
+{
+    variables_.pop_scope();
+    types_.pop_scope();
+}
 
-    if (parent_)
+// Find a variable in the current or enclosing scopes
+const Type *Scope::resolve_variable(const std::string &name, Symbol symbol) const
+{
+    if (name.empty())
     {
-        return parent_->resolve_variable(name);
+        throw std::invalid_argument("Cannot find empty name");
     }
 
-    return nullptr;
+    const auto *type = variables_.find(symbol != NO_SYMBOL ? symbol : names_->lookup(name));
+    return type ? *type : nullptr;
 }
 
 // Insert a variable into the current scope
-bool Scope::insert_variable(std::string name, TypePtr type)
+bool Scope::insert_variable(const std::string &name, const Type *type, Symbol symbol)
 {
     if (name.empty())
     {
@@ -37,17 +57,18 @@ bool Scope::insert_variable(std::string name, TypePtr type)
         MO_WARN("Type be null");
     }
 
-    if (variables_.find(name) != variables_.end() || types_.find(name) != types_.end())
+    if (symbol == NO_SYMBOL)
+        symbol = names_->intern(name);
+    if (variables_.find_local(symbol) || types_.find_local(symbol))
     {
         MO_WARN("Variable or type already exists: %s", name.c_str());
         return false; // Variable or type already exists
     }
 
-    variables_[name] = std::move(type);
-    return true;
+    return variables_.insert(symbol, type);
 }
 
-bool Scope::insert_type(std::string name, TypePtr type)
+bool Scope::insert_type(const std::string &name, const Type *type)
 {
     if (name.empty())
     {
@@ -58,34 +79,29 @@ bool Scope::insert_type(std::string name, TypePtr type)
         MO_WARN("Type be null");
     }
 
-    if (variables_.find(name) != variables_.end())
+    const Symbol symbol = names_->intern(name);
+    if (variables_.find_local(symbol))
     {
         MO_WARN("Variable already exists: %s", name.c_str());
         return false; // Variable or type already exists
     }
 
-    types_[name] = std::move(type);
-    return true;
+    if (auto *existing = types_.find_local(symbol))
+    {
+        *existing = type;
+        return true;
+    }
+    return types_.insert(symbol, type);
 }
 
-// Resolve a type in the current or parent scopes
-TypePtr Scope::resolve_type(const std::string &name) const
+// Resolve a type in the current or enclosing scopes
+const Type *Scope::resolve_type(const std::string &name) const
 {
     if (name.empty())
     {
         throw std::invalid_argument("Cannot resolve empty name");
     }
 
-    auto type_it = types_.find(name);
-    if (type_it != types_.end())
-    {
-        return type_it->second->clone();
-    }
-
-    if (parent_)
-    {
-        return parent_->resolve_type(name);
-    }
-
-    return nullptr;
+    const auto *type = types_.find(names_->lookup(name));
+    return type ? *type : nullptr;
 }
@@ -1,27 +1,46 @@
 // ast_scope.h -- AST symbol table for variables and types
 #pragma once
 
+#include <memory>
+
 #include "ast.h"
-#include <unordered_map>
+#include "scoped_symbol_table.h"
 
 namespace ast
 {
+    // Variables and types of all nested block scopes, kept in flat scoped tables
+    // keyed by interned name. The scope does not own the types; they live in the
+    // program's TypeContext, so lookups are plain pointer returns. Callers
+    // holding the lexer's `symbol` for a name pass it and skip hashing the name.
     class Scope
     {
     public:
-        Scope(Scope *parent) : parent_(parent) {}
+        Scope() : own_names_(std::make_unique<SymbolTable>()), names_(own_names_.get()) {}
+        // A copy interns into its own copy of the names, which keeps the ids, so
+        // copies used on other threads don't share a table
+        Scope(const Scope &other);
+        Scope &operator=(const Scope &other);
+        Scope(Scope &&) = default;
+        Scope &operator=(Scope &&) = default;
+        // Interns into `names` from now on, normally the program's table, so the
+        // identifiers' symbols are valid keys. Call before the first insert
+        void use_symbol_table(SymbolTable *names) { names_ = names; }
 
-        ast::TypePtr resolve_variable(const std::string &name) const;
-        ast::TypePtr resolve_type(const std::string &name) const;
-        bool insert_variable(std::string name, ast::TypePtr type);
-        bool insert_type(std::string name, ast::TypePtr type);
+        void push();
+        void pop();
+        size_t depth() const { return variables_.depth(); }
+        bool is_global() const { return depth() == 0; }
 
-        Scope *parent() const { return parent_; }
+        const ast::Type *resolve_variable(const std::string &name, Symbol symbol = NO_SYMBOL) const;
+        const ast::Type *resolve_type(const std::string &name) const;
+        bool insert_variable(const std::string &name, const ast::Type *type, Symbol symbol = NO_SYMBOL);
+        bool insert_type(const std::string &name, const ast::Type *type);
 
     private:
-        Scope *parent_ = nullptr;
-        std::unordered_map<std::string, ast::TypePtr> variables_;
-        std::unordered_map<std::string, ast::TypePtr> types_;
+        std::unique_ptr<SymbolTable> own_names_;
+        SymbolTable *names_;
+        ScopedSymbolTable<const ast::Type *> variables_;
+        ScopedSymbolTable<const ast::Type *> types_;
     };
 
 }
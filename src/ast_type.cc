@@ -30,9 +30,17 @@ namespace ast
     //===----------------------------------------------------------------------===//
     // Type
     //===----------------------------------------------------------------------===//
+    void TypeDeleter::operator()(Type *type) const noexcept
+    {
+        if (type && !type->is_interned())
+        {
+            delete type;
+        }
+    }
+
     TypePtr Type::create_placeholder()
     {
-        return std::make_unique<PlaceholderType>();
+        return make_type<PlaceholderType>();
     }
 
     TypePtr Type::create_void()
@@ -41,7 +49,7 @@ namespace ast
         {
         public:
             Kind kind() const noexcept override { return Kind::Void; }
-            TypePtr clone() const override { return std::make_unique<VoidType>(); }
+            TypePtr clone_impl() const override { return make_type<VoidType>(); }
             bool equals(const Type *other) const noexcept override
             {
                 return other->kind() == Kind::Void;
@@ -49,12 +57,12 @@ namespace ast
 
             std::string to_string() const override { return "void"; }
         };
-        return std::make_unique<VoidType>();
+        return make_type<VoidType>();
     }
 
     TypePtr Type::create_bool()
     {
-        return std::make_unique<BoolType>();
+        return make_type<BoolType>();
     }
 
     TypePtr Type::create_int(uint8_t bit_width, bool unsigned_)
@@ -62,34 +70,34 @@ namespace ast
         if (bit_width == 1)
         {
             MO_WARN("Use create_bool() instead of create_int(1, false)");
-            return std::make_unique<BoolType>();
+            return make_type<BoolType>();
         }
-        return std::make_unique<IntegerType>(bit_width, unsigned_);
+        return make_type<IntegerType>(bit_width, unsigned_);
     }
 
     TypePtr Type::create_float(uint8_t bit_width)
     {
-        return std::make_unique<FloatType>(bit_width);
+        return make_type<FloatType>(bit_width);
     }
 
     TypePtr Type::create_string()
     {
-        return std::make_unique<StringType>();
+        return make_type<StringType>();
     }
 
     TypePtr Type::create_pointer(TypePtr pointee)
     {
-        return std::make_unique<PointerType>(std::move(pointee));
+        return make_type<PointerType>(std::move(pointee));
     }
 
     TypePtr Type::create_array(TypePtr element, int size)
     {
-        return std::make_unique<ArrayType>(std::move(element), size);
+        return make_type<ArrayType>(std::move(element), size);
     }
 
     TypePtr Type::create_tuple(std::vector<TypePtr> elem_types)
     {
-        return std::make_unique<TupleType>(std::move(elem_types));
+        return make_type<TupleType>(std::move(elem_types));
     }
 
     TypePtr Type::create_function(TypePtr return_type, std::vector<TypePtr> params)
@@ -98,22 +106,22 @@ namespace ast
         {
             return_type = create_void();
         }
-        return std::make_unique<FunctionType>(std::move(return_type), std::move(params));
+        return make_type<FunctionType>(std::move(return_type), std::move(params));
     }
 
     TypePtr Type::create_struct(std::string name, std::vector<TypedField> members)
     {
-        return std::make_unique<StructType>(std::move(name), std::move(members));
+        return make_type<StructType>(std::move(name), std::move(members));
     }
 
     TypePtr Type::create_alias(std::string name)
     {
-        return std::make_unique<AliasType>(std::move(name));
+        return make_type<AliasType>(std::move(name));
     }
 
     TypePtr Type::create_qualified(Qualifier q, TypePtr base)
     {
-        return std::make_unique<QualifiedType>(q, std::move(base));
+        return make_type<QualifiedType>(q, std::move(base));
     }
 
     std::string VoidType::to_string() const
@@ -9,6 +9,7 @@
 #include <cstdint>
 #include <stdexcept>
 
+#include "ast_arena.h"
 #include "mo_debug.h"
 
 #define MO_DEFAULT_INT_BITWIDTH (32)
@@ -35,8 +36,22 @@ namespace ast
     class QualifiedType;
     class VoidType;
     class PlaceholderType;
+    class TypeContext;
 
-    using TypePtr = std::unique_ptr<Type>;
+    // Deletes owned types and leaves interned ones alone; those belong to their
+    // TypeContext, so a TypePtr may also be a non-owning handle to a shared type.
+    struct TypeDeleter
+    {
+        void operator()(Type *type) const noexcept;
+    };
+
+    using TypePtr = std::unique_ptr<Type, TypeDeleter>;
+
+    template <typename T, typename... Args>
+    TypePtr make_type(Args &&...args)
+    {
+        return TypePtr(new T(std::forward<Args>(args)...));
+    }
 
     //===----------------------------------------------------------------------===//
     //                             Utility Classes
@@ -74,7 +89,7 @@ namespace ast
     //===----------------------------------------------------------------------===//
     //                            Abstract Base Class: Type
     //===----------------------------------------------------------------------===//
-    class Type
+    class Type : public ArenaNode
     {
     public:
         enum class Kind
@@ -98,10 +113,17 @@ namespace ast
 
         // Type characteristic queries
         virtual Kind kind() const noexcept = 0;
-        virtual TypePtr clone() const = 0;
         virtual bool equals(const Type *other) const noexcept = 0;
         virtual std::string to_string() const = 0;
 
+        // Copies an owned type. An interned type is immutable and shared, so its
+        // clone is just another handle to the same node.
+        TypePtr clone() const
+        {
+            return interned_ ? TypePtr(const_cast<Type *>(this)) : clone_impl();
+        }
+        bool is_interned() const noexcept { return interned_; }
+
         // Type conversion methods
         virtual IntegerType *as_integer() noexcept { return nullptr; }
         virtual const IntegerType *as_integer() const noexcept { return nullptr; }
@@ -158,6 +180,13 @@ namespace ast
         static TypePtr create_struct(std::string name, std::vector<TypedField> members);
         static TypePtr create_alias(std::string name);
         static TypePtr create_qualified(Qualifier q, TypePtr base);
+
+    protected:
+        virtual TypePtr clone_impl() const = 0;
+
+    private:
+        friend class TypeContext;
+        bool interned_ = false;
     };
 
     //===----------------------------------------------------------------------===//
@@ -167,7 +196,7 @@ namespace ast
     {
     public:
         Kind kind() const noexcept override { return Kind::Void; }
-        TypePtr clone() const override { return std::make_unique<VoidType>(); }
+        TypePtr clone_impl() const override { return make_type<VoidType>(); }
         bool equals(const Type *other) const noexcept override
         {
             return other->kind() == Kind::Void;
@@ -182,7 +211,7 @@ namespace ast
     {
     public:
         Kind kind() const noexcept override { return Kind::Placeholder; }
-        TypePtr clone() const override { return std::make_unique<PlaceholderType>(); }
+        TypePtr clone_impl() const override { return make_type<PlaceholderType>(); }
         bool equals(const Type *other) const noexcept override
         {
             return other->kind() == Kind::Placeholder;
@@ -253,16 +282,17 @@ namespace ast
         Kind kind() const noexcept override { return Kind::Int; }
         size_t bit_width() const noexcept { return bit_width_; }
 
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<IntegerType>(bit_width_, unsigned_);
+            return make_type<IntegerType>(bit_width_, unsigned_);
         }
 
         bool equals(const Type *other) const noexcept override
         {
             if (other->kind() != Kind::Int)
                 return false;
-            return bit_width_ == static_cast<const IntegerType *>(other)->bit_width_;
+            const auto *o = static_cast<const IntegerType *>(other);
+            return bit_width_ == o->bit_width_ && unsigned_ == o->unsigned_;
         }
 
         bool is_unsigned() const noexcept override
@@ -294,9 +324,9 @@ namespace ast
         Kind kind() const noexcept override { return Kind::Float; }
         uint8_t bit_width() const noexcept { return bit_width_; }
 
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<FloatType>(bit_width_);
+            return make_type<FloatType>(bit_width_);
         }
 
         bool equals(const Type *other) const noexcept override
@@ -332,9 +362,9 @@ namespace ast
 
         Kind kind() const noexcept override { return Kind::Bool; }
 
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<BoolType>();
+            return make_type<BoolType>();
         }
 
         bool equals(const Type *other) const noexcept override
@@ -363,9 +393,9 @@ namespace ast
 
         Kind kind() const noexcept override { return Kind::String; }
 
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<StringType>();
+            return make_type<StringType>();
         }
 
         bool equals(const Type *other) const noexcept override
@@ -399,9 +429,9 @@ namespace ast
         Kind kind() const noexcept override { return Kind::Pointer; }
         const Type &pointee() const noexcept { return *pointee_; }
 
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<PointerType>(pointee_->clone());
+            return make_type<PointerType>(pointee_->clone());
         }
 
         bool equals(const Type *other) const noexcept override
@@ -446,9 +476,9 @@ namespace ast
         int size() const noexcept { return size_; } // -1 indicates unspecified size
 
         // Cloning operation
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<ArrayType>(element_->clone(), size_);
+            return make_type<ArrayType>(element_->clone(), size_);
         }
 
         // Type comparison
@@ -495,7 +525,7 @@ namespace ast
             return elements_;
         }
 
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
             std::vector<TypePtr> cloned_elements;
             cloned_elements.reserve(elements_.size());
@@ -503,7 +533,7 @@ namespace ast
             {
                 cloned_elements.push_back(elem->clone());
             }
-            return std::make_unique<TupleType>(std::move(cloned_elements));
+            return make_type<TupleType>(std::move(cloned_elements));
         }
 
         // 类型比较
@@ -615,14 +645,14 @@ namespace ast
 
         Kind kind() const noexcept override { return Kind::Struct; }
 
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
             std::vector<TypedField> cloned_members;
             for (const auto &m : members_)
             {
                 cloned_members.emplace_back(m.name, m.type->clone());
             }
-            return std::make_unique<StructType>(name_, std::move(cloned_members));
+            return make_type<StructType>(name_, std::move(cloned_members));
         }
 
         std::string to_string() const override;
@@ -685,14 +715,14 @@ namespace ast
         const std::vector<TypePtr> &params() const noexcept { return params_; }
 
         // Cloning operation
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
             std::vector<TypePtr> cloned_params;
             for (const auto &p : params_)
             {
                 cloned_params.emplace_back(p->clone());
             }
-            return std::make_unique<FunctionType>(
+            return make_type<FunctionType>(
                 return_type_->clone(),
                 std::move(cloned_params));
         }
@@ -755,9 +785,9 @@ namespace ast
         const std::string &name() const noexcept { return name_; }
 
         // Cloning operation
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<AliasType>(name_);
+            return make_type<AliasType>(name_);
         }
 
         // Type comparison
@@ -796,9 +826,9 @@ namespace ast
         Type &base_type() noexcept { return *base_; }
 
         // Cloning operation
-        TypePtr clone() const override
+        TypePtr clone_impl() const override
         {
-            return std::make_unique<QualifiedType>(qualifiers_, base_->clone());
+            return make_type<QualifiedType>(qualifiers_, base_->clone());
         }
 
         // Type comparison
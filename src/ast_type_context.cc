@@ -0,0 +1,225 @@
+//===----------------------------------------------------------------------===//
+//                             Headers and Namespaces
+//===----------------------------------------------------------------------===//
+
+#include "ast_type_context.h"
+#include <functional>
+
+#include "ast_arena.h"
+#include "mo_debug.h"
+
+using namespace ast;
+
+//===----------------------------------------------------------------------===//
+//                             TypeContext Implementation
+//===----------------------------------------------------------------------===//
+
+size_t TypeContext::KeyHash::operator()(const Key &key) const noexcept
+{
+    auto mix = [](size_t seed, size_t value)
+    { return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)); };
+
+    size_t h = static_cast<size_t>(key.kind);
+    h = mix(h, std::hash<int64_t>{}(key.data));
+    if (!key.name.empty())
+        h = mix(h, std::hash<std::string>{}(key.name));
+    for (const Type *operand : key.operands)
+        h = mix(h, std::hash<const Type *>{}(operand));
+    return h;
+}
+
+TypeContext::~TypeContext()
+{
+    // Canonical types hold handles to their children, and the handles look at the
+    // child when they are destroyed, so parents must go first.
+    for (auto it = storage_.rbegin(); it != storage_.rend(); ++it)
+    {
+        delete *it;
+    }
+}
+
+template <typename Build>
+const Type *TypeContext::get_or_create(Key key, Build build)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (auto it = types_.find(key); it != types_.end())
+    {
+        return it->second;
+    }
+
+    // Canonical types live as long as the context, never in a node arena
+    ArenaScope heap_scope(nullptr);
+    Type *type = build().release();
+    type->interned_ = true;
+    storage_.push_back(type);
+    types_.emplace(std::move(key), type);
+    return type;
+}
+
+const Type *TypeContext::get_placeholder()
+{
+    return get_or_create({Type::Kind::Placeholder}, []
+                         { return Type::create_placeholder(); });
+}
+
+const Type *TypeContext::get_void()
+{
+    return get_or_create({Type::Kind::Void}, []
+                         { return Type::create_void(); });
+}
+
+const Type *TypeContext::get_bool()
+{
+    return get_or_create({Type::Kind::Bool}, []
+                         { return Type::create_bool(); });
+}
+
+const Type *TypeContext::get_int(uint8_t bit_width, bool is_unsigned)
+{
+    if (bit_width == 1)
+    {
+        return get_bool();
+    }
+    return get_or_create({Type::Kind::Int, bit_width | (is_unsigned ? 0x100 : 0)}, [&]
+                         { return Type::create_int(bit_width, is_unsigned); });
+}
+
+const Type *TypeContext::get_float(uint8_t bit_width)
+{
+    return get_or_create({Type::Kind::Float, bit_width}, [&]
+                         { return Type::create_float(bit_width); });
+}
+
+const Type *TypeContext::get_string()
+{
+    return get_or_create({Type::Kind::String}, []
+                         { return Type::create_string(); });
+}
+
+const Type *TypeContext::get_pointer(const Type *pointee)
+{
+    MO_ASSERT(pointee && pointee->is_interned(), "Pointee must be interned");
+    return get_or_create({Type::Kind::Pointer, 0, {}, {pointee}}, [&]
+                         { return Type::create_pointer(share(pointee)); });
+}
+
+const Type *TypeContext::get_array(const Type *element, int size)
+{
+    MO_ASSERT(element && element->is_interned(), "Element type must be interned");
+    return get_or_create({Type::Kind::Array, size, {}, {element}}, [&]
+                         { return Type::create_array(share(element), size); });
+}
+
+const Type *TypeContext::get_tuple(const std::vector<const Type *> &elements)
+{
+    return get_or_create({Type::Kind::Tuple, 0, {}, elements}, [&]
+                         {
+                             std::vector<TypePtr> element_types;
+                             element_types.reserve(elements.size());
+                             for (const Type *element : elements)
+                                 element_types.push_back(share(element));
+                             return Type::create_tuple(std::move(element_types)); });
+}
+
+const Type *TypeContext::get_function(const Type *return_type, const std::vector<const Type *> &params)
+{
+    MO_ASSERT(return_type && return_type->is_interned(), "Return type must be interned");
+    std::vector<const Type *> operands;
+    operands.reserve(params.size() + 1);
+    operands.push_back(return_type);
+    operands.insert(operands.end(), params.begin(), params.end());
+
+    return get_or_create({Type::Kind::Function, 0, {}, std::move(operands)}, [&]
+                         {
+                             std::vector<TypePtr> param_types;
+                             param_types.reserve(params.size());
+                             for (const Type *param : params)
+                                 param_types.push_back(share(param));
+                             return Type::create_function(share(return_type), std::move(param_types)); });
+}
+
+const Type *TypeContext::get_alias(const std::string &name)
+{
+    return get_or_create({Type::Kind::Alias, 0, name}, [&]
+                         { return Type::create_alias(name); });
+}
+
+const Type *TypeContext::get_qualified(Qualifier qualifiers, const Type *base)
+{
+    MO_ASSERT(base && base->is_interned(), "Base type must be interned");
+    return get_or_create({Type::Kind::Qualified, static_cast<uint8_t>(qualifiers), {}, {base}}, [&]
+                         { return Type::create_qualified(qualifiers, share(base)); });
+}
+
+const Type *TypeContext::intern(const Type &type)
+{
+    if (type.is_interned())
+    {
+        return &type;
+    }
+
+    switch (type.kind())
+    {
+    case Type::Kind::Placeholder:
+        return get_placeholder();
+    case Type::Kind::Void:
+        return get_void();
+    case Type::Kind::Bool:
+        return get_bool();
+    case Type::Kind::String:
+        return get_string();
+    case Type::Kind::Int:
+    {
+        const auto *int_type = type.as_integer();
+        return get_int(static_cast<uint8_t>(int_type->bit_width()), int_type->is_unsigned());
+    }
+    case Type::Kind::Float:
+        return get_float(type.as_float()->bit_width());
+    case Type::Kind::Pointer:
+        return get_pointer(intern(type.as_pointer()->pointee()));
+    case Type::Kind::Array:
+    {
+        const auto *array_type = type.as_array();
+        return get_array(intern(array_type->element_type()), array_type->size());
+    }
+    case Type::Kind::Tuple:
+    {
+        std::vector<const Type *> elements;
+        for (const auto &element : type.as_tuple()->element_types())
+            elements.push_back(intern(*element));
+        return get_tuple(elements);
+    }
+    case Type::Kind::Function:
+    {
+        const auto *function_type = type.as_function();
+        std::vector<const Type *> params;
+        for (const auto &param : function_type->params())
+            params.push_back(intern(*param));
+        return get_function(intern(function_type->return_type()), params);
+    }
+    case Type::Kind::Struct:
+    {
+        // Members are part of the identity, so the key records their names too
+        const auto *struct_type = type.as_struct();
+        Key key{Type::Kind::Struct, 0, struct_type->name()};
+        std::vector<TypedField> members;
+        for (const auto &member : *struct_type)
+        {
+            key.name += '\n';
+            key.name += member.name;
+            key.operands.push_back(intern(*member.type));
+            members.emplace_back(member.name, share(key.operands.back()));
+        }
+        return get_or_create(std::move(key), [&]
+                             { return Type::create_struct(struct_type->name(), std::move(members)); });
+    }
+    case Type::Kind::Alias:
+        return get_alias(type.as_alias()->name());
+    case Type::Kind::Qualified:
+    {
+        const auto *qualified_type = type.as_qualified();
+        return get_qualified(qualified_type->qualifiers(), intern(qualified_type->base_type()));
+    }
+    }
+    MO_UNREACHABLE();
+}
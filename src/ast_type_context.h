@@ -0,0 +1,84 @@
+// ast_type_context.h - Interned (hash-consed) AST types
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ast_type.h"
+
+namespace ast
+{
+    //===----------------------------------------------------------------------===//
+    //                             TypeContext
+    //===----------------------------------------------------------------------===//
+
+    // Owns one canonical node per structurally distinct type. Canonical types are
+    // immutable and built from canonical children, so two of them are equal iff
+    // they are the same pointer. Handing one to a node is done with clone(), which
+    // for an interned type returns a non-owning TypePtr instead of copying.
+    // Interning is thread-safe, so function bodies can be checked in parallel.
+    class TypeContext
+    {
+    public:
+        TypeContext() = default;
+        TypeContext(const TypeContext &) = delete;
+        TypeContext &operator=(const TypeContext &) = delete;
+        ~TypeContext();
+
+        // Returns the canonical equivalent of `type`; interned types map to themselves.
+        const Type *intern(const Type &type);
+
+        const Type *get_placeholder();
+        const Type *get_void();
+        const Type *get_bool();
+        const Type *get_int(uint8_t bit_width = MO_DEFAULT_INT_BITWIDTH, bool is_unsigned = false);
+        const Type *get_float(uint8_t bit_width = MO_DEFAULT_FLOAT_PRECISION);
+        const Type *get_string();
+        const Type *get_pointer(const Type *pointee);
+        const Type *get_array(const Type *element, int size);
+        const Type *get_tuple(const std::vector<const Type *> &elements);
+        const Type *get_function(const Type *return_type, const std::vector<const Type *> &params);
+        const Type *get_alias(const std::string &name);
+        const Type *get_qualified(Qualifier qualifiers, const Type *base);
+
+        size_t size()
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return storage_.size();
+        }
+
+    private:
+        // Structural identity of a type in terms of its already-canonical operands
+        struct Key
+        {
+            Type::Kind kind;
+            int64_t data = 0;
+            std::string name = {};
+            std::vector<const Type *> operands = {};
+
+            bool operator==(const Key &other) const
+            {
+                return kind == other.kind && data == other.data && name == other.name && operands == other.operands;
+            }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key &key) const noexcept;
+        };
+
+        template <typename Build>
+        const Type *get_or_create(Key key, Build build);
+
+        static TypePtr share(const Type *type) { return type->clone(); }
+
+        std::mutex mutex_; // guards types_ and storage_
+        std::unordered_map<Key, Type *, KeyHash> types_;
+        // Creation order; children always precede the types built from them
+        std::vector<Type *> storage_;
+    };
+
+}
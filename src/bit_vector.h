@@ -0,0 +1,103 @@
+// bit_vector.h - Bit sets over dense indices
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             Bit Vector
+//===----------------------------------------------------------------------===//
+
+// A set of indices in [0, size) stored one bit each. The word loops are
+// plain contiguous passes so the compiler can vectorize them; bits past
+// `size` are always zero, which keeps comparisons and counts word-wise.
+class BitVector
+{
+public:
+    using Word = uint64_t;
+    static constexpr unsigned WORD_BITS = 64;
+
+    BitVector() = default;
+    explicit BitVector(size_t size) : size_(size), words_(num_words(size)) {}
+
+    size_t size() const { return size_; }
+    void resize(size_t size)
+    {
+        size_ = size;
+        words_.resize(num_words(size));
+        clear_unused_bits();
+    }
+
+    bool test(size_t i) const { return words_[i / WORD_BITS] >> (i % WORD_BITS) & 1; }
+    void set(size_t i) { words_[i / WORD_BITS] |= Word(1) << (i % WORD_BITS); }
+    void reset(size_t i) { words_[i / WORD_BITS] &= ~(Word(1) << (i % WORD_BITS)); }
+    void clear() { std::fill(words_.begin(), words_.end(), 0); }
+
+    bool any() const
+    {
+        return std::any_of(words_.begin(), words_.end(), [](Word w) { return w != 0; });
+    }
+
+    size_t count() const
+    {
+        size_t n = 0;
+        for (Word w : words_)
+            n += std::popcount(w);
+        return n;
+    }
+
+    // this |= other; returns whether any bit was added
+    bool union_with(const BitVector &other)
+    {
+        Word added = 0;
+        for (size_t w = 0; w < words_.size(); ++w)
+        {
+            const Word merged = words_[w] | other.words_[w];
+            added |= merged ^ words_[w];
+            words_[w] = merged;
+        }
+        return added != 0;
+    }
+
+    // this = gen | (live & ~kill), the transfer function of backward data
+    // flow; returns whether the result differs from the old contents
+    bool assign_transfer(const BitVector &gen, const BitVector &live, const BitVector &kill)
+    {
+        Word changed = 0;
+        for (size_t w = 0; w < words_.size(); ++w)
+        {
+            const Word result = gen.words_[w] | (live.words_[w] & ~kill.words_[w]);
+            changed |= result ^ words_[w];
+            words_[w] = result;
+        }
+        return changed != 0;
+    }
+
+    // Calls `fn(index)` for every set bit, in increasing order
+    template <typename Fn>
+    void for_each(Fn &&fn) const
+    {
+        for (size_t w = 0; w < words_.size(); ++w)
+        {
+            for (Word bits = words_[w]; bits; bits &= bits - 1)
+                fn(w * WORD_BITS + std::countr_zero(bits));
+        }
+    }
+
+    bool operator==(const BitVector &other) const = default;
+
+private:
+    static size_t num_words(size_t size) { return (size + WORD_BITS - 1) / WORD_BITS; }
+
+    void clear_unused_bits()
+    {
+        if (size_ % WORD_BITS)
+            words_.back() &= (Word(1) << (size_ % WORD_BITS)) - 1;
+    }
+
+    size_t size_ = 0;
+    std::vector<Word> words_;
+};
@@ -0,0 +1,645 @@
+#include "block_placement.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <optional>
+#include <unordered_set>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // Probability of leaving a loop, or of an early return, at one branch.
+    // 1/32 makes a loop run 32 times per entry
+    constexpr double UNLIKELY = 1.0 / 32;
+    // Iterations assumed for a loop that never exits
+    constexpr double MAX_LOOP_SCALE = 1024;
+    // Blocks followed through unconditional jumps looking for a return
+    constexpr unsigned RETURN_LOOKAHEAD = 4;
+    constexpr unsigned NO_LOOP = ~0u;
+
+    bool is_branch(const MachineInst &mi)
+    {
+        return mi.has_flag(MIFlag::Branch) || mi.has_flag(MIFlag::Terminator);
+    }
+
+    // Index of the block operand a branch targets, or -1
+    int target_operand(const MachineInst &mi)
+    {
+        const auto &ops = mi.operands();
+        for (int i = static_cast<int>(ops.size()) - 1; i >= 0; --i)
+        {
+            if (ops[i].is_basic_block())
+                return i;
+        }
+        return -1;
+    }
+
+    std::unique_ptr<MachineInst> rebuild(const MachineInst &like, unsigned opcode, const std::vector<MOperand> &ops)
+    {
+        auto mi = std::make_unique<MachineInst>(opcode, ops);
+        for (unsigned flag = 0; flag < static_cast<unsigned>(MIFlag::TOTAL_FLAGS); ++flag)
+        {
+            if (like.has_flag(static_cast<MIFlag>(flag)))
+                mi->set_flag(static_cast<MIFlag>(flag));
+        }
+        return mi;
+    }
+
+    // How control leaves a block: `cond` to `taken`, then `jump` or the
+    // fall-through to `next`. No `next` means the block returns
+    struct BlockExit
+    {
+        MachineInst *cond = nullptr;
+        MachineBasicBlock *taken = nullptr;
+        MachineInst *jump = nullptr;
+        MachineBasicBlock *next = nullptr;
+    };
+
+    std::optional<BlockExit> analyze_exit(MachineBasicBlock &mbb, MachineBasicBlock *layout_next,
+                                          const TargetInstInfo &tii)
+    {
+        // The one target of an analyzable branch, which for a jump mustn't
+        // fall through
+        auto branch_target = [&](MachineInst &mi, bool conditional) -> MachineBasicBlock *
+        {
+            std::unordered_set<MachineBasicBlock *> targets;
+            MachineBasicBlock *fall_through = nullptr;
+            if (!tii.analyze_branch(mbb, &mi, targets, fall_through) || targets.size() != 1)
+                return nullptr;
+            if (!conditional && fall_through)
+                return nullptr;
+            MachineBasicBlock *target = *targets.begin();
+            const int index = target_operand(mi);
+            if (index < 0 || mi.operands()[index].basic_block() != target)
+                return nullptr;
+            return target;
+        };
+
+        BlockExit exit;
+        const auto &insts = mbb.instructions();
+        MachineInst *last = insts.empty() ? nullptr : insts.back().get();
+        // Tail calls leave the function just like returns
+        if (last && (tii.is_return(*last) || last->is_tail_call()))
+            return exit;
+        if (!last || !is_branch(*last))
+        {
+            // Falling off the end of the function
+            if (!layout_next)
+                return std::nullopt;
+            exit.next = layout_next;
+            return exit;
+        }
+
+        if (tii.get_inverse_branch_opcode(last->opcode()))
+        {
+            exit.cond = last;
+            exit.taken = branch_target(*last, true);
+            exit.next = layout_next;
+            if (!exit.taken || !exit.next)
+                return std::nullopt;
+            return exit;
+        }
+        exit.jump = last;
+        exit.next = branch_target(*last, false);
+        if (!exit.next)
+            return std::nullopt;
+        if (insts.size() >= 2 && is_branch(*insts[insts.size() - 2]))
+        {
+            MachineInst *prev = insts[insts.size() - 2].get();
+            if (!tii.get_inverse_branch_opcode(prev->opcode()))
+                return std::nullopt;
+            exit.cond = prev;
+            exit.taken = branch_target(*prev, true);
+            if (!exit.taken)
+                return std::nullopt;
+        }
+        return exit;
+    }
+
+    //===------------------------------------------------------------------===//
+    //                         Function Layout
+    //===------------------------------------------------------------------===//
+
+    class FunctionLayout
+    {
+    public:
+        FunctionLayout(MachineFunction &mf, const TargetInstInfo &tii) : mf_(mf), tii_(tii) {}
+
+        // False if some block's terminators can't be analyzed
+        bool analyze();
+        const std::vector<MachineBasicBlock *> &blocks() const { return blocks_; }
+        double frequency(unsigned b) const { return freq_[b]; }
+        bool is_reachable(unsigned b) const { return reachable_[b]; }
+
+        PlacementStats place();
+
+    private:
+        MachineFunction &mf_;
+        const TargetInstInfo &tii_;
+        std::vector<MachineBasicBlock *> blocks_; // in the original layout
+        std::unordered_map<const MachineBasicBlock *, unsigned> index_;
+        std::vector<BlockExit> exits_;
+        // Distinct successors, with the probability of each
+        std::vector<std::vector<std::pair<unsigned, double>>> succs_;
+        std::vector<bool> reachable_;
+        std::vector<unsigned> rpo_;
+        // Members of each natural loop, its header and the smallest loop
+        // around it, and the innermost loop of each block
+        std::vector<std::vector<bool>> loops_;
+        std::vector<unsigned> loop_headers_;
+        std::vector<unsigned> loop_parent_;
+        std::vector<size_t> loop_sizes_;
+        std::vector<unsigned> loop_of_;
+        std::vector<double> freq_;
+
+        void find_loops();
+        bool returns_soon(unsigned b) const;
+        void compute_probabilities();
+        void compute_frequencies();
+        bool apply_profile();
+        std::vector<unsigned> build_order() const;
+        void rewrite(MachineBasicBlock *mbb, const BlockExit &exit, MachineBasicBlock *next, PlacementStats &stats);
+    };
+
+    bool FunctionLayout::analyze()
+    {
+        for (const auto &mbb : mf_.basic_blocks())
+        {
+            index_.emplace(mbb.get(), static_cast<unsigned>(blocks_.size()));
+            blocks_.push_back(mbb.get());
+        }
+        for (size_t i = 0; i < blocks_.size(); ++i)
+        {
+            MachineBasicBlock *layout_next = i + 1 < blocks_.size() ? blocks_[i + 1] : nullptr;
+            std::optional<BlockExit> exit = analyze_exit(*blocks_[i], layout_next, tii_);
+            if (!exit)
+                return false;
+            exits_.push_back(*exit);
+        }
+        // Branches into other functions' blocks aren't ours to lay out
+        for (const BlockExit &exit : exits_)
+        {
+            for (MachineBasicBlock *target : {exit.taken, exit.next})
+            {
+                if (target && !index_.count(target))
+                    return false;
+            }
+        }
+
+        succs_.assign(blocks_.size(), {});
+        for (size_t b = 0; b < blocks_.size(); ++b)
+        {
+            const BlockExit &exit = exits_[b];
+            if (exit.cond && exit.taken != exit.next)
+                succs_[b].push_back({index_.at(exit.taken), 0.5});
+            if (exit.next)
+                succs_[b].push_back({index_.at(exit.next), succs_[b].empty() ? 1.0 : 0.5});
+        }
+        find_loops();
+        if (!apply_profile())
+        {
+            compute_probabilities();
+            compute_frequencies();
+        }
+        return true;
+    }
+
+    void FunctionLayout::find_loops()
+    {
+        const size_t n = blocks_.size();
+        reachable_.assign(n, false);
+        loop_of_.assign(n, NO_LOOP);
+        if (n == 0)
+            return;
+
+        // Depth-first from the entry; edges back to a block still on the
+        // stack close a loop
+        std::vector<std::pair<unsigned, unsigned>> back_edges;
+        std::vector<bool> on_stack(n, false);
+        std::vector<unsigned> postorder;
+        std::vector<std::pair<unsigned, size_t>> stack = {{0, 0}};
+        reachable_[0] = on_stack[0] = true;
+        while (!stack.empty())
+        {
+            auto &[b, next_succ] = stack.back();
+            if (next_succ < succs_[b].size())
+            {
+                const unsigned s = succs_[b][next_succ++].first;
+                if (on_stack[s])
+                    back_edges.push_back({b, s});
+                else if (!reachable_[s])
+                {
+                    reachable_[s] = on_stack[s] = true;
+                    stack.push_back({s, 0});
+                }
+                continue;
+            }
+            on_stack[b] = false;
+            postorder.push_back(b);
+            stack.pop_back();
+        }
+        rpo_.assign(postorder.rbegin(), postorder.rend());
+
+        std::vector<std::vector<unsigned>> preds(n);
+        for (unsigned b = 0; b < n; ++b)
+        {
+            for (const auto &[s, p] : succs_[b])
+                preds[s].push_back(b);
+        }
+        // Back edges to the same header make one loop
+        std::map<unsigned, unsigned> loop_of_header;
+        for (const auto &[latch, header] : back_edges)
+        {
+            auto [it, inserted] = loop_of_header.emplace(header, static_cast<unsigned>(loops_.size()));
+            if (inserted)
+            {
+                loop_headers_.push_back(header);
+                loops_.emplace_back(n, false);
+                loops_.back()[header] = true;
+            }
+            std::vector<bool> &members = loops_[it->second];
+            std::vector<unsigned> worklist;
+            if (!members[latch])
+            {
+                members[latch] = true;
+                worklist.push_back(latch);
+            }
+            while (!worklist.empty())
+            {
+                const unsigned b = worklist.back();
+                worklist.pop_back();
+                for (unsigned p : preds[b])
+                {
+                    if (reachable_[p] && !members[p])
+                    {
+                        members[p] = true;
+                        worklist.push_back(p);
+                    }
+                }
+            }
+        }
+
+        loop_sizes_.resize(loops_.size());
+        for (size_t l = 0; l < loops_.size(); ++l)
+            loop_sizes_[l] = std::count(loops_[l].begin(), loops_[l].end(), true);
+        auto smallest = [&](unsigned b, unsigned than)
+        {
+            unsigned best = NO_LOOP;
+            for (unsigned l = 0; l < loops_.size(); ++l)
+            {
+                if (l == than || !loops_[l][b] || (than != NO_LOOP && loop_sizes_[l] <= loop_sizes_[than]))
+                    continue;
+                if (best == NO_LOOP || loop_sizes_[l] < loop_sizes_[best])
+                    best = l;
+            }
+            return best;
+        };
+        for (unsigned b = 0; b < n; ++b)
+            loop_of_[b] = smallest(b, NO_LOOP);
+        loop_parent_.resize(loops_.size());
+        for (unsigned l = 0; l < loops_.size(); ++l)
+            loop_parent_[l] = smallest(loop_headers_[l], l);
+    }
+
+    // Whether `b` returns, possibly through a few jumps, without another
+    // conditional branch
+    bool FunctionLayout::returns_soon(unsigned b) const
+    {
+        for (unsigned step = 0; step < RETURN_LOOKAHEAD; ++step)
+        {
+            const BlockExit &exit = exits_[b];
+            if (!exit.next)
+                return true;
+            if (exit.cond)
+                return false;
+            b = index_.at(exit.next);
+        }
+        return false;
+    }
+
+    void FunctionLayout::compute_probabilities()
+    {
+        for (unsigned b = 0; b < blocks_.size(); ++b)
+        {
+            auto &succs = succs_[b];
+            if (succs.size() != 2)
+                continue;
+            const unsigned taken = succs[0].first;
+            const unsigned next = succs[1].first;
+            double p_taken = 0.5;
+
+            const unsigned loop = loop_of_[b];
+            const bool taken_stays = loop != NO_LOOP && loops_[loop][taken];
+            const bool next_stays = loop != NO_LOOP && loops_[loop][next];
+            if (taken_stays != next_stays)
+                p_taken = taken_stays ? 1 - UNLIKELY : UNLIKELY;
+            else if (returns_soon(taken) != returns_soon(next))
+                p_taken = returns_soon(taken) ? UNLIKELY : 1 - UNLIKELY;
+
+            succs[0].second = p_taken;
+            succs[1].second = 1 - p_taken;
+        }
+    }
+
+    // Measured counts replace both heuristics when every reachable block
+    // has one and the function ran at all. Machine blocks only know how
+    // often they ran, so the count of a conditional edge is read off a
+    // successor that is reached from nowhere else
+    bool FunctionLayout::apply_profile()
+    {
+        const unsigned n = static_cast<unsigned>(blocks_.size());
+        if (!blocks_[0]->has_profile_count() || blocks_[0]->profile_count() == 0)
+            return false;
+        std::vector<unsigned> preds(n, 0);
+        for (unsigned b = 0; b < n; ++b)
+        {
+            if (!reachable_[b])
+                continue;
+            if (!blocks_[b]->has_profile_count())
+                return false;
+            for (const auto &[s, p] : succs_[b])
+                ++preds[s];
+        }
+
+        auto count = [&](unsigned b) { return static_cast<double>(blocks_[b]->profile_count()); };
+        for (unsigned b = 0; b < n; ++b)
+        {
+            auto &succs = succs_[b];
+            if (succs.size() != 2 || count(b) == 0)
+                continue;
+            const unsigned taken = succs[0].first;
+            const unsigned next = succs[1].first;
+            double taken_count;
+            if (preds[taken] == 1)
+                taken_count = count(taken);
+            else if (preds[next] == 1)
+                taken_count = count(b) - count(next);
+            else if (count(taken) + count(next) > 0)
+                taken_count = count(b) * count(taken) / (count(taken) + count(next));
+            else
+                taken_count = count(b) / 2;
+            const double p_taken = std::clamp(taken_count / count(b), 0.0, 1.0);
+            succs[0].second = p_taken;
+            succs[1].second = 1 - p_taken;
+        }
+
+        freq_.assign(n, 0.0);
+        for (unsigned b = 0; b < n; ++b)
+        {
+            if (reachable_[b])
+                freq_[b] = count(b) / count(0);
+        }
+        return true;
+    }
+
+    // Frequencies follow loop by loop, innermost first. Within a loop, the
+    // header gets a mass of 1, which flows along the edges in reverse
+    // postorder, with each inner loop a single node whose exits split the
+    // mass that entered it. What reaches the header again gives the
+    // iterations per entry, 1 / (1 - back)
+    void FunctionLayout::compute_frequencies()
+    {
+        const unsigned n = static_cast<unsigned>(blocks_.size());
+        freq_.assign(n, 0.0);
+        std::vector<std::vector<std::pair<unsigned, double>>> exit_dist(loops_.size());
+
+        // The loop just inside `loop` that holds `b`, or NO_LOOP
+        auto child_loop = [&](unsigned b, unsigned loop)
+        {
+            unsigned l = loop_of_[b];
+            if (l == loop)
+                return NO_LOOP;
+            while (l != NO_LOOP && loop_parent_[l] != loop)
+                l = loop_parent_[l];
+            return l;
+        };
+
+        // NO_LOOP solves the function
+        auto solve = [&](unsigned loop)
+        {
+            auto in_scope = [&](unsigned b) { return loop == NO_LOOP ? reachable_[b] : loops_[loop][b]; };
+            auto node = [&](unsigned b)
+            {
+                const unsigned child = child_loop(b, loop);
+                return child == NO_LOOP ? b : loop_headers_[child];
+            };
+            const unsigned header = loop == NO_LOOP ? 0 : loop_headers_[loop];
+            std::vector<double> mass(n, 0.0);
+            mass[node(header)] = 1;
+            double back = 0;
+            std::map<unsigned, double> exits;
+            for (unsigned x : rpo_)
+            {
+                if (!in_scope(x) || node(x) != x)
+                    continue;
+                const unsigned child = child_loop(x, loop);
+                for (const auto &[t, p] : child == NO_LOOP ? succs_[x] : exit_dist[child])
+                {
+                    const double m = mass[x] * p;
+                    if (loop != NO_LOOP && t == header)
+                        back += m;
+                    else if (in_scope(t))
+                        mass[node(t)] += m;
+                    else
+                        exits[t] += m;
+                }
+            }
+
+            const double scale = loop == NO_LOOP ? 1.0 : 1 / std::max(1 - back, 1 / MAX_LOOP_SCALE);
+            for (unsigned b = 0; b < n; ++b)
+            {
+                if (!in_scope(b))
+                    continue;
+                if (child_loop(b, loop) == NO_LOOP)
+                    freq_[b] = mass[b] * scale;
+                else
+                    freq_[b] *= mass[node(b)] * scale;
+            }
+            if (loop == NO_LOOP)
+                return;
+            double total = 0;
+            for (const auto &[t, m] : exits)
+                total += m;
+            for (const auto &[t, m] : exits)
+                exit_dist[loop].push_back({t, m / total});
+        };
+
+        std::vector<unsigned> by_size(loops_.size());
+        for (unsigned l = 0; l < loops_.size(); ++l)
+            by_size[l] = l;
+        std::stable_sort(by_size.begin(), by_size.end(),
+                         [&](unsigned x, unsigned y) { return loop_sizes_[x] < loop_sizes_[y]; });
+        for (unsigned l : by_size)
+            solve(l);
+        solve(NO_LOOP);
+    }
+
+    std::vector<unsigned> FunctionLayout::build_order() const
+    {
+        struct Edge
+        {
+            unsigned from, to;
+            double weight;
+        };
+        std::vector<Edge> edges;
+        for (unsigned b = 0; b < blocks_.size(); ++b)
+        {
+            if (!reachable_[b])
+                continue;
+            for (const auto &[s, p] : succs_[b])
+            {
+                // The entry has to stay first
+                if (s != 0 && s != b)
+                    edges.push_back({b, s, freq_[b] * p});
+            }
+        }
+        // Hottest first; on ties keep fall-throughs the old layout had
+        std::sort(edges.begin(), edges.end(), [](const Edge &x, const Edge &y)
+                  {
+                      if (x.weight != y.weight)
+                          return x.weight > y.weight;
+                      const bool x_falls = x.to == x.from + 1;
+                      const bool y_falls = y.to == y.from + 1;
+                      if (x_falls != y_falls)
+                          return x_falls;
+                      return std::make_pair(x.from, x.to) < std::make_pair(y.from, y.to);
+                  });
+
+        std::vector<std::vector<unsigned>> chains(blocks_.size());
+        std::vector<unsigned> chain_of(blocks_.size());
+        for (unsigned b = 0; b < blocks_.size(); ++b)
+        {
+            chains[b] = {b};
+            chain_of[b] = b;
+        }
+        for (const Edge &edge : edges)
+        {
+            const unsigned from = chain_of[edge.from];
+            const unsigned to = chain_of[edge.to];
+            if (from == to || chains[from].back() != edge.from || chains[to].front() != edge.to)
+                continue;
+            for (unsigned b : chains[to])
+                chain_of[b] = from;
+            chains[from].insert(chains[from].end(), chains[to].begin(), chains[to].end());
+            chains[to].clear();
+        }
+
+        std::vector<std::pair<double, unsigned>> rest; // (hottest block, chain)
+        for (unsigned c = 0; c < chains.size(); ++c)
+        {
+            if (chains[c].empty() || c == chain_of[0])
+                continue;
+            double hottest = 0;
+            for (unsigned b : chains[c])
+                hottest = std::max(hottest, freq_[b]);
+            rest.push_back({hottest, c});
+        }
+        std::stable_sort(rest.begin(), rest.end(), [&](const auto &x, const auto &y)
+                         {
+                             if (x.first != y.first)
+                                 return x.first > y.first;
+                             return chains[x.second].front() < chains[y.second].front();
+                         });
+
+        std::vector<unsigned> order = chains[chain_of[0]];
+        for (const auto &[hottest, c] : rest)
+            order.insert(order.end(), chains[c].begin(), chains[c].end());
+        return order;
+    }
+
+    void FunctionLayout::rewrite(MachineBasicBlock *mbb, const BlockExit &exit, MachineBasicBlock *next,
+                                 PlacementStats &stats)
+    {
+        if (!exit.next)
+            return;
+        auto remove_jump = [&]
+        {
+            if (!exit.jump)
+                return;
+            mbb->erase(mbb->locate(exit.jump));
+            ++stats.removed_jumps;
+        };
+        auto ensure_jump = [&]
+        {
+            if (exit.jump)
+                return;
+            mbb->append(tii_.build_jump(exit.next));
+            ++stats.inserted_jumps;
+        };
+
+        if (exit.next == next)
+            remove_jump();
+        else if (exit.cond && exit.taken == next)
+        {
+            // Branch on the opposite condition to where the jump went
+            std::vector<MOperand> ops(exit.cond->operands().begin(), exit.cond->operands().end());
+            ops[target_operand(*exit.cond)] = MOperand::create_basic_block(exit.next);
+            mbb->insert(mbb->locate(exit.cond),
+                        rebuild(*exit.cond, tii_.get_inverse_branch_opcode(exit.cond->opcode()), ops));
+            mbb->erase(mbb->locate(exit.cond));
+            ++stats.inverted_branches;
+            remove_jump();
+        }
+        else
+            ensure_jump();
+    }
+
+    PlacementStats FunctionLayout::place()
+    {
+        PlacementStats stats;
+        const std::vector<unsigned> order = build_order();
+        std::vector<MachineBasicBlock *> layout;
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            layout.push_back(blocks_[order[i]]);
+            if (order[i] != i)
+                ++stats.moved_blocks;
+        }
+        mf_.reorder_blocks(layout);
+        for (size_t i = 0; i < layout.size(); ++i)
+        {
+            MachineBasicBlock *next = i + 1 < layout.size() ? layout[i + 1] : nullptr;
+            rewrite(layout[i], exits_[order[i]], next, stats);
+        }
+        return stats;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Block Placement
+//===----------------------------------------------------------------------===//
+
+std::unordered_map<const MachineBasicBlock *, double> estimate_block_frequencies(MachineFunction &mf)
+{
+    std::unordered_map<const MachineBasicBlock *, double> result;
+    const TargetInstInfo *tii = mf.parent()->target_inst_info();
+    if (!tii)
+        return result;
+    FunctionLayout layout(mf, *tii);
+    if (!layout.analyze())
+        return result;
+    for (unsigned b = 0; b < layout.blocks().size(); ++b)
+    {
+        if (layout.is_reachable(b))
+            result.emplace(layout.blocks()[b], layout.frequency(b));
+    }
+    return result;
+}
+
+PlacementStats place_blocks(MachineFunction &mf)
+{
+    MachineInstPoolScope pool(mf);
+    const TargetInstInfo *tii = mf.parent()->target_inst_info();
+    if (!tii || mf.basic_blocks().size() < 2)
+        return {};
+    // Without a way to add jumps no layout but the current one is safe
+    if (!tii->build_jump(mf.basic_blocks().front().get()))
+        return {};
+    FunctionLayout layout(mf, *tii);
+    if (!layout.analyze())
+        return {};
+    return layout.place();
+}
@@ -0,0 +1,52 @@
+// block_placement.h - Static branch prediction and basic block layout
+#pragma once
+
+#include <unordered_map>
+
+#include "machine.h"
+
+//===----------------------------------------------------------------------===//
+//                             Block Placement
+//===----------------------------------------------------------------------===//
+//
+// Instruction selection lays blocks out in creation order, with edge blocks
+// for phi copies at the end, so loop bodies and cold paths end up
+// interleaved. Placement estimates how often each block runs and lays out
+// the function again, so the likely successor of each block follows it.
+//
+// Branch probabilities come from two static heuristics, after LLVM and Ball
+// and Larus: branches leaving a loop are unlikely, and so are branches to a
+// block that returns without branching again, as early returns do. Block
+// frequencies follow from solving the flow equations over them. Blocks are
+// then joined into chains along the hottest edges first (Pettis-Hansen),
+// which keeps loop bodies together and, where the layout before allowed,
+// rotates loops so the back edge falls through into the test. The entry's
+// chain comes first and the others follow from hottest to coldest.
+//
+// With a profile applied (transforms/profile.h), instruction selection
+// carries block counts over to the machine blocks. When every reachable
+// block has one, the counts give the frequencies and the probabilities
+// instead, and the heuristics only fill in for functions without them.
+//
+// Finally the terminators are fixed up: jumps to the next block go, a
+// conditional branch to it is inverted to target the other successor, and
+// blocks that lose their fall-through gain a jump. Functions with a
+// terminator analyze_branch can't describe, or on targets without
+// get_inverse_branch_opcode and build_jump, are left alone.
+
+struct PlacementStats
+{
+    unsigned moved_blocks = 0; // blocks whose position changed
+    unsigned inverted_branches = 0;
+    unsigned removed_jumps = 0;
+    unsigned inserted_jumps = 0;
+};
+
+// Expected executions of each reachable block per call, with the target of
+// the function's MachineModule. Block successors aren't needed
+std::unordered_map<const MachineBasicBlock *, double> estimate_block_frequencies(MachineFunction &mf);
+
+// Lays out the blocks of `mf`, with the target of its MachineModule. Block
+// successor lists stay valid. Meant to run last, once no pass adds control
+// flow of its own
+PlacementStats place_blocks(MachineFunction &mf);
@@ -0,0 +1,507 @@
+#include "compile_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+// What a program declares under each name
+struct FunctionKeys::Declarations
+{
+    std::unordered_map<std::string, std::vector<const ast::FunctionDecl *>> functions;
+    // Methods by their name without the receiver, which is all that
+    // `obj.method()` holds
+    std::unordered_map<std::string, std::vector<const ast::FunctionDecl *>> methods;
+    std::unordered_map<std::string, const ast::GlobalDecl *> globals;
+    std::unordered_map<std::string, const ast::StructDecl *> structs;
+    std::unordered_map<std::string, const ast::TypeAliasDecl *> aliases;
+};
+
+namespace
+{
+    constexpr uint32_t CACHE_ENTRY_MAGIC = 0x43434F4D; // "MOCC"
+    constexpr size_t CACHE_HEADER_SIZE = 4 + 3 * 8;
+    constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+    constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+    bool fail(std::string *err_msg, std::string message)
+    {
+        if (err_msg)
+            *err_msg = std::move(message);
+        return false;
+    }
+
+    uint64_t checksum(std::span<const uint8_t> bytes)
+    {
+        uint64_t h = FNV_OFFSET;
+        for (uint8_t byte : bytes)
+        {
+            h ^= byte;
+            h *= FNV_PRIME;
+        }
+        return h;
+    }
+
+    void put(std::vector<uint8_t> &out, uint64_t value, unsigned size)
+    {
+        for (unsigned i = 0; i < size; ++i)
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    uint64_t get(std::span<const uint8_t> bytes, size_t offset, unsigned size)
+    {
+        uint64_t value = 0;
+        for (unsigned i = 0; i < size; ++i)
+            value |= uint64_t(bytes[offset + i]) << (8 * i);
+        return value;
+    }
+
+    //===------------------------------------------------------------------===//
+    //                         Key Hashing
+    //===------------------------------------------------------------------===//
+
+    // Takes in a function tree node by node; a node it doesn't know makes
+    // the function uncacheable rather than risk two trees sharing a key
+    class KeyHasher
+    {
+    public:
+        explicit KeyHasher(const FunctionKeys::Declarations &decls) : decls_(decls) { mix(FUNCTION_KEY_VERSION); }
+
+        void function(const ast::FunctionDecl &func);
+        void dependencies();
+
+        bool ok() const { return ok_; }
+        uint64_t key() const { return h_; }
+
+    private:
+        void mix(uint64_t value);
+        void mix(const std::string &str);
+        void name(const std::string &name);
+        void type(const ast::Type *type);
+        void type_names(const ast::Type &type);
+        void signature(const ast::FunctionDecl &func, bool param_names);
+        void expr(const ast::Expr *expr);
+        void stmt(const ast::Statement *stmt);
+
+        const FunctionKeys::Declarations &decls_;
+
+        // Names met so far, in the order they were met
+        std::vector<std::string> names_;
+        std::unordered_set<std::string> seen_;
+
+        uint64_t h_ = FNV_OFFSET;
+        bool ok_ = true;
+    };
+
+    void KeyHasher::mix(uint64_t value)
+    {
+        for (unsigned i = 0; i < 8; ++i)
+        {
+            h_ ^= (value >> (8 * i)) & 0xff;
+            h_ *= FNV_PRIME;
+        }
+    }
+
+    void KeyHasher::mix(const std::string &str)
+    {
+        mix(str.size());
+        for (char c : str)
+        {
+            h_ ^= static_cast<uint8_t>(c);
+            h_ *= FNV_PRIME;
+        }
+    }
+
+    void KeyHasher::name(const std::string &name)
+    {
+        mix(name);
+        if (seen_.insert(name).second)
+            names_.push_back(name);
+    }
+
+    void KeyHasher::type(const ast::Type *type)
+    {
+        if (!type)
+            return mix(std::string());
+        mix(type->to_string());
+        type_names(*type);
+    }
+
+    // Structs and aliases are written by name, so what they stand for comes
+    // in with the dependencies
+    void KeyHasher::type_names(const ast::Type &type)
+    {
+        if (const ast::QualifiedType *qualified = type.as_qualified())
+            return type_names(qualified->base_type());
+        if (const ast::PointerType *pointer = type.as_pointer())
+            return type_names(pointer->pointee());
+        if (const ast::ArrayType *array = type.as_array())
+            return type_names(array->element_type());
+        if (const ast::StructType *st = type.as_struct())
+        {
+            if (seen_.insert(st->name()).second)
+                names_.push_back(st->name());
+            return;
+        }
+        if (const ast::AliasType *alias = type.as_alias())
+        {
+            if (seen_.insert(alias->name()).second)
+                names_.push_back(alias->name());
+            return;
+        }
+        if (const ast::TupleType *tuple = type.as_tuple())
+        {
+            for (const auto &element : tuple->element_types())
+                type_names(*element);
+            return;
+        }
+        if (const ast::FunctionType *func = type.as_function())
+        {
+            type_names(func->return_type());
+            for (const auto &param : func->params())
+                type_names(*param);
+        }
+    }
+
+    // Callers don't see the names of the parameters, except for `this`
+    void KeyHasher::signature(const ast::FunctionDecl &func, bool param_names)
+    {
+        mix(func.name);
+        type(func.return_type.get());
+        mix(func.params.size());
+        for (const ast::TypedField &param : func.params)
+        {
+            if (param_names || param.name == "this" || param.name == "self")
+                mix(param.name);
+            type(param.type.get());
+        }
+        type(func.receiver_type.get());
+        mix(uint64_t(func.is_method) | uint64_t(func.is_static) << 1);
+    }
+
+    void KeyHasher::function(const ast::FunctionDecl &func)
+    {
+        signature(func, true);
+        mix(func.body.size());
+        for (const auto &statement : func.body)
+            stmt(statement.get());
+    }
+
+    void KeyHasher::expr(const ast::Expr *expr)
+    {
+        if (!expr)
+            return mix(std::string());
+        mix(expr->name());
+        mix(uint64_t(expr->expr_category));
+        type(expr->type.get());
+
+        auto exprs = [&](const std::vector<ast::ExprPtr> &list)
+        {
+            mix(list.size());
+            for (const auto &element : list)
+                this->expr(element.get());
+        };
+
+        if (auto *var = dynamic_cast<const ast::VariableExpr *>(expr))
+            name(var->identifier);
+        else if (auto *lit = dynamic_cast<const ast::IntegerLiteralExpr *>(expr))
+            mix(uint64_t(int64_t(lit->value)));
+        else if (auto *lit = dynamic_cast<const ast::BooleanLiteralExpr *>(expr))
+            mix(lit->value);
+        else if (auto *lit = dynamic_cast<const ast::FloatLiteralExpr *>(expr))
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &lit->value, sizeof(bits));
+            mix(bits);
+        }
+        else if (auto *lit = dynamic_cast<const ast::StringLiteralExpr *>(expr))
+            mix(lit->value);
+        else if (auto *lit = dynamic_cast<const ast::StructLiteralExpr *>(expr))
+        {
+            name(lit->struct_name);
+            mix(lit->members.size());
+            for (const auto &[member, value] : lit->members)
+            {
+                mix(member);
+                this->expr(value.get());
+            }
+        }
+        else if (auto *bin = dynamic_cast<const ast::BinaryExpr *>(expr))
+        {
+            mix(uint64_t(bin->op));
+            this->expr(bin->left.get());
+            this->expr(bin->right.get());
+        }
+        else if (auto *unary = dynamic_cast<const ast::UnaryExpr *>(expr))
+        {
+            mix(uint64_t(unary->op));
+            this->expr(unary->operand.get());
+        }
+        else if (auto *call = dynamic_cast<const ast::CallExpr *>(expr))
+        {
+            this->expr(call->callee.get());
+            exprs(call->args);
+        }
+        else if (auto *access = dynamic_cast<const ast::MemberAccessExpr *>(expr))
+        {
+            this->expr(access->object.get());
+            name(access->member);
+            mix(uint64_t(access->accessor));
+            mix(uint64_t(access->is_call) | uint64_t(access->is_method_call) << 1 |
+                uint64_t(access->is_indirect_call) << 2);
+            exprs(access->args);
+            if (access->resolved_func)
+                name(access->resolved_func->name);
+        }
+        else if (auto *index = dynamic_cast<const ast::ArrayAccessExpr *>(expr))
+        {
+            this->expr(index->array.get());
+            this->expr(index->index.get());
+        }
+        else if (auto *cast = dynamic_cast<const ast::CastExpr *>(expr))
+        {
+            type(cast->target_type.get());
+            this->expr(cast->expr.get());
+        }
+        else if (auto *size = dynamic_cast<const ast::SizeofExpr *>(expr))
+        {
+            mix(uint64_t(size->kind));
+            if (size->kind == ast::SizeofExpr::Kind::Type)
+                type(size->target_type.get());
+            else
+                this->expr(size->target_expr.get());
+        }
+        else if (auto *tuple = dynamic_cast<const ast::TupleExpr *>(expr))
+            exprs(tuple->elements);
+        else if (auto *address = dynamic_cast<const ast::AddressOfExpr *>(expr))
+            this->expr(address->operand.get());
+        else if (auto *deref = dynamic_cast<const ast::DerefExpr *>(expr))
+            this->expr(deref->operand.get());
+        else if (auto *list = dynamic_cast<const ast::InitListExpr *>(expr))
+            exprs(list->members);
+        else if (auto *pointer = dynamic_cast<const ast::FunctionPointerExpr *>(expr))
+        {
+            mix(pointer->param_types.size());
+            for (const auto &param : pointer->param_types)
+                type(param.get());
+            type(pointer->return_type.get());
+        }
+        else
+            ok_ = false;
+    }
+
+    void KeyHasher::stmt(const ast::Statement *stmt)
+    {
+        if (!stmt)
+            return mix(std::string());
+
+        if (auto *block = dynamic_cast<const ast::BlockStmt *>(stmt))
+        {
+            mix("block");
+            mix(block->statements.size());
+            for (const auto &statement : block->statements)
+                this->stmt(statement.get());
+        }
+        else if (dynamic_cast<const ast::GlobalDecl *>(stmt))
+            ok_ = false;
+        else if (auto *decl = dynamic_cast<const ast::VarDeclStmt *>(stmt))
+        {
+            mix("let");
+            mix(decl->is_const);
+            mix(decl->name);
+            type(decl->type.get());
+            expr(decl->init_expr.get());
+        }
+        else if (auto *ret = dynamic_cast<const ast::ReturnStmt *>(stmt))
+        {
+            mix("return");
+            expr(ret->value.get());
+        }
+        else if (auto *branch = dynamic_cast<const ast::IfStmt *>(stmt))
+        {
+            mix("if");
+            expr(branch->condition.get());
+            this->stmt(branch->then_branch.get());
+            this->stmt(branch->else_branch.get());
+        }
+        else if (auto *loop = dynamic_cast<const ast::WhileStmt *>(stmt))
+        {
+            mix("while");
+            expr(loop->condition.get());
+            this->stmt(loop->body.get());
+        }
+        else if (dynamic_cast<const ast::BreakStmt *>(stmt))
+            mix("break");
+        else if (dynamic_cast<const ast::ContinueStmt *>(stmt))
+            mix("continue");
+        else if (auto *expr_stmt = dynamic_cast<const ast::ExprStmt *>(stmt))
+        {
+            mix("expr");
+            expr(expr_stmt->expr.get());
+        }
+        else
+            ok_ = false;
+    }
+
+    // Each name met in the body, or in a declaration it brought in, adds
+    // whatever the program declares under it. A name declaring nothing
+    // still counts, so declaring it later changes the key
+    void KeyHasher::dependencies()
+    {
+        for (size_t i = 0; i < names_.size(); ++i)
+        {
+            const std::string current = names_[i];
+            mix(current);
+            if (auto it = decls_.functions.find(current); it != decls_.functions.end())
+            {
+                for (const ast::FunctionDecl *func : it->second)
+                    signature(*func, false);
+            }
+            if (auto it = decls_.methods.find(current); it != decls_.methods.end())
+            {
+                for (const ast::FunctionDecl *method : it->second)
+                    signature(*method, false);
+            }
+            if (auto it = decls_.globals.find(current); it != decls_.globals.end())
+            {
+                mix("global");
+                mix(it->second->is_const);
+                type(it->second->type.get());
+                expr(it->second->init_expr.get());
+            }
+            if (auto it = decls_.structs.find(current); it != decls_.structs.end())
+            {
+                mix("struct");
+                mix(it->second->fields.size());
+                for (const ast::TypedField &field : it->second->fields)
+                {
+                    mix(field.name);
+                    type(field.type.get());
+                }
+            }
+            if (auto it = decls_.aliases.find(current); it != decls_.aliases.end())
+            {
+                mix("alias");
+                type(it->second->type.get());
+            }
+        }
+    }
+} // namespace
+
+//===----------------------------------------------------------------------===//
+//                             Cache Implementation
+//===----------------------------------------------------------------------===//
+
+std::unique_ptr<CompilationCache> CompilationCache::open(std::string directory, std::string *err_msg)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(directory, ec);
+    if (ec || !std::filesystem::is_directory(directory))
+        return fail(err_msg, "cannot create cache directory `" + directory + "`"), nullptr;
+    return std::unique_ptr<CompilationCache>(new CompilationCache(std::move(directory)));
+}
+
+std::string CompilationCache::path_for(uint64_t key) const
+{
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(directory_) / name).string();
+}
+
+std::optional<std::vector<uint8_t>> CompilationCache::lookup(uint64_t key) const
+{
+    std::ifstream in(path_for(key), std::ios::binary);
+    std::vector<uint8_t> bytes;
+    if (in)
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+
+    std::span<const uint8_t> entry(bytes);
+    if (entry.size() < CACHE_HEADER_SIZE || get(entry, 0, 4) != CACHE_ENTRY_MAGIC || get(entry, 4, 8) != key ||
+        get(entry, 12, 8) != entry.size() - CACHE_HEADER_SIZE ||
+        get(entry, 20, 8) != checksum(entry.subspan(CACHE_HEADER_SIZE)))
+    {
+        ++misses_;
+        return std::nullopt;
+    }
+    ++hits_;
+    return std::vector<uint8_t>(entry.begin() + CACHE_HEADER_SIZE, entry.end());
+}
+
+bool CompilationCache::store(uint64_t key, std::span<const uint8_t> bytes, std::string *err_msg)
+{
+    std::vector<uint8_t> entry;
+    entry.reserve(CACHE_HEADER_SIZE + bytes.size());
+    put(entry, CACHE_ENTRY_MAGIC, 4);
+    put(entry, key, 8);
+    put(entry, bytes.size(), 8);
+    put(entry, checksum(bytes), 8);
+    entry.insert(entry.end(), bytes.begin(), bytes.end());
+
+    // Unique to this store, whichever build or thread it comes from
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    const std::string path = path_for(key);
+    const std::string temp = path + ".tmp" + std::to_string(rng());
+    {
+        std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(entry.data()), static_cast<std::streamsize>(entry.size()));
+        if (!out.good())
+        {
+            std::error_code ec;
+            std::filesystem::remove(temp, ec);
+            return fail(err_msg, "cannot write `" + temp + "`");
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec)
+    {
+        std::filesystem::remove(temp, ec);
+        return fail(err_msg, "cannot write `" + path + "`");
+    }
+    ++stores_;
+    return true;
+}
+
+//===----------------------------------------------------------------------===//
+//                             Key Implementation
+//===----------------------------------------------------------------------===//
+
+FunctionKeys::FunctionKeys(const ast::Program &program) : decls_(std::make_unique<Declarations>())
+{
+    for (const auto &func : program.functions)
+        decls_->functions[func->name].push_back(func.get());
+    for (const auto &impl : program.impl_blocks)
+    {
+        for (const auto &method : impl->methods)
+        {
+            decls_->functions[method->name].push_back(method.get());
+            if (size_t colons = method->name.rfind("::"); colons != std::string::npos)
+                decls_->methods[method->name.substr(colons + 2)].push_back(method.get());
+        }
+    }
+    for (const auto &global : program.globals)
+        decls_->globals.emplace(global->name, global.get());
+    for (const auto &decl : program.structs)
+        decls_->structs.emplace(decl->name, decl.get());
+    for (const auto &alias : program.aliases)
+        decls_->aliases.emplace(alias->name, alias.get());
+}
+
+FunctionKeys::~FunctionKeys() = default;
+
+std::optional<uint64_t> FunctionKeys::key(const ast::FunctionDecl &func) const
+{
+    KeyHasher hasher(*decls_);
+    hasher.function(func);
+    hasher.dependencies();
+    if (!hasher.ok())
+        return std::nullopt;
+    return hasher.key();
+}
@@ -0,0 +1,76 @@
+// compile_cache.h - Persistent cache of what a build has lowered, by content
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+
+//===----------------------------------------------------------------------===//
+//                             Compilation Cache
+//===----------------------------------------------------------------------===//
+//
+// One file per key under a directory, so that separate builds share what
+// they have compiled. An entry is written under a temporary name and then
+// renamed into place, so builds and threads running at once only ever see
+// whole entries. An entry that is cut short, fails its checksum or was
+// stored for another key reads as a miss.
+
+class CompilationCache
+{
+public:
+    // Creates `directory` if it doesn't exist
+    static std::unique_ptr<CompilationCache> open(std::string directory, std::string *err_msg = nullptr);
+
+    const std::string &directory() const { return directory_; }
+
+    // The bytes stored for `key`, or nothing
+    std::optional<std::vector<uint8_t>> lookup(uint64_t key) const;
+    bool store(uint64_t key, std::span<const uint8_t> bytes, std::string *err_msg = nullptr);
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t stores() const { return stores_; }
+
+private:
+    explicit CompilationCache(std::string directory) : directory_(std::move(directory)) {}
+    std::string path_for(uint64_t key) const;
+
+    std::string directory_;
+    mutable std::atomic<size_t> hits_ = 0;
+    mutable std::atomic<size_t> misses_ = 0;
+    std::atomic<size_t> stores_ = 0;
+};
+
+//===----------------------------------------------------------------------===//
+//                             Keys
+//===----------------------------------------------------------------------===//
+
+// Bump when lowering changes what a function turns into, so entries left
+// by older builds stop matching
+constexpr uint64_t FUNCTION_KEY_VERSION = 1;
+
+// Keys for what the functions of `program` lower to. A key covers the
+// function's own tree, with the types the checker gave it, and what the
+// program declares under the names it can reach: the signatures of the
+// functions and methods it names, the globals it names and the structs and
+// aliases any of those are made of
+class FunctionKeys
+{
+public:
+    explicit FunctionKeys(const ast::Program &program);
+    ~FunctionKeys();
+
+    // Nothing if `func` holds a node the key doesn't know how to take in
+    std::optional<uint64_t> key(const ast::FunctionDecl &func) const;
+
+    struct Declarations;
+
+private:
+    std::unique_ptr<Declarations> decls_;
+};
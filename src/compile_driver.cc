@@ -0,0 +1,668 @@
+// compile_driver.cc - Compiles many Mo files at once, stage by stage on a shared pool
+#include "compile_driver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include "ir_generator.h"
+#include "ir_printer.h"
+#include "isel.h"
+#include "mo_debug.h"
+#include "parser.h"
+#include "phase_stats.h"
+#include "reg_alloc/module_allocator.h"
+#include "targets/asimov_emitter.h"
+#include "targets/asimov_isel.h"
+#include "targets/asimov_target.h"
+#include "targets/riscv_emitter.h"
+#include "targets/riscv_isel.h"
+#include "targets/riscv_target.h"
+#include "transforms/inliner.h"
+#include "transforms/loop_passes.h"
+#include "transforms/pass_manager.h"
+#include "transforms/sroa.h"
+#include "type_checker.h"
+
+const char *compile_stage_name(CompileStage stage)
+{
+    switch (stage)
+    {
+    case CompileStage::Frontend:
+        return "frontend";
+    case CompileStage::Optimize:
+        return "optimize";
+    case CompileStage::Select:
+        return "select";
+    case CompileStage::Codegen:
+        return "codegen";
+    }
+    return "<invalid>";
+}
+
+namespace
+{
+    // What a file is assumed to hold at its peak (AST, IR and machine code
+    // together) per byte of source, for the memory budget
+    constexpr size_t BYTES_PER_SOURCE_BYTE = 64;
+
+    // The ASIMOV frame is its total size below R7, with nothing to protect
+    class DriverFrameLowering : public ASIMOV::ASIMOVFrameLowering
+    {
+    public:
+        int get_frame_index_offset(const MachineFunction &mf, int frame_index) const override
+        {
+            return static_cast<int>(mf.frame()->get_frame_index_offset(frame_index));
+        }
+        FrameLayout compute_frame_layout(const MachineFunction &mf) const override
+        {
+            return {static_cast<int>(mf.frame()->get_total_frame_size()), 0};
+        }
+        void emit_stack_protector(MachineFunction &, int) const override {}
+    };
+
+    // Target descriptions, built once and only read by the workers
+    struct Backend
+    {
+        DriverTarget target;
+        std::unique_ptr<TargetRegisterInfo> tri;
+        std::unique_ptr<TargetInstInfo> tii;
+        std::unique_ptr<TargetISelInfo> isel;
+        std::unique_ptr<TargetFrameLowering> frame_lowering;
+
+        explicit Backend(DriverTarget target) : target(target)
+        {
+            if (target == DriverTarget::ASIMOV)
+            {
+                auto asimov_tii = std::make_unique<ASIMOV::ASIMOVTargetInstInfo>();
+                isel = std::make_unique<ASIMOV::ASIMOVISelInfo>(asimov_tii.get());
+                tri = std::make_unique<ASIMOV::ASIMOVRegisterInfo>();
+                tii = std::move(asimov_tii);
+                frame_lowering = std::make_unique<DriverFrameLowering>();
+            }
+            else
+            {
+                auto riscv_tii = std::make_unique<RISCV::RISCVTargetInstInfo>();
+                isel = std::make_unique<RISCV::RISCVISelInfo>(riscv_tii.get());
+                tri = std::make_unique<RISCV::RISCVRegisterInfo>();
+                frame_lowering = std::make_unique<RISCV::RISCVFrameLowering>(riscv_tii.get());
+                tii = std::move(riscv_tii);
+            }
+        }
+
+        // What the target can't emit yet. The ASIMOV ISA has no indirect
+        // jump to return through, so the emitter makes CALL a plain JMP and
+        // RET a HALT; only tail calls, which never come back, come out right
+        bool check(const MachineFunction &mf, std::string *err_msg) const
+        {
+            if (target != DriverTarget::ASIMOV)
+                return true;
+            for (const auto &mbb : mf.basic_blocks())
+            {
+                for (const auto &mi : mbb->instructions())
+                {
+                    if (!mi->has_flag(MIFlag::Call) || mi->is_tail_call())
+                        continue;
+                    const std::string callee = mi->operands()[0].is_external_sym() ? mi->operands()[0].external_sym() : "";
+                    *err_msg = "call to `" + callee + "` is not supported on ASIMOV, which has no return sequence";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // The same, on the IR before selection: ASIMOV branches only on zero
+        // and non-zero, so an ordering compare has nothing to select into
+        bool check(const Function &f, std::string *err_msg) const
+        {
+            if (target != DriverTarget::ASIMOV)
+                return true;
+            for (BasicBlock *bb : f.basic_blocks())
+            {
+                for (const Instruction &inst : *bb)
+                {
+                    std::string_view predicate;
+                    if (const auto *icmp = dynamic_cast<const ICmpInst *>(&inst))
+                    {
+                        if (icmp->predicate() == ICmpInst::EQ || icmp->predicate() == ICmpInst::NE)
+                            continue;
+                        predicate = IRPrinter::predicate_name(icmp->predicate());
+                    }
+                    else if (const auto *fcmp = dynamic_cast<const FCmpInst *>(&inst))
+                        predicate = IRPrinter::predicate_name(fcmp->predicate());
+                    else
+                        continue;
+                    *err_msg = "`" + std::string(predicate) + "` compare in block `" + bb->name() +
+                               "` is not supported on ASIMOV, which can only branch on == and != of integers";
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // Writes to `path`, or to `bytes` when there is no path
+        bool emit(const MachineModule &mm, const std::string &path, std::vector<uint8_t> &bytes,
+                  std::string *err_msg) const
+        {
+            if (target == DriverTarget::ASIMOV)
+            {
+                ASIMOV::ASIMOVEmitOptions options;
+                if (Function *main = mm.ir_module()->get_function("main"); main && !main->basic_blocks().empty())
+                    options.entry = "main";
+                ASIMOV::ASIMOVImage image;
+                if (!ASIMOV::emit_image(mm, image, options, err_msg))
+                    return false;
+                if (!path.empty())
+                    return image.write_file(path, err_msg);
+                bytes = image.serialize();
+                return true;
+            }
+
+            RISCV::RISCVObject object;
+            if (!RISCV::emit_object(mm, object, {}, err_msg))
+                return false;
+            if (!path.empty())
+                return object.write_file(path, err_msg);
+            bytes = object.to_elf();
+            return true;
+        }
+    };
+
+    double seconds_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A file between stages. Only the task of its current stage touches it,
+    // except during Select, when each task owns one function
+    struct FileJob
+    {
+        const CompileInput *input = nullptr;
+        CompileResult *result = nullptr;
+        size_t reservation = 0;
+        std::chrono::steady_clock::time_point started;
+
+        std::string source;
+        std::unique_ptr<ast::Program> program;
+        std::unique_ptr<Module> module;
+        std::unique_ptr<MachineModule> mm;
+
+        // Select, indexed like the functions it lowers
+        std::vector<Function *> funcs;
+        std::vector<MachineFunction *> mfs;
+        std::vector<std::string> select_errors;
+        std::vector<char> select_ok;
+        std::atomic<size_t> functions_left{0};
+        std::mutex select_time_mutex;
+
+        void fail(const std::string &message) { result->errors.push_back(input->path + ": " + message); }
+    };
+
+    struct Task
+    {
+        FileJob *job = nullptr;
+        CompileStage stage = CompileStage::Frontend;
+        size_t function = 0; // Select only
+    };
+
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    class Scheduler
+    {
+    public:
+        Scheduler(std::span<const CompileInput> inputs, std::vector<CompileResult> &results,
+                  const DriverOptions &options, const Backend &backend, unsigned num_workers)
+            : inputs_(inputs), results_(results), options_(options), backend_(backend), queues_(num_workers)
+        {
+            for (const CompileInput &input : inputs)
+            {
+                size_t size = 0;
+                if (input.source)
+                {
+                    size = input.source->size();
+                }
+                else
+                {
+                    std::error_code ec;
+                    size = static_cast<size_t>(std::filesystem::file_size(input.path, ec));
+                    if (ec)
+                        size = 0; // the frontend reports the file
+                }
+                estimates_.push_back(size * BYTES_PER_SOURCE_BYTE);
+            }
+        }
+
+        void run_worker(unsigned worker)
+        {
+            Task task;
+            while (next_task(worker, task))
+                run(task, worker);
+        }
+
+        const DriverStats &stats() const { return stats_; }
+
+    private:
+        // Own work newest first, then stolen work oldest first, then a new
+        // file; blocks until one of them turns up or everything is done
+        bool next_task(unsigned worker, Task &task)
+        {
+            while (true)
+            {
+                if (pop_own(worker, task) || steal(worker, task))
+                    return true;
+
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (queued_ > 0)
+                    continue; // queued since we looked
+                if (admit_locked(task))
+                    return true;
+                if (next_input_ == inputs_.size() && in_flight_ == 0)
+                {
+                    work_changed_.notify_all();
+                    return false;
+                }
+                work_changed_.wait(lock, [&]
+                                   { return queued_ > 0 || can_admit_locked() ||
+                                            (next_input_ == inputs_.size() && in_flight_ == 0); });
+            }
+        }
+
+        bool pop_own(unsigned worker, Task &task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queues_[worker].mutex);
+                if (queues_[worker].tasks.empty())
+                    return false;
+                task = queues_[worker].tasks.back();
+                queues_[worker].tasks.pop_back();
+            }
+            std::lock_guard<std::mutex> lock(mutex_);
+            --queued_;
+            return true;
+        }
+
+        bool steal(unsigned worker, Task &task)
+        {
+            for (size_t i = 1; i < queues_.size(); ++i)
+            {
+                WorkerQueue &victim = queues_[(worker + i) % queues_.size()];
+                {
+                    std::lock_guard<std::mutex> lock(victim.mutex);
+                    if (victim.tasks.empty())
+                        continue;
+                    task = victim.tasks.front();
+                    victim.tasks.pop_front();
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                --queued_;
+                ++stats_.steals;
+                return true;
+            }
+            return false;
+        }
+
+        void push(unsigned worker, const Task &task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(queues_[worker].mutex);
+                queues_[worker].tasks.push_back(task);
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++queued_;
+            }
+            work_changed_.notify_one();
+        }
+
+        bool can_admit_locked() const
+        {
+            if (next_input_ == inputs_.size())
+                return false;
+            return options_.memory_budget == 0 || in_flight_ == 0 ||
+                   reserved_ + estimates_[next_input_] <= options_.memory_budget;
+        }
+
+        bool admit_locked(Task &task)
+        {
+            if (!can_admit_locked())
+                return false;
+            const size_t index = next_input_++;
+            auto job = std::make_unique<FileJob>();
+            job->input = &inputs_[index];
+            job->result = &results_[index];
+            job->result->path = inputs_[index].path;
+            job->reservation = estimates_[index];
+            job->started = std::chrono::steady_clock::now();
+            reserved_ += job->reservation;
+            ++in_flight_;
+            stats_.peak_files_in_flight = std::max(stats_.peak_files_in_flight, in_flight_);
+            stats_.peak_reserved_bytes = std::max(stats_.peak_reserved_bytes, reserved_);
+            task = {job.release(), CompileStage::Frontend};
+            return true;
+        }
+
+        void finish(FileJob *job)
+        {
+            job->result->ok = job->result->errors.empty();
+            job->result->wall_seconds = seconds_since(job->started);
+            const size_t reservation = job->reservation;
+            delete job;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                reserved_ -= reservation;
+                --in_flight_;
+            }
+            work_changed_.notify_all();
+        }
+
+        void run(const Task &task, unsigned worker)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                ++stats_.tasks;
+            }
+            FileJob &job = *task.job;
+            const auto start = std::chrono::steady_clock::now();
+            bool more = false;
+            try
+            {
+                switch (task.stage)
+                {
+                case CompileStage::Frontend:
+                    more = run_frontend(job);
+                    break;
+                case CompileStage::Optimize:
+                    more = run_optimize(job);
+                    break;
+                case CompileStage::Select:
+                    run_select(job, task.function);
+                    break;
+                case CompileStage::Codegen:
+                    run_codegen(job);
+                    break;
+                }
+            }
+            catch (const std::exception &error)
+            {
+                if (task.stage == CompileStage::Select)
+                {
+                    job.select_ok[task.function] = false;
+                    job.select_errors[task.function] = error.what();
+                }
+                else
+                {
+                    job.fail(error.what());
+                    more = false;
+                }
+            }
+
+            const double elapsed = seconds_since(start);
+            const unsigned stage = static_cast<unsigned>(task.stage);
+            if (task.stage != CompileStage::Select)
+            {
+                job.result->stage_seconds[stage] += elapsed;
+            }
+            else
+            {
+                {
+                    std::lock_guard<std::mutex> lock(job.select_time_mutex);
+                    job.result->stage_seconds[stage] += elapsed;
+                }
+                // The last function to finish moves the file on
+                if (job.functions_left.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                    return;
+                more = collect_select_errors(job);
+            }
+
+            if (!more)
+            {
+                finish(&job);
+                return;
+            }
+            if (task.stage == CompileStage::Frontend)
+            {
+                push(worker, {&job, CompileStage::Optimize});
+            }
+            else if (task.stage == CompileStage::Optimize && !job.funcs.empty())
+            {
+                // Pushed last to first, so this worker starts on the first
+                // function and thieves take from the end of the module
+                for (size_t i = job.funcs.size(); i-- > 0;)
+                    push(worker, {&job, CompileStage::Select, i});
+            }
+            else
+            {
+                push(worker, {&job, CompileStage::Codegen});
+            }
+        }
+
+        bool run_frontend(FileJob &job)
+        {
+            if (job.input->source)
+            {
+                job.source = *job.input->source;
+            }
+            else
+            {
+                std::ifstream file(job.input->path, std::ios::binary);
+                if (!file)
+                {
+                    job.fail("cannot open file");
+                    return false;
+                }
+                std::ostringstream buffer;
+                buffer << file.rdbuf();
+                job.source = buffer.str();
+            }
+
+            Parser parser{Lexer::borrowed(job.source)};
+            job.program = std::make_unique<ast::Program>(parser.parse());
+            for (const std::string &error : parser.errors())
+                job.fail(error);
+            if (!job.result->errors.empty())
+                return false;
+
+            TypeChecker checker(job.program.get());
+            TypeChecker::TypeCheckResult checked = checker.check();
+            for (const std::string &error : checked.errors)
+                job.fail(error);
+            return checked.ok && job.result->errors.empty();
+        }
+
+        bool run_optimize(FileJob &job)
+        {
+            job.module = std::make_unique<Module>();
+            {
+                IRGenerator generator(job.module.get());
+                generator.set_entry_points(options_.entry_points);
+                generator.generate(*job.program);
+            }
+            lower_aggregate_copies(*job.module);
+            job.program.reset();
+            job.source.clear();
+            job.source.shrink_to_fit();
+
+            if (options_.opt_level > 0)
+            {
+                PassManager pm;
+                add_inliner_passes(pm);
+                if (options_.opt_level > 1)
+                    add_loop_passes(pm, backend_.isel->vector_bytes());
+                pm.run(*job.module);
+            }
+
+            // MachineModule isn't thread-safe, so the functions the Select
+            // tasks fill in are all created here
+            job.mm = std::make_unique<MachineModule>(job.module.get());
+            job.mm->set_target_info(backend_.tri.get(), backend_.tii.get());
+            for (Function *func : job.module->functions())
+            {
+                if (func->basic_blocks().empty())
+                    continue;
+                job.funcs.push_back(func);
+                job.mfs.push_back(job.mm->create_machine_function(func));
+            }
+            job.select_errors.resize(job.funcs.size());
+            job.select_ok.assign(job.funcs.size(), false);
+            job.functions_left.store(job.funcs.size(), std::memory_order_relaxed);
+            job.result->functions = static_cast<unsigned>(job.funcs.size());
+            return true;
+        }
+
+        void run_select(FileJob &job, size_t index)
+        {
+            if (!backend_.check(*job.funcs[index], &job.select_errors[index]))
+                return;
+            job.select_ok[index] = select_function(*backend_.isel, *job.funcs[index], *job.mfs[index],
+                                                   &job.select_errors[index]);
+        }
+
+        // Called once every function is selected, in module order
+        bool collect_select_errors(FileJob &job)
+        {
+            for (size_t i = 0; i < job.funcs.size(); ++i)
+            {
+                if (!job.select_ok[i])
+                    job.fail(job.funcs[i]->name() + ": " + job.select_errors[i]);
+            }
+            return job.result->errors.empty();
+        }
+
+        void run_codegen(FileJob &job)
+        {
+            for (size_t i = 0; i < job.mfs.size(); ++i)
+            {
+                std::string err;
+                if (!backend_.check(*job.mfs[i], &err))
+                    job.fail(job.funcs[i]->name() + ": " + err);
+            }
+            if (!job.result->errors.empty())
+                return;
+            std::vector<FunctionAllocation> allocations =
+                allocate_module(*job.mm, options_.opt_level, backend_.frame_lowering.get());
+            for (const FunctionAllocation &allocation : allocations)
+            {
+                if (!allocation.regalloc.successful)
+                    job.fail(allocation.mf->ir_function()->name() + ": " + allocation.regalloc.error_message);
+            }
+            if (!job.result->errors.empty())
+                return;
+            for (MachineFunction *mf : job.mfs)
+            {
+                resolve_frame_indices(*mf, backend_.isel->frame_register());
+                if (backend_.frame_lowering)
+                    backend_.frame_lowering->legalize_frame_offsets(*mf);
+            }
+
+            std::string err;
+            if (!backend_.emit(*job.mm, job.input->output_path, job.result->output, &err))
+                job.fail(err);
+        }
+
+        std::span<const CompileInput> inputs_;
+        std::vector<CompileResult> &results_;
+        const DriverOptions &options_;
+        const Backend &backend_;
+        std::vector<size_t> estimates_;
+        std::vector<WorkerQueue> queues_;
+
+        // Guards everything below
+        std::mutex mutex_;
+        std::condition_variable work_changed_;
+        size_t queued_ = 0;
+        size_t next_input_ = 0;
+        unsigned in_flight_ = 0;
+        size_t reserved_ = 0;
+        DriverStats stats_;
+    };
+}
+
+std::vector<CompileResult> compile_files(std::span<const CompileInput> inputs, const DriverOptions &options,
+                                         DriverStats *stats)
+{
+    std::vector<CompileResult> results(inputs.size());
+    const Backend backend(options.target);
+    unsigned num_workers = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    num_workers = static_cast<unsigned>(std::min<size_t>(num_workers, std::max<size_t>(inputs.size(), 1)));
+
+    Scheduler scheduler(inputs, results, options, backend, num_workers);
+    std::vector<std::thread> workers;
+    for (unsigned worker = 1; worker < num_workers; ++worker)
+        workers.emplace_back([&scheduler, worker]
+                             { scheduler.run_worker(worker); });
+    scheduler.run_worker(0);
+    for (std::thread &worker : workers)
+        worker.join();
+
+    if (stats)
+        *stats = scheduler.stats();
+    return results;
+}
+
+void print_file_timings(std::span<const CompileResult> results, std::ostream &os)
+{
+    size_t name_width = 4;
+    for (const CompileResult &result : results)
+        name_width = std::max(name_width, result.path.size());
+
+    os << "===-------------------------------------------------------------------------===\n"
+       << "                          Per-file stage report\n"
+       << "===-------------------------------------------------------------------------===\n";
+    os << std::left << std::setw(static_cast<int>(name_width) + 2) << "File" << std::right;
+    for (unsigned stage = 0; stage < NUM_COMPILE_STAGES; ++stage)
+        os << std::setw(12) << compile_stage_name(static_cast<CompileStage>(stage));
+    os << std::setw(12) << "wall" << std::setw(8) << "Funcs" << "  Status\n";
+
+    for (const CompileResult &result : results)
+    {
+        os << std::left << std::setw(static_cast<int>(name_width) + 2) << result.path << std::right
+           << std::fixed << std::setprecision(3);
+        for (double seconds : result.stage_seconds)
+            os << std::setw(12) << seconds * 1e3;
+        os << std::setw(12) << result.wall_seconds * 1e3 << std::setw(8) << result.functions
+           << "  " << (result.ok ? "ok" : "failed") << "\n";
+    }
+    os << "(milliseconds)\n" << std::defaultfloat;
+}
+
+void export_file_timings_to_json(std::span<const CompileResult> results, std::ostream &os)
+{
+    std::stringstream json;
+    json << "{\n";
+    json << "  \"title\": \"Compiled Files\",\n";
+    json << "  \"files\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const CompileResult &result = results[i];
+        json << (i ? ",\n" : "\n");
+        json << "    {\n";
+        json << "      \"path\": \"" << escape_json_string(result.path) << "\",\n";
+        json << "      \"ok\": " << (result.ok ? "true" : "false") << ",\n";
+        json << "      \"functions\": " << result.functions << ",\n";
+        json << "      \"stagesMs\": {";
+        for (unsigned stage = 0; stage < NUM_COMPILE_STAGES; ++stage)
+        {
+            json << (stage ? ", " : "") << "\"" << compile_stage_name(static_cast<CompileStage>(stage)) << "\": "
+                 << std::fixed << std::setprecision(3) << result.stage_seconds[stage] * 1e3;
+        }
+        json << "},\n";
+        json << "      \"wallMs\": " << std::fixed << std::setprecision(3) << result.wall_seconds * 1e3 << "\n";
+        json << "    }";
+    }
+    json << "\n  ]\n";
+    json << "}\n";
+    os << json.str();
+}
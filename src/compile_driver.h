@@ -0,0 +1,99 @@
+// compile_driver.h - Compiles many Mo files at once, stage by stage on a shared pool
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             Compile Driver
+//===----------------------------------------------------------------------===//
+//
+// Each file goes through four stages, each one or more tasks on a pool of
+// workers:
+//   Frontend  read, lex, parse and type check
+//   Optimize  lower to IR and run the pass pipeline of the opt level
+//   Select    instruction selection, one task per function
+//   Codegen   register allocation, frame lowering, then the object or image
+// A worker runs the tasks it queued itself newest first, which keeps a file
+// on the worker that has it in cache, and an idle worker steals the oldest
+// task of another worker. So files at different stages overlap, and the
+// functions of one large file spread over every idle worker.
+//
+// A new file is only started when nothing queued is left to run, so files
+// finish before more are begun. With a memory budget, files also wait
+// while the ones in flight are estimated to use it up. The estimate is a
+// fixed multiple of the source size. One file is always let through, however
+// large.
+
+enum class DriverTarget
+{
+    RISCV,  // RV64 LP64D ELF objects
+    ASIMOV, // ASIMOV images; the ISA can't return from a call, so calls other than tail calls are errors
+};
+
+enum class CompileStage : uint8_t
+{
+    Frontend,
+    Optimize,
+    Select,
+    Codegen,
+};
+
+constexpr unsigned NUM_COMPILE_STAGES = 4;
+
+// "frontend", "optimize", "select" or "codegen"
+const char *compile_stage_name(CompileStage stage);
+
+struct DriverOptions
+{
+    DriverTarget target = DriverTarget::RISCV;
+    unsigned opt_level = 1;
+    unsigned jobs = 0;        // worker threads, 0 for one per hardware core
+    size_t memory_budget = 0; // bytes the files in flight are estimated to need, 0 for no limit
+    // Compile only the functions these reach, see IRGenerator::set_entry_points;
+    // empty compiles every function
+    std::vector<std::string> entry_points = {};
+};
+
+struct CompileInput
+{
+    std::string path;                  // read unless `source` is given; names the file in messages
+    std::optional<std::string> source;
+    std::string output_path;           // empty keeps the output in CompileResult::output
+};
+
+struct CompileResult
+{
+    std::string path;
+    bool ok = false;
+    std::vector<std::string> errors;   // "path: message"
+    std::vector<uint8_t> output;       // ELF object or ASIMOV image, unless it was written out
+    unsigned functions = 0;            // functions selected
+    // Time spent in the tasks of each stage, indexed by CompileStage. Select
+    // adds up tasks that may have run at once on several workers
+    double stage_seconds[NUM_COMPILE_STAGES] = {};
+    double wall_seconds = 0;           // from the file starting to it finishing
+};
+
+struct DriverStats
+{
+    size_t tasks = 0;
+    size_t steals = 0;                 // tasks run by a worker other than the one that queued them
+    unsigned peak_files_in_flight = 0;
+    size_t peak_reserved_bytes = 0;
+};
+
+// Compiles every input on options.jobs workers. Results are in input order
+// and don't depend on the number of workers or the budget; a file that
+// fails doesn't stop the others
+std::vector<CompileResult> compile_files(std::span<const CompileInput> inputs, const DriverOptions &options,
+                                         DriverStats *stats = nullptr);
+
+// One row per file with the seconds of each stage, as a table or as JSON
+void print_file_timings(std::span<const CompileResult> results, std::ostream &os);
+void export_file_timings_to_json(std::span<const CompileResult> results, std::ostream &os);
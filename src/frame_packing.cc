@@ -0,0 +1,303 @@
+#include "frame_packing.h"
+#include "bit_vector.h"
+#include "block_placement.h"
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <unordered_map>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    enum class Access
+    {
+        Load,
+        Store,
+        Other
+    };
+
+    Access access_kind(const MachineInst &mi)
+    {
+        const bool load = mi.has_flag(MIFlag::MayLoad);
+        const bool store = mi.has_flag(MIFlag::MayStore);
+        if (load == store)
+            return Access::Other;
+        return load ? Access::Load : Access::Store;
+    }
+
+    // Spill slots of one function, numbered densely in frame index order
+    class SpillSlots
+    {
+    public:
+        explicit SpillSlots(MachineFunction &mf) : mf_(mf)
+        {
+            for (const auto &[index, object] : mf.frame()->objects())
+            {
+                const bool spill = object.flags & FrameObjectMetadata::IsSpillSlot;
+                if (!spill || (object.flags & FrameObjectMetadata::IsVariableSize) || object.size <= 0)
+                    continue;
+                ids_[index] = static_cast<unsigned>(slots_.size());
+                slots_.push_back(index);
+            }
+            pinned_.resize(slots_.size());
+            interferes_.assign(slots_.size(), BitVector(slots_.size()));
+        }
+
+        size_t size() const { return slots_.size(); }
+        int frame_index(unsigned id) const { return slots_[id]; }
+        // Dense id of the spill slot at `index`, or -1
+        int id(int index) const
+        {
+            auto it = ids_.find(index);
+            return it == ids_.end() ? -1 : static_cast<int>(it->second);
+        }
+
+        void find_pinned();
+        void find_interference();
+        bool interferes(unsigned a, unsigned b) const { return interferes_[a].test(b); }
+        bool is_pinned(unsigned id) const { return pinned_.test(id); }
+
+    private:
+        MachineFunction &mf_;
+        std::vector<int> slots_;
+        std::unordered_map<int, unsigned> ids_;
+        BitVector pinned_;
+        std::vector<BitVector> interferes_;
+
+        void interfere(unsigned slot, const BitVector &live)
+        {
+            live.for_each([&](size_t other)
+                          {
+                              if (other == slot)
+                                  return;
+                              interferes_[slot].set(other);
+                              interferes_[other].set(slot); });
+        }
+
+        // Applies `mi` to `live` going backwards, recording interference
+        // at stores when `record` is set
+        void step(const MachineInst &mi, BitVector &live, bool record);
+    };
+
+    void SpillSlots::find_pinned()
+    {
+        for (const auto &mbb : mf_.basic_blocks())
+        {
+            for (const auto &mi : mbb->instructions())
+            {
+                for (const auto &op : mi->operands())
+                {
+                    int slot = -1;
+                    if (op.is_frame_index())
+                        slot = id(op.frame_index());
+                    else if (op.is_mem_fi() && access_kind(*mi) == Access::Other)
+                        slot = id(op.mem_fi().frame_index);
+                    if (slot >= 0)
+                        pinned_.set(static_cast<size_t>(slot));
+                }
+            }
+        }
+    }
+
+    void SpillSlots::step(const MachineInst &mi, BitVector &live, bool record)
+    {
+        const Access kind = access_kind(mi);
+        for (const auto &op : mi.operands())
+        {
+            if (!op.is_mem_fi())
+                continue;
+            const int slot = id(op.mem_fi().frame_index);
+            if (slot < 0)
+                continue;
+            if (kind == Access::Store)
+            {
+                if (record)
+                    interfere(static_cast<unsigned>(slot), live);
+                if (op.mem_fi().offset == 0)
+                    live.reset(static_cast<size_t>(slot));
+            }
+            else
+            {
+                live.set(static_cast<size_t>(slot));
+            }
+        }
+    }
+
+    void SpillSlots::find_interference()
+    {
+        const auto &blocks = mf_.basic_blocks();
+        const size_t count = blocks.size();
+        std::unordered_map<const MachineBasicBlock *, size_t> block_ids;
+        for (size_t b = 0; b < count; ++b)
+            block_ids[blocks[b].get()] = b;
+
+        // Upward-exposed loads and whole-slot stores of each block
+        std::vector<BitVector> gen(count, BitVector(size())), kill(count, BitVector(size()));
+        for (size_t b = 0; b < count; ++b)
+        {
+            BitVector live(size());
+            const auto &insts = blocks[b]->instructions();
+            for (auto it = insts.rbegin(); it != insts.rend(); ++it)
+            {
+                step(**it, live, false);
+                if (access_kind(**it) != Access::Store)
+                    continue;
+                for (const auto &op : (*it)->operands())
+                {
+                    const int slot = op.is_mem_fi() && op.mem_fi().offset == 0 ? id(op.mem_fi().frame_index) : -1;
+                    if (slot >= 0)
+                        kill[b].set(static_cast<size_t>(slot));
+                }
+            }
+            gen[b] = live;
+        }
+
+        std::vector<BitVector> live_in(count, BitVector(size())), live_out(count, BitVector(size()));
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t b = count; b-- > 0;)
+            {
+                for (MachineBasicBlock *succ : blocks[b]->successors())
+                {
+                    auto it = block_ids.find(succ);
+                    if (it != block_ids.end())
+                        live_out[b].union_with(live_in[it->second]);
+                }
+                changed |= live_in[b].assign_transfer(gen[b], live_out[b], kill[b]);
+            }
+        }
+
+        for (size_t b = 0; b < count; ++b)
+        {
+            BitVector live = live_out[b];
+            const auto &insts = blocks[b]->instructions();
+            for (auto it = insts.rbegin(); it != insts.rend(); ++it)
+                step(**it, live, true);
+        }
+        // Slots read before any store hold whatever was there on entry, all at once
+        if (count > 0)
+        {
+            live_in[0].for_each([&](size_t slot)
+                                { interfere(static_cast<unsigned>(slot), live_in[0]); });
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Frame Packing
+//===----------------------------------------------------------------------===//
+
+FramePackingStats pack_frame_objects(MachineFunction &mf)
+{
+    FramePackingStats stats;
+    MachineFrame &frame = *mf.frame();
+
+    // Accesses per call of every frame object
+    const auto freq = estimate_block_frequencies(mf);
+    std::unordered_map<int, float> weights;
+    for (const auto &mbb : mf.basic_blocks())
+    {
+        float block_weight = 1.0f;
+        if (!freq.empty())
+        {
+            auto it = freq.find(mbb.get());
+            block_weight = it == freq.end() ? 0.0f : static_cast<float>(it->second);
+        }
+        for (const auto &mi : mbb->instructions())
+        {
+            for (const auto &op : mi->operands())
+            {
+                if (op.is_mem_fi())
+                    weights[op.mem_fi().frame_index] += block_weight;
+                else if (op.is_frame_index())
+                    weights[op.frame_index()] += block_weight;
+            }
+        }
+    }
+
+    SpillSlots slots(mf);
+    stats.spill_slots = static_cast<unsigned>(slots.size());
+    if (slots.size() > 1)
+    {
+        slots.find_pinned();
+        slots.find_interference();
+
+        // Hottest slots pick first, so they keep their own index
+        std::vector<unsigned> order(slots.size());
+        std::iota(order.begin(), order.end(), 0u);
+        auto weight = [&](unsigned slot)
+        {
+            auto it = weights.find(slots.frame_index(slot));
+            return it == weights.end() ? 0.0f : it->second;
+        };
+        std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b)
+                         { return weight(a) > weight(b); });
+
+        std::vector<std::vector<unsigned>> colors;
+        std::map<int, int> merged; // frame index -> the slot it now shares
+        for (unsigned slot : order)
+        {
+            if (slots.is_pinned(slot))
+                continue;
+            const FrameObjectMetadata *object = frame.get_frame_object(slots.frame_index(slot));
+            std::vector<unsigned> *color = nullptr;
+            for (auto &members : colors)
+            {
+                const FrameObjectMetadata *leader = frame.get_frame_object(slots.frame_index(members.front()));
+                if (leader->size != object->size || leader->alignment != object->alignment)
+                    continue;
+                const bool clash = std::any_of(members.begin(), members.end(), [&](unsigned member)
+                                               { return slots.interferes(slot, member); });
+                if (!clash)
+                {
+                    color = &members;
+                    break;
+                }
+            }
+            if (!color)
+            {
+                colors.push_back({slot});
+                continue;
+            }
+            const int leader = slots.frame_index(color->front());
+            merged[slots.frame_index(slot)] = leader;
+            color->push_back(slot);
+        }
+
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            for (auto &mi : *mbb)
+            {
+                for (unsigned i = 0; i < mi->operands().size(); ++i)
+                {
+                    MOperand &op = mi->operand(i);
+                    if (!op.is_mem_fi())
+                        continue;
+                    auto it = merged.find(op.mem_fi().frame_index);
+                    if (it != merged.end())
+                        op = MOperand::create_mem_fi(it->second, op.mem_fi().offset);
+                }
+            }
+        }
+        for (const auto &[index, leader] : merged)
+        {
+            stats.merged_slots++;
+            stats.bytes_saved += frame.get_frame_object(index)->size;
+            weights[leader] += weights[index];
+            weights.erase(index);
+            frame.remove_frame_object(index);
+        }
+    }
+
+    for (const auto &[index, object] : frame.objects())
+    {
+        auto it = weights.find(index);
+        frame.set_access_weight(index, it == weights.end() ? 0.0f : it->second);
+    }
+    return stats;
+}
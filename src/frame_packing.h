@@ -0,0 +1,38 @@
+// frame_packing.h - Spill slot coloring and frame access weights
+#pragma once
+
+#include "machine.h"
+
+//===----------------------------------------------------------------------===//
+//                             Frame Packing
+//===----------------------------------------------------------------------===//
+//
+// The allocators give every spilled virtual register a slot of its own, so
+// a function that spills a lot grows a frame far larger than what is ever
+// live at once. Packing runs after the spill code is in place, while the
+// slots are still addressed by frame index, and shares slots the way the
+// allocator shares registers: a backward liveness pass over the slot loads
+// and stores finds which slots hold a value at the same time, and slots of
+// the same size and alignment that never do are colored together, hottest
+// first. Merged slots are removed from the frame.
+//
+// It also records for every frame object how often it is accessed per
+// call, from estimate_block_frequencies, which frame_layout uses to give
+// the hot objects the small offsets.
+//
+// A slot whose address is taken as a FrameIndex operand, or that an
+// instruction touches without being flagged exactly one of MayLoad and
+// MayStore, keeps a slot of its own. A store kills a slot only at offset 0,
+// as the spill code writes whole slots from there.
+
+struct FramePackingStats
+{
+    unsigned spill_slots = 0;  // spill slots before packing
+    unsigned merged_slots = 0; // slots folded into another and removed
+    int64_t bytes_saved = 0;   // their total size
+};
+
+// Colors the spill slots of `mf` and sets the access weight of each frame
+// object, with the target of its MachineModule. Block successor lists must
+// be up to date
+FramePackingStats pack_frame_objects(MachineFunction &mf);
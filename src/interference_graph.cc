@@ -0,0 +1,75 @@
+#include "interference_graph.h"
+
+#include <algorithm>
+
+//===----------------------------------------------------------------------===//
+// Interference Graph Implementation
+//===----------------------------------------------------------------------===//
+
+InterferenceGraph::InterferenceGraph(std::vector<unsigned> regs, std::vector<std::pair<unsigned, unsigned>> edges)
+    : regs_(std::move(regs)), offsets_(regs_.size() + 1, 0)
+{
+    // Both directions, then sorted by source so each row is contiguous
+    const size_t given = edges.size();
+    edges.reserve(given * 2);
+    for (size_t i = 0; i < given; ++i)
+    {
+        edges.emplace_back(edges[i].second, edges[i].first);
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    adjacency_.reserve(edges.size());
+    for (auto [from, to] : edges)
+    {
+        ++offsets_[from + 1];
+        adjacency_.push_back(to);
+    }
+    for (size_t i = 1; i < offsets_.size(); ++i)
+    {
+        offsets_[i] += offsets_[i - 1];
+    }
+
+    const size_t n = regs_.size();
+    if (n <= MATRIX_NODES)
+    {
+        matrix_.resize(n * n);
+        for (auto [from, to] : edges)
+        {
+            matrix_.set(from * n + to);
+        }
+    }
+}
+
+unsigned InterferenceGraph::node(unsigned reg) const
+{
+    auto it = std::lower_bound(regs_.begin(), regs_.end(), reg);
+    return it != regs_.end() && *it == reg ? static_cast<unsigned>(it - regs_.begin()) : NO_NODE;
+}
+
+bool InterferenceGraph::interferes(unsigned reg1, unsigned reg2) const
+{
+    const unsigned a = node(reg1), b = node(reg2);
+    if (a == NO_NODE || b == NO_NODE)
+        return false;
+    if (matrix_.size())
+        return matrix_.test(a * regs_.size() + b);
+    auto row = neighbors(a);
+    return std::binary_search(row.begin(), row.end(), b);
+}
+
+std::map<unsigned, std::set<unsigned>> InterferenceGraph::to_map() const
+{
+    std::map<unsigned, std::set<unsigned>> graph;
+    for (unsigned i = 0; i < regs_.size(); ++i)
+    {
+        if (!degree(i))
+            continue;
+        auto &conflicts = graph[regs_[i]];
+        for (unsigned j : neighbors(i))
+        {
+            conflicts.insert(regs_[j]);
+        }
+    }
+    return graph;
+}
@@ -0,0 +1,53 @@
+// interference_graph.h - Compact register interference graph
+#pragma once
+
+#include <map>
+#include <set>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "bit_vector.h"
+
+//===----------------------------------------------------------------------===//
+//                             Interference Graph
+//===----------------------------------------------------------------------===//
+//
+// Registers are numbered 0..n-1 in increasing order and the edges are kept
+// in compressed sparse rows: node i's neighbours are
+// adjacency[offsets[i] .. offsets[i + 1]), sorted. Small graphs also get an
+// n x n bit matrix so `interferes` is a single bit test.
+class InterferenceGraph
+{
+public:
+    static constexpr unsigned NO_NODE = ~0u;
+    static constexpr size_t MATRIX_NODES = 512;
+
+    InterferenceGraph() : offsets_(1, 0) {}
+    // `regs` sorted and unique; `edges` pairs of node indices, in either or
+    // both directions, duplicates allowed
+    InterferenceGraph(std::vector<unsigned> regs, std::vector<std::pair<unsigned, unsigned>> edges);
+
+    size_t num_nodes() const { return regs_.size(); }
+    size_t num_edges() const { return adjacency_.size() / 2; }
+    unsigned reg(unsigned node) const { return regs_[node]; }
+    // NO_NODE if `reg` is not in the graph
+    unsigned node(unsigned reg) const;
+
+    std::span<const unsigned> neighbors(unsigned node) const
+    {
+        return {adjacency_.data() + offsets_[node], adjacency_.data() + offsets_[node + 1]};
+    }
+    size_t degree(unsigned node) const { return offsets_[node + 1] - offsets_[node]; }
+
+    bool interferes(unsigned reg1, unsigned reg2) const;
+
+    // Register -> interfering registers, for registers with at least one edge
+    std::map<unsigned, std::set<unsigned>> to_map() const;
+
+private:
+    std::vector<unsigned> regs_;
+    std::vector<unsigned> offsets_;
+    std::vector<unsigned> adjacency_;
+    BitVector matrix_;
+};
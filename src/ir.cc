@@ -1,8 +1,13 @@
 #include "ir.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
 #include <sstream>
 #include <iomanip>
 #include <limits>
+#include <numeric>
 
 #include "mo_debug.h"
 
@@ -68,15 +73,26 @@ size_t ArrayType::size() const
     return size_; // Allow ZST
 }
 
-StructLayout calculate_aligned_layout(const std::vector<Type *> &members)
+StructLayout calculate_aligned_layout(const std::vector<Type *> &members, bool reorder_fields)
 {
     StructLayout layout;
     size_t offset = 0;               // Tracks the current byte offset in the struct
     size_t max_alignment = 0;        // Tracks the maximum alignment requirement among all members
     bool has_non_zst_member = false; // Flag to check if the struct has any non-ZST members
 
-    for (auto *member_type : members)
+    // Order the members are placed in; declaration order unless reordering
+    std::vector<size_t> order(members.size());
+    std::iota(order.begin(), order.end(), size_t(0));
+    if (reorder_fields)
     {
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                         { return members[a]->alignment() > members[b]->alignment(); });
+    }
+    layout.members.resize(members.size());
+
+    for (size_t index : order)
+    {
+        Type *member_type = members[index];
         size_t alignment = member_type->alignment(); // Alignment requirement of the current member
         size_t size = member_type->size();           // Size of the current member
 
@@ -97,13 +113,13 @@ StructLayout calculate_aligned_layout(const std::vector<Type *> &members)
                 offset += alignment - (offset % alignment);
             }
 
-            layout.members.push_back({member_type, offset});
+            layout.members[index] = {member_type, offset};
             offset += size;
         }
         else
         {
             // For ZST members, record the member's type and offset but do not affect the offset
-            layout.members.push_back({member_type, offset});
+            layout.members[index] = {member_type, offset};
         }
     }
 
@@ -159,7 +175,7 @@ void StructType::set_body(const std::vector<MemberInfo> &members)
         member_types.push_back(member.type);
     }
 
-    StructLayout layout = calculate_aligned_layout(member_types);
+    StructLayout layout = calculate_aligned_layout(member_types, module_ && module_->reorders_struct_fields());
 
     size_ = layout.size;
     offsets_.clear();
@@ -168,6 +184,20 @@ void StructType::set_body(const std::vector<MemberInfo> &members)
     {
         offsets_.push_back(offset_entry.offset);
     }
+
+    if (module_)
+    {
+        module_->index_struct(this);
+    }
+}
+
+void StructType::set_name(const std::string &name)
+{
+    std::string old_name = std::exchange(name_, name);
+    if (module_)
+    {
+        module_->rename_struct(this, old_name);
+    }
 }
 
 Type *StructType::get_member_type(unsigned index) const
@@ -218,18 +248,113 @@ size_t StructType::size() const
 //===----------------------------------------------------------------------===//
 //                             Value Implementation
 //===----------------------------------------------------------------------===//
+namespace
+{
+    // Constants, globals and functions are used from every function of a module,
+    // so while any module is concurrent, use-list updates take a lock striped by
+    // the used value.
+    std::atomic<int> concurrent_modules{0};
+    std::array<std::mutex, 64> use_list_mutexes;
+
+    // Set while a module destroys its functions. Every use lives in an
+    // instruction, so then all uses are about to die and use lists are left
+    // as they are instead of being unlinked one use at a time.
+    thread_local bool dropping_uses = false;
+
+    std::unique_lock<std::mutex> lock_use_list(const Value *value)
+    {
+        if (concurrent_modules.load(std::memory_order_relaxed) == 0)
+        {
+            return {};
+        }
+        const size_t stripe = std::hash<const Value *>{}(value) % use_list_mutexes.size();
+        return std::unique_lock<std::mutex>(use_list_mutexes[stripe]);
+    }
+}
+
+void Use::link()
+{
+    auto lock = lock_use_list(value_);
+    next_ = value_->use_list_;
+    if (next_)
+    {
+        next_->prev_ = &next_;
+    }
+    prev_ = &value_->use_list_;
+    value_->use_list_ = this;
+}
+
+void Use::unlink()
+{
+    auto lock = lock_use_list(value_);
+    *prev_ = next_;
+    if (next_)
+    {
+        next_->prev_ = prev_;
+    }
+    next_ = nullptr;
+    prev_ = nullptr;
+}
+
+void Use::set(Value *value)
+{
+    if (value == value_)
+    {
+        return;
+    }
+    if (value_ && !dropping_uses)
+    {
+        unlink();
+    }
+    value_ = value;
+    if (value_)
+    {
+        link();
+    }
+}
+
+void Use::take(Use &other)
+{
+    MO_ASSERT(value_ == nullptr, "Use is still linked");
+    if (!other.value_)
+    {
+        return;
+    }
+    auto lock = lock_use_list(other.value_);
+    value_ = std::exchange(other.value_, nullptr);
+    next_ = std::exchange(other.next_, nullptr);
+    prev_ = std::exchange(other.prev_, nullptr);
+    *prev_ = this;
+    if (next_)
+    {
+        next_->prev_ = &next_;
+    }
+}
+
 Value::~Value()
 {
-    // Notify all users that this value is invalid
-    for (auto *user : users_)
+    if (dropping_uses)
     {
-        user->remove_use_of(this);
+        return;
+    }
+    // Users of this value are left with a null operand
+    auto lock = lock_use_list(this);
+    while (Use *use = use_list_)
+    {
+        use_list_ = use->next_;
+        use->value_ = nullptr;
+        use->next_ = nullptr;
+        use->prev_ = nullptr;
     }
 }
 
-void Value::remove_user(Value *user)
+void Value::replace_all_uses_with(Value *value)
 {
-    users_.erase(std::remove(users_.begin(), users_.end(), user), users_.end());
+    MO_ASSERT(value != this, "Cannot replace a value with itself");
+    while (use_list_)
+    {
+        use_list_->set(value);
+    }
 }
 
 //===----------------------------------------------------------------------===//
@@ -237,39 +362,99 @@ void Value::remove_user(Value *user)
 //===----------------------------------------------------------------------===//
 User::~User()
 {
-    for (auto *op : operands_)
+    for (unsigned i = 0; i < num_operands_; ++i)
     {
-        if (op)
-            op->remove_user(this);
+        uses_[i].set(nullptr);
     }
+    free_uses();
 }
 
-void User::set_operand(unsigned i, Value *v)
+void User::free_uses()
 {
-    if (i < operands_.size() && operands_[i])
+    if (uses_ == inline_uses_)
+    {
+        return;
+    }
+    std::destroy_n(uses_, capacity_);
+    const size_t bytes = capacity_ * sizeof(Use);
+    if (slab_)
+    {
+        SlabAllocator::release(uses_, bytes);
+    }
+    else
     {
-        operands_[i]->remove_user(this);
+        ::operator delete(uses_, bytes);
     }
+}
 
-    if (i >= operands_.size())
+void User::reserve_operands(unsigned capacity)
+{
+    if (capacity <= capacity_)
+    {
+        return;
+    }
+    capacity = std::max(capacity, capacity_ * 2);
+    const size_t bytes = capacity * sizeof(Use);
+    void *memory = slab_ ? slab_->allocate(bytes) : ::operator new(bytes);
+    Use *uses = new (memory) Use[capacity];
+    for (unsigned i = 0; i < num_operands_; ++i)
     {
-        operands_.resize(i + 1);
+        uses[i].user_ = this;
+        uses[i].take(uses_[i]);
     }
+    free_uses();
+    uses_ = uses;
+    capacity_ = capacity;
+}
+
+void User::add_operand(Value *v)
+{
+    reserve_operands(num_operands_ + 1);
+    Use &use = uses_[num_operands_++];
+    use.user_ = this;
+    use.set(v);
+}
 
-    operands_[i] = v;
-    if (v)
+void User::set_operand(unsigned i, Value *v)
+{
+    while (i >= num_operands_)
     {
-        v->add_user(this);
+        add_operand(nullptr);
     }
+    uses_[i].set(v);
 }
 
 void User::remove_use_of(Value *v)
 {
-    auto it = std::find(operands_.begin(), operands_.end(), v);
-    if (it != operands_.end())
+    for (unsigned i = 0; i < num_operands_; ++i)
+    {
+        if (uses_[i].get() == v)
+        {
+            uses_[i].set(nullptr);
+        }
+    }
+}
+
+void User::drop_all_references()
+{
+    for (unsigned i = 0; i < num_operands_; ++i)
+    {
+        uses_[i].set(nullptr);
+    }
+}
+
+void User::erase_operands(unsigned first, unsigned count)
+{
+    MO_ASSERT(first + count <= num_operands_, "Invalid operand range");
+    for (unsigned i = first; i + count < num_operands_; ++i)
+    {
+        uses_[i].set(uses_[i + count].get());
+    }
+    for (unsigned i = num_operands_ - count; i < num_operands_; ++i)
     {
-        *it = nullptr;
+        uses_[i].set(nullptr);
     }
+    num_operands_ -= count;
 }
 
 //===----------------------------------------------------------------------===//
@@ -277,15 +462,14 @@ void User::remove_use_of(Value *v)
 //===----------------------------------------------------------------------===//
 Instruction::Instruction(Opcode opcode, Type *type, BasicBlock *parent,
                          std::vector<Value *> operands, const std::string &name)
-    : User(type, name), opcode_(opcode), parent_(parent),
+    : User(type, name, &parent->parent_function()->allocator()), opcode_(opcode), parent_(parent),
       prev_(nullptr), next_(nullptr)
 {
     MO_ASSERT(parent != nullptr, "Parent block is null");
-    operands_ = std::move(operands);
-    for (auto *op : operands_)
+    reserve_operands(operands.size());
+    for (auto *op : operands)
     {
-        if (op)
-            op->add_user(this);
+        add_operand(op);
     }
 }
 
@@ -293,14 +477,24 @@ Instruction *Instruction::create(Opcode opc, Type *type,
                                  std::vector<Value *> operands,
                                  BasicBlock *parent)
 {
-    auto *inst = new Instruction(opc, type, parent, operands);
+    auto *inst = new (parent) Instruction(opc, type, parent, operands);
     parent->insert_before(nullptr, std::unique_ptr<Instruction>(inst));
     return inst;
 }
 
+void *Instruction::operator new(size_t size, BasicBlock *parent)
+{
+    return parent->parent_function()->allocator().allocate(size);
+}
+
 //===----------------------------------------------------------------------===//
 //                           BasicBlock Implementation
 //===----------------------------------------------------------------------===//
+void *BasicBlock::operator new(size_t size, Function *parent)
+{
+    return parent->allocator().allocate(size);
+}
+
 BasicBlock::BasicBlock(const std::string &name, Function *parent)
     : Value(parent->parent_module()->get_void_type(), name),
       parent_(parent), head_(nullptr), tail_(nullptr) {}
@@ -386,6 +580,27 @@ void BasicBlock::insert_after(Instruction *pos, std::unique_ptr<Instruction> ins
     }
 }
 
+std::unique_ptr<Instruction> BasicBlock::remove(Instruction *inst)
+{
+    MO_ASSERT(inst->parent_ == this, "Instruction does not belong to this block");
+    if (inst->prev_)
+        inst->prev_->next_ = inst->next_;
+    else
+        head_ = inst->next_;
+    if (inst->next_)
+        inst->next_->prev_ = inst->prev_;
+    else
+        tail_ = inst->prev_;
+    inst->prev_ = inst->next_ = nullptr;
+    return std::unique_ptr<Instruction>(inst);
+}
+
+void BasicBlock::erase(Instruction *inst)
+{
+    MO_ASSERT(!inst->has_uses(), "Erasing an instruction that is still used");
+    remove(inst);
+}
+
 Instruction *BasicBlock::first_non_phi() const
 {
     Instruction *inst = head_;
@@ -415,6 +630,18 @@ void BasicBlock::add_successor(BasicBlock *bb)
     }
 }
 
+void BasicBlock::remove_successor(BasicBlock *bb)
+{
+    auto it = std::find(successors_.begin(), successors_.end(), bb);
+    if (it == successors_.end())
+    {
+        return;
+    }
+    successors_.erase(it);
+    auto &preds = bb->predecessors_;
+    preds.erase(std::find(preds.begin(), preds.end(), this));
+}
+
 void BasicBlock::append(Instruction *inst)
 {
     inst->parent_ = this;
@@ -456,6 +683,11 @@ Instruction *BasicBlock::get_terminator() const
 //===----------------------------------------------------------------------===//
 //                             Function Implementation
 //===----------------------------------------------------------------------===//
+void *Argument::operator new(size_t size, Function *parent)
+{
+    return parent->allocator().allocate(size);
+}
+
 Function::Function(const std::string &name, Module *parent, Type *return_type,
                    const ParamList &params)
     : Value(parent->get_function_type(return_type, param_list_to_types(params)), name),
@@ -467,8 +699,7 @@ Function::Function(const std::string &name, Module *parent, Type *return_type,
     // Create arguments
     for (const auto &[param_name, param_type] : params)
     {
-        arguments_.emplace_back(
-            std::make_unique<Argument>(param_name, param_type, this));
+        arguments_.emplace_back(new (this) Argument(param_name, param_type, this));
         args_.push_back(arguments_.back().get());
     }
 }
@@ -485,11 +716,29 @@ bool Function::remove_basic_block(BasicBlock *bb)
     return false;
 }
 
+void Function::erase_basic_block(BasicBlock *bb)
+{
+    while (!bb->successors().empty())
+    {
+        bb->remove_successor(bb->successors().back());
+    }
+    MO_ASSERT(bb->predecessors().empty(), "Erasing block %s with predecessors", bb->name().c_str());
+    for (Instruction &inst : *bb)
+    {
+        inst.drop_all_references();
+    }
+    remove_basic_block(bb);
+    auto it = std::find_if(basic_blocks_.begin(), basic_blocks_.end(),
+                           [bb](const auto &owned)
+                           { return owned.get() == bb; });
+    basic_blocks_.erase(it);
+}
+
 Function::~Function() = default;
 
 BasicBlock *Function::create_basic_block(const std::string &name)
 {
-    basic_blocks_.push_back(std::make_unique<BasicBlock>(name, this));
+    basic_blocks_.emplace_back(new (this) BasicBlock(name, this));
     basic_block_ptrs_.push_back(basic_blocks_.back().get());
     return basic_block_ptrs_.back();
 }
@@ -503,38 +752,105 @@ Module::Module(std::string name)
     void_type_ = std::unique_ptr<VoidType>(new VoidType(this));
 }
 
-Module::~Module() = default;
+Module::~Module()
+{
+    set_concurrent(false);
+
+    // Tear the functions down without maintaining use lists; afterwards no
+    // use is left, so the module-level values just forget theirs
+    dropping_uses = true;
+    functions_.clear();
+    dropping_uses = false;
+
+    auto forget_uses = [](const auto &table)
+    {
+        for (const auto &entry : table)
+        {
+            entry.second->use_list_ = nullptr;
+        }
+    };
+    forget_uses(constant_ints_);
+    forget_uses(constant_fps_);
+    forget_uses(constant_structs_);
+    forget_uses(constant_arrays_);
+    forget_uses(constant_strings_);
+    forget_uses(constant_pointer_nulls_);
+    forget_uses(constant_aggregate_zeros_);
+    for (const auto &gv : global_variables_)
+    {
+        gv->use_list_ = nullptr;
+    }
+}
+
+void Module::set_concurrent(bool concurrent)
+{
+    if (concurrent == concurrent_)
+    {
+        return;
+    }
+    concurrent_ = concurrent;
+    concurrent_modules.fetch_add(concurrent ? 1 : -1, std::memory_order_relaxed);
+}
 
 Function *Module::create_function(
     const std::string &name,
     Type *return_type,
     const std::vector<std::pair<std::string, Type *>> &params)
 {
+    auto lock = lock_if_concurrent();
     functions_.push_back(
         std::make_unique<Function>(name, this, return_type, params));
-    return functions_.back().get();
+    Function *function = functions_.back().get();
+    function_index_.get_or_insert(name, [&]
+                                  { return function; });
+    return function;
 }
 
 Function *Module::create_function(
     const std::string &name,
     FunctionType *type)
 {
+    auto lock = lock_if_concurrent();
     auto params = type->params();
     functions_.push_back(
         std::make_unique<Function>(name, this, type->return_type(), params));
-    return functions_.back().get();
+    Function *function = functions_.back().get();
+    function_index_.get_or_insert(name, [&]
+                                  { return function; });
+    return function;
 }
 
 GlobalVariable *Module::create_global_variable(Type *type, bool is_constant, Constant *initializer, const std::string &name)
 {
+    auto lock = lock_if_concurrent();
     auto *gv_ptr = new GlobalVariable(type, is_constant, initializer, name);
     auto gv = std::unique_ptr<GlobalVariable>(gv_ptr);
     global_variables_.push_back(std::move(gv));
+    if (!name.empty())
+    {
+        global_index_.get_or_insert(name, [&]
+                                    { return gv_ptr; });
+    }
     return gv_ptr;
 }
 
+Function *Module::get_function(const std::string &name) const
+{
+    auto lock = lock_if_concurrent();
+    Function *const *function = function_index_.find(name);
+    return function ? *function : nullptr;
+}
+
+GlobalVariable *Module::get_global_variable(const std::string &name) const
+{
+    auto lock = lock_if_concurrent();
+    GlobalVariable *const *gv = global_index_.find(name);
+    return gv ? *gv : nullptr;
+}
+
 IntegerType *Module::get_integer_type(uint8_t bit_width, bool unsigned_)
 {
+    auto lock = lock_if_concurrent();
     auto &type = integer_types_[std::make_pair(bit_width, unsigned_)];
     if (!type)
     {
@@ -550,6 +866,7 @@ IntegerType *Module::get_boolean_type()
 
 FloatType *Module::get_float_type(uint8_t bit_width)
 {
+    auto lock = lock_if_concurrent();
     auto &type = float_types_[bit_width];
     if (!type)
     {
@@ -560,37 +877,29 @@ FloatType *Module::get_float_type(uint8_t bit_width)
 
 PointerType *Module::get_pointer_type(Type *element_type)
 {
+    auto lock = lock_if_concurrent();
     assert(element_type && "Invalid element type");
 
-    auto &type = pointer_types_[element_type];
-    if (!type)
-    {
-        type = std::unique_ptr<PointerType>(new PointerType(this, element_type));
-    }
-    return type.get();
+    return pointer_types_.get_or_insert(element_type, [&]
+                                        { return std::unique_ptr<PointerType>(new PointerType(this, element_type)); })
+        .get();
 }
 
 FunctionType *Module::get_function_type(Type *return_type, const std::vector<Type *> &param_types)
 {
+    auto lock = lock_if_concurrent();
     assert(return_type && "Invalid return type");
 
-    auto key = std::make_pair(return_type, param_types);
-    auto it = function_types_.find(key);
-    if (it != function_types_.end())
-    {
-        return it->second.get();
-    }
-
-    ParamList params;
-    params.reserve(param_types.size());
-    for (auto *param_type : param_types)
-    {
-        params.push_back({"", param_type});
-    }
-    auto function_type = std::unique_ptr<FunctionType>(new FunctionType(this, return_type, params));
-    auto *result = function_type.get();
-    function_types_[key] = std::move(function_type);
-    return result;
+    return function_types_.get_or_insert({return_type, param_types}, [&]
+                                         {
+                                             ParamList params;
+                                             params.reserve(param_types.size());
+                                             for (auto *param_type : param_types)
+                                             {
+                                                 params.push_back({"", param_type});
+                                             }
+                                             return std::unique_ptr<FunctionType>(new FunctionType(this, return_type, params)); })
+        .get();
 }
 
 Type *Module::get_void_type()
@@ -600,33 +909,25 @@ Type *Module::get_void_type()
 
 ArrayType *Module::get_array_type(Type *element_type, uint64_t num_elements)
 {
-    const auto key = std::make_pair(element_type, num_elements);
-    auto it = array_types_.find(key);
-
-    if (it != array_types_.end())
-    {
-        return it->second.get();
-    }
-
-    auto ty = new ArrayType(this, element_type, num_elements);
-    MO_DEBUG("Registering new array type, element type: '%s', num elements: %zu", element_type->name().c_str(), num_elements);
-    array_types_.emplace(key, std::unique_ptr<ArrayType>(ty));
-    return ty;
+    auto lock = lock_if_concurrent();
+    return array_types_.get_or_insert({element_type, num_elements}, [&]
+                                      {
+                                          MO_DEBUG("Registering new array type, element type: '%s', num elements: %zu", element_type->name().c_str(), num_elements);
+                                          return std::unique_ptr<ArrayType>(new ArrayType(this, element_type, num_elements)); })
+        .get();
 }
 
 // FIXME: should not get by members
 StructType *Module::get_struct_type_anonymous(const std::vector<MemberInfo> &members)
 {
+    auto lock = lock_if_concurrent();
     // Find existing struct
-    for (auto &st : struct_types_)
+    if (StructType **st = structs_by_members_.find(members))
     {
-        if (!st->is_opaque() && st->members() == members)
-        {
-            return st.get();
-        }
+        return *st;
     }
 
-    // Create new struct
+    // Create new struct; a complete body indexes itself
     auto *st = new StructType(this, members);
     MO_DEBUG("Registering new struct type, name: '%s' type: '%s'", st->name().c_str(), st->name().c_str());
     struct_types_.push_back(std::unique_ptr<StructType>(st));
@@ -635,26 +936,48 @@ StructType *Module::get_struct_type_anonymous(const std::vector<MemberInfo> &mem
 
 StructType *Module::try_get_named_global_type(const std::string &name)
 {
+    auto lock = lock_if_concurrent();
     assert(!name.empty() && "Invalid struct name");
-    MO_DEBUG("Searching for named global type, name: '%s'", name.c_str());
-    // Check existing struct types
-    for (auto &st : struct_types_)
+    StructType **st = named_structs_.find(name);
+    return st ? *st : nullptr;
+}
+
+void Module::index_struct(StructType *st)
+{
+    auto lock = lock_if_concurrent();
+    if (!st->is_opaque())
     {
-        if (st->identifier() == name)
-        {
-            return st.get();
-        }
-        else
+        structs_by_members_.get_or_insert(st->members(), [&]
+                                          { return st; });
+    }
+    if (!st->identifier().empty())
+    {
+        named_structs_.get_or_insert(st->identifier(), [&]
+                                     { return st; });
+    }
+}
+
+void Module::rename_struct(StructType *st, const std::string &old_name)
+{
+    auto lock = lock_if_concurrent();
+    if (StructType **entry = named_structs_.find(old_name); entry && *entry == st)
+    {
+        *entry = nullptr;
+    }
+    if (!st->identifier().empty())
+    {
+        StructType *&entry = named_structs_.get_or_insert(st->identifier(), [&]
+                                                          { return st; });
+        if (!entry)
         {
-            MO_DEBUG("Mismatch name: '%s' vs '%s'", st->name().c_str(), name.c_str());
+            entry = st;
         }
     }
-
-    return nullptr;
 }
 
 StructType *Module::get_struct_type(const std::string &name, const std::vector<MemberInfo> &members)
 {
+    auto lock = lock_if_concurrent();
     if (!name.empty())
     {
         // Check existing struct types
@@ -671,12 +994,9 @@ StructType *Module::get_struct_type(const std::string &name, const std::vector<M
     else
     {
         // Anonymous struct, search by match all members
-        for (auto &st : struct_types_)
+        if (StructType **st = structs_by_members_.find(members))
         {
-            if (!st->is_opaque() && st->members() == members)
-            {
-                return st.get();
-            }
+            return *st;
         }
     }
 
@@ -684,24 +1004,18 @@ StructType *Module::get_struct_type(const std::string &name, const std::vector<M
     auto *st = new StructType(this, name, members);
     MO_DEBUG("Registering new struct type, name: '%s' type: '%s'", name.c_str(), st->name().c_str());
     struct_types_.push_back(std::unique_ptr<StructType>(st));
+    index_struct(st);
     return st;
 }
 
 VectorType *Module::get_vector_type(Type *element_type, uint64_t num_elements)
 {
-    auto key = std::make_pair(element_type, num_elements);
-    auto it = vector_types_.find(key);
-    if (it != vector_types_.end())
-    {
-        return it->second.get();
-    }
-
-    auto vt = new VectorType(this, element_type, num_elements);
-    MO_DEBUG("Registering new vector type, element type: '%s', num elements: %zu", element_type->name().c_str(), num_elements);
-    auto vector_type = std::unique_ptr<VectorType>(vt);
-    auto *result = vector_type.get();
-    vector_types_[key] = std::move(vector_type);
-    return result;
+    auto lock = lock_if_concurrent();
+    return vector_types_.get_or_insert({element_type, num_elements}, [&]
+                                       {
+                                           MO_DEBUG("Registering new vector type, element type: '%s', num elements: %zu", element_type->name().c_str(), num_elements);
+                                           return std::unique_ptr<VectorType>(new VectorType(this, element_type, num_elements)); })
+        .get();
 }
 
 static bool is_supported_bit_width(uint8_t bit_width)
@@ -731,22 +1045,15 @@ uint64_t truncate_value(uint64_t value, uint8_t bit_width, bool is_unsigned)
 
 ConstantInt *Module::get_constant_int(IntegerType *type, uint64_t value)
 {
+    auto lock = lock_if_concurrent();
     MO_ASSERT(type != nullptr, "Invalid integer type");
 
     const bool is_unsigned = type->is_unsigned();
     const uint64_t processed_value = truncate_value(value, type->bit_width(), is_unsigned);
     MO_DEBUG("Creating %s constant int, type: '%s', value: %zu", is_unsigned ? "unsigned" : "signed", type->name().c_str(), processed_value);
-    const auto key = std::make_pair(type, processed_value);
-    if (auto it = constant_ints_.find(key); it != constant_ints_.end())
-    {
-        return it->second.get();
-    }
-
-    auto result = constant_ints_.emplace(
-        key,
-        std::unique_ptr<ConstantInt>(new ConstantInt(type, processed_value)));
-
-    return result.first->second.get();
+    return constant_ints_.get_or_insert({type, processed_value}, [&]
+                                        { return std::unique_ptr<ConstantInt>(new ConstantInt(type, processed_value)); })
+        .get();
 }
 
 ConstantInt *Module::get_constant_int(uint8_t bit_width, uint64_t value, bool unsigned_)
@@ -761,14 +1068,13 @@ ConstantInt *Module::get_constant_bool(bool value) {
 
 ConstantFP *Module::get_constant_fp(FloatType *type, double value)
 {
-    if (auto it = constant_fps_.find({type, value}); it != constant_fps_.end())
-    {
-        return it->second.get();
-    }
-
-    auto &constant = constant_fps_[{type, value}];
-    constant = std::unique_ptr<ConstantFP>(new ConstantFP(type, value));
-    return constant.get();
+    auto lock = lock_if_concurrent();
+    static_assert(sizeof(double) == sizeof(uint64_t), "Unexpected double size");
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return constant_fps_.get_or_insert({type, bits}, [&]
+                                       { return std::unique_ptr<ConstantFP>(new ConstantFP(type, value)); })
+        .get();
 }
 
 ConstantFP *Module::get_constant_fp(uint8_t bit_width, double value)
@@ -778,17 +1084,10 @@ ConstantFP *Module::get_constant_fp(uint8_t bit_width, double value)
 
 ConstantString *Module::get_constant_string(std::string value)
 {
-    for (auto &constant : constant_strings_)
-    {
-        if (constant->value() == value)
-        {
-            return constant.get();
-        }
-    }
-
-    auto &constant = constant_strings_.emplace_back(
-        std::unique_ptr<ConstantString>(new ConstantString(get_array_type(get_integer_type(8), value.size() + 1), value)));
-    return constant.get();
+    auto lock = lock_if_concurrent();
+    return constant_strings_.get_or_insert(value, [&]
+                                           { return std::unique_ptr<ConstantString>(new ConstantString(get_array_type(get_integer_type(8), value.size() + 1), value)); })
+        .get();
 }
 
 Constant *Module::get_constant_zero(Type *type)
@@ -819,62 +1118,34 @@ Constant *Module::get_constant_zero(Type *type)
 
 ConstantAggregateZero *Module::get_constant_aggregate_zero(Type *type)
 {
-    for (auto &constant : constant_aggregate_zeros_)
-    {
-        if (*constant->type() == *type)
-        {
-            return constant.get();
-        }
-    }
-
-    auto &constant = constant_aggregate_zeros_.emplace_back(
-        std::unique_ptr<ConstantAggregateZero>(new ConstantAggregateZero(type)));
-    return constant.get();
+    auto lock = lock_if_concurrent();
+    return constant_aggregate_zeros_.get_or_insert(type, [&]
+                                                   { return std::unique_ptr<ConstantAggregateZero>(new ConstantAggregateZero(type)); })
+        .get();
 }
 
 ConstantPointerNull *Module::get_constant_pointer_null(PointerType *type)
 {
-    for (auto &constant : constant_pointer_nulls_)
-    {
-        if (*constant->type() == *type)
-        {
-            return constant.get();
-        }
-    }
-
-    auto &constant = constant_pointer_nulls_.emplace_back(
-        std::unique_ptr<ConstantPointerNull>(new ConstantPointerNull(type)));
-    return constant.get();
+    auto lock = lock_if_concurrent();
+    return constant_pointer_nulls_.get_or_insert(type, [&]
+                                                 { return std::unique_ptr<ConstantPointerNull>(new ConstantPointerNull(type)); })
+        .get();
 }
 
 ConstantStruct *Module::get_constant_struct(StructType *type, const std::vector<Constant *> &members)
 {
-    for (auto &constant : constant_structs_)
-    {
-        if (*constant->type() == *type && constant->elements() == members)
-        {
-            return constant.get();
-        }
-    }
-
-    auto &constant = constant_structs_.emplace_back(
-        std::unique_ptr<ConstantStruct>(new ConstantStruct(type, members)));
-    return constant.get();
+    auto lock = lock_if_concurrent();
+    return constant_structs_.get_or_insert({type, members}, [&]
+                                           { return std::unique_ptr<ConstantStruct>(new ConstantStruct(type, members)); })
+        .get();
 }
 
 ConstantArray *Module::get_constant_array(ArrayType *type, const std::vector<Constant *> &elements)
 {
-    for (auto &constant : constant_arrays_)
-    {
-        if (*constant->type() == *type && constant->elements() == elements)
-        {
-            return constant.get();
-        }
-    }
-
-    auto &constant = constant_arrays_.emplace_back(
-        std::unique_ptr<ConstantArray>(new ConstantArray(type, elements)));
-    return constant.get();
+    auto lock = lock_if_concurrent();
+    return constant_arrays_.get_or_insert({type, elements}, [&]
+                                          { return std::unique_ptr<ConstantArray>(new ConstantArray(type, elements)); })
+        .get();
 }
 
 //===----------------------------------------------------------------------===//
@@ -1066,7 +1337,7 @@ BranchInst *BranchInst::create(BasicBlock *target, BasicBlock *parent)
     std::vector<Value *> ops{target};
     MO_ASSERT(target != nullptr, "Invalid target block");
     MO_ASSERT(parent != nullptr, "Invalid parent block");
-    auto *inst = new BranchInst(target, parent, ops);
+    auto *inst = new (parent) BranchInst(target, parent, ops);
     parent->add_successor(target);
     return inst;
 }
@@ -1075,7 +1346,7 @@ BranchInst *BranchInst::create_cond(Value *cond, BasicBlock *true_bb,
                                     BasicBlock *false_bb, BasicBlock *parent)
 {
     std::vector<Value *> ops{cond, true_bb, false_bb};
-    auto *inst = new BranchInst(true_bb, parent, ops);
+    auto *inst = new (parent) BranchInst(true_bb, parent, ops);
     parent->add_successor(true_bb);
     parent->add_successor(false_bb);
     inst->false_bb_ = false_bb;
@@ -1092,6 +1363,30 @@ BasicBlock *BranchInst::get_false_successor() const
     return false_bb_;
 }
 
+uint64_t BranchInst::edge_weight(const BasicBlock *succ) const
+{
+    if (!is_conditional())
+        return parent_->profile_count();
+    if (!has_weights_)
+        return 0;
+    return (true_bb_ == succ ? true_weight_ : 0) + (false_bb_ == succ ? false_weight_ : 0);
+}
+
+void BranchInst::replace_successor(BasicBlock *from, BasicBlock *to)
+{
+    for (unsigned i = is_conditional() ? 1 : 0; i < num_operands(); ++i)
+    {
+        if (operand(i) == from)
+            set_operand(i, to);
+    }
+    if (true_bb_ == from)
+        true_bb_ = to;
+    if (false_bb_ == from)
+        false_bb_ = to;
+    parent_->remove_successor(from);
+    parent_->add_successor(to);
+}
+
 //____________________________________________________________________________
 //                           ReturnInst Implementations
 // ‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾‾
@@ -1101,7 +1396,7 @@ ReturnInst::ReturnInst(Value *value, BasicBlock *parent)
 
 ReturnInst *ReturnInst::create(Value *value, BasicBlock *parent)
 {
-    return new ReturnInst(value, parent);
+    return new (parent) ReturnInst(value, parent);
 }
 
 //____________________________________________________________________________
@@ -1113,7 +1408,7 @@ UnreachableInst::UnreachableInst(BasicBlock *parent)
 
 UnreachableInst *UnreachableInst::create(BasicBlock *parent)
 {
-    return new UnreachableInst(parent);
+    return new (parent) UnreachableInst(parent);
 }
 
 //____________________________________________________________________________
@@ -1124,19 +1419,36 @@ PhiInst::PhiInst(Type *type, BasicBlock *parent)
 
 PhiInst *PhiInst::create(Type *type, BasicBlock *parent)
 {
-    return new PhiInst(type, parent);
+    return new (parent) PhiInst(type, parent);
 }
 
 void PhiInst::add_incoming(Value *val, BasicBlock *bb)
 {
-    operands_.push_back(val);
-    operands_.push_back(bb);
-    val->add_user(this);
+    add_operand(val);
+    add_operand(bb);
+}
+
+void PhiInst::remove_incoming(BasicBlock *bb)
+{
+    for (unsigned i = num_incoming(); i-- > 0;)
+    {
+        if (get_incoming_block(i) == bb)
+            erase_operands(2 * i, 2);
+    }
+}
+
+void PhiInst::replace_incoming_block(BasicBlock *from, BasicBlock *to)
+{
+    for (unsigned i = 0; i < num_incoming(); ++i)
+    {
+        if (get_incoming_block(i) == from)
+            set_operand(2 * i + 1, to);
+    }
 }
 
 BasicBlock *PhiInst::get_incoming_block(unsigned i) const
 {
-    return static_cast<BasicBlock *>(operands_[2 * i + 1]);
+    return static_cast<BasicBlock *>(operand(2 * i + 1));
 }
 
 //____________________________________________________________________________
@@ -1152,7 +1464,7 @@ ICmpInst *ICmpInst::create(Predicate pred, Value *lhs, Value *rhs,
                            BasicBlock *parent)
 {
     std::vector<Value *> ops{lhs, rhs};
-    auto *inst = new ICmpInst(parent, ops);
+    auto *inst = new (parent) ICmpInst(parent, ops);
     inst->pred_ = pred;
     return inst;
 }
@@ -1165,7 +1477,7 @@ FCmpInst::FCmpInst(Predicate pred, BasicBlock *parent, std::vector<Value *> oper
 
 FCmpInst *FCmpInst::create(Predicate pred, Value *lhs, Value *rhs, BasicBlock *parent, const std::string &name)
 {
-    return new FCmpInst(pred, parent, {lhs, rhs}, name);
+    return new (parent) FCmpInst(pred, parent, {lhs, rhs}, name);
 }
 
 //____________________________________________________________________________
@@ -1179,7 +1491,7 @@ AllocaInst *AllocaInst::create(Type *allocated_type, BasicBlock *parent,
                                const std::string &name)
 {
     Type *ptr_type = parent->parent_function()->parent_module()->get_pointer_type(allocated_type);
-    auto *inst = new AllocaInst(allocated_type, ptr_type, parent);
+    auto *inst = new (parent) AllocaInst(allocated_type, ptr_type, parent);
     inst->set_name(name); // TODO: set by intializer?
     return inst;
 }
@@ -1194,7 +1506,7 @@ LoadInst *LoadInst::create(Value *ptr, BasicBlock *parent,
                            const std::string &name)
 {
     auto *ptr_type = static_cast<PointerType *>(ptr->type());
-    auto *inst = new LoadInst(ptr_type->element_type(), parent, ptr);
+    auto *inst = new (parent) LoadInst(ptr_type->element_type(), parent, ptr);
     inst->set_name(name);
     return inst;
 }
@@ -1209,7 +1521,7 @@ StoreInst::StoreInst(BasicBlock *parent, Value *value, Value *ptr)
 StoreInst *StoreInst::create(Value *value, Value *ptr, BasicBlock *parent)
 {
 
-    auto *inst = new StoreInst(parent, value, ptr);
+    auto *inst = new (parent) StoreInst(parent, value, ptr);
     return inst;
 }
 
@@ -1220,12 +1532,16 @@ GetElementPtrInst::GetElementPtrInst(Type *result_type, BasicBlock *parent,
                                      Value *ptr, std::vector<Value *> indices)
     : Instruction(Opcode::GetElementPtr, result_type, parent, {ptr})
 {
-    operands_.insert(operands_.end(), indices.begin(), indices.end());
+    for (auto *index : indices)
+    {
+        add_operand(index);
+    }
 }
 
 const std::vector<Value *> GetElementPtrInst::indices() const
 {
-    return std::vector<Value *>(operands_.begin() + 1, operands_.end());
+    auto ops = operands();
+    return std::vector<Value *>(++ops.begin(), ops.end());
 }
 
 Type *GetElementPtrInst::get_result_type(Type *base_type,
@@ -1286,7 +1602,7 @@ GetElementPtrInst *GetElementPtrInst::create(Value *ptr, std::vector<Value *> in
                                              const std::string &name)
 {
     Type *result_type = get_result_type(ptr->type(), indices);
-    auto *inst = new GetElementPtrInst(result_type, parent, ptr, indices);
+    auto *inst = new (parent) GetElementPtrInst(result_type, parent, ptr, indices);
     inst->set_name(name);
     return inst;
 }
@@ -1325,7 +1641,7 @@ bool BinaryInst::is_binary_op(Opcode op)
 BinaryInst *BinaryInst::create(Opcode op, Value *lhs, Value *rhs, BasicBlock *parent, const std::string &name)
 {
     assert(is_binary_op(op) && "Invalid binary opcode");
-    return new BinaryInst(op, lhs->type(), parent, {lhs, rhs}, name);
+    return new (parent) BinaryInst(op, lhs->type(), parent, {lhs, rhs}, name);
 }
 
 //____________________________________________________________________________
@@ -1351,7 +1667,7 @@ bool UnaryInst::isUnaryOp(Opcode op)
 UnaryInst *UnaryInst::create(Opcode op, Value *operand, BasicBlock *parent, const std::string &name)
 {
     assert(isUnaryOp(op) && "Invalid unary opcode");
-    return new UnaryInst(op, operand->type(), parent, {operand}, name);
+    return new (parent) UnaryInst(op, operand->type(), parent, {operand}, name);
 }
 
 //____________________________________________________________________________
@@ -1368,7 +1684,7 @@ bool ConversionInst::isConversionOp(Opcode op)
 ConversionInst *ConversionInst::create(Opcode op, Value *val, Type *dest_type, BasicBlock *parent, const std::string &name)
 {
     assert(isConversionOp(op) && "Invalid conversion opcode");
-    return new ConversionInst(op, dest_type, parent, {val}, name);
+    return new (parent) ConversionInst(op, dest_type, parent, {val}, name);
 }
 
 //____________________________________________________________________________
@@ -1390,7 +1706,7 @@ BitCastInst::BitCastInst(BasicBlock *parent, Value *val, Type *target_type, cons
 
 BitCastInst *BitCastInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new BitCastInst(parent, val, target_type, name);
+    return new (parent) BitCastInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1400,7 +1716,7 @@ PtrToIntInst *PtrToIntInst::create(Value *ptr, Type *target_type, BasicBlock *pa
 {
     assert(ptr->type()->is_pointer() && "Source value must be a pointer type");
     assert(target_type->is_integer() && "Target type must be an integer type");
-    return new PtrToIntInst(parent, ptr, target_type, name);
+    return new (parent) PtrToIntInst(parent, ptr, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1411,12 +1727,12 @@ CallInst::CallInst(BasicBlock *parent, Value *callee, Type *return_type, const s
 
 CallInst *CallInst::create(Value *callee, Type *return_type, const std::vector<Value *> &args, BasicBlock *parent, const std::string &name)
 {
-    return new CallInst(parent, callee, return_type, args, name);
+    return new (parent) CallInst(parent, callee, return_type, args, name);
 }
 CallInst *CallInst::create(Function *callee, const std::vector<Value *> &args, BasicBlock *parent, const std::string &name)
 {
     auto return_type = callee->return_type();
-    return new CallInst(parent, callee, return_type, args, name);
+    return new (parent) CallInst(parent, callee, return_type, args, name);
 }
 
 std::vector<Value *> CallInst::create_operand_list(Value *callee, const std::vector<Value *> &args)
@@ -1448,7 +1764,7 @@ SExtInst::SExtInst(BasicBlock *parent, Value *val, Type *target_type, const std:
 
 SExtInst *SExtInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new SExtInst(parent, val, target_type, name);
+    return new (parent) SExtInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1461,7 +1777,7 @@ ZExtInst::ZExtInst(BasicBlock *parent, Value *val, Type *target_type, const std:
 
 ZExtInst *ZExtInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new ZExtInst(parent, val, target_type, name);
+    return new (parent) ZExtInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1475,7 +1791,7 @@ TruncInst::TruncInst(BasicBlock *parent, Value *val, Type *target_type, const st
 
 TruncInst *TruncInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new TruncInst(parent, val, target_type, name);
+    return new (parent) TruncInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1486,7 +1802,7 @@ SIToFPInst::SIToFPInst(BasicBlock *parent, Value *val, Type *target_type, const
 
 SIToFPInst *SIToFPInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new SIToFPInst(parent, val, target_type, name);
+    return new (parent) SIToFPInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1497,7 +1813,7 @@ FPToSIInst::FPToSIInst(BasicBlock *parent, Value *val, Type *target_type, const
 
 FPToSIInst *FPToSIInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new FPToSIInst(parent, val, target_type, name);
+    return new (parent) FPToSIInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1508,7 +1824,7 @@ FPExtInst::FPExtInst(BasicBlock *parent, Value *val, Type *target_type, const st
 
 FPExtInst *FPExtInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new FPExtInst(parent, val, target_type, name);
+    return new (parent) FPExtInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1519,7 +1835,7 @@ FPTruncInst::FPTruncInst(BasicBlock *parent, Value *val, Type *target_type, cons
 
 FPTruncInst *FPTruncInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new FPTruncInst(parent, val, target_type, name);
+    return new (parent) FPTruncInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1534,7 +1850,7 @@ IntToPtrInst::IntToPtrInst(BasicBlock *parent, Value *val, Type *target_type, co
 
 IntToPtrInst *IntToPtrInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new IntToPtrInst(parent, val, target_type, name);
+    return new (parent) IntToPtrInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1549,7 +1865,7 @@ FPToUIInst::FPToUIInst(BasicBlock *parent, Value *val, Type *target_type, const
 
 FPToUIInst *FPToUIInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new FPToUIInst(parent, val, target_type, name);
+    return new (parent) FPToUIInst(parent, val, target_type, name);
 }
 
 //____________________________________________________________________________
@@ -1564,5 +1880,5 @@ UIToFPInst::UIToFPInst(BasicBlock *parent, Value *val, Type *target_type, const
 
 UIToFPInst *UIToFPInst::create(Value *val, Type *target_type, BasicBlock *parent, const std::string &name)
 {
-    return new UIToFPInst(parent, val, target_type, name);
+    return new (parent) UIToFPInst(parent, val, target_type, name);
 }
@@ -11,8 +11,12 @@
 #include <cassert>
 #include <unordered_map>
 #include <algorithm>
+#include <mutex>
+#include <optional>
 
 #include "mo_debug.h"
+#include "open_hash_map.h"
+#include "slab_allocator.h"
 
 //===----------------------------------------------------------------------===//
 //                             Forward Declarations
@@ -71,7 +75,7 @@ class FPTruncInst;
 struct Member;
 struct StructLayout;
 
-StructLayout calculate_aligned_layout(const std::vector<Type *> &members);
+StructLayout calculate_aligned_layout(const std::vector<Type *> &members, bool reorder_fields = false);
 uint64_t truncate_value(uint64_t value, uint8_t bit_width, bool is_unsigned);
 
 //===----------------------------------------------------------------------===//
@@ -79,15 +83,6 @@ uint64_t truncate_value(uint64_t value, uint8_t bit_width, bool is_unsigned);
 //===----------------------------------------------------------------------===//
 namespace std
 {
-    template <>
-    struct hash<std::pair<Type *, uint64_t>>
-    {
-        size_t operator()(const std::pair<Type *, uint64_t> &p) const
-        {
-            return hash<Type *>{}(p.first) ^ (hash<uint64_t>{}(p.second) << 1);
-        }
-    };
-
     template <>
     struct hash<std::pair<uint8_t, bool>>
     {
@@ -603,7 +598,7 @@ public:
     // For named structs, identifier is the name
     // For anonymous structs, identifier is all members' types
 
-    void set_name(const std::string &name) { name_ = name; }
+    void set_name(const std::string &name);
     std::string name() const override
     {
         return "%" + name_;
@@ -814,6 +809,39 @@ protected:
 //===----------------------------------------------------------------------===//
 //                              Value Base Class
 //===----------------------------------------------------------------------===//
+// One operand slot of a User. Each non-null Use is linked into the use list
+// of the value it refers to, so the uses of a value can be walked and
+// rewritten without touching any other value.
+class Use
+{
+public:
+    Use() = default;
+    Use(const Use &) = delete;
+    Use &operator=(const Use &) = delete;
+    ~Use() { set(nullptr); }
+
+    Value *get() const { return value_; }
+    User *user() const { return user_; }
+    Use *next_use() const { return next_; }
+
+    // Re-points the slot, moving it between use lists
+    void set(Value *value);
+
+private:
+    friend class Value;
+    friend class User;
+
+    void link();
+    void unlink();
+    // Takes over `other`'s value and position in its use list
+    void take(Use &other);
+
+    Value *value_ = nullptr;
+    User *user_ = nullptr;
+    Use *next_ = nullptr;
+    Use **prev_ = nullptr; // the pointer that points at this use
+};
+
 class Value
 {
 public:
@@ -821,11 +849,66 @@ public:
 
     const std::string &name() const { return name_; }
     Type *type() const { return type_; }
-    const std::vector<User *> &users() const { return users_; }
+
+    // Walks the use list, yielding either the Use or its User (T is Use * or
+    // User *); a user that refers to this value twice appears twice
+    template <typename T>
+    class UseRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = T;
+            using difference_type = std::ptrdiff_t;
+            using pointer = T *;
+            using reference = T;
+
+            explicit iterator(Use *use = nullptr) : use_(use) {}
+            T operator*() const
+            {
+                if constexpr (std::is_same_v<T, Use *>)
+                    return use_;
+                else
+                    return use_->user();
+            }
+            iterator &operator++()
+            {
+                use_ = use_->next_use();
+                return *this;
+            }
+            bool operator==(const iterator &other) const { return use_ == other.use_; }
+            bool operator!=(const iterator &other) const { return use_ != other.use_; }
+
+        private:
+            Use *use_;
+        };
+
+        explicit UseRange(Use *head) : head_(head) {}
+        iterator begin() const { return iterator(head_); }
+        iterator end() const { return iterator(); }
+        bool empty() const { return head_ == nullptr; }
+        size_t size() const
+        {
+            size_t count = 0;
+            for (Use *use = head_; use; use = use->next_use())
+                ++count;
+            return count;
+        }
+
+    private:
+        Use *head_;
+    };
+
+    UseRange<Use *> uses() const { return UseRange<Use *>(use_list_); }
+    UseRange<User *> users() const { return UseRange<User *>(use_list_); }
+    bool has_uses() const { return use_list_ != nullptr; }
+
+    // Points every use of this value at `value` instead, in O(number of uses)
+    void replace_all_uses_with(Value *value);
 
     void set_name(const std::string &name) { name_ = name; }
-    void add_user(User *user) { users_.push_back(user); }
-    void remove_user(Value *user);
 
 protected:
     Value(Type *type, const std::string &name = "")
@@ -833,7 +916,11 @@ protected:
 
     Type *type_;
     std::string name_;
-    std::vector<User *> users_;
+
+private:
+    friend class Use;
+    friend class Module;
+    Use *use_list_ = nullptr;
 };
 
 //===----------------------------------------------------------------------===//
@@ -842,25 +929,113 @@ protected:
 class User : public Value
 {
 public:
-    const std::vector<Value *> &operands() const { return operands_; }
+    // Operand values in order; null slots are allowed (e.g. `ret void`)
+    class OperandRange
+    {
+    public:
+        class iterator
+        {
+        public:
+            using iterator_category = std::random_access_iterator_tag;
+            using value_type = Value *;
+            using difference_type = std::ptrdiff_t;
+            using pointer = Value *const *;
+            using reference = Value *;
+
+            explicit iterator(const Use *use = nullptr) : use_(use) {}
+            Value *operator*() const { return use_->get(); }
+            Value *operator[](difference_type n) const { return use_[n].get(); }
+            iterator &operator++()
+            {
+                ++use_;
+                return *this;
+            }
+            iterator &operator--()
+            {
+                --use_;
+                return *this;
+            }
+            iterator &operator+=(difference_type n)
+            {
+                use_ += n;
+                return *this;
+            }
+            iterator &operator-=(difference_type n)
+            {
+                use_ -= n;
+                return *this;
+            }
+            iterator operator+(difference_type n) const { return iterator(use_ + n); }
+            iterator operator-(difference_type n) const { return iterator(use_ - n); }
+            difference_type operator-(const iterator &other) const { return use_ - other.use_; }
+            bool operator==(const iterator &other) const { return use_ == other.use_; }
+            bool operator!=(const iterator &other) const { return use_ != other.use_; }
+            bool operator<(const iterator &other) const { return use_ < other.use_; }
+
+        private:
+            const Use *use_;
+        };
+
+        OperandRange(const Use *begin, const Use *end) : begin_(begin), end_(end) {}
+        iterator begin() const { return iterator(begin_); }
+        iterator end() const { return iterator(end_); }
+        size_t size() const { return end_ - begin_; }
+        bool empty() const { return begin_ == end_; }
+        Value *operator[](size_t i) const { return begin_[i].get(); }
+        Value *back() const { return end_[-1].get(); }
+
+    private:
+        const Use *begin_;
+        const Use *end_;
+    };
+
+    OperandRange operands() const { return OperandRange(uses_, uses_ + num_operands_); }
+    unsigned num_operands() const { return num_operands_; }
     Value *operand(unsigned i) const
     {
-        if (i >= operands_.size())
+        if (i >= num_operands_)
         {
             MO_WARN("Invalid operand index: %u", i);
             return nullptr;
         }
-        return operands_.at(i);
+        return uses_[i].get();
+    }
+    Use &operand_use(unsigned i)
+    {
+        MO_ASSERT(i < num_operands_, "Invalid operand index: %u", i);
+        return uses_[i];
     }
+    // Grows the operand list when `i` is past its end
     void set_operand(unsigned i, Value *v);
     void remove_use_of(Value *v);
+    // Clears every operand, so the values this user refers to lose the use
+    void drop_all_references();
 
 protected:
-    User(Type *type, const std::string &name = "")
-        : Value(type, name) {}
+    // Operand lists too long for the inline slots come from `slab` when given
+    User(Type *type, const std::string &name = "", SlabAllocator *slab = nullptr)
+        : Value(type, name), slab_(slab) {}
+    User(const User &) = delete;
+    User &operator=(const User &) = delete;
     ~User() override;
 
-    std::vector<Value *> operands_;
+    void add_operand(Value *v);
+    void reserve_operands(unsigned capacity);
+    // Removes operands [first, first + count), shifting the rest down
+    void erase_operands(unsigned first, unsigned count);
+
+private:
+    // Operands up to this many live inside the object itself; covers every
+    // instruction but calls, GEPs and phis with more than one edge
+    static constexpr unsigned INLINE_OPERANDS = 3;
+
+    void free_uses();
+
+    Use inline_uses_[INLINE_OPERANDS];
+    Use *uses_ = inline_uses_;
+    SlabAllocator *slab_;
+    unsigned num_operands_ = 0;
+    unsigned capacity_ = INLINE_OPERANDS;
 };
 
 //===----------------------------------------------------------------------===//
@@ -940,6 +1115,11 @@ public:
                                std::vector<Value *> operands,
                                BasicBlock *parent);
 
+    // Instructions are allocated from their function's slab: `new (parent) T(...)`
+    static void *operator new(size_t size, BasicBlock *parent);
+    static void operator delete(void *ptr, BasicBlock *) noexcept { SlabAllocator::release(ptr, 0); }
+    static void operator delete(void *ptr, size_t size) noexcept { SlabAllocator::release(ptr, size); }
+
 protected:
     friend class BasicBlock;
 
@@ -961,6 +1141,11 @@ public:
     explicit BasicBlock(const std::string &name, Function *parent);
     ~BasicBlock() override;
 
+    // Allocated from the slab of the owning function
+    static void *operator new(size_t size, Function *parent);
+    static void operator delete(void *ptr, Function *) noexcept { SlabAllocator::release(ptr, 0); }
+    static void operator delete(void *ptr, size_t size) noexcept { SlabAllocator::release(ptr, size); }
+
     Function *parent_function() const { return parent_; }
 
     Instruction *first_instruction() const { return head_; }
@@ -970,12 +1155,24 @@ public:
     Instruction *get_terminator() const;
     void insert_before(Instruction *pos, std::unique_ptr<Instruction> inst);
     void insert_after(Instruction *pos, std::unique_ptr<Instruction> inst);
+    // Unlinks `inst` from this block and hands it back to the caller
+    std::unique_ptr<Instruction> remove(Instruction *inst);
+    // Unlinks and destroys `inst`, which must have no uses left
+    void erase(Instruction *inst);
 
     const std::vector<BasicBlock *> &predecessors() const { return predecessors_; }
     const std::vector<BasicBlock *> &successors() const { return successors_; }
     void add_successor(BasicBlock *bb);
+    void remove_successor(BasicBlock *bb);
     void append(Instruction *inst);
 
+    // Times the block ran in a profiled run, once apply_profile set it.
+    // Passes that copy or split blocks carry it over where they can
+    bool has_profile_count() const { return profile_count_.has_value(); }
+    uint64_t profile_count() const { return profile_count_.value_or(0); }
+    void set_profile_count(uint64_t count) { profile_count_ = count; }
+    void clear_profile_count() { profile_count_.reset(); }
+
     class iterator
     {
     public:
@@ -1045,6 +1242,7 @@ private:
 
     std::vector<BasicBlock *> predecessors_;
     std::vector<BasicBlock *> successors_;
+    std::optional<uint64_t> profile_count_;
 };
 
 //===----------------------------------------------------------------------===//
@@ -1056,6 +1254,11 @@ public:
     Argument(const std::string &name, Type *type, Function *parent)
         : Value(type, name), parent_(parent) {}
 
+    // Allocated from the slab of the owning function
+    static void *operator new(size_t size, Function *parent);
+    static void operator delete(void *ptr, Function *) noexcept { SlabAllocator::release(ptr, 0); }
+    static void operator delete(void *ptr, size_t size) noexcept { SlabAllocator::release(ptr, size); }
+
     Function *parent() const { return parent_; }
 
 private:
@@ -1078,6 +1281,11 @@ public:
     Argument *arg(size_t idx) const { return args_.at(idx); }
     size_t num_args() const { return args_.size(); }
     void set_instance_method(bool is_instance_method) { is_instance_method_ = is_instance_method; }
+    bool is_instance_method() const { return is_instance_method_; }
+    // Only called from inside its module, so the backend may choose how it
+    // passes arguments (CallingConv::Fast) instead of following the C rules
+    void set_internal(bool is_internal) { is_internal_ = is_internal; }
+    bool is_internal() const { return is_internal_; }
     std::vector<Type *> param_types() const
     {
         std::vector<Type *> types;
@@ -1089,6 +1297,9 @@ public:
     auto end() { return basic_blocks_.end(); }
     auto entry_block() const { return basic_blocks_.front().get(); }
     bool remove_basic_block(BasicBlock *bb);
+    // Destroys `bb` after cutting its edges and operands; nothing outside
+    // the block may still refer to it or to its instructions
+    void erase_basic_block(BasicBlock *bb);
 
     bool has_hidden_retval() const { return has_hidden_retval_; }
     Type *hidden_retval_type() const { return hidden_retval_type_; }
@@ -1100,14 +1311,21 @@ public:
 
     const std::vector<BasicBlock *> &basic_blocks() const { return basic_block_ptrs_; }
 
+    // Backs the arguments, blocks and instructions of this function
+    SlabAllocator &allocator() { return allocator_; }
+
 private:
     Module *parent_;
     Type *return_type_;
+    // Declared before everything it backs, so it dies last. Starts small, as
+    // a declaration that never gets a body only holds its arguments
+    SlabAllocator allocator_{1024};
     std::vector<std::unique_ptr<Argument>> arguments_;
     std::vector<Argument *> args_;
     std::vector<std::unique_ptr<BasicBlock>> basic_blocks_;
     std::vector<BasicBlock *> basic_block_ptrs_;
     bool is_instance_method_ = false;
+    bool is_internal_ = false;
 
     bool has_hidden_retval_ = false;
     Type *hidden_retval_type_ = nullptr;
@@ -1117,54 +1335,63 @@ private:
 //                              Module
 //===----------------------------------------------------------------------===//
 
-class Module
+// Read-only view of a vector of owned objects that yields raw pointers, so
+// Module can hand out its functions, globals and types without copying.
+// Adding elements to the container invalidates the view's iterators.
+template <typename T>
+class OwnedRange
 {
-    struct DoublePairHash
+    using Storage = std::vector<std::unique_ptr<T>>;
+
+public:
+    class iterator
     {
-        template <typename T1, typename T2>
-        size_t operator()(const std::pair<T1, T2> &p) const
-        {
-            // ensure double is hashed fully
-            static_assert(sizeof(double) == sizeof(uint64_t), "Unexpected double size");
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T *;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T *const *;
+        using reference = T *;
 
-            size_t hash1 = std::hash<T1>{}(p.first);
-            uint64_t bit_width = 0;
+        iterator() = default;
+        explicit iterator(typename Storage::const_iterator it) : it_(it) {}
 
-            if constexpr (std::is_same_v<T2, double>)
-            {
-                // uint64_t convert double to uint64_t
-                std::memcpy(&bit_width, &p.second, sizeof(double));
-            }
-            else
-            {
-                bit_width = std::hash<T2>{}(p.second);
-            }
-
-            size_t hash2 = std::hash<uint64_t>{}(bit_width);
-            return hash1 ^ (hash2 << 1);
+        T *operator*() const { return it_->get(); }
+        iterator &operator++()
+        {
+            ++it_;
+            return *this;
         }
-    };
-
-    struct DoublePairEqual
-    {
-        template <typename T1, typename T2>
-        bool operator()(const std::pair<T1, T2> &lhs, const std::pair<T1, T2> &rhs) const
+        iterator operator++(int) { return iterator(it_++); }
+        iterator &operator--()
         {
-            if (lhs.first != rhs.first)
-                return false;
-
-            if constexpr (std::is_same_v<T2, double>)
-            {
-                // 按二进制严格比较 double
-                return std::memcmp(&lhs.second, &rhs.second, sizeof(double)) == 0;
-            }
-            else
-            {
-                return lhs.second == rhs.second;
-            }
+            --it_;
+            return *this;
         }
+        difference_type operator-(const iterator &other) const { return it_ - other.it_; }
+        bool operator==(const iterator &other) const { return it_ == other.it_; }
+        bool operator!=(const iterator &other) const { return it_ != other.it_; }
+
+    private:
+        typename Storage::const_iterator it_;
     };
 
+    explicit OwnedRange(const Storage &storage) : storage_(&storage) {}
+
+    iterator begin() const { return iterator(storage_->begin()); }
+    iterator end() const { return iterator(storage_->end()); }
+    size_t size() const { return storage_->size(); }
+    bool empty() const { return storage_->empty(); }
+    T *operator[](size_t index) const { return (*storage_)[index].get(); }
+    T *front() const { return storage_->front().get(); }
+    T *back() const { return storage_->back().get(); }
+
+private:
+    const Storage *storage_;
+};
+
+class Module
+{
 public:
     friend class VoidType;
     friend class PointerType;
@@ -1174,6 +1401,20 @@ public:
     Module(std::string name = "");
     ~Module();
 
+    const std::string &name() const { return name_; }
+
+    // While concurrent, uniquing of types and constants and creation of
+    // functions and globals are serialised, and so are the use-lists of all
+    // values, so functions can be generated on several threads at once.
+    void set_concurrent(bool concurrent);
+    bool is_concurrent() const { return concurrent_; }
+
+    // Lays out the structs completed from now on with their fields sorted
+    // by alignment, see calculate_aligned_layout. Off by default, since the
+    // layout then no longer matches code compiled elsewhere
+    void set_reorder_struct_fields(bool reorder) { reorder_struct_fields_ = reorder; }
+    bool reorders_struct_fields() const { return reorder_struct_fields_; }
+
     Function *create_function(
         const std::string &name,
         Type *return_type,
@@ -1215,44 +1456,14 @@ public:
     ConstantStruct *get_constant_struct(StructType *type, const std::vector<Constant *> &members);
     ConstantArray *get_constant_array(ArrayType *type, const std::vector<Constant *> &elements);
 
-    const std::vector<Function *> functions() const
-    {
-        std::vector<Function *> result;
-        result.reserve(functions_.size());
-        for (auto &f : functions_)
-            result.push_back(f.get());
-        return result;
-    }
+    // Creation-order views; they do not copy
+    OwnedRange<Function> functions() const { return OwnedRange<Function>(functions_); }
+    OwnedRange<GlobalVariable> global_variables() const { return OwnedRange<GlobalVariable>(global_variables_); }
+    OwnedRange<StructType> struct_types() const { return OwnedRange<StructType>(struct_types_); }
 
-    Function *get_function(const std::string &name) const
-    {
-        for (auto &f : functions_)
-        {
-            if (f->name() == name)
-            {
-                return f.get();
-            }
-        }
-        return nullptr;
-    }
-
-    const std::vector<GlobalVariable *> global_variables() const
-    {
-        std::vector<GlobalVariable *> result;
-        result.reserve(global_variables_.size());
-        for (auto &gv : global_variables_)
-            result.push_back(gv.get());
-        return result;
-    }
-    
-    std::vector<StructType *> struct_types() const
-    {
-        std::vector<StructType *> result;
-        result.reserve(struct_types_.size());
-        for (auto &s : struct_types_)
-            result.push_back(s.get());
-        return result;
-    }
+    // Lookup by the name given at creation; the first of equally named wins
+    Function *get_function(const std::string &name) const;
+    GlobalVariable *get_global_variable(const std::string &name) const;
 
     StructType *get_struct_type_anonymous(const std::vector<MemberInfo> &members);
     StructType *try_get_named_global_type(const std::string &name);
@@ -1261,58 +1472,103 @@ public:
     VectorType *get_vector_type(Type *element_type, uint64_t num_elements);
 
 private:
+    // Holds mutex_ only while the module is concurrent
+    std::unique_lock<std::recursive_mutex> lock_if_concurrent() const
+    {
+        return concurrent_ ? std::unique_lock<std::recursive_mutex>(mutex_)
+                           : std::unique_lock<std::recursive_mutex>();
+    }
+
     std::string name_;
+    mutable std::recursive_mutex mutex_;
+    bool concurrent_ = false;
+    bool reorder_struct_fields_ = false;
     std::unique_ptr<VoidType> void_type_;
+
+    // Uniquing keys. Types are unique per module, so keys hold type pointers and
+    // compare them by identity.
+    // (type, payload): integer value, float bit pattern or element count
+    using TypeValueKey = std::pair<Type *, uint64_t>;
+    struct TypeValueKeyHash
+    {
+        uint64_t operator()(const TypeValueKey &key) const { return hash_combine(hash_pointer(key.first), key.second); }
+    };
+    // (type, operands): function signatures, constant structs and arrays
+    struct TypeListKeyHash
+    {
+        template <typename T>
+        uint64_t operator()(const std::pair<Type *, std::vector<T *>> &key) const
+        {
+            uint64_t hash = hash_combine(hash_pointer(key.first), key.second.size());
+            for (const T *operand : key.second)
+            {
+                hash = hash_combine(hash, reinterpret_cast<uintptr_t>(operand));
+            }
+            return hash;
+        }
+    };
+    struct PointerKeyHash
+    {
+        uint64_t operator()(const Type *type) const { return hash_pointer(type); }
+    };
+    struct StringKeyHash
+    {
+        uint64_t operator()(const std::string &value) const { return hash_bytes(value); }
+    };
+    struct MembersKeyHash
+    {
+        uint64_t operator()(const std::vector<MemberInfo> &members) const
+        {
+            uint64_t hash = members.size();
+            for (const auto &member : members)
+            {
+                hash = hash_combine(hash, hash_bytes(member.name));
+                hash = hash_combine(hash, reinterpret_cast<uintptr_t>(member.type));
+            }
+            return hash;
+        }
+    };
+    using FunctionTypeKey = std::pair<Type *, std::vector<Type *>>;
+    using ConstantListKey = std::pair<Type *, std::vector<Constant *>>;
+
     // (bit_width, unsigned) -> integer_type
     std::unordered_map<std::pair<uint8_t, bool>, std::unique_ptr<IntegerType>> integer_types_;
     std::unordered_map<uint8_t, std::unique_ptr<FloatType>> float_types_;
     // (element_type) -> pointer_type
-    std::unordered_map<Type *, std::unique_ptr<PointerType>> pointer_types_;
+    OpenHashMap<Type *, std::unique_ptr<PointerType>, PointerKeyHash> pointer_types_;
 
-    std::unordered_map<std::pair<Type *, uint64_t>,
-                       std::unique_ptr<ConstantInt>>
-        constant_ints_;
-
-    std::unordered_map<
-        std::pair<Type *, double>,
-        std::unique_ptr<ConstantFP>,
-        DoublePairHash,
-        DoublePairEqual>
-        constant_fps_;
+    OpenHashMap<TypeValueKey, std::unique_ptr<ConstantInt>, TypeValueKeyHash> constant_ints_;
+    // Keyed by the bit pattern, so 0.0 and -0.0 (and NaN payloads) stay distinct
+    OpenHashMap<TypeValueKey, std::unique_ptr<ConstantFP>, TypeValueKeyHash> constant_fps_;
 
     std::vector<std::unique_ptr<Function>> functions_;
     std::vector<std::unique_ptr<GlobalVariable>> global_variables_;
+    // Name -> first function or global created under it
+    OpenHashMap<std::string, Function *, StringKeyHash> function_index_;
+    OpenHashMap<std::string, GlobalVariable *, StringKeyHash> global_index_;
 
-    std::vector<std::unique_ptr<ConstantStruct>> constant_structs_;
-    std::vector<std::unique_ptr<ConstantArray>> constant_arrays_;
-    std::vector<std::unique_ptr<ConstantString>> constant_strings_;
-    std::vector<std::unique_ptr<ConstantPointerNull>> constant_pointer_nulls_;
-    std::vector<std::unique_ptr<ConstantAggregateZero>> constant_aggregate_zeros_;
+    OpenHashMap<ConstantListKey, std::unique_ptr<ConstantStruct>, TypeListKeyHash> constant_structs_;
+    OpenHashMap<ConstantListKey, std::unique_ptr<ConstantArray>, TypeListKeyHash> constant_arrays_;
+    OpenHashMap<std::string, std::unique_ptr<ConstantString>, StringKeyHash> constant_strings_;
+    OpenHashMap<Type *, std::unique_ptr<ConstantPointerNull>, PointerKeyHash> constant_pointer_nulls_;
+    OpenHashMap<Type *, std::unique_ptr<ConstantAggregateZero>, PointerKeyHash> constant_aggregate_zeros_;
 
     friend class ArrayType;
     friend class StructType;
 
     // Type storage
-    std::unordered_map<std::pair<Type *, uint64_t>,
-                       std::unique_ptr<ArrayType>>
-        array_types_;
+    OpenHashMap<TypeValueKey, std::unique_ptr<ArrayType>, TypeValueKeyHash> array_types_;
     std::vector<std::unique_ptr<StructType>> struct_types_;
-    std::unordered_map<std::pair<Type *, uint64_t>, std::unique_ptr<VectorType>> vector_types_;
+    // Lookup of struct_types_ by name and, for complete structs, by members;
+    // the first struct registered under a key wins
+    OpenHashMap<std::string, StructType *, StringKeyHash> named_structs_;
+    OpenHashMap<std::vector<MemberInfo>, StructType *, MembersKeyHash> structs_by_members_;
+    OpenHashMap<TypeValueKey, std::unique_ptr<VectorType>, TypeValueKeyHash> vector_types_;
 
-    using FunctionTypeKey = std::pair<Type *, std::vector<Type *>>;
-    struct FunctionTypeKeyHash
-    {
-        size_t operator()(const FunctionTypeKey &key) const
-        {
-            size_t hash = std::hash<Type *>{}(key.first);
-            for (auto *type : key.second)
-            {
-                hash ^= std::hash<Type *>{}(type);
-            }
-            return hash;
-        }
-    };
-    std::unordered_map<FunctionTypeKey, std::unique_ptr<FunctionType>, FunctionTypeKeyHash> function_types_;
+    OpenHashMap<FunctionTypeKey, std::unique_ptr<FunctionType>, TypeListKeyHash> function_types_;
+
+    void index_struct(StructType *st);
+    void rename_struct(StructType *st, const std::string &old_name);
 };
 
 //===----------------------------------------------------------------------===//
@@ -1502,12 +1758,28 @@ public:
 
     bool is_conditional() const
     {
-        auto sz = operands_.size();
+        auto sz = num_operands();
         MO_ASSERT(sz == 3 || sz == 1, "BranchInst should have 1 or 3 operands");
         return sz == 3;
     }
     BasicBlock *get_true_successor() const;
     BasicBlock *get_false_successor() const;
+    // Re-targets every edge to `from` at `to`, keeping the CFG edges in step
+    void replace_successor(BasicBlock *from, BasicBlock *to);
+
+    // Times a conditional branch went to each successor in a profiled run
+    bool has_branch_weights() const { return has_weights_; }
+    uint64_t true_weight() const { return true_weight_; }
+    uint64_t false_weight() const { return false_weight_; }
+    void set_branch_weights(uint64_t true_weight, uint64_t false_weight)
+    {
+        has_weights_ = true;
+        true_weight_ = true_weight;
+        false_weight_ = false_weight;
+    }
+    // Profiled runs along the edge to `succ`: the block's own count for an
+    // unconditional branch, 0 when there is nothing to go by
+    uint64_t edge_weight(const BasicBlock *succ) const;
 
 private:
     BranchInst(BasicBlock *target, BasicBlock *parent,
@@ -1515,6 +1787,9 @@ private:
 
     BasicBlock *true_bb_;
     BasicBlock *false_bb_;
+    bool has_weights_ = false;
+    uint64_t true_weight_ = 0;
+    uint64_t false_weight_ = 0;
 };
 
 class ReturnInst : public Instruction
@@ -1522,7 +1797,7 @@ class ReturnInst : public Instruction
 public:
     static ReturnInst *create(Value *value, BasicBlock *parent);
 
-    Value *value() const { return operands_.size() > 0 ? operands_[0] : nullptr; }
+    Value *value() const { return num_operands() > 0 ? operand(0) : nullptr; }
 
 private:
     ReturnInst(Value *value, BasicBlock *parent);
@@ -1543,9 +1818,11 @@ public:
     static PhiInst *create(Type *type, BasicBlock *parent);
 
     void add_incoming(Value *val, BasicBlock *bb);
+    void remove_incoming(BasicBlock *bb);
+    void replace_incoming_block(BasicBlock *from, BasicBlock *to);
 
-    unsigned num_incoming() const { return operands_.size() / 2; }
-    Value *get_incoming_value(unsigned i) const { return operands_[2 * i]; }
+    unsigned num_incoming() const { return num_operands() / 2; }
+    Value *get_incoming_value(unsigned i) const { return operand(2 * i); }
     BasicBlock *get_incoming_block(unsigned i) const;
 
 private:
@@ -1730,8 +2007,15 @@ public:
     std::vector<Value *> create_operand_list(Value *callee, const std::vector<Value *> &args);
     std::vector<Value *> arguments() const;
 
+    // Set by mark_tail_calls on calls the caller's frame is dead across, so
+    // the backend may jump to the callee instead
+    bool is_tail_call() const { return tail_call_; }
+    void set_tail_call(bool tail_call) { tail_call_ = tail_call; }
+
 private:
     CallInst(BasicBlock *parent, Value *callee, Type *return_type, const std::vector<Value *> &args, const std::string &name);
+
+    bool tail_call_ = false;
 };
 
 class RawCallInst : public Instruction
@@ -1883,4 +2167,8 @@ struct StructLayout
     size_t alignment;
 };
 
-StructLayout calculate_aligned_layout(const std::vector<Type *> &members);
+// Offsets of `members` in declaration order. With `reorder_fields` the
+// members are placed by decreasing alignment instead, which leaves no
+// padding between them when sizes are multiples of alignments; member
+// indices don't change, only where the members sit
+StructLayout calculate_aligned_layout(const std::vector<Type *> &members, bool reorder_fields);
@@ -0,0 +1,1338 @@
+#include "ir_binary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <unordered_set>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    enum class TypeTag : uint8_t
+    {
+        Void,
+        Int,
+        Float,
+        Pointer,
+        Function,
+        Array,
+        Vector,
+        Struct,    // a shell; members follow in the struct bodies
+        Anonymous, // an anonymous struct by its members, in function entries
+    };
+
+    enum class ValueTag : uint8_t
+    {
+        Int,
+        FP,
+        String,
+        Null,
+        Zero,
+        Array,
+        Struct,
+        Global,
+        External, // a global of the module linked into, by name
+    };
+
+    // Operands are (payload << 2) | kind
+    enum OperandKind : uint64_t
+    {
+        Backward = 0, // an earlier local, payload = how far back, minus one
+        Forward = 1,  // a local defined later, payload = how far ahead; its type follows
+        Global = 2,   // payload = module value + 1, 0 for no value
+        Block = 3,    // payload = block index
+    };
+
+    enum FunctionFlags : uint64_t
+    {
+        InstanceMethod = 1,
+        Internal = 2,
+        HiddenRetval = 4,
+    };
+
+    bool fail(std::string *err_msg, std::string message)
+    {
+        if (err_msg)
+            *err_msg = std::move(message);
+        return false;
+    }
+
+    void put(std::vector<uint8_t> &out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value) | 0x80);
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint64_t fp_bits(double value)
+    {
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    // The struct `type` holds by value, looking through arrays and vectors
+    const StructType *held_struct(const Type *type)
+    {
+        while (type)
+        {
+            if (const QualifiedType *qualified = type->as_qualified())
+                type = &qualified->base_type();
+            else if (const ArrayType *array = type->as_array())
+                type = array->element_type();
+            else if (const VectorType *vector = type->as_vector())
+                type = vector->element_type();
+            else
+                return type->as_struct();
+        }
+        return nullptr;
+    }
+
+    //===------------------------------------------------------------------===//
+    //                         Writing
+    //===------------------------------------------------------------------===//
+
+    class ModuleWriter
+    {
+    public:
+        explicit ModuleWriter(const Module &module) : module_(module) {}
+        // Writes a function entry for `only`
+        ModuleWriter(const Module &module, const Function *only, std::span<GlobalVariable *const> owned)
+            : module_(module), only_(only), owned_(owned.begin(), owned.end())
+        {
+        }
+
+        std::vector<uint8_t> write();
+
+    private:
+        uint64_t string_id(const std::string &str);
+        uint64_t type_id(const Type *type);
+        uint64_t value_id(const Value *value);
+        void order_struct(const StructType *st, std::unordered_set<const StructType *> &seen,
+                          std::vector<const StructType *> &order);
+        void write_struct_shell(const StructType *st);
+        void write_body(const Function &func, std::vector<uint8_t> &out);
+        std::vector<const Function *> written_functions() const;
+
+        const Module &module_;
+        const Function *only_ = nullptr;
+        std::unordered_set<const GlobalVariable *> owned_;
+
+        std::unordered_map<std::string, uint64_t> string_ids_;
+        std::vector<const std::string *> strings_; // keys of string_ids_
+
+        std::unordered_map<const Type *, uint64_t> type_ids_;
+        std::vector<uint8_t> type_table_;
+        uint64_t num_types_ = 0;
+
+        std::unordered_map<const Value *, uint64_t> value_ids_;
+        std::vector<uint8_t> value_table_;
+        uint64_t num_values_ = 0; // functions included
+    };
+
+    uint64_t ModuleWriter::string_id(const std::string &str)
+    {
+        auto [it, inserted] = string_ids_.emplace(str, strings_.size());
+        if (inserted)
+            strings_.push_back(&it->first);
+        return it->second;
+    }
+
+    void ModuleWriter::write_struct_shell(const StructType *st)
+    {
+        const uint64_t name = string_id(st->identifier());
+        type_ids_.emplace(st, num_types_++);
+        put(type_table_, uint64_t(TypeTag::Struct));
+        put(type_table_, name);
+    }
+
+    uint64_t ModuleWriter::type_id(const Type *type)
+    {
+        if (const QualifiedType *qualified = type->as_qualified())
+            return type_id(&qualified->base_type());
+        if (auto it = type_ids_.find(type); it != type_ids_.end())
+            return it->second;
+
+        // What the entry refers to gets its number first
+        std::vector<uint64_t> fields;
+        TypeTag tag;
+        switch (type->type_id())
+        {
+        case Type::VoidTy:
+            tag = TypeTag::Void;
+            break;
+        case Type::IntTy:
+            tag = TypeTag::Int;
+            fields = {type->bit_width(), type->is_unsigned()};
+            break;
+        case Type::FpTy:
+            tag = TypeTag::Float;
+            fields = {type->bit_width()};
+            break;
+        case Type::PtrTy:
+            tag = TypeTag::Pointer;
+            fields = {type_id(type->as_pointer()->element_type())};
+            break;
+        case Type::FuncTy:
+        {
+            const FunctionType *func = type->as_function();
+            tag = TypeTag::Function;
+            fields = {type_id(func->return_type()), func->num_params()};
+            for (Type *param : func->param_types())
+                fields.push_back(type_id(param));
+            break;
+        }
+        case Type::ArrayTy:
+            tag = TypeTag::Array;
+            fields = {type_id(type->as_array()->element_type()), type->as_array()->num_elements()};
+            break;
+        case Type::VecTy:
+            tag = TypeTag::Vector;
+            fields = {type_id(type->as_vector()->element_type()), type->as_vector()->num_elements()};
+            break;
+        case Type::StructTy:
+        {
+            const StructType *st = type->as_struct();
+            if (!only_ || !st->identifier().empty())
+            {
+                // Structs of a module are all there already, an entry names
+                // those it meets
+                write_struct_shell(st);
+                return type_ids_.at(type);
+            }
+            tag = TypeTag::Anonymous;
+            fields = {st->members().size()};
+            for (const MemberInfo &member : st->members())
+            {
+                fields.push_back(string_id(member.name));
+                fields.push_back(type_id(member.type));
+            }
+            break;
+        }
+        default:
+            MO_UNREACHABLE();
+        }
+
+        put(type_table_, uint64_t(tag));
+        for (uint64_t field : fields)
+            put(type_table_, field);
+        type_ids_.emplace(type, num_types_);
+        return num_types_++;
+    }
+
+    uint64_t ModuleWriter::value_id(const Value *value)
+    {
+        if (auto it = value_ids_.find(value); it != value_ids_.end())
+            return it->second;
+
+        std::vector<uint64_t> fields;
+        ValueTag tag;
+        if (auto *ci = dynamic_cast<const ConstantInt *>(value))
+        {
+            tag = ValueTag::Int;
+            fields = {ci->value()};
+        }
+        else if (auto *fp = dynamic_cast<const ConstantFP *>(value))
+        {
+            tag = ValueTag::FP;
+            fields = {fp_bits(fp->value())};
+        }
+        else if (auto *str = dynamic_cast<const ConstantString *>(value))
+        {
+            tag = ValueTag::String;
+            fields = {string_id(str->value())};
+        }
+        else if (dynamic_cast<const ConstantPointerNull *>(value))
+        {
+            tag = ValueTag::Null;
+        }
+        else if (dynamic_cast<const ConstantAggregateZero *>(value))
+        {
+            tag = ValueTag::Zero;
+        }
+        else if (auto *aggregate = dynamic_cast<const ConstantAggregate *>(value))
+        {
+            tag = dynamic_cast<const ConstantStruct *>(value) ? ValueTag::Struct : ValueTag::Array;
+            fields = {aggregate->elements().size()};
+            for (const Constant *element : aggregate->elements())
+                fields.push_back(value_id(element) + 1);
+        }
+        else if (auto *gv = dynamic_cast<const GlobalVariable *>(value); gv && only_ && !owned_.count(gv))
+        {
+            tag = ValueTag::External;
+            fields = {gv->is_constant(), string_id(gv->name())};
+        }
+        else if (auto *gv = dynamic_cast<const GlobalVariable *>(value))
+        {
+            tag = ValueTag::Global;
+            fields = {gv->is_constant(), gv->initializer() ? value_id(gv->initializer()) + 1 : 0, string_id(gv->name())};
+        }
+        else
+        {
+            MO_ASSERT(false, "`%s` is not a module-level value", value->name().c_str());
+            return 0;
+        }
+
+        put(value_table_, uint64_t(tag));
+        put(value_table_, type_id(value->type()));
+        for (uint64_t field : fields)
+            put(value_table_, field);
+        value_ids_.emplace(value, num_values_);
+        return num_values_++;
+    }
+
+    // Members held by value are laid out first, so set_body sees their sizes
+    void ModuleWriter::order_struct(const StructType *st, std::unordered_set<const StructType *> &seen,
+                                    std::vector<const StructType *> &order)
+    {
+        if (!seen.insert(st).second)
+            return;
+        for (const MemberInfo &member : st->members())
+        {
+            if (const StructType *held = held_struct(member.type))
+                order_struct(held, seen, order);
+        }
+        order.push_back(st);
+    }
+
+    void ModuleWriter::write_body(const Function &func, std::vector<uint8_t> &out)
+    {
+        const std::vector<BasicBlock *> &blocks = func.basic_blocks();
+        if (blocks.empty())
+            return;
+
+        std::unordered_map<const Value *, uint64_t> locals;
+        std::unordered_map<const BasicBlock *, uint64_t> block_ids;
+        uint64_t next = 0;
+        for (Argument *arg : func.args())
+            locals.emplace(arg, next++);
+        for (BasicBlock *bb : blocks)
+        {
+            block_ids.emplace(bb, block_ids.size());
+            for (const Instruction &inst : *bb)
+                locals.emplace(&inst, next++);
+        }
+
+        put(out, blocks.size());
+        for (BasicBlock *bb : blocks)
+        {
+            put(out, string_id(bb->name()));
+            put(out, bb->has_profile_count());
+            if (bb->has_profile_count())
+                put(out, bb->profile_count());
+        }
+
+        uint64_t id = func.num_args();
+        for (BasicBlock *bb : blocks)
+        {
+            uint64_t num_insts = 0;
+            for (Instruction *inst = bb->first_instruction(); inst; inst = inst->next())
+                ++num_insts;
+            put(out, num_insts);
+            for (const Instruction &inst : *bb)
+            {
+                put(out, uint64_t(inst.opcode()));
+                put(out, type_id(inst.type()));
+                put(out, string_id(inst.name()));
+                put(out, inst.num_operands());
+                for (Value *op : inst.operands())
+                {
+                    auto *block = dynamic_cast<const BasicBlock *>(op);
+                    if (!op)
+                        put(out, Global);
+                    else if (block && block_ids.count(block))
+                        put(out, block_ids.at(block) << 2 | Block);
+                    else if (auto local = locals.find(op); local == locals.end())
+                        put(out, (value_id(op) + 1) << 2 | Global);
+                    else if (local->second < id)
+                        put(out, (id - 1 - local->second) << 2 | Backward);
+                    else
+                    {
+                        put(out, (local->second - id) << 2 | Forward);
+                        put(out, type_id(op->type()));
+                    }
+                }
+
+                switch (inst.opcode())
+                {
+                case Opcode::ICmp:
+                    put(out, static_cast<const ICmpInst &>(inst).predicate());
+                    break;
+                case Opcode::FCmp:
+                    put(out, static_cast<const FCmpInst &>(inst).predicate());
+                    break;
+                case Opcode::Alloca:
+                    put(out, type_id(static_cast<const AllocaInst &>(inst).allocated_type()));
+                    break;
+                case Opcode::Br:
+                case Opcode::CondBr:
+                {
+                    const auto &branch = static_cast<const BranchInst &>(inst);
+                    put(out, branch.has_branch_weights());
+                    if (branch.has_branch_weights())
+                    {
+                        put(out, branch.true_weight());
+                        put(out, branch.false_weight());
+                    }
+                    break;
+                }
+                case Opcode::Call:
+                    put(out, static_cast<const CallInst &>(inst).is_tail_call());
+                    break;
+                default:
+                    break;
+                }
+                ++id;
+            }
+        }
+    }
+
+    // Every function of a module; for an entry, its function and then those
+    // it calls or takes the address of
+    std::vector<const Function *> ModuleWriter::written_functions() const
+    {
+        if (!only_)
+            return {module_.functions().begin(), module_.functions().end()};
+
+        std::vector<const Function *> funcs = {only_};
+        std::unordered_set<const Value *> seen = {only_};
+        std::vector<const Value *> work;
+        for (BasicBlock *bb : only_->basic_blocks())
+        {
+            for (const Instruction &inst : *bb)
+                work.insert(work.end(), inst.operands().begin(), inst.operands().end());
+        }
+        for (const GlobalVariable *gv : owned_)
+            work.push_back(gv->initializer());
+        while (!work.empty())
+        {
+            const Value *value = work.back();
+            work.pop_back();
+            if (!value || !seen.insert(value).second)
+                continue;
+            if (auto *func = dynamic_cast<const Function *>(value))
+                funcs.push_back(func);
+            else if (auto *aggregate = dynamic_cast<const ConstantAggregate *>(value))
+                work.insert(work.end(), aggregate->elements().begin(), aggregate->elements().end());
+        }
+        return funcs;
+    }
+
+    std::vector<uint8_t> ModuleWriter::write()
+    {
+        string_id("");
+        const uint64_t module_name = string_id(module_.name());
+        const std::vector<const Function *> funcs = written_functions();
+        if (!only_)
+        {
+            for (StructType *st : module_.struct_types())
+                write_struct_shell(st);
+        }
+        for (const Function *func : funcs)
+            value_ids_.emplace(func, num_values_++);
+        const uint64_t num_functions = num_values_;
+        if (!only_)
+        {
+            for (GlobalVariable *gv : module_.global_variables())
+                value_id(gv);
+        }
+
+        std::vector<uint8_t> functions;
+        std::vector<uint8_t> code;
+        for (const Function *func : funcs)
+        {
+            std::vector<uint8_t> body;
+            if (!only_ || func == only_)
+                write_body(*func, body);
+            put(functions, string_id(func->name()));
+            put(functions, type_id(func->return_type()));
+            put(functions, func->num_args());
+            for (Argument *arg : func->args())
+            {
+                put(functions, string_id(arg->name()));
+                put(functions, type_id(arg->type()));
+            }
+            uint64_t flags = 0;
+            if (func->is_instance_method())
+                flags |= InstanceMethod;
+            if (func->is_internal())
+                flags |= Internal;
+            if (func->has_hidden_retval())
+                flags |= HiddenRetval;
+            put(functions, flags);
+            if (func->has_hidden_retval())
+                put(functions, type_id(func->hidden_retval_type()));
+            put(functions, body.size());
+            code.insert(code.end(), body.begin(), body.end());
+        }
+
+        std::vector<uint8_t> struct_bodies;
+        std::unordered_set<const StructType *> seen;
+        std::vector<const StructType *> order;
+        for (StructType *st : module_.struct_types())
+            order_struct(st, seen, order);
+        // An entry carries the members of each struct it names, and so the
+        // structs those name in turn
+        for (size_t known = 0; known != type_ids_.size();)
+        {
+            known = type_ids_.size();
+            for (const StructType *st : order)
+            {
+                if (type_ids_.count(st))
+                {
+                    for (const MemberInfo &member : st->members())
+                        type_id(member.type);
+                }
+            }
+        }
+        uint64_t num_bodies = 0;
+        for (const StructType *st : order)
+        {
+            if (st->is_opaque() || !type_ids_.count(st) || (only_ && st->identifier().empty()))
+                continue;
+            ++num_bodies;
+            put(struct_bodies, type_ids_.at(st));
+            put(struct_bodies, st->members().size());
+            for (const MemberInfo &member : st->members())
+            {
+                put(struct_bodies, string_id(member.name));
+                put(struct_bodies, type_id(member.type));
+            }
+        }
+
+        std::vector<uint8_t> out;
+        for (unsigned i = 0; i < 4; ++i)
+            out.push_back(static_cast<uint8_t>(IR_BINARY_MAGIC >> (8 * i)));
+        put(out, IR_BINARY_VERSION);
+        put(out, strings_.size());
+        for (const std::string *str : strings_)
+        {
+            put(out, str->size());
+            out.insert(out.end(), str->begin(), str->end());
+        }
+        put(out, module_name);
+        put(out, num_types_);
+        out.insert(out.end(), type_table_.begin(), type_table_.end());
+        put(out, num_bodies);
+        out.insert(out.end(), struct_bodies.begin(), struct_bodies.end());
+        put(out, num_functions);
+        out.insert(out.end(), functions.begin(), functions.end());
+        put(out, num_values_ - num_functions);
+        out.insert(out.end(), value_table_.begin(), value_table_.end());
+        out.insert(out.end(), code.begin(), code.end());
+        return out;
+    }
+
+    //===------------------------------------------------------------------===//
+    //                         Reading
+    //===------------------------------------------------------------------===//
+
+    // Stands in for a value used before the instruction defining it
+    class Placeholder : public Value
+    {
+    public:
+        explicit Placeholder(Type *type) : Value(type) {}
+    };
+
+    // Reads numbers and references off `bytes`; after the first error every
+    // read returns nothing and `ok` stays false
+    class Decoder
+    {
+    public:
+        Decoder(std::span<const uint8_t> bytes, const std::vector<std::string_view> &strings,
+                const std::vector<Type *> &types, const std::vector<Value *> &values)
+            : p_(bytes.data()), end_(bytes.data() + bytes.size()), strings_(strings), types_(types), values_(values)
+        {
+        }
+
+        bool ok() const { return error_.empty(); }
+        const std::string &error() const { return error_; }
+        bool at_end() const { return p_ == end_; }
+        size_t remaining() const { return static_cast<size_t>(end_ - p_); }
+
+        bool fail(const std::string &message)
+        {
+            if (error_.empty())
+                error_ = message;
+            p_ = end_;
+            return false;
+        }
+
+        uint64_t number()
+        {
+            uint64_t value = 0;
+            for (unsigned shift = 0; shift < 64 && p_ != end_; shift += 7)
+            {
+                const uint8_t byte = *p_++;
+                value |= uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80))
+                    return value;
+            }
+            fail("truncated or overlong number");
+            return 0;
+        }
+
+        // A count of entries of at least one byte each
+        uint64_t count()
+        {
+            const uint64_t n = number();
+            if (n > remaining())
+                fail("count " + std::to_string(n) + " runs past the end");
+            return ok() ? n : 0;
+        }
+
+        std::span<const uint8_t> take(uint64_t size)
+        {
+            if (size > remaining())
+            {
+                fail("section runs past the end");
+                return {};
+            }
+            std::span<const uint8_t> bytes(p_, size);
+            p_ += size;
+            return bytes;
+        }
+
+        std::string string()
+        {
+            const uint64_t id = number();
+            if (id >= strings_.size())
+            {
+                fail("string " + std::to_string(id) + " out of range");
+                return {};
+            }
+            return std::string(strings_[id]);
+        }
+
+        Type *type()
+        {
+            const uint64_t id = number();
+            if (id >= types_.size())
+            {
+                fail("type " + std::to_string(id) + " out of range");
+                return nullptr;
+            }
+            return types_[id];
+        }
+
+        // A module value + 1, or 0 for none
+        Value *value_or_null()
+        {
+            const uint64_t id = number();
+            if (id > values_.size())
+            {
+                fail("value " + std::to_string(id - 1) + " out of range");
+                return nullptr;
+            }
+            return id ? values_[id - 1] : nullptr;
+        }
+
+        Constant *constant_or_null()
+        {
+            Value *value = value_or_null();
+            auto *constant = dynamic_cast<Constant *>(value);
+            if (value && !constant)
+                fail("`" + value->name() + "` is not a constant");
+            return constant;
+        }
+
+    private:
+        const uint8_t *p_;
+        const uint8_t *end_;
+        std::string error_;
+        const std::vector<std::string_view> &strings_;
+        const std::vector<Type *> &types_;
+        const std::vector<Value *> &values_;
+    };
+
+    Type *read_type(Decoder &in, Module &m, std::vector<Type *> &types, bool linking)
+    {
+        const uint64_t tag = in.number();
+        switch (static_cast<TypeTag>(tag))
+        {
+        case TypeTag::Void:
+            return m.get_void_type();
+        case TypeTag::Int:
+        {
+            const uint64_t bits = in.number();
+            const bool is_unsigned = in.number();
+            if (bits == 0 || bits > 64)
+                break;
+            return m.get_integer_type(static_cast<uint8_t>(bits), is_unsigned);
+        }
+        case TypeTag::Float:
+        {
+            const uint64_t bits = in.number();
+            if (bits != 32 && bits != 64)
+                break;
+            return m.get_float_type(static_cast<uint8_t>(bits));
+        }
+        case TypeTag::Pointer:
+            if (Type *element = in.type())
+                return m.get_pointer_type(element);
+            return nullptr;
+        case TypeTag::Function:
+        {
+            Type *ret = in.type();
+            std::vector<Type *> params(in.count());
+            for (Type *&param : params)
+                param = in.type();
+            if (!in.ok())
+                return nullptr;
+            return m.get_function_type(ret, params);
+        }
+        case TypeTag::Array:
+        case TypeTag::Vector:
+        {
+            Type *element = in.type();
+            const uint64_t n = in.number();
+            if (!in.ok())
+                return nullptr;
+            return static_cast<TypeTag>(tag) == TypeTag::Array ? static_cast<Type *>(m.get_array_type(element, n))
+                                                               : m.get_vector_type(element, n);
+        }
+        case TypeTag::Struct:
+        {
+            const std::string name = in.string();
+            if (!in.ok())
+                return nullptr;
+            if (linking)
+            {
+                StructType *st = name.empty() ? nullptr : m.try_get_named_global_type(name);
+                if (!st)
+                    in.fail("no struct `" + name + "` to link against");
+                return st;
+            }
+            // Every shell exists before any body is set, so no two of them
+            // are uniqued into one
+            StructType *st = m.get_struct_type_anonymous({});
+            if (!name.empty())
+                st->set_name(name);
+            return st;
+        }
+        case TypeTag::Anonymous:
+        {
+            std::vector<MemberInfo> members;
+            for (uint64_t n = in.count(); members.size() < n && in.ok();)
+            {
+                std::string name = in.string();
+                Type *member = in.type();
+                members.emplace_back(name, member);
+            }
+            if (!in.ok() || members.empty())
+                break;
+            return m.get_struct_type_anonymous(members);
+        }
+        }
+        in.fail("bad entry in the type table at type " + std::to_string(types.size()));
+        return nullptr;
+    }
+
+    Constant *read_constant(Decoder &in, Module &m, bool linking)
+    {
+        const uint64_t tag = in.number();
+        Type *type = in.type();
+        if (!in.ok())
+            return nullptr;
+        switch (static_cast<ValueTag>(tag))
+        {
+        case ValueTag::Int:
+            if (IntegerType *int_type = type->as_integer())
+                return m.get_constant_int(int_type, in.number());
+            break;
+        case ValueTag::FP:
+            if (FloatType *float_type = type->as_float())
+            {
+                const uint64_t bits = in.number();
+                double value;
+                std::memcpy(&value, &bits, sizeof(value));
+                return m.get_constant_fp(float_type, value);
+            }
+            break;
+        case ValueTag::String:
+            return m.get_constant_string(in.string());
+        case ValueTag::Null:
+            if (PointerType *ptr = type->as_pointer())
+                return m.get_constant_pointer_null(ptr);
+            break;
+        case ValueTag::Zero:
+            return m.get_constant_aggregate_zero(type);
+        case ValueTag::Array:
+        case ValueTag::Struct:
+        {
+            std::vector<Constant *> elements(in.count());
+            for (Constant *&element : elements)
+            {
+                element = in.constant_or_null();
+                if (!element)
+                    in.fail("missing element");
+            }
+            if (!in.ok())
+                return nullptr;
+            if (static_cast<ValueTag>(tag) == ValueTag::Array && type->as_array())
+                return m.get_constant_array(type->as_array(), elements);
+            if (static_cast<ValueTag>(tag) == ValueTag::Struct && type->as_struct())
+                return m.get_constant_struct(type->as_struct(), elements);
+            break;
+        }
+        case ValueTag::Global:
+        {
+            const bool is_constant = in.number();
+            Constant *initializer = in.constant_or_null();
+            const std::string name = in.string();
+            if (!in.ok())
+                return nullptr;
+            return m.create_global_variable(type, is_constant, initializer, name);
+        }
+        case ValueTag::External:
+        {
+            const bool is_constant = in.number();
+            const std::string name = in.string();
+            if (!in.ok() || !linking)
+                break;
+            GlobalVariable *gv = m.get_global_variable(name);
+            if (!gv || gv->type() != type || gv->is_constant() != is_constant)
+                in.fail("no global `" + name + "` of the same type to link against");
+            return gv;
+        }
+        }
+        in.fail("bad entry in the value table");
+        return nullptr;
+    }
+
+    Instruction *create_cast(Opcode op, Value *val, Type *type, BasicBlock *bb, const std::string &name)
+    {
+        switch (op)
+        {
+        case Opcode::ZExt:
+            return ZExtInst::create(val, type, bb, name);
+        case Opcode::SExt:
+            return SExtInst::create(val, type, bb, name);
+        case Opcode::Trunc:
+            return TruncInst::create(val, type, bb, name);
+        case Opcode::SIToFP:
+            return SIToFPInst::create(val, type, bb, name);
+        case Opcode::FPToSI:
+            return FPToSIInst::create(val, type, bb, name);
+        case Opcode::FPExt:
+            return FPExtInst::create(val, type, bb, name);
+        case Opcode::FPTrunc:
+            return FPTruncInst::create(val, type, bb, name);
+        case Opcode::BitCast:
+            return BitCastInst::create(val, type, bb, name);
+        case Opcode::PtrToInt:
+            return PtrToIntInst::create(val, type, bb, name);
+        case Opcode::IntToPtr:
+            return IntToPtrInst::create(val, type, bb, name);
+        case Opcode::FPToUI:
+            return FPToUIInst::create(val, type, bb, name);
+        case Opcode::UIToFP:
+            return UIToFPInst::create(val, type, bb, name);
+        default:
+            return nullptr;
+        }
+    }
+
+    // Builds one instruction from its operands and reads what follows them;
+    // nullptr with the decoder failed when the record doesn't make sense
+    Instruction *create_instruction(Decoder &in, Opcode op, Type *type, const std::string &name,
+                                    const std::vector<Value *> &ops, BasicBlock *bb)
+    {
+        const size_t n = ops.size();
+        auto present = [&](size_t first)
+        { return std::all_of(ops.begin() + std::min(first, n), ops.end(), [](Value *v)
+                             { return v != nullptr; }); };
+        auto pointer = [&](size_t i)
+        { return i < n && ops[i] && ops[i]->type()->is_pointer(); };
+        auto block = [&](size_t i)
+        { return i < n ? dynamic_cast<BasicBlock *>(ops[i]) : nullptr; };
+
+        switch (op)
+        {
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::UDiv:
+        case Opcode::SDiv:
+        case Opcode::URem:
+        case Opcode::SRem:
+        case Opcode::BitAnd:
+        case Opcode::BitOr:
+        case Opcode::BitXor:
+        case Opcode::Shl:
+        case Opcode::LShr:
+        case Opcode::AShr:
+            if (n == 2 && present(0))
+                return BinaryInst::create(op, ops[0], ops[1], bb, name);
+            break;
+        case Opcode::Neg:
+        case Opcode::Not:
+        case Opcode::FNeg:
+        case Opcode::BitNot:
+            if (n == 1 && present(0))
+                return UnaryInst::create(op, ops[0], bb, name);
+            break;
+        case Opcode::ICmp:
+        {
+            const uint64_t pred = in.number();
+            if (n != 2 || !present(0) || pred > ICmpInst::UGE)
+                break;
+            auto *cmp = ICmpInst::create(static_cast<ICmpInst::Predicate>(pred), ops[0], ops[1], bb);
+            cmp->set_name(name);
+            return cmp;
+        }
+        case Opcode::FCmp:
+        {
+            const uint64_t pred = in.number();
+            if (n != 2 || !present(0) || pred > FCmpInst::OGE)
+                break;
+            return FCmpInst::create(static_cast<FCmpInst::Predicate>(pred), ops[0], ops[1], bb, name);
+        }
+        case Opcode::Alloca:
+        {
+            Type *allocated = in.type();
+            if (n != 0 || !allocated)
+                break;
+            return AllocaInst::create(allocated, bb, name);
+        }
+        case Opcode::Load:
+            if (n == 1 && pointer(0))
+                return LoadInst::create(ops[0], bb, name);
+            break;
+        case Opcode::Store:
+            if (n == 2 && present(0) && pointer(1))
+                return StoreInst::create(ops[0], ops[1], bb);
+            break;
+        case Opcode::GetElementPtr:
+            if (pointer(0) && present(1))
+                return GetElementPtrInst::create(ops[0], std::vector<Value *>(ops.begin() + 1, ops.end()), bb, name);
+            break;
+        case Opcode::Br:
+        case Opcode::CondBr:
+        {
+            const bool weighted = in.number();
+            const uint64_t true_weight = weighted ? in.number() : 0;
+            const uint64_t false_weight = weighted ? in.number() : 0;
+            BranchInst *branch = nullptr;
+            if (n == 1 && block(0))
+                branch = BranchInst::create(block(0), bb);
+            else if (n == 3 && ops[0] && block(1) && block(2))
+                branch = BranchInst::create_cond(ops[0], block(1), block(2), bb);
+            else
+                break;
+            if (weighted)
+                branch->set_branch_weights(true_weight, false_weight);
+            return branch;
+        }
+        case Opcode::Ret:
+            if (n <= 1)
+                return ReturnInst::create(n ? ops[0] : nullptr, bb);
+            break;
+        case Opcode::Unreachable:
+            if (n == 0)
+                return UnreachableInst::create(bb);
+            break;
+        case Opcode::Phi:
+        {
+            if (n % 2 != 0)
+                break;
+            for (size_t i = 0; i < n; i += 2)
+            {
+                if (!ops[i] || !block(i + 1))
+                    return in.fail("bad phi in `" + bb->name() + "`"), nullptr;
+            }
+            auto *phi = PhiInst::create(type, bb);
+            phi->set_name(name);
+            for (size_t i = 0; i < n; i += 2)
+                phi->add_incoming(ops[i], block(i + 1));
+            return phi;
+        }
+        case Opcode::Call:
+        {
+            const bool tail = in.number();
+            if (n == 0 || !present(0))
+                break;
+            auto *call = CallInst::create(ops[0], type, std::vector<Value *>(ops.begin() + 1, ops.end()), bb, name);
+            call->set_tail_call(tail);
+            return call;
+        }
+        default:
+            if (n == 1 && ops[0])
+            {
+                if (Instruction *cast = create_cast(op, ops[0], type, bb, name))
+                    return cast;
+            }
+            break;
+        }
+        in.fail("bad instruction with opcode " + std::to_string(static_cast<int>(op)) + " in `" + bb->name() + "`");
+        return nullptr;
+    }
+
+    // Takes a half-built body apart again
+    void discard_body(Function *func)
+    {
+        for (BasicBlock *bb : func->basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+                inst.drop_all_references();
+            while (!bb->successors().empty())
+                bb->remove_successor(bb->successors().back());
+        }
+        while (!func->basic_blocks().empty())
+            func->erase_basic_block(func->basic_blocks().back());
+    }
+
+    // Whether `func`, of the module an entry is linked into, has the
+    // signature the entry expects
+    bool links_to(const Function *func, const Type *ret, const ParamList &params, const Type *hidden_retval)
+    {
+        if (!func || func->return_type() != ret || func->num_args() != params.size() ||
+            func->hidden_retval_type() != hidden_retval)
+            return false;
+        for (size_t i = 0; i < params.size(); ++i)
+        {
+            if (func->arg(i)->type() != params[i].second)
+                return false;
+        }
+        return true;
+    }
+} // namespace
+
+//===----------------------------------------------------------------------===//
+//                             Writer Implementation
+//===----------------------------------------------------------------------===//
+
+std::vector<uint8_t> serialize_module(const Module &module)
+{
+    return ModuleWriter(module).write();
+}
+
+std::vector<uint8_t> serialize_function(const Function &func, std::span<GlobalVariable *const> owned_globals)
+{
+    return ModuleWriter(*func.parent_module(), &func, owned_globals).write();
+}
+
+bool write_module_file(const Module &module, const std::string &path, std::string *err_msg)
+{
+    const std::vector<uint8_t> bytes = serialize_module(module);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+    if (!out.good())
+        return fail(err_msg, "cannot write `" + path + "`");
+    return true;
+}
+
+//===----------------------------------------------------------------------===//
+//                             Reader Implementation
+//===----------------------------------------------------------------------===//
+
+ModuleReader::~ModuleReader() = default;
+
+std::unique_ptr<ModuleReader> ModuleReader::parse(std::vector<uint8_t> bytes, std::string *err_msg)
+{
+    std::unique_ptr<ModuleReader> reader(new ModuleReader());
+    reader->bytes_ = std::move(bytes);
+    if (!reader->read_tables(err_msg))
+        return nullptr;
+    return reader;
+}
+
+std::unique_ptr<ModuleReader> ModuleReader::read_file(const std::string &path, std::string *err_msg)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return fail(err_msg, "cannot open `" + path + "`"), nullptr;
+    std::vector<uint8_t> bytes{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    return parse(std::move(bytes), err_msg);
+}
+
+std::unique_ptr<Module> ModuleReader::load_module(std::vector<uint8_t> bytes, std::string *err_msg)
+{
+    std::unique_ptr<ModuleReader> reader = parse(std::move(bytes), err_msg);
+    if (!reader || !reader->materialize_all(err_msg))
+        return nullptr;
+    return reader->release_module();
+}
+
+Function *ModuleReader::link_function(std::vector<uint8_t> bytes, Module &dest, std::string *err_msg)
+{
+    ModuleReader reader;
+    reader.bytes_ = std::move(bytes);
+    reader.module_ = &dest;
+    reader.linking_ = true;
+    if (!reader.read_tables(err_msg))
+        return nullptr;
+
+    Function *linked = nullptr;
+    for (Value *value : reader.values_)
+    {
+        auto *func = dynamic_cast<Function *>(value);
+        if (func && !reader.is_materialized(func))
+            linked = func;
+    }
+    if (!linked)
+        return fail(err_msg, "binary IR: the entry has no body"), nullptr;
+    return reader.materialize(linked, err_msg) ? linked : nullptr;
+}
+
+bool ModuleReader::read_tables(std::string *err_msg)
+{
+    uint32_t magic = 0;
+    for (unsigned i = 0; i < 4 && i < bytes_.size(); ++i)
+        magic |= uint32_t(bytes_[i]) << (8 * i);
+    if (bytes_.size() < 4 || magic != IR_BINARY_MAGIC)
+        return fail(err_msg, "not a binary IR module");
+
+    Decoder in(std::span<const uint8_t>(bytes_).subspan(4), strings_, types_, values_);
+    if (const uint64_t version = in.number(); version != IR_BINARY_VERSION)
+        return fail(err_msg, "unsupported binary IR version " + std::to_string(version));
+
+    strings_.resize(in.count());
+    for (std::string_view &str : strings_)
+    {
+        std::span<const uint8_t> chars = in.take(in.number());
+        str = std::string_view(reinterpret_cast<const char *>(chars.data()), chars.size());
+    }
+    if (in.ok() && (strings_.empty() || !strings_[0].empty()))
+        in.fail("the string table doesn't start with \"\"");
+    const std::string module_name = in.string();
+    if (!linking_)
+    {
+        owned_ = std::make_unique<Module>(module_name);
+        module_ = owned_.get();
+    }
+
+    const uint64_t num_types = in.count();
+    types_.reserve(num_types);
+    for (uint64_t i = 0; i < num_types && in.ok(); ++i)
+        types_.push_back(read_type(in, *module_, types_, linking_));
+
+    const uint64_t num_bodies = in.count();
+    for (uint64_t i = 0; i < num_bodies && in.ok(); ++i)
+    {
+        Type *type = in.type();
+        StructType *st = type ? type->as_struct() : nullptr;
+        if (in.ok() && (!st || (!linking_ && !st->is_opaque())))
+            in.fail("members for something other than an empty struct");
+        std::vector<MemberInfo> members;
+        for (uint64_t n = in.count(); members.size() < n && in.ok();)
+        {
+            std::string name = in.string();
+            Type *member = in.type();
+            members.emplace_back(name, member);
+        }
+        if (in.ok() && linking_ && st->members() != members)
+            in.fail("struct `" + st->identifier() + "` differs from the one linked against");
+        else if (in.ok() && !linking_)
+            st->set_body(members);
+    }
+
+    const uint64_t num_functions = in.count();
+    std::vector<std::pair<Function *, uint64_t>> code_sizes;
+    code_sizes.reserve(num_functions);
+    values_.reserve(num_functions);
+    for (uint64_t i = 0; i < num_functions && in.ok(); ++i)
+    {
+        const std::string name = in.string();
+        Type *ret = in.type();
+        ParamList params(in.count());
+        for (auto &[param_name, param_type] : params)
+        {
+            param_name = in.string();
+            param_type = in.type();
+        }
+        const uint64_t flags = in.number();
+        Type *hidden_retval = (flags & HiddenRetval) ? in.type() : nullptr;
+        const uint64_t code_size = in.number();
+        if (!in.ok())
+            break;
+
+        Function *func = linking_ ? module_->get_function(name) : module_->create_function(name, ret, params);
+        if (linking_ && !links_to(func, ret, params, hidden_retval))
+        {
+            in.fail("no function `" + name + "` of the same type to link against");
+            break;
+        }
+        if (!linking_ || code_size)
+        {
+            if (linking_ && !func->basic_blocks().empty())
+            {
+                in.fail("`" + name + "` already has a body");
+                break;
+            }
+            func->set_instance_method(flags & InstanceMethod);
+            func->set_internal(flags & Internal);
+            func->set_hidden_retval(hidden_retval);
+            for (size_t arg = 0; linking_ && arg < params.size(); ++arg)
+                func->arg(arg)->set_name(params[arg].first);
+        }
+        values_.push_back(func);
+        code_sizes.emplace_back(func, code_size);
+    }
+
+    const uint64_t num_values = in.count();
+    values_.reserve(values_.size() + num_values);
+    for (uint64_t i = 0; i < num_values && in.ok(); ++i)
+        values_.push_back(read_constant(in, *module_, linking_));
+
+    bodies_.reserve(code_sizes.size());
+    for (const auto &[func, code_size] : code_sizes)
+    {
+        std::span<const uint8_t> code = in.take(code_size);
+        bodies_.emplace(func, LazyBody{code, code.empty()});
+    }
+    if (in.ok() && !in.at_end())
+        in.fail(std::to_string(in.remaining()) + " bytes past the last body");
+    if (!in.ok())
+        return fail(err_msg, "binary IR: " + in.error());
+    return true;
+}
+
+bool ModuleReader::is_materialized(const Function *func) const
+{
+    auto it = bodies_.find(func);
+    return it == bodies_.end() || it->second.materialized;
+}
+
+bool ModuleReader::materialize(Function *func, std::string *err_msg)
+{
+    auto it = bodies_.find(func);
+    if (it == bodies_.end())
+        return fail(err_msg, "`" + func->name() + "` is not from this reader");
+    if (it->second.materialized)
+        return true;
+    if (!decode_body(func, it->second.code, err_msg))
+        return false;
+    it->second.materialized = true;
+    return true;
+}
+
+bool ModuleReader::materialize_all(std::string *err_msg)
+{
+    for (Function *func : module_->functions())
+    {
+        if (!materialize(func, err_msg))
+            return false;
+    }
+    return true;
+}
+
+Function *ModuleReader::get_function(const std::string &name, std::string *err_msg)
+{
+    Function *func = module_->get_function(name);
+    if (!func)
+        return fail(err_msg, "no function `" + name + "`"), nullptr;
+    return materialize(func, err_msg) ? func : nullptr;
+}
+
+bool ModuleReader::decode_body(Function *func, std::span<const uint8_t> code, std::string *err_msg)
+{
+    Decoder in(code, strings_, types_, values_);
+
+    std::vector<BasicBlock *> blocks(in.count());
+    if (in.ok() && blocks.empty())
+        in.fail("a body without blocks");
+    for (BasicBlock *&bb : blocks)
+    {
+        const std::string name = in.string();
+        const bool counted = in.number();
+        const uint64_t count = counted ? in.number() : 0;
+        if (!in.ok())
+            break;
+        bb = func->create_basic_block(name);
+        if (counted)
+            bb->set_profile_count(count);
+    }
+
+    std::vector<Value *> locals(func->args().begin(), func->args().end());
+    std::unordered_map<uint64_t, std::unique_ptr<Placeholder>> forward;
+    std::vector<Value *> ops;
+    for (BasicBlock *bb : blocks)
+    {
+        for (uint64_t n = in.count(); n > 0 && in.ok(); --n)
+        {
+            const uint64_t id = locals.size();
+            const uint64_t opcode = in.number();
+            Type *type = in.type();
+            const std::string name = in.string();
+            ops.assign(in.count(), nullptr);
+            for (Value *&op : ops)
+            {
+                const uint64_t operand = in.number();
+                const uint64_t payload = operand >> 2;
+                switch (operand & 3)
+                {
+                case Backward:
+                    if (payload >= id)
+                        in.fail("operand reaches back before the arguments");
+                    else
+                        op = locals[id - 1 - payload];
+                    break;
+                case Forward:
+                {
+                    Type *op_type = in.type();
+                    std::unique_ptr<Placeholder> &placeholder = forward[id + payload];
+                    if (!placeholder && op_type)
+                        placeholder = std::make_unique<Placeholder>(op_type);
+                    else if (placeholder && placeholder->type() != op_type)
+                        in.fail("value " + std::to_string(id + payload) + " used with two types");
+                    op = placeholder.get();
+                    break;
+                }
+                case Global:
+                    if (payload > values_.size())
+                        in.fail("value " + std::to_string(payload - 1) + " out of range");
+                    else
+                        op = payload ? values_[payload - 1] : nullptr;
+                    break;
+                case Block:
+                    if (payload >= blocks.size())
+                        in.fail("block " + std::to_string(payload) + " out of range");
+                    else
+                        op = blocks[payload];
+                    break;
+                }
+            }
+            if (!in.ok())
+                break;
+            if (opcode > static_cast<uint64_t>(Opcode::AShr))
+            {
+                in.fail("unknown opcode " + std::to_string(opcode));
+                break;
+            }
+
+            Instruction *inst = create_instruction(in, static_cast<Opcode>(opcode), type, name, ops, bb);
+            if (!inst)
+                break;
+            bb->append(inst);
+            locals.push_back(inst);
+            if (inst->type() != type)
+                in.fail("`" + name + "` is not of the type recorded for it");
+            if (auto it = forward.find(id); it != forward.end())
+            {
+                if (it->second->type() != inst->type())
+                    in.fail("`" + name + "` is used before it is defined with another type");
+                it->second->replace_all_uses_with(inst);
+                forward.erase(it);
+            }
+        }
+    }
+    if (in.ok() && !forward.empty())
+        in.fail("value " + std::to_string(forward.begin()->first) + " is used but never defined");
+    if (in.ok() && !in.at_end())
+        in.fail("bytes past the last instruction");
+
+    if (!in.ok())
+    {
+        discard_body(func);
+        return fail(err_msg, "binary IR: `" + func->name() + "`: " + in.error());
+    }
+    return true;
+}
@@ -0,0 +1,108 @@
+// ir_binary.h - Binary IR modules with lazily loaded function bodies
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "ir.h"
+
+//===----------------------------------------------------------------------===//
+//                             Binary IR
+//===----------------------------------------------------------------------===//
+//
+// A module on disk is, after the magic and version:
+//
+//   strings     every name, referred to by index; index 0 is ""
+//   types       structs first, as shells, then every other type after
+//               the types it is made of
+//   bodies      struct members, each struct after those it holds by value
+//   functions   name, signature, argument names, flags, body size
+//   values      constants and globals, each after what it refers to
+//   code        the bodies of the functions, one after the other
+//
+// All numbers are unsigned LEB128. Module-level values are numbered with
+// the functions first, then the value table. In a body the arguments come
+// first and every instruction takes the next number, in block order. An
+// operand that refers to an earlier value stores how far back it is, one
+// defined later (phis, blocks out of dominance order) how far ahead plus
+// its type, so the reader can stand in for it until it is defined.
+//
+// Only the declarations are built when a module is read. A body is decoded
+// the first time it is asked for, straight from the bytes of the file, so
+// loading a large module costs little more than its symbol table. A
+// function whose body isn't loaded yet looks like a declaration.
+//
+// Block profile counts, branch weights and tail call marks are kept.
+// Qualified types are written as their base type.
+//
+// A function entry is the same layout with one body, for linking into a
+// module that already declares what the body refers to. Its functions,
+// named structs and most globals are only looked up there, by name, and
+// must have the same types; anonymous structs are found by their members.
+// The globals the caller says belong to the function, such as its string
+// literals, are written whole and created anew.
+
+constexpr uint32_t IR_BINARY_MAGIC = 0x52494F4D; // "MOIR"
+constexpr uint16_t IR_BINARY_VERSION = 1;
+
+std::vector<uint8_t> serialize_module(const Module &module);
+bool write_module_file(const Module &module, const std::string &path, std::string *err_msg = nullptr);
+std::vector<uint8_t> serialize_function(const Function &func, std::span<GlobalVariable *const> owned_globals = {});
+
+class ModuleReader
+{
+public:
+    // Reads everything but the function bodies. The tables are checked
+    // against `bytes` up front; a body is checked when it is loaded
+    static std::unique_ptr<ModuleReader> parse(std::vector<uint8_t> bytes, std::string *err_msg = nullptr);
+    static std::unique_ptr<ModuleReader> read_file(const std::string &path, std::string *err_msg = nullptr);
+
+    // Reads the module and every body at once
+    static std::unique_ptr<Module> load_module(std::vector<uint8_t> bytes, std::string *err_msg = nullptr);
+
+    // Builds the body of a function entry into its declaration in `dest`,
+    // which must not have a body yet. Returns that function, or nullptr if
+    // the entry doesn't fit `dest`; the globals it brought may stay behind
+    static Function *link_function(std::vector<uint8_t> bytes, Module &dest, std::string *err_msg = nullptr);
+
+    ~ModuleReader();
+
+    Module &module() { return *module_; }
+
+    bool is_materialized(const Function *func) const;
+    // Builds the body of `func` if it isn't there yet. On failure the
+    // function is left without blocks
+    bool materialize(Function *func, std::string *err_msg = nullptr);
+    bool materialize_all(std::string *err_msg = nullptr);
+    // The function called `name` with its body loaded, nullptr if there is
+    // none or its body is broken
+    Function *get_function(const std::string &name, std::string *err_msg = nullptr);
+
+    // Hands the module over; bodies not loaded by then stay declarations
+    std::unique_ptr<Module> release_module() { return std::move(owned_); }
+
+private:
+    struct LazyBody
+    {
+        std::span<const uint8_t> code;
+        bool materialized = false;
+    };
+
+    ModuleReader() = default;
+    bool read_tables(std::string *err_msg);
+    bool decode_body(Function *func, std::span<const uint8_t> code, std::string *err_msg);
+
+    std::vector<uint8_t> bytes_;
+    std::unique_ptr<Module> owned_;
+    Module *module_ = nullptr; // owned_, or the module linked into
+    bool linking_ = false;
+    std::vector<std::string_view> strings_; // point into bytes_
+    std::vector<Type *> types_;
+    std::vector<Value *> values_; // functions, then the value table
+    std::unordered_map<const Function *, LazyBody> bodies_;
+};
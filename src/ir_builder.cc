@@ -1,6 +1,8 @@
 #include "ir_builder.h"
 #include "mo_debug.h"
 
+#include <bit>
+
 IRBuilder::IRBuilder(Module *module)
     : module_(module), insert_block_(nullptr), insert_pos_(nullptr)
 {
@@ -24,30 +26,37 @@ void IRBuilder::clear_insert_point()
     insert_pos_ = nullptr;
 }
 
-UnaryInst *IRBuilder::create_unary(Opcode opc, Value *operand, const std::string &name)
+Value *IRBuilder::create_unary(Opcode opc, Value *operand, const std::string &name)
 {
+    if (folding_ && module_)
+    {
+        if (Constant *folded = ConstantFolder(module_).fold_unary(opc, operand))
+        {
+            return folded;
+        }
+    }
     auto *inst = UnaryInst::create(opc, operand, insert_block_, name);
     insert(inst);
     return inst;
 }
 
-UnaryInst *IRBuilder::create_neg(Value *val, const std::string &name)
+Value *IRBuilder::create_neg(Value *val, const std::string &name)
 {
     return create_unary(Opcode::Neg, val, name);
 }
 
-UnaryInst *IRBuilder::create_fneg(Value *val, const std::string &name)
+Value *IRBuilder::create_fneg(Value *val, const std::string &name)
 {
     return create_unary(Opcode::FNeg, val, name);
 }
 
-UnaryInst *IRBuilder::create_not(Value *val, const std::string &name)
+Value *IRBuilder::create_not(Value *val, const std::string &name)
 {
     return create_unary(Opcode::Not, val, name);
 }
 
-BinaryInst *IRBuilder::create_binary(Opcode opc, Value *lhs, Value *rhs,
-                                     const std::string &name)
+Value *IRBuilder::create_binary(Opcode opc, Value *lhs, Value *rhs,
+                                const std::string &name)
 {
     // Enhanced type checking
     MO_DEBUG("Creating binary instruction: %d %s %s", int(opc),
@@ -58,86 +67,94 @@ BinaryInst *IRBuilder::create_binary(Opcode opc, Value *lhs, Value *rhs,
             lhs->type()->type_id() == Type::FpTy) &&
            "Binary operation requires integer or float operands");
 
+    if (folding_ && module_)
+    {
+        if (Value *simplified = simplify_binary(opc, lhs, rhs, name))
+        {
+            return simplified;
+        }
+    }
+
     auto *inst = BinaryInst::create(opc, lhs, rhs, insert_block_, name);
     insert(inst);
     return inst;
 }
 
-BinaryInst *IRBuilder::create_add(Value *lhs, Value *rhs,
-                                  const std::string &name)
+Value *IRBuilder::create_add(Value *lhs, Value *rhs,
+                             const std::string &name)
 {
     return create_binary(Opcode::Add, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_sub(Value *lhs, Value *rhs,
-                                  const std::string &name)
+Value *IRBuilder::create_sub(Value *lhs, Value *rhs,
+                             const std::string &name)
 {
     return create_binary(Opcode::Sub, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_mul(Value *lhs, Value *rhs,
-                                  const std::string &name)
+Value *IRBuilder::create_mul(Value *lhs, Value *rhs,
+                             const std::string &name)
 {
     return create_binary(Opcode::Mul, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_udiv(Value *lhs, Value *rhs,
-                                   const std::string &name)
+Value *IRBuilder::create_udiv(Value *lhs, Value *rhs,
+                              const std::string &name)
 {
     return create_binary(Opcode::UDiv, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_sdiv(Value *lhs, Value *rhs,
-                                   const std::string &name)
+Value *IRBuilder::create_sdiv(Value *lhs, Value *rhs,
+                              const std::string &name)
 {
     return create_binary(Opcode::SDiv, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_bitand(Value *lhs, Value *rhs,
-                                     const std::string &name)
+Value *IRBuilder::create_bitand(Value *lhs, Value *rhs,
+                                const std::string &name)
 {
     return create_binary(Opcode::BitAnd, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_bitor(Value *lhs, Value *rhs,
-                                    const std::string &name)
+Value *IRBuilder::create_bitor(Value *lhs, Value *rhs,
+                               const std::string &name)
 {
     return create_binary(Opcode::BitOr, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_bitxor(Value *lhs, Value *rhs,
-                                     const std::string &name)
+Value *IRBuilder::create_bitxor(Value *lhs, Value *rhs,
+                                const std::string &name)
 {
     return create_binary(Opcode::BitXor, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_srem(Value *lhs, Value *rhs, const std::string &name)
+Value *IRBuilder::create_srem(Value *lhs, Value *rhs, const std::string &name)
 {
     return create_binary(Opcode::SRem, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_urem(Value *lhs, Value *rhs, const std::string &name)
+Value *IRBuilder::create_urem(Value *lhs, Value *rhs, const std::string &name)
 {
     return create_binary(Opcode::URem, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_shl(Value *lhs, Value *rhs, const std::string &name)
+Value *IRBuilder::create_shl(Value *lhs, Value *rhs, const std::string &name)
 {
     return create_binary(Opcode::Shl, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_ashr(Value *lhs, Value *rhs, const std::string &name)
+Value *IRBuilder::create_ashr(Value *lhs, Value *rhs, const std::string &name)
 {
     return create_binary(Opcode::AShr, lhs, rhs, name);
 }
 
-BinaryInst *IRBuilder::create_lshr(Value *lhs, Value *rhs, const std::string &name)
+Value *IRBuilder::create_lshr(Value *lhs, Value *rhs, const std::string &name)
 {
     return create_binary(Opcode::LShr, lhs, rhs, name);
 }
 
-ICmpInst *IRBuilder::create_icmp(ICmpInst::Predicate pred, Value *lhs,
-                                 Value *rhs, const std::string &name)
+Value *IRBuilder::create_icmp(ICmpInst::Predicate pred, Value *lhs,
+                              Value *rhs, const std::string &name)
 {
     // Ensure integer types
     assert(lhs->type()->type_id() == Type::IntTy &&
@@ -146,14 +163,22 @@ ICmpInst *IRBuilder::create_icmp(ICmpInst::Predicate pred, Value *lhs,
     MO_ASSERT(*lhs->type() == *rhs->type(), "Operand type mismatch: %s vs %s",
               lhs->type()->to_string().c_str(), rhs->type()->to_string().c_str());
 
+    if (folding_ && module_)
+    {
+        if (Constant *folded = ConstantFolder(module_).fold_icmp(pred, lhs, rhs))
+        {
+            return folded;
+        }
+    }
+
     auto *inst = ICmpInst::create(pred, lhs, rhs, insert_block_);
     inst->set_name(name);
     insert(inst);
     return inst;
 }
 
-FCmpInst *IRBuilder::create_fcmp(FCmpInst::Predicate pred, Value *lhs,
-                                 Value *rhs, const std::string &name)
+Value *IRBuilder::create_fcmp(FCmpInst::Predicate pred, Value *lhs,
+                              Value *rhs, const std::string &name)
 {
     // Ensure floating-point types
     assert(lhs->type()->type_id() == Type::FpTy &&
@@ -161,6 +186,14 @@ FCmpInst *IRBuilder::create_fcmp(FCmpInst::Predicate pred, Value *lhs,
            "FCmp requires float operands");
     assert(*lhs->type() == *rhs->type() && "Operand type mismatch");
 
+    if (folding_ && module_)
+    {
+        if (Constant *folded = ConstantFolder(module_).fold_fcmp(pred, lhs, rhs))
+        {
+            return folded;
+        }
+    }
+
     auto *inst = FCmpInst::create(pred, lhs, rhs, insert_block_, name);
     insert(inst);
     return inst;
@@ -423,6 +456,93 @@ StructType *IRBuilder::get_struct_type_anonymous(const std::vector<MemberInfo> &
     return module_->get_struct_type_anonymous(members);
 }
 
+Value *IRBuilder::fold_cast(Opcode opc, Value *val, Type *target_type) const
+{
+    return folding_ && module_ ? ConstantFolder(module_).fold_cast(opc, val, target_type) : nullptr;
+}
+
+Value *IRBuilder::simplify_binary(Opcode opc, Value *lhs, Value *rhs, const std::string &name)
+{
+    if (Constant *folded = ConstantFolder(module_).fold_binary(opc, lhs, rhs))
+    {
+        return folded;
+    }
+
+    // The identities below hold for integers only; x + 0.0 is not x for x = -0.0
+    auto *type = dynamic_cast<IntegerType *>(lhs->type());
+    if (!type)
+    {
+        return nullptr;
+    }
+
+    // Canonicalize a constant operand of a commutative operation to the right
+    const bool commutative = opc == Opcode::Add || opc == Opcode::Mul || opc == Opcode::BitAnd ||
+                             opc == Opcode::BitOr || opc == Opcode::BitXor;
+    if (commutative && dynamic_cast<ConstantInt *>(lhs))
+    {
+        std::swap(lhs, rhs);
+    }
+
+    if (lhs == rhs && (opc == Opcode::Sub || opc == Opcode::BitXor))
+    {
+        return module_->get_constant_int(type, 0);
+    }
+
+    auto *c = dynamic_cast<ConstantInt *>(rhs);
+    if (!c)
+    {
+        return nullptr;
+    }
+    const uint64_t value = truncate_value(c->value(), type->bit_width(), true);
+    const uint64_t all_ones = truncate_value(~uint64_t(0), type->bit_width(), true);
+    const bool is_power_of_two = std::has_single_bit(value);
+    auto log2 = [&]
+    { return module_->get_constant_int(type, std::countr_zero(value)); };
+
+    switch (opc)
+    {
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::BitOr:
+    case Opcode::BitXor:
+    case Opcode::Shl:
+    case Opcode::LShr:
+    case Opcode::AShr:
+        return value == 0 ? lhs : nullptr;
+    case Opcode::Mul:
+        if (value == 0)
+            return rhs;
+        if (value == 1)
+            return lhs;
+        if (is_power_of_two)
+            return create_shl(lhs, log2(), name);
+        return nullptr;
+    case Opcode::UDiv:
+        if (value == 1)
+            return lhs;
+        if (is_power_of_two)
+            return create_lshr(lhs, log2(), name);
+        return nullptr;
+    case Opcode::SDiv:
+        // Shifting would round negative dividends the wrong way
+        return value == 1 ? lhs : nullptr;
+    case Opcode::URem:
+        if (value == 1)
+            return module_->get_constant_int(type, 0);
+        if (is_power_of_two)
+            return create_bitand(lhs, module_->get_constant_int(type, value - 1), name);
+        return nullptr;
+    case Opcode::BitAnd:
+        if (value == 0)
+            return rhs;
+        if (value == all_ones)
+            return lhs;
+        return nullptr;
+    default:
+        return nullptr;
+    }
+}
+
 void IRBuilder::insert(Instruction *inst)
 {
     if (insert_pos_)
@@ -532,11 +652,15 @@ bool is_legal_bitcast(Type *src, Type *dst)
 }
 
 // BitCast Instruction
-BitCastInst *IRBuilder::create_bitcast(Value *val, Type *target_type,
-                                       const std::string &name)
+Value *IRBuilder::create_bitcast(Value *val, Type *target_type,
+                                 const std::string &name)
 {
     assert(is_legal_bitcast(val->type(), target_type) &&
            "Bitcast types must have same size");
+    if (Value *folded = fold_cast(Opcode::BitCast, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = BitCastInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
@@ -553,56 +677,72 @@ PtrToIntInst *IRBuilder::create_ptrtoint(Value *ptr, Type *target_type,
 }
 
 // Sign Extension Instruction
-SExtInst *IRBuilder::create_sext(Value *val, Type *target_type,
-                                 const std::string &name)
+Value *IRBuilder::create_sext(Value *val, Type *target_type,
+                              const std::string &name)
 {
     assert(val->type()->type_id() == Type::IntTy && "SExt source must be integer");
     assert(target_type->type_id() == Type::IntTy &&
            "SExt target must be integer");
     assert(target_type->size() > val->type()->size() &&
            "SExt must expand to larger type");
+    if (Value *folded = fold_cast(Opcode::SExt, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = SExtInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
 }
 
 // Zero Extension Instruction
-ZExtInst *IRBuilder::create_zext(Value *val, Type *target_type,
-                                 const std::string &name)
+Value *IRBuilder::create_zext(Value *val, Type *target_type,
+                              const std::string &name)
 {
     assert(val->type()->type_id() == Type::IntTy && "ZExt source must be integer");
     assert(target_type->type_id() == Type::IntTy &&
            "ZExt target must be integer");
     assert(target_type->size() > val->type()->size() &&
            "ZExt must expand to larger type");
+    if (Value *folded = fold_cast(Opcode::ZExt, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = ZExtInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
 }
 
 // Floating-point Extension Instruction
-FPExtInst *IRBuilder::create_fpext(Value *val, Type *target_type,
-                                   const std::string &name)
+Value *IRBuilder::create_fpext(Value *val, Type *target_type,
+                               const std::string &name)
 {
     assert(val->type()->type_id() == Type::FpTy && "FPExt source must be float");
     assert(target_type->type_id() == Type::FpTy &&
            "FPExt target must be float");
     assert(target_type->size() > val->type()->size() &&
            "FPExt must expand to larger floating-point type");
+    if (Value *folded = fold_cast(Opcode::FPExt, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = FPExtInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
 }
 
 // Floating-point Truncation Instruction
-FPTruncInst *IRBuilder::create_fptrunc(Value *val, Type *target_type,
-                                       const std::string &name)
+Value *IRBuilder::create_fptrunc(Value *val, Type *target_type,
+                                 const std::string &name)
 {
     assert(val->type()->type_id() == Type::FpTy && "FPTrunc source must be float");
     assert(target_type->type_id() == Type::FpTy &&
            "FPTrunc target must be float");
     assert(target_type->size() < val->type()->size() &&
            "FPTrunc must reduce to smaller floating-point type");
+    if (Value *folded = fold_cast(Opcode::FPTrunc, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = FPTruncInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
@@ -620,57 +760,73 @@ IntToPtrInst *IRBuilder::create_inttoptr(Value *val, Type *target_type,
     return inst;
 }
 
-FPToSIInst *IRBuilder::create_fptosi(Value *val, Type *target_type,
-                                     const std::string &name)
+Value *IRBuilder::create_fptosi(Value *val, Type *target_type,
+                                const std::string &name)
 {
     assert(val->type()->type_id() == Type::FpTy &&
            "FPToSI source must be float");
     assert(target_type->type_id() == Type::IntTy &&
            "FPToSI target must be integer");
+    if (Value *folded = fold_cast(Opcode::FPToSI, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = FPToSIInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
 }
 
-FPToUIInst *IRBuilder::create_fptoui(Value *val, Type *target_type,
-                                     const std::string &name)
+Value *IRBuilder::create_fptoui(Value *val, Type *target_type,
+                                const std::string &name)
 {
     assert(val->type()->type_id() == Type::FpTy &&
            "FPToUI source must be float");
     assert(target_type->type_id() == Type::IntTy &&
            "FPToUI target must be integer");
+    if (Value *folded = fold_cast(Opcode::FPToUI, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = FPToUIInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
 }
 
-SIToFPInst *IRBuilder::create_sitofp(Value *val, Type *target_type,
-                                     const std::string &name)
+Value *IRBuilder::create_sitofp(Value *val, Type *target_type,
+                                const std::string &name)
 {
     assert(val->type()->type_id() == Type::IntTy &&
            "SIToFP source must be integer");
     assert(target_type->type_id() == Type::FpTy &&
            "SIToFP target must be float");
+    if (Value *folded = fold_cast(Opcode::SIToFP, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = SIToFPInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
 }
 
-UIToFPInst *IRBuilder::create_uitofp(Value *val, Type *target_type,
-                                     const std::string &name)
+Value *IRBuilder::create_uitofp(Value *val, Type *target_type,
+                                const std::string &name)
 {
     assert(val->type()->type_id() == Type::IntTy &&
            "UIToFP source must be integer");
     assert(target_type->type_id() == Type::FpTy &&
            "UIToFP target must be float");
+    if (Value *folded = fold_cast(Opcode::UIToFP, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = UIToFPInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
 }
 
 // Truncate Instruction
-TruncInst *IRBuilder::create_trunc(Value *val, Type *target_type,
-                                   const std::string &name)
+Value *IRBuilder::create_trunc(Value *val, Type *target_type,
+                               const std::string &name)
 {
     assert(val->type()->type_id() == Type::IntTy &&
            "Trunc source must be integer");
@@ -678,6 +834,10 @@ TruncInst *IRBuilder::create_trunc(Value *val, Type *target_type,
            "Trunc target must be integer");
     assert(target_type->size() < val->type()->size() &&
            "Trunc must reduce to smaller type");
+    if (Value *folded = fold_cast(Opcode::Trunc, val, target_type))
+    {
+        return folded;
+    }
     auto *inst = TruncInst::create(val, target_type, insert_block_, name);
     insert(inst);
     return inst;
@@ -693,7 +853,7 @@ Value *IRBuilder::create_cast(Value *src_val, Type *target_type,
     if (*src_type == *target_type)
         return src_val;
 
-    Instruction *inst = nullptr;
+    Value *inst = nullptr;
     // Try to dynamically cast the source and target types to integer and float types.
     const auto src_int = dynamic_cast<IntegerType *>(src_type);
     const auto tgt_int = dynamic_cast<IntegerType *>(target_type);
@@ -721,8 +881,6 @@ Value *IRBuilder::create_cast(Value *src_val, Type *target_type,
         }
         if (inst)
         {
-            // Insert the instruction into the current basic block.
-            insert(inst);
             // Return the created instruction.
             return inst;
         }
@@ -739,7 +897,7 @@ Value *IRBuilder::create_cast(Value *src_val, Type *target_type,
         {
             // If the source bit width is less than the target bit width, perform either sign extension or zero extension.
             // The decision depends on whether the source integer type is signed or unsigned.
-            inst = src_int->is_unsigned() ? static_cast<Instruction *>(create_zext(src_val, target_type, name)) : static_cast<Instruction *>(create_sext(src_val, target_type, name));
+            inst = src_int->is_unsigned() ? create_zext(src_val, target_type, name) : create_sext(src_val, target_type, name);
         }
         else if (src_bit_width > tgt_bit_width)
         {
@@ -763,13 +921,13 @@ Value *IRBuilder::create_cast(Value *src_val, Type *target_type,
         }
         // Perform either floating-point to signed integer conversion or floating-point to unsigned integer conversion.
         // The decision depends on whether the target integer type is signed or unsigned.
-        inst = tgt_int->is_unsigned() ? static_cast<Instruction *>(create_fptoui(src_val, target_type, name)) : static_cast<Instruction *>(create_fptosi(src_val, target_type, name));
+        inst = tgt_int->is_unsigned() ? create_fptoui(src_val, target_type, name) : create_fptosi(src_val, target_type, name);
     }
     else if (src_int && tgt_fp)
     {
         // Perform either signed integer to floating-point conversion or unsigned integer to floating-point conversion.
         // The decision depends on whether the source integer type is signed or unsigned.
-        inst = src_int->is_unsigned() ? static_cast<Instruction *>(create_uitofp(src_val, target_type, name)) : static_cast<Instruction *>(create_sitofp(src_val, target_type, name));
+        inst = src_int->is_unsigned() ? create_uitofp(src_val, target_type, name) : create_sitofp(src_val, target_type, name);
     }
 
     /*-------------------- Floating-point bit_width adjustment --------------------*/
@@ -815,8 +973,6 @@ Value *IRBuilder::create_cast(Value *src_val, Type *target_type,
 
     // Assert that the instruction was created.  If not, the cast is unsupported.
     assert(inst && ("Unsupported cast: " + src_type->name() + " -> " + target_type->name()).c_str());
-    // Insert the instruction into the current basic block.
-    insert(inst);
-    // Return the created instruction.
+    // The creators above already inserted the instruction into the current basic block.
     return inst;
 }
@@ -2,6 +2,7 @@
 
 #pragma once
 #include "ir.h"
+#include "ir_folder.h"
 
 //===----------------------------------------------------------------------===//
 //                            IRBuilder Framework
@@ -19,6 +20,17 @@ public:
     void clear_insert_point();
     BasicBlock *get_insert_block() const { return insert_block_; }
 
+    //===--------------------------------------------------------------------===//
+    //                               Folding
+    //===--------------------------------------------------------------------===//
+
+    // When enabled, arithmetic, comparisons and conversions on constants are
+    // folded, and identities such as x + 0, x * 1 or x * 2^k are simplified
+    // (the last into a shift). Those creators then may return a constant or an
+    // existing value instead of a new instruction. Off by default.
+    void set_folding(bool enabled) { folding_ = enabled; }
+    bool folding() const { return folding_; }
+
     //===--------------------------------------------------------------------===//
     //                               Constants
     //===--------------------------------------------------------------------===//
@@ -32,31 +44,31 @@ public:
     //===--------------------------------------------------------------------===//
 
     //--- Arithmetic Instructions ---//
-    BinaryInst *create_binary(Opcode opc, Value *lhs, Value *rhs,
+    Value *create_binary(Opcode opc, Value *lhs, Value *rhs,
                               const std::string &name = "");
-    BinaryInst *create_add(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_sub(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_mul(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_udiv(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_sdiv(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_bitand(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_bitor(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_bitxor(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_srem(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_urem(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_shl(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_ashr(Value *lhs, Value *rhs, const std::string &name = "");
-    BinaryInst *create_lshr(Value *lhs, Value *rhs, const std::string &name = "");
-
-    UnaryInst *create_unary(Opcode opc, Value *val, const std::string &name = "");
-    UnaryInst *create_fneg(Value *val, const std::string &name = "");
-    UnaryInst *create_not(Value *val, const std::string &name = "");
-    UnaryInst *create_neg(Value *val, const std::string &name = "");
+    Value *create_add(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_sub(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_mul(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_udiv(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_sdiv(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_bitand(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_bitor(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_bitxor(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_srem(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_urem(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_shl(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_ashr(Value *lhs, Value *rhs, const std::string &name = "");
+    Value *create_lshr(Value *lhs, Value *rhs, const std::string &name = "");
+
+    Value *create_unary(Opcode opc, Value *val, const std::string &name = "");
+    Value *create_fneg(Value *val, const std::string &name = "");
+    Value *create_not(Value *val, const std::string &name = "");
+    Value *create_neg(Value *val, const std::string &name = "");
 
     //--- Comparison Instructions ---//
-    ICmpInst *create_icmp(ICmpInst::Predicate pred, Value *lhs, Value *rhs,
+    Value *create_icmp(ICmpInst::Predicate pred, Value *lhs, Value *rhs,
                           const std::string &name = "");
-    FCmpInst *create_fcmp(FCmpInst::Predicate pred, Value *lhs, Value *rhs,
+    Value *create_fcmp(FCmpInst::Predicate pred, Value *lhs, Value *rhs,
                           const std::string &name = "");
 
     //--- Control Flow Instructions ---//
@@ -91,28 +103,28 @@ public:
                                    const std::string &name);
 
     // --- Cast Instructions --- //
-    BitCastInst *create_bitcast(Value *val, Type *target_type,
+    Value *create_bitcast(Value *val, Type *target_type,
                                 const std::string &name);
     PtrToIntInst *create_ptrtoint(Value *ptr, Type *target_type,
                                   const std::string &name);
     IntToPtrInst *create_inttoptr(Value *val, Type *target_type,
                                   const std::string &name);
-    SExtInst *create_sext(Value *val, Type *target_type, const std::string &name);
-    ZExtInst *create_zext(Value *val, Type *target_type,
+    Value *create_sext(Value *val, Type *target_type, const std::string &name);
+    Value *create_zext(Value *val, Type *target_type,
                           const std::string &name);
-    FPExtInst *create_fpext(Value *val, Type *target_type,
+    Value *create_fpext(Value *val, Type *target_type,
                             const std::string &name);
-    FPTruncInst *create_fptrunc(Value *val, Type *target_type,
+    Value *create_fptrunc(Value *val, Type *target_type,
                                 const std::string &name);
-    TruncInst *create_trunc(Value *val, Type *target_type,
+    Value *create_trunc(Value *val, Type *target_type,
                             const std::string &name);
-    FPToSIInst *create_fptosi(Value *val, Type *target_type,
+    Value *create_fptosi(Value *val, Type *target_type,
                               const std::string &name);
-    FPToUIInst *create_fptoui(Value *val, Type *target_type,
+    Value *create_fptoui(Value *val, Type *target_type,
                               const std::string &name);
-    SIToFPInst *create_sitofp(Value *val, Type *target_type,
+    Value *create_sitofp(Value *val, Type *target_type,
                               const std::string &name);
-    UIToFPInst *create_uitofp(Value *val, Type *target_type,
+    Value *create_uitofp(Value *val, Type *target_type,
                               const std::string &name);
     Value *create_cast(Value *src_val, Type *target_type,
                        const std::string &name,
@@ -127,8 +139,12 @@ public:
 
 private:
     void insert(Instruction *inst);
+    // Result of opc on lhs and rhs without a new instruction, or nullptr
+    Value *simplify_binary(Opcode opc, Value *lhs, Value *rhs, const std::string &name);
+    Value *fold_cast(Opcode opc, Value *val, Type *target_type) const;
 
     Module *module_;
     BasicBlock *insert_block_;
     Instruction *insert_pos_;
+    bool folding_ = false;
 };
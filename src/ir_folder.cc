@@ -0,0 +1,329 @@
+#include "ir_folder.h"
+#include <cmath>
+#include <limits>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // Operand value zero-extended from its width
+    uint64_t as_unsigned(const ConstantInt *c)
+    {
+        return truncate_value(c->value(), c->type()->bit_width(), true);
+    }
+
+    // Operand value sign-extended from its width
+    int64_t as_signed(const ConstantInt *c)
+    {
+        return static_cast<int64_t>(truncate_value(c->value(), c->type()->bit_width(), false));
+    }
+
+    // Whether `value` converts to an integer of `bit_width` bits without
+    // leaving its range, which the conversion instructions leave undefined
+    bool fits_integer(double value, uint8_t bit_width, bool is_unsigned)
+    {
+        if (!std::isfinite(value))
+        {
+            return false;
+        }
+        const double truncated = std::trunc(value);
+        if (is_unsigned)
+        {
+            return truncated >= 0 && truncated < std::ldexp(1.0, bit_width);
+        }
+        const double limit = std::ldexp(1.0, bit_width - 1);
+        return truncated >= -limit && truncated < limit;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             ConstantFolder Implementation
+//===----------------------------------------------------------------------===//
+
+Constant *ConstantFolder::get_fp(Type *type, double value) const
+{
+    // f32 constants hold the value rounded to single precision
+    if (type->bit_width() == 32)
+    {
+        value = static_cast<float>(value);
+    }
+    return module_->get_constant_fp(static_cast<FloatType *>(type), value);
+}
+
+Constant *ConstantFolder::fold_binary(Opcode opc, Value *lhs, Value *rhs) const
+{
+    if (auto *l = dynamic_cast<ConstantInt *>(lhs))
+    {
+        auto *r = dynamic_cast<ConstantInt *>(rhs);
+        if (!r)
+        {
+            return nullptr;
+        }
+        auto *type = static_cast<IntegerType *>(l->type());
+        const uint8_t bits = type->bit_width();
+        const uint64_t a = l->value(), b = r->value();
+        const int64_t min_signed = bits == 64 ? std::numeric_limits<int64_t>::min() : -(int64_t(1) << (bits - 1));
+
+        uint64_t result;
+        switch (opc)
+        {
+        case Opcode::Add:
+            result = a + b;
+            break;
+        case Opcode::Sub:
+            result = a - b;
+            break;
+        case Opcode::Mul:
+            result = a * b;
+            break;
+        case Opcode::UDiv:
+        case Opcode::URem:
+            if (as_unsigned(r) == 0)
+            {
+                return nullptr;
+            }
+            result = opc == Opcode::UDiv ? as_unsigned(l) / as_unsigned(r) : as_unsigned(l) % as_unsigned(r);
+            break;
+        case Opcode::SDiv:
+        case Opcode::SRem:
+            if (as_signed(r) == 0 || (as_signed(l) == min_signed && as_signed(r) == -1))
+            {
+                return nullptr;
+            }
+            result = static_cast<uint64_t>(opc == Opcode::SDiv ? as_signed(l) / as_signed(r) : as_signed(l) % as_signed(r));
+            break;
+        case Opcode::BitAnd:
+            result = a & b;
+            break;
+        case Opcode::BitOr:
+            result = a | b;
+            break;
+        case Opcode::BitXor:
+            result = a ^ b;
+            break;
+        case Opcode::Shl:
+        case Opcode::LShr:
+        case Opcode::AShr:
+            if (as_unsigned(r) >= bits)
+            {
+                return nullptr;
+            }
+            if (opc == Opcode::Shl)
+                result = a << as_unsigned(r);
+            else if (opc == Opcode::LShr)
+                result = as_unsigned(l) >> as_unsigned(r);
+            else
+                result = static_cast<uint64_t>(as_signed(l) >> as_unsigned(r));
+            break;
+        default:
+            return nullptr;
+        }
+        return module_->get_constant_int(type, result);
+    }
+
+    if (auto *l = dynamic_cast<ConstantFP *>(lhs))
+    {
+        auto *r = dynamic_cast<ConstantFP *>(rhs);
+        if (!r)
+        {
+            return nullptr;
+        }
+        switch (opc)
+        {
+        case Opcode::Add:
+            return get_fp(l->type(), l->value() + r->value());
+        case Opcode::Sub:
+            return get_fp(l->type(), l->value() - r->value());
+        case Opcode::Mul:
+            return get_fp(l->type(), l->value() * r->value());
+        case Opcode::SDiv:
+        case Opcode::UDiv:
+            return get_fp(l->type(), l->value() / r->value());
+        default:
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+Constant *ConstantFolder::fold_unary(Opcode opc, Value *operand) const
+{
+    if (auto *c = dynamic_cast<ConstantInt *>(operand))
+    {
+        auto *type = static_cast<IntegerType *>(c->type());
+        switch (opc)
+        {
+        case Opcode::Neg:
+            return module_->get_constant_int(type, 0 - c->value());
+        case Opcode::Not:
+            if (type->bit_width() == 1)
+            {
+                return module_->get_constant_bool(c->value() == 0);
+            }
+            return nullptr;
+        case Opcode::BitNot:
+            return module_->get_constant_int(type, ~c->value());
+        default:
+            return nullptr;
+        }
+    }
+    if (auto *c = dynamic_cast<ConstantFP *>(operand); c && opc == Opcode::FNeg)
+    {
+        return get_fp(c->type(), -c->value());
+    }
+    return nullptr;
+}
+
+Constant *ConstantFolder::fold_icmp(ICmpInst::Predicate pred, Value *lhs, Value *rhs) const
+{
+    auto *l = dynamic_cast<ConstantInt *>(lhs);
+    auto *r = dynamic_cast<ConstantInt *>(rhs);
+    if (!l || !r)
+    {
+        return nullptr;
+    }
+    const uint64_t ua = as_unsigned(l), ub = as_unsigned(r);
+    const int64_t sa = as_signed(l), sb = as_signed(r);
+
+    bool result;
+    switch (pred)
+    {
+    case ICmpInst::EQ:
+        result = ua == ub;
+        break;
+    case ICmpInst::NE:
+        result = ua != ub;
+        break;
+    case ICmpInst::SLT:
+        result = sa < sb;
+        break;
+    case ICmpInst::SLE:
+        result = sa <= sb;
+        break;
+    case ICmpInst::SGT:
+        result = sa > sb;
+        break;
+    case ICmpInst::SGE:
+        result = sa >= sb;
+        break;
+    case ICmpInst::ULT:
+        result = ua < ub;
+        break;
+    case ICmpInst::ULE:
+        result = ua <= ub;
+        break;
+    case ICmpInst::UGT:
+        result = ua > ub;
+        break;
+    case ICmpInst::UGE:
+        result = ua >= ub;
+        break;
+    default:
+        return nullptr;
+    }
+    return module_->get_constant_bool(result);
+}
+
+Constant *ConstantFolder::fold_fcmp(FCmpInst::Predicate pred, Value *lhs, Value *rhs) const
+{
+    auto *l = dynamic_cast<ConstantFP *>(lhs);
+    auto *r = dynamic_cast<ConstantFP *>(rhs);
+    if (!l || !r)
+    {
+        return nullptr;
+    }
+    const double a = l->value(), b = r->value();
+
+    // Comparisons with NaN are false, except plain NE which is true (as in C)
+    bool result;
+    switch (pred)
+    {
+    case FCmpInst::EQ:
+    case FCmpInst::OEQ:
+        result = a == b;
+        break;
+    case FCmpInst::NE:
+        result = a != b;
+        break;
+    case FCmpInst::ONE:
+        result = a < b || a > b;
+        break;
+    case FCmpInst::LT:
+    case FCmpInst::OLT:
+        result = a < b;
+        break;
+    case FCmpInst::LE:
+    case FCmpInst::OLE:
+        result = a <= b;
+        break;
+    case FCmpInst::GT:
+    case FCmpInst::OGT:
+        result = a > b;
+        break;
+    case FCmpInst::GE:
+    case FCmpInst::OGE:
+        result = a >= b;
+        break;
+    default:
+        return nullptr;
+    }
+    return module_->get_constant_bool(result);
+}
+
+Constant *ConstantFolder::fold_cast(Opcode opc, Value *val, Type *target_type) const
+{
+    auto *target_int = dynamic_cast<IntegerType *>(target_type);
+
+    if (auto *c = dynamic_cast<ConstantInt *>(val))
+    {
+        switch (opc)
+        {
+        case Opcode::ZExt:
+            return module_->get_constant_int(target_int, as_unsigned(c));
+        case Opcode::SExt:
+            return module_->get_constant_int(target_int, static_cast<uint64_t>(as_signed(c)));
+        case Opcode::Trunc:
+            return module_->get_constant_int(target_int, c->value());
+        case Opcode::BitCast:
+            // Only integer reinterpretations of equal width carry a plain value
+            if (target_int && target_int->bit_width() == c->type()->bit_width())
+            {
+                return module_->get_constant_int(target_int, c->value());
+            }
+            return nullptr;
+        case Opcode::SIToFP:
+            return get_fp(target_type, static_cast<double>(as_signed(c)));
+        case Opcode::UIToFP:
+            return get_fp(target_type, static_cast<double>(as_unsigned(c)));
+        default:
+            return nullptr;
+        }
+    }
+
+    if (auto *c = dynamic_cast<ConstantFP *>(val))
+    {
+        switch (opc)
+        {
+        case Opcode::FPExt:
+        case Opcode::FPTrunc:
+            return get_fp(target_type, c->value());
+        case Opcode::FPToSI:
+            if (!target_int || !fits_integer(c->value(), target_int->bit_width(), false))
+            {
+                return nullptr;
+            }
+            return module_->get_constant_int(target_int, static_cast<uint64_t>(static_cast<int64_t>(c->value())));
+        case Opcode::FPToUI:
+            if (!target_int || !fits_integer(c->value(), target_int->bit_width(), true))
+            {
+                return nullptr;
+            }
+            return module_->get_constant_int(target_int, static_cast<uint64_t>(c->value()));
+        default:
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,32 @@
+// ir_folder.h - Constant folding of IR operations
+#pragma once
+
+#include "ir.h"
+
+//===----------------------------------------------------------------------===//
+//                             ConstantFolder
+//===----------------------------------------------------------------------===//
+
+// Evaluates IR operations whose operands are all ConstantInt or ConstantFP,
+// producing uniqued constants of the module. Integer results wrap to the bit
+// width of their type through truncate_value, like the instruction would at
+// run time. Every fold returns nullptr when an operand is not constant or the
+// result is not defined at compile time (division by zero, INT_MIN / -1,
+// out-of-range shifts and float-to-int conversions), and the caller then emits
+// the instruction as usual.
+class ConstantFolder
+{
+public:
+    explicit ConstantFolder(Module *module) : module_(module) {}
+
+    Constant *fold_binary(Opcode opc, Value *lhs, Value *rhs) const;
+    Constant *fold_unary(Opcode opc, Value *operand) const;
+    Constant *fold_icmp(ICmpInst::Predicate pred, Value *lhs, Value *rhs) const;
+    Constant *fold_fcmp(FCmpInst::Predicate pred, Value *lhs, Value *rhs) const;
+    Constant *fold_cast(Opcode opc, Value *val, Type *target_type) const;
+
+private:
+    Constant *get_fp(Type *type, double value) const;
+
+    Module *module_;
+};
@@ -1,56 +1,40 @@
 #include "ir_generator.h"
+#include "ir_binary.h"
+#include "phase_stats.h"
 
 IRGenerator::IRGenerator(Module *module)
     : module_(module), builder_(module)
 {
-    // sym_table_stack_.emplace_back(); // Global scope
-    current_scope_ = new Scope(nullptr);
+    builder_.set_folding(true);
 }
 
 IRGenerator::~IRGenerator()
 {
-    delete current_scope_;
 }
 //===----------------------------------------------------------------------===//
 // Scope Management
 //===----------------------------------------------------------------------===//
 void IRGenerator::push_scope()
 {
-    // sym_table_stack_.emplace_back();
-    current_scope_ = new Scope(current_scope_);
+    scope_.push();
 }
 
 void IRGenerator::pop_scope()
 {
-    // assert(sym_table_stack_.size() > 1 && "Cannot pop global scope");
-    // sym_table_stack_.pop_back();
-    MO_ASSERT(current_scope_->parent() != nullptr, "Cannot pop global scope");
-    auto tmp = current_scope_;
-    current_scope_ = current_scope_->parent();
-    delete tmp;
+    MO_ASSERT(!scope_.is_global(), "Cannot pop global scope");
+    scope_.pop();
 }
 
-Value *IRGenerator::lookup_symbol(const std::string &name)
+Value *IRGenerator::lookup_symbol(const std::string &name, Symbol symbol)
 {
-    // for (auto it = sym_table_stack_.rbegin(); it != sym_table_stack_.rend(); ++it)
-    // {
-    //     if (auto found = it->find(name); found != it->end())
-    //     {
-    //         return found->second;
-    //     }
-    // }
-    // return nullptr;
-    return current_scope_->resolve_variable(name);
+    return scope_.resolve_variable(name, symbol);
 }
 
-void IRGenerator::declare_symbol(const std::string &name, Value *val)
+void IRGenerator::declare_symbol(const std::string &name, Value *val, Symbol symbol)
 {
-    // MO_DEBUG("Declaring symbol '%s' with value addr %p type '%s' (symbol depth %zu)",
-    //          name.c_str(), val, val->type()->name().c_str(), sym_table_stack_.size());
-    // sym_table_stack_.back()[name] = val;
     MO_DEBUG("Declaring symbol '%s' with value addr %p type '%s' (symbol depth %zu)",
-             name.c_str(), val, val->type()->name().c_str(), current_scope_->depth());
-    current_scope_->insert_variable(name, val);
+             name.c_str(), val, val->type()->name().c_str(), scope_.depth());
+    scope_.insert_variable(name, val, symbol);
 }
 
 //===----------------------------------------------------------------------===//
@@ -242,7 +226,7 @@ Type *IRGenerator::convert_type(const ast::Type &ast_type)
     case ast::Type::Kind::Alias:
     {
         auto &alias_type = static_cast<const ast::AliasType &>(ast_type);
-        ir_type = current_scope_->resolve_type(alias_type.name());
+        ir_type = scope_.resolve_type(alias_type.name());
         MO_ASSERT(ir_type != nullptr, "Failed to resolve alias type");
         break;
     }
@@ -502,19 +486,17 @@ Value *IRGenerator::handle_conversion(Value *val, Type *target_type, bool is_exp
         {
             std::cerr << "Warning: implicit conversion from floating to integer\n";
         }
-        CastInst *cast = target_int_type->is_unsigned()
-                             ? static_cast<CastInst *>(builder_.create_fptoui(val, target_type, "fptoui"))
-                             : static_cast<CastInst *>(builder_.create_fptosi(val, target_type, "fptosi"));
-        return cast;
+        return target_int_type->is_unsigned()
+                   ? builder_.create_fptoui(val, target_type, "fptoui")
+                   : builder_.create_fptosi(val, target_type, "fptosi");
     }
 
     if (source_type->is_integer() && target_type->is_float())
     {
         IntegerType *source_int_type = source_type->as_integer();
-        CastInst *cast = source_int_type->is_unsigned()
-                             ? static_cast<CastInst *>(builder_.create_uitofp(val, target_type, "uitofp"))
-                             : static_cast<CastInst *>(builder_.create_sitofp(val, target_type, "sitofp"));
-        return cast;
+        return source_int_type->is_unsigned()
+                   ? builder_.create_uitofp(val, target_type, "uitofp")
+                   : builder_.create_sitofp(val, target_type, "sitofp");
     }
 
     // ---------------------------
@@ -708,7 +690,7 @@ void IRGenerator::handle_var_decl(const ast::VarDeclStmt &decl)
     if (decl.type->kind() == ast::Type::Kind::Tuple)
     {
         AllocaInst *alloca = builder_.create_alloca(ir_type, decl.name);
-        declare_symbol(decl.name, alloca);
+        declare_symbol(decl.name, alloca, decl.symbol);
 
         if (decl.init_expr)
         {
@@ -722,7 +704,7 @@ void IRGenerator::handle_var_decl(const ast::VarDeclStmt &decl)
     }
 
     AllocaInst *alloca = builder_.create_alloca(ir_type, decl.name);
-    declare_symbol(decl.name, alloca);
+    declare_symbol(decl.name, alloca, decl.symbol);
 
     if (decl.init_expr)
     {
@@ -786,7 +768,8 @@ void IRGenerator::handle_if(const ast::IfStmt &if_stmt)
     }
 
     // Determine if merge_bb is needed
-    bool merge_needed = !(then_terminated && (else_bb ? else_terminated : true));
+    // Without an else branch the false edge always lands on the merge block
+    bool merge_needed = !then_terminated || !else_bb || !else_terminated;
     if (merge_needed)
     {
         builder_.set_insert_point(merge_bb);
@@ -955,7 +938,7 @@ Value *IRGenerator::generate_lvalue(const ast::Expr &expr)
     // Handle variable expressions, return the allocated address
     if (const auto *var_expr = dynamic_cast<const ast::VariableExpr *>(&expr))
     {
-        Value *addr = lookup_symbol(var_expr->identifier);
+        Value *addr = lookup_symbol(var_expr->identifier, var_expr->symbol);
         MO_ASSERT(addr != nullptr, "Undefined variable '%s' in lvalue", var_expr->identifier.c_str());
         return addr;
     }
@@ -1299,6 +1282,7 @@ Value *IRGenerator::handle_string_literal(const ast::StringLiteralExpr &expr)
         true, // constant
         const_str,
         "str");
+    body_globals_.push_back(str);
 
     return builder_.create_bitcast(str, module_->get_pointer_type(module_->get_integer_type(8)), "str.cast");
 }
@@ -1562,12 +1546,14 @@ void IRGenerator::generate_function_body(const ast::FunctionDecl &func)
 
     current_func_ = dynamic_cast<Function *>(func_val);
     assert(current_func_ && "Symbol is not a function");
+    body_globals_.clear();
 
     // 2. Create entry basic block
     BasicBlock *entry_bb = current_func_->create_basic_block("entry");
     builder_.set_insert_point(entry_bb);
 
-    // 3. Parameter handling
+    // 3. Parameter handling. Parameters share the body's scope.
+    push_scope();
     size_t arg_idx = 0;
 
     // 3a. Handle hidden return pointer
@@ -1584,6 +1570,7 @@ void IRGenerator::generate_function_body(const ast::FunctionDecl &func)
         (func.params[0].name == "this" || func.params[0].name == "self"))
     {
         is_method = true;
+        current_func_->set_instance_method(true);
         Value *this_arg = current_func_->arg(arg_idx++);
         this_arg->set_name("this");
 
@@ -1607,7 +1594,6 @@ void IRGenerator::generate_function_body(const ast::FunctionDecl &func)
     }
 
     // 4. Generate function body
-    push_scope();
     for (const auto &stmt : func.body)
     {
         generate_stmt(*stmt);
@@ -1631,14 +1617,115 @@ void IRGenerator::generate_function_body(const ast::FunctionDecl &func)
     current_func_ = nullptr;
 }
 
-//===----------------------------------------------------------------------===//
-// Implementation Blocks
-//===----------------------------------------------------------------------===//
-void IRGenerator::generate_impl_block(const ast::ImplBlock &impl)
+void IRGenerator::generate_function_bodies(const std::vector<const ast::FunctionDecl *> &funcs)
+{
+    if (!pool_ || pool_->size() < 2 || funcs.size() < 2)
+    {
+        for (const auto *func : funcs)
+        {
+            generate_cached_function_body(*this, *func);
+        }
+        return;
+    }
+
+    // Every function is declared and bodies only read the global scope, so each
+    // worker lowers into the shared module with its own builder and scope copy.
+    struct ConcurrentModule
+    {
+        Module *module;
+        explicit ConcurrentModule(Module *m) : module(m) { module->set_concurrent(true); }
+        ~ConcurrentModule() { module->set_concurrent(false); }
+    } concurrent(module_);
+
+    std::vector<std::unique_ptr<IRGenerator>> workers(pool_->size());
+    pool_->parallel_for(funcs.size(), [&](size_t index, unsigned worker)
+                        {
+                            auto &generator = workers[worker];
+                            if (!generator)
+                            {
+                                generator = std::make_unique<IRGenerator>(module_);
+                                generator->scope_ = scope_;
+                                generator->type_cache_ = type_cache_;
+                            }
+                            generate_cached_function_body(*generator, *funcs[index]); });
+}
+
+// Lowers the entry points, then in waves every function the previous wave
+// refers to and that isn't lowered yet, so each wave can still go to the pool
+// and the cache. Returns the functions lowered, in the order they were reached
+std::vector<const ast::FunctionDecl *> IRGenerator::generate_reachable_bodies(const std::vector<const ast::FunctionDecl *> &funcs)
+{
+    std::unordered_map<const Value *, const ast::FunctionDecl *> unreached;
+    for (const auto *func : funcs)
+    {
+        unreached.emplace(lookup_symbol(func->name), func);
+    }
+
+    std::vector<const ast::FunctionDecl *> lowered;
+    std::vector<const ast::FunctionDecl *> wave;
+    auto reach = [&](const Value *value)
+    {
+        auto it = unreached.find(value);
+        if (it != unreached.end())
+        {
+            wave.push_back(it->second);
+            unreached.erase(it);
+        }
+    };
+    for (const auto &name : entry_points_)
+    {
+        if (Function *root = module_->get_function(name))
+        {
+            reach(root);
+        }
+    }
+
+    while (!wave.empty())
+    {
+        generate_function_bodies(wave);
+        const size_t first = lowered.size();
+        lowered.insert(lowered.end(), wave.begin(), wave.end());
+        wave.clear();
+        for (size_t i = first; i < lowered.size(); ++i)
+        {
+            for (BasicBlock *bb : module_->get_function(lowered[i]->name)->basic_blocks())
+            {
+                for (const Instruction &inst : *bb)
+                {
+                    for (Value *operand : inst.operands())
+                    {
+                        reach(operand);
+                    }
+                }
+            }
+        }
+    }
+    return lowered;
+}
+
+// A cached body is linked into the function's declaration; one that is
+// missing or doesn't fit any more is lowered by `generator` and stored.
+// Storing is best effort, a failed store only costs the next build a miss
+void IRGenerator::generate_cached_function_body(IRGenerator &generator, const ast::FunctionDecl &func)
 {
-    for (const auto &method : impl.methods)
+    std::optional<uint64_t> key = cache_keys_ ? cache_keys_->key(func) : std::nullopt;
+    if (key)
     {
-        generate_function_body(*method);
+        if (std::optional<std::vector<uint8_t>> entry = cache_->lookup(*key))
+        {
+            if (ModuleReader::link_function(std::move(*entry), *module_))
+            {
+                ++linked_bodies_;
+                return;
+            }
+        }
+    }
+
+    generator.generate_function_body(func);
+    if (key)
+    {
+        Function *func_ir = module_->get_function(func.name);
+        cache_->store(*key, serialize_function(*func_ir, generator.body_globals_));
     }
 }
 
@@ -1730,7 +1817,7 @@ Value *IRGenerator::handle_call(const ast::CallExpr &call)
 //===----------------------------------------------------------------------===//
 Value *IRGenerator::handle_variable(const ast::VariableExpr &var)
 {
-    Value *symbol = lookup_symbol(var.identifier);
+    Value *symbol = lookup_symbol(var.identifier, var.symbol);
     MO_ASSERT(symbol != nullptr, "Undefined variable: %s", var.identifier.c_str());
 
     if (auto *alloca = dynamic_cast<AllocaInst *>(symbol))
@@ -1998,8 +2085,8 @@ void IRGenerator::generate_global(const ast::GlobalDecl &global)
         global.name);
 
     // sym_table_stack_[0][global.name] = gv; // Add to global scope
-    MO_ASSERT(current_scope_->parent() == nullptr, "Global variable not at global scope");
-    declare_symbol(global.name, gv);
+    MO_ASSERT(scope_.is_global(), "Global variable not at global scope");
+    declare_symbol(global.name, gv, global.symbol);
 }
 
 //===----------------------------------------------------------------------===//
@@ -2007,28 +2094,32 @@ void IRGenerator::generate_global(const ast::GlobalDecl &global)
 //===----------------------------------------------------------------------===//
 void IRGenerator::generate(const ast::Program &program)
 {
+    PhaseTimer timer("irgen");
+    if (program.symbols)
+        scope_.use_symbol_table(program.symbols.get());
+
     // 1.1. Collect type names
     for (const auto &alias : program.aliases)
     {
-        current_scope_->insert_type(alias->name, nullptr);
+        scope_.declare_type(alias->name);
     }
 
     for (const auto &struct_decl : program.structs)
     {
-        current_scope_->insert_type(struct_decl->name, nullptr);
+        scope_.declare_type(struct_decl->name);
     }
 
     // 1.2. Fill in type aliases
     for (const auto &alias : program.aliases)
     {
         auto ty = convert_type(*alias->type); // Force alias type creation
-        current_scope_->insert_type(alias->name, ty);
+        scope_.insert_type(alias->name, ty);
     }
 
     for (const auto &struct_decl : program.structs)
     {
         auto ty = convert_type(*struct_decl->type()); // Force struct type creation
-        current_scope_->insert_type(struct_decl->name, ty);
+        scope_.insert_type(struct_decl->name, ty);
     }
 
     // 2. Generate global variables
@@ -2050,14 +2141,58 @@ void IRGenerator::generate(const ast::Program &program)
         }
     }
 
-    // 3.2. Generate function bodies
+    // 3.2. Generate function bodies, all of them or the ones the entry points reach
+    std::vector<const ast::FunctionDecl *> bodies;
     for (const auto &func : program.functions)
     {
-        generate_function_body(*func);
+        bodies.push_back(func.get());
     }
     for (const auto &impl : program.impl_blocks)
     {
-        generate_impl_block(*impl);
+        for (const auto &method : impl->methods)
+        {
+            bodies.push_back(method.get());
+        }
+    }
+    linked_bodies_ = 0;
+    if (cache_)
+    {
+        cache_keys_ = std::make_unique<FunctionKeys>(program);
+    }
+    const size_t num_functions = bodies.size();
+    if (entry_points_.empty())
+    {
+        generate_function_bodies(bodies);
+    }
+    else
+    {
+        bodies = generate_reachable_bodies(bodies);
+    }
+    cache_keys_.reset();
+
+    if (PhaseStats::global().enabled())
+    {
+        size_t num_instructions = 0;
+        for (const auto *func : bodies)
+        {
+            for (const auto &bb : *static_cast<Function *>(lookup_symbol(func->name)))
+            {
+                for (auto it = bb->begin(); it != bb->end(); ++it)
+                {
+                    num_instructions++;
+                }
+            }
+        }
+        timer.count("functions", bodies.size());
+        if (!entry_points_.empty())
+        {
+            timer.count("unreached functions", num_functions - bodies.size());
+        }
+        if (cache_)
+        {
+            timer.count("cached functions", linked_bodies_);
+        }
+        timer.count("instructions", num_instructions);
     }
 }
 
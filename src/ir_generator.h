@@ -2,13 +2,17 @@
 
 #pragma once
 
+#include <atomic>
 #include <stack>
+#include <string>
 #include <vector>
 #include <unordered_map>
 
 #include "ast.h"
+#include "compile_cache.h"
 #include "ir_builder.h"
 #include "ir_scope.h"
+#include "thread_pool.h"
 
 class IRGenerator
 {
@@ -17,9 +21,30 @@ public:
     ~IRGenerator();
     void generate(const ast::Program &program);
 
+    // Lowers function bodies on `pool` once all functions are declared; the
+    // module is made concurrent meanwhile. nullptr generates sequentially.
+    void set_thread_pool(ThreadPool *pool) { pool_ = pool; }
+
+    // Links in the body `cache` holds for each function whose key is there
+    // and stores the bodies it had to lower. nullptr lowers every function.
+    void set_cache(CompilationCache *cache) { cache_ = cache; }
+
+    // Lowers only the bodies reachable from the functions named here, each
+    // once a lowered body first refers to it by a call or as a value; the
+    // rest stay declarations, which later stages skip. Names that aren't
+    // functions of the program are ignored. Empty lowers every body.
+    void set_entry_points(std::vector<std::string> names) { entry_points_ = std::move(names); }
+
 protected:
     // Context management
     Module *module_;
+    ThreadPool *pool_ = nullptr;
+    CompilationCache *cache_ = nullptr;
+    std::vector<std::string> entry_points_;
+    std::unique_ptr<FunctionKeys> cache_keys_; // while generating with a cache
+    std::atomic<size_t> linked_bodies_ = 0;
+    // Globals made while lowering the current body, such as its string literals
+    std::vector<GlobalVariable *> body_globals_;
     IRBuilder builder_;
     Function *current_func_ = nullptr;
 
@@ -32,9 +57,8 @@ protected:
         return bb;
     }
 
-    // Symbol table stack for scoping
-    // std::vector<std::unordered_map<std::string, Value *>> sym_table_stack_;
-    Scope* current_scope_;
+    // Symbol table for all nested scopes
+    Scope scope_;
 
     // Loop context stacks
     std::stack<BasicBlock *> loop_cond_stack_;
@@ -54,8 +78,9 @@ protected:
     // Scope management
     void push_scope();
     void pop_scope();
-    Value *lookup_symbol(const std::string &name);
-    void declare_symbol(const std::string &name, Value *val);
+    // `symbol` is the name's id in the program's symbol table, when known
+    Value *lookup_symbol(const std::string &name, Symbol symbol = NO_SYMBOL);
+    void declare_symbol(const std::string &name, Value *val, Symbol symbol = NO_SYMBOL);
 
     // Control flow
     void push_loop(BasicBlock *cond_bb, BasicBlock *end_bb);
@@ -64,7 +89,9 @@ protected:
     // AST dispatch
     void declare_function(const ast::FunctionDecl &func);
     void generate_function_body(const ast::FunctionDecl &func);
-    void generate_impl_block(const ast::ImplBlock &impl);
+    void generate_function_bodies(const std::vector<const ast::FunctionDecl *> &funcs);
+    std::vector<const ast::FunctionDecl *> generate_reachable_bodies(const std::vector<const ast::FunctionDecl *> &funcs);
+    void generate_cached_function_body(IRGenerator &generator, const ast::FunctionDecl &func);
     void generate_stmt(const ast::Statement &stmt);
     void generate_array_init(AllocaInst *array_ptr, const ast::Expr &init_expr);
     Value *generate_expr(const ast::Expr &expr);
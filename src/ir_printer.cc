@@ -0,0 +1,642 @@
+// ir_printer.cc - Textual and JSON-lines dumps of the IR
+#include "ir_printer.h"
+
+//===----------------------------------------------------------------------===//
+//                             Spellings
+//===----------------------------------------------------------------------===//
+
+std::string_view IRWriter::type_name(const Type *type)
+{
+    auto [it, inserted] = type_names_.try_emplace(type);
+    if (inserted)
+        it->second = type->name();
+    return it->second;
+}
+
+void IRWriter::value(const Value *value)
+{
+    MO_ASSERT(value, "Invalid value");
+    auto *constant = dynamic_cast<const Constant *>(value);
+    if (!constant)
+    {
+        out_ << '%' << value->name();
+        return;
+    }
+    // Globals can be renamed between writes, and integers are cheaper to
+    // spell again than to look up
+    if (auto *global = dynamic_cast<const GlobalVariable *>(constant))
+    {
+        out_ << '@' << global->name();
+        return;
+    }
+    if (auto *integer = dynamic_cast<const ConstantInt *>(constant))
+    {
+        if (integer->type()->bit_width() == 1)
+            out_ << (integer->value() ? "true" : "false");
+        else
+            out_ << integer->value();
+        return;
+    }
+    out_ << constant_name(constant);
+}
+
+std::string_view IRWriter::constant_name(const Constant *constant)
+{
+    auto [it, inserted] = constant_names_.try_emplace(constant);
+    if (inserted)
+        it->second = constant->as_string();
+    return it->second;
+}
+
+void IRWriter::typed_value(const Value *v)
+{
+    out_ << type_name(v->type()) << ' ';
+    value(v);
+}
+
+//===----------------------------------------------------------------------===//
+//                             Module Entities
+//===----------------------------------------------------------------------===//
+
+void IRWriter::write(const Module &module)
+{
+    for (const auto &struct_ty : module.struct_types())
+        write(*struct_ty);
+    for (const auto &global_var : module.global_variables())
+        write(*global_var);
+    for (const auto &function : module.functions())
+        write(*function);
+}
+
+void IRWriter::write(const StructType &struct_ty)
+{
+    const auto &members = struct_ty.members();
+    if (format_ == Format::JSONLines)
+    {
+        out_ << "{\"kind\":\"struct\",\"name\":";
+        json_string(type_name(&struct_ty));
+        out_ << ",\"members\":[";
+        for (size_t i = 0; i < members.size(); ++i)
+        {
+            if (i != 0)
+                out_ << ',';
+            json_string(type_name(members[i].type));
+        }
+        out_ << "]}\n";
+        return;
+    }
+
+    out_ << type_name(&struct_ty) << " = type { ";
+    for (size_t i = 0; i < members.size(); ++i)
+    {
+        if (i != 0)
+            out_ << ", ";
+        out_ << type_name(members[i].type);
+    }
+    out_ << " }\n";
+}
+
+void IRWriter::write(const GlobalVariable &global_var)
+{
+    if (format_ == Format::JSONLines)
+    {
+        out_ << "{\"kind\":\"global\",\"name\":";
+        json_string(global_var.name());
+        out_ << ",\"constant\":" << (global_var.is_constant() ? "true" : "false") << ",\"type\":";
+        json_string(type_name(global_var.type()));
+        out_ << ",\"init\":";
+        if (global_var.initializer())
+            json_value(global_var.initializer());
+        else
+            out_ << "null";
+        out_ << "}\n";
+        return;
+    }
+
+    out_ << '@' << global_var.name() << " = " << (global_var.is_constant() ? "constant " : "global ")
+         << type_name(global_var.type()) << ' ';
+    if (global_var.initializer())
+        value(global_var.initializer());
+    else
+        out_ << "zeroinitializer";
+    out_ << '\n';
+}
+
+void IRWriter::write(const Function &function)
+{
+    if (format_ == Format::JSONLines)
+    {
+        out_ << "{\"kind\":\"function\",\"name\":";
+        json_string(function.name());
+        out_ << ",\"return\":";
+        json_string(type_name(function.return_type()));
+        out_ << ",\"args\":[";
+        for (size_t i = 0; i < function.num_args(); ++i)
+        {
+            if (i != 0)
+                out_ << ',';
+            out_ << "{\"name\":";
+            json_string(function.arg(i)->name());
+            out_ << ",\"type\":";
+            json_string(type_name(function.arg(i)->type()));
+            out_ << '}';
+        }
+        out_ << "],\"blocks\":" << function.basic_blocks().size() << "}\n";
+        for (const auto &bb : function.basic_blocks())
+            write(*bb);
+        return;
+    }
+
+    out_ << "define " << type_name(function.return_type()) << " @" << function.name() << '(';
+    for (size_t i = 0; i < function.num_args(); ++i)
+    {
+        if (i != 0)
+            out_ << ", ";
+        typed_value(function.arg(i));
+    }
+    out_ << ") {\n";
+    for (const auto &bb : function.basic_blocks())
+        write(*bb);
+    out_ << "}\n";
+}
+
+void IRWriter::write(const BasicBlock &bb)
+{
+    if (format_ == Format::JSONLines)
+    {
+        out_ << "{\"kind\":\"block\",\"function\":";
+        json_string(bb.parent_function() ? std::string_view(bb.parent_function()->name()) : std::string_view());
+        out_ << ",\"name\":";
+        json_string(bb.name());
+        out_ << ",\"preds\":[";
+        const auto &preds = bb.predecessors();
+        for (size_t i = 0; i < preds.size(); ++i)
+        {
+            if (i != 0)
+                out_ << ',';
+            json_string(preds[i]->name());
+        }
+        out_ << "]}\n";
+    }
+    else
+    {
+        out_ << bb.name() << ":\n";
+    }
+    for (auto inst = bb.first_instruction(); inst; inst = inst->next())
+        write(*inst);
+}
+
+void IRWriter::write(const Instruction &inst)
+{
+    if (format_ == Format::JSONLines)
+        write_json(inst);
+    else
+        write_text(inst);
+}
+
+//===----------------------------------------------------------------------===//
+//                             Instructions
+//===----------------------------------------------------------------------===//
+
+void IRWriter::write_text(const Instruction &inst)
+{
+    auto result = [&]()
+    {
+        out_ << "  ";
+        value(&inst);
+        out_ << " = ";
+    };
+
+    switch (inst.opcode())
+    {
+    case Opcode::Alloca:
+    {
+        const auto &alloca_inst = static_cast<const AllocaInst &>(inst);
+        result();
+        out_ << "alloca " << type_name(alloca_inst.allocated_type()) << '\n';
+        break;
+    }
+    case Opcode::Load:
+    {
+        const auto &load_inst = static_cast<const LoadInst &>(inst);
+        result();
+        out_ << "load " << type_name(load_inst.type()) << ", ";
+        typed_value(load_inst.pointer());
+        out_ << '\n';
+        break;
+    }
+    case Opcode::Store:
+    {
+        const auto &store_inst = static_cast<const StoreInst &>(inst);
+        out_ << "  store ";
+        typed_value(store_inst.value());
+        out_ << ", ";
+        typed_value(store_inst.pointer());
+        out_ << '\n';
+        break;
+    }
+    case Opcode::Ret:
+    {
+        const auto &ret_inst = static_cast<const ReturnInst &>(inst);
+        if (ret_inst.value())
+        {
+            out_ << "  ret ";
+            typed_value(ret_inst.value());
+            out_ << '\n';
+        }
+        else
+        {
+            out_ << "  ret void\n";
+        }
+        break;
+    }
+    case Opcode::Br:
+    case Opcode::CondBr:
+    {
+        const auto &br_inst = static_cast<const BranchInst &>(inst);
+        if (br_inst.is_conditional())
+        {
+            out_ << "  br i1 ";
+            value(br_inst.operand(0));
+            out_ << ", label ";
+            value(br_inst.get_true_successor());
+            out_ << ", label ";
+            value(br_inst.get_false_successor());
+        }
+        else
+        {
+            out_ << "  br label ";
+            value(br_inst.get_true_successor());
+        }
+        out_ << '\n';
+        break;
+    }
+    case Opcode::Unreachable:
+        out_ << "  unreachable\n";
+        break;
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::UDiv:
+    case Opcode::SDiv:
+    case Opcode::SRem:
+    case Opcode::URem:
+    case Opcode::Shl:
+    case Opcode::LShr:
+    case Opcode::AShr:
+    case Opcode::BitAnd:
+    case Opcode::BitOr:
+    case Opcode::BitXor:
+    {
+        const auto &binary_inst = static_cast<const BinaryInst &>(inst);
+        result();
+        out_ << IRPrinter::opcode_name(inst.opcode()) << ' ';
+        typed_value(binary_inst.left());
+        out_ << ", ";
+        value(binary_inst.right());
+        out_ << '\n';
+        break;
+    }
+    case Opcode::ICmp:
+    case Opcode::FCmp:
+    {
+        result();
+        if (inst.opcode() == Opcode::ICmp)
+            out_ << "icmp " << IRPrinter::predicate_name(static_cast<const ICmpInst &>(inst).predicate()) << ' ';
+        else
+            out_ << "fcmp " << IRPrinter::predicate_name(static_cast<const FCmpInst &>(inst).predicate()) << ' ';
+        typed_value(inst.operand(0));
+        out_ << ", ";
+        value(inst.operand(1));
+        out_ << '\n';
+        break;
+    }
+    case Opcode::GetElementPtr:
+    {
+        const auto &gep_inst = static_cast<const GetElementPtrInst &>(inst);
+        auto *ptr_type = gep_inst.base_pointer()->type()->as_pointer();
+        result();
+        out_ << "getelementptr " << type_name(ptr_type->element_type()) << ", ";
+        typed_value(gep_inst.base_pointer());
+        out_ << ", ";
+        for (size_t i = 0; i < gep_inst.indices().size(); ++i)
+        {
+            if (i != 0)
+                out_ << ", ";
+            typed_value(gep_inst.indices()[i]);
+        }
+        out_ << '\n';
+        break;
+    }
+    case Opcode::Phi:
+    {
+        const auto &phi_inst = static_cast<const PhiInst &>(inst);
+        result();
+        out_ << "phi " << type_name(phi_inst.type()) << ' ';
+        for (unsigned i = 0; i < phi_inst.num_incoming(); ++i)
+        {
+            if (i != 0)
+                out_ << ", ";
+            out_ << "[ ";
+            value(phi_inst.get_incoming_value(i));
+            out_ << ", ";
+            value(phi_inst.get_incoming_block(i));
+            out_ << " ]";
+        }
+        out_ << '\n';
+        break;
+    }
+    case Opcode::ZExt:
+    case Opcode::SExt:
+    case Opcode::Trunc:
+    case Opcode::SIToFP:
+    case Opcode::FPToSI:
+    case Opcode::FPExt:
+    case Opcode::FPTrunc:
+    case Opcode::BitCast:
+    case Opcode::PtrToInt:
+    case Opcode::IntToPtr:
+    case Opcode::FPToUI:
+    case Opcode::UIToFP:
+    {
+        const auto &conv_inst = static_cast<const ConversionInst &>(inst);
+        result();
+        out_ << IRPrinter::opcode_name(inst.opcode()) << ' ';
+        typed_value(conv_inst.get_source());
+        out_ << " to " << type_name(conv_inst.get_dest_type()) << '\n';
+        break;
+    }
+    case Opcode::Call:
+    {
+        const auto &call_inst = static_cast<const CallInst &>(inst);
+        const Function *callee = call_inst.called_function();
+        out_ << "  ";
+        value(&inst);
+        out_ << (call_inst.is_tail_call() ? " = tail call " : " = call ") << type_name(callee->return_type()) << " @"
+             << callee->name() << '(';
+        for (unsigned i = 1; i < call_inst.num_operands(); ++i)
+        {
+            if (i != 1)
+                out_ << ", ";
+            typed_value(call_inst.operand(i));
+        }
+        out_ << ")\n";
+        break;
+    }
+    case Opcode::Neg:
+    case Opcode::Not:
+    case Opcode::FNeg:
+    case Opcode::BitNot:
+    {
+        const auto &unary_inst = static_cast<const UnaryInst &>(inst);
+        result();
+        out_ << IRPrinter::opcode_name(inst.opcode()) << ' ';
+        typed_value(unary_inst.get_operand());
+        out_ << '\n';
+        break;
+    }
+    }
+}
+
+void IRWriter::write_json(const Instruction &inst)
+{
+    out_ << "{\"kind\":\"inst\",\"block\":";
+    json_string(inst.parent() ? std::string_view(inst.parent()->name()) : std::string_view());
+    out_ << ",\"op\":\"" << IRPrinter::opcode_name(inst.opcode()) << '"';
+    if (inst.type() && !inst.type()->is_void())
+    {
+        out_ << ",\"name\":";
+        json_string(inst.name());
+        out_ << ",\"type\":";
+        json_string(type_name(inst.type()));
+    }
+    switch (inst.opcode())
+    {
+    case Opcode::ICmp:
+        out_ << ",\"predicate\":\"" << IRPrinter::predicate_name(static_cast<const ICmpInst &>(inst).predicate()) << '"';
+        break;
+    case Opcode::FCmp:
+        out_ << ",\"predicate\":\"" << IRPrinter::predicate_name(static_cast<const FCmpInst &>(inst).predicate()) << '"';
+        break;
+    case Opcode::Alloca:
+        out_ << ",\"allocated\":";
+        json_string(type_name(static_cast<const AllocaInst &>(inst).allocated_type()));
+        break;
+    case Opcode::Call:
+        if (static_cast<const CallInst &>(inst).is_tail_call())
+            out_ << ",\"tail\":true";
+        break;
+    default:
+        break;
+    }
+    out_ << ",\"operands\":[";
+    for (unsigned i = 0; i < inst.num_operands(); ++i)
+    {
+        if (i != 0)
+            out_ << ',';
+        json_value(inst.operand(i));
+    }
+    out_ << "]}\n";
+}
+
+//===----------------------------------------------------------------------===//
+//                             JSON
+//===----------------------------------------------------------------------===//
+
+void IRWriter::json_string(std::string_view text)
+{
+    out_ << '"';
+    out_.write_json_escaped(text);
+    out_ << '"';
+}
+
+// Operands as the text form spells them, except that functions are `@name`
+void IRWriter::json_value(const Value *v)
+{
+    out_ << '"';
+    auto *constant = dynamic_cast<const Constant *>(v);
+    if (auto *function = dynamic_cast<const Function *>(v))
+    {
+        out_ << '@';
+        out_.write_json_escaped(function->name());
+    }
+    else if (!constant)
+    {
+        out_ << '%';
+        out_.write_json_escaped(v->name());
+    }
+    else if (auto *global = dynamic_cast<const GlobalVariable *>(constant))
+    {
+        out_ << '@';
+        out_.write_json_escaped(global->name());
+    }
+    else if (dynamic_cast<const ConstantInt *>(constant))
+    {
+        value(constant);
+    }
+    else
+    {
+        out_.write_json_escaped(constant_name(constant));
+    }
+    out_ << '"';
+}
+
+//===----------------------------------------------------------------------===//
+//                             Opcode Names
+//===----------------------------------------------------------------------===//
+
+std::string_view IRPrinter::opcode_name(Opcode op)
+{
+    switch (op)
+    {
+    case Opcode::Add:
+        return "add";
+    case Opcode::Sub:
+        return "sub";
+    case Opcode::Mul:
+        return "mul";
+    case Opcode::UDiv:
+        return "udiv";
+    case Opcode::SDiv:
+        return "sdiv";
+    case Opcode::URem:
+        return "urem";
+    case Opcode::SRem:
+        return "srem";
+    case Opcode::ZExt:
+        return "zext";
+    case Opcode::SExt:
+        return "sext";
+    case Opcode::Trunc:
+        return "trunc";
+    case Opcode::SIToFP:
+        return "sitofp";
+    case Opcode::FPToSI:
+        return "fptosi";
+    case Opcode::FPExt:
+        return "fpext";
+    case Opcode::FPTrunc:
+        return "fptrunc";
+    case Opcode::BitCast:
+        return "bitcast";
+    case Opcode::BitAnd:
+        return "and";
+    case Opcode::BitOr:
+        return "or";
+    case Opcode::BitXor:
+        return "xor";
+    case Opcode::Shl:
+        return "shl";
+    case Opcode::LShr:
+        return "lshr";
+    case Opcode::AShr:
+        return "ashr";
+    case Opcode::PtrToInt:
+        return "ptrtoint";
+    case Opcode::Alloca:
+        return "alloca";
+    case Opcode::Load:
+        return "load";
+    case Opcode::Store:
+        return "store";
+    case Opcode::GetElementPtr:
+        return "getelementptr";
+    case Opcode::ICmp:
+        return "icmp";
+    case Opcode::FCmp:
+        return "fcmp";
+    case Opcode::Br:
+        return "br";
+    case Opcode::CondBr:
+        return "br";
+    case Opcode::Unreachable:
+        return "unreachable";
+    case Opcode::Ret:
+        return "ret";
+    case Opcode::Phi:
+        return "phi";
+    case Opcode::Call:
+        return "call";
+    case Opcode::IntToPtr:
+        return "inttoptr";
+    case Opcode::FPToUI:
+        return "fptoui";
+    case Opcode::UIToFP:
+        return "uitofp";
+    case Opcode::Neg:
+        return "neg";
+    case Opcode::Not:
+        return "not";
+    case Opcode::FNeg:
+        return "fneg";
+    case Opcode::BitNot:
+        return "bitnot";
+    }
+
+    assert(false && "Invalid opcode");
+    return "<err>";
+}
+
+std::string_view IRPrinter::predicate_name(ICmpInst::Predicate pred)
+{
+    switch (pred)
+    {
+    case ICmpInst::EQ:
+        return "eq";
+    case ICmpInst::NE:
+        return "ne";
+    case ICmpInst::SLT:
+        return "slt";
+    case ICmpInst::SLE:
+        return "sle";
+    case ICmpInst::SGT:
+        return "sgt";
+    case ICmpInst::SGE:
+        return "sge";
+    case ICmpInst::ULT:
+        return "ult";
+    case ICmpInst::ULE:
+        return "ule";
+    case ICmpInst::UGT:
+        return "ugt";
+    case ICmpInst::UGE:
+        return "uge";
+    }
+
+    assert(false && "Invalid predicate");
+    return "<err>";
+}
+
+std::string_view IRPrinter::predicate_name(FCmpInst::Predicate pred)
+{
+    switch (pred)
+    {
+    case FCmpInst::EQ:
+        return "eq";
+    case FCmpInst::NE:
+        return "ne";
+    case FCmpInst::OEQ:
+        return "oeq";
+    case FCmpInst::ONE:
+        return "one";
+    case FCmpInst::LT:
+        return "lt";
+    case FCmpInst::LE:
+        return "le";
+    case FCmpInst::GT:
+        return "gt";
+    case FCmpInst::GE:
+        return "ge";
+    case FCmpInst::OLT:
+        return "olt";
+    case FCmpInst::OLE:
+        return "ole";
+    case FCmpInst::OGT:
+        return "ogt";
+    case FCmpInst::OGE:
+        return "oge";
+    }
+
+    assert(false && "Invalid predicate");
+    return "<err>";
+}
@@ -1,30 +1,50 @@
 #include "ir_scope.h"
 #include "mo_debug.h"
 
-// Find a variable in the current or parent scopes
-Value *Scope::resolve_variable(const std::string &name) const
+Scope::Scope(const Scope &other)
+    : own_names_(std::make_unique<SymbolTable>(*other.names_)), names_(own_names_.get()),
+      variables_(other.variables_), types_(other.types_)
 {
-    if (name.empty())
-    {
-        throw std::invalid_argument("Cannot find empty name");
-    }
+}
 
-    auto var_it = variables_.find(name);
-    if (var_it != variables_.end())
+Scope &Scope::operator=(const Scope &other)
+{
+    if (this != &other)
     {
-        return var_it->second;
+        own_names_ = std::make_unique<SymbolTable>(*other.names_);
+        names_ = own_names_.get();
+        variables_ = other.variables_;
+        types_ = other.types_;
     }
+    return *this;
+}
 
-    if (parent_)
+void Scope::push()
+{
+    variables_.push_scope();
+    types_.push_scope();
+}
+
+void Scope::pop()
+{
+    variables_.pop_scope();
+    types_.pop_scope();
+}
+
+// Find a variable in the current or enclosing scopes
+Value *Scope::resolve_variable(const std::string &name, Symbol symbol) const
+{
+    if (name.empty())
     {
-        return parent_->resolve_variable(name);
+        throw std::invalid_argument("Cannot find empty name");
     }
 
-    return nullptr;
+    Value *const *value = variables_.find(symbol != NO_SYMBOL ? symbol : names_->lookup(name));
+    return value ? *value : nullptr;
 }
 
 // Insert a variable into the current scope
-bool Scope::insert_variable(std::string name, Value *type)
+bool Scope::insert_variable(const std::string &name, Value *type, Symbol symbol)
 {
     if (name.empty())
     {
@@ -35,23 +55,24 @@ bool Scope::insert_variable(std::string name, Value *type)
         throw std::invalid_argument("Type cannot be null");
     }
 
-    if (auto it = variables_.find(name); it != variables_.end())
+    if (symbol == NO_SYMBOL)
+        symbol = names_->intern(name);
+    if (variables_.find_local(symbol))
     {
         MO_WARN("Variable already exists: %s", name.c_str());
         return false;
     }
 
-    if (auto it = types_.find(name); it != types_.end())
+    if (types_.find_local(symbol))
     {
         MO_WARN("Type already exists: %s", name.c_str());
         return false;
     }
 
-    variables_[name] = std::move(type);
-    return true;
+    return variables_.insert(symbol, type);
 }
 
-bool Scope::insert_type(std::string name, Type *type)
+bool Scope::insert_type(const std::string &name, Type *type)
 {
     if (name.empty())
     {
@@ -62,47 +83,52 @@ bool Scope::insert_type(std::string name, Type *type)
         MO_WARN("Inserting null type: %s", name.c_str());
     }
 
-    if (auto it = variables_.find(name); it != variables_.end())
+    const Symbol symbol = names_->intern(name);
+    if (variables_.find_local(symbol))
     {
         MO_WARN("Variable already exists: %s", name.c_str());
         return false;
     }
 
-    if (auto it = types_.find(name); it != types_.end())
+    if (Type **existing = types_.find_local(symbol))
     {
-        if (it->second != nullptr)
+        if (*existing != nullptr)
         {
             MO_WARN("Type already exists: %s", name.c_str());
             return false;
         }
-        else
-        {
-            MO_WARN("Type already exists (but with null pointer): %s", name.c_str());
-        }
+        // Declared by declare_type
+        *existing = type;
+        return true;
     }
 
-    types_[name] = std::move(type);
-    return true;
+    return types_.insert(symbol, type);
 }
 
-// Resolve a type in the current or parent scopes
-Type *Scope::resolve_type(const std::string &name) const
+bool Scope::declare_type(const std::string &name)
 {
     if (name.empty())
     {
-        throw std::invalid_argument("Cannot resolve empty name");
+        throw std::invalid_argument("Cannot insert empty name");
     }
 
-    auto type_it = types_.find(name);
-    if (type_it != types_.end())
+    const Symbol symbol = names_->intern(name);
+    if (variables_.find_local(symbol) || types_.find_local(symbol))
     {
-        return type_it->second;
+        MO_WARN("Name already declared: %s", name.c_str());
+        return false;
     }
+    return types_.insert(symbol, nullptr);
+}
 
-    if (parent_)
+// Resolve a type in the current or enclosing scopes
+Type *Scope::resolve_type(const std::string &name) const
+{
+    if (name.empty())
     {
-        return parent_->resolve_type(name);
+        throw std::invalid_argument("Cannot resolve empty name");
     }
 
-    return nullptr;
+    Type *const *type = types_.find(names_->lookup(name));
+    return type ? *type : nullptr;
 }
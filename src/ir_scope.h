@@ -1,30 +1,44 @@
 // ir_scope.h -- Scope for the intermediate representation
 #pragma once
 
+#include <memory>
+
 #include "ir.h"
-#include <unordered_map>
+#include "scoped_symbol_table.h"
 
+// Variables and types of all nested block scopes, kept in flat scoped tables
+// keyed by interned name, so entering or leaving a block does not allocate.
+// Like ast::Scope, a `symbol` from the lexer is used as the key as it is.
 class Scope
 {
 public:
-    Scope(Scope *parent) : parent_(parent) {
-        if (parent_) {
-            depth_ = parent_->depth_ + 1;
-        }
-    }
+    Scope() : own_names_(std::make_unique<SymbolTable>()), names_(own_names_.get()) {}
+    // A copy interns into its own copy of the names, which keeps the ids, so
+    // copies used on other threads don't share a table
+    Scope(const Scope &other);
+    Scope &operator=(const Scope &other);
+    Scope(Scope &&) = default;
+    Scope &operator=(Scope &&) = default;
+    // Interns into `names` from now on; call before the first insert
+    void use_symbol_table(SymbolTable *names) { names_ = names; }
+
+    void push();
+    void pop();
 
-    Value* resolve_variable(const std::string &name) const;
+    Value* resolve_variable(const std::string &name, Symbol symbol = NO_SYMBOL) const;
     Type* resolve_type(const std::string &name) const;
-    bool insert_variable(std::string name, Value* value);
-    bool insert_type(std::string name, Type* type);
+    bool insert_variable(const std::string &name, Value* value, Symbol symbol = NO_SYMBOL);
+    bool insert_type(const std::string &name, Type* type);
+    // Reserves `name` in the current scope for a type insert_type fills in
+    // later, so types can name each other whatever their declaration order
+    bool declare_type(const std::string &name);
 
-    Scope *parent() const { return parent_; }
-    size_t depth() const { return depth_; }
-    bool is_global() const { return depth_ == 0; }
+    size_t depth() const { return variables_.depth(); }
+    bool is_global() const { return depth() == 0; }
 
 private:
-    Scope *parent_ = nullptr;
-    size_t depth_ = 0;
-    std::unordered_map<std::string, Value*> variables_;
-    std::unordered_map<std::string, Type*> types_;
+    std::unique_ptr<SymbolTable> own_names_;
+    SymbolTable *names_;
+    ScopedSymbolTable<Value *> variables_;
+    ScopedSymbolTable<Type *> types_;
 };
@@ -0,0 +1,1112 @@
+#include "isel.h"
+#include <optional>
+#include <stdexcept>
+#include <unordered_set>
+
+#include "thread_pool.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    uint64_t pattern_key(Opcode opcode, int predicate)
+    {
+        return (static_cast<uint64_t>(opcode) << 8) | static_cast<uint8_t>(predicate + 1);
+    }
+
+    ISelType isel_type(const Type *type)
+    {
+        if (type->is_vector())
+            return static_cast<const VectorType *>(type)->element_type()->is_float() ? ISelType::FloatVector
+                                                                                     : ISelType::IntVector;
+        if (!type->is_float())
+            return ISelType::Int;
+        return type->size() == 8 ? ISelType::F64 : ISelType::F32;
+    }
+
+    int64_t signed_value(const ConstantInt *c)
+    {
+        const unsigned bits = c->type()->bit_width();
+        const uint64_t value = c->value();
+        // Booleans stay 0/1
+        if (bits <= 1 || bits >= 64)
+            return static_cast<int64_t>(value);
+        const uint64_t sign = uint64_t(1) << (bits - 1);
+        return static_cast<int64_t>((value ^ sign) - sign);
+    }
+
+    // Byte offset of `gep` from its base, if every index is constant
+    std::optional<int64_t> constant_offset(const GetElementPtrInst &gep)
+    {
+        int64_t offset = 0;
+        Type *type = gep.base_pointer()->type();
+        for (Value *index : gep.indices())
+        {
+            auto *c = dynamic_cast<ConstantInt *>(index);
+            if (!c)
+                return std::nullopt;
+            const int64_t i = signed_value(c);
+            if (auto *ptr = dynamic_cast<PointerType *>(type))
+            {
+                type = ptr->element_type();
+                offset += i * static_cast<int64_t>(type->size());
+            }
+            else if (auto *array = dynamic_cast<ArrayType *>(type))
+            {
+                type = array->element_type();
+                offset += i * static_cast<int64_t>(type->size());
+            }
+            else if (auto *vector = dynamic_cast<VectorType *>(type))
+            {
+                type = vector->element_type();
+                offset += i * static_cast<int64_t>(type->size());
+            }
+            else if (auto *st = dynamic_cast<StructType *>(type))
+            {
+                offset += static_cast<int64_t>(st->get_member_offset(static_cast<unsigned>(i)));
+                type = st->get_member_type(static_cast<unsigned>(i));
+            }
+            else
+            {
+                return std::nullopt;
+            }
+        }
+        return offset;
+    }
+
+    bool is_memory_use(const Use *use)
+    {
+        auto *inst = dynamic_cast<Instruction *>(use->user());
+        if (!inst)
+            return false;
+        if (inst->opcode() == Opcode::Load)
+            return true;
+        // Storing the address itself needs it in a register
+        return inst->opcode() == Opcode::Store && static_cast<StoreInst *>(inst)->pointer() == use->get() &&
+               static_cast<StoreInst *>(inst)->value() != use->get();
+    }
+
+    bool has_phis(const BasicBlock *bb)
+    {
+        const Instruction *first = bb->first_instruction();
+        return first && first->opcode() == Opcode::Phi;
+    }
+
+    class SelectionError : public std::runtime_error
+    {
+    public:
+        using std::runtime_error::runtime_error;
+    };
+
+    // Something to feed a pattern: a register, an immediate, or the offset of
+    // a frame object, which stays symbolic until the frame is laid out
+    struct Src
+    {
+        enum Kind : uint8_t
+        {
+            Reg,
+            Imm,
+            Frame
+        };
+        Kind kind;
+        int64_t value;
+
+        static Src reg(unsigned r) { return {Reg, r}; }
+        static Src imm(int64_t v) { return {Imm, v}; }
+        static Src frame(int fi) { return {Frame, fi}; }
+
+        bool is_reg() const { return kind == Reg; }
+        bool is_zero() const { return kind == Imm && value == 0; }
+    };
+
+    // Where a load or store goes
+    struct Address
+    {
+        bool is_frame;
+        int frame_index;
+        unsigned base;
+        int64_t offset;
+    };
+
+    class FunctionSelector
+    {
+    public:
+        FunctionSelector(const TargetISelInfo &target, Function &func, MachineFunction &mf)
+            : target_(target), tii_(target.inst_info()), func_(func), mf_(mf) {}
+
+        void run();
+
+    private:
+        //===------------------------ Operands -------------------------===//
+
+        unsigned vreg_of(Value *value)
+        {
+            auto it = vregs_.find(value);
+            if (it != vregs_.end())
+                return it->second;
+            Type *type = value->type();
+            unsigned vreg = mf_.create_vreg(target_.reg_class(type), static_cast<unsigned>(type->size()),
+                                            type->is_float(), value);
+            vregs_.emplace(value, vreg);
+            return vreg;
+        }
+
+        unsigned new_int_vreg()
+        {
+            return mf_.create_vreg(target_.int_reg_class(), target_.register_bits() / 8);
+        }
+
+        Src src_of(Value *value)
+        {
+            if (auto *c = dynamic_cast<ConstantInt *>(value))
+                return Src::imm(signed_value(c));
+            if (dynamic_cast<ConstantPointerNull *>(value))
+                return Src::imm(0);
+            return Src::reg(reg_of(value));
+        }
+
+        unsigned reg_of(Value *value)
+        {
+            if (auto *c = dynamic_cast<ConstantInt *>(value))
+                return materialize(signed_value(c));
+            if (dynamic_cast<ConstantPointerNull *>(value))
+                return materialize(0);
+            if (auto *global = dynamic_cast<GlobalVariable *>(value))
+            {
+                unsigned rd = new_int_vreg();
+                mbb_->append(target_.build_global_address(rd, global));
+                return rd;
+            }
+            if (dynamic_cast<Constant *>(value) || dynamic_cast<Function *>(value))
+                fail("constant operand `" + value->name() + "` is not supported");
+            auto fi = frame_indices_.find(value);
+            if (fi != frame_indices_.end())
+                return frame_address(fi->second);
+            return vreg_of(value);
+        }
+
+        unsigned reg_of(Src src)
+        {
+            switch (src.kind)
+            {
+            case Src::Reg:
+                return static_cast<unsigned>(src.value);
+            case Src::Imm:
+                return materialize(src.value);
+            case Src::Frame:
+            {
+                unsigned rd = new_int_vreg();
+                emit(target_.load_imm_opcode(), {MOperand::create_reg(rd, true),
+                                                 MOperand::create_frame_index(static_cast<int>(src.value))});
+                return rd;
+            }
+            }
+            return 0;
+        }
+
+        // Constants are loaded once per block and reused after that
+        unsigned materialize(int64_t imm)
+        {
+            if (imm == 0 && target_.zero_register() != TargetISelInfo::NO_REG)
+                return target_.zero_register();
+            auto it = block_constants_.find(imm);
+            if (it != block_constants_.end())
+                return it->second;
+            unsigned rd = new_int_vreg();
+            emit(target_.load_imm_opcode(), {MOperand::create_reg(rd, true), MOperand::create_imm(imm)});
+            block_constants_.emplace(imm, rd);
+            return rd;
+        }
+
+        unsigned frame_address(int fi)
+        {
+            unsigned rd = new_int_vreg();
+            if (!select_op(Opcode::Add, ISelPattern::ANY_PREDICATE, ISelType::Int,
+                           Src::reg(target_.frame_register()), Src::frame(fi), rd))
+                fail("no pattern for frame addresses");
+            return rd;
+        }
+
+        //===------------------------ Emission -------------------------===//
+
+        MachineInst *emit(unsigned opcode, const std::vector<MOperand> &ops)
+        {
+            auto mi = std::make_unique<MachineInst>(opcode, ops);
+            MachineInst *raw = mi.get();
+            mbb_->append(std::move(mi));
+            return raw;
+        }
+
+        void emit_copy(unsigned rd, unsigned rs, bool is_fp)
+        {
+            if (rd != rs)
+                mbb_->append(target_.build_copy(rd, rs, is_fp));
+        }
+
+        void set_block(MachineBasicBlock *mbb)
+        {
+            mbb_ = mbb;
+            block_constants_.clear();
+        }
+
+        [[noreturn]] void fail(const std::string &message) const
+        {
+            throw SelectionError(message);
+        }
+
+        [[noreturn]] void fail(const Instruction &inst) const
+        {
+            fail("no pattern for opcode " + std::to_string(static_cast<int>(inst.opcode())) +
+                 (inst.name().empty() ? "" : " (`" + inst.name() + "`)") + " in block `" + inst.parent()->name() + "`");
+        }
+
+        // Emits `rd = lhs op rhs` with the first pattern that fits
+        bool select_op(Opcode opcode, int predicate, ISelType type, Src lhs, Src rhs, unsigned rd);
+        void apply_then(const ISelPattern &pattern, unsigned rd);
+        bool select_branch(int predicate, Src lhs, Src rhs, MachineBasicBlock *target);
+
+        Address match_address(Value *ptr);
+        MOperand memory_operand(const Address &addr);
+        void materialize_address(const Address &addr, unsigned rd);
+        void select_gep(GetElementPtrInst &gep);
+
+        // Vector accesses take no offset, and go after the target's setup
+        MOperand vector_memory_operand(Value *ptr);
+        void emit_vector_config(const Type *type);
+        void read_vector_state(MachineInst *mi);
+
+        void select_instruction(Instruction &inst);
+        void select_cast(Instruction &inst);
+        void select_call(CallInst &call);
+        void select_return(ReturnInst &ret);
+        void select_branch_inst(BranchInst &br);
+
+        void emit_jump(MachineBasicBlock *target)
+        {
+            MachineInst *mi = emit(target_.jump_opcode(), {MOperand::create_basic_block(target)});
+            mi->set_flag(MIFlag::Branch);
+            mi->set_flag(MIFlag::Terminator);
+            mbb_->add_successor(target);
+        }
+
+        void emit_phi_copies(const BasicBlock *pred, const BasicBlock *succ);
+        // Where the branch from `pred` to `succ` should go. With `split`, phi
+        // copies get a block of their own instead of going into `pred`
+        MachineBasicBlock *edge_target(const BasicBlock *pred, const BasicBlock *succ, bool split);
+
+        MachineBasicBlock *next_block(const BasicBlock *bb) const
+        {
+            auto it = layout_next_.find(bb);
+            return it == layout_next_.end() ? nullptr : it->second;
+        }
+
+        const TargetISelInfo &target_;
+        const TargetInstInfo &tii_;
+        Function &func_;
+        MachineFunction &mf_;
+        MachineBasicBlock *mbb_ = nullptr;
+
+        std::unordered_map<const BasicBlock *, MachineBasicBlock *> blocks_;
+        std::unordered_map<const BasicBlock *, MachineBasicBlock *> layout_next_;
+        std::unordered_map<const Value *, unsigned> vregs_;
+        std::unordered_map<const Value *, int> frame_indices_;
+        std::unordered_set<const Instruction *> folded_;
+        std::unordered_map<int64_t, unsigned> block_constants_;
+        // Call lowered to a jump, whose return is already taken care of
+        const CallInst *tail_call_ = nullptr;
+    };
+}
+
+//===----------------------------------------------------------------------===//
+//                             FunctionSelector Implementation
+//===----------------------------------------------------------------------===//
+
+bool FunctionSelector::select_op(Opcode opcode, int predicate, ISelType type, Src lhs, Src rhs, unsigned rd)
+{
+    const std::vector<const ISelPattern *> &patterns = target_.lookup(opcode, predicate);
+
+    // Immediate forms first
+    for (const ISelPattern *p : patterns)
+    {
+        if (p->type != type || p->form != ISelForm::RegImm)
+            continue;
+        Src reg_side = lhs, imm_side = rhs;
+        if (!reg_side.is_reg() && imm_side.is_reg())
+        {
+            if (!p->commutative)
+                continue;
+            std::swap(reg_side, imm_side);
+        }
+        MOperand imm_op;
+        if (imm_side.kind == Src::Frame)
+        {
+            // Offsets are only known once the frame is laid out
+            if (p->negate_imm)
+                continue;
+            imm_op = MOperand::create_frame_index(static_cast<int>(imm_side.value));
+        }
+        else if (imm_side.kind == Src::Imm)
+        {
+            const int64_t imm = p->negate_imm ? -imm_side.value : imm_side.value;
+            if (!tii_.is_legal_immediate(imm, p->imm_bits))
+                continue;
+            imm_op = MOperand::create_imm(imm);
+        }
+        else
+        {
+            continue;
+        }
+        emit(p->machine_opcode, {MOperand::create_reg(rd, true), MOperand::create_reg(reg_of(reg_side)), imm_op});
+        apply_then(*p, rd);
+        return true;
+    }
+
+    for (const ISelPattern *p : patterns)
+    {
+        if (p->type != type || p->form != ISelForm::RegReg)
+            continue;
+        Src a = lhs, b = rhs;
+        if (p->swap_operands)
+            std::swap(a, b);
+        const unsigned ra = reg_of(a);
+        const unsigned rb = reg_of(b);
+        emit(p->machine_opcode, {MOperand::create_reg(rd, true), MOperand::create_reg(ra), MOperand::create_reg(rb)});
+        apply_then(*p, rd);
+        return true;
+    }
+    return false;
+}
+
+void FunctionSelector::apply_then(const ISelPattern &pattern, unsigned rd)
+{
+    for (const auto &[opcode, imm] : pattern.then)
+    {
+        emit(opcode, {MOperand::create_reg(rd, true), MOperand::create_reg(rd), MOperand::create_imm(imm)});
+    }
+}
+
+bool FunctionSelector::select_branch(int predicate, Src lhs, Src rhs, MachineBasicBlock *target)
+{
+    for (const ISelPattern *p : target_.lookup(Opcode::CondBr, predicate))
+    {
+        if (p->type != ISelType::Int)
+            continue;
+        Src a = lhs, b = rhs;
+        if (p->swap_operands)
+            std::swap(a, b);
+
+        MachineInst *branch;
+        switch (p->form)
+        {
+        case ISelForm::BranchReg:
+        {
+            if (!b.is_zero())
+            {
+                if (!p->commutative || !a.is_zero())
+                    continue;
+                std::swap(a, b);
+            }
+            branch = emit(p->machine_opcode, {MOperand::create_reg(reg_of(a)), MOperand::create_basic_block(target)});
+            break;
+        }
+        case ISelForm::BranchRegReg:
+        {
+            const unsigned ra = reg_of(a);
+            const unsigned rb = reg_of(b);
+            branch = emit(p->machine_opcode, {MOperand::create_reg(ra), MOperand::create_reg(rb),
+                                              MOperand::create_basic_block(target)});
+            break;
+        }
+        case ISelForm::BranchCompare:
+        {
+            const unsigned ra = reg_of(a);
+            const unsigned rb = reg_of(b);
+            const unsigned t = new_int_vreg();
+            MachineInst *cmp = emit(p->compare_opcode, {MOperand::create_reg(t, true), MOperand::create_reg(ra),
+                                                        MOperand::create_reg(rb)});
+            cmp->set_flag(MIFlag::IsCompare);
+            branch = emit(p->machine_opcode, {MOperand::create_reg(t), MOperand::create_basic_block(target)});
+            break;
+        }
+        default:
+            continue;
+        }
+        branch->set_flag(MIFlag::Branch);
+        branch->set_flag(MIFlag::Terminator);
+        mbb_->add_successor(target);
+        return true;
+    }
+    return false;
+}
+
+Address FunctionSelector::match_address(Value *ptr)
+{
+    int64_t offset = 0;
+    while (auto *gep = dynamic_cast<GetElementPtrInst *>(ptr))
+    {
+        std::optional<int64_t> gep_offset = constant_offset(*gep);
+        if (!gep_offset)
+            break;
+        offset += *gep_offset;
+        ptr = gep->base_pointer();
+    }
+
+    auto fi = frame_indices_.find(ptr);
+    if (fi != frame_indices_.end())
+        return {true, fi->second, 0, offset};
+
+    unsigned base = reg_of(ptr);
+    if (offset != 0 && !tii_.is_legal_immediate(offset, target_.memory_offset_bits()))
+    {
+        unsigned sum = new_int_vreg();
+        if (!select_op(Opcode::Add, ISelPattern::ANY_PREDICATE, ISelType::Int, Src::reg(base), Src::imm(offset), sum))
+            fail("no pattern for address arithmetic");
+        return {false, 0, sum, 0};
+    }
+    return {false, 0, base, offset};
+}
+
+MOperand FunctionSelector::memory_operand(const Address &addr)
+{
+    if (addr.is_frame)
+        return MOperand::create_mem_fi(addr.frame_index, static_cast<int>(addr.offset));
+    return MOperand::create_mem_ri(addr.base, static_cast<int>(addr.offset));
+}
+
+void FunctionSelector::materialize_address(const Address &addr, unsigned rd)
+{
+    const Src base = addr.is_frame ? Src::reg(frame_address(addr.frame_index)) : Src::reg(addr.base);
+    if (addr.offset == 0)
+    {
+        emit_copy(rd, static_cast<unsigned>(base.value), false);
+        return;
+    }
+    if (!select_op(Opcode::Add, ISelPattern::ANY_PREDICATE, ISelType::Int, base, Src::imm(addr.offset), rd))
+        fail("no pattern for address arithmetic");
+}
+
+MOperand FunctionSelector::vector_memory_operand(Value *ptr)
+{
+    const Address addr = match_address(ptr);
+    if (!addr.is_frame && addr.offset == 0)
+        return MOperand::create_mem_ri(addr.base, 0);
+    const unsigned rd = new_int_vreg();
+    materialize_address(addr, rd);
+    return MOperand::create_mem_ri(rd, 0);
+}
+
+void FunctionSelector::emit_vector_config(const Type *type)
+{
+    if (auto config = target_.build_vector_config(static_cast<const VectorType *>(type)))
+        mbb_->append(std::move(config));
+}
+
+void FunctionSelector::read_vector_state(MachineInst *mi)
+{
+    if (target_.vector_state_reg() != TargetISelInfo::NO_REG)
+        mi->set_implicit_uses({target_.vector_state_reg()});
+}
+
+void FunctionSelector::select_gep(GetElementPtrInst &gep)
+{
+    const unsigned rd = vreg_of(&gep);
+    if (constant_offset(gep))
+    {
+        materialize_address(match_address(&gep), rd);
+        return;
+    }
+
+    // Constant parts accumulate; each variable index adds index * stride
+    unsigned base = reg_of(gep.base_pointer());
+    int64_t offset = 0;
+    Type *type = gep.base_pointer()->type();
+    for (Value *index : gep.indices())
+    {
+        int64_t stride;
+        if (auto *st = dynamic_cast<StructType *>(type))
+        {
+            const unsigned member = static_cast<unsigned>(signed_value(static_cast<ConstantInt *>(index)));
+            offset += static_cast<int64_t>(st->get_member_offset(member));
+            type = st->get_member_type(member);
+            continue;
+        }
+        if (auto *ptr = dynamic_cast<PointerType *>(type))
+            type = ptr->element_type();
+        else if (auto *array = dynamic_cast<ArrayType *>(type))
+            type = array->element_type();
+        else if (auto *vector = dynamic_cast<VectorType *>(type))
+            type = vector->element_type();
+        else
+            fail(gep);
+        stride = static_cast<int64_t>(type->size());
+
+        if (auto *c = dynamic_cast<ConstantInt *>(index))
+        {
+            offset += signed_value(c) * stride;
+            continue;
+        }
+        unsigned scaled = reg_of(index);
+        if (stride != 1)
+        {
+            const unsigned product = new_int_vreg();
+            const bool pow2 = (stride & (stride - 1)) == 0;
+            int shift = 0;
+            while (pow2 && (int64_t(1) << shift) != stride)
+                ++shift;
+            if (!(pow2 && select_op(Opcode::Shl, ISelPattern::ANY_PREDICATE, ISelType::Int, Src::reg(scaled),
+                                    Src::imm(shift), product)) &&
+                !select_op(Opcode::Mul, ISelPattern::ANY_PREDICATE, ISelType::Int, Src::reg(scaled),
+                           Src::imm(stride), product))
+                fail(gep);
+            scaled = product;
+        }
+        const unsigned sum = new_int_vreg();
+        if (!select_op(Opcode::Add, ISelPattern::ANY_PREDICATE, ISelType::Int, Src::reg(base), Src::reg(scaled), sum))
+            fail(gep);
+        base = sum;
+    }
+    materialize_address({false, 0, base, offset}, rd);
+}
+
+void FunctionSelector::select_cast(Instruction &inst)
+{
+    Value *src = inst.operand(0);
+    Type *from = src->type();
+    Type *to = inst.type();
+    if (from->is_float() != to->is_float() || from->is_vector() || to->is_vector())
+        fail(inst);
+
+    const unsigned reg_bits = target_.register_bits();
+    const unsigned from_bits = from->is_float() ? 0 : from->bit_width();
+    const unsigned to_bits = to->is_float() ? 0 : to->bit_width();
+    const ISelType type = isel_type(to);
+
+    // Integers narrower than 32 bits are kept zero-extended, so truncating
+    // masks and sign extension shifts the sign bit up and back down
+    if (inst.opcode() == Opcode::Trunc && to_bits < 32 && to_bits < from_bits)
+    {
+        if (!select_op(Opcode::BitAnd, ISelPattern::ANY_PREDICATE, type, src_of(src),
+                       Src::imm((int64_t(1) << to_bits) - 1), vreg_of(&inst)))
+            fail(inst);
+        return;
+    }
+    if (inst.opcode() == Opcode::SExt && from_bits < 32 && from_bits < to_bits)
+    {
+        const unsigned rd = vreg_of(&inst);
+        if (from_bits == 1)
+        {
+            if (!select_op(Opcode::Sub, ISelPattern::ANY_PREDICATE, type, Src::imm(0), src_of(src), rd))
+                fail(inst);
+            return;
+        }
+        const int64_t shift = reg_bits - from_bits;
+        const unsigned up = new_int_vreg();
+        if (!select_op(Opcode::Shl, ISelPattern::ANY_PREDICATE, type, src_of(src), Src::imm(shift), up) ||
+            !select_op(Opcode::AShr, ISelPattern::ANY_PREDICATE, type, Src::reg(up), Src::imm(shift), rd))
+            fail(inst);
+        return;
+    }
+    if (from->is_float() && from->size() != to->size())
+        fail(inst);
+
+    // Everything else keeps the bits as they are
+    const unsigned rs = reg_of(src);
+    auto it = vregs_.find(&inst);
+    if (it == vregs_.end() && MachineFunction::is_virtual_reg(rs))
+    {
+        vregs_.emplace(&inst, rs);
+        return;
+    }
+    emit_copy(vreg_of(&inst), rs, to->is_float());
+}
+
+void FunctionSelector::select_call(CallInst &call)
+{
+    Function *callee = call.called_function();
+    if (!callee)
+        fail("indirect calls are not supported");
+
+    const CallingConv::ID cc = target_.calling_convention(*callee);
+    std::vector<std::pair<unsigned, Value *>> moves;
+    size_t next_int = 0, next_fp = 0;
+    for (Value *arg : call.arguments())
+    {
+        if (arg->type()->is_vector())
+            fail("call to `" + callee->name() + "` passes a vector, which is not supported");
+        const bool is_fp = arg->type()->is_float();
+        const std::vector<unsigned> &regs = is_fp ? target_.fp_arg_regs(cc) : target_.int_arg_regs(cc);
+        size_t &next = is_fp ? next_fp : next_int;
+        if (next == regs.size())
+            fail("call to `" + callee->name() + "` passes arguments on the stack, which is not supported");
+        moves.emplace_back(regs[next++], arg);
+    }
+
+    // Everything is in a vreg before the argument registers are written
+    std::vector<unsigned> sources;
+    for (const auto &[phys, arg] : moves)
+    {
+        sources.push_back(reg_of(arg));
+    }
+    for (size_t i = 0; i < moves.size(); ++i)
+    {
+        emit_copy(moves[i].first, sources[i], moves[i].second->type()->is_float());
+    }
+
+    // The argument registers stay live up to the call
+    std::vector<unsigned> arg_regs;
+    for (const auto &[phys, arg] : moves)
+    {
+        arg_regs.push_back(phys);
+    }
+
+    // The callee returns to our caller, with its result already in place
+    const TargetRegisterInfo *tri = mf_.parent() ? mf_.parent()->target_reg_info() : nullptr;
+    if (call.is_tail_call() && tri && tri->supports_tail_call(mf_.call_convention()))
+    {
+        MachineInst *mi = emit(target_.jump_opcode(), {MOperand::create_external_sym(mf_.parent()->intern_symbol(callee->name()))});
+        mi->set_flag(MIFlag::Call);
+        mi->set_flag(MIFlag::Terminator);
+        mi->set_implicit_uses(std::move(arg_regs));
+        tail_call_ = &call;
+        return;
+    }
+
+    MachineInst *mi = emit(target_.call_opcode(), {MOperand::create_external_sym(mf_.parent()->intern_symbol(callee->name()))});
+    mi->set_flag(MIFlag::Call);
+    mi->set_implicit_uses(std::move(arg_regs));
+    if (tri)
+    {
+        // Everything the convention lets the callee overwrite, until
+        // allocate_module knows better
+        const std::set<unsigned> &clobbers = tri->get_caller_saved_regs(cc);
+        mi->set_implicit_defs({clobbers.begin(), clobbers.end()});
+    }
+
+    Type *type = call.type();
+    if (type->is_vector())
+        fail("call to `" + callee->name() + "` returns a vector, which is not supported");
+    if (!type->is_void())
+    {
+        emit_copy(vreg_of(&call), type->is_float() ? target_.fp_return_reg() : target_.int_return_reg(),
+                  type->is_float());
+    }
+}
+
+void FunctionSelector::select_return(ReturnInst &ret)
+{
+    if (tail_call_ && ret.prev() == tail_call_)
+        return;
+    if (Value *value = ret.value())
+    {
+        if (value->type()->is_vector())
+            fail("returning a vector is not supported");
+        const bool is_fp = value->type()->is_float();
+        emit_copy(is_fp ? target_.fp_return_reg() : target_.int_return_reg(), reg_of(value), is_fp);
+    }
+    MachineInst *mi = emit(target_.return_opcode(), {});
+    mi->set_flag(MIFlag::Terminator);
+}
+
+void FunctionSelector::emit_phi_copies(const BasicBlock *pred, const BasicBlock *succ)
+{
+    std::vector<std::pair<unsigned, Value *>> copies;
+    for (const Instruction *inst = succ->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+    {
+        auto *phi = static_cast<const PhiInst *>(inst);
+        for (unsigned i = 0; i < phi->num_incoming(); ++i)
+        {
+            if (phi->get_incoming_block(i) == pred)
+            {
+                if (phi->type()->is_vector())
+                    fail("vector phis are not supported");
+                copies.emplace_back(vreg_of(const_cast<PhiInst *>(phi)), phi->get_incoming_value(i));
+                break;
+            }
+        }
+    }
+
+    // Phis read their inputs all at once; going through fresh registers
+    // keeps one copy from clobbering another's source
+    std::vector<unsigned> sources;
+    for (const auto &[dst, value] : copies)
+    {
+        const unsigned rs = reg_of(value);
+        if (copies.size() == 1)
+        {
+            sources.push_back(rs);
+            continue;
+        }
+        const VRegInfo info = mf_.get_vreg_info(dst); // create_vreg may grow the table
+        const unsigned t = mf_.create_vreg(info.register_class_id_, info.size_, info.is_fp_);
+        emit_copy(t, rs, info.is_fp_);
+        sources.push_back(t);
+    }
+    for (size_t i = 0; i < copies.size(); ++i)
+    {
+        emit_copy(copies[i].first, sources[i], copies[i].second->type()->is_float());
+    }
+}
+
+MachineBasicBlock *FunctionSelector::edge_target(const BasicBlock *pred, const BasicBlock *succ, bool split)
+{
+    MachineBasicBlock *succ_mbb = blocks_.at(succ);
+    if (!has_phis(succ))
+        return succ_mbb;
+    if (!split)
+    {
+        emit_phi_copies(pred, succ);
+        return succ_mbb;
+    }
+
+    MachineBasicBlock *saved = mbb_;
+    MachineBasicBlock *edge = mf_.create_block(pred->name() + "." + succ->name());
+    const auto *branch = static_cast<const BranchInst *>(pred->get_terminator());
+    if (branch->has_branch_weights())
+        edge->set_profile_count(branch->edge_weight(succ));
+    set_block(edge);
+    emit_phi_copies(pred, succ);
+    emit_jump(succ_mbb);
+    set_block(saved);
+    return edge;
+}
+
+void FunctionSelector::select_branch_inst(BranchInst &br)
+{
+    const BasicBlock *bb = br.parent();
+    MachineBasicBlock *next = next_block(bb);
+    if (!br.is_conditional())
+    {
+        MachineBasicBlock *target = edge_target(bb, br.get_true_successor(), false);
+        if (target == next)
+            mbb_->add_successor(target);
+        else
+            emit_jump(target);
+        return;
+    }
+
+    Value *cond = br.operand(0);
+    int predicate = ICmpInst::NE;
+    Src lhs = Src::imm(0), rhs = Src::imm(0);
+    auto *cmp = dynamic_cast<ICmpInst *>(cond);
+    if (cmp && folded_.count(cmp))
+    {
+        predicate = cmp->predicate();
+        lhs = src_of(cmp->operand(0));
+        rhs = src_of(cmp->operand(1));
+    }
+    else
+    {
+        lhs = src_of(cond);
+    }
+
+    MachineBasicBlock *true_target = edge_target(bb, br.get_true_successor(), true);
+    MachineBasicBlock *false_target = edge_target(bb, br.get_false_successor(), true);
+    if (!select_branch(predicate, lhs, rhs, true_target))
+        fail(br);
+    if (false_target == next)
+        mbb_->add_successor(false_target);
+    else
+        emit_jump(false_target);
+}
+
+void FunctionSelector::select_instruction(Instruction &inst)
+{
+    const Opcode opcode = inst.opcode();
+    switch (opcode)
+    {
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::UDiv:
+    case Opcode::SDiv:
+    case Opcode::URem:
+    case Opcode::SRem:
+    case Opcode::BitAnd:
+    case Opcode::BitOr:
+    case Opcode::BitXor:
+    case Opcode::Shl:
+    case Opcode::LShr:
+    case Opcode::AShr:
+        if (inst.type()->is_vector())
+        {
+            const unsigned lhs = reg_of(inst.operand(0)), rhs = reg_of(inst.operand(1));
+            emit_vector_config(inst.type());
+            if (!select_op(opcode, ISelPattern::ANY_PREDICATE, isel_type(inst.type()), Src::reg(lhs), Src::reg(rhs),
+                           vreg_of(&inst)))
+                fail(inst);
+            read_vector_state(mbb_->instructions().back().get());
+            return;
+        }
+        if (!select_op(opcode, ISelPattern::ANY_PREDICATE, isel_type(inst.type()), src_of(inst.operand(0)),
+                       src_of(inst.operand(1)), vreg_of(&inst)))
+            fail(inst);
+        return;
+    case Opcode::Neg:
+        if (inst.type()->is_float() || inst.type()->is_vector() ||
+            !select_op(Opcode::Sub, ISelPattern::ANY_PREDICATE, ISelType::Int, Src::imm(0), src_of(inst.operand(0)),
+                       vreg_of(&inst)))
+            fail(inst);
+        return;
+    case Opcode::Not:
+    case Opcode::BitNot:
+        if (inst.type()->is_vector() ||
+            !select_op(Opcode::BitXor, ISelPattern::ANY_PREDICATE, ISelType::Int, src_of(inst.operand(0)),
+                       Src::imm(opcode == Opcode::Not ? 1 : -1), vreg_of(&inst)))
+            fail(inst);
+        return;
+    case Opcode::ICmp:
+        if (inst.operand(0)->type()->is_vector() ||
+            !select_op(Opcode::ICmp, static_cast<ICmpInst &>(inst).predicate(), isel_type(inst.operand(0)->type()),
+                       src_of(inst.operand(0)), src_of(inst.operand(1)), vreg_of(&inst)))
+            fail(inst);
+        return;
+    case Opcode::Alloca:
+    case Opcode::Phi:
+    case Opcode::Unreachable:
+        return;
+    case Opcode::Load:
+    {
+        const unsigned opc = target_.load_opcode(inst.type());
+        if (!opc)
+            fail(inst);
+        Value *ptr = static_cast<LoadInst &>(inst).pointer();
+        const bool is_vector = inst.type()->is_vector();
+        MOperand mem = is_vector ? vector_memory_operand(ptr) : memory_operand(match_address(ptr));
+        if (is_vector)
+            emit_vector_config(inst.type());
+        MachineInst *mi = emit(opc, {MOperand::create_reg(vreg_of(&inst), true), mem});
+        mi->set_flag(MIFlag::MayLoad);
+        if (is_vector)
+            read_vector_state(mi);
+        return;
+    }
+    case Opcode::Store:
+    {
+        auto &store = static_cast<StoreInst &>(inst);
+        const unsigned opc = target_.store_opcode(store.value()->type());
+        if (!opc)
+            fail(inst);
+        const unsigned rs = reg_of(store.value());
+        const bool is_vector = store.value()->type()->is_vector();
+        MOperand mem = is_vector ? vector_memory_operand(store.pointer()) : memory_operand(match_address(store.pointer()));
+        if (is_vector)
+            emit_vector_config(store.value()->type());
+        MachineInst *mi = emit(opc, {MOperand::create_reg(rs), mem});
+        mi->set_flag(MIFlag::MayStore);
+        if (is_vector)
+            read_vector_state(mi);
+        return;
+    }
+    case Opcode::GetElementPtr:
+        select_gep(static_cast<GetElementPtrInst &>(inst));
+        return;
+    case Opcode::Br:
+    case Opcode::CondBr:
+        select_branch_inst(static_cast<BranchInst &>(inst));
+        return;
+    case Opcode::Ret:
+        select_return(static_cast<ReturnInst &>(inst));
+        return;
+    case Opcode::Call:
+        select_call(static_cast<CallInst &>(inst));
+        return;
+    case Opcode::ZExt:
+    case Opcode::SExt:
+    case Opcode::Trunc:
+    case Opcode::BitCast:
+    case Opcode::PtrToInt:
+    case Opcode::IntToPtr:
+        select_cast(inst);
+        return;
+    default:
+        fail(inst);
+    }
+}
+
+void FunctionSelector::run()
+{
+    mf_.set_call_convention(target_.calling_convention(func_));
+    const std::vector<BasicBlock *> &bbs = func_.basic_blocks();
+    for (BasicBlock *bb : bbs)
+    {
+        blocks_[bb] = mf_.create_block(bb->name());
+        if (bb->has_profile_count())
+            blocks_[bb]->set_profile_count(bb->profile_count());
+    }
+    for (size_t i = 0; i + 1 < bbs.size(); ++i)
+    {
+        layout_next_[bbs[i]] = blocks_[bbs[i + 1]];
+    }
+
+    // Frame objects, and what folds into its users instead of being selected
+    for (BasicBlock *bb : bbs)
+    {
+        for (Instruction &inst : *bb)
+        {
+            if (inst.opcode() == Opcode::Alloca)
+            {
+                Type *type = static_cast<AllocaInst &>(inst).allocated_type();
+                frame_indices_[&inst] = mf_.frame()->create_fixed_size(&inst, static_cast<int64_t>(type->size()),
+                                                                         static_cast<unsigned>(type->alignment()));
+            }
+            else if (inst.opcode() == Opcode::ICmp)
+            {
+                auto &cmp = static_cast<ICmpInst &>(inst);
+                Instruction *term = bb->get_terminator();
+                unsigned num_uses = 0;
+                for (User *user : cmp.users())
+                {
+                    num_uses += user == term ? 1 : 2;
+                }
+                if (num_uses == 1 && term->opcode() == Opcode::Br && static_cast<BranchInst *>(term)->is_conditional() &&
+                    isel_type(cmp.operand(0)->type()) == ISelType::Int &&
+                    !target_.lookup(Opcode::CondBr, cmp.predicate()).empty())
+                    folded_.insert(&inst);
+            }
+            else if (inst.opcode() == Opcode::GetElementPtr &&
+                     constant_offset(static_cast<GetElementPtrInst &>(inst)) && inst.has_uses())
+            {
+                bool all_memory = true;
+                for (Use *use : inst.uses())
+                {
+                    all_memory &= is_memory_use(use);
+                }
+                if (all_memory)
+                    folded_.insert(&inst);
+            }
+        }
+    }
+
+    set_block(blocks_.at(func_.entry_block()));
+    size_t next_int = 0, next_fp = 0;
+    for (size_t i = 0; i < func_.num_args(); ++i)
+    {
+        Argument *arg = func_.arg(i);
+        const bool is_fp = arg->type()->is_float();
+        const std::vector<unsigned> &regs = is_fp ? target_.fp_arg_regs(mf_.call_convention())
+                                                  : target_.int_arg_regs(mf_.call_convention());
+        size_t &next = is_fp ? next_fp : next_int;
+        if (next == regs.size())
+            fail("arguments passed on the stack are not supported");
+        emit_copy(vreg_of(arg), regs[next++], is_fp);
+    }
+
+    for (BasicBlock *bb : bbs)
+    {
+        if (mbb_ != blocks_.at(bb))
+            set_block(blocks_.at(bb));
+        for (Instruction &inst : *bb)
+        {
+            if (!folded_.count(&inst))
+                select_instruction(inst);
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             TargetISelInfo Implementation
+//===----------------------------------------------------------------------===//
+
+const std::vector<const ISelPattern *> &TargetISelInfo::lookup(Opcode opcode, int predicate) const
+{
+    static const std::vector<const ISelPattern *> none;
+    auto it = index_.find(pattern_key(opcode, predicate));
+    return it == index_.end() ? none : it->second;
+}
+
+void TargetISelInfo::add_pattern(ISelPattern pattern)
+{
+    patterns_.push_back(std::make_unique<ISelPattern>(std::move(pattern)));
+    const ISelPattern *p = patterns_.back().get();
+    index_[pattern_key(p->ir_opcode, p->predicate)].push_back(p);
+}
+
+//===----------------------------------------------------------------------===//
+//                             Instruction Selection Implementation
+//===----------------------------------------------------------------------===//
+
+bool select_function(const TargetISelInfo &target, Function &func, MachineFunction &mf, std::string *err_msg)
+{
+    MachineInstPoolScope pool(mf);
+    try
+    {
+        FunctionSelector(target, func, mf).run();
+        return true;
+    }
+    catch (const SelectionError &error)
+    {
+        if (err_msg)
+            *err_msg = error.what();
+        return false;
+    }
+}
+
+std::vector<MachineFunction *> select_module(const TargetISelInfo &target, Module &module, MachineModule &mm,
+                                             ThreadPool *pool, std::vector<std::string> *errors)
+{
+    // MachineModule isn't thread-safe, so the functions are created up front
+    std::vector<Function *> funcs;
+    std::vector<MachineFunction *> mfs;
+    for (Function *func : module.functions())
+    {
+        if (func->basic_blocks().empty())
+            continue;
+        funcs.push_back(func);
+        mfs.push_back(mm.create_machine_function(func));
+    }
+
+    std::vector<std::string> messages(funcs.size());
+    std::vector<char> ok(funcs.size());
+    auto lower = [&](size_t index, unsigned)
+    {
+        ok[index] = select_function(target, *funcs[index], *mfs[index], &messages[index]);
+    };
+    if (pool)
+    {
+        pool->parallel_for(funcs.size(), lower);
+    }
+    else
+    {
+        for (size_t i = 0; i < funcs.size(); ++i)
+        {
+            lower(i, 0);
+        }
+    }
+
+    if (errors)
+    {
+        for (size_t i = 0; i < funcs.size(); ++i)
+        {
+            if (!ok[i])
+                errors->push_back(funcs[i]->name() + ": " + messages[i]);
+        }
+    }
+    return mfs;
+}
+
+void resolve_frame_indices(MachineFunction &mf, unsigned frame_reg)
+{
+    const MachineFrame &frame = *mf.frame();
+    for (const auto &mbb : mf.basic_blocks())
+    {
+        for (auto &mi : *mbb)
+        {
+            for (unsigned i = 0; i < mi->operands().size(); ++i)
+            {
+                MOperand &op = mi->operand(i);
+                if (op.is_mem_fi())
+                {
+                    const MOperand::MEMfi mem = op.mem_fi();
+                    const int offset = static_cast<int>(frame.get_frame_index_offset(mem.frame_index)) + mem.offset;
+                    op = MOperand::create_mem_ri(frame_reg, offset);
+                }
+                else if (op.is_frame_index())
+                {
+                    op = MOperand::create_imm(static_cast<int64_t>(frame.get_frame_index_offset(op.frame_index())));
+                }
+            }
+        }
+    }
+}
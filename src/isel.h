@@ -0,0 +1,204 @@
+// isel.h - Table-driven instruction selection from IR to machine code
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ir.h"
+#include "machine.h"
+
+class ThreadPool;
+
+//===----------------------------------------------------------------------===//
+//                             Selection Patterns
+//===----------------------------------------------------------------------===//
+//
+// A target describes itself as a table of patterns, each turning one IR
+// operation with a given operand shape into one machine instruction. The
+// selector walks every block and, for each instruction, takes the first
+// pattern whose shape fits: constant operands that pass `is_legal_immediate`
+// select the immediate forms, compares that only feed the block's branch
+// fold into it, and constant-offset GEPs and allocas fold into the memory
+// operand of their loads and stores. VectorType values live in the target's
+// vector class and select the IntVector and FloatVector patterns; their
+// loads and stores take the address in a register.
+
+enum class ISelForm : uint8_t
+{
+    RegReg,        // op rd, rs1, rs2
+    RegImm,        // op rd, rs1, imm
+    BranchRegReg,  // op rs1, rs2, target
+    BranchReg,     // op rs1, target; compares rs1 against zero
+    BranchCompare, // compare t, rs1, rs2 then op t, target
+};
+
+// Operand types a pattern applies to
+enum class ISelType : uint8_t
+{
+    Int, // integers and pointers
+    F32,
+    F64,
+    IntVector, // VectorType of integers
+    FloatVector
+};
+
+struct ISelPattern
+{
+    static constexpr int ANY_PREDICATE = -1;
+
+    Opcode ir_opcode;              // CondBr for the branch forms
+    int predicate;                 // ICmpInst::Predicate or ANY_PREDICATE
+    ISelForm form;
+    unsigned machine_opcode;
+    ISelType type = ISelType::Int;
+    unsigned imm_bits = 0;         // RegImm: width checked with is_legal_immediate
+    bool commutative = false;      // a constant left operand may move right
+    bool swap_operands = false;    // e.g. `a > b` as `b < a`
+    bool negate_imm = false;       // e.g. `x - c` as `x + -c`
+    unsigned compare_opcode = 0;   // BranchCompare
+    // Applied to the result in order, each as `op rd, rd, imm`
+    std::vector<std::pair<unsigned, int64_t>> then = {};
+};
+
+//===----------------------------------------------------------------------===//
+//                             Target Selection Info
+//===----------------------------------------------------------------------===//
+
+class TargetISelInfo
+{
+public:
+    static constexpr unsigned NO_REG = ~0u;
+
+    virtual ~TargetISelInfo() = default;
+
+    const TargetInstInfo &inst_info() const { return *tii_; }
+
+    // Patterns for `opcode` and `predicate` in table order
+    const std::vector<const ISelPattern *> &lookup(Opcode opcode, int predicate = ISelPattern::ANY_PREDICATE) const;
+
+    unsigned reg_class(const Type *type) const
+    {
+        if (type->is_vector())
+            return vector_class_;
+        if (!type->is_float())
+            return int_class_;
+        return type->size() == 8 ? double_class_ : float_class_;
+    }
+    unsigned int_reg_class() const { return int_class_; }
+    unsigned register_bits() const { return register_bits_; }
+    // Base register of frame object addresses
+    unsigned frame_register() const { return frame_reg_; }
+    // NO_REG if the target has none
+    unsigned zero_register() const { return zero_reg_; }
+    unsigned memory_offset_bits() const { return memory_offset_bits_; }
+    // Width of the vector registers, 0 if the target has none
+    unsigned vector_bytes() const { return vector_bytes_; }
+    // Read by every vector instruction, NO_REG if nothing sets it up
+    unsigned vector_state_reg() const { return vector_state_reg_; }
+
+    unsigned load_imm_opcode() const { return load_imm_opcode_; }
+    unsigned jump_opcode() const { return jump_opcode_; }
+    unsigned call_opcode() const { return call_opcode_; }
+    unsigned return_opcode() const { return return_opcode_; }
+
+    const std::vector<unsigned> &int_arg_regs() const { return int_arg_regs_; }
+    const std::vector<unsigned> &fp_arg_regs() const { return fp_arg_regs_; }
+    // Argument registers under `cc`, which is C or Fast
+    const std::vector<unsigned> &int_arg_regs(CallingConv::ID cc) const
+    {
+        return cc == CallingConv::Fast ? fast_int_arg_regs_ : int_arg_regs_;
+    }
+    const std::vector<unsigned> &fp_arg_regs(CallingConv::ID cc) const
+    {
+        return cc == CallingConv::Fast ? fast_fp_arg_regs_ : fp_arg_regs_;
+    }
+    // Fast for internal functions when the target describes it, else C
+    CallingConv::ID calling_convention(const Function &func) const
+    {
+        return func.is_internal() && !fast_int_arg_regs_.empty() ? CallingConv::Fast : CallingConv::C;
+    }
+    unsigned int_return_reg() const { return int_return_reg_; }
+    unsigned fp_return_reg() const { return fp_return_reg_; }
+
+    // 0 if the target cannot access a value of `type` in one instruction
+    virtual unsigned load_opcode(const Type *type) const = 0;
+    virtual unsigned store_opcode(const Type *type) const = 0;
+    // `rd = address of global`
+    virtual std::unique_ptr<MachineInst> build_global_address(unsigned rd, GlobalVariable *global) const = 0;
+    virtual std::unique_ptr<MachineInst> build_copy(unsigned rd, unsigned rs, bool is_fp) const = 0;
+    // Emitted before each instruction on `type`, or nullptr when the target
+    // needs nothing; the instruction reads vector_state_reg_ after it
+    virtual std::unique_ptr<MachineInst> build_vector_config(const VectorType *type) const
+    {
+        (void)type;
+        return nullptr;
+    }
+
+protected:
+    explicit TargetISelInfo(const TargetInstInfo *tii) : tii_(tii) {}
+
+    void add_pattern(ISelPattern pattern);
+
+    const TargetInstInfo *tii_;
+    unsigned int_class_ = 0;
+    unsigned float_class_ = 0;
+    unsigned double_class_ = 0;
+    unsigned register_bits_ = 32;
+    unsigned frame_reg_ = NO_REG;
+    unsigned zero_reg_ = NO_REG;
+    unsigned memory_offset_bits_ = 0;
+    unsigned load_imm_opcode_ = 0;
+    unsigned jump_opcode_ = 0;
+    unsigned call_opcode_ = 0;
+    unsigned return_opcode_ = 0;
+    std::vector<unsigned> int_arg_regs_;
+    std::vector<unsigned> fp_arg_regs_;
+    // Empty when the target has no Fast convention
+    std::vector<unsigned> fast_int_arg_regs_;
+    std::vector<unsigned> fast_fp_arg_regs_;
+    unsigned int_return_reg_ = NO_REG;
+    unsigned fp_return_reg_ = NO_REG;
+    unsigned vector_class_ = 0;
+    unsigned vector_bytes_ = 0;
+    unsigned vector_state_reg_ = NO_REG;
+
+private:
+    std::vector<std::unique_ptr<ISelPattern>> patterns_;
+    std::unordered_map<uint64_t, std::vector<const ISelPattern *>> index_;
+};
+
+//===----------------------------------------------------------------------===//
+//                             Instruction Selection
+//===----------------------------------------------------------------------===//
+//
+// Every IR block becomes a machine block, in the same order, and edges into
+// a block with phis get a block of their own when their source has several
+// successors; the phis turn into copies at the end of the incoming blocks.
+// Arguments and return values go through the target's argument and return
+// registers, the longer Fast list for internal functions. Calls carry the
+// argument registers as implicit uses and, with target register info, the
+// convention's caller-saved registers as implicit defs. Calls marked as tail calls become a jump to the callee, and
+// their return is dropped, when the calling convention supports it. Frame
+// objects are addressed with MEMfi operands and FrameIndex immediates until
+// `resolve_frame_indices` runs, since spill slots added later move the
+// layout.
+
+// Lowers `func` into the empty `mf`. Returns false with `err_msg` set when
+// something in `func` has no pattern on the target
+bool select_function(const TargetISelInfo &target, Function &func, MachineFunction &mf,
+                     std::string *err_msg = nullptr);
+
+// Creates a MachineFunction in `mm` for each function of `module` with a
+// body and lowers them, in parallel on `pool` when one is given. Failed
+// functions keep whatever was selected before the failure and report
+// through `errors`, as "name: message". Returns the MachineFunctions in
+// module order
+std::vector<MachineFunction *> select_module(const TargetISelInfo &target, Module &module, MachineModule &mm,
+                                             ThreadPool *pool = nullptr, std::vector<std::string> *errors = nullptr);
+
+// Rewrites MEMfi operands into MEMri off `frame_reg` and FrameIndex
+// operands into immediates, using the frame's current layout
+void resolve_frame_indices(MachineFunction &mf, unsigned frame_reg);
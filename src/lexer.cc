@@ -4,9 +4,23 @@
 //===----------------------------------------------------------------------===//
 
 #include "lexer.h"
+#include <algorithm>
+#include <bit>
 #include <string>
 #include <unordered_map>
 
+#include "phase_stats.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #include "mo_debug.h"
 
 //===----------------------------------------------------------------------===//
@@ -173,6 +187,149 @@ std::string token_to_string(const Token &token)
     return result;
 }
 
+//===----------------------------------------------------------------------===//
+//                             Scanning Kernels
+//===----------------------------------------------------------------------===//
+//
+// Bulk scanners used for whitespace, comments and string bodies. Each returns
+// the offset of the first byte at or after `from` that stops the run (or
+// `s.size()`), looking at 32 (AVX2) or 16 (SSE2/NEON) bytes per step with a
+// scalar tail. Line/column bookkeeping is done afterwards by Lexer::skip_to.
+
+static inline bool is_space_byte(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+#if defined(__ARM_NEON)
+// Bitmask with one bit per byte lane, like _mm_movemask_epi8
+static inline uint32_t neon_movemask(uint8x16_t v)
+{
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8(v, vld1q_u8(weights));
+    uint32_t lo = vaddv_u8(vget_low_u8(bits));
+    uint32_t hi = vaddv_u8(vget_high_u8(bits));
+    return lo | (hi << 8);
+}
+#endif
+
+// First byte that is not one of ' ', '\t', '\n', '\v', '\f', '\r'
+static size_t scan_whitespace(std::string_view s, size_t from)
+{
+    const char *p = s.data();
+    size_t i = from;
+    const size_t n = s.size();
+    // Most runs between tokens are a single space; don't pay for a vector load there
+    while (i < n && i < from + 2)
+    {
+        if (!is_space_byte(static_cast<unsigned char>(p[i])))
+            return i;
+        ++i;
+    }
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i rel = _mm256_sub_epi8(v, _mm256_set1_epi8('\t'));
+        __m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(rel, _mm256_set1_epi8(4)), rel);
+        __m256i space = _mm256_or_si256(ctrl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        uint32_t mask = ~static_cast<uint32_t>(_mm256_movemask_epi8(space));
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i rel = _mm_sub_epi8(v, _mm_set1_epi8('\t'));
+        __m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(rel, _mm_set1_epi8(4)), rel);
+        __m128i space = _mm_or_si128(ctrl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        uint32_t mask = ~static_cast<uint32_t>(_mm_movemask_epi8(space)) & 0xFFFF;
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + i));
+        uint8x16_t ctrl = vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8(4));
+        uint8x16_t space = vorrq_u8(ctrl, vceqq_u8(v, vdupq_n_u8(' ')));
+        uint32_t mask = ~neon_movemask(space) & 0xFFFF;
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#endif
+    while (i < n && is_space_byte(static_cast<unsigned char>(p[i])))
+        ++i;
+    return i;
+}
+
+// First '"' or '\\' inside a string literal body
+static size_t scan_string_body(std::string_view s, size_t from)
+{
+    const char *p = s.data();
+    size_t i = from;
+    const size_t n = s.size();
+#if defined(__AVX2__)
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('"')),
+                                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\\')));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hit));
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+        uint32_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hit));
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= n; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + i));
+        uint8x16_t hit = vorrq_u8(vceqq_u8(v, vdupq_n_u8('"')), vceqq_u8(v, vdupq_n_u8('\\')));
+        uint32_t mask = neon_movemask(hit);
+        if (mask)
+            return i + std::countr_zero(mask);
+    }
+#endif
+    while (i < n && p[i] != '"' && p[i] != '\\')
+        ++i;
+    return i;
+}
+
+// Number of '\n' bytes in s[from, to)
+static size_t count_newlines(std::string_view s, size_t from, size_t to)
+{
+    const char *p = s.data();
+    size_t i = from;
+    size_t count = 0;
+#if defined(__SSE2__)
+    const __m128i nl = _mm_set1_epi8('\n');
+    for (; i + 16 <= to; i += 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + i));
+        count += std::popcount(static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl))));
+    }
+#elif defined(__ARM_NEON)
+    for (; i + 16 <= to; i += 16)
+    {
+        uint8x16_t v = vld1q_u8(reinterpret_cast<const uint8_t *>(p + i));
+        count += std::popcount(neon_movemask(vceqq_u8(v, vdupq_n_u8('\n'))));
+    }
+#endif
+    count += std::count(p + i, p + to, '\n');
+    return count;
+}
+
 //===----------------------------------------------------------------------===//
 //                             Token Class Implementation
 //===----------------------------------------------------------------------===//
@@ -182,15 +339,79 @@ Token::Token() : type(TokenType::Invalid), start_line(0), start_col(0), end_line
 Token::Token(TokenType type, int start_line, int start_col, int end_line, int end_col, const std::string &lexeme)
     : type(type), start_line(start_line), start_col(start_col), end_line(end_line), end_col(end_col), lexeme(lexeme) {}
 
+//===----------------------------------------------------------------------===//
+//                             SymbolTable Class Implementation
+//===----------------------------------------------------------------------===//
+
+SymbolTable::SymbolTable()
+{
+    names_.emplace_back(); // reserve id 0 for NO_SYMBOL
+}
+
+SymbolTable::SymbolTable(const SymbolTable &other)
+    : names_(other.names_)
+{
+    index_.reserve(names_.size());
+    for (size_t i = 1; i < names_.size(); ++i)
+    {
+        index_.emplace(std::string_view(names_[i]), static_cast<Symbol>(i));
+    }
+}
+
+SymbolTable &SymbolTable::operator=(const SymbolTable &other)
+{
+    if (this != &other)
+    {
+        *this = SymbolTable(other);
+    }
+    return *this;
+}
+
+Symbol SymbolTable::intern(std::string_view name)
+{
+    if (auto it = index_.find(name); it != index_.end())
+    {
+        return it->second;
+    }
+
+    Symbol symbol = static_cast<Symbol>(names_.size());
+    const std::string &stored = names_.emplace_back(name);
+    index_.emplace(std::string_view(stored), symbol);
+    return symbol;
+}
+
+Symbol SymbolTable::lookup(std::string_view name) const
+{
+    auto it = index_.find(name);
+    return it != index_.end() ? it->second : NO_SYMBOL;
+}
+
+std::string_view SymbolTable::name(Symbol symbol) const
+{
+    MO_ASSERT(symbol < names_.size(), "Invalid symbol %u", symbol);
+    return names_[symbol];
+}
+
 //===----------------------------------------------------------------------===//
 //                             Lexer Class Implementation
 //===----------------------------------------------------------------------===//
 
-Lexer::Lexer(const std::string &input) : input(input), pos(0), current_line(1), current_col(1) {}
+Lexer::Lexer(const std::string &input)
+    : owned_input(std::make_unique<std::string>(input)), input(*owned_input), symbols(nullptr),
+      pos(0), current_line(1), current_col(1) {}
+
+Lexer::Lexer(std::string_view source, SymbolTable *symbols)
+    : input(source), symbols(symbols), pos(0), current_line(1), current_col(1) {}
+
+Lexer::Lexer(Lexer &&other) noexcept : owned_input(std::move(other.owned_input)), input(other.input),
+                                       symbols(other.symbols), pos(other.pos), current_line(other.current_line),
+                                       current_col(other.current_col), errors(std::move(other.errors))
+{
+}
 
-Lexer::Lexer(Lexer &&other) noexcept : input(std::move(other.input)),
-                                       pos(other.pos), current_line(other.current_line), current_col(other.current_col)
+Lexer Lexer::borrowed(std::string_view source, SymbolTable *symbols)
 {
+    return Lexer(source, symbols);
 }
 
 Token Lexer::parse_complex_operators()
@@ -365,6 +586,18 @@ Token Lexer::next_token()
 {
     skip_whitespace_and_comments();
 
+    size_t start_pos = pos;
+    Token token = scan_token();
+    token.text = input.substr(start_pos, pos - start_pos);
+    if (symbols && token.type == TokenType::Identifier)
+    {
+        token.symbol = symbols->intern(token.text);
+    }
+    return token;
+}
+
+Token Lexer::scan_token()
+{
     if (pos >= input.size())
     {
         return Token(TokenType::Eof, current_line, current_col, current_line, current_col, "");
@@ -501,29 +734,46 @@ char Lexer::peek(size_t offset) const
     return input[pos + offset];
 }
 
+void Lexer::skip_to(size_t new_pos)
+{
+    // Resolve line/column for a whole skipped span at once instead of per byte
+    new_pos = std::min(new_pos, input.size());
+    if (new_pos <= pos)
+        return;
+    size_t newlines = count_newlines(input, pos, new_pos);
+    if (newlines == 0)
+    {
+        current_col += static_cast<int>(new_pos - pos);
+    }
+    else
+    {
+        size_t last_newline = new_pos - 1;
+        while (input[last_newline] != '\n')
+            --last_newline;
+        current_line += static_cast<int>(newlines);
+        current_col = static_cast<int>(new_pos - last_newline);
+    }
+    pos = new_pos;
+}
+
 void Lexer::skip_whitespace_and_comments()
 {
     while (pos < input.size())
     {
-        char c = input[pos];
-        if (isspace(c))
+        size_t next = scan_whitespace(input, pos);
+        if (next != pos)
         {
-            advance();
+            skip_to(next);
+            continue;
         }
-        else if (c == '/')
+
+        if (input[pos] == '/' && peek(1) == '/')
         {
-            if (peek(1) == '/')
-            {
-                skip_line_comment();
-            }
-            else if (peek(1) == '*')
-            {
-                skip_block_comment();
-            }
-            else
-            {
-                break;
-            }
+            skip_line_comment();
+        }
+        else if (input[pos] == '/' && peek(1) == '*')
+        {
+            skip_block_comment();
         }
         else
         {
@@ -534,30 +784,30 @@ void Lexer::skip_whitespace_and_comments()
 
 void Lexer::skip_line_comment()
 {
-    while (pos < input.size() && input[pos] != '\n')
-    {
-        advance();
-    }
-    if (pos < input.size())
-        advance(); // Skip the newline
+    size_t newline = input.find('\n', pos);
+    skip_to(newline == std::string_view::npos ? input.size() : newline + 1); // including the newline
 }
 
 void Lexer::skip_block_comment()
 {
     int start_line = current_line;
     int start_col = current_col;
-    advance(); // Skip '/'
-    advance(); // Skip '*'
-    while (pos < input.size())
+    size_t search = pos + 2; // Skip '/*'
+    while (true)
     {
-        if (input[pos] == '*' && peek(1) == '/')
+        size_t star = input.find('*', search);
+        if (star == std::string_view::npos || star + 1 >= input.size())
         {
-            advance(); // Skip '*'
-            advance(); // Skip '/'
+            break;
+        }
+        if (input[star + 1] == '/')
+        {
+            skip_to(star + 2); // Skip '*/'
             return;
         }
-        advance();
+        search = star + 1;
     }
+    skip_to(input.size());
     errors.push_back({"Unclosed block comment", start_line, start_col});
 }
 
@@ -565,47 +815,45 @@ Token Lexer::parse_number()
 {
     int start_line = current_line;
     int start_col = current_col;
-    std::string numStr;
+    size_t start_pos = pos;
     bool isFloat = false;
 
+    // The literal is sliced out of the source once it is complete instead of being built byte by byte
+    auto num_str = [&]()
+    { return std::string(input.substr(start_pos, pos - start_pos)); };
+
     if (peek() == '0' && (peek(1) == 'x' || peek(1) == 'b'))
     {
-        int start_line = current_line;
-        int start_col = current_col;
-
-        numStr += input[pos];
+        char radix = peek(1);
         advance();
-        numStr += input[pos];
         advance();
 
-        if (numStr.back() == 'x')
+        if (radix == 'x')
         {
             bool has_digits = false;
             while (pos < input.size() && isxdigit(input[pos]))
             {
                 has_digits = true;
-                numStr += input[pos];
                 advance();
             }
             if (!has_digits)
             {
                 errors.push_back({"Invalid hexadecimal literal: no digits after 0x", start_line, start_col});
-                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, numStr);
+                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, num_str());
             }
         }
-        else if (numStr.back() == 'b')
+        else
         {
             bool has_digits = false;
             while (pos < input.size() && (input[pos] == '0' || input[pos] == '1'))
             {
                 has_digits = true;
-                numStr += input[pos];
                 advance();
             }
             if (!has_digits)
             {
                 errors.push_back({"Invalid binary literal: no digits after 0b", start_line, start_col});
-                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, numStr);
+                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, num_str());
             }
         }
     }
@@ -613,23 +861,20 @@ Token Lexer::parse_number()
     {
         while (pos < input.size() && isdigit(input[pos]))
         {
-            numStr += input[pos];
             advance();
         }
 
         if (pos < input.size() && input[pos] == '.')
         {
             isFloat = true;
-            numStr += input[pos];
             advance();
             if (pos >= input.size() || !isdigit(input[pos]))
             {
                 errors.push_back({"Invalid float literal: missing fractional part", start_line, start_col});
-                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, numStr);
+                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, num_str());
             }
             while (pos < input.size() && isdigit(input[pos]))
             {
-                numStr += input[pos];
                 advance();
             }
         }
@@ -637,21 +882,18 @@ Token Lexer::parse_number()
         if (pos < input.size() && (input[pos] == 'e' || input[pos] == 'E'))
         {
             isFloat = true;
-            numStr += input[pos];
             advance();
             if (pos < input.size() && (input[pos] == '+' || input[pos] == '-'))
             {
-                numStr += input[pos];
                 advance();
             }
             if (pos >= input.size() || !isdigit(input[pos]))
             {
                 errors.push_back({"Invalid exponent in float literal: missing exponent", start_line, start_col});
-                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, numStr);
+                return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, num_str());
             }
             while (pos < input.size() && isdigit(input[pos]))
             {
-                numStr += input[pos];
                 advance();
             }
         }
@@ -661,21 +903,20 @@ Token Lexer::parse_number()
             errors.push_back({"Invalid decimal literal: invalid suffix", start_line, start_col});
             while (pos < input.size() && isalpha(input[pos]))
             {
-                numStr += input[pos];
                 advance();
             }
-            return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, numStr);
+            return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, num_str());
         }
     }
 
-    if (numStr.empty())
+    if (pos == start_pos)
     {
         errors.push_back({"Empty number literal", start_line, start_col});
         return Token(TokenType::Invalid, start_line, start_col, current_line, current_col - 1, "");
     }
 
     TokenType type = isFloat ? TokenType::FloatLiteral : TokenType::IntegerLiteral;
-    return Token(type, start_line, start_col, current_line, current_col - 1, numStr);
+    return Token(type, start_line, start_col, current_line, current_col - 1, num_str());
 }
 
 Token Lexer::parse_string()
@@ -684,49 +925,51 @@ Token Lexer::parse_string()
     int start_col = current_col;
     advance(); // Skip opening "
     std::string str;
-    bool escape = false;
 
     while (pos < input.size())
     {
-        char c = input[pos];
-        if (escape)
+        // Copy the run up to the next quote or backslash in one go
+        size_t special = scan_string_body(input, pos);
+        str.append(input.substr(pos, special - pos));
+        skip_to(special);
+        if (pos >= input.size())
         {
-            switch (c)
-            {
-            case 'n':
-                str += '\n';
-                break;
-            case 't':
-                str += '\t';
-                break;
-            case 'r':
-                str += '\r';
-                break;
-            case '"':
-                str += '"';
-                break;
-            case '\\':
-                str += '\\';
-                break;
-            default:
-                str += '\\';
-                str += c;
-                break;
-            }
-            escape = false;
-        }
-        else if (c == '\\')
-        {
-            escape = true;
+            break;
         }
-        else if (c == '"')
+
+        if (input[pos] == '"')
         {
             advance(); // end "
             return Token(TokenType::StringLiteral, start_line, start_col, current_line, current_col - 1, str);
         }
-        else
+
+        advance(); // Skip backslash
+        if (pos >= input.size())
         {
+            break;
+        }
+        char c = input[pos];
+        switch (c)
+        {
+        case 'n':
+            str += '\n';
+            break;
+        case 't':
+            str += '\t';
+            break;
+        case 'r':
+            str += '\r';
+            break;
+        case '"':
+            str += '"';
+            break;
+        case '\\':
+            str += '\\';
+            break;
+        default:
+            str += '\\';
             str += c;
+            break;
         }
         advance();
     }
@@ -739,7 +982,6 @@ Token Lexer::parse_identifier_or_keyword()
 {
     int start_line = current_line;
     int start_col = current_col;
-    std::string ident;
 
     if (pos >= input.size())
     {
@@ -774,8 +1016,6 @@ Token Lexer::parse_identifier_or_keyword()
         return Token(TokenType::Invalid, start_line, start_col, current_line, current_col, "");
     }
 
-    // add the first character to the identifier
-    ident += input.substr(initial_pos, bytes);
     pos += bytes;
     current_col++; // every unicode character takes 1 column
 
@@ -806,7 +1046,6 @@ Token Lexer::parse_identifier_or_keyword()
 
         if (valid_continue)
         {
-            ident += input.substr(current_pos, next_bytes);
             pos += next_bytes;
             current_col++;
         }
@@ -817,18 +1056,16 @@ Token Lexer::parse_identifier_or_keyword()
         }
     }
 
-    if (ident == "true")
+    std::string_view ident = input.substr(initial_pos, pos - initial_pos);
+    const KeywordInfo *keyword = lookup_keyword(ident);
+    TokenType type = keyword ? keyword->type : TokenType::Identifier;
+    Token token(type, start_line, start_col, current_line, current_col - 1, std::string(ident));
+    if (keyword)
     {
-        return Token(TokenType::BooleanLiteral, start_line, start_col, current_line, current_col - 1, "true");
+        token.bit_width = keyword->bit_width;
+        token.is_unsigned = keyword->is_unsigned;
     }
-    else if (ident == "false")
-    {
-        return Token(TokenType::BooleanLiteral, start_line, start_col, current_line, current_col - 1, "false");
-    }
-
-    auto it = keywords.find(ident);
-    TokenType type = (it != keywords.end()) ? it->second : TokenType::Identifier;
-    return Token(type, start_line, start_col, current_line, current_col - 1, ident);
+    return token;
 }
 
 Token Lexer::parse_double_colon_or_colon()
@@ -930,10 +1167,30 @@ Token Lexer::parse_or()
     return Token(TokenType::Pipe, start_line, start_col, current_line, current_col - 1, "|");
 }
 
-Token Lexer::parse_single_char(TokenType type, const std::string &lexeme)
+Token Lexer::parse_single_char(TokenType type, const char *lexeme)
 {
     int start_line = current_line;
     int start_col = current_col;
     advance();
     return Token(type, start_line, start_col, current_line, current_col - 1, lexeme);
 }
+
+//===----------------------------------------------------------------------===//
+//                             TokenStream Class Implementation
+//===----------------------------------------------------------------------===//
+
+// Rough bytes-per-token ratio of typical sources, used to size the buffer up front
+static constexpr size_t ESTIMATED_BYTES_PER_TOKEN = 4;
+
+TokenStream::TokenStream(Lexer &&lexer) : lexer_(std::move(lexer)), cursor_(0)
+{
+    PhaseTimer timer("lex");
+    tokens_.reserve(lexer_.input_size() / ESTIMATED_BYTES_PER_TOKEN + 1);
+    while (true)
+    {
+        tokens_.push_back(lexer_.next_token());
+        if (tokens_.back().type == TokenType::Eof)
+            break;
+    }
+    timer.count("tokens", tokens_.size());
+}
@@ -2,7 +2,13 @@
 
 #pragma once
 
+#include <cstdint>
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <cctype>
@@ -103,34 +109,116 @@ enum class TokenType
     Eof,
 };
 
-const std::unordered_map<std::string, TokenType> keywords = {
-    {"let", TokenType::Let},
-    {"struct", TokenType::Struct},
-    {"impl", TokenType::Impl},
-    {"fn", TokenType::Fn},
-    {"static", TokenType::Static},
-    {"this", TokenType::This},
-    {"type", TokenType::Type},
-    {"return", TokenType::Return},
-    {"int", TokenType::Int},
-    {"i8", TokenType::Int},
-    {"i16", TokenType::Int},
-    {"i32", TokenType::Int},
-    {"i64", TokenType::Int},
-    {"u8", TokenType::Int},
-    {"u16", TokenType::Int},
-    {"u32", TokenType::Int},
-    {"u64", TokenType::Int},
-    {"float", TokenType::Float},
-    {"f32", TokenType::Float},
-    {"f64", TokenType::Float},
-    {"const", TokenType::Const},
-    {"sizeof", TokenType::Sizeof},
-    {"cast", TokenType::Cast},
-    {"if", TokenType::If},
-    {"else", TokenType::Else},
-    {"while", TokenType::While},
-    {"for", TokenType::For},
+struct KeywordInfo
+{
+    std::string_view spelling;
+    TokenType type;
+    uint8_t bit_width; // for builtin numeric types, 0 otherwise
+    bool is_unsigned;
+};
+
+// The single keyword list; KEYWORD_TABLE below is generated from it at compile time.
+constexpr KeywordInfo KEYWORDS[] = {
+    {"let", TokenType::Let, 0, false},
+    {"struct", TokenType::Struct, 0, false},
+    {"impl", TokenType::Impl, 0, false},
+    {"fn", TokenType::Fn, 0, false},
+    {"static", TokenType::Static, 0, false},
+    {"this", TokenType::This, 0, false},
+    {"type", TokenType::Type, 0, false},
+    {"return", TokenType::Return, 0, false},
+    {"int", TokenType::Int, 32, false},
+    {"i8", TokenType::Int, 8, false},
+    {"i16", TokenType::Int, 16, false},
+    {"i32", TokenType::Int, 32, false},
+    {"i64", TokenType::Int, 64, false},
+    {"u8", TokenType::Int, 8, true},
+    {"u16", TokenType::Int, 16, true},
+    {"u32", TokenType::Int, 32, true},
+    {"u64", TokenType::Int, 64, true},
+    {"float", TokenType::Float, 64, false},
+    {"f32", TokenType::Float, 32, false},
+    {"f64", TokenType::Float, 64, false},
+    {"const", TokenType::Const, 0, false},
+    {"sizeof", TokenType::Sizeof, 0, false},
+    {"cast", TokenType::Cast, 0, false},
+    {"if", TokenType::If, 0, false},
+    {"else", TokenType::Else, 0, false},
+    {"while", TokenType::While, 0, false},
+    {"for", TokenType::For, 0, false},
+    {"true", TokenType::BooleanLiteral, 0, false},
+    {"false", TokenType::BooleanLiteral, 0, false},
+};
+
+constexpr size_t KEYWORD_TABLE_SIZE = 64;
+constexpr size_t KEYWORD_MIN_LENGTH = 2;
+constexpr size_t KEYWORD_MAX_LENGTH = 6;
+
+// Perfect hash over KEYWORDS: the constants were picked so that no two keywords
+// collide, which is verified by the static_assert below. Requires length >= 2.
+constexpr size_t keyword_hash(std::string_view s)
+{
+    return (s.size() * 28 + static_cast<unsigned char>(s[0]) * 2 + static_cast<unsigned char>(s[1]) +
+            static_cast<unsigned char>(s.back()) * 23) %
+           KEYWORD_TABLE_SIZE;
+}
+
+struct KeywordTable
+{
+    // Index + 1 into KEYWORDS, 0 for an empty slot
+    uint8_t slots[KEYWORD_TABLE_SIZE] = {};
+    bool perfect = true;
+
+    constexpr KeywordTable()
+    {
+        for (size_t i = 0; i < std::size(KEYWORDS); ++i)
+        {
+            size_t h = keyword_hash(KEYWORDS[i].spelling);
+            if (slots[h] != 0)
+                perfect = false;
+            slots[h] = static_cast<uint8_t>(i + 1);
+        }
+    }
+};
+
+constexpr KeywordTable KEYWORD_TABLE{};
+static_assert(KEYWORD_TABLE.perfect, "keyword_hash has collisions, pick new constants");
+
+// Returns the keyword spelled by `ident`, or nullptr for a plain identifier.
+constexpr const KeywordInfo *lookup_keyword(std::string_view ident)
+{
+    if (ident.size() < KEYWORD_MIN_LENGTH || ident.size() > KEYWORD_MAX_LENGTH)
+        return nullptr;
+    uint8_t slot = KEYWORD_TABLE.slots[keyword_hash(ident)];
+    if (slot == 0 || KEYWORDS[slot - 1].spelling != ident)
+        return nullptr;
+    return &KEYWORDS[slot - 1];
+}
+
+// Interned identifier id. Equal names map to equal ids within one SymbolTable,
+// so later phases can compare names without touching the characters.
+using Symbol = uint32_t;
+constexpr Symbol NO_SYMBOL = 0;
+
+class SymbolTable
+{
+public:
+    SymbolTable();
+    // Copies keep the same ids; the index is rebuilt to point into the copy's own names
+    SymbolTable(const SymbolTable &other);
+    SymbolTable &operator=(const SymbolTable &other);
+    SymbolTable(SymbolTable &&) = default;
+    SymbolTable &operator=(SymbolTable &&) = default;
+
+    Symbol intern(std::string_view name);
+    Symbol lookup(std::string_view name) const;
+    std::string_view name(Symbol symbol) const;
+    size_t size() const { return names_.size() - 1; }
+
+private:
+    // deque keeps the stored strings at stable addresses, so the index can key on views into them
+    std::deque<std::string> names_;
+    std::unordered_map<std::string_view, Symbol> index_;
 };
 
 struct Token
@@ -142,6 +230,13 @@ struct Token
     int end_line;
     int end_col;
     std::string lexeme;
+    // Raw source span of the token, valid as long as the lexer's input buffer is alive
+    std::string_view text;
+    // Interned id for identifiers when the lexer has a symbol table, NO_SYMBOL otherwise
+    Symbol symbol = NO_SYMBOL;
+    // Bit width and signedness of builtin numeric type keywords (`i8`...`u64`, `f32`, `f64`)
+    uint8_t bit_width = 0;
+    bool is_unsigned = false;
     Token();
     Token(TokenType type, int start_line, int start_col, int end_line, int end_col, const std::string &lexeme);
 };
@@ -151,11 +246,26 @@ class Lexer
 public:
     Lexer(const std::string &input);
     Lexer(Lexer &&other) noexcept;
+
+    // Lex a caller-owned buffer (e.g. an mmapped file) without copying it.
+    // The buffer must outlive the lexer and every token's `text`.
+    static Lexer borrowed(std::string_view source, SymbolTable *symbols = nullptr);
+
     Token next_token();
     const std::vector<LexerError> &get_errors() const { return errors; }
+    size_t input_size() const { return input.size(); }
+
+    void set_symbol_table(SymbolTable *table) { symbols = table; }
+    SymbolTable *symbol_table() const { return symbols; }
 
 private:
-    std::string input;
+    Lexer(std::string_view source, SymbolTable *symbols);
+
+    // Heap-allocated so `input` and every token's `text` stay valid when the
+    // lexer (or the TokenStream holding it) is moved; null for borrowed input
+    std::unique_ptr<std::string> owned_input;
+    std::string_view input;
+    SymbolTable *symbols;
     size_t pos;
     int current_line;
     int current_col;
@@ -165,7 +275,9 @@ private:
     std::pair<char32_t, int> decode_utf8();
 #endif // MO_UNICODE
 
+    Token scan_token();
     void advance();
+    void skip_to(size_t new_pos);
     char peek(size_t offset = 0) const;
     void skip_whitespace_and_comments();
     void skip_line_comment();
@@ -183,7 +295,39 @@ private:
     Token parse_ge_or_gt();
     Token parse_and();
     Token parse_or();
-    Token parse_single_char(TokenType type, const std::string &lexeme);
+    Token parse_single_char(TokenType type, const char *lexeme);
+};
+
+// Lexes the whole input into one contiguous buffer ahead of the parser, so
+// consumers advance by index, never copy tokens and get arbitrary lookahead.
+// The buffer is complete after construction, so references stay valid for
+// the lifetime of the stream.
+class TokenStream
+{
+public:
+    explicit TokenStream(Lexer &&lexer);
+
+    const Token &current() const { return tokens_[cursor_]; }
+    // Token `offset` positions after the current one, clamped to the trailing Eof
+    const Token &peek(size_t offset = 1) const { return tokens_[std::min(cursor_ + offset, tokens_.size() - 1)]; }
+    // Previously consumed token, or a default (Invalid) token at the beginning
+    const Token &previous() const { return cursor_ > 0 ? tokens_[cursor_ - 1] : empty_; }
+    void advance()
+    {
+        if (cursor_ + 1 < tokens_.size())
+            ++cursor_;
+    }
+
+    size_t position() const { return cursor_; }
+    size_t size() const { return tokens_.size(); }
+    const std::vector<Token> &tokens() const { return tokens_; }
+    const Lexer &lexer() const { return lexer_; }
+
+private:
+    Lexer lexer_;
+    std::vector<Token> tokens_; // always ends with exactly one Eof token
+    size_t cursor_;
+    Token empty_;
 };
 
 std::string token_to_string(const Token &token);
@@ -0,0 +1,46 @@
+#include "live_interval_union.h"
+#include "mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+// Live Interval Union Implementation
+//===----------------------------------------------------------------------===//
+
+void LiveIntervalUnion::insert(LiveRange *lr)
+{
+    for (const auto &interval : lr->intervals())
+    {
+        MO_ASSERT(!find_conflict(interval.start(), interval.end()), "Overlapping segment for vreg %u", lr->vreg());
+        segments_.emplace(interval.start(), Segment{interval.end(), lr});
+    }
+}
+
+void LiveIntervalUnion::remove(const LiveRange *lr)
+{
+    for (const auto &interval : lr->intervals())
+    {
+        auto it = segments_.find(interval.start());
+        if (it != segments_.end() && it->second.range == lr)
+            segments_.erase(it);
+    }
+}
+
+LiveRange *LiveIntervalUnion::find_conflict(const LiveRange &lr) const
+{
+    for (const auto &interval : lr.intervals())
+    {
+        if (LiveRange *conflict = find_conflict(interval.start(), interval.end()))
+            return conflict;
+    }
+    return nullptr;
+}
+
+LiveRange *LiveIntervalUnion::find_conflict(unsigned start, unsigned end) const
+{
+    // Segments are disjoint, so only the last one starting before `end` can
+    // reach into [start, end)
+    auto it = segments_.lower_bound(end);
+    if (it == segments_.begin())
+        return nullptr;
+    --it;
+    return it->second.end > start ? it->second.range : nullptr;
+}
@@ -0,0 +1,39 @@
+// live_interval_union.h - Live ranges assigned to one physical register
+#pragma once
+
+#include <map>
+
+#include "lra.h"
+
+//===----------------------------------------------------------------------===//
+//                           Live Interval Union
+//===----------------------------------------------------------------------===//
+//
+// The intervals of every range occupying one physical register, keyed by
+// start. Ranges in a union never overlap, so the segments are disjoint and
+// a query only has to look at the segment before each interval's end.
+class LiveIntervalUnion
+{
+public:
+    // `lr` must not conflict with anything already in the union
+    void insert(LiveRange *lr);
+    // Drops the segments that came from `lr`
+    void remove(const LiveRange *lr);
+
+    // A range in the union that overlaps `lr`, or nullptr
+    LiveRange *find_conflict(const LiveRange &lr) const;
+
+    bool empty() const { return segments_.empty(); }
+    size_t size() const { return segments_.size(); }
+
+private:
+    LiveRange *find_conflict(unsigned start, unsigned end) const;
+
+    struct Segment
+    {
+        unsigned end;
+        LiveRange *range;
+    };
+
+    std::map<unsigned, Segment> segments_;
+};
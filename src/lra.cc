@@ -1,5 +1,6 @@
 #include "lra.h"
 #include "machine.h"
+#include "phase_stats.h"
 #include <algorithm>
 #include <stdexcept>
 #include <limits>
@@ -61,6 +62,17 @@ void LiveRange::add_interval(unsigned start, unsigned end)
     merge_intervals(); // Ensure intervals are ordered and non-overlapping
 }
 
+void LiveRange::assign_intervals(const std::vector<std::pair<unsigned, unsigned>> &bounds)
+{
+    intervals_.clear();
+    intervals_.reserve(bounds.size());
+    for (auto [start, end] : bounds)
+    {
+        intervals_.emplace_back(start, end, this);
+    }
+    merge_intervals();
+}
+
 bool LiveRange::live_at(unsigned pos) const
 {
     // Binary search optimization: find the first interval with start > pos
@@ -80,19 +92,54 @@ bool LiveRange::live_at(unsigned pos) const
 
 bool LiveRange::interferes_with(const LiveRange &other) const
 {
-    const auto &a = intervals_;
-    const auto &b = other.intervals_;
-    size_t i = 0, j = 0;
+    const bool shorter = intervals_.size() <= other.intervals_.size();
+    const auto &a = shorter ? intervals_ : other.intervals_;
+    const auto &b = shorter ? other.intervals_ : intervals_;
 
-    while (i < a.size() && j < b.size())
+    auto it = b.begin();
+    for (const auto &interval : a)
     {
-        if (a[i].overlaps(b[j]))
+        // 第一个右端在 interval 左端之后的区间；之后的查找从这里继续
+        it = std::upper_bound(it, b.end(), interval.start(),
+                              [](unsigned pos, const LiveInterval &x) { return pos < x.end(); });
+        if (it == b.end())
+            return false;
+        if (it->start() < interval.end())
             return true;
-        a[i].start() < b[j].start() ? ++i : ++j;
     }
     return false;
 }
 
+void LiveRange::add_occurrence(unsigned pos, MachineInst *inst, bool is_def)
+{
+    LiveOccurrence occurrence{pos, is_def, inst};
+    // 按位置顺序扫描函数时总是追加在末尾
+    if (occurrences_.empty() || occurrences_.back() < occurrence)
+    {
+        occurrences_.push_back(occurrence);
+        return;
+    }
+    auto it = std::lower_bound(occurrences_.begin(), occurrences_.end(), occurrence);
+    if (it == occurrences_.end() || !(*it == occurrence))
+        occurrences_.insert(it, occurrence);
+}
+
+void LiveRange::remove_occurrences(unsigned pos, const MachineInst *inst)
+{
+    auto first = std::lower_bound(occurrences_.begin(), occurrences_.end(), LiveOccurrence{pos, false, nullptr});
+    auto last = first;
+    while (last != occurrences_.end() && last->pos == pos)
+        ++last;
+    occurrences_.erase(std::remove_if(first, last, [&](const LiveOccurrence &o) { return o.inst == inst; }), last);
+}
+
+std::span<const LiveOccurrence> LiveRange::occurrences_in(const LiveInterval &interval) const
+{
+    auto first = std::lower_bound(occurrences_.begin(), occurrences_.end(), LiveOccurrence{interval.start(), false, nullptr});
+    auto last = std::lower_bound(first, occurrences_.end(), LiveOccurrence{interval.end(), false, nullptr});
+    return {first, last};
+}
+
 std::string LiveRange::to_string() const
 {
     std::ostringstream oss;
@@ -151,21 +198,15 @@ void LiveRange::merge_intervals()
     }
     intervals_.swap(merged);
 }
-std::vector<std::unique_ptr<LiveRange>> LiveRange::atomized_ranges(MachineFunction &mf)
+std::vector<std::unique_ptr<LiveRange>> LiveRange::atomized_ranges() const
 {
-
+    // 每个区间一份，寄存器不变：区间之间的数据流由分配器自己处理
     std::vector<std::unique_ptr<LiveRange>> ret;
     ret.reserve(intervals_.size());
-
-    bool is_first_interval = true;
-    for (LiveInterval interval_ : intervals_)
+    for (const LiveInterval &interval : intervals_)
     {
-        LiveInterval copied(interval_);
-
-        // 区间分裂之后，要创建新的变量，这样能确保以 Interval 为单位的分配器能够正确分配
-
-        auto new_vreg = is_first_interval ? vreg_ : mf.clone_vreg(vreg_);
-        std::unique_ptr<LiveRange> new_range(new LiveRange(new_vreg));
+        std::unique_ptr<LiveRange> new_range(new LiveRange(vreg_));
+        LiveInterval copied(interval);
         copied.parent_ = new_range.get();
         new_range->intervals_.push_back(copied);
         new_range->preg_ = preg_;
@@ -173,27 +214,12 @@ std::vector<std::unique_ptr<LiveRange>> LiveRange::atomized_ranges(MachineFuncti
         new_range->is_spilled_ = is_spilled_;
         new_range->spill_slot_ = spill_slot_;
 
-        new_range->def_insts_ = copied.def_insts();
-        new_range->use_insts_ = copied.use_insts();
-
-        if (!is_first_interval) // 替换新区间对变量的使用
-        {
-            MO_DEBUG("New vreg cloned: %u -> %u", vreg_, new_vreg);
-            for (auto &bb : mf.basic_blocks())
-            {
-                for (auto &it : bb->instructions())
-                {
-                    it->replace_reg(vreg_, new_vreg);
-                }
-            }
-        }
+        auto inside = occurrences_in(copied);
+        new_range->occurrences_.assign(inside.begin(), inside.end());
 
         assert(new_range->is_atomized() && "New range is not atomized.");
         ret.emplace_back(std::move(new_range));
-
-        is_first_interval = false;
     }
-
     return ret;
 }
 
@@ -202,9 +228,19 @@ std::vector<std::unique_ptr<LiveRange>> LiveRange::atomized_ranges(MachineFuncti
 //===----------------------------------------------------------------------===//
 void LiveRangeAnalyzer::compute() const
 {
-    if (!live_ranges_dirty_)
-        return;
+    if (live_ranges_dirty_)
+    {
+        compute_all();
+    }
+    else if (!touched_blocks_.empty())
+    {
+        apply_pending_edits();
+    }
+}
 
+void LiveRangeAnalyzer::compute_all() const
+{
+    PhaseTimer timer("liveness");
     MO_DEBUG("Computing live ranges for function");
     mf_.ensure_global_positions_computed();
     compute_data_flow();
@@ -222,17 +258,21 @@ void LiveRangeAnalyzer::compute() const
         // }
 
         MO_DEBUG("处理指令级活跃区间");
-        for (auto &inst : bb->instructions())
+        // 位置之间留有空隙，区间的右端取下一条指令的位置，相邻指令的区间才能首尾相接
+        const auto &insts = bb->instructions();
+        for (size_t i = 0; i < insts.size(); ++i)
         {
+            auto &inst = insts[i];
             size_t pos = mf_.get_global_instr_pos(inst.get());
+            size_t next = i + 1 < insts.size() ? mf_.get_global_instr_pos(insts[i + 1].get()) : bb->global_end();
             MO_DEBUG("current pos: %zu", pos);
             MO_DEBUG("处理定义");
             // 如果当前程序点定义了一个变量，那么从这次定义直到最后一次（本定义）使用都活跃。
             for (auto &reg : inst->defs())
             {
                 LiveRange *lr = live_range_of(reg);
-                lr->add_interval(pos, pos + 1);
-                lr->add_def_inst(pos, inst.get());
+                lr->add_interval(pos, next);
+                lr->add_occurrence(pos, inst.get(), true);
             }
 
             MO_DEBUG("处理使用");
@@ -246,8 +286,8 @@ void LiveRangeAnalyzer::compute() const
             {
                 LiveRange *lr = live_range_of(reg);
                 size_t in_block_last_def = find_last_def_pos(bb.get(), reg, pos);
-                lr->add_interval(in_block_last_def, std::max(pos, in_block_last_def) + 1);
-                lr->add_use_inst(pos, inst.get());
+                lr->add_interval(in_block_last_def, next);
+                lr->add_occurrence(pos, inst.get(), false);
             }
         }
     }
@@ -255,7 +295,9 @@ void LiveRangeAnalyzer::compute() const
     MO_DEBUG("处理跨块活跃区间");
     for (auto &bb : mf_.basic_blocks())
     {
-        auto &info = block_info_[bb.get()];
+        if (bb->instructions().empty())
+            continue; // 空块里没有位置可供活跃
+        auto &info = block_info_[block_index_.at(bb.get())];
         // for (auto reg : info.in)
         // {
         //     // 如果一个变量在入口活跃，则从块头到首次定义都活跃
@@ -264,13 +306,14 @@ void LiveRangeAnalyzer::compute() const
         //     lr->add_interval(bb->global_start(), first_def_pos + 1);
         // }
 
-        for (auto reg : info.out)
+        info.out.for_each([&](size_t index)
         {
             // 如果一个变量在出口活跃，则从上次定义点到块尾都活跃
+            unsigned reg = index_reg_[index];
             LiveRange *lr = live_range_of(reg);
             size_t first_def_pos = find_last_def_pos(bb.get(), reg, -1);
             // auto reg_def_pos = first_def_pos != bb->global_end_inclusive() ? first_def_pos : bb->global_start();
-            lr->add_interval(first_def_pos, bb->global_end_inclusive() + 1);
+            lr->add_interval(first_def_pos, bb->global_end());
             // for (auto *succ : bb->successors())
             // {
             //     auto &succ_info = block_info_[succ];
@@ -292,10 +335,12 @@ void LiveRangeAnalyzer::compute() const
             //         }
             //     }
             // }
-        }
+        });
     }
 
+    clear_pending_edits();
     live_ranges_dirty_ = false;
+    timer.count("live_ranges", reg_live_ranges_.size());
     if (compute_metric_counter_)
     {
         *compute_metric_counter_ += 1;
@@ -315,79 +360,354 @@ LiveRange *LiveRangeAnalyzer::live_range_of(unsigned reg) const
     return reg_live_ranges_[reg].get();
 };
 
-std::vector<MachineBasicBlock *> compute_reverse_post_order(MachineBasicBlock *entry)
+namespace
 {
-    std::vector<MachineBasicBlock *> order;
-    std::unordered_set<MachineBasicBlock *> visited;
-    std::function<void(MachineBasicBlock *)> dfs = [&](MachineBasicBlock *bb)
+    // Post-order of the blocks reachable from `entry`, as indices into
+    // `succs`; iterative so long chains of blocks don't exhaust the stack
+    std::vector<unsigned> compute_post_order(const std::vector<std::vector<unsigned>> &succs, unsigned entry)
     {
-        if (visited.count(bb))
-            return;
-        visited.insert(bb);
-        for (auto *succ : bb->successors())
+        std::vector<unsigned> order;
+        std::vector<char> visited(succs.size());
+        std::vector<std::pair<unsigned, size_t>> stack{{entry, 0}};
+        visited[entry] = true;
+        while (!stack.empty())
         {
-            dfs(succ);
+            auto &[bb, next] = stack.back();
+            if (next < succs[bb].size())
+            {
+                unsigned succ = succs[bb][next++];
+                if (!visited[succ])
+                {
+                    visited[succ] = true;
+                    stack.emplace_back(succ, 0); // invalidates `bb` and `next`
+                }
+                continue;
+            }
+            order.push_back(bb);
+            stack.pop_back();
         }
-        order.push_back(bb);
-    };
-    dfs(entry);
-    return order;
+        return order;
+    }
+}
+
+void LiveRangeAnalyzer::number_registers() const
+{
+    reg_index_.clear();
+    index_reg_.clear();
+    block_index_.clear();
+    for (auto &bb : mf_.basic_blocks())
+    {
+        block_index_.emplace(bb.get(), static_cast<unsigned>(block_index_.size()));
+        for (auto &inst : bb->instructions())
+        {
+            for (auto &op : inst->operands())
+            {
+                if (op.is_reg() && reg_index_.try_emplace(op.reg(), index_reg_.size()).second)
+                    index_reg_.push_back(op.reg());
+            }
+        }
+    }
 }
 
-// 关键修正1: 正确的数据流方程
 void LiveRangeAnalyzer::compute_data_flow() const
 {
-    block_info_.clear();
+    number_registers();
+    const size_t num_blocks = mf_.basic_blocks().size();
+    const size_t num_regs = index_reg_.size();
+    block_info_.assign(num_blocks, {BitVector(num_regs), BitVector(num_regs), BitVector(num_regs), BitVector(num_regs)});
+    if (num_blocks == 0)
+        return;
 
-    // 初始化 USE/DEF 集合
+    std::vector<std::vector<unsigned>> succs(num_blocks), preds(num_blocks);
     for (auto &bb : mf_.basic_blocks())
     {
-        auto &info = block_info_[bb.get()];
-        compute_local_use_def(bb.get(), info.use, info.def);
+        const unsigned b = block_index_.at(bb.get());
+        compute_local_use_def(bb.get(), block_info_[b].use, block_info_[b].def);
+        for (auto *succ : bb->successors())
+        {
+            const unsigned s = block_index_.at(succ);
+            succs[b].push_back(s);
+            preds[s].push_back(b);
+        }
     }
 
-    // 获取逆后序序列（反向遍历）
-    std::vector<MachineBasicBlock *> rpo_order = compute_reverse_post_order(mf_.basic_blocks().front().get());
-
-    // 迭代直到收敛
-    bool changed;
-    unsigned iter = 0;
-    do
+    // Backward problem, so the worklist starts in post-order: most
+    // successors settle before their predecessors are visited. Blocks the
+    // entry can't reach go last so their sets are still filled in
+    std::vector<unsigned> order = compute_post_order(succs, 0);
+    std::vector<char> queued(num_blocks);
+    for (unsigned b : order)
+        queued[b] = true;
+    for (unsigned b = 0; b < num_blocks; ++b)
     {
-        changed = false;
-        for (auto *bb : rpo_order)
-        { // 按逆后序处理
-            auto &info = block_info_[bb];
+        if (!queued[b])
+        {
+            order.push_back(b);
+            queued[b] = true;
+        }
+    }
 
-            // 计算 OUT[B] = ∪ IN[S] (S 是 B 的后继)
-            std::unordered_set<unsigned> new_out;
-            for (auto *succ : bb->successors())
+    std::vector<unsigned> worklist(order.rbegin(), order.rend());
+    unsigned visits = 0;
+    while (!worklist.empty())
+    {
+        const unsigned b = worklist.back();
+        worklist.pop_back();
+        queued[b] = false;
+        ++visits;
+
+        // OUT[B] = ∪ IN[S], IN[B] = use[B] ∪ (OUT[B] - def[B])
+        BlockLiveness &info = block_info_[b];
+        for (unsigned s : succs[b])
+            info.out.union_with(block_info_[s].in);
+        if (!info.in.assign_transfer(info.use, info.out, info.def))
+            continue;
+        for (unsigned p : preds[b])
+        {
+            if (!queued[p])
             {
-                new_out.insert(block_info_[succ].in.begin(),
-                               block_info_[succ].in.end());
+                queued[p] = true;
+                worklist.push_back(p);
             }
+        }
+    }
+    MO_DEBUG("Data flow analysis finished after %u block visits", visits);
+}
 
-            // 计算 IN[B] = use[B] ∪ (OUT[B] - def[B])
-            auto new_in = info.use;
-            for (auto reg : new_out)
-            {
-                if (!info.def.count(reg))
-                {
-                    new_in.insert(reg);
-                }
-            }
+//===----------------------------------------------------------------------===//
+// Incremental Updates
+//===----------------------------------------------------------------------===//
+
+// 插入与删除只改变所涉寄存器的出现集合，并记下被改动的块和位置；真正的修补推迟到下一次查询，
+// 这样一连串编辑（比如插入一批 spill 代码）只付一次代价。位置一旦重排，记下的区间就都作废了
+void LiveRangeAnalyzer::instruction_inserted(MachineInst *mi)
+{
+    if (live_ranges_dirty_)
+        return;
+    const SlotIndexes &slots = mf_.slot_indexes();
+    if (!block_index_.count(mi->parent()) || !slots.is_valid() || slots.generation() != slot_generation_)
+    {
+        mark_dirty();
+        return;
+    }
+
+    const size_t pos = slots.index(mi);
+    touched_blocks_.insert(mi->parent());
+    edited_slots_.push_back(pos);
+    for (unsigned reg : mi->defs())
+    {
+        live_range_of(reg)->add_occurrence(pos, mi, true);
+        touched_regs_.insert(reg);
+    }
+    for (unsigned reg : mi->uses())
+    {
+        live_range_of(reg)->add_occurrence(pos, mi, false);
+        touched_regs_.insert(reg);
+    }
+}
 
-            // 检测变化
-            if (new_in != info.in || new_out != info.out)
+void LiveRangeAnalyzer::instruction_removed(MachineInst *mi)
+{
+    if (live_ranges_dirty_)
+        return;
+    const SlotIndexes &slots = mf_.slot_indexes();
+    if (!block_index_.count(mi->parent()) || !slots.is_valid() || slots.generation() != slot_generation_)
+    {
+        mark_dirty();
+        return;
+    }
+
+    const size_t pos = slots.index(mi);
+    touched_blocks_.insert(mi->parent());
+    edited_slots_.push_back(pos);
+    auto forget = [&](unsigned reg)
+    {
+        auto it = reg_live_ranges_.find(reg);
+        if (it != reg_live_ranges_.end())
+            it->second->remove_occurrences(pos, mi);
+        touched_regs_.insert(reg);
+    };
+    // defs()/uses() 还包括内存操作数的基址寄存器
+    for (unsigned reg : mi->defs())
+        forget(reg);
+    for (unsigned reg : mi->uses())
+        forget(reg);
+}
+
+// 原地改写不动位置，别的寄存器的区间也就不受影响，不必记下改动的位置
+void LiveRangeAnalyzer::registers_rewritten(MachineInst *mi, unsigned old_reg, unsigned new_reg)
+{
+    if (live_ranges_dirty_)
+        return;
+    const SlotIndexes &slots = mf_.slot_indexes();
+    if (!block_index_.count(mi->parent()) || !slots.is_valid() || slots.generation() != slot_generation_)
+    {
+        mark_dirty();
+        return;
+    }
+
+    const size_t pos = slots.index(mi);
+    touched_blocks_.insert(mi->parent());
+    const std::set<unsigned> defs = mi->defs();
+    const std::set<unsigned> uses = mi->uses();
+    auto refresh = [&](unsigned reg)
+    {
+        LiveRange *lr = live_range_of(reg);
+        lr->remove_occurrences(pos, mi);
+        if (defs.count(reg))
+            lr->add_occurrence(pos, mi, true);
+        if (uses.count(reg))
+            lr->add_occurrence(pos, mi, false);
+        touched_regs_.insert(reg);
+    };
+    refresh(old_reg);
+    refresh(new_reg);
+}
+
+void LiveRangeAnalyzer::clear_pending_edits() const
+{
+    slot_generation_ = mf_.slot_indexes().generation();
+    touched_blocks_.clear();
+    touched_regs_.clear();
+    edited_slots_.clear();
+}
+
+void LiveRangeAnalyzer::apply_pending_edits() const
+{
+    PhaseTimer timer("liveness.update");
+
+    // 位置重排过就只能整体重算。分配之后几乎每个寄存器都被改写过，也照样逐个修补，
+    // 每个寄存器只花扫一遍块的代价
+    mf_.ensure_global_positions_computed();
+    if (mf_.slot_indexes().generation() != slot_generation_)
+    {
+        MO_DEBUG("Edits can't be patched in, recomputing live ranges");
+        compute_all();
+        return;
+    }
+
+    // 给新出现的寄存器编号
+    for (unsigned reg : touched_regs_)
+    {
+        if (reg_index_.try_emplace(reg, index_reg_.size()).second)
+            index_reg_.push_back(reg);
+    }
+    for (auto &info : block_info_)
+    {
+        info.in.resize(index_reg_.size());
+        info.out.resize(index_reg_.size());
+        info.use.resize(index_reg_.size());
+        info.def.resize(index_reg_.size());
+    }
+    for (const MachineBasicBlock *bb : touched_blocks_)
+    {
+        BlockLiveness &info = block_info_[block_index_.at(bb)];
+        compute_local_use_def(bb, info.use, info.def);
+    }
+    // 其它寄存器在所有块里的 use/def 都没变，活跃集合也就不变
+    for (unsigned reg : touched_regs_)
+    {
+        compute_reg_liveness(reg_index_.at(reg));
+    }
+
+    std::sort(edited_slots_.begin(), edited_slots_.end());
+    std::vector<unsigned> rebuild(touched_regs_.begin(), touched_regs_.end());
+    for (auto &[reg, lr] : reg_live_ranges_)
+    {
+        if (!touched_regs_.count(reg) && is_stale(*lr))
+            rebuild.push_back(reg);
+    }
+    for (unsigned reg : rebuild)
+    {
+        rebuild_live_range(reg);
+    }
+
+    MO_DEBUG("Patched %zu live ranges after edits in %zu blocks", rebuild.size(), touched_blocks_.size());
+    timer.count("patched_ranges", rebuild.size());
+    clear_pending_edits();
+}
+
+// 单个寄存器的活跃性：从向上暴露的使用出发沿前驱回溯，遇到定义它的块就停
+void LiveRangeAnalyzer::compute_reg_liveness(unsigned index) const
+{
+    std::vector<const MachineBasicBlock *> worklist;
+    for (auto &bb : mf_.basic_blocks())
+    {
+        BlockLiveness &info = block_info_[block_index_.at(bb.get())];
+        info.out.reset(index);
+        info.in.reset(index);
+        if (info.use.test(index))
+        {
+            info.in.set(index);
+            worklist.push_back(bb.get());
+        }
+    }
+
+    while (!worklist.empty())
+    {
+        const MachineBasicBlock *bb = worklist.back();
+        worklist.pop_back();
+        for (const MachineBasicBlock *pred : bb->predecessors())
+        {
+            BlockLiveness &info = block_info_[block_index_.at(pred)];
+            if (info.out.test(index))
+                continue;
+            info.out.set(index);
+            if (!info.def.test(index) && !info.in.test(index))
             {
-                changed = true;
-                info.in = std::move(new_in);
-                info.out = std::move(new_out);
+                info.in.set(index);
+                worklist.push_back(pred);
             }
         }
-        iter++;
-    } while (changed);
-    MO_DEBUG("Data flow analysis finished in %u iterations", iter);
+    }
+}
+
+// 没被重排的位置保持不变，区间只有在端点附近被改动时才可能变：端点指令被删、紧挨着右端插入了指令，
+// 或者左端所在块的开头多了指令。从左端所在块的开头到右端之间有改动就重建，宁可多建几个
+bool LiveRangeAnalyzer::is_stale(const LiveRange &lr) const
+{
+    const SlotIndexes &slots = mf_.slot_indexes();
+    for (const auto &interval : lr.intervals())
+    {
+        const size_t lo = slots.block_start(slots.block_at(interval.start()));
+        auto it = std::lower_bound(edited_slots_.begin(), edited_slots_.end(), lo);
+        if (it != edited_slots_.end() && *it <= interval.end())
+            return true;
+    }
+    return false;
+}
+
+// 与 compute_all 同样的规则，只是从出现集合出发，不扫描整个函数
+void LiveRangeAnalyzer::rebuild_live_range(unsigned reg) const
+{
+    auto it = reg_live_ranges_.find(reg);
+    if (it == reg_live_ranges_.end())
+        return;
+    LiveRange &lr = *it->second;
+
+    const SlotIndexes &slots = mf_.slot_indexes();
+    std::vector<std::pair<unsigned, unsigned>> bounds;
+    for (const LiveOccurrence &o : lr.occurrences())
+    {
+        const size_t start = o.is_def ? o.pos : find_last_def_pos(o.inst->parent(), reg, o.pos);
+        bounds.emplace_back(start, slots.next_index(o.inst));
+    }
+    // 只作内存基址出现的寄存器没有编号，也就不会跨块活跃
+    if (auto index = reg_index_.find(reg); index != reg_index_.end())
+    {
+        for (auto &bb : mf_.basic_blocks())
+        {
+            if (!bb->instructions().empty() && block_info_[block_index_.at(bb.get())].out.test(index->second))
+                bounds.emplace_back(find_last_def_pos(bb.get(), reg, -1), bb->global_end());
+        }
+    }
+
+    if (bounds.empty())
+    {
+        reg_live_ranges_.erase(it); // 最后一次出现被删掉了
+        return;
+    }
+    lr.assign_intervals(bounds);
 }
 
 // 查找块内首次定义位置
@@ -471,64 +791,95 @@ bool LiveRangeAnalyzer::has_conflict(unsigned reg1, unsigned reg2) const
         return false;
     }
 
-    // 优化后的区间遍历
-    auto &intervals1 = lr1->intervals();
-    auto &intervals2 = lr2->intervals();
-    auto it1 = intervals1.begin();
-    auto it2 = intervals2.begin();
-
-    while (it1 != intervals1.end() && it2 != intervals2.end())
-    {
-        if (it1->overlaps(*it2))
-        {
-            MO_DEBUG("has_confict: %s overlaps %s", it1->to_string().c_str(), it2->to_string().c_str());
-            return true;
-        }
-        it1->start() < it2->start() ? ++it1 : ++it2;
-    }
-
-    return false;
+    return lr1->interferes_with(*lr2);
 }
 
 // 辅助函数：计算基本块局部USE/DEF
-void LiveRangeAnalyzer::compute_local_use_def(MachineBasicBlock *bb, std::unordered_set<unsigned> &use, std::unordered_set<unsigned> &def) const
+void LiveRangeAnalyzer::compute_local_use_def(const MachineBasicBlock *bb, BitVector &use, BitVector &def) const
 {
-
     use.clear();
     def.clear();
-    std::unordered_set<unsigned> temp_use;
-
     for (auto &inst : bb->instructions())
     {
-        // 记录所有def寄存器
+        // 记录use寄存器（排除在之前指令def之后使用的），同一条指令先读后写
         for (auto &op : inst->operands())
         {
-            if (op.is_reg() && op.is_def())
+            if (op.is_reg() && !op.is_def())
             {
-                def.insert(op.reg());
+                const unsigned i = reg_index_.at(op.reg());
+                if (!def.test(i))
+                    use.set(i);
             }
         }
-        // 记录use寄存器（排除在def之后使用的）
+        // 记录所有def寄存器
         for (auto &op : inst->operands())
         {
-            if (op.is_reg() && !op.is_def())
-            {
-                if (!def.count(op.reg()))
-                {
-                    temp_use.insert(op.reg());
-                }
-            }
+            if (op.is_reg() && op.is_def())
+                def.set(reg_index_.at(op.reg()));
         }
     }
-    use = temp_use;
+}
+
+const LiveRangeAnalyzer::BlockLiveness *LiveRangeAnalyzer::block_liveness(const MachineBasicBlock *bb) const
+{
+    compute();
+    auto it = block_index_.find(bb);
+    return it == block_index_.end() ? nullptr : &block_info_[it->second];
+}
+
+std::vector<unsigned> LiveRangeAnalyzer::collect(const BitVector &bits) const
+{
+    std::vector<unsigned> regs;
+    regs.reserve(bits.count());
+    bits.for_each([&](size_t i) { regs.push_back(index_reg_[i]); });
+    std::sort(regs.begin(), regs.end());
+    return regs;
+}
+
+bool LiveRangeAnalyzer::query(const BitVector BlockLiveness::*set, unsigned reg, const MachineBasicBlock *bb) const
+{
+    const BlockLiveness *info = block_liveness(bb);
+    auto it = reg_index_.find(reg);
+    return info && it != reg_index_.end() && (info->*set).test(it->second);
+}
+
+std::vector<unsigned> LiveRangeAnalyzer::live_in(const MachineBasicBlock *bb) const
+{
+    const BlockLiveness *info = block_liveness(bb);
+    return info ? collect(info->in) : std::vector<unsigned>{};
+}
+
+std::vector<unsigned> LiveRangeAnalyzer::live_out(const MachineBasicBlock *bb) const
+{
+    const BlockLiveness *info = block_liveness(bb);
+    return info ? collect(info->out) : std::vector<unsigned>{};
+}
+
+std::vector<unsigned> LiveRangeAnalyzer::upward_exposed_uses(const MachineBasicBlock *bb) const
+{
+    const BlockLiveness *info = block_liveness(bb);
+    return info ? collect(info->use) : std::vector<unsigned>{};
+}
+
+std::vector<unsigned> LiveRangeAnalyzer::block_defs(const MachineBasicBlock *bb) const
+{
+    const BlockLiveness *info = block_liveness(bb);
+    return info ? collect(info->def) : std::vector<unsigned>{};
+}
+
+bool LiveRangeAnalyzer::is_live_in(unsigned reg, const MachineBasicBlock *bb) const
+{
+    return query(&BlockLiveness::in, reg, bb);
+}
+
+bool LiveRangeAnalyzer::is_live_out(unsigned reg, const MachineBasicBlock *bb) const
+{
+    return query(&BlockLiveness::out, reg, bb);
 }
 
 LiveRange *LiveRangeAnalyzer::get_live_range(unsigned reg) const
 {
-    if (live_ranges_dirty_)
-    {
-        compute();
-    }
+    compute();
 
     auto it = reg_live_ranges_.find(reg);
     if (it == reg_live_ranges_.end())
@@ -548,34 +899,81 @@ LiveRange *LiveRangeAnalyzer::get_physical_live_range(unsigned reg) const
     return nullptr;
 }
 
-std::map<unsigned, std::set<unsigned>> LiveRangeAnalyzer::build_interference_graph() const
+InterferenceGraph LiveRangeAnalyzer::build_interference() const
 {
     compute(); // 确保活跃区间数据最新
+    PhaseTimer timer("interference");
 
-    std::map<unsigned, std::set<unsigned>> graph;
-    const auto &ranges = reg_live_ranges_;
+    std::vector<unsigned> regs;
+    regs.reserve(reg_live_ranges_.size());
+    for (const auto &[reg, lr] : reg_live_ranges_)
+    {
+        regs.push_back(reg);
+    }
+    std::sort(regs.begin(), regs.end());
 
-    // 遍历所有寄存器对（包括虚拟和物理）
-    for (auto it1 = ranges.begin(); it1 != ranges.end(); ++it1)
+    // 所有区间按起点排序：(start, end, node)
+    struct Event
     {
-        const unsigned reg1 = it1->first;
+        unsigned start;
+        unsigned end;
+        unsigned node;
+        bool operator<(const Event &rhs) const { return start < rhs.start; }
+    };
+    std::vector<Event> events;
+    for (unsigned node = 0; node < regs.size(); ++node)
+    {
+        // FIXME: 同 has_conflict，0 寄存器不参与冲突
+        if (regs[node] == 0)
+            continue;
+        for (const auto &interval : reg_live_ranges_.at(regs[node])->intervals())
+        {
+            events.push_back({interval.start(), interval.end(), node});
+        }
+    }
+    std::sort(events.begin(), events.end());
 
-        for (auto it2 = std::next(it1); it2 != ranges.end(); ++it2)
+    // 扫描线：active 中是仍然活跃的区间，新区间与它们全部重叠
+    std::vector<std::pair<unsigned, unsigned>> edges;
+    std::vector<Event> active;
+    for (const Event &event : events)
+    {
+        active.erase(std::remove_if(active.begin(), active.end(),
+                                    [&](const Event &e) { return e.end <= event.start; }),
+                     active.end());
+        for (const Event &e : active)
         {
-            const unsigned reg2 = it2->first;
+            if (e.node != event.node)
+                edges.emplace_back(e.node, event.node);
+        }
+        active.push_back(event);
+    }
 
-            // 使用 has_conflict 判断冲突
-            if (has_conflict(reg1, reg2))
-            {
-                graph[reg1].insert(reg2);
-                graph[reg2].insert(reg1);
-            }
+    // 物理寄存器与已分配到其别名上的区间冲突，不论是否重叠
+    for (unsigned phys = 0; phys < regs.size(); ++phys)
+    {
+        if (regs[phys] == 0 || !MachineFunction::is_physical_reg(regs[phys]))
+            continue;
+        for (unsigned other = 0; other < regs.size(); ++other)
+        {
+            const LiveRange *lr = reg_live_ranges_.at(regs[other]).get();
+            if (other != phys && regs[other] != 0 && lr->is_allocated() && is_alias_(regs[phys], lr->vreg()))
+                edges.emplace_back(phys, other);
         }
     }
 
+    timer.count("registers", regs.size());
+    timer.count("intervals", events.size());
+    InterferenceGraph graph(std::move(regs), std::move(edges));
+    timer.count("edges", graph.num_edges());
     return graph;
 }
 
+std::map<unsigned, std::set<unsigned>> LiveRangeAnalyzer::build_interference_graph() const
+{
+    return build_interference().to_map();
+}
+
 void LiveRangeAnalyzer::dump(std::ostream &os)
 {
     os << "Live Range Analysis Result:\n";
@@ -9,10 +9,15 @@
 #include <limits>
 #include <map>
 #include <vector>
+#include <utility>
 #include <string>
 #include <sstream>
 #include <functional>
 #include <memory>
+#include <span>
+
+#include "bit_vector.h"
+#include "interference_graph.h"
 
 using AliasCheckFn = std::function<bool(unsigned reg1, unsigned reg2)>;
 class MachineFunction;
@@ -32,8 +37,6 @@ private:
     unsigned start_; // Inclusive
     unsigned end_;   // Exclusive
     LiveRange *parent_;
-    mutable std::unordered_set<MachineInst *> def_insts_;
-    mutable std::unordered_set<MachineInst *> use_insts_;
 
 public:
     LiveInterval(unsigned start, unsigned end, LiveRange *parent = nullptr);
@@ -43,11 +46,6 @@ public:
     unsigned end() const;
     LiveRange *parent() { return parent_; }
 
-    void add_def_inst(MachineInst *inst) const { def_insts_.insert(inst); }
-    void add_use_inst(MachineInst *inst) const { use_insts_.insert(inst); }
-    const auto &def_insts() const { return def_insts_; }
-    const auto &use_insts() const { return use_insts_; }
-
     // Interval overlap check (including adjacent intervals)
     bool overlaps(const LiveInterval &other) const;
 
@@ -67,19 +65,34 @@ public:
     friend class LiveRange;
 };
 
-// A collection of live intervals that are related to a register.
+// One read or write of a range's register, at the instruction's position
+struct LiveOccurrence
+{
+    unsigned pos;
+    bool is_def; // Reads sort before writes at the same position
+    MachineInst *inst;
+
+    bool operator<(const LiveOccurrence &rhs) const
+    {
+        return pos < rhs.pos || (pos == rhs.pos && is_def < rhs.is_def);
+    }
+    bool operator==(const LiveOccurrence &rhs) const = default;
+};
+
+// A collection of live intervals that are related to a register. Both the
+// intervals and the occurrences are flat arrays sorted by position, so an
+// interval's occurrences are a binary search away.
 class LiveRange
 {
 private:
     std::vector<LiveInterval> intervals_;
+    std::vector<LiveOccurrence> occurrences_;
 
     unsigned preg_ = std::numeric_limits<unsigned>::max(); // Currently assigned register (physical or virtual)
     unsigned vreg_ = std::numeric_limits<unsigned>::max(); // Original virtual register
     bool is_allocated_ = false;                            // Whether it is bound to a physical register
     bool is_spilled_ = false;                              // Whether it has been spilled to the stack
     int spill_slot_ = -1;                                  // Stack slot index
-    mutable std::unordered_set<MachineInst *> def_insts_;
-    mutable std::unordered_set<MachineInst *> use_insts_;
 
 private:
     // Internal function to merge overlapping intervals
@@ -92,37 +105,23 @@ public:
 
     // Add an interval and automatically merge overlaps
     void add_interval(unsigned start, unsigned end);
-
-    void add_def_inst(size_t pos, MachineInst *inst) const
-    {
-        def_insts_.insert(inst);
-        for (auto &interval : intervals_)
-        {
-            if (interval.start() <= pos && pos < interval.end())
-            {
-                interval.add_def_inst(inst);
-            }
-        }
-    }
-
-    void add_use_inst(size_t pos, MachineInst *inst) const
-    {
-        use_insts_.insert(inst);
-        for (auto &interval : intervals_)
-        {
-            if (interval.start() <= pos && pos < interval.end())
-            {
-                interval.add_use_inst(inst);
-            }
-        }
-    }
-    std::unordered_set<MachineInst *> &def_insts() const { return def_insts_; }
-    std::unordered_set<MachineInst *> &use_insts() const { return use_insts_; }
+    // Replace every interval with `bounds`, given as [start, end) pairs in
+    // any order; allocation state and occurrence sets are kept
+    void assign_intervals(const std::vector<std::pair<unsigned, unsigned>> &bounds);
+
+    // Record that `inst` at `pos` reads or writes the register
+    void add_occurrence(unsigned pos, MachineInst *inst, bool is_def);
+    // Forget every occurrence of `inst`, which sits at `pos`
+    void remove_occurrences(unsigned pos, const MachineInst *inst);
+    const std::vector<LiveOccurrence> &occurrences() const { return occurrences_; }
+    // The occurrences inside `interval`
+    std::span<const LiveOccurrence> occurrences_in(const LiveInterval &interval) const;
 
     // Check if it is live at the specified position
     bool live_at(unsigned pos) const;
 
-    // Fast conflict detection (linear two-pointer scan)
+    // Conflict detection: walks the range with fewer intervals and binary
+    // searches the other
     bool interferes_with(const LiveRange &other) const;
 
     std::string to_string() const;
@@ -151,7 +150,9 @@ public:
         return intervals_[0];
     }
 
-    std::vector<std::unique_ptr<LiveRange>> atomized_ranges(MachineFunction &mf);
+    // One single-interval copy per interval, all for the same register and
+    // each with the occurrences inside it
+    std::vector<std::unique_ptr<LiveRange>> atomized_ranges() const;
 };
 
 const AliasCheckFn none_alias = [](unsigned reg1, unsigned reg2)
@@ -167,22 +168,47 @@ private:
     mutable std::unordered_map<unsigned, std::unique_ptr<LiveRange>> reg_live_ranges_;
     mutable size_t *compute_metric_counter_ = nullptr;
     AliasCheckFn is_alias_;
+
+    // The data flow runs over dense numberings: registers in order of first
+    // appearance, blocks in function order. Each block's sets are bit vectors
+    // over the register numbering
     struct BlockLiveness
     {
-        std::unordered_set<unsigned> in;
-        std::unordered_set<unsigned> out;
-        std::unordered_set<unsigned> use;
-        std::unordered_set<unsigned> def;
+        BitVector in;
+        BitVector out;
+        BitVector use;
+        BitVector def;
     };
 
-    mutable std::unordered_map<MachineBasicBlock *, BlockLiveness> block_info_;
+    mutable std::unordered_map<unsigned, unsigned> reg_index_;
+    mutable std::vector<unsigned> index_reg_;
+    mutable std::unordered_map<const MachineBasicBlock *, unsigned> block_index_;
+    mutable std::vector<BlockLiveness> block_info_;
+
+    // Edits reported since the last compute, patched in by the next query.
+    // Intervals are in slot indexes, which stay put as long as the
+    // SlotIndexes generation does
+    mutable std::unordered_set<const MachineBasicBlock *> touched_blocks_;
+    mutable std::unordered_set<unsigned> touched_regs_;
+    mutable std::vector<size_t> edited_slots_;
+    mutable unsigned slot_generation_ = 0;
 
 private:
     LiveRange *live_range_of(unsigned reg) const;
+    void number_registers() const;
     void compute_data_flow() const;
     size_t find_first_def_pos(MachineBasicBlock *bb, unsigned reg, size_t after_pos_exclusive) const;
     size_t find_last_def_pos(MachineBasicBlock *bb, unsigned reg, size_t before_pos_exclusive) const;
-    void compute_local_use_def(MachineBasicBlock *bb, std::unordered_set<unsigned> &use, std::unordered_set<unsigned> &def) const;
+    void compute_local_use_def(const MachineBasicBlock *bb, BitVector &use, BitVector &def) const;
+    const BlockLiveness *block_liveness(const MachineBasicBlock *bb) const;
+    std::vector<unsigned> collect(const BitVector &bits) const;
+    bool query(const BitVector BlockLiveness::*set, unsigned reg, const MachineBasicBlock *bb) const;
+    void compute_all() const;
+    void apply_pending_edits() const;
+    void clear_pending_edits() const;
+    void compute_reg_liveness(unsigned index) const;
+    bool is_stale(const LiveRange &lr) const;
+    void rebuild_live_range(unsigned reg) const;
 
 public:
     explicit LiveRangeAnalyzer(const MachineFunction &mf, AliasCheckFn is_alias = none_alias)
@@ -195,12 +221,34 @@ public:
     LiveRange *get_live_range(unsigned reg) const;
     LiveRange *get_physical_live_range(unsigned phys_reg) const;
 
+    // Sweeps every interval in start order against the set still live, so
+    // the cost is the number of edges rather than the number of pairs. Edges
+    // match has_conflict on every pair of registers with a live range
+    InterferenceGraph build_interference() const;
     std::map<unsigned, std::set<unsigned>> build_interference_graph() const;
 
     void mark_dirty() { live_ranges_dirty_ = true; }
 
+    // Instruction-level edits, reported by MachineBasicBlock as they happen:
+    // `mi` after it is inserted, or before it is erased. Only the registers
+    // `mi` references and the ranges with an edit near their ends get
+    // rebuilt; everything else keeps its intervals as they are. CFG edits
+    // are not tracked and need mark_dirty
+    void instruction_inserted(MachineInst *mi);
+    void instruction_removed(MachineInst *mi);
+    // Operand rewrites in place, reported by replace_reg and remap_registers
+    // once `mi` refers to `new_reg` where it referred to `old_reg`. Nothing
+    // moves, so only the two registers get rebuilt
+    void registers_rewritten(MachineInst *mi, unsigned old_reg, unsigned new_reg);
+
     std::unordered_map<unsigned, std::unique_ptr<LiveRange>> &get_all_live_ranges() const { return reg_live_ranges_; }
-    BlockLiveness &block_info(MachineBasicBlock *bb) const { return block_info_[bb]; }
+    // Block-level sets, in increasing register order
+    std::vector<unsigned> live_in(const MachineBasicBlock *bb) const;
+    std::vector<unsigned> live_out(const MachineBasicBlock *bb) const;
+    std::vector<unsigned> upward_exposed_uses(const MachineBasicBlock *bb) const;
+    std::vector<unsigned> block_defs(const MachineBasicBlock *bb) const;
+    bool is_live_in(unsigned reg, const MachineBasicBlock *bb) const;
+    bool is_live_out(unsigned reg, const MachineBasicBlock *bb) const;
     void dump(std::ostream &os);
     void export_to_gantt_chart(std::ostream &os) const;
     void export_to_json(std::ostream &os) const;
@@ -8,40 +8,30 @@
 
 void PressureTracker::add_interval(const LiveRange &live_range)
 {
-    unsigned weight = tri_.get_reg_weight(live_range.vreg());
+    add_interval(live_range, tri_.get_reg_weight(live_range.vreg()));
+}
+
+void PressureTracker::add_interval(const LiveRange &live_range, unsigned weight)
+{
     for (const auto &interval : live_range.intervals())
     {
-        auto start = interval.start();
-        auto end = interval.end();
-
-        for (unsigned pos = start; pos <= end; ++pos)
-        {
-            pressure_at_pos_[pos] += weight;
-            // Any addition might change the maximum, so mark as dirty.
-            max_pressure_dirty_ = true;
-        }
+        // Live on [start, end], both ends included
+        pressure_deltas_[interval.start()] += static_cast<int>(weight);
+        pressure_deltas_[interval.end() + 1] -= static_cast<int>(weight);
     }
+    // Any addition might change the maximum, so mark as dirty.
+    max_pressure_dirty_ = true;
 }
 
 void PressureTracker::remove_interval(const LiveRange &live_range)
 {
-    unsigned weight = tri_.get_reg_weight(live_range.vreg());
+    int weight = static_cast<int>(tri_.get_reg_weight(live_range.vreg()));
     for (const auto &interval : live_range.intervals())
     {
-        auto start = interval.start();
-        auto end = interval.end();
-
-        for (unsigned pos = start; pos <= end; ++pos)
-        {
-            pressure_at_pos_[pos] -= weight;
-            // If the reduced position was the original maximum, mark for
-            // recalculation.
-            if (pressure_at_pos_[pos] + weight == cached_max_pressure_)
-            {
-                max_pressure_dirty_ = true;
-            }
-        }
+        pressure_deltas_[interval.start()] -= weight;
+        pressure_deltas_[interval.end() + 1] += weight;
     }
+    max_pressure_dirty_ = true;
 }
 
 unsigned PressureTracker::get_max_pressure() const
@@ -49,9 +39,11 @@ unsigned PressureTracker::get_max_pressure() const
     if (max_pressure_dirty_)
     {
         cached_max_pressure_ = 0;
-        for (const auto &[pos, pressure] : pressure_at_pos_)
+        int pressure = 0;
+        for (const auto &[pos, delta] : pressure_deltas_)
         {
-            cached_max_pressure_ = std::max(cached_max_pressure_, pressure);
+            pressure += delta;
+            cached_max_pressure_ = std::max(cached_max_pressure_, static_cast<unsigned>(pressure));
         }
         max_pressure_dirty_ = false;
     }
@@ -60,8 +52,10 @@ unsigned PressureTracker::get_max_pressure() const
 
 void PressureTracker::dump_pressure_curve() const
 {
-    for (const auto &[pos, pressure] : pressure_at_pos_)
+    int pressure = 0;
+    for (const auto &[pos, delta] : pressure_deltas_)
     {
+        pressure += delta;
         std::cout << "Position " << pos << ": " << pressure << "\n";
     }
 }
@@ -70,263 +64,204 @@ void PressureTracker::dump_pressure_curve() const
 // MOperand Implementation
 //===----------------------------------------------------------------------===//
 
-MOperand::MEMrix MOperand::get_mem_rix() const
-{
-    assert(is_mem_rix());
-    return std::get<MEMrix>(storage_);
-}
-MOperand MOperand::create_mem_rix(unsigned base_reg, unsigned index_reg,
-                                  int scale, int offset)
-{
-    MOperand op;
-    op.storage_ = MEMrix{base_reg, index_reg, scale, offset};
-    op.type_ = MOperandType::MEMrix;
-    return op;
-}
-
 MOperand MOperand::create_reg(unsigned reg, bool is_def)
 {
     MOperand op;
-    op.storage_ = reg;
-    op.is_def_ = is_def;
     op.type_ = MOperandType::Register;
+    op.is_def_ = is_def;
+    op.word_ = reg;
     return op;
 }
 
 MOperand MOperand::create_imm(int64_t val)
 {
     MOperand op;
-    op.storage_ = val;
     op.type_ = MOperandType::Immediate;
+    op.payload_.imm = val;
     return op;
 }
 
 MOperand MOperand::create_fp_imm(double val)
 {
     MOperand op;
-    op.storage_ = val;
     op.type_ = MOperandType::FPImmediate;
+    op.payload_.fp_imm = val;
     return op;
 }
 
 MOperand MOperand::create_frame_index(int index)
 {
     MOperand op;
-    op.storage_ = index;
     op.type_ = MOperandType::FrameIndex;
+    op.word_ = static_cast<unsigned>(index);
     return op;
 }
 
 MOperand MOperand::create_global(GlobalVariable *global_variable)
 {
     MOperand op;
-    op.storage_ = global_variable;
     op.type_ = MOperandType::GlobalAddress;
+    op.payload_.ptr = global_variable;
     return op;
 }
 
-MOperand MOperand::create_external_sym(std::string symbol)
+MOperand MOperand::create_external_sym(const char *symbol)
 {
     MOperand op;
-    op.storage_ = ExternalSymbol{std::move(symbol)};
     op.type_ = MOperandType::ExternalSymbol;
+    op.payload_.ptr = symbol;
     return op;
 }
 
-MOperand MOperand::create_label(std::string symbol)
+MOperand MOperand::create_label(const char *label)
 {
     MOperand op;
-    op.storage_ = Label{std::move(symbol)};
     op.type_ = MOperandType::Label;
+    op.payload_.ptr = label;
     return op;
 }
 
 MOperand MOperand::create_basic_block(MachineBasicBlock *bb)
 {
     MOperand op;
-    op.storage_ = bb;
     op.type_ = MOperandType::BasicBlock;
+    op.payload_.ptr = bb;
     return op;
 }
 
 MOperand MOperand::create_mem_ri(unsigned base_reg, int offset)
 {
     MOperand op;
-    op.storage_ = MEMri{base_reg, offset};
     op.type_ = MOperandType::MEMri;
+    op.word_ = base_reg;
+    op.payload_.mem = {0, offset};
     return op;
 }
 
 MOperand MOperand::create_mem_rr(unsigned base_reg, unsigned index_reg)
 {
     MOperand op;
-    op.storage_ = MEMrr{base_reg, index_reg};
     op.type_ = MOperandType::MEMrr;
+    op.word_ = base_reg;
+    op.payload_.mem = {index_reg, 0};
+    return op;
+}
+
+MOperand MOperand::create_mem_rix(unsigned base_reg, unsigned index_reg,
+                                  int scale, int offset)
+{
+    assert(scale >= INT8_MIN && scale <= INT8_MAX);
+    MOperand op;
+    op.type_ = MOperandType::MEMrix;
+    op.scale_ = static_cast<int8_t>(scale);
+    op.word_ = base_reg;
+    op.payload_.mem = {index_reg, offset};
     return op;
 }
+
+MOperand MOperand::create_mem_fi(int frame_index, int offset)
+{
+    MOperand op;
+    op.type_ = MOperandType::MEMfi;
+    op.word_ = static_cast<unsigned>(frame_index);
+    op.payload_.mem = {0, offset};
+    return op;
+}
+
 unsigned MOperand::reg() const
 {
     assert(is_reg());
-    return std::get<unsigned>(storage_);
+    return word_;
 }
 
 int64_t MOperand::imm() const
 {
     assert(is_imm());
-    return std::get<int64_t>(storage_);
+    return payload_.imm;
 }
 
 double MOperand::fp_imm() const
 {
     assert(is_fp_imm());
-    return std::get<double>(storage_);
+    return payload_.fp_imm;
 }
 
 int MOperand::frame_index() const
 {
     assert(is_frame_index());
-    return std::get<int>(storage_);
+    return static_cast<int>(word_);
 }
 
 GlobalVariable *MOperand::global() const
 {
     assert(is_global());
-    return std::get<GlobalVariable *>(storage_);
+    return static_cast<GlobalVariable *>(const_cast<void *>(payload_.ptr));
 }
 
 const char *MOperand::external_sym() const
 {
     assert(is_external_sym());
-    return std::get<ExternalSymbol>(storage_).value.c_str();
+    return static_cast<const char *>(payload_.ptr);
 }
 
 const char *MOperand::label() const
 {
     assert(is_label());
-    return std::get<Label>(storage_).value.c_str();
+    return static_cast<const char *>(payload_.ptr);
 }
 
 MachineBasicBlock *MOperand::basic_block() const
 {
     assert(is_basic_block());
-    return std::get<MachineBasicBlock *>(storage_);
+    return static_cast<MachineBasicBlock *>(const_cast<void *>(payload_.ptr));
 }
 
 MOperand::MEMri MOperand::mem_ri() const
 {
     assert(is_mem_ri());
-    return std::get<MEMri>(storage_);
+    return {word_, payload_.mem.offset};
 }
 
 MOperand::MEMrr MOperand::mem_rr() const
 {
     assert(is_mem_rr());
-    return std::get<MEMrr>(storage_);
-}
-
-unsigned MOperand::base_reg() const
-{
-    if (is_mem_ri())
-        return std::get<MEMri>(storage_).base_reg;
-    if (is_mem_rr())
-        return std::get<MEMrr>(storage_).base_reg;
-    if (is_mem_rix())
-        return std::get<MEMrix>(storage_).base_reg;
-    assert(false && "Not a memory operand!");
-    return 0;
-}
-
-#include <cassert>
-
-bool MOperand::is_reg() const noexcept
-{
-    bool expected = std::holds_alternative<unsigned>(storage_);
-    bool actual = type_ == MOperandType::Register;
-    assert(expected == actual);
-    return actual;
-}
-bool MOperand::is_imm() const noexcept
-{
-    bool expected = std::holds_alternative<int64_t>(storage_);
-    bool actual = type_ == MOperandType::Immediate;
-    assert(expected == actual);
-    return actual;
-}
-bool MOperand::is_fp_imm() const noexcept
-{
-    bool expected = std::holds_alternative<double>(storage_);
-    bool actual = type_ == MOperandType::FPImmediate;
-    assert(expected == actual);
-    return actual;
-}
-bool MOperand::is_frame_index() const noexcept
-{
-    bool expected = std::holds_alternative<int>(storage_);
-    bool actual = type_ == MOperandType::FrameIndex;
-    assert(expected == actual);
-    return actual;
-}
-bool MOperand::is_global() const noexcept
-{
-    bool expected = std::holds_alternative<GlobalVariable *>(storage_);
-    bool actual = type_ == MOperandType::GlobalAddress;
-    assert(expected == actual);
-    return actual;
-}
-bool MOperand::is_external_sym() const noexcept
-{
-    bool expected = std::holds_alternative<ExternalSymbol>(storage_);
-    bool actual = type_ == MOperandType::ExternalSymbol;
-    assert(expected == actual);
-    return actual;
+    return {word_, payload_.mem.index_reg};
 }
 
-bool MOperand::is_label() const noexcept
+MOperand::MEMrix MOperand::get_mem_rix() const
 {
-    bool expected = std::holds_alternative<Label>(storage_);
-    bool actual = type_ == MOperandType::Label;
-    assert(expected == actual);
-    return actual;
+    assert(is_mem_rix());
+    return {word_, payload_.mem.index_reg, scale_, payload_.mem.offset};
 }
 
-bool MOperand::is_basic_block() const noexcept
+MOperand::MEMfi MOperand::mem_fi() const
 {
-    bool expected = std::holds_alternative<MachineBasicBlock *>(storage_);
-    bool actual = type_ == MOperandType::BasicBlock;
-    assert(expected == actual);
-    return actual;
+    assert(is_mem_fi());
+    return {static_cast<int>(word_), payload_.mem.offset};
 }
 
-bool MOperand::is_mem_ri() const noexcept
+unsigned MOperand::base_reg() const
 {
-    bool expected = std::holds_alternative<MEMri>(storage_);
-    bool actual = type_ == MOperandType::MEMri;
-    assert(expected == actual);
-    return actual;
+    assert((is_mem_ri() || is_mem_rr() || is_mem_rix()) && "Not a memory operand!");
+    return word_;
 }
 
-bool MOperand::is_mem_rr() const noexcept
+void MOperand::set_reg(unsigned reg)
 {
-    bool expected = std::holds_alternative<MEMrr>(storage_);
-    bool actual = type_ == MOperandType::MEMrr;
-    assert(expected == actual);
-    return actual;
+    assert(is_reg());
+    word_ = reg;
 }
 
-bool MOperand::is_mem_rix() const noexcept
+void MOperand::set_base_reg(unsigned reg)
 {
-    bool expected = std::holds_alternative<MEMrix>(storage_);
-    bool actual = type_ == MOperandType::MEMrix;
-    assert(expected == actual);
-    return actual;
+    assert((is_mem_ri() || is_mem_rr() || is_mem_rix()) && "Not a memory operand!");
+    word_ = reg;
 }
 
-bool MOperand::is_valid() const noexcept
+void MOperand::set_index_reg(unsigned reg)
 {
-    bool expected = !std::holds_alternative<std::monostate>(storage_);
-    bool actual = type_ != MOperandType::Invalid;
-    assert(expected == actual);
-    return actual;
+    assert((is_mem_rr() || is_mem_rix()) && "No index register");
+    payload_.mem.index_reg = reg;
 }
 
 std::string MOperand::to_string() const
@@ -365,6 +300,11 @@ std::string MOperand::to_string() const
         oss << "[R" << mem.base_reg << " + R" << mem.index_reg << "*" << mem.scale
             << " + " << mem.offset << "]";
     }
+    else if (is_mem_fi())
+    {
+        auto mem = mem_fi();
+        oss << "[fi#" << mem.frame_index << " + " << mem.offset << "]";
+    }
     else if (is_frame_index())
     {
         oss << "fi#" << frame_index();
@@ -428,6 +368,10 @@ std::string MachineInst::to_string(const TargetInstInfo *target_info) const
     {
         oss << " " << op.to_string();
     }
+    for (unsigned reg : implicit_uses())
+        oss << " R" << reg << "<imp-use>";
+    for (unsigned reg : implicit_defs())
+        oss << " R" << reg << "<imp-def>";
 
     // Add flag information
     if (flags_.any())
@@ -462,8 +406,46 @@ std::string MachineInst::to_string(const TargetInstInfo *target_info) const
     return oss.str();
 }
 
-MachineInst::MachineInst(unsigned opcode, const std::vector<MOperand> &ops)
-    : opcode_(opcode), ops_(ops) {}
+namespace
+{
+    thread_local SlabAllocator *current_inst_pool = nullptr;
+}
+
+MachineInstPoolScope::MachineInstPoolScope(MachineFunction &mf) : previous_(current_inst_pool)
+{
+    current_inst_pool = &mf.inst_pool();
+}
+
+MachineInstPoolScope::~MachineInstPoolScope() { current_inst_pool = previous_; }
+
+SlabAllocator *MachineInstPoolScope::current() { return current_inst_pool; }
+
+// 复制的是指令本身，不是它在块里的位置：副本插入之前不属于任何块
+MachineInst::MachineInst(const MachineInst &other)
+    : opcode_(other.opcode_), ops_(other.ops_),
+      implicit_(other.implicit_ ? std::make_unique<ImplicitRegs>(*other.implicit_) : nullptr),
+      flags_(other.flags_) {}
+
+MachineInst &MachineInst::operator=(const MachineInst &other)
+{
+    if (this != &other)
+    {
+        opcode_ = other.opcode_;
+        ops_ = other.ops_;
+        implicit_ = other.implicit_ ? std::make_unique<ImplicitRegs>(*other.implicit_) : nullptr;
+        flags_ = other.flags_;
+    }
+    return *this;
+}
+
+void *MachineInst::operator new(size_t size)
+{
+    if (current_inst_pool)
+        return current_inst_pool->allocate(size);
+    return SlabAllocator::allocate_unowned(size);
+}
+
+void MachineInst::operator delete(void *ptr, size_t size) noexcept { SlabAllocator::release(ptr, size); }
 
 bool MachineInst::verify(VerificationLevel level, const TargetInstInfo *tii,
                          std::string *err_msg) const
@@ -520,142 +502,84 @@ void MachineInst::insert_operand(unsigned idx, const MOperand &op)
 void MachineInst::remove_operand(unsigned idx) { ops_.erase(ops_.begin() + idx); }
 void MachineInst::replace_reg(unsigned old_reg, unsigned new_reg)
 {
-    // Iterate through all operands
-    for (auto &op : ops_)
-    {
-        // Replace direct register operands
-        if (op.is_reg() && op.reg() == old_reg)
-        {
-            // Save original operand flags
-            bool is_def = op.is_def();
-
-            // Create a new register operand and preserve flags
-            op = MOperand::create_reg(new_reg, is_def);
-            continue;
-        }
-
-        // Replace base register in memory operands
-        if (op.is_mem_ri() && op.base_reg() == old_reg)
-        {
-            MOperand::MEMri mem = op.mem_ri();
-            op = MOperand::create_mem_ri(new_reg, mem.offset);
-            continue;
-        }
-
-        // Replace register-register memory operands
-        if (op.is_mem_rr())
-        {
-            MOperand::MEMrr mem = op.mem_rr();
-            if (mem.base_reg == old_reg || mem.index_reg == old_reg)
-            {
-                unsigned new_base = (mem.base_reg == old_reg) ? new_reg : mem.base_reg;
-                unsigned new_index = (mem.index_reg == old_reg) ? new_reg : mem.index_reg;
-                op = MOperand::create_mem_rr(new_base, new_index);
-            }
-            continue;
-        }
-
-        // Replace scaled index memory operands
-        if (op.is_mem_rix())
-        {
-            MOperand::MEMrix mem = op.get_mem_rix();
-            if (mem.base_reg == old_reg || mem.index_reg == old_reg)
-            {
-                unsigned new_base = (mem.base_reg == old_reg) ? new_reg : mem.base_reg;
-                unsigned new_index = (mem.index_reg == old_reg) ? new_reg : mem.index_reg;
-                op = MOperand::create_mem_rix(new_base, new_index, mem.scale, mem.offset);
-            }
-            continue;
-        }
-    }
-}
-void MachineInst::remap_registers(const std::map<unsigned, unsigned> &vreg_map)
-{
-    // Iterate through all operands
+    bool changed = false;
     for (auto &op : ops_)
     {
-        // Remap direct register operands
         if (op.is_reg())
         {
-            unsigned old_reg = op.reg();
-            auto it = vreg_map.find(old_reg);
-            if (it != vreg_map.end())
-            {
-                // Found a mapping, replace with physical register
-                bool is_def = op.is_def();
-
-                op = MOperand::create_reg(it->second, is_def);
-            }
-        }
-
-        // Remap base register in memory operands
-        if (op.is_mem_ri())
-        {
-            MOperand::MEMri mem = op.mem_ri();
-            auto it = vreg_map.find(mem.base_reg);
-            if (it != vreg_map.end())
+            if (op.reg() == old_reg)
             {
-                op = MOperand::create_mem_ri(it->second, mem.offset);
+                op.set_reg(new_reg);
+                changed = true;
             }
         }
-
-        // Remap register-register memory operands
-        if (op.is_mem_rr())
+        else if (op.is_mem_ri() || op.is_mem_rr() || op.is_mem_rix())
         {
-            MOperand::MEMrr mem = op.mem_rr();
-            unsigned new_base = mem.base_reg;
-            unsigned new_index = mem.index_reg;
-            bool changed = false;
-
-            auto base_it = vreg_map.find(mem.base_reg);
-            if (base_it != vreg_map.end())
+            if (op.base_reg() == old_reg)
             {
-                new_base = base_it->second;
+                op.set_base_reg(new_reg);
                 changed = true;
             }
-
-            auto index_it = vreg_map.find(mem.index_reg);
-            if (index_it != vreg_map.end())
+            if (op.is_mem_rr() && op.mem_rr().index_reg == old_reg)
             {
-                new_index = index_it->second;
+                op.set_index_reg(new_reg);
                 changed = true;
             }
-
-            if (changed)
+            else if (op.is_mem_rix() && op.get_mem_rix().index_reg == old_reg)
             {
-                op = MOperand::create_mem_rr(new_base, new_index);
-            }
-        }
-
-        // Remap scaled index memory operands
-        if (op.is_mem_rix())
-        {
-            MOperand::MEMrix mem = op.get_mem_rix();
-            unsigned new_base = mem.base_reg;
-            unsigned new_index = mem.index_reg;
-            bool changed = false;
-
-            auto base_it = vreg_map.find(mem.base_reg);
-            if (base_it != vreg_map.end())
-            {
-                new_base = base_it->second;
+                op.set_index_reg(new_reg);
                 changed = true;
             }
+        }
+    }
+    // 活跃分析据此只修补这两个寄存器
+    if (changed && old_reg != new_reg && parent_bb_)
+        parent_bb_->parent()->live_range_analyzer()->registers_rewritten(this, old_reg, new_reg);
+}
 
-            auto index_it = vreg_map.find(mem.index_reg);
-            if (index_it != vreg_map.end())
-            {
-                new_index = index_it->second;
-                changed = true;
-            }
+void MachineInst::remap_registers(std::span<const unsigned> vreg_map)
+{
+    // 改写过的寄存器对，最后一起报给活跃分析
+    struct Rename
+    {
+        unsigned from, to;
+        bool operator==(const Rename &) const = default;
+    };
+    SmallVector<Rename, INLINE_OPERANDS> renamed;
+    auto mapped = [&](unsigned reg)
+    {
+        if (!MachineFunction::is_virtual_reg(reg))
+            return reg;
+        const unsigned index = MachineFunction::vreg_index(reg);
+        if (index >= vreg_map.size() || vreg_map[index] == NO_REG || vreg_map[index] == reg)
+            return reg;
+        const Rename rename{reg, vreg_map[index]};
+        if (std::find(renamed.begin(), renamed.end(), rename) == renamed.end())
+            renamed.push_back(rename);
+        return vreg_map[index];
+    };
 
-            if (changed)
-            {
-                op = MOperand::create_mem_rix(new_base, new_index, mem.scale, mem.offset);
-            }
+    for (auto &op : ops_)
+    {
+        if (op.is_reg())
+        {
+            op.set_reg(mapped(op.reg()));
+        }
+        else if (op.is_mem_ri() || op.is_mem_rr() || op.is_mem_rix())
+        {
+            op.set_base_reg(mapped(op.base_reg()));
+            if (op.is_mem_rr())
+                op.set_index_reg(mapped(op.mem_rr().index_reg));
+            else if (op.is_mem_rix())
+                op.set_index_reg(mapped(op.get_mem_rix().index_reg));
         }
     }
+    if (!parent_bb_)
+        return;
+    for (const Rename &rename : renamed)
+        parent_bb_->parent()->live_range_analyzer()->registers_rewritten(this, rename.from, rename.to);
 }
+
 std::set<unsigned> MachineInst::uses() const
 {
     std::set<unsigned> regs;
@@ -689,6 +613,7 @@ std::set<unsigned> MachineInst::uses() const
             regs.insert(mem.index_reg);
         }
     }
+    regs.insert(implicit_uses().begin(), implicit_uses().end());
 
     // remove ZERO register from set
     return regs;
@@ -706,6 +631,7 @@ std::set<unsigned> MachineInst::defs() const
             regs.insert(op.reg());
         }
     }
+    regs.insert(implicit_defs().begin(), implicit_defs().end());
 
     // remove ZERO register from set
     return regs;
@@ -722,29 +648,39 @@ MachineBasicBlock::MachineBasicBlock(MachineFunction &machine_function,
 MachineBasicBlock::iterator MachineBasicBlock::insert(
     iterator pos, std::unique_ptr<MachineInst> inst)
 {
-    mf_.mark_global_positions_dirty();
-    mf_.live_range_analyzer()->mark_dirty();
     inst->parent_bb_ = this;
-    return insts_.insert(pos, std::move(inst));
+    auto it = insts_.insert(pos, std::move(inst));
+    mf_.slot_indexes().instruction_inserted(this, it - insts_.begin());
+    mf_.live_range_analyzer()->instruction_inserted(it->get());
+    return it;
 }
 
 void MachineBasicBlock::erase(iterator pos)
 {
-    mf_.mark_global_positions_dirty();
-    mf_.live_range_analyzer()->mark_dirty();
+    // The freed index just widens the gap around it
+    mf_.live_range_analyzer()->instruction_removed(pos->get());
     insts_.erase(pos);
 }
 
 void MachineBasicBlock::append(std::unique_ptr<MachineInst> mi)
 {
-    mf_.mark_global_positions_dirty();
-    mf_.live_range_analyzer()->mark_dirty();
     mi->parent_bb_ = this;
     insts_.push_back(std::move(mi));
+    mf_.slot_indexes().instruction_inserted(this, insts_.size() - 1);
+    mf_.live_range_analyzer()->instruction_inserted(insts_.back().get());
 }
 
 MachineBasicBlock::iterator MachineBasicBlock::locate(const MachineInst *mi)
 {
+    // Indexes increase along the block, so a numbered block can be searched
+    if (mi->parent() == this && mf_.slot_indexes().is_valid())
+    {
+        auto it = std::lower_bound(insts_.begin(), insts_.end(), mi->slot_,
+                                   [](const std::unique_ptr<MachineInst> &inst, size_t slot)
+                                   { return inst->slot_ < slot; });
+        if (it != insts_.end() && it->get() == mi)
+            return it;
+    }
     auto it = std::find_if(insts_.begin(), insts_.end(), [mi](const std::unique_ptr<MachineInst> &ptr)
                            { return ptr.get() == mi; });
     return it;
@@ -777,7 +713,6 @@ MachineBasicBlock *MachineBasicBlock::prev_physical_block() const
 
 void MachineBasicBlock::add_successor(MachineBasicBlock *successor)
 {
-    mf_.mark_global_positions_dirty();
     mf_.live_range_analyzer()->mark_dirty();
     successors_.insert(successor);
     successor->predecessors_.insert(this);
@@ -785,7 +720,6 @@ void MachineBasicBlock::add_successor(MachineBasicBlock *successor)
 
 void MachineBasicBlock::remove_successor(MachineBasicBlock *successor)
 {
-    mf_.mark_global_positions_dirty();
     mf_.live_range_analyzer()->mark_dirty();
     auto it = std::find(successors_.begin(), successors_.end(), successor);
     if (it != successors_.end())
@@ -799,7 +733,6 @@ void MachineBasicBlock::remove_successor(MachineBasicBlock *successor)
 
 void MachineBasicBlock::add_predecessor(MachineBasicBlock *predecessor)
 {
-    mf_.mark_global_positions_dirty();
     mf_.live_range_analyzer()->mark_dirty();
     predecessors_.insert(predecessor);
     predecessor->successors_.insert(this);
@@ -807,7 +740,6 @@ void MachineBasicBlock::add_predecessor(MachineBasicBlock *predecessor)
 
 void MachineBasicBlock::remove_predecessor(MachineBasicBlock *predecessor)
 {
-    mf_.mark_global_positions_dirty();
     mf_.live_range_analyzer()->mark_dirty();
     auto it = std::find(predecessors_.begin(), predecessors_.end(), predecessor);
     if (it != predecessors_.end())
@@ -823,7 +755,7 @@ size_t MachineBasicBlock::global_start() const
 {
     auto it = insts_.begin();
     if (it == insts_.end())
-        return 0;
+        return mf_.slot_indexes().block_start(this);
 
     return mf_.get_global_instr_pos((*it).get());
 }
@@ -831,12 +763,19 @@ size_t MachineBasicBlock::global_end_inclusive() const
 {
     auto it = insts_.end();
     if (it == insts_.begin())
-        return 0;
+        return mf_.slot_indexes().block_start(this);
 
     it--;
     return mf_.get_global_instr_pos((*it).get());
 }
 
+size_t MachineBasicBlock::global_end() const
+{
+    if (insts_.empty())
+        return global_start();
+    return mf_.slot_indexes().next_index(insts_.back().get());
+}
+
 std::string MachineBasicBlock::to_string() const
 {
     std::ostringstream oss;
@@ -867,52 +806,33 @@ MachineBasicBlock *MachineFunction::create_block(std::string label)
         std::make_unique<MachineBasicBlock>(*this, next_bb_number_, std::move(label));
     auto *ptr = block.get();
     blocks_.push_back(std::move(block));
+    slot_indexes_.block_created(ptr);
     next_bb_number_++;
     return ptr;
 }
 
 void MachineFunction::ensure_global_positions_computed() const
 {
-    if (!global_positions_dirty_)
-        return;
-
-    MO_DEBUG("Recomputing global instruction positions");
-
-    // Reset global instruction positions
-    global_instr_positions_.clear();
-    next_global_pos_ = 0;
-
-    // Traverse all instructions in basic block order
-    for (const auto &bb : blocks_)
-    {
-        for (const auto &inst : bb->instructions())
-        {
-            global_instr_positions_[inst.get()] = next_global_pos_++;
-            // printf("Global position for %p is %d\n", inst.get(), next_global_pos_);
-        }
-    }
-    global_positions_dirty_ = false;
-
-    MO_DEBUG("%zu global instruction positions computed", global_instr_positions_.size());
+    slot_indexes_.ensure_numbered();
 }
 
 unsigned MachineFunction::create_vreg(unsigned register_class_id, unsigned size,
                                       bool is_fp, Value *original_value)
 {
-    vreg_infos_[next_vreg_] = {register_class_id, size, is_fp, original_value};
+    vreg_infos_.push_back({register_class_id, size, is_fp, original_value});
     return next_vreg_++;
 }
 
 unsigned MachineFunction::clone_vreg(unsigned vreg) {
-    vreg_infos_[next_vreg_] = vreg_infos_[vreg];
+    const VRegInfo info = get_vreg_info(vreg);
+    vreg_infos_.push_back(info);
     return next_vreg_++;
 }
 
 const VRegInfo &MachineFunction::get_vreg_info(unsigned reg) const
 {
-    auto it = vreg_infos_.find(reg);
-    MO_ASSERT(it != vreg_infos_.end(), "Invalid virtual register: %u", reg);
-    return it->second;
+    MO_ASSERT(is_virtual_reg(reg) && vreg_index(reg) < vreg_infos_.size(), "Invalid virtual register: %u", reg);
+    return vreg_infos_[vreg_index(reg)];
 }
 
 std::string MachineFunction::to_string() const
@@ -926,7 +846,7 @@ std::string MachineFunction::to_string() const
     }
 
     oss << "Virtual registers:\n";
-    for (const auto &[vreg, info] : vreg_infos_)
+    for (unsigned vreg = FIRST_VIRT_REG; vreg < next_vreg_; ++vreg)
     {
         oss << "  vreg" << vreg
             // << " [" << info.lr.start << "-" << info.lr.end
@@ -1085,6 +1005,43 @@ std::vector<unsigned> TargetRegisterInfo::get_allocation_order(unsigned reg_clas
     return get_allocatable_regs(reg_class_id);
 }
 
+void TargetRegisterInfo::build_allocation_tables() const
+{
+    allocation_orders_.resize(register_classes_.size());
+    alias_masks_.assign(reg_descs_.size(), std::vector<uint64_t>(register_classes_.size(), 0));
+    for (unsigned rc_id = 0; rc_id < register_classes_.size(); ++rc_id)
+    {
+        allocation_orders_[rc_id] = get_allocation_order(rc_id);
+        const auto &order = allocation_orders_[rc_id];
+        MO_ASSERT(order.size() <= MAX_CLASS_REGS, "Register class %u has %zu registers", rc_id, order.size());
+        for (unsigned i = 0; i < order.size(); ++i)
+        {
+            const uint64_t bit = uint64_t(1) << i;
+            alias_masks_[order[i]][rc_id] |= bit;
+            for (unsigned alias : alias_map_[order[i]])
+                alias_masks_[alias][rc_id] |= bit;
+        }
+    }
+}
+
+std::span<const unsigned> TargetRegisterInfo::allocation_order(unsigned reg_class_id) const
+{
+    std::call_once(allocation_tables_once_, [this]
+                   { build_allocation_tables(); });
+    if (reg_class_id >= allocation_orders_.size())
+        return {};
+    return allocation_orders_[reg_class_id];
+}
+
+uint64_t TargetRegisterInfo::alias_mask(unsigned reg, unsigned reg_class_id) const
+{
+    std::call_once(allocation_tables_once_, [this]
+                   { build_allocation_tables(); });
+    if (reg >= alias_masks_.size() || reg_class_id >= register_classes_.size())
+        return 0;
+    return alias_masks_[reg][reg_class_id];
+}
+
 bool TargetRegisterInfo::can_allocate_reg(unsigned reg, bool ignore_reserved) const
 {
     if (reg >= reg_descs_.size())
@@ -1169,6 +1126,12 @@ MachineFunction *MachineModule::create_machine_function(Function *function)
     return functions_.back().get();
 }
 
+const char *MachineModule::intern_symbol(std::string_view name)
+{
+    std::lock_guard<std::mutex> lock(symbols_mutex_);
+    return symbols_.emplace(name).first->c_str();
+}
+
 void MachineModule::set_target_info(const TargetRegisterInfo *tri,
                                     const TargetInstInfo *tii)
 {
@@ -1190,6 +1153,21 @@ MachineFunction::iterator MachineFunction::locate(const MachineBasicBlock *mbb)
                             });
     return ret;
 }
+void MachineFunction::reorder_blocks(const std::vector<MachineBasicBlock *> &order)
+{
+    assert(order.size() == blocks_.size());
+    std::unordered_map<const MachineBasicBlock *, std::unique_ptr<MachineBasicBlock>> owned;
+    for (auto &mbb : blocks_)
+        owned.emplace(mbb.get(), std::move(mbb));
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        auto it = owned.find(order[i]);
+        assert(it != owned.end() && it->second && "Block listed twice or not in this function");
+        blocks_[i] = std::move(it->second);
+    }
+    mark_global_positions_dirty();
+}
+
 void MachineFunction::build_cfg()
 {
     auto &mf = *this;
@@ -1294,14 +1272,14 @@ void MachineFunction::dump_cfg(std::ostream &out) const
 
         // 输出 Use/Def
         out << "USE: {";
-        for (unsigned reg : lra_->block_info(bb.get()).use)
+        for (unsigned reg : lra_->upward_exposed_uses(bb.get()))
         {
             out << reg << " ";
         }
         out << "}\\l";
 
         out << "DEF: {";
-        for (unsigned reg : lra_->block_info(bb.get()).def)
+        for (unsigned reg : lra_->block_defs(bb.get()))
         {
             out << reg << " ";
         }
@@ -1309,14 +1287,14 @@ void MachineFunction::dump_cfg(std::ostream &out) const
 
         // 输出 In/Out
         out << " IN: {";
-        for (unsigned reg : lra_->block_info(bb.get()).in)
+        for (unsigned reg : lra_->live_in(bb.get()))
         {
             out << reg << " ";
         }
         out << "}\\l";
 
         out << "OUT: {";
-        for (unsigned reg : lra_->block_info(bb.get()).out)
+        for (unsigned reg : lra_->live_out(bb.get()))
         {
             out << reg << " ";
         }
@@ -1376,7 +1354,6 @@ void MachineFunction::export_cfg_to_json(std::ostream &os) const
         }
         first_bb = false;
 
-        const auto &bi = lra_->block_info(bb.get());
 
         os << "{\n";
         os << "\"label\": \"" << bb->label() << "\",\n";
@@ -1440,10 +1417,10 @@ void MachineFunction::export_cfg_to_json(std::ostream &os) const
         os << "\n"
            << "],\n";
 
-        os << "\"use\": [" << mo_join(bi.use, ",") << "],\n";
-        os << "\"def\": [" << mo_join(bi.def, ",") << "],\n";
-        os << "\"in\": [" << mo_join(bi.in, ",") << "],\n";
-        os << "\"out\": [" << mo_join(bi.out, ",") << "]\n";
+        os << "\"use\": [" << mo_join(lra_->upward_exposed_uses(bb.get()), ",") << "],\n";
+        os << "\"def\": [" << mo_join(lra_->block_defs(bb.get()), ",") << "],\n";
+        os << "\"in\": [" << mo_join(lra_->live_in(bb.get()), ",") << "],\n";
+        os << "\"out\": [" << mo_join(lra_->live_out(bb.get()), ",") << "]\n";
 
         os << "}";
     }
@@ -7,9 +7,14 @@
 #include <cassert>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <set>
+#include <span>
 #include <sstream>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -18,6 +23,10 @@
 #include "lra.h"
 #include "reg_alloc.h"
 #include "machine_frame.h"
+#include "slab_allocator.h"
+#include "slot_indexes.h"
+#include "small_vector.h"
+#include "vreg_table.h"
 
 // Forward declarations
 class CallingConv;
@@ -99,6 +108,11 @@ struct CallingConventionRules
 // Machine Operand Types
 //===----------------------------------------------------------------------===//
 
+// Sixteen bytes, trivially copyable: a tag, the def flag and one register
+// or frame index word, then an eight-byte payload. Symbol and label
+// operands hold a pointer to a name they don't own; build them from a
+// literal or from MachineModule::intern_symbol, which keeps the name for
+// the module's lifetime.
 class MOperand
 {
 public:
@@ -123,17 +137,14 @@ public:
         int offset;
     };
 
-    struct ExternalSymbol
+    // A frame object plus offset, before the frame layout is final
+    struct MEMfi
     {
-        std::string value;
-    };
-
-    struct Label
-    {
-        std::string value;
+        int frame_index;
+        int offset;
     };
 
-    enum class MOperandType : unsigned
+    enum class MOperandType : uint8_t
     {
         Invalid,
         Register,
@@ -146,28 +157,28 @@ public:
         BasicBlock,
         MEMri,
         MEMrr,
-        MEMrix
+        MEMrix,
+        MEMfi
     };
 
 private:
-    using Storage = std::variant<
-        std::monostate,      // Invalid
-        unsigned,            // Register (physical/virtual register number)
-        int64_t,             // Immediate (integer immediate)
-        double,              // FPImmediate (floating-point immediate)
-        int,                 // FrameIndex (stack frame index)
-        GlobalVariable *,    // Global (global variable)
-        ExternalSymbol,      // ExternalSym (external symbol)
-        Label,               // Label (label to be resolved to a constant value)
-        MachineBasicBlock *, // BasicBlock (basic block reference)
-        MEMri,               // MEMri memory operand
-        MEMrr,               // MEMrr memory operand
-        MEMrix               // MEMrix memory operand
-        >;
-
-    Storage storage_;
     MOperandType type_ = MOperandType::Invalid;
     bool is_def_ = false; // Is this a definition.
+    int8_t scale_ = 0;    // MEMrix
+    // Register, base register (MEMri, MEMrr, MEMrix) or frame index
+    // (FrameIndex, MEMfi)
+    unsigned word_ = 0;
+    union Payload
+    {
+        int64_t imm = 0;
+        double fp_imm;
+        const void *ptr; // GlobalVariable, MachineBasicBlock or a name
+        struct
+        {
+            unsigned index_reg; // MEMrr, MEMrix
+            int offset;         // MEMri, MEMrix, MEMfi
+        } mem;
+    } payload_;
 
 public:
     MOperand() = default;
@@ -176,19 +187,22 @@ public:
     MOperand &operator=(const MOperand &) = default;
     MOperand &operator=(MOperand &&) = default;
 
+    MOperandType type() const noexcept { return type_; }
+
     // Type checking methods
-    bool is_reg() const noexcept;
-    bool is_imm() const noexcept;
-    bool is_fp_imm() const noexcept;
-    bool is_frame_index() const noexcept;
-    bool is_global() const noexcept;
-    bool is_external_sym() const noexcept;
-    bool is_label() const noexcept;
-    bool is_basic_block() const noexcept;
-    bool is_mem_ri() const noexcept;
-    bool is_mem_rr() const noexcept;
-    bool is_mem_rix() const noexcept;
-    bool is_valid() const noexcept;
+    bool is_reg() const noexcept { return type_ == MOperandType::Register; }
+    bool is_imm() const noexcept { return type_ == MOperandType::Immediate; }
+    bool is_fp_imm() const noexcept { return type_ == MOperandType::FPImmediate; }
+    bool is_frame_index() const noexcept { return type_ == MOperandType::FrameIndex; }
+    bool is_global() const noexcept { return type_ == MOperandType::GlobalAddress; }
+    bool is_external_sym() const noexcept { return type_ == MOperandType::ExternalSymbol; }
+    bool is_label() const noexcept { return type_ == MOperandType::Label; }
+    bool is_basic_block() const noexcept { return type_ == MOperandType::BasicBlock; }
+    bool is_mem_ri() const noexcept { return type_ == MOperandType::MEMri; }
+    bool is_mem_rr() const noexcept { return type_ == MOperandType::MEMrr; }
+    bool is_mem_rix() const noexcept { return type_ == MOperandType::MEMrix; }
+    bool is_mem_fi() const noexcept { return type_ == MOperandType::MEMfi; }
+    bool is_valid() const noexcept { return type_ != MOperandType::Invalid; }
 
     // Creation methods
     static MOperand create_reg(unsigned reg, bool is_def = false);
@@ -196,13 +210,14 @@ public:
     static MOperand create_fp_imm(double val);
     static MOperand create_frame_index(int index);
     static MOperand create_global(GlobalVariable *global_variable);
-    static MOperand create_external_sym(std::string value);
-    static MOperand create_label(std::string value);
+    static MOperand create_external_sym(const char *symbol);
+    static MOperand create_label(const char *label);
     static MOperand create_basic_block(MachineBasicBlock *bb);
     static MOperand create_mem_ri(unsigned base_reg, int offset);
     static MOperand create_mem_rr(unsigned base_reg, unsigned index_reg);
     static MOperand create_mem_rix(unsigned base_reg, unsigned index_reg, int scale,
                                    int offset);
+    static MOperand create_mem_fi(int frame_index, int offset);
 
     // Access methods
     unsigned reg() const;
@@ -216,13 +231,22 @@ public:
     MEMri mem_ri() const;
     MEMrr mem_rr() const;
     MEMrix get_mem_rix() const;
+    MEMfi mem_fi() const;
     unsigned base_reg() const;
 
+    // Rewrites the register, or a memory operand's base register, in place
+    void set_reg(unsigned reg);
+    void set_base_reg(unsigned reg);
+    // Index register of a MEMrr or MEMrix operand
+    void set_index_reg(unsigned reg);
+
     bool is_def() const { return is_def_; }
 
     std::string to_string() const;
 };
 
+static_assert(sizeof(MOperand) == 16, "MOperand should stay compact");
+
 //===----------------------------------------------------------------------===//
 // Machine Instructions
 //===----------------------------------------------------------------------===//
@@ -258,27 +282,68 @@ public:
         TARGET_SPECIFIC  // Target-related deep validation
     };
 
+    // Operands kept in the instruction itself before spilling to the heap;
+    // enough for every three-address form
+    static constexpr size_t INLINE_OPERANDS = 3;
+    using OperandList = SmallVector<MOperand, INLINE_OPERANDS>;
+
+    // remap_registers entry for a virtual register left as it is
+    static constexpr unsigned NO_REG = ~0u;
+
+    // Allocated from the pool of the MachineFunction named by the innermost
+    // MachineInstPoolScope on this thread, or from the heap outside of one
+    static void *operator new(size_t size);
+    static void operator delete(void *ptr, size_t size) noexcept;
+
 private:
     unsigned opcode_;
-    std::vector<MOperand> ops_;
+    OperandList ops_;
+    // Physical registers read or written without an operand of their own.
+    // Only calls have any, so the lists live out of line
+    struct ImplicitRegs
+    {
+        std::vector<unsigned> uses;
+        std::vector<unsigned> defs;
+    };
+    std::unique_ptr<ImplicitRegs> implicit_;
+    inline static const std::vector<unsigned> NO_IMPLICIT_REGS{};
     FlagSet flags_;
     MachineBasicBlock *parent_bb_ = nullptr;
+    size_t slot_ = 0; // Maintained by SlotIndexes
 
     friend class MachineBasicBlock;
+    friend class SlotIndexes;
+
+    ImplicitRegs &implicit_regs()
+    {
+        if (!implicit_)
+            implicit_ = std::make_unique<ImplicitRegs>();
+        return *implicit_;
+    }
 
 public:
-    MachineInst(unsigned opcode, const std::vector<MOperand> &operands = {});
+    explicit MachineInst(unsigned opcode) : opcode_(opcode) {}
+    MachineInst(const MachineInst &other);
+    MachineInst &operator=(const MachineInst &other);
+    MachineInst(unsigned opcode, std::initializer_list<MOperand> operands) : opcode_(opcode), ops_(operands) {}
+    MachineInst(unsigned opcode, std::span<const MOperand> operands) : opcode_(opcode), ops_(operands) {}
 
     size_t position() const;
     void erase_from_parent() const;
-    // Register allocation support
+    // Register allocation support. Both report what they rename to the
+    // function's LiveRangeAnalyzer once the instruction is in a block
     void replace_reg(unsigned old_reg, unsigned new_reg);
-    void remap_registers(const std::map<unsigned, unsigned> &vreg_map);
+    // Renames virtual register v to vreg_map[MachineFunction::vreg_index(v)]
+    // unless that is NO_REG or past the end of the map
+    void remap_registers(std::span<const unsigned> vreg_map);
 
     // Flag operations
     void set_flag(MIFlag flag, bool val = true);
     bool has_flag(MIFlag flag) const;
     void clear_all_flags() { flags_.reset(); }
+    // A jump into another function that ends this one, leaving the callee to
+    // return to our caller; flagged both Call and Terminator
+    bool is_tail_call() const { return has_flag(MIFlag::Call) && has_flag(MIFlag::Terminator); }
 
     // Operand management
     MOperand &operand(unsigned index) { return ops_.at(index); }
@@ -287,6 +352,14 @@ public:
     void remove_operand(unsigned index);
     bool is_operand_def(unsigned index) const noexcept;
 
+    // A call reads the argument registers it passes and clobbers whatever
+    // the callee may overwrite. Both count in uses() and defs(), so liveness
+    // and allocation see them, but they are never encoded
+    const std::vector<unsigned> &implicit_uses() const { return implicit_ ? implicit_->uses : NO_IMPLICIT_REGS; }
+    const std::vector<unsigned> &implicit_defs() const { return implicit_ ? implicit_->defs : NO_IMPLICIT_REGS; }
+    void set_implicit_uses(std::vector<unsigned> regs) { implicit_regs().uses = std::move(regs); }
+    void set_implicit_defs(std::vector<unsigned> regs) { implicit_regs().defs = std::move(regs); }
+
     // Verification and string conversion
     bool verify(VerificationLevel level, const TargetInstInfo *target_info = nullptr,
                 std::string *err_msg = nullptr) const;
@@ -295,7 +368,7 @@ public:
 public:
     // Accessors
     unsigned opcode() const { return opcode_; }
-    const std::vector<MOperand> &operands() const { return ops_; }
+    std::span<const MOperand> operands() const { return ops_; }
     MachineBasicBlock *parent() const { return parent_bb_; }
 
     // Analysis methods
@@ -321,6 +394,12 @@ private:
     std::unordered_set<MachineBasicBlock *> predecessors_;
     std::unordered_set<MachineBasicBlock *> successors_;
     mutable std::unique_ptr<PressureTracker> pressure_tracker_;
+    // Index range owned in the function's SlotIndexes
+    size_t slot_start_ = 0;
+    size_t slot_end_ = 0;
+    std::optional<uint64_t> profile_count_;
+
+    friend class SlotIndexes;
 
 public:
     MachineBasicBlock(MachineFunction &mf, unsigned number, std::string label);
@@ -355,9 +434,17 @@ public:
 
     size_t global_start() const;
     size_t global_end_inclusive() const;
+    // Index of the first instruction after this block's
+    size_t global_end() const;
     // Label management
     void set_label(const std::string &label) { label_ = label; }
 
+    // Times the block ran in a profiled run, carried over from the IR block
+    // or the branch edge it was selected from
+    bool has_profile_count() const { return profile_count_.has_value(); }
+    uint64_t profile_count() const { return profile_count_.value_or(0); }
+    void set_profile_count(uint64_t count) { profile_count_ = count; }
+
     std::string to_string() const;
     size_t index() const { return number_; }
 
@@ -386,7 +473,10 @@ class MachineFunction
 private:
     Function *ir_func_; // Source IR function
     MachineModule *mm_; // Target machine module
-    static const unsigned FIRST_VIRT_REG = 1000;
+
+    // Backs the instructions created under a MachineInstPoolScope for this
+    // function; declared before the blocks so it outlives them
+    SlabAllocator inst_pool_{4096};
 
     // Basic blocks
     std::vector<std::unique_ptr<MachineBasicBlock>> blocks_;
@@ -396,16 +486,13 @@ private:
 
     // Virtual register management
     unsigned next_vreg_ = FIRST_VIRT_REG; // Virtual register counter
-    std::unordered_map<unsigned, VRegInfo> vreg_infos_;
+    std::vector<VRegInfo> vreg_infos_;    // Indexed by vreg_index()
 
     // Analysis results
     mutable std::unique_ptr<LiveRangeAnalyzer> lra_;
 
-    // Global instruction position map: instruction pointer -> global position
-    mutable std::unordered_map<const MachineInst *, size_t>
-        global_instr_positions_;
-    mutable size_t next_global_pos_ = 0;
-    mutable bool global_positions_dirty_ = true;
+    // Instruction positions
+    SlotIndexes slot_indexes_{*this};
 
     // Register allocation
     std::unique_ptr<RegisterAllocator> reg_allocator_;
@@ -418,12 +505,16 @@ private:
 
     unsigned next_bb_number_ = 0; // Basic block number generator
 
+    CallingConv::ID call_conv_ = CallingConv::C;
+
 public:
     using iterator = std::vector<std::unique_ptr<MachineBasicBlock>>::iterator;
     using const_iterator = std::vector<std::unique_ptr<MachineBasicBlock>>::const_iterator;
 
     static bool is_physical_reg(unsigned reg) { return reg < FIRST_VIRT_REG; }
     static bool is_virtual_reg(unsigned reg) { return reg >= FIRST_VIRT_REG; }
+    // Position of a virtual register in tables indexed densely by vreg
+    static unsigned vreg_index(unsigned reg) { return reg - FIRST_VIRT_REG; }
 
     explicit MachineFunction(Function *ir_function, MachineModule *mm)
         : ir_func_(ir_function), mm_(mm), frame_(new MachineFrame())
@@ -442,6 +533,8 @@ public:
     MachineBasicBlock *create_block(std::string label = "");
     const std::vector<std::unique_ptr<MachineBasicBlock>> &basic_blocks() const;
     iterator locate(const MachineBasicBlock *mbb);
+    // Lays the blocks out in `order`, which must hold each of them once
+    void reorder_blocks(const std::vector<MachineBasicBlock *> &order);
     void build_cfg();
     void dump_cfg(std::ostream &out) const;
     void export_text(std::ostream &out) const;
@@ -454,6 +547,8 @@ public:
     unsigned clone_vreg(unsigned vreg);
 
     const VRegInfo &get_vreg_info(unsigned reg) const;
+    // Virtual registers created so far; their vreg_index() runs below this
+    unsigned num_vregs() const { return next_vreg_ - FIRST_VIRT_REG; }
 
     // Helper function to ensure global positions are computed
     void ensure_global_positions_computed() const;
@@ -465,24 +560,43 @@ public:
     int create_register_spill_slot(unsigned vreg, unsigned reg_class_id);
 
     // Instruction position management
-    void mark_global_positions_dirty() { global_positions_dirty_ = true; }
-    size_t get_global_instr_pos(const MachineInst *mi) const
-    {
-        ensure_global_positions_computed();
-        MO_ASSERT(global_instr_positions_.count(mi) != 0, "Instruction %p not found in global position map!", mi);
-        return global_instr_positions_.at(mi);
-    }
+    void mark_global_positions_dirty() { slot_indexes_.invalidate(); }
+    size_t get_global_instr_pos(const MachineInst *mi) const { return slot_indexes_.index(mi); }
+    SlotIndexes &slot_indexes() { return slot_indexes_; }
+    const SlotIndexes &slot_indexes() const { return slot_indexes_; }
 
-    CallingConv::ID call_convention() const { return CallingConv::C; }
+    // How this function takes its arguments; set by instruction selection
+    CallingConv::ID call_convention() const { return call_conv_; }
+    void set_call_convention(CallingConv::ID cc) { call_conv_ = cc; }
 
     std::unique_ptr<PressureTracker> compute_pressure() const;
 
     MachineModule *parent() const { return mm_; }
+    Function *ir_function() const { return ir_func_; }
     LiveRangeAnalyzer *live_range_analyzer() const { return lra_.get(); }
     MachineFrame *frame() const { return frame_.get(); }
+    SlabAllocator &inst_pool() { return inst_pool_; }
+    const SlabAllocator &inst_pool() const { return inst_pool_; }
     std::string to_string() const;
 };
 
+// Makes `mf`'s pool where MachineInsts created on this thread are allocated
+// while the scope is alive. Scopes nest; the previous pool is restored on
+// exit. Instructions made under a scope must stay in that function.
+class MachineInstPoolScope
+{
+public:
+    explicit MachineInstPoolScope(MachineFunction &mf);
+    ~MachineInstPoolScope();
+    MachineInstPoolScope(const MachineInstPoolScope &) = delete;
+    MachineInstPoolScope &operator=(const MachineInstPoolScope &) = delete;
+
+    static SlabAllocator *current();
+
+private:
+    SlabAllocator *previous_;
+};
+
 //===----------------------------------------------------------------------===//
 // Target Description Classes
 //===----------------------------------------------------------------------===//
@@ -527,7 +641,19 @@ protected:
 
     const std::vector<unsigned> empty_reg_list_;
 
+    // Per-class allocation orders and, for each register, the positions in
+    // every class's order it or one of its aliases takes. Built once, on
+    // first use, from get_allocation_order, so target overrides are honoured;
+    // classes and aliases must all be registered by then
+    mutable std::once_flag allocation_tables_once_;
+    mutable std::vector<std::vector<unsigned>> allocation_orders_;
+    mutable std::vector<std::vector<uint64_t>> alias_masks_;
+    void build_allocation_tables() const;
+
 public:
+    // Position masks are one machine word
+    static constexpr unsigned MAX_CLASS_REGS = 64;
+
     virtual ~TargetRegisterInfo() = default;
     explicit TargetRegisterInfo(unsigned num_regs)
         : reg_descs_(num_regs), alias_map_(num_regs) {}
@@ -536,6 +662,8 @@ public:
     bool is_callee_saved(CallingConv::ID cc, unsigned reg) const { return call_conventions_.at(cc).callee_saved_regs.count(reg); }
     bool is_caller_saved(CallingConv::ID cc, unsigned reg) const { return call_conventions_.at(cc).caller_saved_regs.count(reg); }
     bool is_temp_reg(CallingConv::ID cc, unsigned reg) const { return call_conventions_.at(cc).temp_regs.count(reg); }
+    bool supports_tail_call(CallingConv::ID cc) const { return call_conventions_.at(cc).supports_tail_call; }
+    bool has_call_convention(CallingConv::ID cc) const { return call_conventions_.count(cc) != 0; }
     bool is_reserved_reg(unsigned reg) const { return reg_descs_[reg].is_reserved; }
     unsigned get_spill_cost(unsigned reg) const { return reg_descs_[reg].spill_cost; }
     unsigned get_primary_reg_class(unsigned reg) const
@@ -565,6 +693,10 @@ public:
     virtual std::vector<unsigned> get_temp_regs(CallingConv::ID cc, unsigned reg_class_id) const;
     virtual std::vector<unsigned> get_allocatable_regs(unsigned reg_class_id) const;
     virtual std::vector<unsigned> get_allocation_order(unsigned reg_class_id) const;
+    // get_allocation_order, precomputed; stays valid as long as the target
+    std::span<const unsigned> allocation_order(unsigned reg_class_id) const;
+    // Bit i set when `reg` is allocation_order(reg_class_id)[i] or aliases it
+    uint64_t alias_mask(unsigned reg, unsigned reg_class_id) const;
     virtual bool can_allocate_reg(unsigned reg, bool ignore_reserved = false) const;
     virtual unsigned get_reg_size_in_bytes(unsigned reg) const;
     virtual unsigned get_suitable_reg_class(unsigned vreg) const;
@@ -601,6 +733,15 @@ public:
     // Special instruction identification
     virtual bool is_return(const MachineInst &mi) const = 0;
     virtual bool is_call(const MachineInst &mi) const = 0;
+    // Plain register-to-register copies, in the forms copy_phys_reg emits;
+    // register allocation coalesces them away
+    virtual bool is_copy(const MachineInst &mi, unsigned &dest_reg, unsigned &src_reg) const { return false; }
+    // Instructions that define one register from nothing but immediates,
+    // frame indices, symbols and registers allocation never hands out, so a
+    // copy computes the same value anywhere in the function. Register
+    // allocation re-emits such a definition at the uses of a value it
+    // would otherwise spill
+    virtual bool is_trivially_rematerializable(const MachineInst &mi) const { return false; }
 
     // Immediate legality check
     virtual bool is_legal_immediate(int64_t immediate,
@@ -640,6 +781,13 @@ public:
         std::unordered_set<MachineBasicBlock *> &branch_targets /*out*/,
         MachineBasicBlock *&fall_through /*out*/
     ) const = 0;
+
+    // Opcode of the conditional branch taken exactly when `opcode` isn't,
+    // with the same operands, or 0 if it has none or isn't one
+    virtual unsigned get_inverse_branch_opcode(unsigned opcode) const { return 0; }
+    // Unconditional jump to `target`, flagged as a terminator; null if the
+    // target can't build one
+    virtual std::unique_ptr<MachineInst> build_jump(MachineBasicBlock *target) const { return nullptr; }
 };
 
 //===----------------------------------------------------------------------===//
@@ -665,6 +813,9 @@ public:
 
     virtual void emit_stack_protector(MachineFunction &mf,
                                       int guard_index) const = 0; // Insert stack protection code
+    // Rewrites the frame accesses resolve_frame_indices left with offsets
+    // the target's instructions can't encode; nothing by default
+    virtual void legalize_frame_offsets(MachineFunction &mf) const { (void)mf; }
 };
 
 //===----------------------------------------------------------------------===//
@@ -678,17 +829,37 @@ private:
     std::vector<std::unique_ptr<MachineFunction>> functions_;
     const TargetRegisterInfo *tri_ = nullptr;
     const TargetInstInfo *tii_ = nullptr;
+    std::unordered_map<std::string, std::set<unsigned>> clobbered_regs_;
+    // Names symbol operands point at; set nodes never move
+    std::unordered_set<std::string> symbols_;
+    std::mutex symbols_mutex_;
 
 public:
     explicit MachineModule(Module *ir_module) : ir_module_(ir_module) {}
 
+    // A copy of `name` that lives as long as the module, the same pointer
+    // for equal names; safe to call from functions selected in parallel
+    const char *intern_symbol(std::string_view name);
+
     MachineFunction *create_machine_function(Function *function);
+    const std::vector<std::unique_ptr<MachineFunction>> &functions() const { return functions_; }
+
+    // Physical registers a call to the allocated function `name` may
+    // overwrite, its own callees included; null until allocate_module
+    // records them
+    const std::set<unsigned> *clobbered_regs(const std::string &name) const
+    {
+        auto it = clobbered_regs_.find(name);
+        return it == clobbered_regs_.end() ? nullptr : &it->second;
+    }
+    void set_clobbered_regs(const std::string &name, std::set<unsigned> regs) { clobbered_regs_[name] = std::move(regs); }
 
     void set_target_info(const TargetRegisterInfo *target_register_info,
                          const TargetInstInfo *target_inst_info);
 
     const TargetInstInfo *target_inst_info() const { return tii_; }
     const TargetRegisterInfo *target_reg_info() const { return tri_; }
+    Module *ir_module() const { return ir_module_; }
 };
 
 //===----------------------------------------------------------------------===//
@@ -699,8 +870,9 @@ class PressureTracker
 {
 private:
     const TargetRegisterInfo &tri_;
-    std::map<unsigned, unsigned>
-        pressure_at_pos_; // Use ordered map for traversal
+    // Pressure changes at interval boundaries, in position order; the curve
+    // is their running sum, so sparse positions cost nothing extra
+    std::map<unsigned, int> pressure_deltas_;
     mutable bool max_pressure_dirty_ =
         false; // Flag indicating whether to recalculate max pressure
     mutable unsigned cached_max_pressure_ = 0;
@@ -711,6 +883,8 @@ public:
     explicit PressureTracker(const TargetRegisterInfo &target_register_info)
         : tri_(target_register_info) {}
     void add_interval(const LiveRange &live_range);
+    // For virtual registers, whose weight the target can't look up
+    void add_interval(const LiveRange &live_range, unsigned weight);
     void remove_interval(const LiveRange &live_range);
     unsigned get_max_pressure() const;
     void dump_pressure_curve() const;
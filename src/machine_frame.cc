@@ -1,5 +1,7 @@
 #include "machine_frame.h"
 
+#include <algorithm>
+
 //===----------------------------------------------------------------------===//
 // FrameObjectMetadata Implementation
 //===----------------------------------------------------------------------===//
@@ -50,27 +52,75 @@ const std::vector<int> &MachineFrame::frame_layout() const
         frame_offsets_.clear();
         total_frame_size_ = 0;
 
-        // 2. 生成排序策略（示例：按对齐降序排列）
+        // 2. 排序：单位字节访问次数高的在前，其次对齐、大小降序，最后按索引保证结果确定
         std::vector<std::pair<int, FrameObjectMetadata *>> sorted_objects;
         for (const auto &[idx, obj] : frame_objects_)
         {
             sorted_objects.emplace_back(idx, obj.get());
         }
+        auto density = [](const FrameObjectMetadata *obj)
+        {
+            return obj->size > 0 ? obj->access_weight / static_cast<float>(obj->size) : 0.0f;
+        };
         std::sort(sorted_objects.begin(), sorted_objects.end(),
-                  [](const auto &a, const auto &b)
+                  [&](const auto &a, const auto &b)
                   {
-                      return a.second->alignment > b.second->alignment;
+                      const bool a_variable = a.second->flags & FrameObjectMetadata::IsVariableSize;
+                      const bool b_variable = b.second->flags & FrameObjectMetadata::IsVariableSize;
+                      if (a_variable != b_variable)
+                          return b_variable;
+                      if (density(a.second) != density(b.second))
+                          return density(a.second) > density(b.second);
+                      if (a.second->alignment != b.second->alignment)
+                          return a.second->alignment > b.second->alignment;
+                      if (a.second->size != b.second->size)
+                          return a.second->size > b.second->size;
+                      return a.first < b.first;
                   });
 
-        // 3. 计算偏移量和总大小（假设栈向下增长）
+        // 3. 计算偏移量和总大小（假设栈向下增长），对齐留下的空隙记下来给后面的小对象用
+        struct Hole
+        {
+            size_t begin;
+            size_t end;
+        };
+        std::vector<Hole> holes;
+        auto align_up = [](size_t offset, size_t alignment)
+        { return (offset + alignment - 1) & ~(alignment - 1); };
+
         size_t current_offset = 0;
         for (const auto &[idx, obj] : sorted_objects)
         {
-            // 对齐调整
-            size_t aligned_offset = (current_offset + obj->alignment - 1) & ~(obj->alignment - 1);
-            // 分配空间
-            frame_offsets_[idx] = aligned_offset;
-            current_offset = aligned_offset + obj->size;
+            const size_t alignment = std::max(obj->alignment, 1u);
+            const size_t size = obj->size > 0 ? static_cast<size_t>(obj->size) : 0;
+
+            bool placed = false;
+            for (size_t h = 0; h < holes.size() && size > 0; ++h)
+            {
+                const Hole hole = holes[h];
+                const size_t start = align_up(hole.begin, alignment);
+                if (start + size > hole.end)
+                    continue;
+                frame_offsets_[idx] = start;
+                holes.erase(holes.begin() + static_cast<std::ptrdiff_t>(h));
+                if (start + size < hole.end)
+                    holes.insert(holes.begin() + static_cast<std::ptrdiff_t>(h), Hole{start + size, hole.end});
+                if (hole.begin < start)
+                    holes.insert(holes.begin() + static_cast<std::ptrdiff_t>(h), Hole{hole.begin, start});
+                placed = true;
+                break;
+            }
+
+            if (!placed)
+            {
+                // 对齐调整
+                size_t aligned_offset = align_up(current_offset, alignment);
+                if (aligned_offset > current_offset)
+                    holes.push_back(Hole{current_offset, aligned_offset});
+                // 分配空间
+                frame_offsets_[idx] = aligned_offset;
+                current_offset = aligned_offset + size;
+            }
             layout_order_.push_back(idx);
         }
         total_frame_size_ = current_offset;
@@ -158,6 +208,21 @@ bool MachineFrame::is_valid_index(int index) const
 {
     return frame_objects_.find(index) != frame_objects_.end();
 }
+
+void MachineFrame::remove_frame_object(int index)
+{
+    if (frame_objects_.erase(index))
+        is_frame_layout_dirty_ = true;
+}
+
+void MachineFrame::set_access_weight(int index, float weight)
+{
+    if (FrameObjectMetadata *meta = get_metadata(index))
+    {
+        meta->access_weight = weight;
+        is_frame_layout_dirty_ = true;
+    }
+}
 // factory methods
 int MachineFrame::create_fixed_size(Value *value, int64_t size, unsigned alignment)
 {
@@ -26,16 +26,25 @@ struct FrameObjectMetadata
     Value *associated_value = nullptr; // Associated IR object
     unsigned spill_rc_id = 0;          // 溢出目标的寄存器类别 ID
     bool spill_needs_reload = true;    // 是否需重新加载
+    float access_weight = 0;           // Estimated accesses per call, for layout
 
     // Validity check
     bool validate(std::string *err = nullptr) const;
 };
 
+// A register the prologue stores and the epilogue loads back
+struct SavedRegister
+{
+    unsigned reg;
+    int frame_index;
+};
+
 class MachineFrame
 {
 private:
     std::unordered_map<int, std::unique_ptr<FrameObjectMetadata>> frame_objects_; // Key is frame index
     int next_frame_idx_ = 0;                                                      // Stack object index counter
+    std::vector<SavedRegister> saved_registers_;
 
     // Stack frame layout cache
     mutable bool is_frame_layout_dirty_ = true;             // Layout cache status
@@ -77,9 +86,21 @@ public:
     size_t get_frame_index_offset(int index) const;
     size_t get_total_frame_size() const;
     bool is_valid_index(int index) const;
-    // Stack frame layout
+    // Drops an object nothing refers to any more, such as a spill slot
+    // merged into another. Indices of the others stay the same
+    void remove_frame_object(int index);
+    void set_access_weight(int index, float weight);
+    // Stack frame layout. Objects accessed most per byte come first, so
+    // the hot ones get the small offsets that short encodings reach, and
+    // later objects fill the padding earlier ones leave where they fit.
+    // Variable-size objects go last
     const std::vector<int> &frame_layout() const;
 
+    // Callee-saved registers (and the return address) the frame lowering
+    // keeps in the frame, in the order the prologue stores them
+    const std::vector<SavedRegister> &saved_registers() const { return saved_registers_; }
+    void set_saved_registers(std::vector<SavedRegister> regs) { saved_registers_ = std::move(regs); }
+
     // factory methods
     int create_fixed_size(Value *value, int64_t size, unsigned alignment);
 
@@ -0,0 +1,158 @@
+// moc.cc - Compiles Mo files to RISC-V objects or ASIMOV images, many at once
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "compile_driver.h"
+#include "phase_stats.h"
+
+namespace
+{
+    void usage(const char *argv0)
+    {
+        std::cerr << "Usage: " << argv0 << " [options] <file.mo | @file-list>...\n"
+                  << "  -j N                 worker threads (default: one per core)\n"
+                  << "  -O0, -O1, -O2        optimization level (default: -O1)\n"
+                  << "  --target=riscv|asimov\n"
+                  << "  -o DIR               output directory (default: next to each input)\n"
+                  << "  --max-memory=MB      start no more files while those in flight may need this much\n"
+                  << "  --entry=NAME         compile only the functions NAME reaches, repeatable\n"
+                  << "  --time-report[=json] per-file stage times and the phase report, to stderr\n"
+                  << "A file list names one input per line.\n";
+    }
+
+    bool parse_unsigned(const std::string &text, unsigned &value)
+    {
+        if (text.empty() || text.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+        value = static_cast<unsigned>(std::strtoul(text.c_str(), nullptr, 10));
+        return true;
+    }
+
+    bool read_file_list(const std::string &path, std::vector<std::string> &files)
+    {
+        std::ifstream list(path);
+        if (!list)
+            return false;
+        for (std::string line; std::getline(list, line);)
+        {
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+            if (!line.empty())
+                files.push_back(line);
+        }
+        return true;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    DriverOptions options;
+    std::string output_dir;
+    std::string time_report;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string arg = argv[i];
+        unsigned value = 0;
+        if (arg == "-j" && i + 1 < argc && parse_unsigned(argv[i + 1], value))
+        {
+            options.jobs = value;
+            ++i;
+        }
+        else if (arg.rfind("-j", 0) == 0 && parse_unsigned(arg.substr(2), value))
+        {
+            options.jobs = value;
+        }
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2")
+        {
+            options.opt_level = static_cast<unsigned>(arg[2] - '0');
+        }
+        else if (arg == "--target=riscv")
+        {
+            options.target = DriverTarget::RISCV;
+        }
+        else if (arg == "--target=asimov")
+        {
+            options.target = DriverTarget::ASIMOV;
+        }
+        else if (arg == "-o" && i + 1 < argc)
+        {
+            output_dir = argv[++i];
+        }
+        else if (arg.rfind("--max-memory=", 0) == 0 && parse_unsigned(arg.substr(13), value))
+        {
+            options.memory_budget = static_cast<size_t>(value) << 20;
+        }
+        else if (arg.rfind("--entry=", 0) == 0 && arg.size() > 8)
+        {
+            options.entry_points.push_back(arg.substr(8));
+        }
+        else if (arg.rfind("--time-report", 0) == 0)
+        {
+            time_report = arg;
+            PhaseStats::global().set_enabled(true);
+        }
+        else if (arg.size() > 1 && arg[0] == '@')
+        {
+            if (!read_file_list(arg.substr(1), files))
+            {
+                std::cerr << "Error: Could not open file list " << arg.substr(1) << std::endl;
+                return 1;
+            }
+        }
+        else if (!arg.empty() && arg[0] != '-')
+        {
+            files.push_back(arg);
+        }
+        else
+        {
+            std::cerr << "Error: Unknown option " << arg << std::endl;
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (files.empty())
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    const char *extension = options.target == DriverTarget::ASIMOV ? ".img" : ".o";
+    std::vector<CompileInput> inputs;
+    for (const std::string &file : files)
+    {
+        std::filesystem::path output = std::filesystem::path(file).replace_extension(extension);
+        if (!output_dir.empty())
+            output = std::filesystem::path(output_dir) / output.filename();
+        inputs.push_back({.path = file, .source = std::nullopt, .output_path = output.string()});
+    }
+
+    std::vector<CompileResult> results = compile_files(inputs, options);
+
+    int status = 0;
+    for (const CompileResult &result : results)
+    {
+        for (const std::string &error : result.errors)
+            std::cerr << error << "\n";
+        if (!result.ok)
+            status = 1;
+    }
+
+    if (time_report == "--time-report=json")
+    {
+        export_file_timings_to_json(results, std::cerr);
+        PhaseStats::global().export_to_json(std::cerr);
+    }
+    else if (!time_report.empty())
+    {
+        print_file_timings(results, std::cerr);
+        PhaseStats::global().print_table(std::cerr);
+    }
+    return status;
+}
@@ -0,0 +1,146 @@
+// open_hash_map.h - Open-addressing hash map for uniquing tables
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             Hashing helpers
+//===----------------------------------------------------------------------===//
+
+// Finalizer of splitmix64: every input bit affects every output bit, so small
+// integers and pointers that differ only in their low bits spread over the table.
+inline uint64_t hash_mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+inline uint64_t hash_combine(uint64_t seed, uint64_t value)
+{
+    return hash_mix(seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2)));
+}
+
+inline uint64_t hash_pointer(const void *ptr)
+{
+    return hash_mix(reinterpret_cast<uintptr_t>(ptr));
+}
+
+inline uint64_t hash_bytes(std::string_view bytes)
+{
+    return std::hash<std::string_view>{}(bytes);
+}
+
+//===----------------------------------------------------------------------===//
+//                             OpenHashMap
+//===----------------------------------------------------------------------===//
+//
+// Insert-only map built for uniquing: entries live densely in insertion order
+// and a power-of-two slot array, probed linearly, maps hashes to entry indices.
+// Each slot keeps a fragment of the hash, so probing rarely compares keys that
+// do not match. Entries are destroyed in reverse insertion order, so values
+// built from earlier values go first.
+
+template <typename Key, typename Value, typename Hash, typename Equal = std::equal_to<Key>>
+class OpenHashMap
+{
+public:
+    OpenHashMap() = default;
+    OpenHashMap(const OpenHashMap &) = delete;
+    OpenHashMap &operator=(const OpenHashMap &) = delete;
+    ~OpenHashMap()
+    {
+        while (!entries_.empty())
+        {
+            entries_.pop_back();
+        }
+    }
+
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    Value *find(const Key &key) { return find(key, Hash{}(key)); }
+    const Value *find(const Key &key) const { return const_cast<OpenHashMap *>(this)->find(key); }
+
+    // Value for `key`, inserting make() first if the key is new
+    template <typename Make>
+    Value &get_or_insert(const Key &key, Make make)
+    {
+        const uint64_t hash = Hash{}(key);
+        if (Value *value = find(key, hash))
+        {
+            return *value;
+        }
+        if ((entries_.size() + 1) * 2 > slots_.size())
+        {
+            grow();
+        }
+        entries_.emplace_back(key, make());
+        hashes_.push_back(hash);
+        place(static_cast<uint32_t>(entries_.size() - 1), hash);
+        return entries_.back().second;
+    }
+
+    // Entries in insertion order
+    auto begin() const { return entries_.begin(); }
+    auto end() const { return entries_.end(); }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot
+    {
+        uint32_t entry = EMPTY;
+        uint32_t tag = 0;
+    };
+
+    size_t mask() const { return slots_.size() - 1; }
+    static uint32_t tag_of(uint64_t hash) { return static_cast<uint32_t>(hash >> 32); }
+
+    Value *find(const Key &key, uint64_t hash)
+    {
+        if (slots_.empty())
+        {
+            return nullptr;
+        }
+        for (size_t i = hash & mask(); slots_[i].entry != EMPTY; i = (i + 1) & mask())
+        {
+            const Slot &slot = slots_[i];
+            if (slot.tag == tag_of(hash) && Equal{}(entries_[slot.entry].first, key))
+            {
+                return &entries_[slot.entry].second;
+            }
+        }
+        return nullptr;
+    }
+
+    void place(uint32_t entry, uint64_t hash)
+    {
+        size_t i = hash & mask();
+        while (slots_[i].entry != EMPTY)
+        {
+            i = (i + 1) & mask();
+        }
+        slots_[i] = {entry, tag_of(hash)};
+    }
+
+    void grow()
+    {
+        slots_.assign(slots_.empty() ? 16 : slots_.size() * 2, Slot{});
+        for (uint32_t i = 0; i < entries_.size(); ++i)
+        {
+            place(i, hashes_[i]);
+        }
+    }
+
+    std::vector<std::pair<Key, Value>> entries_;
+    std::vector<uint64_t> hashes_; // parallel to entries_, for rehashing
+    std::vector<Slot> slots_;
+};
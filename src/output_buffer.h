@@ -0,0 +1,166 @@
+// output_buffer.h - Buffered text output for printers and dumps
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             Output Buffer
+//===----------------------------------------------------------------------===//
+
+// Collects text in one buffer and hands it to the stream a chunk at a time,
+// so a printer makes one stream call per `flush_at` bytes instead of one per
+// token. The buffer keeps its capacity across flushes, so a long dump costs
+// no more memory than a chunk. Numbers are formatted in place, spelled the
+// way `std::ostream` spells them under its default flags.
+class OutputBuffer
+{
+public:
+    static constexpr size_t DEFAULT_FLUSH_AT = 64 * 1024;
+
+    explicit OutputBuffer(std::ostream &os, size_t flush_at = DEFAULT_FLUSH_AT) : os_(&os), flush_at_(flush_at)
+    {
+        buffer_.reserve(flush_at + 256);
+    }
+    ~OutputBuffer() { flush(); }
+
+    OutputBuffer(const OutputBuffer &) = delete;
+    OutputBuffer &operator=(const OutputBuffer &) = delete;
+
+    void flush()
+    {
+        if (buffer_.empty())
+            return;
+        os_->write(buffer_.data(), std::streamsize(buffer_.size()));
+        flushed_ += buffer_.size();
+        buffer_.clear();
+    }
+
+    // Bytes handed to the stream so far, plus what is still buffered
+    size_t bytes_written() const { return flushed_ + buffer_.size(); }
+
+    void write(std::string_view text)
+    {
+        buffer_.insert(buffer_.end(), text.begin(), text.end());
+        maybe_flush();
+    }
+    void put(char c)
+    {
+        buffer_.push_back(c);
+        maybe_flush();
+    }
+    void spaces(size_t count)
+    {
+        buffer_.insert(buffer_.end(), count, ' ');
+        maybe_flush();
+    }
+
+    template <typename T>
+        requires std::is_integral_v<T>
+    void write_integer(T value)
+    {
+        char digits[24];
+        auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer_.insert(buffer_.end(), digits, end);
+        maybe_flush();
+    }
+
+    // `%g`, which is what `os << value` prints
+    void write_double(double value)
+    {
+        char digits[32];
+        int n = std::snprintf(digits, sizeof(digits), "%g", value);
+        buffer_.insert(buffer_.end(), digits, digits + n);
+        maybe_flush();
+    }
+
+    // `text` as the inside of a JSON string, without the quotes
+    void write_json_escaped(std::string_view text)
+    {
+        static constexpr char HEX[] = "0123456789abcdef";
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"':
+                write("\\\"");
+                break;
+            case '\\':
+                write("\\\\");
+                break;
+            case '\b':
+                write("\\b");
+                break;
+            case '\f':
+                write("\\f");
+                break;
+            case '\n':
+                write("\\n");
+                break;
+            case '\r':
+                write("\\r");
+                break;
+            case '\t':
+                write("\\t");
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    const char escape[] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xf]};
+                    write(std::string_view(escape, sizeof(escape)));
+                }
+                else
+                {
+                    buffer_.push_back(c);
+                }
+            }
+        }
+        maybe_flush();
+    }
+
+    OutputBuffer &operator<<(std::string_view text)
+    {
+        write(text);
+        return *this;
+    }
+    OutputBuffer &operator<<(const char *text)
+    {
+        write(text);
+        return *this;
+    }
+    OutputBuffer &operator<<(char c)
+    {
+        put(c);
+        return *this;
+    }
+    template <typename T>
+        requires(std::is_integral_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>)
+    OutputBuffer &operator<<(T value)
+    {
+        write_integer(value);
+        return *this;
+    }
+    OutputBuffer &operator<<(double value)
+    {
+        write_double(value);
+        return *this;
+    }
+
+private:
+    void maybe_flush()
+    {
+        if (buffer_.size() >= flush_at_)
+            flush();
+    }
+
+    std::ostream *os_;
+    size_t flush_at_;
+    size_t flushed_ = 0;
+    std::vector<char> buffer_;
+};
@@ -1,6 +1,7 @@
 // src/parser.cc
 #include "parser.h"
 #include "mo_debug.h"
+#include "phase_stats.h"
 
 #include <cassert>
 #include <unordered_set>
@@ -15,358 +16,418 @@ using namespace ast;
 
 void apply_const_to_innermost(Type *type);
 
-Parser::Parser(Lexer &&lexer) : lexer_(std::move(lexer)), current_(lexer_.next_token())
+namespace
 {
-    init_pratt_rules();
-    init_type_pratt_rules();
+    // The lexer, interning into `symbols` unless it has a table of its own
+    Lexer interning(Lexer &&lexer, SymbolTable *symbols)
+    {
+        if (!lexer.symbol_table())
+            lexer.set_symbol_table(symbols);
+        return std::move(lexer);
+    }
 }
 
-struct TokenTypeAssocHash
+Parser::Parser(Lexer &&lexer)
+    : owned_symbols_(lexer.symbol_table() ? nullptr : std::make_unique<SymbolTable>()),
+      tokens_(interning(std::move(lexer), owned_symbols_.get())), current_(&tokens_.current()),
+      previous_(&tokens_.previous()), symbols_(owned_symbols_ ? owned_symbols_.get() : tokens_.lexer().symbol_table())
 {
-    std::size_t operator()(const std::pair<TokenType, ASSOC> &p) const
-    {
-        return std::hash<TokenType>()(p.first) ^ std::hash<ASSOC>()(p.second);
-    }
-};
-
-const static std::unordered_map<std::pair<TokenType, ASSOC>, int, TokenTypeAssocHash> precedence_map =
-    {
-        {{TokenType::Assign, R_ASSOC}, 1},    // right assoc
-        {{TokenType::AddAssign, R_ASSOC}, 1}, // right assoc
-        {{TokenType::SubAssign, R_ASSOC}, 1}, // right assoc
-        {{TokenType::MulAssign, R_ASSOC}, 1}, // right assoc
-        {{TokenType::DivAssign, R_ASSOC}, 1}, // right assoc
-        {{TokenType::ModAssign, R_ASSOC}, 1}, // right assoc
-        {{TokenType::AndAssign, R_ASSOC}, 1}, // right assoc
-        {{TokenType::OrAssign, R_ASSOC}, 1},  // right assoc
-        {{TokenType::XorAssign, R_ASSOC}, 1}, // right assoc
-        {{TokenType::LSAssign, R_ASSOC}, 1},  // right assoc
-        {{TokenType::RSAssign, R_ASSOC}, 1},  // right assoc
-
-        {{TokenType::Or, L_ASSOC}, 10},
-        {{TokenType::And, L_ASSOC}, 11},
-        {{TokenType::Pipe, L_ASSOC}, 12},
-        {{TokenType::Caret, L_ASSOC}, 12},
-        {{TokenType::Ampersand, L_ASSOC}, 13},
-
-        {{TokenType::Eq, L_ASSOC}, 20},
-        {{TokenType::Ne, L_ASSOC}, 20},
-
-        {{TokenType::Lt, L_ASSOC}, 30},
-        {{TokenType::Le, L_ASSOC}, 30},
-        {{TokenType::Gt, L_ASSOC}, 30},
-        {{TokenType::Ge, L_ASSOC}, 30},
-
-        {{TokenType::LShift, L_ASSOC}, 40},
-        {{TokenType::RShift, L_ASSOC}, 40},
-
-        {{TokenType::Plus, L_ASSOC}, 50},
-        {{TokenType::Minus, L_ASSOC}, 50},
-
-        {{TokenType::Star, L_ASSOC}, 60},
-        {{TokenType::Slash, L_ASSOC}, 60},
-        {{TokenType::Modulo, L_ASSOC}, 60},
-
-        // {{TokenType::DotStar, L_ASSOC}, 70},
-        // {{TokenType::ArrowStar, L_ASSOC}, 70},
-
-        {{TokenType::Cast, R_ASSOC}, 80},
-        {{TokenType::Star, R_ASSOC}, 80},      // Deref
-        {{TokenType::Ampersand, R_ASSOC}, 13}, // Address of
-        {{TokenType::Not, R_ASSOC}, 80},       // !
-        {{TokenType::Tilde, R_ASSOC}, 80},     // ~
-        {{TokenType::Sizeof, R_ASSOC}, 80},
-
-        {{TokenType::Decrement, R_ASSOC}, 90},
-        {{TokenType::Increment, R_ASSOC}, 90},
-        {{TokenType::LParen, L_ASSOC}, 90},   // Call
-        {{TokenType::LBracket, L_ASSOC}, 90}, // Index
-        {{TokenType::Dot, L_ASSOC}, 90},      // Member access
-        {{TokenType::Arrow, L_ASSOC}, 90},    // Member access
-
-        {{TokenType::DoubleColon, L_ASSOC}, 100},
-};
-
-int get_precedence(TokenType type, ASSOC assoc = L_ASSOC | R_ASSOC)
+}
+
+// Already lexed; without the lexer's table, identifiers are interned as the parser meets them
+Parser::Parser(TokenStream &&tokens)
+    : owned_symbols_(tokens.lexer().symbol_table() ? nullptr : std::make_unique<SymbolTable>()),
+      tokens_(std::move(tokens)), current_(&tokens_.current()), previous_(&tokens_.previous()),
+      symbols_(owned_symbols_ ? owned_symbols_.get() : tokens_.lexer().symbol_table())
 {
-    int precedence = 0;
-    bool found = false;
-    if (assoc & L_ASSOC)
+}
+
+//===----------------------------------------------------------------------===//
+//                             Pratt Tables
+//===----------------------------------------------------------------------===//
+//
+// Everything the Pratt loops need per token is looked up by indexing constexpr
+// arrays with the TokenType; handlers are dispatched by a switch on the rule
+// kind, so there is no type-erased call on the expression hot path.
+
+namespace
+{
+    constexpr size_t TOKEN_TYPE_COUNT = static_cast<size_t>(TokenType::Eof) + 1;
+
+    constexpr size_t token_index(TokenType type)
     {
-        auto it = precedence_map.find(std::make_pair(type, L_ASSOC));
-        if (it != precedence_map.end())
-        {
-            precedence = it->second;
-            found = true;
-        }
+        return static_cast<size_t>(type);
     }
-    if (assoc & R_ASSOC)
+
+    struct PrecedenceEntry
+    {
+        TokenType type;
+        ASSOC assoc;
+        int precedence;
+    };
+
+    constexpr PrecedenceEntry EXPR_PRECEDENCES[] = {
+        {TokenType::Assign, R_ASSOC, 1},    // right assoc
+        {TokenType::AddAssign, R_ASSOC, 1}, // right assoc
+        {TokenType::SubAssign, R_ASSOC, 1}, // right assoc
+        {TokenType::MulAssign, R_ASSOC, 1}, // right assoc
+        {TokenType::DivAssign, R_ASSOC, 1}, // right assoc
+        {TokenType::ModAssign, R_ASSOC, 1}, // right assoc
+        {TokenType::AndAssign, R_ASSOC, 1}, // right assoc
+        {TokenType::OrAssign, R_ASSOC, 1},  // right assoc
+        {TokenType::XorAssign, R_ASSOC, 1}, // right assoc
+        {TokenType::LSAssign, R_ASSOC, 1},  // right assoc
+        {TokenType::RSAssign, R_ASSOC, 1},  // right assoc
+
+        {TokenType::Or, L_ASSOC, 10},
+        {TokenType::And, L_ASSOC, 11},
+        {TokenType::Pipe, L_ASSOC, 12},
+        {TokenType::Caret, L_ASSOC, 12},
+        {TokenType::Ampersand, L_ASSOC, 13},
+
+        {TokenType::Eq, L_ASSOC, 20},
+        {TokenType::Ne, L_ASSOC, 20},
+
+        {TokenType::Lt, L_ASSOC, 30},
+        {TokenType::Le, L_ASSOC, 30},
+        {TokenType::Gt, L_ASSOC, 30},
+        {TokenType::Ge, L_ASSOC, 30},
+
+        {TokenType::LShift, L_ASSOC, 40},
+        {TokenType::RShift, L_ASSOC, 40},
+
+        {TokenType::Plus, L_ASSOC, 50},
+        {TokenType::Minus, L_ASSOC, 50},
+
+        {TokenType::Star, L_ASSOC, 60},
+        {TokenType::Slash, L_ASSOC, 60},
+        {TokenType::Modulo, L_ASSOC, 60},
+
+        // {TokenType::DotStar, L_ASSOC, 70},
+        // {TokenType::ArrowStar, L_ASSOC, 70},
+
+        {TokenType::Cast, R_ASSOC, 80},
+        {TokenType::Star, R_ASSOC, 80},      // Deref
+        {TokenType::Ampersand, R_ASSOC, 13}, // Address of
+        {TokenType::Not, R_ASSOC, 80},       // !
+        {TokenType::Tilde, R_ASSOC, 80},     // ~
+        {TokenType::Sizeof, R_ASSOC, 80},
+
+        {TokenType::Decrement, R_ASSOC, 90},
+        {TokenType::Increment, R_ASSOC, 90},
+        {TokenType::LParen, L_ASSOC, 90},   // Call
+        {TokenType::LBracket, L_ASSOC, 90}, // Index
+        {TokenType::Dot, L_ASSOC, 90},      // Member access
+        {TokenType::Arrow, L_ASSOC, 90},    // Member access
+
+        {TokenType::DoubleColon, L_ASSOC, 100},
+    };
+
+    constexpr PrecedenceEntry TYPE_PRECEDENCES[] = {
+        {TokenType::Const, R_ASSOC, 90},
+
+        {TokenType::Star, R_ASSOC, 80},
+        // {TokenType::Caret, R_ASSOC, 80},
+
+        {TokenType::LBracket, L_ASSOC, 100},
+        {TokenType::LParen, L_ASSOC, 100},
+        {TokenType::Arrow, L_ASSOC, 50},
+    };
+
+    struct PrecedenceTable
     {
-        auto it = precedence_map.find(std::make_pair(type, R_ASSOC));
-        if (it != precedence_map.end())
+        int left[TOKEN_TYPE_COUNT] = {};
+        int right[TOKEN_TYPE_COUNT] = {};
+
+        template <size_t N>
+        constexpr explicit PrecedenceTable(const PrecedenceEntry (&entries)[N])
         {
-            precedence = it->second;
-            found = true;
+            for (const auto &entry : entries)
+            {
+                (entry.assoc == L_ASSOC ? left : right)[token_index(entry.type)] = entry.precedence;
+            }
         }
-    }
-    if (!found)
+
+        // With both associativities requested the right one wins, as it is looked up last.
+        // Tokens without an entry have precedence 0.
+        constexpr int get(TokenType type, ASSOC assoc) const
+        {
+            int precedence = 0;
+            if ((assoc & L_ASSOC) && left[token_index(type)] != 0)
+                precedence = left[token_index(type)];
+            if ((assoc & R_ASSOC) && right[token_index(type)] != 0)
+                precedence = right[token_index(type)];
+            return precedence;
+        }
+    };
+
+    constexpr PrecedenceTable EXPR_PRECEDENCE_TABLE{EXPR_PRECEDENCES};
+    constexpr PrecedenceTable TYPE_PRECEDENCE_TABLE{TYPE_PRECEDENCES};
+
+    enum class PrefixRule : uint8_t
+    {
+        None,
+        Identifier,
+        Literal,
+        AddressOf,
+        Deref,
+        Unary,
+        Grouped,
+        Cast,
+        Sizeof,
+        InitList,
+    };
+
+    enum class InfixRule : uint8_t
     {
-        MO_DEBUG("parser: warning: no precedence for token '%s' with associativity %s, "
-                 "falling back to 0",
-                 token_type_to_string(type).c_str(), assoc ? "right" : "left");
-    }
-    return precedence;
-};
+        None,
+        Binary,      // left assoc, right operand binds at the operator precedence
+        BinaryRight, // right assoc (assignments)
+        MemberAccess,
+        ArrayAccess,
+        Call,
+    };
 
-void Parser::init_pratt_rules()
-{
-    auto add_prefix_rule = [&](TokenType type, std::function<ExprPtr()> prefix)
+    enum class TypePrefixRule : uint8_t
     {
-        pratt_rules_[type].insert({std::move(prefix), nullptr});
+        None,
+        Int,
+        Float,
+        String,
+        Alias,
+        Pointer,
+        Const,
     };
-    auto add_infix_rule = [&](TokenType type, std::function<ExprPtr(ExprPtr)> infix)
+
+    enum class TypePostfixRule : uint8_t
     {
-        pratt_rules_[type].insert({nullptr, std::move(infix)});
+        None,
+        Array,
+        Function,
     };
 
-    // Prefix rules
-    add_prefix_rule(TokenType::Identifier, [&]
-                    { return parse_identifier(get_precedence(TokenType::Identifier) - 1); });
-    add_prefix_rule(TokenType::IntegerLiteral, [&]
-                    { return parse_literal(); });
-    add_prefix_rule(TokenType::BooleanLiteral, [&]
-                    { return parse_literal(); });
-    add_prefix_rule(TokenType::FloatLiteral, [&]
-                    { return parse_literal(); });
-    add_prefix_rule(TokenType::StringLiteral, [&]
-                    { return parse_literal(); });
-    add_prefix_rule(TokenType::Ampersand, [&]
-                    { return parse_address_of(); });
-    add_prefix_rule(TokenType::Star, [&]
-                    { return parse_deref(get_precedence(TokenType::Star, R_ASSOC) - 1); });
-    add_prefix_rule(TokenType::Plus, [&]
-                    { return parse_unary(get_precedence(TokenType::Plus, R_ASSOC) - 1); });
-    add_prefix_rule(TokenType::Minus, [&]
-                    { return parse_unary(get_precedence(TokenType::Minus, R_ASSOC) - 1); });
-    add_prefix_rule(TokenType::Not, [&]
-                    { return parse_unary(get_precedence(TokenType::Not, R_ASSOC) - 1); });
-    add_prefix_rule(TokenType::Tilde, [&]
-                    { return parse_unary(get_precedence(TokenType::Tilde, R_ASSOC) - 1); });
-    add_prefix_rule(TokenType::LParen, [&]
-                    { return parse_tuple_or_grouped(); });
-    add_prefix_rule(TokenType::Cast, [&]
-                    { return parse_cast(); });
-    add_prefix_rule(TokenType::Sizeof, [&]
-                    { return parse_sizeof(); });
-    add_prefix_rule(TokenType::LBracket, [&]
-                    { return parse_init_list(); });
-
-    // Infix/postfix rules
-    add_infix_rule(TokenType::Assign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Assign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::AddAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::AddAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::SubAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::SubAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::MulAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::MulAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::DivAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::DivAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::ModAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::ModAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::AndAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::AndAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::OrAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::OrAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::XorAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::XorAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::LSAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::LSAssign, R_ASSOC) - 1);/* Right assoc*/ });
-    add_infix_rule(TokenType::RSAssign, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::RSAssign, R_ASSOC) - 1);/* Right assoc*/ });
-
-    add_infix_rule(TokenType::Plus, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Plus)); });
-    add_infix_rule(TokenType::Minus, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Minus)); });
-    add_infix_rule(TokenType::Star, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Star)); });
-    add_infix_rule(TokenType::Slash, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Slash)); });
-    add_infix_rule(TokenType::Modulo, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Modulo)); });
-
-    add_infix_rule(TokenType::And, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::And)); });
-    add_infix_rule(TokenType::Or, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Or)); });
-    add_infix_rule(TokenType::Eq, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Eq)); });
-    add_infix_rule(TokenType::Ne, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Ne)); });
-    add_infix_rule(TokenType::Lt, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Lt)); });
-    add_infix_rule(TokenType::Le, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Le)); });
-    add_infix_rule(TokenType::Gt, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Gt)); });
-    add_infix_rule(TokenType::Lt, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::Lt)); });
-    add_infix_rule(TokenType::LShift, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::LShift)); });
-    add_infix_rule(TokenType::RShift, [&](ExprPtr l)
-                   { return parse_binary(std::move(l), get_precedence(TokenType::RShift)); });
-
-    add_infix_rule(TokenType::Dot, [&](ExprPtr l)
-                   { return parse_member_access(std::move(l)); });
-    add_infix_rule(TokenType::Arrow, [&](ExprPtr l)
-                   { return parse_member_access(std::move(l)); });
-    add_infix_rule(TokenType::DoubleColon, [&](ExprPtr l)
-                   { return parse_member_access(std::move(l)); });
-    add_infix_rule(TokenType::LBracket, [&](ExprPtr l)
-                   { return parse_array_access(std::move(l)); });
-    add_infix_rule(TokenType::LParen, [&](ExprPtr l)
-                   { return parse_call(std::move(l)); });
-}
+    struct PrattRules
+    {
+        PrefixRule prefix[TOKEN_TYPE_COUNT] = {};
+        InfixRule infix[TOKEN_TYPE_COUNT] = {};
+        TypePrefixRule type_prefix[TOKEN_TYPE_COUNT] = {};
+        TypePostfixRule type_postfix[TOKEN_TYPE_COUNT] = {};
 
-const static std::unordered_map<std::pair<TokenType, ASSOC>, int, TokenTypeAssocHash> type_precedence_map = {
-    {{TokenType::Const, R_ASSOC}, 90},
+        constexpr PrattRules()
+        {
+            auto add_prefix = [&](TokenType type, PrefixRule rule)
+            { prefix[token_index(type)] = rule; };
+            auto add_infix = [&](TokenType type, InfixRule rule)
+            { infix[token_index(type)] = rule; };
+
+            add_prefix(TokenType::Identifier, PrefixRule::Identifier);
+            add_prefix(TokenType::IntegerLiteral, PrefixRule::Literal);
+            add_prefix(TokenType::BooleanLiteral, PrefixRule::Literal);
+            add_prefix(TokenType::FloatLiteral, PrefixRule::Literal);
+            add_prefix(TokenType::StringLiteral, PrefixRule::Literal);
+            add_prefix(TokenType::Ampersand, PrefixRule::AddressOf);
+            add_prefix(TokenType::Star, PrefixRule::Deref);
+            add_prefix(TokenType::Plus, PrefixRule::Unary);
+            add_prefix(TokenType::Minus, PrefixRule::Unary);
+            add_prefix(TokenType::Not, PrefixRule::Unary);
+            add_prefix(TokenType::Tilde, PrefixRule::Unary);
+            add_prefix(TokenType::LParen, PrefixRule::Grouped);
+            add_prefix(TokenType::Cast, PrefixRule::Cast);
+            add_prefix(TokenType::Sizeof, PrefixRule::Sizeof);
+            add_prefix(TokenType::LBracket, PrefixRule::InitList);
+
+            for (TokenType type : {TokenType::Assign, TokenType::AddAssign, TokenType::SubAssign,
+                                   TokenType::MulAssign, TokenType::DivAssign, TokenType::ModAssign,
+                                   TokenType::AndAssign, TokenType::OrAssign, TokenType::XorAssign,
+                                   TokenType::LSAssign, TokenType::RSAssign})
+            {
+                add_infix(type, InfixRule::BinaryRight);
+            }
+            for (TokenType type : {TokenType::Plus, TokenType::Minus, TokenType::Star, TokenType::Slash,
+                                   TokenType::Modulo, TokenType::And, TokenType::Or, TokenType::Eq,
+                                   TokenType::Ne, TokenType::Lt, TokenType::Le, TokenType::Gt,
+                                   TokenType::Ge, TokenType::LShift, TokenType::RShift})
+            {
+                add_infix(type, InfixRule::Binary);
+            }
+            add_infix(TokenType::Dot, InfixRule::MemberAccess);
+            add_infix(TokenType::Arrow, InfixRule::MemberAccess);
+            add_infix(TokenType::DoubleColon, InfixRule::MemberAccess);
+            add_infix(TokenType::LBracket, InfixRule::ArrayAccess);
+            add_infix(TokenType::LParen, InfixRule::Call);
+
+            type_prefix[token_index(TokenType::Int)] = TypePrefixRule::Int;
+            type_prefix[token_index(TokenType::Float)] = TypePrefixRule::Float;
+            type_prefix[token_index(TokenType::String)] = TypePrefixRule::String;
+            type_prefix[token_index(TokenType::Identifier)] = TypePrefixRule::Alias;
+            type_prefix[token_index(TokenType::Star)] = TypePrefixRule::Pointer;
+            type_prefix[token_index(TokenType::Const)] = TypePrefixRule::Const;
+
+            type_postfix[token_index(TokenType::LBracket)] = TypePostfixRule::Array;
+            type_postfix[token_index(TokenType::LParen)] = TypePostfixRule::Function;
+        }
+    };
 
-    {{TokenType::Star, R_ASSOC}, 80},
-    // {{TokenType::Caret, R_ASSOC}, 80},
+    constexpr PrattRules PRATT_RULES{};
+} // namespace
 
-    {{TokenType::LBracket, L_ASSOC}, 100},
-    {{TokenType::LParen, L_ASSOC}, 100},
-    {{TokenType::Arrow, L_ASSOC}, 50},
-};
+static constexpr int get_precedence(TokenType type, ASSOC assoc = L_ASSOC | R_ASSOC)
+{
+    return EXPR_PRECEDENCE_TABLE.get(type, assoc);
+}
 
-int get_type_precedence(TokenType token_type, ASSOC assoc = L_ASSOC | R_ASSOC)
+static constexpr int get_type_precedence(TokenType token_type, ASSOC assoc = L_ASSOC | R_ASSOC)
 {
-    int precedence = 0;
-    bool found = false;
-    if (assoc & L_ASSOC)
-    {
-        auto it = type_precedence_map.find(std::make_pair(token_type, L_ASSOC));
-        if (it != type_precedence_map.end())
-        {
-            precedence = it->second;
-            found = true;
-        }
-    }
-    if (assoc & R_ASSOC)
-    {
-        auto it = type_precedence_map.find(std::make_pair(token_type, R_ASSOC));
-        if (it != type_precedence_map.end())
-        {
-            precedence = it->second;
-            found = true;
-        }
-    }
-    if (!found)
-    {
-        MO_DEBUG("parser: warning: no precedence for token '%s' with associativity %s, "
-                 "falling back to 0",
-                 token_type_to_string(token_type).c_str(), assoc ? "right" : "left");
-    }
-    return precedence;
-};
+    return TYPE_PRECEDENCE_TABLE.get(token_type, assoc);
+}
 
 uint8_t Parser::parse_bitwidth()
 {
-    auto lexeme = current_.lexeme;
+    // Builtin numeric keywords carry their width from the lexer
+    const uint8_t bit_width = current_->bit_width;
+    auto lexeme = current_->lexeme;
     advance();
 
     assert(!lexeme.empty() && "Expected bitwidth lexeme");
-    if (lexeme == "int")
-        return 32;
+    if (bit_width != 0)
+        return bit_width;
     if (lexeme == "bool")
         return 1;
-    else if (lexeme == "float")
-        return 64;
-    else if (lexeme[0] == 'i')
+
+    error("Invalid bitwidth: " + lexeme);
+    return 0;
+}
+
+TypePtr Parser::parse_type_prefix(TokenType type)
+{
+    switch (PRATT_RULES.type_prefix[token_index(type)])
+    {
+    case TypePrefixRule::Int:
     {
-        return std::stoi(lexeme.substr(1));
+        auto unsigned_ = current_->is_unsigned;
+        return Type::create_int(parse_bitwidth(), unsigned_);
     }
-    else if (lexeme[0] == 'f')
+    case TypePrefixRule::Float:
+        return Type::create_float(parse_bitwidth());
+    case TypePrefixRule::String:
+        advance();
+        return Type::create_string();
+    case TypePrefixRule::Alias:
     {
-        return std::stoi(lexeme.substr(1));
+        const std::string name = current_->lexeme;
+        advance();
+        return Type::create_alias(name);
     }
-    else
+    case TypePrefixRule::Pointer:
     {
-        error("Invalid bitwidth: " + lexeme);
-        return 0;
+        advance(); // *
+        TypePtr pointee = parse_type(get_precedence(TokenType::Star, R_ASSOC) - 1);
+        return Type::create_pointer(std::move(pointee));
     }
+    case TypePrefixRule::Const:
+    {
+        advance(); // const
+        TypePtr base = parse_type(get_precedence(TokenType::Const, R_ASSOC) - 1);
+        return Type::create_qualified(Qualifier::Const, std::move(base));
+    }
+    case TypePrefixRule::None:
+        break;
+    }
+    MO_UNREACHABLE();
 }
 
-void Parser::init_type_pratt_rules()
+TypePtr Parser::parse_type_postfix(TokenType type, TypePtr left)
 {
-    auto add_prefix_rule = [&](TokenType type, std::function<TypePtr()> fn)
+    switch (PRATT_RULES.type_postfix[token_index(type)])
     {
-        type_pratt_rules_[type].insert({std::forward<decltype(fn)>(fn), nullptr});
-    };
-
-    auto add_postfix_rule = [&](TokenType type, std::function<TypePtr(TypePtr)> fn)
+    case TypePostfixRule::Array:
     {
-        type_pratt_rules_[type].insert({nullptr, std::forward<decltype(fn)>(fn)});
-    };
-
-    add_prefix_rule(TokenType::Int, [&]
-                    { 
-                        auto unsigned_ = current_.lexeme[0] == 'u';
-                        return Type::create_int(parse_bitwidth(), unsigned_); });
-    add_prefix_rule(TokenType::Float, [&]
-                    { return Type::create_float(parse_bitwidth()); });
-    add_prefix_rule(TokenType::String, [&]
-                    { advance(); return Type::create_string(); });
-
-    add_prefix_rule(TokenType::Identifier, [&]
-                    {
-        const std::string name = current_.lexeme;
-        advance();
-        return Type::create_alias(name); });
-
-    add_prefix_rule(TokenType::Star, [&]
-                    {
-        advance(); // *
-        TypePtr pointee = parse_type(get_precedence(TokenType::Star, R_ASSOC) - 1);
-        return Type::create_pointer(std::move(pointee)); });
-
-    add_postfix_rule(TokenType::LBracket, [&](TypePtr element_type)
-                     {
         consume(TokenType::LBracket);
-        
+
         int size = -1;
-        if (match(TokenType::IntegerLiteral)) {
-            size = std::stoi(current_.lexeme);
+        if (match(TokenType::IntegerLiteral))
+        {
+            size = std::stoi(current_->lexeme);
             advance();
         }
-        
-        consume(TokenType::RBracket);
-        return Type::create_array(std::move(element_type), size); });
 
-    add_postfix_rule(TokenType::LParen, [&](TypePtr return_type)
-                     {
+        consume(TokenType::RBracket);
+        return Type::create_array(std::move(left), size);
+    }
+    case TypePostfixRule::Function:
+    {
+        TypePtr return_type = std::move(left);
         consume(TokenType::LParen);
-        
+
         std::vector<TypePtr> params;
-        while (!match(TokenType::RParen)) {
+        while (!match(TokenType::RParen))
+        {
             params.emplace_back(parse_type());
-            if (!try_consume(TokenType::Comma)) break;
+            if (!try_consume(TokenType::Comma))
+                break;
         }
-        
+
         consume(TokenType::RParen);
-        
-        if (try_consume(TokenType::Arrow)) {
+
+        if (try_consume(TokenType::Arrow))
+        {
             return_type = parse_type();
         }
-        
-        return Type::create_function(std::move(return_type), std::move(params)); });
 
-    add_prefix_rule(TokenType::Const, [&]
-                    {
-        advance(); // const
-        TypePtr base = parse_type(get_precedence(TokenType::Const, R_ASSOC) - 1);
-        return Type::create_qualified(Qualifier::Const, std::move(base)); });
+        return Type::create_function(std::move(return_type), std::move(params));
+    }
+    case TypePostfixRule::None:
+        break;
+    }
+    MO_UNREACHABLE();
+}
+
+ExprPtr Parser::parse_prefix(TokenType type)
+{
+    switch (PRATT_RULES.prefix[token_index(type)])
+    {
+    case PrefixRule::Identifier:
+        return parse_identifier(get_precedence(TokenType::Identifier) - 1);
+    case PrefixRule::Literal:
+        return parse_literal();
+    case PrefixRule::AddressOf:
+        return parse_address_of();
+    case PrefixRule::Deref:
+        return parse_deref(get_precedence(TokenType::Star, R_ASSOC) - 1);
+    case PrefixRule::Unary:
+        return parse_unary(get_precedence(type, R_ASSOC) - 1);
+    case PrefixRule::Grouped:
+        return parse_tuple_or_grouped();
+    case PrefixRule::Cast:
+        return parse_cast();
+    case PrefixRule::Sizeof:
+        return parse_sizeof();
+    case PrefixRule::InitList:
+        return parse_init_list();
+    case PrefixRule::None:
+        break;
+    }
+    MO_UNREACHABLE();
+}
+
+ExprPtr Parser::parse_infix(TokenType type, ExprPtr left)
+{
+    switch (PRATT_RULES.infix[token_index(type)])
+    {
+    case InfixRule::Binary:
+        return parse_binary(std::move(left), get_precedence(type));
+    case InfixRule::BinaryRight:
+        return parse_binary(std::move(left), get_precedence(type, R_ASSOC) - 1); // Right assoc
+    case InfixRule::MemberAccess:
+        return parse_member_access(std::move(left));
+    case InfixRule::ArrayAccess:
+        return parse_array_access(std::move(left));
+    case InfixRule::Call:
+        return parse_call(std::move(left));
+    case InfixRule::None:
+        break;
+    }
+    MO_UNREACHABLE();
 }
 
 void apply_const_to_innermost(Type *type, Qualifier q)
@@ -382,47 +443,33 @@ void apply_const_to_innermost(Type *type, Qualifier q)
     }
 }
 
-std::unique_ptr<Type> Parser::parse_type(int precedence)
+TypePtr Parser::parse_type(int precedence)
 {
-    auto token = current_;
-    auto it = type_pratt_rules_.find(token.type);
-
-    if (it == type_pratt_rules_.end())
-    {
-        error("Unexpected token in type: " + token_type_to_string(token.type));
-        return nullptr;
-    }
-
-    // prefix
-    auto &rules = it->second;
-    auto prefix_rule = std::find_if(rules.begin(), rules.end(),
-                                    [](auto &r)
-                                    { return r.prefix != nullptr; });
+    const TokenType type = current_->type;
+    const size_t index = token_index(type);
 
-    if (prefix_rule == rules.end())
+    if (PRATT_RULES.type_prefix[index] == TypePrefixRule::None)
     {
-        error("Missing prefix handler for: " + token_type_to_string(token.type));
+        if (PRATT_RULES.type_postfix[index] == TypePostfixRule::None)
+        {
+            error("Unexpected token in type: " + token_type_to_string(type));
+        }
+        else
+        {
+            error("Missing prefix handler for: " + token_type_to_string(type));
+        }
         return nullptr;
     }
 
-    auto left = prefix_rule->prefix();
+    auto left = parse_type_prefix(type);
 
     // infix/postfix
-    while (precedence < get_type_precedence(current_.type))
+    while (precedence < get_type_precedence(current_->type))
     {
-        auto next = type_pratt_rules_.find(current_.type);
-        if (next == type_pratt_rules_.end())
+        if (PRATT_RULES.type_postfix[token_index(current_->type)] == TypePostfixRule::None)
             break;
 
-        auto &infix_rules = next->second;
-        auto infix_rule = std::find_if(infix_rules.begin(), infix_rules.end(),
-                                       [](auto &r)
-                                       { return r.infix != nullptr; });
-
-        if (infix_rule == infix_rules.end())
-            break;
-
-        left = infix_rule->infix(std::move(left));
+        left = parse_type_postfix(current_->type, std::move(left));
     }
 
     return left;
@@ -431,53 +478,38 @@ std::unique_ptr<Type> Parser::parse_type(int precedence)
 ExprPtr Parser::parse_expr(int precedence)
 {
     MO_DEBUG("parser: parsing expression with precedence %d", precedence);
-    auto token_type = current_.type;
+    auto token_type = current_->type;
+    const size_t index = token_index(token_type);
 
-    auto it = pratt_rules_.find(token_type);
-    if (it == pratt_rules_.end())
+    if (PRATT_RULES.prefix[index] == PrefixRule::None)
     {
-        error(vstring("Unexpected token ", token_to_string(current_), " in expression"));
-        return nullptr;
-    }
-
-    // Find the first prefix rule
-    const auto &rules = it->second;
-    auto prefix_it = std::find_if(rules.begin(), rules.end(), [](const PrattRule &rule)
-                                  { return rule.prefix != nullptr; });
-
-    if (prefix_it == rules.end())
-    {
-        error(vstring("Unexpected prefix token ", token_to_string(current_), " in expression"));
+        if (PRATT_RULES.infix[index] == InfixRule::None)
+        {
+            error(vstring("Unexpected token ", token_to_string(*current_), " in expression"));
+        }
+        else
+        {
+            error(vstring("Unexpected prefix token ", token_to_string(*current_), " in expression"));
+        }
         return nullptr;
     }
 
-    auto left = prefix_it->prefix();
+    auto left = parse_prefix(token_type);
 
     MO_DEBUG("parser: parsed %s prefix expression. new token is %s (precedence %d)",
-             token_type_to_string(token_type).c_str(), token_type_to_string(current_.type).c_str(), get_precedence(current_.type));
+             token_type_to_string(token_type).c_str(), token_type_to_string(current_->type).c_str(), get_precedence(current_->type));
 
-    while (precedence < get_precedence(current_.type))
+    while (precedence < get_precedence(current_->type))
     {
-        auto infix_it = pratt_rules_.find(current_.type);
-        if (infix_it == pratt_rules_.end())
+        if (PRATT_RULES.infix[token_index(current_->type)] == InfixRule::None)
         {
-            MO_DEBUG("parser: no infix rule for token %s", token_type_to_string(current_.type).c_str());
+            MO_DEBUG("parser: no infix rule for token %s", token_type_to_string(current_->type).c_str());
             break;
         }
 
-        const auto &infix_rules = infix_it->second;
-        auto infix_rule_it = std::find_if(infix_rules.begin(), infix_rules.end(), [](const PrattRule &rule)
-                                          { return rule.infix != nullptr; });
-
-        if (infix_rule_it == infix_rules.end())
-        {
-            MO_DEBUG("parser: no infix rule for token %s", token_type_to_string(current_.type).c_str());
-            break;
-        }
-
-        left = infix_rule_it->infix(std::move(left));
+        left = parse_infix(current_->type, std::move(left));
         MO_DEBUG("parser: parsed infix expression. new token is %s (precedence %d)",
-                 token_type_to_string(current_.type).c_str(), get_precedence(current_.type));
+                 token_type_to_string(current_->type).c_str(), get_precedence(current_->type));
     }
 
     return left;
@@ -485,17 +517,17 @@ ExprPtr Parser::parse_expr(int precedence)
 
 ExprPtr Parser::parse_member_access(ExprPtr left)
 {
-    auto accessor = current_.type;
+    auto accessor = current_->type;
     advance(); // Skip . or ->
-    auto member = current_.lexeme;
+    auto member = current_->lexeme;
     consume(TokenType::Identifier, "Expected member name after access operator");
 
     auto expr = std::make_unique<MemberAccessExpr>(std::move(left), member, accessor);
 
     // 处理链式访问 Handle chained member access
-    if (current_.type == TokenType::Dot ||
-        current_.type == TokenType::Arrow ||
-        current_.type == TokenType::DoubleColon)
+    if (current_->type == TokenType::Dot ||
+        current_->type == TokenType::Arrow ||
+        current_->type == TokenType::DoubleColon)
     {
         return parse_expr(get_precedence(accessor));
     }
@@ -522,7 +554,7 @@ ExprPtr Parser::parse_call(ExprPtr left)
     consume(TokenType::LParen, "Expected '(' after function name");
 
     std::vector<ExprPtr> args;
-    if (current_.type != TokenType::RParen)
+    if (current_->type != TokenType::RParen)
     {
         do
         {
@@ -536,9 +568,9 @@ ExprPtr Parser::parse_call(ExprPtr left)
 
 void Parser::consume(TokenType type, const std::string &message)
 {
-    if (current_.type == type)
+    if (current_->type == type)
     {
-        Token consumed = current_;
+        const Token &consumed = *current_;
         MO_DEBUG("parser: consumed token %s", token_to_string(consumed).c_str());
         advance();
         // return consumed;
@@ -551,9 +583,9 @@ void Parser::consume(TokenType type, const std::string &message)
 
 bool Parser::try_consume(TokenType type)
 {
-    if (current_.type == type)
+    if (current_->type == type)
     {
-        Token consumed = current_;
+        const Token &consumed = *current_;
         MO_DEBUG("parser: consumed token %s", token_to_string(consumed).c_str());
         advance();
         return true;
@@ -564,12 +596,12 @@ bool Parser::try_consume(TokenType type)
 
 bool Parser::match(TokenType type)
 {
-    if (current_.type == type)
+    if (current_->type == type)
     {
-        MO_DEBUG("parser: matched token %s", token_to_string(current_).c_str());
+        MO_DEBUG("parser: matched token %s", token_to_string(*current_).c_str());
         return true;
     }
-    MO_DEBUG("parser: no match for token %s, actual token is %s", token_type_to_string(type).c_str(), token_to_string(current_).c_str());
+    MO_DEBUG("parser: no match for token %s, actual token is %s", token_type_to_string(type).c_str(), token_to_string(*current_).c_str());
     return false;
 }
 
@@ -578,7 +610,7 @@ std::unique_ptr<BlockStmt> Parser::parse_block()
     consume(TokenType::LBrace, "Expected '{' at the start of block");
 
     std::vector<StmtPtr> statements;
-    while (current_.type != TokenType::RBrace && current_.type != TokenType::Eof)
+    while (current_->type != TokenType::RBrace && current_->type != TokenType::Eof)
     {
         statements.push_back(parse_statement());
     }
@@ -594,7 +626,7 @@ TypeAliasDecl Parser::parse_type_alias_decl()
 
     consume(TokenType::Type, "Expected 'type' keyword");
 
-    decl.name = current_.lexeme;
+    decl.name = current_->lexeme;
     consume(TokenType::Identifier, "Expected alias name");
 
     consume(TokenType::Assign, "Expected '=' after alias name");
@@ -603,8 +635,13 @@ TypeAliasDecl Parser::parse_type_alias_decl()
 
     consume(TokenType::Semicolon, "Expected ';' after type alias declaration");
 
-    // Register the type alias in your type_aliases_ map
-    type_aliases_.emplace(decl.name, std::move(decl.type));
+    // Register the type alias in your type_aliases_ map. The parser can outlive the
+    // program's arena, so keep a heap copy rather than the arena node itself.
+    {
+        ArenaScope heap_scope(nullptr);
+        type_aliases_.emplace(decl.name, decl.type->clone());
+    }
+    decl.type.reset();
 
     return decl;
 }
@@ -615,21 +652,21 @@ StructDecl Parser::parse_struct_decl()
 
     consume(TokenType::Struct, "Expected 'struct' keyword");
 
-    struct_decl.name = current_.lexeme;
+    struct_decl.name = current_->lexeme;
     consume(TokenType::Identifier, "Expected struct name");
 
     consume(TokenType::LBrace, "Expected '{' at the start of struct body");
 
-    while (current_.type != TokenType::RBrace && current_.type != TokenType::Eof)
+    while (current_->type != TokenType::RBrace && current_->type != TokenType::Eof)
     {
         struct_decl.add_field(parse_struct_member());
 
-        if (current_.type == TokenType::Comma)
+        if (current_->type == TokenType::Comma)
         {
             consume(TokenType::Comma, "Expected ',' between struct members");
         }
 
-        if (current_.type == TokenType::RBrace)
+        if (current_->type == TokenType::RBrace)
         {
             break;
         }
@@ -643,7 +680,7 @@ StructDecl Parser::parse_struct_decl()
 // Parse a struct member declaration (field name and type) e.g. "x: int"
 TypedField Parser::parse_struct_member()
 {
-    std::string name = current_.lexeme;
+    std::string name = current_->lexeme;
     consume(TokenType::Identifier, "Expected field name");
     consume(TokenType::Colon, "Expected ':' after field name");
     auto type = parse_type();
@@ -683,7 +720,7 @@ ExprPtr Parser::parse_struct_literal(std::string struct_name)
     }
     else if (match(TokenType::Identifier))
     {
-        struct_name = current_.lexeme;
+        struct_name = current_->lexeme;
         advance();
     }
 
@@ -693,7 +730,7 @@ ExprPtr Parser::parse_struct_literal(std::string struct_name)
 
     while (!match(TokenType::RBrace))
     {
-        std::string name = current_.lexeme;
+        std::string name = current_->lexeme;
         consume(TokenType::Identifier, "Expected field name");
 
         if (seen_fields.count(name))
@@ -718,9 +755,9 @@ ExprPtr Parser::parse_struct_literal(std::string struct_name)
 
 void Parser::synchronize_type()
 {
-    while (current_.type != TokenType::Eof)
+    while (current_->type != TokenType::Eof)
     {
-        switch (current_.type)
+        switch (current_->type)
         {
         case TokenType::Semicolon:
         case TokenType::RParen:
@@ -738,7 +775,7 @@ void Parser::synchronize_type()
     }
 }
 
-std::unique_ptr<Type> Parser::parse_type_safe()
+TypePtr Parser::parse_type_safe()
 {
     try
     {
@@ -757,7 +794,8 @@ std::unique_ptr<Type> Parser::parse_type_safe()
 ExprPtr Parser::parse_identifier(int min_precedence)
 {
 
-    auto ident = current_.lexeme;
+    auto ident = current_->lexeme;
+    const Symbol symbol = symbol_of(*current_);
     advance();
 
     // handle MyStruct { ... } expr
@@ -769,40 +807,40 @@ ExprPtr Parser::parse_identifier(int min_precedence)
     else
     {
         MO_DEBUG("parser: parsing identifier");
-        return std::make_unique<VariableExpr>(ident);
+        return std::make_unique<VariableExpr>(ident, symbol);
     }
 }
 ExprPtr Parser::parse_literal()
 {
     ExprPtr expr;
-    switch (current_.type)
+    switch (current_->type)
     {
     case TokenType::IntegerLiteral:
-        expr = std::make_unique<IntegerLiteralExpr>(std::stoi(current_.lexeme));
+        expr = std::make_unique<IntegerLiteralExpr>(std::stoi(current_->lexeme));
         break;
     case TokenType::BooleanLiteral:
     {
         bool val = false;
-        if (current_.lexeme == "true")
+        if (current_->lexeme == "true")
         {
             val = true;
         }
-        else if (current_.lexeme == "false")
+        else if (current_->lexeme == "false")
         {
             val = false;
         }
         else
         {
-            error("Invalid boolean literal: " + current_.lexeme);
+            error("Invalid boolean literal: " + current_->lexeme);
         }
         expr = std::make_unique<BooleanLiteralExpr>(val);
         break;
     }
     case TokenType::FloatLiteral:
-        expr = std::make_unique<FloatLiteralExpr>(std::stof(current_.lexeme));
+        expr = std::make_unique<FloatLiteralExpr>(std::stof(current_->lexeme));
         break;
     case TokenType::StringLiteral:
-        expr = std::make_unique<StringLiteralExpr>(current_.lexeme);
+        expr = std::make_unique<StringLiteralExpr>(current_->lexeme);
         break;
     default:
         error("Unexpected literal in expression");
@@ -903,15 +941,15 @@ ExprPtr Parser::parse_init_list()
     consume(TokenType::LBracket, "Expected '[' for initializer list");
 
     std::vector<ExprPtr> members;
-    while (current_.type != TokenType::RBracket && current_.type != TokenType::Eof)
+    while (current_->type != TokenType::RBracket && current_->type != TokenType::Eof)
     {
         members.push_back(parse_expr());
 
-        if (current_.type == TokenType::Comma)
+        if (current_->type == TokenType::Comma)
         {
             advance(); // Consume the comma
         }
-        else if (current_.type != TokenType::RBracket)
+        else if (current_->type != TokenType::RBracket)
         {
             error("Expected ',' or ']' in initializer list");
         }
@@ -924,7 +962,7 @@ ExprPtr Parser::parse_init_list()
 ExprPtr Parser::parse_binary(ExprPtr left, int min_precedence)
 {
     MO_DEBUG("parser: parsing binary expression");
-    auto op = current_.type;
+    auto op = current_->type;
     advance();
     return std::make_unique<BinaryExpr>(op, std::move(left), std::move(parse_expr(min_precedence)));
 }
@@ -932,27 +970,27 @@ ExprPtr Parser::parse_binary(ExprPtr left, int min_precedence)
 ExprPtr Parser::parse_unary(int min_precedence)
 {
     MO_DEBUG("parser: parsing unary expression");
-    auto op = current_.type;
+    auto op = current_->type;
     advance();
     return std::make_unique<UnaryExpr>(op, std::move(parse_expr(min_precedence)));
 }
 
 StmtPtr Parser::parse_statement()
 {
-    if (current_.type == TokenType::Let || current_.type == TokenType::Const)
+    if (current_->type == TokenType::Let || current_->type == TokenType::Const)
     {
         VarDeclStmt stmt = parse_var_decl();
         return std::make_unique<VarDeclStmt>(std::move(stmt));
     }
-    else if (current_.type == TokenType::Return)
+    else if (current_->type == TokenType::Return)
     {
         return parse_return();
     }
-    else if (current_.type == TokenType::If)
+    else if (current_->type == TokenType::If)
     {
         return parse_if();
     }
-    else if (current_.type == TokenType::While)
+    else if (current_->type == TokenType::While)
     {
         return parse_while();
     }
@@ -968,7 +1006,7 @@ StmtPtr Parser::parse_return()
 {
     advance(); // Move past the 'return' keyword
     ExprPtr expr = nullptr;
-    if (current_.type != TokenType::Semicolon)
+    if (current_->type != TokenType::Semicolon)
     {
         expr = parse_expr();
     }
@@ -1003,7 +1041,7 @@ StmtPtr Parser::parse_while()
 
 VarDeclStmt Parser::parse_var_decl()
 {
-    bool is_const = (current_.type == TokenType::Const);
+    bool is_const = (current_->type == TokenType::Const);
     if (is_const)
     {
         advance();
@@ -1013,7 +1051,8 @@ VarDeclStmt Parser::parse_var_decl()
         consume(TokenType::Let, "Expected 'let' or 'const'");
     }
 
-    std::string name = current_.lexeme;
+    std::string name = current_->lexeme;
+    const Symbol symbol = current_->type == TokenType::Identifier ? symbol_of(*current_) : NO_SYMBOL;
     consume(TokenType::Identifier, "Expected variable name");
 
     TypePtr type = nullptr;
@@ -1030,8 +1069,10 @@ VarDeclStmt Parser::parse_var_decl()
         init_expr = parse_expr();
     }
 
-    consume(TokenType::Semicolon, vstring("Expected ';' after variable declaration for ", name, ", but got ", current_.lexeme));
-    return VarDeclStmt{is_const, std::move(name), std::move(type), std::move(init_expr)};
+    consume(TokenType::Semicolon, vstring("Expected ';' after variable declaration for ", name, ", but got ", current_->lexeme));
+    VarDeclStmt decl{is_const, std::move(name), std::move(type), std::move(init_expr)};
+    decl.symbol = symbol;
+    return decl;
 }
 
 FunctionDecl Parser::parse_function_decl(StructType *receiver_type)
@@ -1040,7 +1081,7 @@ FunctionDecl Parser::parse_function_decl(StructType *receiver_type)
 
     consume(TokenType::Fn, "Expected 'fn'");
 
-    std::string name = current_.lexeme;
+    std::string name = current_->lexeme;
     consume(TokenType::Identifier, "Expected function name");
 
     // Params
@@ -1057,7 +1098,7 @@ FunctionDecl Parser::parse_function_decl(StructType *receiver_type)
 
     while (!match(TokenType::RParen))
     {
-        std::string param_name = current_.lexeme;
+        std::string param_name = current_->lexeme;
         consume(TokenType::Identifier, "Expected parameter name");
         consume(TokenType::Colon, "Expected : after parameter name");
         auto type = parse_type();
@@ -1100,27 +1141,28 @@ FunctionDecl Parser::parse_function_decl(StructType *receiver_type)
 
 void Parser::error(const std::string &message) const
 {
-    throw ParseError{current_.start_line, current_.start_col, message};
+    throw ParseError{current_->start_line, current_->start_col, message};
 }
 
 void Parser::advance()
 {
-    MO_DEBUG("parser: advancing to next token (from %s)", current_.lexeme.c_str());
-    previous_ = current_;
-    current_ = lexer_.next_token();
+    MO_DEBUG("parser: advancing to next token (from %s)", current_->lexeme.c_str());
+    tokens_.advance();
+    previous_ = &tokens_.previous();
+    current_ = &tokens_.current();
 }
 
 void Parser::synchronize()
 {
-    while (current_.type != TokenType::Eof)
+    while (current_->type != TokenType::Eof)
     {
-        if (current_.type == TokenType::Semicolon)
+        if (current_->type == TokenType::Semicolon)
         {
             advance();
             return;
         }
 
-        switch (current_.type)
+        switch (current_->type)
         {
         case TokenType::Struct:
         case TokenType::Impl:
@@ -1135,9 +1177,12 @@ void Parser::synchronize()
 
 Program Parser::parse()
 {
+    PhaseTimer timer("parse");
     Program program;
+    program.arena = std::make_unique<Arena>();
+    ArenaScope arena_scope(program.arena.get());
 
-    while (current_.type != TokenType::Eof)
+    while (current_->type != TokenType::Eof)
     {
         try
         {
@@ -1159,7 +1204,7 @@ Program Parser::parse()
             }
             else
             {
-                error("Unexpected token at top level: " + current_.lexeme);
+                error("Unexpected token at top level: " + current_->lexeme);
                 synchronize();
             }
         }
@@ -1171,6 +1216,10 @@ Program Parser::parse()
         }
     }
 
+    timer.count("ast_nodes", program.arena->num_allocations());
+    timer.count("ast_bytes", program.arena->bytes_allocated());
+    // A table the caller gave the lexer stays theirs; copies keep the ids
+    program.symbols = owned_symbols_ ? std::move(owned_symbols_) : std::make_unique<SymbolTable>(*symbols_);
     return program;
 }
 
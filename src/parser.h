@@ -3,9 +3,7 @@
 #include "lexer.h"
 #include "ast.h"
 #include <memory>
-#include <functional>
 #include <unordered_map>
-#include <set>
 #include <sstream>
 #include <string>
 
@@ -20,6 +18,7 @@ class Parser
 {
 public:
     explicit Parser(Lexer &&lexer);
+    explicit Parser(TokenStream &&tokens);
 
     ast::Program parse();
     ast::ExprPtr parse_expr(int precedence = 0);
@@ -28,49 +27,27 @@ public:
     std::vector<std::string> errors() const { return errors_; }
 
 private:
-    Lexer lexer_;
-    Token current_;
-    Token previous_;
+    // The table identifiers are interned into when the lexer brought none;
+    // parse() hands it to the Program
+    std::unique_ptr<SymbolTable> owned_symbols_;
+    TokenStream tokens_;
+    // Point into tokens_, which never reallocates once lexed
+    const Token *current_;
+    const Token *previous_;
+    SymbolTable *symbols_;
     std::vector<std::string> errors_;
-    std::unordered_map<std::string, std::unique_ptr<ast::Type>> type_aliases_;
+    std::unordered_map<std::string, ast::TypePtr> type_aliases_;
 
-    struct PrattRule
-    {
-        std::function<ast::ExprPtr()> prefix;
-        std::function<ast::ExprPtr(ast::ExprPtr)> infix;
-
-        bool operator<(const PrattRule& other) const
-        {
-            if (prefix && other.prefix)
-                return false;
-            if (infix && other.infix)
-                return false;
-            return true;
-        }
-    };
-
-    struct TypePrattRule
-    {
-        std::function<ast::TypePtr()> prefix;
-        std::function<ast::TypePtr(ast::TypePtr)> infix;
-
-        bool operator<(const TypePrattRule& other) const
-        {
-            if (prefix && other.prefix)
-                return false;
-            if (infix && other.infix)
-                return false;
-            return true;
-        }
-    };
-
-    std::unordered_map<TokenType, std::set<PrattRule>> pratt_rules_;
-    std::unordered_map<TokenType, std::set<TypePrattRule>> type_pratt_rules_;
-
-    void init_pratt_rules();
-    void init_type_pratt_rules();
+    // Pratt handlers, dispatched through the constexpr rule tables in parser.cc
+    ast::ExprPtr parse_prefix(TokenType type);
+    ast::ExprPtr parse_infix(TokenType type, ast::ExprPtr left);
+    ast::TypePtr parse_type_prefix(TokenType type);
+    ast::TypePtr parse_type_postfix(TokenType type, ast::TypePtr left);
 
     void advance();
+    // Interned id of an identifier token
+    Symbol symbol_of(const Token &token) { return token.symbol != NO_SYMBOL ? token.symbol : symbols_->intern(token.text); }
+    const Token &peek(size_t offset = 1) const { return tokens_.peek(offset); }
     bool match(TokenType type);
     void consume(TokenType type, const std::string &message = "");
     bool try_consume(TokenType type);
@@ -81,12 +58,12 @@ private:
     ast::TypePtr parse_type_safe();
     ast::TypePtr parse_prefix_type();
     ast::TypePtr parse_pointer_type();
-    ast::TypePtr parse_array_type(std::unique_ptr<ast::Type> base_type);
+    ast::TypePtr parse_array_type(ast::TypePtr base_type);
     ast::TypePtr parse_non_pointer_type();
-    void parse_basic_type(std::unique_ptr<ast::Type> &type);
-    void parse_function_type(std::unique_ptr<ast::Type> &type);
-    void parse_struct_type(std::unique_ptr<ast::Type> &type);
-    void parse_type_alias(std::unique_ptr<ast::Type> &type);
+    void parse_basic_type(ast::TypePtr &type);
+    void parse_function_type(ast::TypePtr &type);
+    void parse_struct_type(ast::TypePtr &type);
+    void parse_type_alias(ast::TypePtr &type);
     void synchronize_type();
 
     ast::TypeAliasDecl parse_type_alias_decl();
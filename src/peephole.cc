@@ -0,0 +1,486 @@
+#include "peephole.h"
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <unordered_set>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    uint64_t pattern_key(PeepholeKind kind, unsigned opcode)
+    {
+        return (static_cast<uint64_t>(kind) << 32) | opcode;
+    }
+
+    bool is_reg_reg_reg(const MachineInst &mi)
+    {
+        const auto &ops = mi.operands();
+        return ops.size() == 3 && ops[0].is_reg() && ops[0].is_def() && ops[1].is_reg() && !ops[1].is_def() &&
+               ops[2].is_reg() && !ops[2].is_def();
+    }
+
+    // `op r, [base + offset]`
+    bool is_reg_mem(const MachineInst &mi)
+    {
+        const auto &ops = mi.operands();
+        return ops.size() == 2 && ops[0].is_reg() && ops[1].is_mem_ri();
+    }
+
+    bool has_memory_operand(const MachineInst &mi)
+    {
+        for (const MOperand &op : mi.operands())
+        {
+            if (op.is_mem_ri() || op.is_mem_rr() || op.is_mem_rix() || op.is_mem_fi())
+                return true;
+        }
+        return false;
+    }
+
+    // Register and immediate operands only, which is all a setup has
+    bool same_operands(const MachineInst &a, const MachineInst &b)
+    {
+        if (a.operands().size() != b.operands().size() || a.implicit_defs() != b.implicit_defs())
+            return false;
+        for (size_t i = 0; i < a.operands().size(); ++i)
+        {
+            const MOperand &x = a.operands()[i], &y = b.operands()[i];
+            if (x.is_reg() && y.is_reg())
+            {
+                if (x.reg() != y.reg() || x.is_def() != y.is_def())
+                    return false;
+            }
+            else if (!x.is_imm() || !y.is_imm() || x.imm() != y.imm())
+                return false;
+        }
+        return true;
+    }
+
+    std::unique_ptr<MachineInst> rebuild(const MachineInst &like, unsigned opcode, const std::vector<MOperand> &ops)
+    {
+        auto mi = std::make_unique<MachineInst>(opcode, ops);
+        for (unsigned flag = 0; flag < static_cast<unsigned>(MIFlag::TOTAL_FLAGS); ++flag)
+        {
+            if (like.has_flag(static_cast<MIFlag>(flag)))
+                mi->set_flag(static_cast<MIFlag>(flag));
+        }
+        return mi;
+    }
+
+    // A stack slot, or any other MEMri location, known to hold `reg`
+    struct KnownSlot
+    {
+        unsigned base_reg;
+        int offset;
+        unsigned bytes;
+        unsigned reg;
+        const PeepholePattern *pattern;
+
+        bool overlaps(unsigned base, int other_offset, unsigned other_bytes) const
+        {
+            return base != base_reg ||
+                   (other_offset < offset + static_cast<int>(bytes) &&
+                    offset < other_offset + static_cast<int>(other_bytes));
+        }
+    };
+
+    struct KnownConstant
+    {
+        int64_t value;
+        const MachineInst *def;
+    };
+
+    class FunctionPeephole
+    {
+    public:
+        FunctionPeephole(const TargetPeepholeInfo &target, MachineFunction &mf)
+            : target_(target), tii_(target.inst_info()), mf_(mf) {}
+
+        PeepholeStats run()
+        {
+            bool changed = true;
+            while (changed)
+            {
+                changed = false;
+                for (const auto &mbb : mf_.basic_blocks())
+                    changed |= run_block(*mbb);
+            }
+            return stats_;
+        }
+
+    private:
+        const TargetPeepholeInfo &target_;
+        const TargetInstInfo &tii_;
+        MachineFunction &mf_;
+        PeepholeStats stats_;
+
+        // Per-block state, from the start of the block up to the current instruction
+        std::unordered_map<unsigned, KnownConstant> constants_;
+        std::vector<KnownSlot> slots_;
+        const MachineInst *setup_ = nullptr;
+
+        bool run_block(MachineBasicBlock &mbb);
+        bool fold_compare_branch(MachineBasicBlock &mbb, size_t &index);
+        bool fold_immediate(MachineBasicBlock &mbb, size_t &index);
+        bool forward_reload(MachineBasicBlock &mbb, size_t index);
+        bool remove_redundant_setup(MachineBasicBlock &mbb, size_t index);
+        void update_state(const MachineInst &mi);
+        void remove_dead_constant(MachineBasicBlock &mbb, unsigned reg, size_t &index);
+
+        bool is_zero(unsigned reg) const
+        {
+            if (reg == target_.zero_register())
+                return true;
+            auto it = constants_.find(reg);
+            return it != constants_.end() && it->second.value == 0;
+        }
+
+        std::optional<int64_t> constant(unsigned reg) const
+        {
+            auto it = constants_.find(reg);
+            if (it == constants_.end())
+                return std::nullopt;
+            return it->second.value;
+        }
+
+        bool is_live_after(MachineBasicBlock &mbb, size_t index, unsigned reg) const;
+    };
+
+    bool FunctionPeephole::run_block(MachineBasicBlock &mbb)
+    {
+        constants_.clear();
+        slots_.clear();
+        setup_ = nullptr;
+        bool changed = false;
+        size_t index = 0;
+        while (index < mbb.instructions().size())
+        {
+            const MachineInst &mi = *mbb.instructions()[index];
+            unsigned dest, src;
+            if (tii_.is_copy(mi, dest, src) && dest == src)
+            {
+                mbb.erase(mbb.begin() + index);
+                ++stats_.identity_copies;
+                changed = true;
+                continue;
+            }
+            // Each rewrite leaves `index` at its result, which is then seen as usual
+            if (fold_compare_branch(mbb, index) || fold_immediate(mbb, index) || forward_reload(mbb, index) ||
+                remove_redundant_setup(mbb, index))
+            {
+                changed = true;
+                continue;
+            }
+            update_state(mi);
+            ++index;
+        }
+        return changed;
+    }
+
+    bool FunctionPeephole::fold_compare_branch(MachineBasicBlock &mbb, size_t &index)
+    {
+        const MachineInst &cmp = *mbb.instructions()[index];
+        const auto &patterns = target_.lookup(PeepholeKind::CompareBranch, cmp.opcode());
+        if (patterns.empty() || index + 1 >= mbb.instructions().size() || !is_reg_reg_reg(cmp))
+            return false;
+        const MachineInst &branch = *mbb.instructions()[index + 1];
+        const auto &branch_ops = branch.operands();
+        const unsigned t = cmp.operands()[0].reg();
+
+        // `br t, target`, or `br t, zero, target` either way round
+        if (branch_ops.empty() || !branch_ops.back().is_basic_block())
+            return false;
+        if (branch_ops.size() == 2)
+        {
+            if (!branch_ops[0].is_reg() || branch_ops[0].reg() != t)
+                return false;
+        }
+        else if (branch_ops.size() == 3)
+        {
+            if (!branch_ops[0].is_reg() || !branch_ops[1].is_reg())
+                return false;
+            const unsigned x = branch_ops[0].reg(), y = branch_ops[1].reg();
+            if (!(x == t && is_zero(y)) && !(y == t && is_zero(x)))
+                return false;
+        }
+        else
+            return false;
+
+        for (const PeepholePattern *p : patterns)
+        {
+            if (branch.opcode() != p->second_opcode)
+                continue;
+            unsigned a = cmp.operands()[1].reg(), b = cmp.operands()[2].reg();
+            std::vector<MOperand> ops;
+            if (p->against_zero)
+            {
+                if (!is_zero(b))
+                {
+                    if (!p->commutative || !is_zero(a))
+                        continue;
+                    std::swap(a, b);
+                }
+                ops = {MOperand::create_reg(a), branch_ops.back()};
+            }
+            else
+                ops = {MOperand::create_reg(a), MOperand::create_reg(b), branch_ops.back()};
+            if (is_live_after(mbb, index + 1, t))
+                return false;
+
+            auto fused = rebuild(branch, p->result_opcode, ops);
+            mbb.erase(mbb.begin() + index + 1);
+            mbb.erase(mbb.begin() + index);
+            mbb.insert(mbb.begin() + index, std::move(fused));
+            ++stats_.compare_branches;
+            if (p->against_zero)
+                remove_dead_constant(mbb, b, index);
+            return true;
+        }
+        return false;
+    }
+
+    bool FunctionPeephole::fold_immediate(MachineBasicBlock &mbb, size_t &index)
+    {
+        const MachineInst &mi = *mbb.instructions()[index];
+        const auto &patterns = target_.lookup(PeepholeKind::FoldImmediate, mi.opcode());
+        if (patterns.empty() || !is_reg_reg_reg(mi))
+            return false;
+        const auto &ops = mi.operands();
+
+        for (const PeepholePattern *p : patterns)
+        {
+            unsigned reg = ops[1].reg(), constant_reg = ops[2].reg();
+            std::optional<int64_t> c = constant(constant_reg);
+            if (!c && p->commutative)
+            {
+                std::swap(reg, constant_reg);
+                c = constant(constant_reg);
+            }
+            if (!c || (p->negate_imm && *c == INT64_MIN))
+                continue;
+            const int64_t imm = p->negate_imm ? -*c : *c;
+            if (!tii_.is_legal_immediate(imm, p->imm_bits))
+                continue;
+
+            auto folded = rebuild(mi, p->result_opcode,
+                                  {ops[0], MOperand::create_reg(reg), MOperand::create_imm(imm)});
+            mbb.erase(mbb.begin() + index);
+            mbb.insert(mbb.begin() + index, std::move(folded));
+            ++stats_.folded_immediates;
+            remove_dead_constant(mbb, constant_reg, index);
+            return true;
+        }
+        return false;
+    }
+
+    bool FunctionPeephole::forward_reload(MachineBasicBlock &mbb, size_t index)
+    {
+        const MachineInst &load = *mbb.instructions()[index];
+        const PeepholePattern *p = target_.memory_pattern(load.opcode());
+        if (!p || load.opcode() != p->second_opcode || !is_reg_mem(load))
+            return false;
+        const unsigned dest = load.operands()[0].reg();
+        const MOperand::MEMri &mem = load.operands()[1].mem_ri();
+
+        const KnownSlot *found = nullptr;
+        for (const KnownSlot &slot : slots_)
+        {
+            if (slot.pattern == p && slot.base_reg == mem.base_reg && slot.offset == mem.offset &&
+                (!found || slot.reg == dest))
+                found = &slot;
+        }
+        if (found)
+        {
+            const unsigned src = found->reg;
+            if (src != dest)
+            {
+                // Some classes only copy through arithmetic, which is no cheaper
+                const size_t size = mbb.instructions().size();
+                tii_.copy_phys_reg(mbb, mbb.begin() + index, dest, src);
+                const size_t inserted = mbb.instructions().size() - size;
+                unsigned copy_dest, copy_src;
+                if (inserted != 1 || !tii_.is_copy(*mbb.instructions()[index], copy_dest, copy_src))
+                {
+                    for (size_t i = 0; i < inserted; ++i)
+                        mbb.erase(mbb.begin() + index);
+                    return false;
+                }
+            }
+            mbb.erase(mbb.begin() + index + (src != dest));
+            ++stats_.forwarded_reloads;
+            return true;
+        }
+        return false;
+    }
+
+    bool FunctionPeephole::remove_redundant_setup(MachineBasicBlock &mbb, size_t index)
+    {
+        const MachineInst &mi = *mbb.instructions()[index];
+        if (!setup_ || setup_->opcode() != mi.opcode() || !same_operands(*setup_, mi))
+            return false;
+        mbb.erase(mbb.begin() + index);
+        ++stats_.redundant_setups;
+        return true;
+    }
+
+    void FunctionPeephole::update_state(const MachineInst &mi)
+    {
+        const std::set<unsigned> defs = mi.defs();
+        if (setup_)
+        {
+            // Changing the state, or a register the setup reads
+            const std::set<unsigned> setup_regs = [this]
+            {
+                std::set<unsigned> regs = setup_->defs();
+                regs.merge(setup_->uses());
+                return regs;
+            }();
+            const bool clobbered = tii_.is_call(mi) && std::any_of(setup_regs.begin(), setup_regs.end(), [this](unsigned reg)
+                                                                   { return target_.is_caller_saved(reg); });
+            if (clobbered || std::any_of(defs.begin(), defs.end(), [&](unsigned reg) { return setup_regs.count(reg); }))
+                setup_ = nullptr;
+        }
+        if (!target_.lookup(PeepholeKind::RedundantSetup, mi.opcode()).empty())
+            setup_ = &mi;
+        for (unsigned reg : defs)
+        {
+            constants_.erase(reg);
+            std::erase_if(slots_, [reg](const KnownSlot &slot) { return slot.reg == reg || slot.base_reg == reg; });
+        }
+
+        if (tii_.is_call(mi))
+        {
+            // Callees may write any memory and any register they don't preserve
+            slots_.clear();
+            std::erase_if(constants_, [this](const auto &entry)
+                          { return MachineFunction::is_physical_reg(entry.first) && target_.is_caller_saved(entry.first); });
+            return;
+        }
+
+        const PeepholePattern *p = target_.memory_pattern(mi.opcode());
+        if (p && is_reg_mem(mi))
+        {
+            const unsigned reg = mi.operands()[0].reg();
+            const MOperand::MEMri &mem = mi.operands()[1].mem_ri();
+            if (mi.opcode() == p->opcode)
+            {
+                std::erase_if(slots_, [&](const KnownSlot &slot)
+                              { return slot.overlaps(mem.base_reg, mem.offset, p->access_bytes); });
+            }
+            if (reg != mem.base_reg)
+                slots_.push_back({mem.base_reg, mem.offset, p->access_bytes, reg, p});
+        }
+        else if (defs.empty() && (mi.has_flag(MIFlag::MayStore) || has_memory_operand(mi)))
+        {
+            // A store of a width the table doesn't know
+            slots_.clear();
+        }
+
+        const auto &ops = mi.operands();
+        if (target_.is_constant_opcode(mi.opcode()) && ops.size() == 2 && ops[0].is_reg() && ops[0].is_def() &&
+            ops[1].is_imm())
+            constants_[ops[0].reg()] = {ops[1].imm(), &mi};
+    }
+
+    void FunctionPeephole::remove_dead_constant(MachineBasicBlock &mbb, unsigned reg, size_t &index)
+    {
+        auto it = constants_.find(reg);
+        if (it == constants_.end())
+            return;
+        const size_t def_index = mbb.locate(it->second.def) - mbb.begin();
+        if (is_live_after(mbb, def_index, reg))
+            return;
+        constants_.erase(it);
+        mbb.erase(mbb.begin() + def_index);
+        ++stats_.dead_constants;
+        if (def_index < index)
+            --index;
+    }
+
+    // Whether `reg` may be read after the instruction at `index`
+    bool FunctionPeephole::is_live_after(MachineBasicBlock &mbb, size_t index, unsigned reg) const
+    {
+        const bool physical = MachineFunction::is_physical_reg(reg);
+        std::unordered_set<const MachineBasicBlock *> visited;
+        std::vector<std::pair<MachineBasicBlock *, size_t>> worklist{{&mbb, index + 1}};
+        while (!worklist.empty())
+        {
+            auto [block, start] = worklist.back();
+            worklist.pop_back();
+
+            bool killed = false;
+            const auto &insts = block->instructions();
+            for (size_t i = start; i < insts.size() && !killed; ++i)
+            {
+                const MachineInst &mi = *insts[i];
+                if (mi.uses().count(reg))
+                    return true;
+                if (tii_.is_return(mi))
+                {
+                    // The caller sees the return registers and whatever it expects preserved
+                    if (physical && (target_.is_return_register(reg) || !target_.is_caller_saved(reg)))
+                        return true;
+                    killed = true;
+                }
+                else if (tii_.is_call(mi) && physical)
+                {
+                    if (target_.is_argument_register(reg))
+                        return true;
+                    killed = target_.is_caller_saved(reg);
+                }
+                killed = killed || mi.defs().count(reg);
+            }
+            if (killed)
+                continue;
+            if (block->successors().empty())
+                return true;
+            for (MachineBasicBlock *succ : block->successors())
+            {
+                if (visited.insert(succ).second)
+                    worklist.push_back({succ, 0});
+            }
+        }
+        return false;
+    }
+} // namespace
+
+//===----------------------------------------------------------------------===//
+//                             TargetPeepholeInfo Implementation
+//===----------------------------------------------------------------------===//
+
+const std::vector<const PeepholePattern *> &TargetPeepholeInfo::lookup(PeepholeKind kind, unsigned opcode) const
+{
+    static const std::vector<const PeepholePattern *> none;
+    auto it = index_.find(pattern_key(kind, opcode));
+    return it == index_.end() ? none : it->second;
+}
+
+const PeepholePattern *TargetPeepholeInfo::memory_pattern(unsigned opcode) const
+{
+    auto it = memory_index_.find(opcode);
+    return it == memory_index_.end() ? nullptr : it->second;
+}
+
+void TargetPeepholeInfo::add_pattern(PeepholePattern pattern)
+{
+    patterns_.push_back(std::make_unique<PeepholePattern>(std::move(pattern)));
+    const PeepholePattern *p = patterns_.back().get();
+    index_[pattern_key(p->kind, p->opcode)].push_back(p);
+    if (p->kind == PeepholeKind::StoreReload)
+    {
+        memory_index_.emplace(p->opcode, p);
+        memory_index_.emplace(p->second_opcode, p);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Peephole Optimization Implementation
+//===----------------------------------------------------------------------===//
+
+PeepholeStats run_peephole(const TargetPeepholeInfo &target, MachineFunction &mf)
+{
+    MachineInstPoolScope pool(mf);
+    return FunctionPeephole(target, mf).run();
+}
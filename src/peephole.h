@@ -0,0 +1,125 @@
+// peephole.h - Table-driven peephole optimization of machine code
+#pragma once
+
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "machine.h"
+
+//===----------------------------------------------------------------------===//
+//                             Peephole Patterns
+//===----------------------------------------------------------------------===//
+//
+// A target describes its peepholes as a table of patterns, each rewriting a
+// short run of instructions within one block. Identity copies, as the
+// target's `is_copy` recognizes them, go regardless of the table. The pass
+// runs on virtual or physical registers alike; results it removes must be
+// dead, which for physical registers it works out across the CFG with the
+// target's calling convention.
+
+enum class PeepholeKind : uint8_t
+{
+    // `compare t, a, b` then `branch t` becomes one branch on a and b
+    CompareBranch,
+    // `op rd, a, t` where t was loaded with a constant becomes `op' rd, a, c`
+    FoldImmediate,
+    // `load r2, [m]` after `store r, [m]` or `load r, [m]` goes when r2 is
+    // r, and becomes `copy r2, r` when copy_phys_reg gives a plain copy
+    StoreReload,
+    // `opcode` setting up state, e.g. vl and vtype, goes when the same
+    // instruction already did and nothing since touched what it defines
+    RedundantSetup,
+};
+
+struct PeepholePattern
+{
+    PeepholeKind kind;
+    unsigned opcode;            // the compare, the register form, the store/load, or the setup
+    unsigned second_opcode = 0; // CompareBranch: branch; StoreReload: the matching load
+    unsigned result_opcode = 0; // CompareBranch: fused branch; FoldImmediate: immediate form
+    bool commutative = false;   // the register operands of `opcode` may swap
+    // CompareBranch: the fused branch tests a against zero, so b must be zero
+    bool against_zero = false;
+    unsigned imm_bits = 0;      // FoldImmediate: width checked with is_legal_immediate
+    bool negate_imm = false;    // FoldImmediate: e.g. `x - c` as `x + -c`
+    unsigned access_bytes = 0;  // StoreReload
+};
+
+struct PeepholeStats
+{
+    unsigned identity_copies = 0;
+    unsigned compare_branches = 0;
+    unsigned folded_immediates = 0;
+    unsigned forwarded_reloads = 0;
+    unsigned redundant_setups = 0;
+    // Constants left without uses by the other rewrites
+    unsigned dead_constants = 0;
+
+    unsigned total() const
+    {
+        return identity_copies + compare_branches + folded_immediates + forwarded_reloads + redundant_setups +
+               dead_constants;
+    }
+};
+
+//===----------------------------------------------------------------------===//
+//                             Target Peephole Info
+//===----------------------------------------------------------------------===//
+
+class TargetPeepholeInfo
+{
+public:
+    static constexpr unsigned NO_REG = ~0u;
+
+    virtual ~TargetPeepholeInfo() = default;
+
+    const TargetInstInfo &inst_info() const { return *tii_; }
+
+    // Patterns keyed on `opcode` (the first instruction), in table order
+    const std::vector<const PeepholePattern *> &lookup(PeepholeKind kind, unsigned opcode) const;
+    // The StoreReload pattern whose store or load is `opcode`
+    const PeepholePattern *memory_pattern(unsigned opcode) const;
+
+    // NO_REG if the target has none
+    unsigned zero_register() const { return zero_reg_; }
+    // `op rd, imm` forms that load a constant
+    bool is_constant_opcode(unsigned opcode) const { return constant_opcodes_.count(opcode) != 0; }
+
+    // Physical registers a call reads, and those it may change
+    bool is_argument_register(unsigned reg) const { return arg_regs_.count(reg) != 0; }
+    bool is_caller_saved(unsigned reg) const { return caller_saved_regs_.count(reg) != 0; }
+    // Physical registers a return reads besides those the callee preserves
+    bool is_return_register(unsigned reg) const { return return_regs_.count(reg) != 0; }
+
+protected:
+    explicit TargetPeepholeInfo(const TargetInstInfo *tii) : tii_(tii) {}
+
+    void add_pattern(PeepholePattern pattern);
+
+    const TargetInstInfo *tii_;
+    unsigned zero_reg_ = NO_REG;
+    std::set<unsigned> constant_opcodes_;
+    std::set<unsigned> arg_regs_;
+    std::set<unsigned> caller_saved_regs_;
+    std::set<unsigned> return_regs_;
+
+private:
+    std::vector<std::unique_ptr<PeepholePattern>> patterns_;
+    std::unordered_map<uint64_t, std::vector<const PeepholePattern *>> index_;
+    std::unordered_map<unsigned, const PeepholePattern *> memory_index_;
+};
+
+//===----------------------------------------------------------------------===//
+//                             Peephole Optimization
+//===----------------------------------------------------------------------===//
+//
+// Meant to run after register allocation, frame index resolution and
+// pseudo expansion, when copies that coalesced onto one register, spill
+// code and the constants of expanded pseudos are all in plain view. Memory
+// forwarding only follows MEMri operands and gives up at calls and at any
+// store that may overlap. Block successors must be up to date.
+
+// Rewrites `mf` until no pattern applies
+PeepholeStats run_peephole(const TargetPeepholeInfo &target, MachineFunction &mf);
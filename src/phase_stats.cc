@@ -0,0 +1,198 @@
+#include "phase_stats.h"
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+#include "mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             Allocation counters
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    std::atomic<uint64_t> allocation_count{0};
+    std::atomic<uint64_t> allocation_bytes{0};
+}
+
+AllocStats current_alloc_stats()
+{
+    return {allocation_count.load(std::memory_order_relaxed),
+            allocation_bytes.load(std::memory_order_relaxed)};
+}
+
+void note_allocation(size_t bytes)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+//===----------------------------------------------------------------------===//
+//                             PhaseStats
+//===----------------------------------------------------------------------===//
+
+PhaseStats &PhaseStats::global()
+{
+    static PhaseStats stats;
+    return stats;
+}
+
+void PhaseStats::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    phases_.clear();
+}
+
+PhaseStats::Phase &PhaseStats::phase(const std::string &name)
+{
+    auto it = std::find_if(phases_.begin(), phases_.end(), [&](const Phase &p)
+                           { return p.name == name; });
+    if (it != phases_.end())
+    {
+        return *it;
+    }
+    phases_.push_back({name});
+    return phases_.back();
+}
+
+void PhaseStats::add_run(const std::string &name, double wall_seconds, const AllocStats &allocated)
+{
+    if (!enabled())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    Phase &p = phase(name);
+    p.runs++;
+    p.wall_seconds += wall_seconds;
+    p.allocations += allocated.count;
+    p.allocated_bytes += allocated.bytes;
+}
+
+void PhaseStats::add_count(const std::string &name, const std::string &counter, uint64_t amount)
+{
+    if (!enabled())
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &counters = phase(name).counters;
+    auto it = std::find_if(counters.begin(), counters.end(), [&](const auto &c)
+                           { return c.first == counter; });
+    if (it == counters.end())
+    {
+        counters.emplace_back(counter, amount);
+    }
+    else
+    {
+        it->second += amount;
+    }
+}
+
+std::vector<PhaseStats::Phase> PhaseStats::phases() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return phases_;
+}
+
+void PhaseStats::print_table(std::ostream &os) const
+{
+    const auto snapshot = phases();
+    double total_seconds = 0;
+    for (const auto &p : snapshot)
+    {
+        total_seconds += p.wall_seconds;
+    }
+
+    os << "===-------------------------------------------------------------------------===\n"
+       << "                          Compile phase report\n"
+       << "===-------------------------------------------------------------------------===\n";
+    os << std::left << std::setw(14) << "Phase" << std::right
+       << std::setw(6) << "Runs"
+       << std::setw(12) << "Wall (ms)"
+       << std::setw(8) << "%"
+       << std::setw(10) << "Allocs"
+       << std::setw(12) << "Bytes"
+       << "  Counters\n";
+
+    for (const auto &p : snapshot)
+    {
+        std::ostringstream counters;
+        for (size_t i = 0; i < p.counters.size(); ++i)
+        {
+            counters << (i ? " " : "") << p.counters[i].first << "=" << p.counters[i].second;
+        }
+        const double percent = total_seconds > 0 ? 100.0 * p.wall_seconds / total_seconds : 0.0;
+        os << std::left << std::setw(14) << p.name << std::right
+           << std::setw(6) << p.runs
+           << std::setw(12) << std::fixed << std::setprecision(3) << p.wall_seconds * 1e3
+           << std::setw(8) << std::setprecision(1) << percent
+           << std::setw(10) << p.allocations
+           << std::setw(12) << p.allocated_bytes
+           << "  " << counters.str() << "\n";
+    }
+    os << std::defaultfloat;
+}
+
+void PhaseStats::export_to_json(std::ostream &os) const
+{
+    const auto snapshot = phases();
+    std::stringstream json;
+    json << "{\n";
+    json << "  \"title\": \"Compile Phases\",\n";
+    json << "  \"phases\": [";
+    for (size_t i = 0; i < snapshot.size(); ++i)
+    {
+        const Phase &p = snapshot[i];
+        json << (i ? ",\n" : "\n");
+        json << "    {\n";
+        json << "      \"name\": \"" << escape_json_string(p.name) << "\",\n";
+        json << "      \"runs\": " << p.runs << ",\n";
+        json << "      \"wallMs\": " << std::fixed << std::setprecision(3) << p.wall_seconds * 1e3 << ",\n";
+        json << "      \"allocations\": " << p.allocations << ",\n";
+        json << "      \"allocatedBytes\": " << p.allocated_bytes << ",\n";
+        json << "      \"counters\": {";
+        for (size_t j = 0; j < p.counters.size(); ++j)
+        {
+            json << (j ? ", " : "") << "\"" << escape_json_string(p.counters[j].first) << "\": " << p.counters[j].second;
+        }
+        json << "}\n";
+        json << "    }";
+    }
+    json << "\n  ]\n";
+    json << "}\n";
+    os << json.str();
+}
+
+//===----------------------------------------------------------------------===//
+//                             PhaseTimer
+//===----------------------------------------------------------------------===//
+
+PhaseTimer::PhaseTimer(const char *phase)
+{
+    if (PhaseStats::global().enabled())
+    {
+        phase_ = phase;
+        start_allocs_ = current_alloc_stats();
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (!phase_)
+    {
+        return;
+    }
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    const AllocStats now = current_alloc_stats();
+    PhaseStats::global().add_run(phase_, elapsed, {now.count - start_allocs_.count, now.bytes - start_allocs_.bytes});
+}
+
+void PhaseTimer::count(const char *counter, uint64_t amount)
+{
+    if (phase_)
+    {
+        PhaseStats::global().add_count(phase_, counter, amount);
+    }
+}
@@ -0,0 +1,88 @@
+// phase_stats.h -- Per-phase wall time, allocation and item counters (-ftime-report)
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             Allocation counters
+//===----------------------------------------------------------------------===//
+
+// Process-wide count of global operator new calls. They stay zero unless the
+// binary links the :alloc_stats library, which replaces operator new.
+struct AllocStats
+{
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+AllocStats current_alloc_stats();
+void note_allocation(size_t bytes);
+
+//===----------------------------------------------------------------------===//
+//                             PhaseStats
+//===----------------------------------------------------------------------===//
+
+// Registry every compiler stage reports into. Recording is off by default, and
+// then timers and counters cost one relaxed load. Phases keep the order in
+// which they first reported; a phase that runs several times accumulates.
+// Phase times are inclusive, so a phase run from inside another one (liveness
+// from register allocation) is also counted in its parent.
+class PhaseStats
+{
+public:
+    struct Phase
+    {
+        std::string name;
+        uint64_t runs = 0;
+        double wall_seconds = 0;
+        uint64_t allocations = 0;
+        uint64_t allocated_bytes = 0;
+        std::vector<std::pair<std::string, uint64_t>> counters = {}; // in first-report order
+    };
+
+    static PhaseStats &global();
+
+    void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+    void reset();
+
+    void add_run(const std::string &phase, double wall_seconds, const AllocStats &allocated);
+    void add_count(const std::string &phase, const std::string &counter, uint64_t amount);
+
+    std::vector<Phase> phases() const;
+    void print_table(std::ostream &os) const;
+    void export_to_json(std::ostream &os) const;
+
+private:
+    Phase &phase(const std::string &name);
+
+    std::atomic<bool> enabled_{false};
+    mutable std::mutex mutex_;
+    std::vector<Phase> phases_;
+};
+
+// Times one run of `phase` and attributes the allocations made meanwhile to it
+class PhaseTimer
+{
+public:
+    explicit PhaseTimer(const char *phase);
+    ~PhaseTimer();
+    PhaseTimer(const PhaseTimer &) = delete;
+    PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+    // Adds to a counter of this phase
+    void count(const char *counter, uint64_t amount);
+
+private:
+    const char *phase_ = nullptr; // nullptr when recording was off at construction
+    std::chrono::steady_clock::time_point start_;
+    AllocStats start_allocs_;
+};
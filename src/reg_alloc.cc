@@ -1,6 +1,10 @@
 #include "reg_alloc.h"
 #include "machine.h"
 #include "lra.h"
+#include <algorithm>
+#include <cmath>
+
+static_assert(VRegToPregTable::EMPTY_SLOT == MachineInst::NO_REG, "register tables feed remap_registers directly");
 //===----------------------------------------------------------------------===//
 // RegisterAllocator Implementation
 //===----------------------------------------------------------------------===//
@@ -9,6 +13,7 @@ std::string RegAllocResult::to_string() const
 {
     std::ostringstream oss;
     oss << "num_spills: " << num_spills << ", "
+        << "num_remats: " << num_remats << ", "
         << "num_copies: " << num_copies << ", "
         << "max_stack_size: " << max_stack_size << ", "
         << "successful: " << successful << ", "
@@ -22,13 +27,37 @@ RegisterAllocator::RegisterAllocator(MachineFunction &mf)
       tri_(*mf.parent()->target_reg_info()),
       tii_(*mf.parent()->target_inst_info()) {}
 
+RegisterAllocator::~RegisterAllocator() = default;
+
 void RegisterAllocator::initialize_allocation()
 {
     // 清除之前的分配状态
     vreg_to_preg_map_.clear();
     vreg_to_spill_slot_.clear();
+    rematerialized_.clear();
     num_spills_ = 0;
+    num_remats_ = 0;
     num_copies_ = 0;
+    compute_loop_depths();
+
+    // 只定义一次、目标又能随处重算的 vreg，溢出时不必占栈槽
+    remat_defs_.clear();
+    std::vector<unsigned> num_defs(mf_.num_vregs());
+    for (const auto &mbb : mf_.basic_blocks())
+    {
+        for (const auto &mi : mbb->instructions())
+        {
+            for (const auto &op : mi->operands())
+            {
+                if (!op.is_reg() || !op.is_def() || !MachineFunction::is_virtual_reg(op.reg()))
+                    continue;
+                if (++num_defs[MachineFunction::vreg_index(op.reg())] == 1 && tii_.is_trivially_rematerializable(*mi))
+                    remat_defs_.set(op.reg(), mi.get());
+                else
+                    remat_defs_.erase(op.reg());
+            }
+        }
+    }
 }
 
 void RegisterAllocator::apply()
@@ -61,52 +90,63 @@ void RegisterAllocator::apply()
             MO_ASSERT(inst != nullptr, "nullptr machine instruction");
 
             // 阶段1：收集需要插入的load/store操作 tuple: (verg, tmpreg, slot)
-            std::vector<std::tuple<unsigned, unsigned, int>> loads, stores;
-            for (auto &op : inst->operands())
+            // 同一个 vreg 只按它第一次出现的操作数处理，之后的出现已被改写成物理寄存器
+            std::vector<std::tuple<unsigned, unsigned, int>> stores;
+            std::vector<std::pair<unsigned, unsigned>> loads; // (vreg, tmpreg)，从栈槽装入或重算
+            bool remat_def = false;
+            auto seen = [&](unsigned vreg)
             {
-                if (!op.is_reg())
+                auto same = [vreg](const auto &entry) { return std::get<0>(entry) == vreg; };
+                return std::any_of(loads.begin(), loads.end(), same) ||
+                       std::any_of(stores.begin(), stores.end(), same);
+            };
+            for (const auto &op : inst->operands())
+            {
+                if (!op.is_reg() || !(vreg_to_spill_slot_.contains(op.reg()) || is_rematerialized(op.reg())) ||
+                    seen(op.reg()))
                 {
                     continue;
                 }
 
-                auto vreg = op.reg();
+                // 处理需要spill的情况
+                unsigned vreg = op.reg();
+                unsigned tmp_reg = vreg_to_tmp_preg_map_.lookup(vreg);
+                MO_ASSERT(tmp_reg != MachineInst::NO_REG, "spilled vreg %u has no temporary register", vreg);
+                MO_DEBUG("spill %u using tmp reg %u", vreg, tmp_reg);
 
-                // 替换物理寄存器
-                if (auto it = vreg_to_preg_map_.find(vreg); it != vreg_to_preg_map_.end())
-                {
-                    inst->replace_reg(vreg, it->second);
-                }
-                if (auto it = vreg_to_tmp_preg_map_.find(vreg); it != vreg_to_tmp_preg_map_.end())
+                if (!op.is_def())
                 {
-                    inst->replace_reg(vreg, it->second);
+                    loads.emplace_back(vreg, tmp_reg);
                 }
-                // 处理需要spill的情况
-                auto spill_it = vreg_to_spill_slot_.find(vreg);
-                if (spill_it == vreg_to_spill_slot_.end())
+                else if (is_rematerialized(vreg))
                 {
-                    continue;
-                }
-
-                unsigned tmp_reg = vreg_to_tmp_preg_map_[vreg];
-                MO_DEBUG("spill %u to slot %d using tmp reg %u", vreg, spill_it->second, tmp_reg);
-                int spill_slot = spill_it->second;
-
-                if (op.is_def())
-                {
-                    stores.emplace_back(vreg, tmp_reg, spill_slot);
+                    remat_def = true;
                 }
                 else
                 {
-                    loads.emplace_back(vreg, tmp_reg, spill_slot);
+                    stores.emplace_back(vreg, tmp_reg, vreg_to_spill_slot_.at(vreg));
                 }
             }
 
+            // 重算的 vreg 的唯一定义：使用处各自重算，这条指令只定义它，删掉即可
+            if (remat_def)
+            {
+                const auto pos = it - mbb->begin();
+                mbb->erase(it);
+                it = mbb->begin() + pos;
+                continue;
+            }
+
+            // 替换物理寄存器：两张表不相交，各走一遍
+            inst->remap_registers(vreg_to_preg_map_.slots());
+            inst->remap_registers(vreg_to_tmp_preg_map_.slots());
+
             // 阶段2：插入load指令（在原指令前）
             if (!loads.empty())
             {
-                for (auto &[vreg, tmp_reg, slot] : loads)
+                for (auto &[vreg, tmp_reg] : loads)
                 {
-                    it = tii_.insert_load_from_stack(*mbb, it, tmp_reg, slot, 0);
+                    it = insert_reload(*mbb, it, vreg, tmp_reg);
                     ++it; // 关键点：移动到新插入的load之后
                     ++load_counter;
                 }
@@ -137,10 +177,9 @@ void RegisterAllocator::apply()
 
 std::optional<unsigned> RegisterAllocator::get_assigned_reg(unsigned vreg) const
 {
-    auto it = vreg_to_preg_map_.find(vreg);
-    if (it != vreg_to_preg_map_.end())
+    if (vreg_to_preg_map_.contains(vreg))
     {
-        return it->second;
+        return vreg_to_preg_map_.at(vreg);
     }
     return std::nullopt;
 }
@@ -155,13 +194,13 @@ bool RegisterAllocator::assign_physical_reg(unsigned vreg, unsigned preg)
     }
 
     // 不允许对vreg重新分配
-    if (vreg_to_preg_map_.find(vreg) != vreg_to_preg_map_.end())
+    if (vreg_to_preg_map_.contains(vreg))
     {
-        MO_ASSERT(false, "vreg %u already assigned to physical register %u", vreg, vreg_to_preg_map_[vreg]);
+        MO_ASSERT(false, "vreg %u already assigned to physical register %u", vreg, vreg_to_preg_map_.at(vreg));
         return false;
     }
 
-    vreg_to_preg_map_[vreg] = preg;
+    vreg_to_preg_map_.set(vreg, preg);
     return true;
 }
 
@@ -175,19 +214,16 @@ bool RegisterAllocator::assign_temp_physical_reg(unsigned vreg, unsigned preg)
     }
 
     // remove old allocation
-    if (vreg_to_preg_map_.count(vreg))
-    {
-        vreg_to_preg_map_.erase(vreg);
-    }
+    vreg_to_preg_map_.erase(vreg);
 
     // 不允许对vreg重新分配
-    if (vreg_to_tmp_preg_map_.find(vreg) != vreg_to_tmp_preg_map_.end())
+    if (vreg_to_tmp_preg_map_.contains(vreg))
     {
-        MO_ASSERT(false, "vreg %u already assigned to temporary register %u", vreg, vreg_to_tmp_preg_map_[vreg]);
+        MO_ASSERT(false, "vreg %u already assigned to temporary register %u", vreg, vreg_to_tmp_preg_map_.at(vreg));
         return false;
     }
 
-    vreg_to_tmp_preg_map_[vreg] = preg;
+    vreg_to_tmp_preg_map_.set(vreg, preg);
     return true;
 }
 
@@ -195,20 +231,14 @@ int RegisterAllocator::allocate_spill_slot(unsigned vreg)
 {
 
     // 为同一个vreg不要创建多个溢出槽
-    if (vreg_to_spill_slot_.find(vreg) != vreg_to_spill_slot_.end())
-    {
-        return vreg_to_spill_slot_[vreg];
-    }
-
-    if (vreg_to_preg_map_.find(vreg) != vreg_to_preg_map_.end()) // 如果 vreg 已经分配，则取消分配
+    if (vreg_to_spill_slot_.contains(vreg))
     {
-        vreg_to_preg_map_.erase(vreg);
+        return vreg_to_spill_slot_.at(vreg);
     }
 
-    if (vreg_to_tmp_preg_map_.find(vreg) != vreg_to_tmp_preg_map_.end()) // 如果 vreg 已经分配，则取消分配
-    {
-        vreg_to_tmp_preg_map_.erase(vreg);
-    }
+    // 如果 vreg 已经分配，则取消分配
+    vreg_to_preg_map_.erase(vreg);
+    vreg_to_tmp_preg_map_.erase(vreg);
 
     const VRegInfo &vreg_info = mf_.get_vreg_info(vreg);
 
@@ -220,56 +250,134 @@ int RegisterAllocator::allocate_spill_slot(unsigned vreg)
     spill_obj.spill_rc_id = vreg_info.register_class_id_;
 
     int slot = mf_.frame()->create_frame_object(spill_obj);
-    vreg_to_spill_slot_[vreg] = slot;
+    vreg_to_spill_slot_.set(vreg, slot);
     num_spills_++;
 
     return slot;
 }
 
-float RegisterAllocator::calculate_spill_cost(unsigned vreg, const LiveRange &live_range)
+bool RegisterAllocator::rematerialize(unsigned vreg)
 {
-    const VRegInfo &vreg_info = mf_.get_vreg_info(vreg);
-    unsigned reg_class_weight = tri_.get_reg_class_weight(vreg_info.register_class_id_);
+    const MachineInst *def = remat_defs_.lookup(vreg);
+    if (def == nullptr)
+    {
+        return false;
+    }
+
+    // 与 allocate_spill_slot 一样取消已有的分配
+    vreg_to_preg_map_.erase(vreg);
+    vreg_to_tmp_preg_map_.erase(vreg);
+    if (rematerialized_.emplace(vreg, std::make_unique<MachineInst>(*def)).second)
+    {
+        num_remats_++;
+    }
+    return true;
+}
 
-    // 计算使用计数
-    unsigned use_count = 0;
-    unsigned def_count = 0;
-    unsigned loop_depth = 1; // 默认循环深度
+MI_iterator RegisterAllocator::insert_reload(MachineBasicBlock &mbb, MI_iterator insert_point, unsigned vreg,
+                                             unsigned reg) const
+{
+    auto remat = rematerialized_.find(vreg);
+    if (remat == rematerialized_.end())
+    {
+        return tii_.insert_load_from_stack(mbb, insert_point, reg, vreg_to_spill_slot_.at(vreg), 0);
+    }
+    auto mi = std::make_unique<MachineInst>(*remat->second);
+    mi->replace_reg(vreg, reg);
+    return mbb.insert(insert_point, std::move(mi));
+}
 
-    // 遍历指令以查找此vreg的使用
-    for (auto &mbb : mf_.basic_blocks())
+void RegisterAllocator::compute_loop_depths()
+{
+    loop_depths_.clear();
+    const auto &blocks = mf_.basic_blocks();
+    if (blocks.empty())
+        return;
+
+    // 深度优先遍历找回边：指向仍在栈上的祖先的边
+    std::unordered_map<const MachineBasicBlock *, bool> on_stack;
+    std::vector<std::pair<MachineBasicBlock *, MachineBasicBlock *>> back_edges; // (尾, 循环头)
+    std::vector<std::pair<MachineBasicBlock *, std::vector<MachineBasicBlock *>>> stack;
+    auto visit = [&](MachineBasicBlock *bb)
+    {
+        on_stack[bb] = true;
+        stack.emplace_back(bb, std::vector<MachineBasicBlock *>(bb->successors().begin(), bb->successors().end()));
+    };
+    visit(blocks.front().get());
+    while (!stack.empty())
     {
-        for (auto &inst : mbb->instructions())
+        auto &[bb, pending] = stack.back();
+        if (pending.empty())
         {
-            unsigned pos = mf_.get_global_instr_pos(inst.get());
+            on_stack[bb] = false;
+            stack.pop_back();
+            continue;
+        }
+        MachineBasicBlock *succ = pending.back();
+        pending.pop_back();
+        auto it = on_stack.find(succ);
+        if (it == on_stack.end())
+            visit(succ);
+        else if (it->second)
+            back_edges.emplace_back(bb, succ);
+    }
 
-            // 如果寄存器在此位置不活跃，则跳过
-            if (!live_range.live_at(pos))
-            {
+    // 同一循环头的回边合成一个自然循环：从尾沿前驱回溯到头
+    std::unordered_map<MachineBasicBlock *, std::unordered_set<const MachineBasicBlock *>> loops;
+    for (auto [tail, header] : back_edges)
+    {
+        auto &body = loops[header];
+        body.insert(header);
+        std::vector<MachineBasicBlock *> worklist{tail};
+        while (!worklist.empty())
+        {
+            MachineBasicBlock *bb = worklist.back();
+            worklist.pop_back();
+            if (!body.insert(bb).second)
                 continue;
-            }
-
-            // 计算使用和定义
-            for (const auto &op : inst->operands())
-            {
-                if (op.is_reg() && op.reg() == vreg)
-                {
-                    if (op.is_def())
-                    {
-                        def_count++;
-                    }
-                    else
-                    {
-                        use_count++;
-                    }
-                }
-            }
+            worklist.insert(worklist.end(), bb->predecessors().begin(), bb->predecessors().end());
         }
     }
+    for (const auto &[header, body] : loops)
+    {
+        for (const MachineBasicBlock *bb : body)
+            ++loop_depths_[bb];
+    }
+}
+
+unsigned RegisterAllocator::loop_depth(const MachineBasicBlock *bb) const
+{
+    auto it = loop_depths_.find(bb);
+    return it != loop_depths_.end() ? it->second : 0;
+}
+
+float RegisterAllocator::block_weight(const MachineBasicBlock *bb) const
+{
+    const MachineBasicBlock *entry = mf_.basic_blocks().front().get();
+    if (bb->has_profile_count() && entry->has_profile_count() && entry->profile_count() > 0)
+        return std::max(static_cast<float>(bb->profile_count()) / static_cast<float>(entry->profile_count()),
+                        MIN_PROFILE_WEIGHT);
+    return std::pow(10.0f, loop_depth(bb));
+}
+
+float RegisterAllocator::calculate_spill_cost(unsigned vreg, const LiveRange &live_range)
+{
+    const VRegInfo &vreg_info = mf_.get_vreg_info(vreg);
+    unsigned reg_class_weight = tri_.get_reg_class_weight(vreg_info.register_class_id_);
 
     // 计算溢出代价:
-    // - 更多使用/定义意味着溢出代价更高
+    // - 更多使用/定义意味着溢出代价更高，定义按两次计
+    // - 按所在块的执行次数加权：有剖析数据时用实测次数，否则每层循环放大十倍
     // - 寄存器类权重因素
-    float spill_cost = (use_count + def_count * 2.0f) * reg_class_weight * loop_depth;
-    return spill_cost;
+    // - 能重算的减半：不必写回，使用处重算一条指令而不是访存
+    float spill_cost = 0.0f;
+    for (const auto &occurrence : live_range.occurrences())
+    {
+        spill_cost += (occurrence.is_def ? 2.0f : 1.0f) * block_weight(occurrence.inst->parent());
+    }
+    if (remat_defs_.contains(vreg))
+    {
+        spill_cost *= 0.5f;
+    }
+    return spill_cost * reg_class_weight;
 }
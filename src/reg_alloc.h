@@ -1,12 +1,16 @@
 // reg_alloc.h - Register Allocation Interface
 #pragma once
 
+#include <climits>
 #include <map>
 #include <set>
 #include <vector>
 #include <memory>
 #include <string>
 #include <optional>
+#include <unordered_map>
+
+#include "vreg_table.h"
 
 // Forward declarations
 class MachineFunction;
@@ -20,10 +24,19 @@ class PressureTracker;
 class MachineModule;
 using MI_iterator = std::vector<std::unique_ptr<MachineInst>>::iterator;
 
+// Physical register per vreg; the empty value is MachineInst::NO_REG, so the
+// slots can go straight to MachineInst::remap_registers
+using VRegToPregTable = VRegTable<unsigned, ~0u>;
+// Spill slot (frame index) per vreg
+using VRegToSlotTable = VRegTable<int, INT_MIN>;
+// An instruction per vreg, such as its only definition
+using VRegToInstTable = VRegTable<const MachineInst *, nullptr>;
+
 // Register allocation result statistics
 struct RegAllocResult
 {
     unsigned num_spills = 0;     // Number of spilled registers
+    unsigned num_remats = 0;     // Spilled registers recomputed at their uses instead of given a slot
     unsigned num_copies = 0;     // Number of register copies inserted
     unsigned max_stack_size = 0; // Maximum stack size used
     bool successful = false;     // Whether allocation succeeded
@@ -43,25 +56,53 @@ protected:
     const TargetInstInfo &tii_;
 
     // Track physical register assignments
-    std::map<unsigned, unsigned> vreg_to_preg_map_;
-    std::map<unsigned, unsigned> vreg_to_tmp_preg_map_; // used for spilling
+    VRegToPregTable vreg_to_preg_map_;
+    VRegToPregTable vreg_to_tmp_preg_map_; // used for spilling
 
     // Track spill slots
-    std::map<unsigned, int> vreg_to_spill_slot_;
+    VRegToSlotTable vreg_to_spill_slot_;
+
+    // The only definition of each vreg the target can recompute anywhere,
+    // see TargetInstInfo::is_trivially_rematerializable
+    VRegToInstTable remat_defs_;
+    // Spilled vregs recomputed at their uses, each with a copy of its
+    // definition, which rewriting may erase
+    std::unordered_map<unsigned, std::unique_ptr<MachineInst>> rematerialized_;
 
     // Allocation statistics
     unsigned num_spills_ = 0;
+    unsigned num_remats_ = 0;
     unsigned num_copies_ = 0;
 
+    // Natural loop nesting depth of each block, 0 outside loops
+    std::unordered_map<const MachineBasicBlock *, unsigned> loop_depths_;
+
     // Utility methods for derived allocators
     virtual void initialize_allocation();
     virtual bool assign_physical_reg(unsigned vreg, unsigned preg);
     virtual bool assign_temp_physical_reg(unsigned vreg, unsigned preg);
     virtual int allocate_spill_slot(unsigned vreg);
+    // Spills `vreg` without a slot, if remat_defs_ has its definition; its
+    // uses then get the definition again instead of a reload and its
+    // definition needs no store
+    bool rematerialize(unsigned vreg);
+    // Gets spilled `vreg` into `reg` right before `insert_point`, by a copy
+    // of its definition if rematerialized and from its slot otherwise.
+    // Returns the inserted instruction
+    MI_iterator insert_reload(MachineBasicBlock &mbb, MI_iterator insert_point, unsigned vreg, unsigned reg) const;
+    // Finds the natural loops of the machine CFG; initialize_allocation
+    // runs it, so the CFG must have been built before
+    void compute_loop_depths();
+    unsigned loop_depth(const MachineBasicBlock *bb) const;
+    // Profiled runs of `bb` per call of the function when the profile
+    // counted both it and the entry, at least MIN_PROFILE_WEIGHT so code
+    // that never ran still orders by its uses; 10^(loop depth) otherwise
+    static constexpr float MIN_PROFILE_WEIGHT = 1e-3f;
+    float block_weight(const MachineBasicBlock *bb) const;
 
 public:
     RegisterAllocator(MachineFunction &mf);
-    virtual ~RegisterAllocator() = default;
+    virtual ~RegisterAllocator(); // where MachineInst is complete, for rematerialized_
 
     // Main allocation method to be implemented by derived classes
     virtual RegAllocResult allocate_registers() = 0;
@@ -74,16 +115,20 @@ public:
     std::optional<unsigned> get_assigned_reg(unsigned vreg) const;
     bool is_spilled(unsigned vreg) const;
     int get_spill_slot(unsigned vreg) const;
+    bool is_rematerialized(unsigned vreg) const { return rematerialized_.count(vreg); }
 
-    std::map<unsigned, unsigned> get_vreg_to_preg_map() const { return vreg_to_preg_map_; }
-    std::map<unsigned, unsigned> get_vreg_to_tmp_preg_map() const { return vreg_to_tmp_preg_map_; }
-    std::map<unsigned, int> get_vreg_to_spill_slot() const { return vreg_to_spill_slot_; }
+    const VRegToPregTable &get_vreg_to_preg_map() const { return vreg_to_preg_map_; }
+    const VRegToPregTable &get_vreg_to_tmp_preg_map() const { return vreg_to_tmp_preg_map_; }
+    const VRegToSlotTable &get_vreg_to_spill_slot() const { return vreg_to_spill_slot_; }
     unsigned get_num_spills() const { return num_spills_; }
+    unsigned get_num_remats() const { return num_remats_; }
     unsigned get_num_copies() const { return num_copies_; }
 
     // Final cleanup and remapping of instructions
     // virtual void finalize_allocation();
 
-    // Calculate spill cost for a virtual register
+    // Calculate spill cost for a virtual register: its uses and defs, each
+    // weighted by the block_weight of its block, halved when it could be
+    // rematerialized, since that costs no memory traffic
     virtual float calculate_spill_cost(unsigned vreg, const LiveRange &live_range);
 };
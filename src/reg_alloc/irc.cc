@@ -0,0 +1,626 @@
+#include "irc.h"
+#include "../machine.h"
+#include "../phase_stats.h"
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+    // 预着色结点的度数视为无穷大
+    constexpr unsigned INFINITE_DEGREE = std::numeric_limits<unsigned>::max() / 2;
+    constexpr unsigned NO_NODE = std::numeric_limits<unsigned>::max();
+
+    uint64_t edge_key(unsigned u, unsigned v)
+    {
+        if (u > v)
+            std::swap(u, v);
+        return (uint64_t(u) << 32) | v;
+    }
+
+    // 两个区间集合在 [lo, hi) 之外是否还有重叠；复制指令处源和目的的重叠不算冲突
+    bool overlaps_outside(const LiveRange &a, const LiveRange &b, unsigned lo, unsigned hi)
+    {
+        auto ia = a.intervals().begin(), ib = b.intervals().begin();
+        while (ia != a.intervals().end() && ib != b.intervals().end())
+        {
+            const unsigned start = std::max(ia->start(), ib->start());
+            const unsigned end = std::min(ia->end(), ib->end());
+            if (start < end && (start < lo || end > hi))
+                return true;
+            if (ia->end() < ib->end())
+                ++ia;
+            else
+                ++ib;
+        }
+        return false;
+    }
+} // namespace
+
+RegAllocResult IteratedCoalescingRegisterAllocator::allocate_registers()
+{
+    PhaseTimer timer("regalloc");
+    MO_DEBUG("Starting iterated register coalescing.");
+    initialize_allocation();
+    spill_temps_.clear();
+    RegAllocResult result;
+
+    unsigned rounds = 0;
+    while (true)
+    {
+        ++rounds;
+        colored_.clear();
+        num_coalesced_ = 0;
+        InterferenceGraph graph = lra_.build_interference();
+
+        std::vector<unsigned> spilled;
+        for (RegisterClass *rc : tri_.get_reg_classes())
+        {
+            auto class_spilled = color_class(*rc, graph);
+            spilled.insert(spilled.end(), class_spilled.begin(), class_spilled.end());
+        }
+        if (spilled.empty())
+            break;
+
+        for (unsigned vreg : spilled)
+        {
+            if (spill_temps_.count(vreg))
+            {
+                MO_DEBUG("Spill temporary %u did not get a register", vreg);
+                result.successful = false;
+                result.error_message = "No register left for spill temporaries";
+                return result;
+            }
+        }
+        MO_DEBUG("Round %u spills %zu registers", rounds, spilled.size());
+        rewrite_program(spilled);
+    }
+
+    for (auto [vreg, preg] : colored_)
+    {
+        assign_physical_reg(vreg, preg);
+    }
+
+    // 两端寄存器不同的复制指令保留下来
+    auto final_reg = [&](unsigned reg)
+    {
+        auto it = colored_.find(reg);
+        return it != colored_.end() ? it->second : reg;
+    };
+    for (const auto &mbb : mf_.basic_blocks())
+    {
+        for (const auto &mi : mbb->instructions())
+        {
+            unsigned dst, src;
+            if (tii_.is_copy(*mi, dst, src) && final_reg(dst) != final_reg(src))
+                ++num_copies_;
+        }
+    }
+
+    timer.count("rounds", rounds);
+    timer.count("coalesced", num_coalesced_);
+    MO_DEBUG("Register allocation completed successfully.");
+    result.num_spills = num_spills_;
+    result.num_remats = num_remats_;
+    result.num_copies = num_copies_;
+    result.successful = true;
+    return result;
+}
+
+void IteratedCoalescingRegisterAllocator::apply()
+{
+    RegisterAllocator::apply();
+
+    for (auto &mbb : mf_.basic_blocks())
+    {
+        for (auto it = mbb->begin(); it != mbb->end();)
+        {
+            unsigned dst, src;
+            if (tii_.is_copy(**it, dst, src) && dst == src)
+            {
+                const auto index = it - mbb->begin();
+                mbb->erase(it);
+                it = mbb->begin() + index;
+                continue;
+            }
+            ++it;
+        }
+    }
+}
+
+std::vector<unsigned> IteratedCoalescingRegisterAllocator::color_class(const RegisterClass &rc, const InterferenceGraph &graph)
+{
+    build(rc, graph);
+    if (nodes_.empty())
+        return {};
+
+    make_worklist();
+    auto pending = [this](std::vector<unsigned> &worklist, NodeState state)
+    {
+        // 工作表惰性删除：状态已变的结点留在表里，取用时跳过
+        while (!worklist.empty() && nodes_[worklist.back()].state != state)
+            worklist.pop_back();
+        return !worklist.empty();
+    };
+    while (true)
+    {
+        if (pending(simplify_worklist_, NodeState::Simplify))
+            simplify();
+        else if (!move_worklist_.empty())
+            coalesce();
+        else if (pending(freeze_worklist_, NodeState::Freeze))
+            freeze();
+        else if (std::any_of(spill_worklist_.begin(), spill_worklist_.end(),
+                             [&](unsigned n) { return nodes_[n].state == NodeState::Spill; }))
+            select_spill();
+        else
+            break;
+    }
+    return assign_colors();
+}
+
+void IteratedCoalescingRegisterAllocator::build(const RegisterClass &rc, const InterferenceGraph &graph)
+{
+    colors_ = tri_.get_allocation_order(rc.id);
+    k_ = colors_.size();
+    nodes_.clear();
+    moves_.clear();
+    adj_set_.clear();
+    simplify_worklist_.clear();
+    freeze_worklist_.clear();
+    spill_worklist_.clear();
+    move_worklist_.clear();
+    select_stack_.clear();
+
+    // 本类的结点：该类的虚拟寄存器，以及可作为颜色的物理寄存器（预着色）
+    const std::unordered_set<unsigned> color_set(colors_.begin(), colors_.end());
+    const auto &ranges = lra_.get_all_live_ranges();
+    std::vector<unsigned> local(graph.num_nodes(), NO_NODE);
+    std::unordered_map<unsigned, unsigned> local_of_reg;
+    for (unsigned g = 0; g < graph.num_nodes(); ++g)
+    {
+        const unsigned reg = graph.reg(g);
+        Node node{.reg = reg};
+        if (MachineFunction::is_virtual_reg(reg))
+        {
+            if (mf_.get_vreg_info(reg).register_class_id_ != rc.id)
+                continue;
+            if (spill_temps_.count(reg))
+            {
+                node.spill_cost = std::numeric_limits<float>::infinity();
+            }
+            else
+            {
+                node.spill_cost = calculate_spill_cost(reg, *ranges.at(reg));
+            }
+        }
+        else if (color_set.count(reg))
+        {
+            node.state = NodeState::Precolored;
+            node.color = reg;
+            node.degree = INFINITE_DEGREE;
+        }
+        else
+        {
+            continue;
+        }
+        local[g] = nodes_.size();
+        local_of_reg[reg] = nodes_.size();
+        nodes_.push_back(std::move(node));
+    }
+
+    // 复制指令；源和目的仅在复制处重叠时不算冲突
+    std::unordered_set<uint64_t> move_only;
+    for (const auto &mbb : mf_.basic_blocks())
+    {
+        for (const auto &mi : mbb->instructions())
+        {
+            unsigned dst, src;
+            if (!tii_.is_copy(*mi, dst, src) || dst == src)
+                continue;
+            // 只写不读的物理寄存器（如返回值）没有活跃区间，复制时补一个预着色结点
+            for (unsigned reg : {dst, src})
+            {
+                if (!local_of_reg.count(reg) && color_set.count(reg))
+                {
+                    local_of_reg[reg] = nodes_.size();
+                    nodes_.push_back({.reg = reg, .state = NodeState::Precolored, .degree = INFINITE_DEGREE, .color = reg});
+                }
+            }
+            auto dst_it = local_of_reg.find(dst), src_it = local_of_reg.find(src);
+            if (dst_it == local_of_reg.end() || src_it == local_of_reg.end())
+                continue;
+            const unsigned d = dst_it->second, s = src_it->second;
+            if (is_precolored(d) && is_precolored(s))
+                continue;
+
+            const unsigned lo = mf_.get_global_instr_pos(mi.get());
+            const unsigned hi = mf_.slot_indexes().next_index(mi.get());
+            auto dst_range = ranges.find(dst), src_range = ranges.find(src);
+            if (dst_range == ranges.end() || src_range == ranges.end() ||
+                !overlaps_outside(*dst_range->second, *src_range->second, lo, hi))
+                move_only.insert(edge_key(d, s));
+
+            const unsigned m = moves_.size();
+            moves_.push_back({.dst = d, .src = s});
+            nodes_[d].moves.push_back(m);
+            nodes_[s].moves.push_back(m);
+            move_worklist_.push_back(m);
+        }
+    }
+
+    for (unsigned g = 0; g < graph.num_nodes(); ++g)
+    {
+        if (local[g] == NO_NODE)
+            continue;
+        for (unsigned h : graph.neighbors(g))
+        {
+            if (h < g || local[h] == NO_NODE)
+                continue;
+            const unsigned u = local[g], v = local[h];
+            if ((is_precolored(u) && is_precolored(v)) || move_only.count(edge_key(u, v)))
+                continue;
+            add_edge(u, v);
+        }
+    }
+    MO_DEBUG("Class %s: %zu nodes, %zu moves, %u colors", rc.name.c_str(), nodes_.size(), moves_.size(), k_);
+}
+
+void IteratedCoalescingRegisterAllocator::add_edge(unsigned u, unsigned v)
+{
+    if (u == v || !adj_set_.insert(edge_key(u, v)).second)
+        return;
+    if (!is_precolored(u))
+    {
+        nodes_[u].adj.push_back(v);
+        ++nodes_[u].degree;
+    }
+    if (!is_precolored(v))
+    {
+        nodes_[v].adj.push_back(u);
+        ++nodes_[v].degree;
+    }
+}
+
+bool IteratedCoalescingRegisterAllocator::adjacent(unsigned u, unsigned v) const
+{
+    return adj_set_.count(edge_key(u, v));
+}
+
+template <typename Fn>
+void IteratedCoalescingRegisterAllocator::for_each_adjacent(unsigned n, Fn &&fn) const
+{
+    for (unsigned m : nodes_[n].adj)
+    {
+        if (!is_removed(m))
+            fn(m);
+    }
+}
+
+template <typename Fn>
+void IteratedCoalescingRegisterAllocator::for_each_node_move(unsigned n, Fn &&fn) const
+{
+    for (unsigned m : nodes_[n].moves)
+    {
+        if (moves_[m].state == MoveState::Active || moves_[m].state == MoveState::Worklist)
+            fn(m);
+    }
+}
+
+bool IteratedCoalescingRegisterAllocator::move_related(unsigned n) const
+{
+    bool related = false;
+    for_each_node_move(n, [&](unsigned) { related = true; });
+    return related;
+}
+
+void IteratedCoalescingRegisterAllocator::push_worklist(unsigned n, NodeState state)
+{
+    nodes_[n].state = state;
+    switch (state)
+    {
+    case NodeState::Simplify:
+        simplify_worklist_.push_back(n);
+        break;
+    case NodeState::Freeze:
+        freeze_worklist_.push_back(n);
+        break;
+    case NodeState::Spill:
+        spill_worklist_.push_back(n);
+        break;
+    default:
+        MO_ASSERT(false, "Not a worklist state");
+    }
+}
+
+void IteratedCoalescingRegisterAllocator::make_worklist()
+{
+    for (unsigned n = 0; n < nodes_.size(); ++n)
+    {
+        if (nodes_[n].state != NodeState::Initial)
+            continue;
+        if (nodes_[n].degree >= k_)
+            push_worklist(n, NodeState::Spill);
+        else if (move_related(n))
+            push_worklist(n, NodeState::Freeze);
+        else
+            push_worklist(n, NodeState::Simplify);
+    }
+}
+
+void IteratedCoalescingRegisterAllocator::enable_moves(unsigned n)
+{
+    for_each_node_move(n, [&](unsigned m)
+                       {
+        if (moves_[m].state == MoveState::Active)
+        {
+            moves_[m].state = MoveState::Worklist;
+            move_worklist_.push_back(m);
+        } });
+}
+
+void IteratedCoalescingRegisterAllocator::decrement_degree(unsigned n)
+{
+    if (is_precolored(n))
+        return;
+    if (nodes_[n].degree-- != k_)
+        return;
+
+    // 度数降到 k 以下：它和邻居的复制又有机会合并
+    enable_moves(n);
+    for_each_adjacent(n, [&](unsigned m) { enable_moves(m); });
+    if (nodes_[n].state != NodeState::Spill)
+        return;
+    push_worklist(n, move_related(n) ? NodeState::Freeze : NodeState::Simplify);
+}
+
+void IteratedCoalescingRegisterAllocator::simplify()
+{
+    const unsigned n = simplify_worklist_.back();
+    simplify_worklist_.pop_back();
+    nodes_[n].state = NodeState::OnStack;
+    select_stack_.push_back(n);
+    for_each_adjacent(n, [&](unsigned m) { decrement_degree(m); });
+}
+
+void IteratedCoalescingRegisterAllocator::add_worklist(unsigned n)
+{
+    if (!is_precolored(n) && !move_related(n) && nodes_[n].degree < k_ && nodes_[n].state == NodeState::Freeze)
+        push_worklist(n, NodeState::Simplify);
+}
+
+bool IteratedCoalescingRegisterAllocator::george_ok(unsigned t, unsigned r) const
+{
+    return nodes_[t].degree < k_ || is_precolored(t) || adjacent(t, r);
+}
+
+bool IteratedCoalescingRegisterAllocator::briggs_ok(unsigned u, unsigned v) const
+{
+    std::vector<unsigned> neighbors;
+    for_each_adjacent(u, [&](unsigned t) { neighbors.push_back(t); });
+    for_each_adjacent(v, [&](unsigned t) { neighbors.push_back(t); });
+    std::sort(neighbors.begin(), neighbors.end());
+    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+
+    unsigned significant = 0;
+    for (unsigned t : neighbors)
+    {
+        if (nodes_[t].degree >= k_)
+            ++significant;
+    }
+    return significant < k_;
+}
+
+unsigned IteratedCoalescingRegisterAllocator::get_alias(unsigned n) const
+{
+    while (nodes_[n].state == NodeState::Coalesced)
+        n = nodes_[n].alias;
+    return n;
+}
+
+void IteratedCoalescingRegisterAllocator::coalesce()
+{
+    const unsigned m = move_worklist_.back();
+    move_worklist_.pop_back();
+    if (moves_[m].state != MoveState::Worklist)
+        return;
+
+    unsigned u = get_alias(moves_[m].dst), v = get_alias(moves_[m].src);
+    if (is_precolored(v))
+        std::swap(u, v);
+
+    if (u == v)
+    {
+        moves_[m].state = MoveState::Coalesced;
+        ++num_coalesced_;
+        add_worklist(u);
+        return;
+    }
+    if (is_precolored(v) || adjacent(u, v))
+    {
+        moves_[m].state = MoveState::Constrained;
+        add_worklist(u);
+        add_worklist(v);
+        return;
+    }
+
+    bool ok;
+    if (is_precolored(u))
+    {
+        ok = true;
+        for_each_adjacent(v, [&](unsigned t) { ok = ok && george_ok(t, u); });
+    }
+    else
+    {
+        ok = briggs_ok(u, v);
+    }
+    if (!ok)
+    {
+        moves_[m].state = MoveState::Active;
+        return;
+    }
+
+    moves_[m].state = MoveState::Coalesced;
+    ++num_coalesced_;
+    combine(u, v);
+    add_worklist(u);
+}
+
+void IteratedCoalescingRegisterAllocator::combine(unsigned u, unsigned v)
+{
+    MO_DEBUG("Coalescing %u into %u", nodes_[v].reg, nodes_[u].reg);
+    nodes_[v].state = NodeState::Coalesced;
+    nodes_[v].alias = u;
+    nodes_[u].moves.insert(nodes_[u].moves.end(), nodes_[v].moves.begin(), nodes_[v].moves.end());
+    enable_moves(v);
+
+    // 先复制邻接表：add_edge 可能往 v 的邻居表里追加
+    const std::vector<unsigned> neighbors = nodes_[v].adj;
+    for (unsigned t : neighbors)
+    {
+        if (is_removed(t))
+            continue;
+        add_edge(t, u);
+        decrement_degree(t);
+    }
+    if (nodes_[u].degree >= k_ && nodes_[u].state == NodeState::Freeze)
+        push_worklist(u, NodeState::Spill);
+}
+
+void IteratedCoalescingRegisterAllocator::freeze_moves(unsigned u)
+{
+    for_each_node_move(u, [&](unsigned m)
+                       {
+        const unsigned x = get_alias(moves_[m].dst), y = get_alias(moves_[m].src);
+        const unsigned v = y == get_alias(u) ? x : y;
+        moves_[m].state = MoveState::Frozen;
+        if (!move_related(v) && nodes_[v].degree < k_ && nodes_[v].state == NodeState::Freeze)
+            push_worklist(v, NodeState::Simplify); });
+}
+
+void IteratedCoalescingRegisterAllocator::freeze()
+{
+    const unsigned u = freeze_worklist_.back();
+    freeze_worklist_.pop_back();
+    push_worklist(u, NodeState::Simplify);
+    freeze_moves(u);
+}
+
+void IteratedCoalescingRegisterAllocator::select_spill()
+{
+    // 代价与度数之比最小的结点最先溢出
+    unsigned best = NO_NODE;
+    float best_ratio = std::numeric_limits<float>::infinity();
+    std::erase_if(spill_worklist_, [&](unsigned n) { return nodes_[n].state != NodeState::Spill; });
+    for (unsigned n : spill_worklist_)
+    {
+        const float ratio = nodes_[n].spill_cost / nodes_[n].degree;
+        if (best == NO_NODE || ratio < best_ratio)
+        {
+            best = n;
+            best_ratio = ratio;
+        }
+    }
+    MO_DEBUG("Potential spill: %u", nodes_[best].reg);
+    push_worklist(best, NodeState::Simplify);
+    freeze_moves(best);
+}
+
+std::vector<unsigned> IteratedCoalescingRegisterAllocator::assign_colors()
+{
+    std::vector<unsigned> spilled;
+    while (!select_stack_.empty())
+    {
+        const unsigned n = select_stack_.back();
+        select_stack_.pop_back();
+
+        std::vector<bool> ok(k_, true);
+        for (unsigned w : nodes_[n].adj)
+        {
+            const Node &a = nodes_[get_alias(w)];
+            if (a.state != NodeState::Colored && a.state != NodeState::Precolored)
+                continue;
+            auto it = std::find(colors_.begin(), colors_.end(), a.color);
+            if (it != colors_.end())
+                ok[it - colors_.begin()] = false;
+        }
+
+        auto free = std::find(ok.begin(), ok.end(), true);
+        if (free == ok.end())
+        {
+            nodes_[n].state = NodeState::Spilled;
+            spilled.push_back(nodes_[n].reg);
+            continue;
+        }
+        nodes_[n].state = NodeState::Colored;
+        nodes_[n].color = colors_[free - ok.begin()];
+    }
+
+    for (auto &node : nodes_)
+    {
+        if (node.state == NodeState::Colored)
+        {
+            colored_[node.reg] = node.color;
+        }
+        else if (node.state == NodeState::Coalesced)
+        {
+            // 合并进去的结点跟随代表结点：着色或一起溢出
+            const Node &alias = nodes_[get_alias(&node - nodes_.data())];
+            if (alias.state == NodeState::Spilled)
+                spilled.push_back(node.reg);
+            else
+                colored_[node.reg] = alias.color;
+        }
+    }
+    return spilled;
+}
+
+void IteratedCoalescingRegisterAllocator::rewrite_program(const std::vector<unsigned> &spilled)
+{
+    // 先收集全部引用点，改写期间不再查询活跃区间
+    std::vector<std::pair<unsigned, std::vector<MachineInst *>>> refs;
+    for (unsigned vreg : spilled)
+    {
+        std::vector<MachineInst *> insts;
+        for (const auto &occurrence : lra_.get_live_range(vreg)->occurrences())
+        {
+            if (insts.empty() || insts.back() != occurrence.inst)
+                insts.push_back(occurrence.inst);
+        }
+        refs.emplace_back(vreg, std::move(insts));
+    }
+
+    for (auto &[vreg, insts] : refs)
+    {
+        // 能重算的不占栈槽：每个使用点前重算一遍，原来的定义删掉
+        const bool remat = rematerialize(vreg);
+        const int slot = remat ? 0 : allocate_spill_slot(vreg);
+        PhaseStats::global().add_count("regalloc", remat ? "remats" : "spills", 1);
+        for (MachineInst *mi : insts)
+        {
+            const bool is_use = mi->uses().count(vreg);
+            const bool is_def = mi->defs().count(vreg);
+            if (remat && is_def)
+            {
+                remat_defs_.erase(vreg);
+                mi->erase_from_parent();
+                continue;
+            }
+            // 每个引用点一个新的短寄存器，区间只覆盖这条指令
+            const unsigned tmp = mf_.clone_vreg(vreg);
+            spill_temps_.insert(tmp);
+            mi->replace_reg(vreg, tmp);
+
+            MachineBasicBlock *mbb = mi->parent();
+            auto it = mbb->locate(mi);
+            if (is_use)
+            {
+                it = insert_reload(*mbb, it, vreg, tmp);
+                ++it;
+            }
+            if (is_def)
+            {
+                tii_.insert_store_to_stack(*mbb, std::next(it), tmp, slot, 0);
+            }
+        }
+    }
+}
@@ -0,0 +1,120 @@
+// irc.h - Iterated Register Coalescing (graph coloring) allocator
+#pragma once
+
+#include "../reg_alloc.h"
+#include "../lra.h"
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct RegisterClass;
+
+// George and Appel's iterated register coalescing, run separately for each
+// register class over the analyzer's interference graph. Copies are
+// coalesced while a node stays colorable (Briggs for two virtual registers,
+// George against a physical one); nodes that do not get a color are
+// spilled by rewriting their uses and defs through short-lived temporaries,
+// and the whole process repeats on the new code.
+class IteratedCoalescingRegisterAllocator : public RegisterAllocator
+{
+private:
+    enum class NodeState : uint8_t
+    {
+        Initial,
+        Precolored,
+        Simplify,
+        Freeze,
+        Spill,
+        OnStack,
+        Coalesced,
+        Colored,
+        Spilled,
+    };
+
+    enum class MoveState : uint8_t
+    {
+        Worklist,
+        Active,
+        Coalesced,
+        Constrained,
+        Frozen,
+    };
+
+    struct Node
+    {
+        unsigned reg;
+        NodeState state = NodeState::Initial;
+        unsigned degree = 0;
+        unsigned alias = 0;      // 被合并进的结点
+        unsigned color = 0;      // 分配到的物理寄存器
+        float spill_cost = 0.0f; // 溢出代价，越大越不该溢出
+        std::vector<unsigned> adj = {};
+        std::vector<unsigned> moves = {};
+    };
+
+    struct Move
+    {
+        unsigned dst;
+        unsigned src;
+        MoveState state = MoveState::Worklist;
+    };
+
+    // 当前寄存器类的工作状态，每轮重建
+    std::vector<unsigned> colors_;
+    unsigned k_ = 0;
+    std::vector<Node> nodes_;
+    std::vector<Move> moves_;
+    std::unordered_set<uint64_t> adj_set_;
+    std::vector<unsigned> simplify_worklist_;
+    std::vector<unsigned> freeze_worklist_;
+    std::vector<unsigned> spill_worklist_;
+    std::vector<unsigned> move_worklist_;
+    std::vector<unsigned> select_stack_;
+
+    // 溢出改写产生的临时寄存器，不再参与溢出
+    std::unordered_set<unsigned> spill_temps_;
+    std::unordered_map<unsigned, unsigned> colored_;
+    unsigned num_coalesced_ = 0;
+
+public:
+    explicit IteratedCoalescingRegisterAllocator(MachineFunction &mf) : RegisterAllocator(mf) {}
+
+    RegAllocResult allocate_registers() override;
+    // Rewrites registers, then drops the copies whose ends got one register
+    void apply() override;
+
+private:
+    // One class: returns the virtual registers that must be spilled
+    std::vector<unsigned> color_class(const RegisterClass &rc, const InterferenceGraph &graph);
+    void build(const RegisterClass &rc, const InterferenceGraph &graph);
+    void make_worklist();
+    void simplify();
+    void coalesce();
+    void freeze();
+    void select_spill();
+    std::vector<unsigned> assign_colors();
+    void rewrite_program(const std::vector<unsigned> &spilled);
+
+    void add_edge(unsigned u, unsigned v);
+    bool adjacent(unsigned u, unsigned v) const;
+    bool is_precolored(unsigned n) const { return nodes_[n].state == NodeState::Precolored; }
+    bool is_removed(unsigned n) const
+    {
+        return nodes_[n].state == NodeState::OnStack || nodes_[n].state == NodeState::Coalesced;
+    }
+    template <typename Fn>
+    void for_each_adjacent(unsigned n, Fn &&fn) const;
+    bool move_related(unsigned n) const;
+    template <typename Fn>
+    void for_each_node_move(unsigned n, Fn &&fn) const;
+    void enable_moves(unsigned n);
+    void decrement_degree(unsigned n);
+    void add_worklist(unsigned n);
+    bool george_ok(unsigned t, unsigned r) const;
+    bool briggs_ok(unsigned u, unsigned v) const;
+    unsigned get_alias(unsigned n) const;
+    void combine(unsigned u, unsigned v);
+    void freeze_moves(unsigned u);
+    void push_worklist(unsigned n, NodeState state);
+};
@@ -1,37 +1,89 @@
 #include "lsra.h"
 #include "../lra.h"
 #include "../machine.h"
+#include "../phase_stats.h"
+#include "../slot_indexes.h"
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <set>
+#include <tuple>
+#include <unordered_set>
+
+// 在 pos 处引用 lr 的指令
+static MachineInst *referenced_at(const LiveRange &lr, unsigned pos)
+{
+    const auto &occurrences = lr.occurrences();
+    auto it = std::lower_bound(occurrences.begin(), occurrences.end(), pos,
+                               [](const LiveOccurrence &occurrence, unsigned p)
+                               { return occurrence.pos < p; });
+    return it != occurrences.end() && it->pos == pos ? it->inst : nullptr;
+}
+
+// 第一个位于 pos 之后（或就在 pos，当 inclusive 时）的引用
+static const LiveOccurrence *next_occurrence(const LiveRange &lr, unsigned pos, bool inclusive)
+{
+    for (const auto &occurrence : lr.occurrences())
+    {
+        if (occurrence.pos > pos || (inclusive && occurrence.pos == pos))
+            return &occurrence;
+    }
+    return nullptr;
+}
 
 void LinearScanRegisterAllocator::initialize()
 {
     MO_DEBUG("Collecting initial intervals for all virtual registers.");
+    initialize_allocation();
+    lra_.compute();
 
     // 收集所有虚拟寄存器的活跃区间
     for (auto &[reg, lr] : lra_.get_all_live_ranges())
     {
         if (MachineFunction::is_virtual_reg(reg))
         {
-            for (auto &range : lr->atomized_ranges(mf_))
+            for (auto &range : lr->atomized_ranges())
             {
                 auto range_ptr = range.get();
+                spill_costs_[range_ptr] = calculate_spill_cost(reg, *range_ptr);
+                pieces_[reg].push_back(range_ptr);
                 ranges_.push_back(std::move(range));
                 unhandled_.push(range_ptr);
             }
         }
     }
 
-    auto pregs = this->collect_allocatable_regs();
-    MO_DEBUG("Initial available physical registers: %s", mo_join(pregs, ", ").c_str());
-    for (unsigned preg : pregs)
+    // 分配顺序和别名掩码由目标预先算好，这里只建空闲位图
+    class_states_.assign(tri_.get_reg_classes().size(), {});
+    reg_owners_.assign(tri_.get_num_regs(), nullptr);
+    unions_.assign(tri_.get_num_regs(), {});
+    std::vector<bool> seen(tri_.get_num_regs(), false);
+    for (RegisterClass *rc : tri_.get_reg_classes())
     {
-        phys_reg_states_[preg] = {.available = true, .assigned_range = nullptr, .last_use_pos = 0};
+        ClassState &cls = class_states_[rc->id];
+        cls.order = tri_.allocation_order(rc->id);
+        cls.free = cls.order.size() == TargetRegisterInfo::MAX_CLASS_REGS ? ~uint64_t(0) : (uint64_t(1) << cls.order.size()) - 1;
+        cls.busy.assign(cls.order.size(), 0);
+        for (unsigned preg : cls.order)
+        {
+            MO_ASSERT(!tri_.is_reserved_reg(preg), "Invalid physical register: %u, reserved", preg);
+            if (seen[preg])
+                continue;
+            seen[preg] = true;
+            if (LiveRange *phys_lr = lra_.get_physical_live_range(preg))
+            {
+                unions_[preg].insert(phys_lr);
+            }
+        }
     }
 }
 
 RegAllocResult LinearScanRegisterAllocator::allocate_registers()
 {
+    PhaseTimer timer("regalloc");
     MO_DEBUG("Starting register allocation.");
     initialize();
+    timer.count("live_ranges", unhandled_.size());
     RegAllocResult result;
 
     while (!unhandled_.empty())
@@ -49,199 +101,350 @@ RegAllocResult LinearScanRegisterAllocator::allocate_registers()
         if (current_range->is_allocated())
         {
             MO_DEBUG("Interval for physical register, skipping.");
-            active_.push(current_range);
-            continue;
+            active_.push_back(current_range);
         }
         else if (allocate_register_for(current_range))
         {
             MO_DEBUG("Successfully allocated register for vreg %u", current_range->vreg());
-            active_.push(current_range);
-            continue;
+            active_.push_back(current_range);
         }
-        else
+        else if (!split_for(current_range)) // 3. 分裂：自己或某个活动片段暂时让出寄存器
         {
-            MO_DEBUG("Failed to allocate register for vreg %u, attempting to spill.", current_interval.parent()->vreg());
-            // 3. 需要溢出处理
-            LiveRange *spill_candidate = choose_register_to_spill(current_interval.start());
-            if (spill_candidate)
-            {
-                MO_DEBUG("Spilling candidate found: vreg %u", spill_candidate->vreg());
-                spill_live_range(spill_candidate);
-                if (allocate_register_for(current_interval.parent()))
-                {
-                    MO_DEBUG("Successfully allocated register for vreg %u after spilling.", current_interval.parent()->vreg());
-                    active_.push(current_interval.parent());
-                }
-                else
-                {
-                    MO_DEBUG("Failed to allocate register even after spilling.");
-                    result.successful = false;
-                    result.error_message = "Failed to allocate even after spilling";
-                    return result;
-                }
-            }
-            else
-            {
-                MO_DEBUG("No spill candidate found.");
-                result.successful = false;
-                result.error_message = "No spill candidate found";
-                return result;
-            }
+            MO_DEBUG("No spill candidate found.");
+            result.successful = false;
+            result.error_message = "No spill candidate found";
+            return result;
         }
     }
 
+    finalize_pieces();
+    timer.count("split_vregs", split_vregs_.size());
+
     MO_DEBUG("Register allocation completed successfully.");
     result.successful = true;
+    result.num_spills = num_spills_;
+    result.num_remats = num_remats_;
     return result;
 }
 
 void LinearScanRegisterAllocator::expire_old_intervals(unsigned current_pos)
 {
     MO_DEBUG("Expiring old intervals at position %u", current_pos);
-    while (!active_.empty())
+    // 区间左闭右开，终点等于当前位置时寄存器已经可以复用
+    std::erase_if(active_, [&](LiveRange *lr)
+                  {
+                      if (lr->atomized_interval().end() > current_pos)
+                          return false;
+                      MO_DEBUG("Interval for register %d has ended, freeing it.", lr->vreg());
+                      MO_ASSERT(lr->is_allocated(), "Expected physical register");
+                      if (reg_owners_[lr->preg()] == lr)
+                      {
+                          reg_owners_[lr->preg()] = nullptr;
+                          vacate(lr->preg());
+                      }
+                      return true; });
+}
+
+bool LinearScanRegisterAllocator::allocate_register_for(LiveRange *lr)
+{
+    auto vreg = lr->vreg();
+    MO_ASSERT(!lr->is_allocated(), "Expected virtual register");
+    MO_DEBUG("Attempting to allocate register for vreg %u", vreg);
+    const ClassState &cls = class_states_[mf_.get_vreg_info(vreg).register_class_id_];
+
+    // 前一个片段的寄存器优先：所有片段落在同一个寄存器上就不用插入装载
+    uint64_t hinted = 0;
+    for (LiveRange *sibling : pieces_[vreg])
+    {
+        if (sibling != lr && sibling->is_allocated() && !sibling->intervals().empty())
+            hinted = tri_.alias_mask(sibling->preg(), mf_.get_vreg_info(vreg).register_class_id_);
+    }
+
+    // 空闲位图里按分配顺序找第一个和已占区间不冲突的
+    for (uint64_t candidates : {cls.free & hinted, cls.free & ~hinted})
     {
-        LiveRange *lr = active_.top();
-        MO_DEBUG("Checking interval for register: %d", lr->vreg());
-        bool ended = lr->atomized_interval().end() < current_pos;
-        if (ended)
+        for (; candidates; candidates &= candidates - 1)
         {
-            // 释放物理寄存器
-            MO_DEBUG("Interval for register %d has ended, freeing it.", lr->vreg());
-            MO_ASSERT(lr->is_allocated(), "Expected physical register");
-            if (lr->is_allocated())
+            const unsigned preg = cls.order[std::countr_zero(candidates)];
+            if (!has_conflict(lr, preg))
             {
-                auto &state = phys_reg_states_[lr->preg()];
-                state.available = true;
-                state.assigned_range = nullptr;
-                state.last_use_pos = 0;
+                MO_DEBUG("  Allocating physical register: %u for vreg %u", preg, vreg);
+                assign_piece(lr, preg);
+                return true;
             }
-            active_.pop();
-        }
-        else
-        {
-            break;
         }
     }
+    MO_DEBUG("Failed to allocate register for vreg %u", vreg);
+    return false;
 }
 
-LiveRange *LinearScanRegisterAllocator::choose_register_to_spill(unsigned current_pos)
+bool LinearScanRegisterAllocator::split_for(LiveRange *lr)
 {
-    MO_DEBUG("Choosing register to spill at position %u", current_pos);
+    const unsigned vreg = lr->vreg();
+    const unsigned pos = lr->atomized_interval().start();
+    const unsigned rc_id = mf_.get_vreg_info(vreg).register_class_id_;
 
-    MO_ASSERT(!active_.empty(), "No active live ranges");
-    return active_.top();
-}
+    // 让出寄存器的代价就是片段的溢出代价。起点那条指令若已有别的寄存器放在
+    // 内存里，临时寄存器被占了，lr 只能去抢
+    const MachineInst *start_inst = referenced_at(*lr, pos);
+    auto taken = start_inst ? mem_refs_.find(start_inst) : mem_refs_.end();
+    const bool can_wait = taken == mem_refs_.end() || taken->second == vreg;
 
-bool LinearScanRegisterAllocator::allocate_register_for(LiveRange *lr)
-{
-    auto vreg = lr->vreg();
-    if (auto preg_it = vreg_to_preg_map_.find(vreg); preg_it != vreg_to_preg_map_.end())
+    LiveRange *victim = nullptr;
+    float best = can_wait ? spill_costs_[lr] : std::numeric_limits<float>::infinity();
+    for (LiveRange *other : active_)
+    {
+        if (!MachineFunction::is_virtual_reg(other->vreg()) ||
+            mf_.get_vreg_info(other->vreg()).register_class_id_ != rc_id)
+            continue;
+        // 在同一条指令上被引用的片段必须留在寄存器里
+        if (referenced_at(*other, pos) || spill_costs_[other] >= best)
+            continue;
+        // 腾出的寄存器还要容得下 lr 的整个片段
+        auto &reg_union = unions_[other->preg()];
+        reg_union.remove(other);
+        const bool fits = reg_union.find_conflict(*lr) == nullptr;
+        reg_union.insert(other);
+        if (!fits)
+            continue;
+        victim = other;
+        best = spill_costs_[other];
+    }
+
+    PhaseStats::global().add_count("regalloc", "splits", 1);
+    if (victim)
     {
-        MO_DEBUG("Register for vreg %u already assigned to preg %u", vreg, preg_it->second);
-        lr->assign(preg_it->second);
+        evicted_.insert(victim->vreg());
+        // 受害者截到 pos 为止，在下一次引用处重新参与分配
+        MO_DEBUG("Splitting vreg %u at %u to free preg %u", victim->vreg(), pos, victim->preg());
+        const unsigned preg = victim->preg();
+        const LiveInterval interval = victim->atomized_interval();
+        release_piece(victim);
+        if (const LiveOccurrence *next = next_occurrence(*victim, pos, true))
+            unhandled_.push(add_piece(victim->vreg(), next->pos, interval.end(), *victim));
+        if (interval.start() < pos)
+        {
+            victim->assign_intervals({{interval.start(), pos}});
+            unions_[preg].insert(victim);
+        }
+        else
+        {
+            victim->assign_intervals({});
+        }
+        assign_piece(lr, preg);
+        active_.push_back(lr);
         return true;
     }
 
-    MO_ASSERT(!lr->is_allocated(), "Expected virtual register");
-    MO_DEBUG("Attempting to allocate register for vreg %u", vreg);
-    std::vector<unsigned> candidates = get_allocatable_regs(vreg);
+    if (!can_wait)
+        return false;
+
+    // lr 自己让出：起点的引用走临时寄存器，下一次引用处再试
+    MO_DEBUG("Splitting vreg %u after %u", vreg, pos);
+    evicted_.insert(vreg);
+    if (start_inst)
+        mem_refs_[start_inst] = vreg;
+    if (const LiveOccurrence *next = next_occurrence(*lr, pos, false))
+        unhandled_.push(add_piece(vreg, next->pos, lr->atomized_interval().end(), *lr));
+    lr->assign_intervals({});
+    return true;
+}
+
+void LinearScanRegisterAllocator::finalize_pieces()
+{
+    std::unordered_set<unsigned> in_memory;
+    for (auto [mi, vreg] : mem_refs_)
+        in_memory.insert(vreg);
 
-    // 寻找最佳物理寄存器
-    for (unsigned preg : candidates)
+    for (auto &[vreg, pieces] : pieces_)
     {
-        MO_DEBUG("Checking physical register: %u", preg);
-        PhysRegState &state = phys_reg_states_[preg];
-        if (state.available && !has_conflict(lr, preg))
+        std::set<unsigned> pregs;
+        for (LiveRange *piece : pieces)
         {
-            MO_DEBUG("  Allocating physical register: %u for vreg %u", preg, vreg);
-            lr->assign(preg);
-            assign_physical_reg(vreg, preg);
-            state.available = false;
-            state.assigned_range = lr;
-            state.last_use_pos = lr->atomized_interval().end();
+            if (piece->is_allocated() && !piece->intervals().empty())
+                pregs.insert(piece->preg());
+        }
+        if (!evicted_.count(vreg) && pregs.size() == 1)
+            assign_physical_reg(vreg, *pregs.begin());
+        else if (!pregs.empty() || in_memory.count(vreg))
+            split_vregs_.push_back(vreg);
+    }
 
-            return true;
+    // 溢出槽始终保存最新的值：每次定义都写回，内存中的引用经临时寄存器访问。
+    // 能重算的不占溢出槽，需要装回的地方重算一遍
+    std::sort(split_vregs_.begin(), split_vregs_.end());
+    for (unsigned vreg : split_vregs_)
+    {
+        if (rematerialize(vreg))
+        {
+            PhaseStats::global().add_count("regalloc", "remats", 1);
         }
-        if (!state.available)
+        else
         {
-            MO_DEBUG("  Not available");
+            allocate_spill_slot(vreg);
+            PhaseStats::global().add_count("regalloc", "spills", 1);
         }
-        if (has_conflict(lr, preg))
+        if (in_memory.count(vreg))
         {
-            MO_DEBUG("  Conflict with current live range");
+            auto rc_id = mf_.get_vreg_info(vreg).register_class_id_;
+            auto tmp_regs = tri_.get_temp_regs(mf_.call_convention(), rc_id);
+            MO_ASSERT(tmp_regs.size() > 0, "No temporary registers available for spilling");
+            assign_temp_physical_reg(vreg, tmp_regs[0]);
         }
     }
-    MO_DEBUG("Failed to allocate register for vreg %u", vreg);
-    return false;
 }
 
-bool LinearScanRegisterAllocator::has_conflict(LiveRange *lr, unsigned preg) const
+void LinearScanRegisterAllocator::apply()
 {
-    MO_DEBUG("Checking for conflicts between vreg %u and preg %u", lr->vreg(), preg);
-    // 检查与物理寄存器的活跃区间冲突
-    if (LiveRange *phys_lr = lra_.get_physical_live_range(preg))
+    // 先收集全部改写，插入指令会让槽位编号失效
+    const SlotIndexes &indexes = mf_.slot_indexes();
+    std::vector<std::tuple<MachineInst *, unsigned, unsigned>> renames; // (指令, 虚拟寄存器, 物理寄存器)
+    std::set<std::tuple<MachineInst *, unsigned, unsigned>> loads;     // 指令之前装入或重算 (指令, 物理寄存器, 虚拟寄存器)
+    std::vector<std::tuple<MachineInst *, unsigned, int>> stores;      // 指令之后写回
+    for (unsigned vreg : split_vregs_)
+    {
+        const bool remat = is_rematerialized(vreg);
+        const int slot = remat ? 0 : vreg_to_spill_slot_.at(vreg);
+        for (LiveRange *piece : pieces_[vreg])
+        {
+            if (!piece->is_allocated() || piece->intervals().empty())
+                continue;
+            const LiveInterval &interval = piece->atomized_interval();
+            const unsigned preg = piece->preg();
+            for (const auto &occurrence : piece->occurrences_in(interval))
+            {
+                if (renames.empty() || std::get<0>(renames.back()) != occurrence.inst)
+                    renames.emplace_back(occurrence.inst, vreg, preg);
+                if (occurrence.is_def)
+                {
+                    if (!remat)
+                        stores.emplace_back(occurrence.inst, preg, slot);
+                }
+                else if (occurrence.pos == interval.start())
+                {
+                    loads.emplace(occurrence.inst, preg, vreg);
+                }
+            }
+        }
+
+        // 块入口：有前驱在出口处不把值放在同一个寄存器里，就从溢出槽装入
+        for (const auto &bb : mf_.basic_blocks())
+        {
+            if (bb->instructions().empty() || !lra_.is_live_in(vreg, bb.get()))
+                continue;
+            MachineInst *first = bb->instructions().front().get();
+            auto preg = location(vreg, indexes.index(first));
+            if (!preg)
+                continue;
+            for (MachineBasicBlock *pred : bb->predecessors())
+            {
+                if (pred->instructions().empty() ||
+                    location(vreg, indexes.index(pred->instructions().back().get())) != preg)
+                {
+                    loads.emplace(first, *preg, vreg);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto &[mi, vreg, preg] : renames)
+        mi->replace_reg(vreg, preg);
+    size_t reloads = 0;
+    for (auto &[mi, preg, vreg] : loads)
     {
-        bool conflicts = phys_lr->interferes_with(*lr);
-        MO_DEBUG("Conflict check result: %s", conflicts ? "true" : "false");
-        return conflicts;
+        insert_reload(*mi->parent(), mi->parent()->locate(mi), vreg, preg);
+        reloads += !is_rematerialized(vreg);
     }
-    MO_DEBUG("No physical live range found for preg %u, assuming no conflict", preg);
-    return false;
+    for (auto &[mi, preg, slot] : stores)
+        tii_.insert_store_to_stack(*mi->parent(), std::next(mi->parent()->locate(mi)), preg, slot, 0);
+    if (!split_vregs_.empty())
+        PhaseStats::global().add_count("regalloc", "reloads", reloads);
+
+    // 留在内存里的引用和其余寄存器照常处理
+    RegisterAllocator::apply();
 }
 
-void LinearScanRegisterAllocator::spill_live_range(LiveRange *lr)
+LiveRange *LinearScanRegisterAllocator::add_piece(unsigned vreg, unsigned start, unsigned end, const LiveRange &from)
 {
-    MO_ASSERT(lr->is_allocated(), "Expected physical register");
-    MO_DEBUG("Spilling range of preg %u", lr->vreg());
-    auto slot = allocate_spill_slot(lr->vreg());
-    auto vreg_rc = mf_.get_vreg_info(lr->vreg()).register_class_id_;
-    auto tmp_regs = tri_.get_temp_regs(mf_.call_convention(), vreg_rc);
-    MO_ASSERT(tmp_regs.size() > 0, "No temporary registers available for spilling");
-    assign_temp_physical_reg(lr->vreg(), tmp_regs[0]);
-    auto preg = lr->preg();
-
-    MO_DEBUG("Freeing physical register: %u", preg);
-
-    auto &state = phys_reg_states_[preg];
-    MO_ASSERT(state.assigned_range == lr, "Expected assigned range");
-    state.available = true;
-    state.assigned_range = nullptr;
-    state.last_use_pos = 0;
+    std::unique_ptr<LiveRange> piece(new LiveRange(vreg));
+    piece->add_interval(start, end);
+    for (const auto &occurrence : from.occurrences())
+    {
+        if (occurrence.pos >= start && occurrence.pos < end)
+            piece->add_occurrence(occurrence.pos, occurrence.inst, occurrence.is_def);
+    }
+    LiveRange *ptr = piece.get();
+    spill_costs_[ptr] = calculate_spill_cost(vreg, *ptr);
+    pieces_[vreg].push_back(ptr);
+    ranges_.push_back(std::move(piece));
+    return ptr;
+}
 
-    lr->mark_spilled(slot);
+void LinearScanRegisterAllocator::assign_piece(LiveRange *lr, unsigned preg)
+{
+    lr->assign(preg);
+    unions_[preg].insert(lr);
+    reg_owners_[preg] = lr;
+    occupy(preg);
 }
 
-std::vector<unsigned> LinearScanRegisterAllocator::get_allocatable_regs(unsigned vreg) const
+void LinearScanRegisterAllocator::release_piece(LiveRange *lr)
 {
-    MO_DEBUG("Getting allocatable registers for vreg %u", vreg);
-    // 获取虚拟寄存器的寄存器类别
-    const auto &vreg_info = mf_.get_vreg_info(vreg);
-    unsigned rc_id = vreg_info.register_class_id_;
+    MO_ASSERT(reg_owners_[lr->preg()] == lr, "Expected assigned range");
+    reg_owners_[lr->preg()] = nullptr;
+    vacate(lr->preg());
+    unions_[lr->preg()].remove(lr);
+    std::erase(active_, lr);
+}
 
-    std::vector<unsigned> pregs = tri_.get_allocation_order(rc_id);
-    // MO_DEBUG("Allocation order for vreg %u: [%s]", vreg, mo_join(pregs, ", ").c_str());
-    // 按使用热度排序
-    std::sort(pregs.begin(), pregs.end(), [&](unsigned a, unsigned b)
-              { 
-                MO_ASSERT(phys_reg_states_.count(a) != 0, "Invalid physical register: %u", a);
-                MO_ASSERT(phys_reg_states_.count(b) != 0, "Invalid physical register: %u", b);
-                return phys_reg_states_.at(a).last_use_pos > phys_reg_states_.at(b).last_use_pos; });
-    MO_DEBUG("Allocatable registers for vreg %u: %zu registers found", vreg, pregs.size());
-    return pregs;
+void LinearScanRegisterAllocator::occupy(unsigned preg)
+{
+    for (unsigned rc_id = 0; rc_id < class_states_.size(); ++rc_id)
+    {
+        ClassState &cls = class_states_[rc_id];
+        for (uint64_t mask = tri_.alias_mask(preg, rc_id); mask; mask &= mask - 1)
+        {
+            const unsigned i = std::countr_zero(mask);
+            if (cls.busy[i]++ == 0)
+                cls.free &= ~(uint64_t(1) << i);
+        }
+    }
 }
 
-std::vector<unsigned> LinearScanRegisterAllocator::collect_allocatable_regs() const
+void LinearScanRegisterAllocator::vacate(unsigned preg)
 {
-    MO_DEBUG("Getting initial allocatable registers");
-    std::vector<unsigned> pregs;
-    for (RegisterClass *rc : tri_.get_reg_classes())
+    for (unsigned rc_id = 0; rc_id < class_states_.size(); ++rc_id)
     {
-        for (unsigned preg : tri_.get_allocatable_regs(rc->id))
+        ClassState &cls = class_states_[rc_id];
+        for (uint64_t mask = tri_.alias_mask(preg, rc_id); mask; mask &= mask - 1)
         {
-            MO_ASSERT(!tri_.is_reserved_reg(preg), "Invalid physical register: %u, reserved", preg);
-            pregs.push_back(preg);
+            const unsigned i = std::countr_zero(mask);
+            MO_ASSERT(cls.busy[i] > 0, "Register %u released twice", preg);
+            if (--cls.busy[i] == 0)
+                cls.free |= uint64_t(1) << i;
         }
     }
-    MO_DEBUG("Initial allocatable registers: %zu registers found", pregs.size());
-    return pregs;
+}
+
+std::optional<unsigned> LinearScanRegisterAllocator::location(unsigned vreg, unsigned pos) const
+{
+    auto it = pieces_.find(vreg);
+    if (it == pieces_.end())
+        return std::nullopt;
+    for (const LiveRange *piece : it->second)
+    {
+        if (piece->is_allocated() && !piece->intervals().empty() && piece->live_at(pos))
+            return piece->preg();
+    }
+    return std::nullopt;
+}
+
+bool LinearScanRegisterAllocator::has_conflict(LiveRange *lr, unsigned preg) const
+{
+    MO_DEBUG("Checking for conflicts between vreg %u and preg %u", lr->vreg(), preg);
+    // 检查与物理寄存器上已有区间的冲突
+    bool conflicts = unions_[preg].find_conflict(*lr) != nullptr;
+    MO_DEBUG("Conflict check result: %s", conflicts ? "true" : "false");
+    return conflicts;
 }
@@ -3,30 +3,30 @@
 
 #include "../reg_alloc.h"
 #include "../lra.h"
+#include "../live_interval_union.h"
+#include <cstdint>
+#include <memory>
 #include <queue>
+#include <span>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
-// Linear Scan allocator implementation
+// Linear Scan allocator implementation, with second-chance binpacking: a
+// range that loses its register is split at its next reference rather than
+// spilled whole, so only the part across the pressure lives in memory and
+// the rest competes for a register again
 class LinearScanRegisterAllocator : public RegisterAllocator
 {
 private:
-    // 比较函数对象
+    // 比较函数对象，起点相同按寄存器编号，让分配结果与遍历顺序无关
     struct CompareByIntervalStartAsc
     {
         bool operator()(const LiveRange *a,
                         const LiveRange *b) const
         {
-            return a->atomized_interval().start() > b->atomized_interval().start(); // 最小堆
-        }
-    };
-
-    struct CompareByIntervalEndAsc
-    {
-        bool operator()(const LiveRange *a,
-                        const LiveRange *b) const
-        {
-            return a->atomized_interval().end() > b->atomized_interval().end(); // 最小堆
+            const unsigned sa = a->atomized_interval().start(), sb = b->atomized_interval().start();
+            return sa > sb || (sa == sb && a->vreg() > b->vreg()); // 最小堆
         }
     };
 
@@ -37,42 +37,63 @@ private:
                         CompareByIntervalStartAsc>
         unhandled_;
 
-    std::priority_queue<LiveRange *,
-                        std::vector<LiveRange *>,
-                        CompareByIntervalEndAsc>
-        active_;
+    // 当前占有寄存器的片段；分裂时要从中间挑出受害者，所以不用堆
+    std::vector<LiveRange *> active_;
 
     std::vector<std::unique_ptr<LiveRange>> ranges_;
+    // 每个虚拟寄存器被切成的片段，按创建顺序
+    std::unordered_map<unsigned, std::vector<LiveRange *>> pieces_;
+    // 在内存中被引用的位置：指令 -> 用临时寄存器顶替的虚拟寄存器
+    std::unordered_map<const MachineInst *, unsigned> mem_refs_;
+    // 有片段让出过寄存器的虚拟寄存器：片段之间的空档里值只在溢出槽中
+    std::unordered_set<unsigned> evicted_;
+    // 片段分到了不同位置的虚拟寄存器，apply 时逐条改写
+    std::vector<unsigned> split_vregs_;
 
-    // 物理寄存器状态跟踪（并非全局状态，是一个动态变化的表）
-    struct PhysRegState
+    // 物理寄存器状态：每个寄存器类一个空闲位图，第 i 位对应分配顺序中的第 i 个
+    // 寄存器。分配和释放经目标的别名掩码同时更新所有重叠的寄存器
+    struct ClassState
     {
-        bool available = true;
-        LiveRange *assigned_range = nullptr;
-        unsigned last_use_pos = 0;
+        std::span<const unsigned> order;
+        uint64_t free = 0;
+        std::vector<unsigned> busy; // 每个位置上占用它或其别名的片段数
     };
+    std::vector<ClassState> class_states_;
+    // 按物理寄存器编号：当前占用它的片段
+    std::vector<LiveRange *> reg_owners_;
+    // 每个物理寄存器上占用的区间：预着色的物理区间和已分配给它的区间
+    std::vector<LiveIntervalUnion> unions_;
 
-    std::unordered_map<unsigned, PhysRegState> phys_reg_states_;
-
-    // 溢出决策相关
-    std::unordered_map<unsigned, float> spill_costs_;
+    // 溢出决策相关：片段内按循环深度加权的引用次数
+    std::unordered_map<const LiveRange *, float> spill_costs_;
 
 public:
     explicit LinearScanRegisterAllocator(MachineFunction &mf) : RegisterAllocator(mf) {}
 
     RegAllocResult allocate_registers() override;
+    // Rewrites the split registers piece by piece, with a reload wherever a
+    // piece starts, then the rest as usual
+    void apply() override;
 
 private:
     // 核心分配步骤
     void initialize();
     void expire_old_intervals(unsigned current_pos);
     bool allocate_register_for(LiveRange *lr);
-    LiveRange *choose_register_to_spill(unsigned current_pos);
+    // No register is free at `lr`'s start: evicts the cheapest of `lr` and
+    // the active pieces it could take a register from. Whatever loses goes
+    // to memory up to its next reference, where a new piece starts
+    bool split_for(LiveRange *lr);
+    void finalize_pieces();
 
     // 辅助方法
-    void update_phys_reg_usage(unsigned preg, unsigned use_pos);
-    std::vector<unsigned> get_allocatable_regs(unsigned vreg) const;
-    std::vector<unsigned> collect_allocatable_regs() const;
+    void occupy(unsigned preg);
+    void vacate(unsigned preg);
     bool has_conflict(LiveRange *lr, unsigned preg) const;
-    void spill_live_range(LiveRange *lr);
+    LiveRange *add_piece(unsigned vreg, unsigned start, unsigned end, const LiveRange &from);
+    void assign_piece(LiveRange *lr, unsigned preg);
+    void release_piece(LiveRange *lr);
+    // The register holding `vreg` at `pos`, or nothing when it lives in
+    // memory there
+    std::optional<unsigned> location(unsigned vreg, unsigned pos) const;
 };
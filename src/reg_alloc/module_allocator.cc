@@ -0,0 +1,232 @@
+#include "module_allocator.h"
+#include "reg_alloc_factory.h"
+#include "../phase_stats.h"
+#include "../thread_pool.h"
+#include <algorithm>
+#include <numeric>
+#include <unordered_map>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // Machine functions by name, for finding the callee of a call
+    using FunctionIndex = std::unordered_map<std::string, size_t>;
+
+    const char *callee_name(const MachineInst &mi)
+    {
+        if (!mi.has_flag(MIFlag::Call) || mi.operands().empty() || !mi.operands()[0].is_external_sym())
+            return nullptr;
+        return mi.operands()[0].external_sym();
+    }
+
+    // Calls to Fast functions that are already allocated only clobber what
+    // those functions were found to use
+    void narrow_call_clobbers(MachineFunction &mf, const MachineModule &mm, const FunctionIndex &index)
+    {
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            for (auto &mi : *mbb)
+            {
+                const char *name = callee_name(*mi);
+                if (!name || mi->is_tail_call())
+                    continue;
+                auto it = index.find(name);
+                const std::set<unsigned> *clobbers = mm.clobbered_regs(name);
+                if (it == index.end() || !clobbers || mm.functions()[it->second]->call_convention() != CallingConv::Fast)
+                    continue;
+                mi->set_implicit_defs({clobbers->begin(), clobbers->end()});
+            }
+        }
+    }
+
+    // Physical registers a call to `mf` may overwrite. A tail call hands
+    // our caller whatever its callee overwrites too
+    std::set<unsigned> collect_clobbered_regs(const MachineFunction &mf, const MachineModule &mm,
+                                              const TargetRegisterInfo &tri)
+    {
+        std::set<unsigned> regs;
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            for (const auto &mi : mbb->instructions())
+            {
+                for (unsigned reg : mi->defs())
+                {
+                    if (MachineFunction::is_physical_reg(reg))
+                        regs.insert(reg);
+                }
+                const char *name = mi->is_tail_call() ? callee_name(*mi) : nullptr;
+                if (!name)
+                    continue;
+                const std::set<unsigned> *clobbers = mm.clobbered_regs(name);
+                if (!clobbers)
+                    clobbers = &tri.get_caller_saved_regs(mf.call_convention());
+                regs.insert(clobbers->begin(), clobbers->end());
+            }
+        }
+        return regs;
+    }
+
+    // Groups of functions that can be allocated together, callees before
+    // their callers; functions calling each other in a cycle come last
+    std::vector<std::vector<size_t>> bottom_up_waves(const MachineModule &mm, const FunctionIndex &index)
+    {
+        const auto &functions = mm.functions();
+        std::vector<std::vector<size_t>> callers(functions.size());
+        std::vector<size_t> pending(functions.size(), 0);
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            std::set<size_t> callees;
+            for (const auto &mbb : functions[i]->basic_blocks())
+            {
+                for (const auto &mi : mbb->instructions())
+                {
+                    const char *name = callee_name(*mi);
+                    auto it = name ? index.find(name) : index.end();
+                    if (it != index.end() && it->second != i)
+                        callees.insert(it->second);
+                }
+            }
+            for (size_t callee : callees)
+                callers[callee].push_back(i);
+            pending[i] = callees.size();
+        }
+
+        std::vector<std::vector<size_t>> waves;
+        std::vector<size_t> ready;
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            if (pending[i] == 0)
+                ready.push_back(i);
+        }
+        std::vector<char> placed(functions.size(), false);
+        while (!ready.empty())
+        {
+            std::vector<size_t> next;
+            for (size_t i : ready)
+            {
+                placed[i] = true;
+                for (size_t caller : callers[i])
+                {
+                    if (--pending[caller] == 0)
+                        next.push_back(caller);
+                }
+            }
+            waves.push_back(std::move(ready));
+            ready = std::move(next);
+        }
+        std::vector<size_t> cyclic;
+        for (size_t i = 0; i < functions.size(); ++i)
+        {
+            if (!placed[i])
+                cyclic.push_back(i);
+        }
+        if (!cyclic.empty())
+            waves.push_back(std::move(cyclic));
+        return waves;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Module Allocation
+//===----------------------------------------------------------------------===//
+
+static FunctionAllocation allocate_function(MachineFunction &mf, unsigned opt_level,
+                                            const TargetFrameLowering *frame_lowering)
+{
+    MachineInstPoolScope pool(mf);
+    FunctionAllocation allocation;
+    allocation.mf = &mf;
+    std::unique_ptr<RegisterAllocator> allocator = create_register_allocator(mf, opt_level);
+    allocation.regalloc = mf.allocate_registers(*allocator);
+    if (!allocation.regalloc.successful)
+        return allocation;
+    allocator->apply();
+    if (opt_level > 0)
+        allocation.frame_packing = pack_frame_objects(mf);
+
+    if (frame_lowering)
+    {
+        // The prologue may add slots for the registers it saves
+        frame_lowering->emit_prologue(mf);
+        frame_lowering->emit_epilogue(mf);
+        allocation.frame_layout = frame_lowering->compute_frame_layout(mf);
+    }
+    return allocation;
+}
+
+std::vector<FunctionAllocation> allocate_module(MachineModule &mm, unsigned opt_level,
+                                                const TargetFrameLowering *frame_lowering, ThreadPool *pool)
+{
+    PhaseTimer timer("regalloc_module");
+    const auto &functions = mm.functions();
+    std::vector<FunctionAllocation> results(functions.size());
+    const TargetRegisterInfo *tri = mm.target_reg_info();
+
+    FunctionIndex index;
+    for (size_t i = 0; i < functions.size(); ++i)
+    {
+        if (Function *func = functions[i]->ir_function())
+            index.emplace(func->name(), i);
+    }
+
+    // At opt level 0 no call is narrowed, so nothing has to wait for its callees
+    std::vector<std::vector<size_t>> waves;
+    if (opt_level > 0 && tri)
+    {
+        waves = bottom_up_waves(mm, index);
+    }
+    else
+    {
+        waves.emplace_back(functions.size());
+        std::iota(waves.back().begin(), waves.back().end(), 0);
+    }
+
+    // 工作量按指令数估计，大的先开始；池里空闲的线程自取下一个函数
+    std::vector<size_t> sizes(functions.size(), 0);
+    for (size_t i = 0; i < functions.size(); ++i)
+    {
+        for (const auto &bb : functions[i]->basic_blocks())
+            sizes[i] += bb->instructions().size();
+    }
+    for (std::vector<size_t> &schedule : waves)
+    {
+        std::stable_sort(schedule.begin(), schedule.end(), [&](size_t a, size_t b)
+                         { return sizes[a] > sizes[b]; });
+
+        auto allocate = [&](size_t slot, unsigned)
+        {
+            const size_t i = schedule[slot];
+            if (opt_level > 0 && tri)
+                narrow_call_clobbers(*functions[i], mm, index);
+            results[i] = allocate_function(*functions[i], opt_level, frame_lowering);
+            if (tri && results[i].regalloc.successful)
+                results[i].clobbered_regs = collect_clobbered_regs(*functions[i], mm, *tri);
+        };
+        if (pool)
+        {
+            pool->parallel_for(schedule.size(), allocate);
+        }
+        else
+        {
+            for (size_t i = 0; i < schedule.size(); ++i)
+            {
+                allocate(i, 0);
+            }
+        }
+
+        // Published between waves, so the functions of one wave only read
+        for (size_t i : schedule)
+        {
+            Function *func = functions[i]->ir_function();
+            if (func && results[i].regalloc.successful && tri)
+                mm.set_clobbered_regs(func->name(), results[i].clobbered_regs);
+        }
+    }
+
+    timer.count("functions", functions.size());
+    timer.count("waves", waves.size());
+    return results;
+}
@@ -0,0 +1,42 @@
+// module_allocator.h - Register allocation and frame lowering for a whole module
+#pragma once
+
+#include "../frame_packing.h"
+#include "../machine.h"
+#include "../reg_alloc.h"
+#include <vector>
+
+class ThreadPool;
+
+struct FunctionAllocation
+{
+    MachineFunction *mf = nullptr;
+    RegAllocResult regalloc;
+    // Spill slot coloring, which only runs above opt level 0
+    FramePackingStats frame_packing;
+    // Left zero when no frame lowering was given or allocation failed
+    FrameLayout frame_layout{0, 0};
+    // Physical registers a call to this function may overwrite; empty
+    // without target register info
+    std::set<unsigned> clobbered_regs;
+};
+
+// Allocates registers in every function of `mm` with the allocator
+// create_register_allocator picks for `opt_level`, rewrites the code, packs
+// the spill slots above opt level 0, and then lays out the frame and emits
+// the prologue and epilogue when `frame_lowering` is given. Functions share
+// only the read-only target info, so with a pool they run in parallel, the
+// largest first so that a few huge functions start early instead of
+// finishing last. The results are in the module's function order whatever
+// the schedule.
+//
+// The registers each allocated function overwrites, its callees' included,
+// are recorded with MachineModule::set_clobbered_regs. Above opt level 0
+// callees are allocated before their callers, wave by wave, and a call to a
+// Fast function that is already done only clobbers what that function
+// uses instead of every caller-saved register, so values can stay in the
+// registers it leaves alone. Calls within a cycle of functions keep the
+// full set.
+std::vector<FunctionAllocation> allocate_module(MachineModule &mm, unsigned opt_level,
+                                                const TargetFrameLowering *frame_lowering = nullptr,
+                                                ThreadPool *pool = nullptr);
@@ -0,0 +1,10 @@
+#include "reg_alloc_factory.h"
+#include "irc.h"
+#include "lsra.h"
+
+std::unique_ptr<RegisterAllocator> create_register_allocator(MachineFunction &mf, unsigned opt_level)
+{
+    if (opt_level == 0)
+        return std::make_unique<LinearScanRegisterAllocator>(mf);
+    return std::make_unique<IteratedCoalescingRegisterAllocator>(mf);
+}
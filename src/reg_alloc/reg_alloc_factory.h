@@ -0,0 +1,9 @@
+// reg_alloc_factory.h - Register allocator selection
+#pragma once
+
+#include "../reg_alloc.h"
+#include <memory>
+
+// Linear scan at -O0, where compile time matters most; iterated register
+// coalescing from -O1 up, which spills less and removes copies
+std::unique_ptr<RegisterAllocator> create_register_allocator(MachineFunction &mf, unsigned opt_level);
@@ -0,0 +1,497 @@
+#include "scheduler.h"
+#include <cstdlib>
+#include <limits>
+#include <optional>
+#include <unordered_set>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // Widest access the scheduler assumes when it can't tell two apart
+    constexpr int MAX_ACCESS_BYTES = 8;
+
+    bool is_barrier(const MachineInst &mi, const TargetInstInfo &tii)
+    {
+        if (tii.is_call(mi) || tii.is_return(mi))
+            return true;
+        for (MIFlag flag : {MIFlag::Branch, MIFlag::Call, MIFlag::Terminator, MIFlag::HasSideEffects,
+                            MIFlag::IsVolatile, MIFlag::FrameSetup, MIFlag::FrameDestroy})
+        {
+            if (mi.has_flag(flag))
+                return true;
+        }
+        for (const MOperand &op : mi.operands())
+        {
+            // Branches and jumps built without their flags
+            if (op.is_basic_block() || op.is_label() || op.is_external_sym())
+                return true;
+        }
+        return false;
+    }
+
+    const MOperand *memory_operand(const MachineInst &mi)
+    {
+        for (const MOperand &op : mi.operands())
+        {
+            if (op.is_mem_ri() || op.is_mem_rr() || op.is_mem_rix() || op.is_mem_fi())
+                return &op;
+        }
+        return nullptr;
+    }
+
+    struct SUnit
+    {
+        MachineInst *mi;
+        unsigned latency;
+        std::vector<std::pair<unsigned, unsigned>> succs = {}; // (unit, latency)
+        unsigned preds_left = 0;
+        unsigned height = 0;
+        unsigned earliest = 0;
+        bool is_load = false;
+        bool is_store = false;
+        const MOperand *address = nullptr;
+        // Version of the address's base register, so equal bases compare
+        unsigned base_version = 0;
+        std::vector<unsigned> defs = {};
+        std::vector<unsigned> uses = {};
+    };
+
+    // Whether two accesses, one of them a store, may touch the same bytes
+    bool may_alias(const SUnit &a, const SUnit &b)
+    {
+        if (!a.address || !b.address)
+            return true;
+        if (a.address->is_mem_ri() && b.address->is_mem_ri())
+        {
+            const auto &x = a.address->mem_ri();
+            const auto &y = b.address->mem_ri();
+            if (x.base_reg != y.base_reg || a.base_version != b.base_version)
+                return true;
+            return std::abs(static_cast<int64_t>(x.offset) - y.offset) < MAX_ACCESS_BYTES;
+        }
+        if (a.address->is_mem_fi() && b.address->is_mem_fi())
+        {
+            const auto &x = a.address->mem_fi();
+            const auto &y = b.address->mem_fi();
+            if (x.frame_index != y.frame_index)
+                return false;
+            return std::abs(static_cast<int64_t>(x.offset) - y.offset) < MAX_ACCESS_BYTES;
+        }
+        return true;
+    }
+
+    class RegionScheduler
+    {
+    public:
+        RegionScheduler(MachineFunction &mf, ScheduleMode mode, const TargetInstInfo &tii,
+                        const TargetRegisterInfo *tri, const std::unordered_map<unsigned, unsigned> &use_counts)
+            : mf_(mf), mode_(mode), tii_(tii), tri_(tri), use_counts_(use_counts) {}
+
+        // Reorders [begin, end) of `mbb`; returns whether anything moved
+        bool run(MachineBasicBlock &mbb, size_t begin, size_t end, ScheduleStats &stats);
+
+    private:
+        MachineFunction &mf_;
+        ScheduleMode mode_;
+        const TargetInstInfo &tii_;
+        const TargetRegisterInfo *tri_;
+        const std::unordered_map<unsigned, unsigned> &use_counts_;
+
+        std::vector<SUnit> units_;
+        // PreRA: uses of each virtual register within the region
+        std::unordered_map<unsigned, unsigned> region_uses_;
+
+        void build_dag(MachineBasicBlock &mbb, size_t begin, size_t end);
+        std::vector<unsigned> pick_order();
+
+        bool tracks(unsigned reg) const { return mode_ == ScheduleMode::PreRA && MachineFunction::is_virtual_reg(reg); }
+        // Every use of `reg` is in this region, so its last one there frees it
+        bool dies_in_region(unsigned reg) const
+        {
+            auto it = use_counts_.find(reg);
+            return region_uses_.at(reg) == (it == use_counts_.end() ? 0 : it->second);
+        }
+        unsigned reg_class(unsigned reg) const { return mf_.get_vreg_info(reg).register_class_id_; }
+        unsigned budget(unsigned reg_class) const
+        {
+            const size_t regs = tri_ ? tri_->allocation_order(reg_class).size() : 0;
+            return regs ? static_cast<unsigned>(regs) : std::numeric_limits<unsigned>::max();
+        }
+        std::unordered_map<unsigned, unsigned> peak_pressure(const std::vector<unsigned> &order) const;
+    };
+
+    void RegionScheduler::build_dag(MachineBasicBlock &mbb, size_t begin, size_t end)
+    {
+        units_.clear();
+        region_uses_.clear();
+        std::unordered_map<unsigned, unsigned> last_def;
+        std::unordered_map<unsigned, std::vector<unsigned>> uses_since_def;
+        std::unordered_map<unsigned, unsigned> versions;
+        std::vector<unsigned> memory_units;
+
+        for (size_t i = begin; i < end; ++i)
+        {
+            MachineInst *mi = mbb.begin()[i].get();
+            SUnit unit{mi, tii_.get_instruction_latency(mi->opcode())};
+            const std::set<unsigned> defs = mi->defs();
+            const std::set<unsigned> uses = mi->uses();
+            unit.defs.assign(defs.begin(), defs.end());
+            unit.uses.assign(uses.begin(), uses.end());
+            unit.address = memory_operand(*mi);
+            unit.is_store = mi->has_flag(MIFlag::MayStore) || (unit.address && defs.empty());
+            unit.is_load = mi->has_flag(MIFlag::MayLoad) || (unit.address && !defs.empty());
+            units_.push_back(std::move(unit));
+        }
+
+        auto add_edge = [this](unsigned from, unsigned to, unsigned latency)
+        {
+            units_[from].succs.push_back({to, latency});
+            ++units_[to].preds_left;
+        };
+
+        for (unsigned n = 0; n < units_.size(); ++n)
+        {
+            SUnit &unit = units_[n];
+            if (unit.address && unit.address->is_mem_ri())
+                unit.base_version = versions[unit.address->mem_ri().base_reg];
+            for (unsigned reg : unit.uses)
+            {
+                if (auto it = last_def.find(reg); it != last_def.end())
+                    add_edge(it->second, n, units_[it->second].latency);
+                uses_since_def[reg].push_back(n);
+                if (tracks(reg))
+                    ++region_uses_[reg];
+            }
+            for (unsigned reg : unit.defs)
+            {
+                // Anti- and output dependencies only order, they don't wait
+                for (unsigned user : uses_since_def[reg])
+                {
+                    if (user != n)
+                        add_edge(user, n, 0);
+                }
+                if (auto it = last_def.find(reg); it != last_def.end())
+                    add_edge(it->second, n, 0);
+                uses_since_def[reg].clear();
+                last_def[reg] = n;
+                ++versions[reg];
+                if (tracks(reg))
+                    region_uses_.try_emplace(reg, 0);
+            }
+            if (unit.is_load || unit.is_store)
+            {
+                for (unsigned other : memory_units)
+                {
+                    const SUnit &earlier = units_[other];
+                    if ((earlier.is_store || unit.is_store) && may_alias(earlier, unit))
+                        add_edge(other, n, earlier.is_store && unit.is_load ? earlier.latency : 0);
+                }
+                memory_units.push_back(n);
+            }
+        }
+
+        // Units only point forward, so one backward sweep settles the heights
+        for (size_t n = units_.size(); n-- > 0;)
+        {
+            SUnit &unit = units_[n];
+            unit.height = unit.latency;
+            for (auto [succ, latency] : unit.succs)
+                unit.height = std::max(unit.height, latency + units_[succ].height);
+        }
+    }
+
+    std::vector<unsigned> RegionScheduler::pick_order()
+    {
+        // PreRA: live values per register class, starting with those
+        // defined before the region
+        std::unordered_map<unsigned, unsigned> live;
+        std::unordered_map<unsigned, unsigned> remaining = region_uses_;
+        std::unordered_set<unsigned> defined;
+        if (mode_ == ScheduleMode::PreRA)
+        {
+            std::unordered_set<unsigned> seen;
+            for (const SUnit &unit : units_)
+            {
+                for (unsigned reg : unit.uses)
+                {
+                    if (tracks(reg) && !defined.count(reg) && seen.insert(reg).second)
+                        ++live[reg_class(reg)];
+                }
+                for (unsigned reg : unit.defs)
+                    defined.insert(reg);
+            }
+        }
+
+        // Registers of each class `unit` would newly keep live, less those it frees
+        auto pressure_delta = [&](const SUnit &unit)
+        {
+            std::unordered_map<unsigned, int> delta;
+            for (unsigned reg : unit.uses)
+            {
+                if (tracks(reg) && remaining[reg] == 1 && dies_in_region(reg))
+                    --delta[reg_class(reg)];
+            }
+            for (unsigned reg : unit.defs)
+            {
+                if (tracks(reg) && (region_uses_[reg] != 0 || !dies_in_region(reg)))
+                    ++delta[reg_class(reg)];
+            }
+            return delta;
+        };
+        auto over_budget = [&](const std::unordered_map<unsigned, int> &delta)
+        {
+            for (auto [rc, d] : delta)
+            {
+                if (d > 0 && live[rc] + d > budget(rc))
+                    return true;
+            }
+            return false;
+        };
+
+        std::vector<unsigned> order;
+        std::vector<unsigned> available;
+        for (unsigned n = 0; n < units_.size(); ++n)
+        {
+            if (units_[n].preds_left == 0)
+                available.push_back(n);
+        }
+        unsigned cycle = 0;
+        while (!available.empty())
+        {
+            std::optional<size_t> best;
+            bool best_over = false;
+            unsigned next_ready = std::numeric_limits<unsigned>::max();
+            for (size_t i = 0; i < available.size(); ++i)
+            {
+                const SUnit &unit = units_[available[i]];
+                if (unit.earliest > cycle)
+                {
+                    next_ready = std::min(next_ready, unit.earliest);
+                    continue;
+                }
+                const bool over = mode_ == ScheduleMode::PreRA && over_budget(pressure_delta(unit));
+                if (!best)
+                {
+                    best = i;
+                    best_over = over;
+                    continue;
+                }
+                // Staying within the registers first, then the critical path,
+                // then the original order
+                const SUnit &current = units_[available[*best]];
+                bool better;
+                if (over != best_over)
+                    better = !over;
+                else if (unit.height != current.height)
+                    better = unit.height > current.height;
+                else
+                    better = available[i] < available[*best];
+                if (better)
+                {
+                    best = i;
+                    best_over = over;
+                }
+            }
+            if (!best)
+            {
+                // Nothing's operands are ready: the core stalls
+                cycle = next_ready;
+                continue;
+            }
+            if (best_over)
+            {
+                // Rather stall for something that frees registers
+                unsigned wait = std::numeric_limits<unsigned>::max();
+                for (unsigned n : available)
+                {
+                    if (units_[n].earliest > cycle && !over_budget(pressure_delta(units_[n])))
+                        wait = std::min(wait, units_[n].earliest);
+                }
+                if (wait != std::numeric_limits<unsigned>::max())
+                {
+                    cycle = wait;
+                    continue;
+                }
+            }
+
+            const unsigned n = available[*best];
+            available.erase(available.begin() + *best);
+            order.push_back(n);
+            const SUnit &unit = units_[n];
+            if (mode_ == ScheduleMode::PreRA)
+            {
+                for (auto [rc, d] : pressure_delta(unit))
+                    live[rc] = static_cast<unsigned>(std::max(0, static_cast<int>(live[rc]) + d));
+                for (unsigned reg : unit.uses)
+                {
+                    if (tracks(reg))
+                        --remaining[reg];
+                }
+            }
+            for (auto [succ, latency] : unit.succs)
+            {
+                units_[succ].earliest = std::max(units_[succ].earliest, cycle + latency);
+                if (--units_[succ].preds_left == 0)
+                    available.push_back(succ);
+            }
+            ++cycle;
+        }
+        return order;
+    }
+
+    std::unordered_map<unsigned, unsigned> RegionScheduler::peak_pressure(const std::vector<unsigned> &order) const
+    {
+        // Instruction `pos` reads at slot 2 * pos and writes at 2 * pos + 1,
+        // so a value freed by an instruction doesn't overlap the one it
+        // defines. Values live into the region start at slot 0 and values
+        // live out of it last past its end
+        const unsigned past_end = 2 * static_cast<unsigned>(order.size());
+        std::unordered_map<unsigned, std::pair<unsigned, unsigned>> spans;
+        for (unsigned pos = 0; pos < order.size(); ++pos)
+        {
+            const SUnit &unit = units_[order[pos]];
+            for (unsigned reg : unit.uses)
+            {
+                if (tracks(reg))
+                    spans.try_emplace(reg, 0, 0).first->second.second = 2 * pos;
+            }
+            for (unsigned reg : unit.defs)
+            {
+                if (tracks(reg))
+                    spans.try_emplace(reg, 2 * pos + 1, 2 * pos + 1);
+            }
+        }
+
+        std::unordered_map<unsigned, PressureTracker> trackers;
+        for (const auto &[reg, span] : spans)
+        {
+            const unsigned end = dies_in_region(reg) ? span.second : past_end;
+            // PressureTracker counts both ends
+            LiveRange range(reg);
+            range.add_interval(span.first, std::max(end, span.first + 1));
+            const unsigned rc = reg_class(reg);
+            trackers.try_emplace(rc, *tri_).first->second.add_interval(range, 1);
+        }
+        std::unordered_map<unsigned, unsigned> peaks;
+        for (const auto &[rc, tracker] : trackers)
+            peaks[rc] = tracker.get_max_pressure();
+        return peaks;
+    }
+
+    bool RegionScheduler::run(MachineBasicBlock &mbb, size_t begin, size_t end, ScheduleStats &stats)
+    {
+        build_dag(mbb, begin, end);
+        const std::vector<unsigned> order = pick_order();
+
+        bool moved = false;
+        for (unsigned pos = 0; pos < order.size(); ++pos)
+            moved |= order[pos] != pos;
+        if (!moved)
+            return false;
+
+        if (mode_ == ScheduleMode::PreRA && tri_)
+        {
+            std::vector<unsigned> original(order.size());
+            for (unsigned pos = 0; pos < original.size(); ++pos)
+                original[pos] = pos;
+            const auto before = peak_pressure(original);
+            for (const auto &[rc, peak] : peak_pressure(order))
+            {
+                auto it = before.find(rc);
+                if (peak > budget(rc) && (it == before.end() || peak > it->second))
+                {
+                    ++stats.pressure_rejects;
+                    return false;
+                }
+            }
+        }
+
+        std::vector<std::unique_ptr<MachineInst>> insts;
+        insts.reserve(order.size());
+        for (size_t i = begin; i < end; ++i)
+            insts.push_back(std::move(mbb.begin()[i]));
+        for (unsigned pos = 0; pos < order.size(); ++pos)
+            mbb.begin()[begin + pos] = std::move(insts[order[pos]]);
+        return true;
+    }
+} // namespace
+
+//===----------------------------------------------------------------------===//
+//                             List Scheduling Implementation
+//===----------------------------------------------------------------------===//
+
+uint64_t estimate_block_cycles(const MachineBasicBlock &mbb, const TargetInstInfo &tii)
+{
+    std::unordered_map<unsigned, uint64_t> ready;
+    uint64_t cycle = 0;
+    uint64_t done = 0;
+    for (const auto &mi : mbb.instructions())
+    {
+        uint64_t issue = cycle;
+        for (unsigned reg : mi->uses())
+        {
+            if (auto it = ready.find(reg); it != ready.end())
+                issue = std::max(issue, it->second);
+        }
+        const uint64_t latency = tii.get_instruction_latency(mi->opcode());
+        for (unsigned reg : mi->defs())
+            ready[reg] = issue + latency;
+        cycle = issue + 1;
+        done = std::max(done, issue + latency);
+    }
+    return done;
+}
+
+ScheduleStats schedule_function(MachineFunction &mf, ScheduleMode mode)
+{
+    const TargetInstInfo &tii = *mf.parent()->target_inst_info();
+    const TargetRegisterInfo *tri = mf.parent()->target_reg_info();
+
+    std::unordered_map<unsigned, unsigned> use_counts;
+    if (mode == ScheduleMode::PreRA)
+    {
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            for (const auto &mi : mbb->instructions())
+            {
+                for (unsigned reg : mi->uses())
+                {
+                    if (MachineFunction::is_virtual_reg(reg))
+                        ++use_counts[reg];
+                }
+            }
+        }
+    }
+
+    ScheduleStats stats;
+    RegionScheduler scheduler(mf, mode, tii, tri, use_counts);
+    bool changed = false;
+    for (const auto &mbb : mf.basic_blocks())
+    {
+        stats.cycles_before += estimate_block_cycles(*mbb, tii);
+        size_t begin = 0;
+        const size_t size = mbb->instructions().size();
+        for (size_t i = 0; i <= size; ++i)
+        {
+            if (i < size && !is_barrier(*mbb->instructions()[i], tii))
+                continue;
+            if (i - begin > 1)
+            {
+                ++stats.regions;
+                if (scheduler.run(*mbb, begin, i, stats))
+                {
+                    ++stats.reordered;
+                    changed = true;
+                }
+            }
+            begin = i + 1;
+        }
+        stats.cycles_after += estimate_block_cycles(*mbb, tii);
+    }
+    if (changed)
+        mf.mark_global_positions_dirty();
+    return stats;
+}
@@ -0,0 +1,51 @@
+// scheduler.h - Latency-driven list scheduling within machine basic blocks
+#pragma once
+
+#include <cstdint>
+
+#include "machine.h"
+
+//===----------------------------------------------------------------------===//
+//                             List Scheduling
+//===----------------------------------------------------------------------===//
+//
+// Each block is cut into regions at calls, returns, branches and anything
+// with side effects, which stay where they are. Within a region the
+// scheduler builds a dependency DAG from defs()/uses(), with edges weighted
+// by get_instruction_latency, plus ordering edges between memory accesses
+// that may overlap. It then issues top-down for a single-issue in-order
+// core, taking among the instructions whose operands are ready the one
+// with the longest latency path to the end of the region, so loads and FP
+// operations start as early as their inputs allow.
+//
+// Before register allocation, once a register class runs out of registers
+// the scheduler prefers instructions that don't leave more of its values
+// live, and it keeps the original order whenever PressureTracker shows the
+// new one needing more registers than the class has and than before. After
+// allocation, anti- and output dependencies on the physical registers keep
+// the assignment valid instead.
+
+enum class ScheduleMode : uint8_t
+{
+    PreRA,
+    PostRA,
+};
+
+struct ScheduleStats
+{
+    unsigned regions = 0;
+    unsigned reordered = 0;
+    // PreRA schedules dropped because they needed more registers
+    unsigned pressure_rejects = 0;
+    // estimate_block_cycles summed over the function
+    uint64_t cycles_before = 0;
+    uint64_t cycles_after = 0;
+};
+
+// Reorders the instructions of every block of `mf`, with the target of its
+// MachineModule. Block successors aren't needed
+ScheduleStats schedule_function(MachineFunction &mf, ScheduleMode mode);
+
+// Cycles a single-issue in-order core takes through `mbb` as it stands,
+// stalling each instruction until the registers it reads are ready
+uint64_t estimate_block_cycles(const MachineBasicBlock &mbb, const TargetInstInfo &tii);
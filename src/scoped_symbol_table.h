@@ -0,0 +1,94 @@
+// scoped_symbol_table.h - Flat symbol table with block scoping
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "lexer.h"
+#include "mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             ScopedSymbolTable
+//===----------------------------------------------------------------------===//
+//
+// One table for all nested scopes, keyed by interned Symbol. Bindings are
+// appended to a single log; for every symbol `heads_` points at its innermost
+// binding, which links to the binding it shadows. Entering a scope records the
+// log size, leaving it unwinds the log back to that mark, so lookups are a
+// vector index and scopes cost no allocation once the vectors have grown.
+
+template <typename V>
+class ScopedSymbolTable
+{
+public:
+    ScopedSymbolTable() { marks_.push_back(0); }
+
+    void push_scope() { marks_.push_back(static_cast<uint32_t>(bindings_.size())); }
+
+    void pop_scope()
+    {
+        MO_ASSERT(marks_.size() > 1, "Cannot pop global scope");
+        const uint32_t mark = marks_.back();
+        marks_.pop_back();
+        while (bindings_.size() > mark)
+        {
+            const Binding &binding = bindings_.back();
+            heads_[binding.symbol] = binding.shadowed;
+            bindings_.pop_back();
+        }
+    }
+
+    // 0 for the global scope
+    size_t depth() const { return marks_.size() - 1; }
+
+    // Binds `symbol` in the innermost scope. Fails if it is already bound there.
+    bool insert(Symbol symbol, V value)
+    {
+        MO_ASSERT(symbol != NO_SYMBOL, "Cannot bind an empty symbol");
+        if (symbol >= heads_.size())
+        {
+            heads_.resize(symbol + 1, NONE);
+        }
+        if (find_local(symbol))
+        {
+            return false;
+        }
+        bindings_.push_back({symbol, heads_[symbol], std::move(value)});
+        heads_[symbol] = static_cast<uint32_t>(bindings_.size() - 1);
+        return true;
+    }
+
+    // Innermost binding of `symbol`, or nullptr
+    const V *find(Symbol symbol) const
+    {
+        if (symbol >= heads_.size() || heads_[symbol] == NONE)
+        {
+            return nullptr;
+        }
+        return &bindings_[heads_[symbol]].value;
+    }
+
+    // Binding of `symbol` made in the innermost scope itself, or nullptr
+    V *find_local(Symbol symbol)
+    {
+        if (symbol >= heads_.size() || heads_[symbol] == NONE || heads_[symbol] < marks_.back())
+        {
+            return nullptr;
+        }
+        return &bindings_[heads_[symbol]].value;
+    }
+
+private:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Binding
+    {
+        Symbol symbol;
+        uint32_t shadowed; // index of the binding this one hides, NONE if none
+        V value;
+    };
+
+    std::vector<uint32_t> heads_; // indexed by Symbol
+    std::vector<Binding> bindings_;
+    std::vector<uint32_t> marks_; // bindings_.size() on entry to each scope
+};
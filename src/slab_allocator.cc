@@ -0,0 +1,75 @@
+#include "slab_allocator.h"
+#include <algorithm>
+#include <new>
+
+#include "mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             SlabAllocator Implementation
+//===----------------------------------------------------------------------===//
+
+void *SlabAllocator::bump(size_t bytes)
+{
+    if (!cursor_ || static_cast<size_t>(end_ - cursor_) < bytes)
+    {
+        // Oversized objects get a slab of their own
+        const size_t slab = std::max(next_slab_, bytes);
+        next_slab_ = std::min(2 * next_slab_, SLAB_SIZE);
+        slabs_.push_back(std::make_unique<std::byte[]>(slab));
+        cursor_ = slabs_.back().get();
+        end_ = cursor_ + slab;
+    }
+    void *result = cursor_;
+    cursor_ += bytes;
+    return result;
+}
+
+void *SlabAllocator::allocate(size_t size)
+{
+    const size_t cls = size_class(size);
+    void *raw;
+    if (cls < NUM_SIZE_CLASSES && free_lists_[cls])
+    {
+        FreeNode *node = free_lists_[cls];
+        free_lists_[cls] = node->next;
+        raw = node;
+    }
+    else
+    {
+        raw = bump(cls * GRANULE);
+    }
+    live_objects_++;
+    auto *header = new (raw) Header{this};
+    return header + 1;
+}
+
+void *SlabAllocator::allocate_unowned(size_t size)
+{
+    auto *header = new (::operator new(sizeof(Header) + size)) Header{nullptr};
+    return header + 1;
+}
+
+void SlabAllocator::release(void *ptr, size_t size) noexcept
+{
+    if (!ptr)
+    {
+        return;
+    }
+    auto *header = static_cast<Header *>(ptr) - 1;
+    SlabAllocator *owner = header->owner;
+    if (!owner)
+    {
+        ::operator delete(header);
+        return;
+    }
+    MO_ASSERT(owner->live_objects_ > 0, "Releasing more objects than were allocated");
+    owner->live_objects_--;
+
+    // Larger objects stay put until the allocator dies
+    const size_t cls = size_class(size);
+    if (cls < NUM_SIZE_CLASSES)
+    {
+        auto *node = new (header) FreeNode{owner->free_lists_[cls]};
+        owner->free_lists_[cls] = node;
+    }
+}
@@ -0,0 +1,68 @@
+// slab_allocator.h - Per-function slab allocator for IR objects
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             SlabAllocator
+//===----------------------------------------------------------------------===//
+
+// Bump-allocates objects out of large slabs, so objects created one after the
+// other (the instructions of a block, the blocks of a function) sit next to
+// each other in memory. Released objects go to a free list for their size
+// class and are handed out again to the next object of that size. Slab memory
+// goes back to the heap only when the allocator is destroyed.
+//
+// Every object is preceded by a small header naming its allocator, so that
+// release() works from a class-specific operator delete, which only gets the
+// pointer and the size. Not thread-safe; a function is built by one thread.
+class SlabAllocator
+{
+public:
+    static constexpr size_t SLAB_SIZE = 32 * 1024;
+
+    // Slabs start at `first_slab` bytes and double up to SLAB_SIZE, so an
+    // allocator that only ever backs a few objects stays small
+    explicit SlabAllocator(size_t first_slab = SLAB_SIZE) : next_slab_(first_slab) {}
+    SlabAllocator(const SlabAllocator &) = delete;
+    SlabAllocator &operator=(const SlabAllocator &) = delete;
+
+    void *allocate(size_t size);
+    // Heap memory behind the same header, naming no allocator, for classes
+    // whose objects come from a slab only some of the time; release() hands
+    // it back to the heap
+    static void *allocate_unowned(size_t size);
+    static void release(void *ptr, size_t size) noexcept;
+
+    size_t num_slabs() const { return slabs_.size(); }
+    size_t num_live_objects() const { return live_objects_; }
+
+private:
+    struct alignas(std::max_align_t) Header
+    {
+        SlabAllocator *owner;
+    };
+
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    static constexpr size_t GRANULE = alignof(std::max_align_t);
+    // Objects up to NUM_SIZE_CLASSES * GRANULE bytes, header included, are recycled
+    static constexpr size_t NUM_SIZE_CLASSES = 64;
+
+    static size_t size_class(size_t size) { return (sizeof(Header) + size + GRANULE - 1) / GRANULE; }
+
+    void *bump(size_t bytes);
+
+    std::vector<std::unique_ptr<std::byte[]>> slabs_;
+    std::byte *cursor_ = nullptr;
+    std::byte *end_ = nullptr;
+    size_t next_slab_;
+    FreeNode *free_lists_[NUM_SIZE_CLASSES] = {};
+    size_t live_objects_ = 0;
+};
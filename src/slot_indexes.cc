@@ -0,0 +1,132 @@
+#include "slot_indexes.h"
+#include "machine.h"
+
+#include <algorithm>
+
+//===----------------------------------------------------------------------===//
+// Slot Indexes Implementation
+//===----------------------------------------------------------------------===//
+
+void SlotIndexes::ensure_numbered() const
+{
+    if (!valid_)
+        renumber();
+}
+
+void SlotIndexes::renumber() const
+{
+    MO_DEBUG("Renumbering slot indexes");
+    size_t next = 0;
+    unit_blocks_.clear();
+    for (const auto &bb : mf_.basic_blocks())
+    {
+        bb->slot_start_ = next;
+        for (const auto &mi : bb->instructions())
+        {
+            next += INSTR_DIST;
+            mi->slot_ = next;
+        }
+        next += INSTR_DIST;
+        bb->slot_end_ = next;
+        unit_blocks_.resize(next / INSTR_DIST, bb.get());
+    }
+    end_ = next;
+    valid_ = true;
+    ++generation_;
+}
+
+// Spreads the block's instructions evenly over its range. Fails when the
+// range has no room left for a gap after every instruction
+bool SlotIndexes::respace(MachineBasicBlock *bb) const
+{
+    const auto &insts = bb->instructions();
+    const size_t dist = (bb->slot_end_ - bb->slot_start_) / (insts.size() + 1);
+    if (dist < 2)
+        return false;
+
+    MO_DEBUG("Respacing slot indexes of %s", bb->label().c_str());
+    for (size_t i = 0; i < insts.size(); ++i)
+    {
+        insts[i]->slot_ = bb->slot_start_ + (i + 1) * dist;
+    }
+    ++generation_;
+    return true;
+}
+
+size_t SlotIndexes::index(const MachineInst *mi) const
+{
+    ensure_numbered();
+    return mi->slot_;
+}
+
+size_t SlotIndexes::next_index(const MachineInst *mi) const
+{
+    ensure_numbered();
+    const MachineBasicBlock *bb = mi->parent();
+    const auto &insts = bb->instructions();
+    auto it = std::upper_bound(insts.begin(), insts.end(), mi->slot_,
+                               [](size_t slot, const std::unique_ptr<MachineInst> &inst)
+                               { return slot < inst->slot_; });
+    if (it != insts.end())
+        return (*it)->slot_;
+
+    // Empty blocks in between hold no index of their own
+    for (size_t start = bb->slot_end_; start < end_;)
+    {
+        const MachineBasicBlock *next = unit_blocks_[start / INSTR_DIST];
+        if (!next->instructions().empty())
+            return next->instructions().front()->slot_;
+        start = next->slot_end_;
+    }
+    return end_;
+}
+
+size_t SlotIndexes::block_start(const MachineBasicBlock *bb) const
+{
+    ensure_numbered();
+    return bb->slot_start_;
+}
+
+size_t SlotIndexes::block_end(const MachineBasicBlock *bb) const
+{
+    ensure_numbered();
+    return bb->slot_end_;
+}
+
+MachineBasicBlock *SlotIndexes::block_at(size_t index) const
+{
+    ensure_numbered();
+    MO_ASSERT(index < end_, "Slot index %zu out of range", index);
+    return unit_blocks_[index / INSTR_DIST];
+}
+
+size_t SlotIndexes::end() const
+{
+    ensure_numbered();
+    return end_;
+}
+
+void SlotIndexes::block_created(MachineBasicBlock *bb)
+{
+    // New blocks go at the end of the layout, so they take fresh indexes
+    if (!valid_)
+        return;
+    bb->slot_start_ = end_;
+    end_ += INSTR_DIST;
+    bb->slot_end_ = end_;
+    unit_blocks_.push_back(bb);
+}
+
+void SlotIndexes::instruction_inserted(MachineBasicBlock *bb, size_t pos)
+{
+    if (!valid_)
+        return;
+
+    const auto &insts = bb->instructions();
+    const size_t lower = pos == 0 ? bb->slot_start_ : insts[pos - 1]->slot_;
+    const size_t upper = pos + 1 == insts.size() ? bb->slot_end_ : insts[pos + 1]->slot_;
+    if (upper - lower >= 2)
+        insts[pos]->slot_ = lower + (upper - lower) / 2;
+    else if (!respace(bb))
+        valid_ = false;
+}
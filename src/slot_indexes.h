@@ -0,0 +1,67 @@
+// slot_indexes.h - Instruction numbering with gaps
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class MachineBasicBlock;
+class MachineFunction;
+class MachineInst;
+
+//===----------------------------------------------------------------------===//
+//                             Slot Indexes
+//===----------------------------------------------------------------------===//
+//
+// Each block owns a range of indexes and each instruction one index inside
+// its block's range, increasing in layout order. Numbering leaves
+// INSTR_DIST between neighbours, so an instruction inserted later takes the
+// midpoint of the two around it and nothing else moves. When that gap is
+// used up the block is spread out again over its own range, and only when
+// the range itself is full does the whole function get renumbered.
+//
+// The indexes live in the instructions and blocks, so looking one up is a
+// field read. Block ranges start and end on multiples of INSTR_DIST, which
+// makes index -> block a table lookup.
+class SlotIndexes
+{
+public:
+    static constexpr size_t INSTR_DIST = 16;
+
+    explicit SlotIndexes(const MachineFunction &mf) : mf_(mf) {}
+
+    // Index of `mi`, numbering the function first if needed
+    size_t index(const MachineInst *mi) const;
+    // Index of the instruction after `mi` in layout order, or end() when
+    // `mi` is the last one
+    size_t next_index(const MachineInst *mi) const;
+    // The range [block_start, block_end) owned by `bb`
+    size_t block_start(const MachineBasicBlock *bb) const;
+    size_t block_end(const MachineBasicBlock *bb) const;
+    // The block whose range holds `index`
+    MachineBasicBlock *block_at(size_t index) const;
+    size_t end() const;
+
+    // Indexes handed out earlier stay put until a renumbering, block-local
+    // or whole; each one changes the generation
+    unsigned generation() const { return generation_; }
+    bool is_valid() const { return valid_; }
+
+    // Numbers every block and instruction afresh on the next lookup
+    void invalidate() { valid_ = false; }
+    void ensure_numbered() const;
+
+    // Updates from MachineFunction and MachineBasicBlock
+    void block_created(MachineBasicBlock *bb);
+    void instruction_inserted(MachineBasicBlock *bb, size_t pos);
+
+private:
+    void renumber() const;
+    bool respace(MachineBasicBlock *bb) const;
+
+    const MachineFunction &mf_;
+    mutable bool valid_ = false;
+    mutable unsigned generation_ = 0;
+    mutable size_t end_ = 0;
+    // Block of every INSTR_DIST-sized unit of the index space
+    mutable std::vector<MachineBasicBlock *> unit_blocks_;
+};
@@ -0,0 +1,145 @@
+// small_vector.h - Vector with inline storage for its first few elements
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+//===----------------------------------------------------------------------===//
+//                             SmallVector
+//===----------------------------------------------------------------------===//
+
+// Keeps up to N elements inside the object itself and moves to the heap only
+// past that, so a container that is almost always short costs no allocation
+// of its own. Elements are moved with memcpy and never destroyed, which is
+// why only trivially copyable types are allowed.
+template <typename T, size_t N>
+class SmallVector
+{
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>,
+                  "SmallVector relocates elements with memcpy");
+
+public:
+    using value_type = T;
+    using iterator = T *;
+    using const_iterator = const T *;
+
+    SmallVector() = default;
+    SmallVector(std::initializer_list<T> init) { assign(init.begin(), init.end()); }
+    SmallVector(std::span<const T> init) { assign(init.data(), init.data() + init.size()); }
+    SmallVector(const SmallVector &other) { assign(other.begin(), other.end()); }
+    SmallVector &operator=(const SmallVector &other)
+    {
+        if (this != &other)
+        {
+            size_ = 0;
+            assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+    ~SmallVector()
+    {
+        if (!is_inline())
+            ::operator delete(data_);
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    size_t capacity() const { return capacity_; }
+    // True while the elements still live in the object
+    bool is_inline() const { return data_ == inline_data(); }
+
+    T *data() { return data_; }
+    const T *data() const { return data_; }
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+
+    T &operator[](size_t index) { return data_[index]; }
+    const T &operator[](size_t index) const { return data_[index]; }
+    T &at(size_t index)
+    {
+        if (index >= size_)
+            throw std::out_of_range("SmallVector index out of range");
+        return data_[index];
+    }
+    const T &at(size_t index) const { return const_cast<SmallVector *>(this)->at(index); }
+    T &front() { return data_[0]; }
+    T &back() { return data_[size_ - 1]; }
+    const T &front() const { return data_[0]; }
+    const T &back() const { return data_[size_ - 1]; }
+
+    operator std::span<const T>() const { return {data_, size_}; }
+
+    void push_back(const T &value)
+    {
+        if (size_ == capacity_)
+        {
+            // `value` may point into the buffer about to be replaced
+            T copy = value;
+            grow(size_ + 1);
+            data_[size_++] = copy;
+            return;
+        }
+        data_[size_++] = value;
+    }
+
+    iterator insert(const_iterator pos, const T &value)
+    {
+        const size_t index = pos - data_;
+        T copy = value;
+        if (size_ == capacity_)
+            grow(size_ + 1);
+        std::memmove(data_ + index + 1, data_ + index, (size_ - index) * sizeof(T));
+        data_[index] = copy;
+        ++size_;
+        return data_ + index;
+    }
+
+    iterator erase(const_iterator pos)
+    {
+        const size_t index = pos - data_;
+        std::memmove(data_ + index, data_ + index + 1, (size_ - index - 1) * sizeof(T));
+        --size_;
+        return data_ + index;
+    }
+
+    void clear() { size_ = 0; }
+
+private:
+    T *inline_data() { return reinterpret_cast<T *>(inline_); }
+    const T *inline_data() const { return reinterpret_cast<const T *>(inline_); }
+
+    void assign(const T *first, const T *last)
+    {
+        const size_t count = last - first;
+        if (count > capacity_)
+            grow(count);
+        if (count)
+            std::memcpy(data_, first, count * sizeof(T));
+        size_ = count;
+    }
+
+    void grow(size_t min_capacity)
+    {
+        const size_t capacity = std::max<size_t>(min_capacity, 2 * capacity_);
+        T *data = static_cast<T *>(::operator new(capacity * sizeof(T)));
+        if (size_)
+            std::memcpy(data, data_, size_ * sizeof(T));
+        if (!is_inline())
+            ::operator delete(data_);
+        data_ = data;
+        capacity_ = static_cast<unsigned>(capacity);
+    }
+
+    T *data_ = inline_data();
+    unsigned size_ = 0;
+    unsigned capacity_ = N;
+    alignas(T) std::byte inline_[N * sizeof(T)];
+};
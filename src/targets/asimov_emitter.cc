@@ -0,0 +1,562 @@
+#include "asimov_emitter.h"
+
+#include "../ir.h"
+#include "asimov_target.h"
+#include "global_data.h"
+#include <stdexcept>
+#include <unordered_map>
+
+namespace ASIMOV
+{
+    namespace
+    {
+        class EmitError : public std::runtime_error
+        {
+        public:
+            using std::runtime_error::runtime_error;
+        };
+
+        constexpr unsigned TEMP_REG = R5;
+
+        bool fits16(int64_t value) { return value >= 0 && value <= 0xFFFF; }
+
+        enum class Form : uint8_t
+        {
+            Plain,      // encoded as it is
+            Skip,       // a copy of a register onto itself
+            Copy,       // MOVW R5, 0; ADD rd, rs, R5
+            LoadImm,    // MOVW or MOVD rd, imm
+            LoadSym,    // MOVW or MOVD rd, address of symbol
+            ImmOperand, // LI R5, imm; op rd, rs, R5
+            FarMemory,  // LI R5, offset; ADD R5, base, R5; op r, [R5 + 0]
+            Jump,       // JMP symbol, for JMP and CALL
+            Branch,     // JZ/JNZ r, block or JNZ/JZ r, +8; JMP block
+            Halt,       // RET
+        };
+
+        struct Item
+        {
+            const MachineInst *mi;
+            Form form = Form::Plain;
+            bool long_form = false;
+            uint32_t symbol = 0;   // target of LoadSym, Jump and Branch
+            uint32_t function = 0; // symbol of the enclosing function
+            int64_t imm = 0;       // the constant LoadImm, ImmOperand and FarMemory load
+            uint32_t offset = 0;   // image offset, set by layout
+        };
+
+        // A symbol whose offset is that of items_[item]
+        struct Mark
+        {
+            size_t item;
+            uint32_t symbol;
+        };
+
+        class Emitter
+        {
+        public:
+            Emitter(const MachineModule &mm, ASIMOVImage &image, const ASIMOVEmitOptions &options)
+                : mm_(mm), tii_(*mm.target_inst_info()), image_(image), options_(options)
+            {
+            }
+
+            void run()
+            {
+                image_ = ASIMOVImage();
+                image_.base_address = options_.base_address;
+                collect();
+                relax();
+                encode();
+                emit_data();
+                set_entry();
+            }
+
+        private:
+            const MachineModule &mm_;
+            const TargetInstInfo &tii_;
+            ASIMOVImage &image_;
+            const ASIMOVEmitOptions &options_;
+
+            std::vector<Item> items_;
+            std::vector<Mark> marks_;
+            std::unordered_map<std::string, uint32_t> functions_;
+            std::unordered_map<std::string, uint32_t> undefined_;
+            std::unordered_map<const MachineBasicBlock *, uint32_t> blocks_;
+            std::unordered_map<const GlobalVariable *, uint32_t> global_symbols_;
+            std::vector<const GlobalVariable *> globals_;
+            std::vector<uint32_t> global_offsets_;
+            uint32_t text_bytes_ = 0;
+            uint32_t image_bytes_ = 0;
+
+            uint32_t add_symbol(std::string name, ASIMOVSymbolKind kind)
+            {
+                image_.symbols.push_back({std::move(name), 0, kind});
+                return static_cast<uint32_t>(image_.symbols.size() - 1);
+            }
+
+            //===---------------------- Collection -----------------------===//
+
+            void collect()
+            {
+                const auto &functions = mm_.functions();
+                std::vector<uint32_t> function_symbols;
+                for (size_t i = 0; i < functions.size(); ++i)
+                {
+                    const Function *f = functions[i]->ir_function();
+                    std::string name = f ? f->name() : "function" + std::to_string(i);
+                    const uint32_t symbol = add_symbol(name, ASIMOVSymbolKind::Function);
+                    functions_.emplace(std::move(name), symbol);
+                    function_symbols.push_back(symbol);
+                }
+                if (const Module *module = mm_.ir_module())
+                {
+                    for (const GlobalVariable *gv : module->global_variables())
+                        add_global(gv);
+                }
+
+                for (size_t i = 0; i < functions.size(); ++i)
+                {
+                    const std::string function_name = image_.symbols[function_symbols[i]].name;
+                    for (const auto &mbb : functions[i]->basic_blocks())
+                    {
+                        const std::string label = mbb->label().empty() ? "bb" + std::to_string(mbb->index()) : mbb->label();
+                        blocks_.emplace(mbb.get(), add_symbol(function_name + "." + label, ASIMOVSymbolKind::Block));
+                    }
+                }
+
+                for (size_t i = 0; i < functions.size(); ++i)
+                {
+                    marks_.push_back({items_.size(), function_symbols[i]});
+                    for (const auto &mbb : functions[i]->basic_blocks())
+                    {
+                        marks_.push_back({items_.size(), blocks_.at(mbb.get())});
+                        for (const auto &mi : mbb->instructions())
+                            items_.push_back(classify(*mi, function_symbols[i]));
+                    }
+                }
+            }
+
+            // Globals named by an initializer get laid out too
+            uint32_t add_global(const GlobalVariable *gv)
+            {
+                auto it = global_symbols_.find(gv);
+                if (it != global_symbols_.end())
+                    return it->second;
+                std::string name = gv->name().empty() ? "global" + std::to_string(globals_.size()) : gv->name();
+                const uint32_t symbol = add_symbol(std::move(name), ASIMOVSymbolKind::Object);
+                global_symbols_.emplace(gv, symbol);
+                globals_.push_back(gv);
+                std::vector<const GlobalVariable *> referenced;
+                referenced_globals(gv->initializer(), referenced);
+                for (const GlobalVariable *other : referenced)
+                    add_global(other);
+                return symbol;
+            }
+
+            uint32_t named_symbol(const std::string &name)
+            {
+                auto it = functions_.find(name);
+                if (it != functions_.end())
+                    return it->second;
+                auto [undefined, inserted] = undefined_.emplace(name, 0);
+                if (inserted)
+                    undefined->second = add_symbol(name, ASIMOVSymbolKind::Undefined);
+                return undefined->second;
+            }
+
+            // Symbol for an address operand, or false if it is not one
+            bool symbol_operand(const MOperand &op, uint32_t &symbol)
+            {
+                if (op.is_global())
+                    symbol = add_global(op.global());
+                else if (op.is_external_sym())
+                    symbol = named_symbol(op.external_sym());
+                else if (op.is_label())
+                    symbol = named_symbol(op.label());
+                else if (op.is_basic_block())
+                {
+                    auto it = blocks_.find(op.basic_block());
+                    if (it == blocks_.end())
+                        throw EmitError("branch to a block outside the module");
+                    symbol = it->second;
+                }
+                else
+                    return false;
+                return true;
+            }
+
+            std::string describe(const MachineInst &mi) const
+            {
+                return std::string("`") + tii_.opcode_name(mi.opcode()) + "`";
+            }
+
+            Item classify(const MachineInst &mi, uint32_t function)
+            {
+                for (const auto &op : mi.operands())
+                {
+                    if (op.is_frame_index() || op.is_mem_fi())
+                        throw EmitError(describe(mi) + " still has a frame index");
+                    const bool virtual_reg = (op.is_reg() && MachineFunction::is_virtual_reg(op.reg())) ||
+                                             (op.is_mem_ri() && MachineFunction::is_virtual_reg(op.mem_ri().base_reg));
+                    if (virtual_reg)
+                        throw EmitError(describe(mi) + " still uses a virtual register");
+                }
+
+                Item item{&mi};
+                item.function = function;
+                const auto &ops = mi.operands();
+                auto expect = [&](size_t count)
+                {
+                    if (ops.size() != count)
+                        throw EmitError(describe(mi) + " needs " + std::to_string(count) + " operands");
+                };
+                auto not_temp = [&](const MOperand &op)
+                {
+                    if (op.is_reg() && op.reg() == TEMP_REG)
+                        throw EmitError(describe(mi) + " reads R5, which the emitter needs as a temporary");
+                };
+
+                switch (mi.opcode())
+                {
+                case ADD:
+                case SUB:
+                case MUL:
+                case DIV:
+                case CMP:
+                case FADD:
+                case FSUB:
+                case FMUL:
+                case FDIV:
+                    expect(3);
+                    if (ops[1].is_imm() || ops[2].is_imm())
+                    {
+                        if ((ops[1].is_imm() && ops[2].is_imm()) || (mi.opcode() >= FADD && mi.opcode() <= FDIV))
+                            throw EmitError(describe(mi) + " has an immediate operand it cannot take");
+                        not_temp(ops[1]);
+                        not_temp(ops[2]);
+                        item.form = Form::ImmOperand;
+                        item.imm = ops[1].is_imm() ? ops[1].imm() : ops[2].imm();
+                    }
+                    break;
+                case MOVW:
+                case MOVD:
+                case LI:
+                    expect(2);
+                    if (ops[1].is_reg())
+                    {
+                        not_temp(ops[1]);
+                        item.form = ops[0].reg() == ops[1].reg() ? Form::Skip : Form::Copy;
+                    }
+                    else if (ops[1].is_imm())
+                    {
+                        item.form = Form::LoadImm;
+                        item.imm = ops[1].imm();
+                        if (item.imm < INT32_MIN || item.imm > UINT32_MAX)
+                            throw EmitError(describe(mi) + " immediate does not fit 32 bits");
+                    }
+                    else if (symbol_operand(ops[1], item.symbol))
+                        item.form = Form::LoadSym;
+                    else
+                        throw EmitError(describe(mi) + " has an operand it cannot take");
+                    break;
+                case LOAD:
+                case STORE:
+                    expect(2);
+                    if (!ops[1].is_mem_ri())
+                        throw EmitError(describe(mi) + " needs a [reg + offset] operand");
+                    if (ops[1].mem_ri().offset < 0 || ops[1].mem_ri().offset > 0xFF)
+                    {
+                        not_temp(MOperand::create_reg(ops[1].mem_ri().base_reg));
+                        item.form = Form::FarMemory;
+                        item.imm = ops[1].mem_ri().offset;
+                    }
+                    break;
+                case JMP:
+                case CALL:
+                    expect(1);
+                    if (!symbol_operand(ops[0], item.symbol))
+                        throw EmitError(describe(mi) + " through a register is not supported");
+                    item.form = Form::Jump;
+                    break;
+                case JZ:
+                case JNZ:
+                    expect(2);
+                    if (!ops[0].is_reg() || !ops[1].is_basic_block())
+                        throw EmitError(describe(mi) + " needs a register and a block");
+                    symbol_operand(ops[1], item.symbol);
+                    item.form = Form::Branch;
+                    break;
+                case RET:
+                    item.form = Form::Halt;
+                    break;
+                case NOP:
+                case HALT:
+                    break;
+                default:
+                    throw EmitError("cannot encode " + describe(mi));
+                }
+                return item;
+            }
+
+            //===----------------------- Layout ---------------------------===//
+
+            static unsigned load_words(int64_t imm) { return fits16(imm) ? 1 : 2; }
+
+            static unsigned words(const Item &item)
+            {
+                switch (item.form)
+                {
+                case Form::Skip:
+                    return 0;
+                case Form::Copy:
+                    return 2;
+                case Form::LoadImm:
+                    return load_words(item.imm);
+                case Form::ImmOperand:
+                    return load_words(item.imm) + 1;
+                case Form::FarMemory:
+                    return load_words(item.imm) + 2;
+                case Form::LoadSym:
+                case Form::Branch:
+                    return item.long_form ? 2 : 1;
+                default:
+                    return 1;
+                }
+            }
+
+            void layout()
+            {
+                uint32_t offset = 0;
+                for (auto &item : items_)
+                {
+                    item.offset = offset;
+                    offset += words(item) * 4;
+                }
+                text_bytes_ = offset;
+                for (const Mark &mark : marks_)
+                {
+                    image_.symbols[mark.symbol].offset = mark.item < items_.size() ? items_[mark.item].offset : text_bytes_;
+                }
+
+                // Data follows the text; it moves only forward as the text grows
+                uint64_t cursor = text_bytes_;
+                global_offsets_.clear();
+                for (const GlobalVariable *gv : globals_)
+                {
+                    const Type *type = global_value_type(gv);
+                    const uint64_t align = std::max<uint64_t>(type->alignment(), 1);
+                    cursor = (cursor + align - 1) / align * align;
+                    global_offsets_.push_back(static_cast<uint32_t>(cursor));
+                    image_.symbols[global_symbols_.at(gv)].offset = static_cast<uint32_t>(cursor);
+                    cursor += type->size();
+                }
+                if (options_.base_address + cursor > (uint64_t(1) << 32))
+                    throw EmitError("the image does not fit above the base address");
+                image_bytes_ = static_cast<uint32_t>(cursor);
+            }
+
+            bool defined(uint32_t symbol) const { return image_.symbols[symbol].kind != ASIMOVSymbolKind::Undefined; }
+            int64_t address(uint32_t symbol) const { return int64_t(options_.base_address) + image_.symbols[symbol].offset; }
+
+            // Everything starts short; a form only ever grows, which only moves
+            // later addresses up, so this settles after a few rounds
+            void relax()
+            {
+                bool changed = true;
+                while (changed)
+                {
+                    layout();
+                    changed = false;
+                    for (auto &item : items_)
+                    {
+                        if (item.long_form || (item.form != Form::LoadSym && item.form != Form::Branch))
+                            continue;
+                        if (!defined(item.symbol) || !fits16(address(item.symbol)))
+                        {
+                            item.long_form = true;
+                            changed = true;
+                        }
+                    }
+                }
+            }
+
+            //===----------------------- Encoding -------------------------===//
+
+            uint32_t encode(unsigned opcode, const MachineInst::OperandList &ops) const
+            {
+                return tii_.get_binary_encoding(MachineInst(opcode, ops));
+            }
+
+            void reloc(ASIMOVRelocKind kind, uint32_t symbol, int64_t addend = 0)
+            {
+                image_.relocations.push_back({static_cast<uint32_t>(image_.text.size() * 4), symbol,
+                                              static_cast<int32_t>(addend), kind});
+            }
+
+            // get_binary_encoding covers single words only, so MOVD is spelled out
+            void load(unsigned rd, int64_t value, bool long_form)
+            {
+                if (!long_form)
+                {
+                    image_.text.push_back(encode(MOVW, {MOperand::create_reg(rd, true), MOperand::create_imm(value)}));
+                    return;
+                }
+                image_.text.push_back((uint32_t(MOVD) << 24) | (rd << 16));
+                image_.text.push_back(static_cast<uint32_t>(value));
+            }
+
+            void jump(uint32_t symbol, const MachineInst &mi)
+            {
+                const int64_t target = defined(symbol) ? address(symbol) : 0;
+                if (target > 0xFFFFFF)
+                    throw EmitError(describe(mi) + " target is beyond the 24-bit range of JMP");
+                reloc(ASIMOVRelocKind::Abs24, symbol);
+                image_.text.push_back(encode(JMP, {MOperand::create_imm(target)}));
+            }
+
+            void encode(const Item &item)
+            {
+                const MachineInst &mi = *item.mi;
+                const auto &ops = mi.operands();
+                const unsigned opcode = mi.opcode() == CMP ? unsigned(SUB) : mi.opcode();
+                switch (item.form)
+                {
+                case Form::Plain:
+                    image_.text.push_back(encode(opcode, ops));
+                    break;
+                case Form::Skip:
+                    break;
+                case Form::Copy:
+                    load(TEMP_REG, 0, false);
+                    image_.text.push_back(encode(ADD, {ops[0], ops[1], MOperand::create_reg(TEMP_REG)}));
+                    break;
+                case Form::LoadImm:
+                    load(ops[0].reg(), item.imm, !fits16(item.imm));
+                    break;
+                case Form::LoadSym:
+                {
+                    const int64_t target = defined(item.symbol) ? address(item.symbol) : 0;
+                    if (item.long_form)
+                        image_.text.push_back((uint32_t(MOVD) << 24) | (ops[0].reg() << 16));
+                    reloc(item.long_form ? ASIMOVRelocKind::Abs32 : ASIMOVRelocKind::Abs16, item.symbol);
+                    if (item.long_form)
+                        image_.text.push_back(static_cast<uint32_t>(target));
+                    else
+                        load(ops[0].reg(), target, false);
+                    break;
+                }
+                case Form::ImmOperand:
+                {
+                    load(TEMP_REG, item.imm, !fits16(item.imm));
+                    const MOperand temp = MOperand::create_reg(TEMP_REG);
+                    image_.text.push_back(encode(opcode, {ops[0], ops[1].is_imm() ? temp : ops[1],
+                                                          ops[2].is_imm() ? temp : ops[2]}));
+                    break;
+                }
+                case Form::FarMemory:
+                {
+                    const MOperand::MEMri mem = ops[1].mem_ri();
+                    load(TEMP_REG, item.imm, !fits16(item.imm));
+                    image_.text.push_back(encode(ADD, {MOperand::create_reg(TEMP_REG, true),
+                                                       MOperand::create_reg(mem.base_reg),
+                                                       MOperand::create_reg(TEMP_REG)}));
+                    image_.text.push_back(encode(opcode, {ops[0], MOperand::create_mem_ri(TEMP_REG, 0)}));
+                    break;
+                }
+                case Form::Jump:
+                    jump(item.symbol, mi);
+                    break;
+                case Form::Branch:
+                {
+                    const uint32_t function_offset = image_.symbols[item.function].offset;
+                    if (!item.long_form)
+                    {
+                        reloc(ASIMOVRelocKind::Abs16, item.symbol);
+                        image_.text.push_back(encode(opcode, {ops[0], MOperand::create_imm(address(item.symbol))}));
+                        break;
+                    }
+                    // The inverted branch skips the JMP, so it has to reach the next item
+                    const int64_t skip = int64_t(options_.base_address) + item.offset + 8;
+                    if (!fits16(skip))
+                        throw EmitError(describe(mi) + " is beyond the 16-bit range of conditional branches");
+                    reloc(ASIMOVRelocKind::Abs16, item.function, item.offset + 8 - function_offset);
+                    image_.text.push_back(encode(opcode == JZ ? JNZ : JZ, {ops[0], MOperand::create_imm(skip)}));
+                    jump(item.symbol, mi);
+                    break;
+                }
+                case Form::Halt:
+                    image_.text.push_back(encode(HALT, {}));
+                    break;
+                }
+            }
+
+            void encode()
+            {
+                image_.text.reserve(text_bytes_ / 4);
+                for (const auto &item : items_)
+                    encode(item);
+                MO_ASSERT(image_.text.size() * 4 == text_bytes_, "Encoded text does not match its layout");
+            }
+
+            //===------------------------- Data ---------------------------===//
+
+            void write_global(size_t index)
+            {
+                const GlobalVariable *gv = globals_[index];
+                const uint32_t at = global_offsets_[index] - text_bytes_;
+                const std::span<uint8_t> bytes(image_.data.data() + at, global_value_type(gv)->size());
+                std::vector<GlobalAddressField> fields;
+                std::string err;
+                if (!write_initializer(gv->initializer(), bytes, true, fields, &err))
+                    throw EmitError(err);
+                // Addresses are 32 bits, in the first word of the field
+                for (const auto &field : fields)
+                {
+                    const uint32_t offset = image_.data_offset() + at + static_cast<uint32_t>(field.offset);
+                    if (offset % 4 != 0 || field.offset + 4 > bytes.size())
+                        throw EmitError("address of `" + field.global->name() + "` is not in a word of `" + gv->name() + "`");
+                    const uint32_t symbol = global_symbols_.at(field.global);
+                    const uint32_t address = static_cast<uint32_t>(this->address(symbol));
+                    image_.relocations.push_back({offset, symbol, 0, ASIMOVRelocKind::Abs32});
+                    for (size_t i = 0; i < 4; ++i)
+                        bytes[field.offset + i] = static_cast<uint8_t>(address >> (24 - 8 * i));
+                }
+            }
+
+            void emit_data()
+            {
+                image_.data.assign(image_bytes_ - text_bytes_, 0);
+                for (size_t i = 0; i < globals_.size(); ++i)
+                {
+                    if (globals_[i]->initializer())
+                        write_global(i);
+                }
+            }
+
+            void set_entry()
+            {
+                if (options_.entry.empty())
+                    return;
+                auto it = functions_.find(options_.entry);
+                if (it == functions_.end())
+                    throw EmitError("entry function `" + options_.entry + "` is not in the module");
+                image_.entry = image_.symbols[it->second].offset;
+            }
+        };
+    } // namespace
+
+    bool emit_image(const MachineModule &mm, ASIMOVImage &image, const ASIMOVEmitOptions &options, std::string *err_msg)
+    {
+        try
+        {
+            Emitter(mm, image, options).run();
+            return true;
+        }
+        catch (const EmitError &e)
+        {
+            if (err_msg)
+                *err_msg = e.what();
+            return false;
+        }
+    }
+} // namespace ASIMOV
@@ -0,0 +1,30 @@
+// asimov_emitter.h - Lays out an allocated ASIMOV module into an image
+#pragma once
+
+#include "../machine.h"
+#include "asimov_image.h"
+#include <string>
+
+namespace ASIMOV
+{
+    struct ASIMOVEmitOptions
+    {
+        uint32_t base_address = 0; // addresses in the emitted words assume this load address
+        std::string entry;         // entry function; the first function when empty
+    };
+
+    // Functions are laid out in module order with their blocks in order, and
+    // the globals of the IR module (plus any other global an instruction
+    // names) follow in the data section. Branches and address loads start in
+    // their short form and are widened until every target fits:
+    //   LI rd, sym     MOVW (16-bit address) or MOVD with a data word
+    //   JZ/JNZ r, bb   one branch, or the inverted branch around a JMP
+    // The ISA has no register moves, immediate ALU forms or indirect jumps,
+    // so copies, immediate operands and out-of-range offsets go through the
+    // temporary R5, CALL becomes a JMP to the callee and RET halts.
+    //
+    // Expects registers to be allocated and frame indices resolved. Returns
+    // false with `err_msg` set when something cannot be encoded.
+    bool emit_image(const MachineModule &mm, ASIMOVImage &image, const ASIMOVEmitOptions &options = {},
+                    std::string *err_msg = nullptr);
+} // namespace ASIMOV
@@ -0,0 +1,272 @@
+#include "asimov_image.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ASIMOV_IMAGE_MMAP 1
+#endif
+
+namespace ASIMOV
+{
+    namespace
+    {
+        // magic, version and flags, base, entry, then five counts
+        constexpr size_t HEADER_BYTES = 36;
+        constexpr size_t SYMBOL_BYTES = 12;
+        constexpr size_t RELOCATION_BYTES = 16;
+
+        void put32(std::vector<uint8_t> &out, uint32_t value)
+        {
+            out.push_back(static_cast<uint8_t>(value >> 24));
+            out.push_back(static_cast<uint8_t>(value >> 16));
+            out.push_back(static_cast<uint8_t>(value >> 8));
+            out.push_back(static_cast<uint8_t>(value));
+        }
+
+        uint32_t get32(const uint8_t *p)
+        {
+            return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+        }
+
+        bool fail(std::string *err_msg, std::string message)
+        {
+            if (err_msg)
+                *err_msg = std::move(message);
+            return false;
+        }
+
+        uint32_t field_mask(ASIMOVRelocKind kind)
+        {
+            switch (kind)
+            {
+            case ASIMOVRelocKind::Abs16:
+                return 0xFFFF;
+            case ASIMOVRelocKind::Abs24:
+                return 0xFFFFFF;
+            case ASIMOVRelocKind::Abs32:
+                break;
+            }
+            return 0xFFFFFFFF;
+        }
+    } // namespace
+
+    const ASIMOVSymbol *ASIMOVImage::find_symbol(const std::string &name) const
+    {
+        for (const auto &symbol : symbols)
+        {
+            if (symbol.name == name)
+                return &symbol;
+        }
+        return nullptr;
+    }
+
+    bool ASIMOVImage::link(uint32_t load_address, std::vector<uint32_t> &words, std::string *err_msg,
+                           const std::unordered_map<std::string, uint32_t> *externals) const
+    {
+        if (uint64_t(load_address) + size() > (uint64_t(1) << 32))
+            return fail(err_msg, "image does not fit above address " + std::to_string(load_address));
+
+        words.assign((size() + 3) / 4, 0);
+        std::copy(text.begin(), text.end(), words.begin());
+        for (size_t i = 0; i < data.size(); ++i)
+        {
+            words[text.size() + i / 4] |= uint32_t(data[i]) << (24 - 8 * (i % 4));
+        }
+
+        for (const auto &reloc : relocations)
+        {
+            const ASIMOVSymbol &symbol = symbols[reloc.symbol];
+            int64_t value;
+            if (symbol.kind == ASIMOVSymbolKind::Undefined)
+            {
+                if (!externals || !externals->count(symbol.name))
+                    return fail(err_msg, "undefined symbol `" + symbol.name + "`");
+                value = int64_t(externals->at(symbol.name)) + reloc.addend;
+            }
+            else
+            {
+                value = int64_t(load_address) + symbol.offset + reloc.addend;
+            }
+
+            const uint32_t mask = field_mask(reloc.kind);
+            if (value < 0 || uint64_t(value) > mask)
+                return fail(err_msg, "address of `" + symbol.name + "` does not fit the field at offset " +
+                                         std::to_string(reloc.offset));
+            uint32_t &word = words[reloc.offset / 4];
+            word = (word & ~mask) | static_cast<uint32_t>(value);
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> ASIMOVImage::serialize() const
+    {
+        std::string strtab;
+        std::vector<uint32_t> names;
+        names.reserve(symbols.size());
+        for (const auto &symbol : symbols)
+        {
+            names.push_back(static_cast<uint32_t>(strtab.size()));
+            strtab += symbol.name;
+            strtab += '\0';
+        }
+
+        std::vector<uint8_t> out;
+        out.reserve(HEADER_BYTES + size() + 3 + symbols.size() * SYMBOL_BYTES +
+                    relocations.size() * RELOCATION_BYTES + strtab.size());
+        put32(out, MAGIC);
+        put32(out, uint32_t(VERSION) << 16);
+        put32(out, base_address);
+        put32(out, entry);
+        put32(out, static_cast<uint32_t>(text.size()));
+        put32(out, static_cast<uint32_t>(data.size()));
+        put32(out, static_cast<uint32_t>(symbols.size()));
+        put32(out, static_cast<uint32_t>(relocations.size()));
+        put32(out, static_cast<uint32_t>(strtab.size()));
+
+        for (uint32_t word : text)
+        {
+            put32(out, word);
+        }
+        out.insert(out.end(), data.begin(), data.end());
+        out.resize(out.size() + (4 - data.size() % 4) % 4, 0);
+
+        for (size_t i = 0; i < symbols.size(); ++i)
+        {
+            put32(out, names[i]);
+            put32(out, symbols[i].offset);
+            put32(out, uint32_t(symbols[i].kind) << 24);
+        }
+        for (const auto &reloc : relocations)
+        {
+            put32(out, reloc.offset);
+            put32(out, reloc.symbol);
+            put32(out, static_cast<uint32_t>(reloc.addend));
+            put32(out, uint32_t(reloc.kind) << 24);
+        }
+        out.insert(out.end(), strtab.begin(), strtab.end());
+        return out;
+    }
+
+    bool ASIMOVImage::parse(std::span<const uint8_t> bytes, ASIMOVImage &image, std::string *err_msg)
+    {
+        if (bytes.size() < HEADER_BYTES || get32(bytes.data()) != MAGIC)
+            return fail(err_msg, "not an ASIMOV image");
+        const uint8_t *p = bytes.data();
+        if ((get32(p + 4) >> 16) != VERSION)
+            return fail(err_msg, "unsupported ASIMOV image version " + std::to_string(get32(p + 4) >> 16));
+
+        const uint64_t text_words = get32(p + 16), data_bytes = get32(p + 20);
+        const uint64_t num_symbols = get32(p + 24), num_relocations = get32(p + 28), strtab_bytes = get32(p + 32);
+        const uint64_t data_padded = (data_bytes + 3) / 4 * 4;
+        const uint64_t total = HEADER_BYTES + text_words * 4 + data_padded + num_symbols * SYMBOL_BYTES +
+                               num_relocations * RELOCATION_BYTES + strtab_bytes;
+        if (total != bytes.size())
+            return fail(err_msg, "ASIMOV image is " + std::to_string(bytes.size()) + " bytes, header says " +
+                                     std::to_string(total));
+        const uint64_t image_size = text_words * 4 + data_bytes;
+        if (image_size > (uint64_t(1) << 32))
+            return fail(err_msg, "ASIMOV image does not fit the address space");
+
+        ASIMOVImage result;
+        result.base_address = get32(p + 8);
+        result.entry = get32(p + 12);
+        if (result.entry % 4 != 0 || (result.entry && result.entry >= text_words * 4))
+            return fail(err_msg, "entry " + std::to_string(result.entry) + " is not in the text");
+
+        p += HEADER_BYTES;
+        result.text.resize(text_words);
+        for (auto &word : result.text)
+        {
+            word = get32(p);
+            p += 4;
+        }
+        result.data.assign(p, p + data_bytes);
+        p += data_padded;
+
+        const uint8_t *symbol_table = p;
+        const char *strtab = reinterpret_cast<const char *>(p + num_symbols * SYMBOL_BYTES +
+                                                            num_relocations * RELOCATION_BYTES);
+        result.symbols.resize(num_symbols);
+        for (auto &symbol : result.symbols)
+        {
+            const uint32_t name = get32(p), kind = p[8];
+            if (name >= strtab_bytes || !std::memchr(strtab + name, '\0', strtab_bytes - name))
+                return fail(err_msg, "symbol name at " + std::to_string(name) + " is outside the string table");
+            if (kind > uint32_t(ASIMOVSymbolKind::Undefined))
+                return fail(err_msg, "unknown symbol kind " + std::to_string(kind));
+            symbol.name = strtab + name;
+            symbol.offset = get32(p + 4);
+            symbol.kind = static_cast<ASIMOVSymbolKind>(kind);
+            if (symbol.kind != ASIMOVSymbolKind::Undefined && symbol.offset > image_size)
+                return fail(err_msg, "symbol `" + symbol.name + "` is outside the image");
+            p += SYMBOL_BYTES;
+        }
+        p = symbol_table + num_symbols * SYMBOL_BYTES;
+
+        result.relocations.resize(num_relocations);
+        for (auto &reloc : result.relocations)
+        {
+            reloc.offset = get32(p);
+            reloc.symbol = get32(p + 4);
+            reloc.addend = static_cast<int32_t>(get32(p + 8));
+            const uint32_t kind = p[12];
+            if (kind > uint32_t(ASIMOVRelocKind::Abs32))
+                return fail(err_msg, "unknown relocation kind " + std::to_string(kind));
+            reloc.kind = static_cast<ASIMOVRelocKind>(kind);
+            if (reloc.symbol >= num_symbols)
+                return fail(err_msg, "relocation refers to symbol " + std::to_string(reloc.symbol));
+            if (reloc.offset % 4 != 0 || uint64_t(reloc.offset) + 4 > (image_size + 3) / 4 * 4)
+                return fail(err_msg, "relocation at " + std::to_string(reloc.offset) + " is outside the image");
+            p += RELOCATION_BYTES;
+        }
+
+        image = std::move(result);
+        return true;
+    }
+
+    bool ASIMOVImage::write_file(const std::string &path, std::string *err_msg) const
+    {
+        const std::vector<uint8_t> bytes = serialize();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!out.good())
+            return fail(err_msg, "cannot write `" + path + "`");
+        return true;
+    }
+
+    bool ASIMOVImage::read_file(const std::string &path, ASIMOVImage &image, std::string *err_msg)
+    {
+#ifdef ASIMOV_IMAGE_MMAP
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return fail(err_msg, "cannot open `" + path + "`");
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0)
+        {
+            ::close(fd);
+            return fail(err_msg, "not an ASIMOV image");
+        }
+        const size_t length = static_cast<size_t>(st.st_size);
+        void *mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return fail(err_msg, "cannot map `" + path + "`");
+        const bool parsed = parse({static_cast<const uint8_t *>(mapped), length}, image, err_msg);
+        ::munmap(mapped, length);
+        return parsed;
+#else
+        std::ifstream in(path, std::ios::binary);
+        if (!in)
+            return fail(err_msg, "cannot open `" + path + "`");
+        const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return parse(bytes, image, err_msg);
+#endif
+    }
+} // namespace ASIMOV
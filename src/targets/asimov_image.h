@@ -0,0 +1,81 @@
+// asimov_image.h - Loadable ASIMOV images with symbol and relocation tables
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ASIMOV
+{
+    enum class ASIMOVSymbolKind : uint8_t
+    {
+        Function,
+        Block,
+        Object,    // a global variable in the data section
+        Undefined, // referenced but not defined here; resolved when linked
+    };
+
+    // Offsets are from the start of the image: text first, data right after
+    struct ASIMOVSymbol
+    {
+        std::string name;
+        uint32_t offset = 0;
+        ASIMOVSymbolKind kind = ASIMOVSymbolKind::Undefined;
+    };
+
+    enum class ASIMOVRelocKind : uint8_t
+    {
+        Abs16, // low 16 bits of the word: MOVW immediates and JZ/JNZ targets
+        Abs24, // low 24 bits of the word: JMP targets
+        Abs32, // the whole word: MOVD data words and pointers in data
+    };
+
+    // The word at `offset` holds the absolute address of `symbol` plus `addend`
+    struct ASIMOVRelocation
+    {
+        uint32_t offset = 0;
+        uint32_t symbol = 0;
+        int32_t addend = 0;
+        ASIMOVRelocKind kind = ASIMOVRelocKind::Abs32;
+    };
+
+    // Text and data with every address already resolved for `base_address`,
+    // plus what is needed to load it anywhere else. On disk everything is
+    // big-endian, so text and data are byte for byte what the VM memory holds
+    // and a mapped file can be copied in as it is.
+    struct ASIMOVImage
+    {
+        static constexpr uint32_t MAGIC = 0x41494D47; // "AIMG"
+        static constexpr uint16_t VERSION = 1;
+
+        uint32_t base_address = 0;
+        uint32_t entry = 0; // image offset of the first instruction to run
+        std::vector<uint32_t> text;
+        std::vector<uint8_t> data;
+        std::vector<ASIMOVSymbol> symbols;
+        std::vector<ASIMOVRelocation> relocations;
+
+        // Bytes covered once loaded; data starts at text.size() * 4
+        uint32_t size() const { return static_cast<uint32_t>(text.size() * 4 + data.size()); }
+        uint32_t data_offset() const { return static_cast<uint32_t>(text.size() * 4); }
+        // The first symbol called `name`, nullptr if there is none
+        const ASIMOVSymbol *find_symbol(const std::string &name) const;
+
+        // Memory words for the image loaded at `load_address`, with every
+        // relocation applied again. Undefined symbols are looked up in
+        // `externals`. Returns false with `err_msg` set when a symbol is
+        // missing or an address no longer fits its field.
+        bool link(uint32_t load_address, std::vector<uint32_t> &words, std::string *err_msg = nullptr,
+                  const std::unordered_map<std::string, uint32_t> *externals = nullptr) const;
+
+        std::vector<uint8_t> serialize() const;
+        // Checks every count, offset and index against `bytes` before use
+        static bool parse(std::span<const uint8_t> bytes, ASIMOVImage &image, std::string *err_msg = nullptr);
+
+        bool write_file(const std::string &path, std::string *err_msg = nullptr) const;
+        // Maps the file where mmap is available and reads it otherwise
+        static bool read_file(const std::string &path, ASIMOVImage &image, std::string *err_msg = nullptr);
+    };
+} // namespace ASIMOV
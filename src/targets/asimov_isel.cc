@@ -0,0 +1,80 @@
+#include "asimov_isel.h"
+
+namespace ASIMOV
+{
+    ASIMOVISelInfo::ASIMOVISelInfo(const ASIMOVTargetInstInfo *tii) : TargetISelInfo(tii)
+    {
+        int_class_ = GR32;
+        float_class_ = FP32;
+        double_class_ = FP32;
+        register_bits_ = 32;
+        frame_reg_ = R7;
+        memory_offset_bits_ = 8;
+        load_imm_opcode_ = LI;
+        jump_opcode_ = JMP;
+        call_opcode_ = CALL;
+        return_opcode_ = RET;
+        int_arg_regs_ = {R0, R1, R2, R3};
+        fp_arg_regs_ = {F0, F1, F2, F3};
+        fast_int_arg_regs_ = {R0, R1, R2, R3, R4};
+        fast_fp_arg_regs_ = {F0, F1, F2, F3, F4, F5, F6, F7};
+        int_return_reg_ = R0;
+        fp_return_reg_ = F0;
+
+        constexpr int any = ISelPattern::ANY_PREDICATE;
+        add_pattern({.ir_opcode = ::Opcode::Add, .predicate = any, .form = ISelForm::RegReg, .machine_opcode = ADD,
+                     .commutative = true});
+        add_pattern({.ir_opcode = ::Opcode::Sub, .predicate = any, .form = ISelForm::RegReg, .machine_opcode = SUB});
+        add_pattern({.ir_opcode = ::Opcode::Mul, .predicate = any, .form = ISelForm::RegReg, .machine_opcode = MUL,
+                     .commutative = true});
+        add_pattern({.ir_opcode = ::Opcode::SDiv, .predicate = any, .form = ISelForm::RegReg, .machine_opcode = DIV});
+
+        const std::pair<::Opcode, unsigned> fp_ops[] = {
+            {::Opcode::Add, FADD}, {::Opcode::Sub, FSUB}, {::Opcode::Mul, FMUL}, {::Opcode::SDiv, FDIV}};
+        for (const auto &[ir_opcode, opcode] : fp_ops)
+        {
+            add_pattern({.ir_opcode = ir_opcode, .predicate = any, .form = ISelForm::RegReg, .machine_opcode = opcode,
+                         .type = ISelType::F32});
+        }
+
+        // Against zero directly, otherwise through the difference. JZ/JNZ
+        // can't tell a negative difference from a positive one, so `<` and
+        // the other orderings have no pattern; the driver reports them
+        add_pattern({.ir_opcode = ::Opcode::CondBr, .predicate = ICmpInst::EQ, .form = ISelForm::BranchReg,
+                     .machine_opcode = JZ, .commutative = true});
+        add_pattern({.ir_opcode = ::Opcode::CondBr, .predicate = ICmpInst::EQ, .form = ISelForm::BranchCompare,
+                     .machine_opcode = JZ, .compare_opcode = CMP});
+        add_pattern({.ir_opcode = ::Opcode::CondBr, .predicate = ICmpInst::NE, .form = ISelForm::BranchReg,
+                     .machine_opcode = JNZ, .commutative = true});
+        add_pattern({.ir_opcode = ::Opcode::CondBr, .predicate = ICmpInst::NE, .form = ISelForm::BranchCompare,
+                     .machine_opcode = JNZ, .compare_opcode = CMP});
+    }
+
+    unsigned ASIMOVISelInfo::load_opcode(const Type *) const
+    {
+        // One width for everything, as with spill code
+        return LOAD;
+    }
+
+    unsigned ASIMOVISelInfo::store_opcode(const Type *) const
+    {
+        return STORE;
+    }
+
+    std::unique_ptr<MachineInst> ASIMOVISelInfo::build_global_address(unsigned rd, GlobalVariable *global) const
+    {
+        return std::make_unique<MachineInst>(LI, std::vector<MOperand>{MOperand::create_reg(rd, true),
+                                                                        MOperand::create_global(global)});
+    }
+
+    std::unique_ptr<MachineInst> ASIMOVISelInfo::build_copy(unsigned rd, unsigned rs, bool is_fp) const
+    {
+        // Same forms as copy_phys_reg
+        if (is_fp)
+            return std::make_unique<MachineInst>(FADD, std::vector<MOperand>{MOperand::create_reg(rd, true),
+                                                                              MOperand::create_reg(F0),
+                                                                              MOperand::create_reg(rs)});
+        return std::make_unique<MachineInst>(MOVW, std::vector<MOperand>{MOperand::create_reg(rd, true),
+                                                                          MOperand::create_reg(rs)});
+    }
+} // namespace ASIMOV
@@ -0,0 +1,22 @@
+// asimov_isel.h - ASIMOV instruction selection patterns
+#pragma once
+
+#include "../isel.h"
+#include "asimov_target.h"
+
+namespace ASIMOV
+{
+    // ASIMOV has no immediate ALU forms, so constants go through LI; the
+    // only conditional branches test a register against zero. Without a
+    // sign test only `==` and `!=` compares select, and only into a branch
+    class ASIMOVISelInfo : public TargetISelInfo
+    {
+    public:
+        explicit ASIMOVISelInfo(const ASIMOVTargetInstInfo *tii);
+
+        unsigned load_opcode(const Type *type) const override;
+        unsigned store_opcode(const Type *type) const override;
+        std::unique_ptr<MachineInst> build_global_address(unsigned rd, GlobalVariable *global) const override;
+        std::unique_ptr<MachineInst> build_copy(unsigned rd, unsigned rs, bool is_fp) const override;
+    };
+} // namespace ASIMOV
@@ -0,0 +1,26 @@
+#include "asimov_peephole.h"
+
+namespace ASIMOV
+{
+    ASIMOVPeepholeInfo::ASIMOVPeepholeInfo(const ASIMOVTargetInstInfo *tii) : TargetPeepholeInfo(tii)
+    {
+        // LI before expand_pseudo, MOVW after
+        constant_opcodes_ = {LI, MOVW};
+        arg_regs_ = {R0, R1, R2, R3, F0, F1, F2, F3};
+        caller_saved_regs_ = {R0, R1, R2, R3, R4, F0, F1, F2, F3, F4, F5, F6, F7};
+        return_regs_ = {R0, F0};
+
+        // CMP expands to SUB, so `t = a - 0` tests a itself
+        for (unsigned compare : {CMP, SUB})
+        {
+            for (unsigned branch : {JZ, JNZ})
+            {
+                add_pattern({.kind = PeepholeKind::CompareBranch, .opcode = compare, .second_opcode = branch,
+                             .result_opcode = branch, .commutative = true, .against_zero = true});
+            }
+        }
+
+        // Spill slots and everything else are one word wide
+        add_pattern({.kind = PeepholeKind::StoreReload, .opcode = STORE, .second_opcode = LOAD, .access_bytes = 4});
+    }
+} // namespace ASIMOV
@@ -0,0 +1,17 @@
+// asimov_peephole.h - ASIMOV peephole patterns
+#pragma once
+
+#include "../peephole.h"
+#include "asimov_target.h"
+
+namespace ASIMOV
+{
+    // Branches only test a register against zero, so a compare folds into
+    // its branch when one side is a known zero. With no immediate ALU forms
+    // there is nothing for constants to fold into
+    class ASIMOVPeepholeInfo : public TargetPeepholeInfo
+    {
+    public:
+        explicit ASIMOVPeepholeInfo(const ASIMOVTargetInstInfo *tii);
+    };
+} // namespace ASIMOV
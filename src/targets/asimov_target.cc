@@ -188,6 +188,15 @@ namespace ASIMOV
         };
 
         call_conventions_[CallingConv::C].temp_regs.insert(Reg::R5); // 临时寄存器
+        // 参数全在寄存器里，尾调用可以直接跳转，复用调用者的栈帧
+        call_conventions_[CallingConv::C].supports_tail_call = true;
+        call_conventions_[CallingConv::C].caller_saved_regs.insert(caller_saved.begin(), caller_saved.end());
+
+        // Fast: 只给模块内部的函数用，保存规则和 C 相同，多用 R4 和 F4-F7 传参
+        CallingConventionRules &fast = call_conventions_[CallingConv::Fast];
+        fast = call_conventions_[CallingConv::C];
+        fast.arg_passing.int_regs.push_back(Reg::R4);
+        fast.arg_passing.fp_regs.insert(fast.arg_passing.fp_regs.end(), {Reg::F4, Reg::F5, Reg::F6, Reg::F7});
 
         MO_DEBUG("Initialized calling conventions for ASIMOV target %p\n", &call_conventions_);
     }
@@ -505,6 +514,27 @@ namespace ASIMOV
         return MI.opcode() == CALL;
     }
 
+    bool ASIMOVTargetInstInfo::is_copy(const MachineInst &MI, unsigned &dest_reg, unsigned &src_reg) const
+    {
+        // 整型复制是寄存器形式的 movw rd, rs；浮点复制借用 F0 的 fadd 不算
+        const auto &ops = MI.operands();
+        if (MI.opcode() != MOVW || ops.size() != 2 || !ops[0].is_reg() || !ops[1].is_reg())
+            return false;
+        dest_reg = ops[0].reg();
+        src_reg = ops[1].reg();
+        return true;
+    }
+
+    bool ASIMOVTargetInstInfo::is_trivially_rematerializable(const MachineInst &MI) const
+    {
+        // 立即数、全局地址或帧下标装入寄存器：li/movw/movd rd, imm
+        const auto &ops = MI.operands();
+        if (MI.opcode() != LI && MI.opcode() != MOVW && MI.opcode() != MOVD)
+            return false;
+        return ops.size() == 2 && ops[0].is_reg() && ops[0].is_def() &&
+               (ops[1].is_imm() || ops[1].is_global() || ops[1].is_frame_index()) && MI.implicit_defs().empty();
+    }
+
     // 操作数类型判断
     bool ASIMOVTargetInstInfo::is_operand_def(unsigned op, unsigned index) const
     {
@@ -657,16 +687,11 @@ namespace ASIMOV
         unsigned dest_reg, int frame_index,
         int64_t offset) const
     {
-        // 获取总偏移
-        MachineFunction &mf = *mbb.parent();
-        unsigned base_reg = Reg::R7; // 默认使用栈指针
-
-        int total_offset = mf.frame()->get_frame_index_offset(frame_index) + offset;
-
-        // 生成: LOAD dest, [R7 + offset]
+        // 生成: LOAD dest, [fi + offset]，帧布局定下后由 resolve_frame_indices 换成 [R7 + offset]
         auto mi = std::make_unique<MachineInst>(LOAD);
         mi->add_operand(MOperand::create_reg(dest_reg, true));
-        mi->add_operand(MOperand::create_mem_ri(base_reg, total_offset));
+        mi->add_operand(MOperand::create_mem_fi(frame_index, static_cast<int>(offset)));
+        mi->set_flag(MIFlag::MayLoad);
 
         return mbb.insert(insert_point, std::move(mi));
     }
@@ -677,13 +702,11 @@ namespace ASIMOV
         unsigned src_reg, int frame_index,
         int64_t offset) const
     {
-        auto mf = mbb.parent();
-        int total_offset = mf->frame()->get_frame_index_offset(frame_index) + offset;
-
-        // 生成: STORE src, [R7 + offset]
+        // 生成: STORE src, [fi + offset]
         auto mi = std::make_unique<MachineInst>(STORE);
         mi->add_operand(MOperand::create_reg(src_reg));
-        mi->add_operand(MOperand::create_mem_ri(R7, total_offset));
+        mi->add_operand(MOperand::create_mem_fi(frame_index, static_cast<int>(offset)));
+        mi->set_flag(MIFlag::MayStore);
 
         return mbb.insert(insert_point, std::move(mi));
     }
@@ -739,6 +762,11 @@ namespace ASIMOV
                 fall_through = nullptr;
                 return true;
             }
+            else if (terminator->is_tail_call())
+            {
+                // 尾调用跳出本函数，没有后继
+                return true;
+            }
             else
             {
                 MO_NOT_IMPLEMENTED();
@@ -798,4 +826,25 @@ namespace ASIMOV
         return false;
     }
 
+    unsigned ASIMOVTargetInstInfo::get_inverse_branch_opcode(unsigned opcode) const
+    {
+        switch (opcode)
+        {
+        case JZ:
+            return JNZ;
+        case JNZ:
+            return JZ;
+        default:
+            return 0;
+        }
+    }
+
+    std::unique_ptr<MachineInst> ASIMOVTargetInstInfo::build_jump(MachineBasicBlock *target) const
+    {
+        auto mi = std::make_unique<MachineInst>(JMP, std::vector<MOperand>{MOperand::create_basic_block(target)});
+        mi->set_flag(MIFlag::Branch);
+        mi->set_flag(MIFlag::Terminator);
+        return mi;
+    }
+
 } // namespace ASIMOV
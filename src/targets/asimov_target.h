@@ -35,8 +35,8 @@ namespace ASIMOV
         R3,
         R4,
         R5, // 临时寄存器
-        R6, // SP 栈指针寄存器
-        R7, // BP 基址指针寄存器（不强制要求）
+        R6,
+        R7, // SP 栈指针寄存器，帧对象都相对它寻址
             // 浮点寄存器 (F0-F7)
         F0 = 8,
         F1,
@@ -117,6 +117,8 @@ namespace ASIMOV
                            MachineBasicBlock::iterator MI) const override;
         bool is_return(const MachineInst &MI) const override;
         bool is_call(const MachineInst &MI) const override;
+        bool is_copy(const MachineInst &MI, unsigned &dest_reg, unsigned &src_reg) const override;
+        bool is_trivially_rematerializable(const MachineInst &MI) const override;
         bool is_legal_immediate(int64_t imm, unsigned size) const override;
 
         // 操作数类型判断
@@ -142,6 +144,8 @@ namespace ASIMOV
             MachineInst *terminator,
             std::unordered_set<MachineBasicBlock *> &branch_targets,
             MachineBasicBlock *&fall_through) const override;
+        unsigned get_inverse_branch_opcode(unsigned opcode) const override;
+        std::unique_ptr<MachineInst> build_jump(MachineBasicBlock *target) const override;
 
     private:
         // 编码辅助函数
@@ -152,6 +156,7 @@ namespace ASIMOV
         uint32_t encode_B(unsigned opcode, const MachineInst &MI) const;
     }; // class ASIMOVTargetInstInfo
 
+    // 帧对象相对 R7 寻址：序言把 R7 下移整个栈帧，每个返回和尾调用前移回
     class ASIMOVFrameLowering : public TargetFrameLowering
     {
     public:
@@ -163,11 +168,11 @@ namespace ASIMOV
             // 分配栈空间
             if (stack_size > 0)
             {
-                // SUB R6, R6, stack_size
+                // SUB R7, R7, stack_size
                 auto &mbb = *mf.basic_blocks().front();
                 auto mi = std::make_unique<MachineInst>(SUB);
-                mi->add_operand(MOperand::create_reg(R6, true));
-                mi->add_operand(MOperand::create_reg(R6));
+                mi->add_operand(MOperand::create_reg(R7, true));
+                mi->add_operand(MOperand::create_reg(R7));
                 mi->add_operand(MOperand::create_imm(stack_size));
                 mbb.insert(mbb.begin(), std::move(mi));
             }
@@ -178,16 +183,23 @@ namespace ASIMOV
             MachineFrame &frame = *mf.frame();
             int stack_size = frame.get_total_frame_size();
 
-            // 释放栈空间
-            if (stack_size > 0)
+            // 释放栈空间: every RET, and every tail call, leaves the frame
+            if (stack_size <= 0)
+                return;
+            for (auto &mbb : mf.basic_blocks())
             {
-                // ADD R6, R6, stack_size
-                auto &mbb = *mf.basic_blocks().back();
-                auto mi = std::make_unique<MachineInst>(ADD);
-                mi->add_operand(MOperand::create_reg(R6, true));
-                mi->add_operand(MOperand::create_reg(R6));
-                mi->add_operand(MOperand::create_imm(stack_size));
-                mbb.insert(std::prev(mbb.end()), std::move(mi));
+                for (size_t i = 0; i < mbb->instructions().size(); ++i)
+                {
+                    const MachineInst &exit = *mbb->instructions()[i];
+                    if (exit.opcode() != RET && !exit.is_tail_call())
+                        continue;
+                    // ADD R7, R7, stack_size
+                    auto mi = std::make_unique<MachineInst>(ADD);
+                    mi->add_operand(MOperand::create_reg(R7, true));
+                    mi->add_operand(MOperand::create_reg(R7));
+                    mi->add_operand(MOperand::create_imm(stack_size));
+                    mbb->insert(mbb->begin() + i++, std::move(mi));
+                }
             }
         }
     }; // class ASIMOVFrameLowering
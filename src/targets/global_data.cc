@@ -0,0 +1,111 @@
+#include "global_data.h"
+
+#include "../ir.h"
+#include <cstring>
+
+const Type *global_value_type(const GlobalVariable *gv)
+{
+    if (gv->initializer() && !dynamic_cast<const GlobalVariable *>(gv->initializer()))
+        return gv->initializer()->type();
+    if (const PointerType *pointer = gv->type()->as_pointer())
+        return pointer->element_type();
+    return gv->type();
+}
+
+namespace
+{
+    bool overrun(std::string *err_msg)
+    {
+        if (err_msg)
+            *err_msg = "initializer overruns its global";
+        return false;
+    }
+
+    bool put(std::span<uint8_t> bytes, size_t at, uint64_t value, size_t size, bool big_endian, std::string *err_msg)
+    {
+        if (at + size > bytes.size())
+            return overrun(err_msg);
+        for (size_t i = 0; i < size; ++i)
+        {
+            const size_t shift = 8 * (big_endian ? size - 1 - i : i);
+            bytes[at + i] = static_cast<uint8_t>(value >> shift);
+        }
+        return true;
+    }
+
+    bool write_at(const Constant *c, std::span<uint8_t> bytes, size_t at, bool big_endian,
+                  std::vector<GlobalAddressField> &fields, std::string *err_msg)
+    {
+        if (auto *gv = dynamic_cast<const GlobalVariable *>(c))
+        {
+            fields.push_back({at, gv});
+            return true;
+        }
+        if (auto *ci = dynamic_cast<const ConstantInt *>(c))
+            return put(bytes, at, ci->value(), std::min<size_t>(ci->type()->size(), 8), big_endian, err_msg);
+        if (auto *cf = dynamic_cast<const ConstantFP *>(c))
+        {
+            if (cf->type()->size() == 4)
+            {
+                const float value = static_cast<float>(cf->value());
+                uint32_t bits;
+                std::memcpy(&bits, &value, 4);
+                return put(bytes, at, bits, 4, big_endian, err_msg);
+            }
+            const double value = cf->value();
+            uint64_t bits;
+            std::memcpy(&bits, &value, 8);
+            return put(bytes, at, bits, 8, big_endian, err_msg);
+        }
+        if (auto *cs = dynamic_cast<const ConstantString *>(c))
+        {
+            const size_t size = std::min(cs->value().size(), cs->type()->size());
+            if (at + size > bytes.size())
+                return overrun(err_msg);
+            std::memcpy(bytes.data() + at, cs->value().data(), size);
+            return true;
+        }
+        if (auto *ca = dynamic_cast<const ConstantArray *>(c))
+        {
+            const size_t element_size = ca->type()->as_array()->element_type()->size();
+            for (size_t i = 0; i < ca->elements().size(); ++i)
+            {
+                if (!write_at(ca->elements()[i], bytes, at + i * element_size, big_endian, fields, err_msg))
+                    return false;
+            }
+            return true;
+        }
+        if (auto *st = dynamic_cast<const ConstantStruct *>(c))
+        {
+            const StructType *type = st->type()->as_struct();
+            for (size_t i = 0; i < st->elements().size(); ++i)
+            {
+                if (!write_at(st->elements()[i], bytes, at + type->get_member_offset(i), big_endian, fields, err_msg))
+                    return false;
+            }
+            return true;
+        }
+        if (dynamic_cast<const ConstantPointerNull *>(c) || dynamic_cast<const ConstantAggregateZero *>(c))
+            return true;
+        if (err_msg)
+            *err_msg = "unsupported initializer " + c->as_string();
+        return false;
+    }
+} // namespace
+
+bool write_initializer(const Constant *c, std::span<uint8_t> bytes, bool big_endian,
+                       std::vector<GlobalAddressField> &fields, std::string *err_msg)
+{
+    return write_at(c, bytes, 0, big_endian, fields, err_msg);
+}
+
+void referenced_globals(const Constant *c, std::vector<const GlobalVariable *> &globals)
+{
+    if (auto *gv = dynamic_cast<const GlobalVariable *>(c))
+        globals.push_back(gv);
+    else if (auto *aggregate = dynamic_cast<const ConstantAggregate *>(c))
+    {
+        for (const Constant *element : aggregate->elements())
+            referenced_globals(element, globals);
+    }
+}
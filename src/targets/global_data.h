@@ -0,0 +1,33 @@
+// global_data.h - Byte images of global variable initializers for emitters
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+class Constant;
+class GlobalVariable;
+class Type;
+
+// Globals are typed either by their value or by a pointer to it; one whose
+// initializer is the address of another global is pointer sized
+const Type *global_value_type(const GlobalVariable *gv);
+
+// A field of an initializer that holds the address of `global`
+struct GlobalAddressField
+{
+    size_t offset;
+    const GlobalVariable *global;
+};
+
+// Writes `c` into `bytes`, which must start zeroed and be as large as its
+// type. Address fields are left zero and listed in `fields` for the caller
+// to relocate. Returns false with `err_msg` set for initializers that have
+// no byte image.
+bool write_initializer(const Constant *c, std::span<uint8_t> bytes, bool big_endian,
+                       std::vector<GlobalAddressField> &fields, std::string *err_msg = nullptr);
+
+// Appends the globals whose addresses `c` holds, in the order they appear
+void referenced_globals(const Constant *c, std::vector<const GlobalVariable *> &globals);
@@ -0,0 +1,992 @@
+#include "riscv_emitter.h"
+
+#include "../ir.h"
+#include "global_data.h"
+#include <bit>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace RISCV
+{
+    namespace
+    {
+        class EmitError : public std::runtime_error
+        {
+        public:
+            using std::runtime_error::runtime_error;
+        };
+
+        bool fits_signed(int64_t value, unsigned bits)
+        {
+            return value >= -(int64_t(1) << (bits - 1)) && value < (int64_t(1) << (bits - 1));
+        }
+
+        int64_t sext12(int64_t value)
+        {
+            const int64_t low = value & 0xFFF;
+            return low >= 0x800 ? low - 0x1000 : low;
+        }
+
+        // Upper 20 bits for AUIPC/LUI, rounded so the low 12 can be added signed
+        int64_t hi20(int64_t value) { return ((value + 0x800) >> 12) & 0xFFFFF; }
+
+        uint16_t bits(int64_t value, unsigned hi, unsigned lo)
+        {
+            return static_cast<uint16_t>((uint64_t(value) >> lo) & ((1u << (hi - lo + 1)) - 1));
+        }
+
+        unsigned num(unsigned reg) { return reg & 0x1F; }
+        // x8-x15 and f8-f15, the registers the 3-bit RVC fields can name
+        bool creg(unsigned reg) { return num(reg) >= 8 && num(reg) <= 15; }
+        unsigned cnum(unsigned reg) { return num(reg) - 8; }
+
+        MOperand reg(unsigned r, bool def = false) { return MOperand::create_reg(r, def); }
+        MOperand imm(int64_t value) { return MOperand::create_imm(value); }
+
+        enum class Form : uint8_t
+        {
+            Fixed,       // encoded once during collection
+            Branch,      // C.BEQZ/C.BNEZ, Bxx, or the inverted Bxx over a JAL
+            Jump,        // C.J, JAL x0, or AUIPC t1 + JALR x0 to a function
+            Call,        // C.JAL, JAL ra, or AUIPC ra + JALR ra
+            Plt,         // CALL or J to an undefined symbol, with R_RISCV_CALL_PLT
+            LoadAddress, // AUIPC rd + ADDI rd
+        };
+
+        struct Item
+        {
+            const MachineInst *mi;
+            Form form = Form::Fixed;
+            uint8_t level = 0;   // how far Branch, Jump and Call have grown
+            uint32_t symbol = 0; // target of every form but Fixed
+            uint32_t label = 0;  // the AUIPC of a relocated LoadAddress
+            uint32_t code = 0;   // Fixed: its bytes in fixed_
+            uint32_t code_size = 0;
+            uint64_t offset = 0; // in .text, set by layout
+        };
+
+        // A symbol whose offset is that of items_[item]
+        struct Mark
+        {
+            size_t item;
+            uint32_t symbol;
+        };
+
+        class Emitter
+        {
+        public:
+            Emitter(const MachineModule &mm, RISCVObject &object, const RISCVEmitOptions &options)
+                : mm_(mm), object_(object), options_(options)
+            {
+                tii_ = dynamic_cast<const RISCVTargetInstInfo *>(mm.target_inst_info());
+                if (!tii_)
+                    throw EmitError("the module does not target RISC-V");
+                const ABIVersion abi = tii_->abi_version();
+                rv64_ = abi != ABIVersion::ILP32 && abi != ABIVersion::ILP32F;
+            }
+
+            void run()
+            {
+                object_ = RISCVObject();
+                object_.rv64 = rv64_;
+                object_.compressed = options_.compress;
+                object_.abi = tii_->abi_version();
+                collect();
+                relax();
+                encode();
+                emit_data();
+            }
+
+        private:
+            const MachineModule &mm_;
+            const RISCVTargetInstInfo *tii_;
+            RISCVObject &object_;
+            const RISCVEmitOptions &options_;
+            bool rv64_;
+
+            std::vector<Item> items_;
+            std::vector<Mark> marks_;
+            std::vector<uint8_t> fixed_;
+            std::vector<uint32_t> function_symbols_;
+            std::unordered_map<std::string, uint32_t> functions_;
+            std::unordered_map<std::string, uint32_t> undefined_;
+            std::unordered_map<const MachineBasicBlock *, uint32_t> blocks_;
+            std::unordered_map<const GlobalVariable *, uint32_t> global_symbols_;
+            std::vector<const GlobalVariable *> globals_;
+            uint64_t text_bytes_ = 0;
+            unsigned labels_ = 0;
+
+            uint32_t add_symbol(std::string name, RISCVSymbolKind kind, RISCVSection section)
+            {
+                object_.symbols.push_back({std::move(name), kind, section});
+                return static_cast<uint32_t>(object_.symbols.size() - 1);
+            }
+
+            const RISCVSymbol &symbol(uint32_t index) const { return object_.symbols[index]; }
+            bool in_text(uint32_t index) const { return symbol(index).section == RISCVSection::Text; }
+
+            std::string describe(const MachineInst &mi) const
+            {
+                return std::string("`") + tii_->opcode_name(mi.opcode()) + "`";
+            }
+
+            //===---------------------- Collection -----------------------===//
+
+            void collect()
+            {
+                const auto &functions = mm_.functions();
+                for (size_t i = 0; i < functions.size(); ++i)
+                {
+                    const Function *f = functions[i]->ir_function();
+                    std::string name = f ? f->name() : "function" + std::to_string(i);
+                    const uint32_t symbol = add_symbol(name, RISCVSymbolKind::Function, RISCVSection::Text);
+                    functions_.emplace(std::move(name), symbol);
+                    function_symbols_.push_back(symbol);
+                }
+                if (const Module *module = mm_.ir_module())
+                {
+                    for (const GlobalVariable *gv : module->global_variables())
+                        add_global(gv);
+                }
+
+                for (size_t i = 0; i < functions.size(); ++i)
+                {
+                    const std::string function_name = symbol(function_symbols_[i]).name;
+                    for (const auto &mbb : functions[i]->basic_blocks())
+                    {
+                        const std::string label = mbb->label().empty() ? "bb" + std::to_string(mbb->index()) : mbb->label();
+                        blocks_.emplace(mbb.get(), add_symbol(function_name + "." + label, RISCVSymbolKind::Block,
+                                                              RISCVSection::Text));
+                    }
+                }
+
+                for (size_t i = 0; i < functions.size(); ++i)
+                {
+                    marks_.push_back({items_.size(), function_symbols_[i]});
+                    for (const auto &mbb : functions[i]->basic_blocks())
+                    {
+                        marks_.push_back({items_.size(), blocks_.at(mbb.get())});
+                        for (const auto &mi : mbb->instructions())
+                            items_.push_back(classify(*mi));
+                    }
+                }
+            }
+
+            // Globals named by an initializer get laid out too
+            uint32_t add_global(const GlobalVariable *gv)
+            {
+                auto it = global_symbols_.find(gv);
+                if (it != global_symbols_.end())
+                    return it->second;
+                std::string name = gv->name().empty() ? "global" + std::to_string(globals_.size()) : gv->name();
+                const uint32_t symbol = add_symbol(std::move(name), RISCVSymbolKind::Object, RISCVSection::Data);
+                global_symbols_.emplace(gv, symbol);
+                globals_.push_back(gv);
+                std::vector<const GlobalVariable *> referenced;
+                referenced_globals(gv->initializer(), referenced);
+                for (const GlobalVariable *other : referenced)
+                    add_global(other);
+                return symbol;
+            }
+
+            uint32_t named_symbol(const std::string &name)
+            {
+                auto it = functions_.find(name);
+                if (it != functions_.end())
+                    return it->second;
+                auto [undefined, inserted] = undefined_.emplace(name, 0);
+                if (inserted)
+                    undefined->second = add_symbol(name, RISCVSymbolKind::Undefined, RISCVSection::Undefined);
+                return undefined->second;
+            }
+
+            // Symbol for an address operand, or false if it is not one
+            bool symbol_operand(const MOperand &op, uint32_t &symbol)
+            {
+                if (op.is_global())
+                    symbol = add_global(op.global());
+                else if (op.is_external_sym())
+                    symbol = named_symbol(op.external_sym());
+                else if (op.is_label())
+                    symbol = named_symbol(op.label());
+                else if (op.is_basic_block())
+                {
+                    auto it = blocks_.find(op.basic_block());
+                    if (it == blocks_.end())
+                        throw EmitError("branch to a block outside the module");
+                    symbol = it->second;
+                }
+                else
+                    return false;
+                return true;
+            }
+
+            Item classify(const MachineInst &mi)
+            {
+                for (const auto &op : mi.operands())
+                {
+                    if (op.is_frame_index() || op.is_mem_fi())
+                        throw EmitError(describe(mi) + " still has a frame index");
+                    const bool virtual_reg = (op.is_reg() && MachineFunction::is_virtual_reg(op.reg())) ||
+                                             (op.is_mem_ri() && MachineFunction::is_virtual_reg(op.mem_ri().base_reg));
+                    if (virtual_reg)
+                        throw EmitError(describe(mi) + " still uses a virtual register");
+                }
+
+                Item item{&mi};
+                const auto &ops = mi.operands();
+                auto expect = [&](size_t count)
+                {
+                    if (ops.size() != count)
+                        throw EmitError(describe(mi) + " needs " + std::to_string(count) + " operands");
+                };
+
+                switch (mi.opcode())
+                {
+                case LI:
+                    expect(2);
+                    if (ops[1].is_imm())
+                    {
+                        std::vector<MachineInst> sequence;
+                        load_immediate(mi, ops[0].reg(), ops[1].imm(), sequence);
+                        fixed(item, sequence);
+                        return item;
+                    }
+                    [[fallthrough]];
+                case LA:
+                    expect(2);
+                    if (!ops[0].is_reg() || !symbol_operand(ops[1], item.symbol))
+                        throw EmitError(describe(mi) + " needs a register and a symbol");
+                    item.form = Form::LoadAddress;
+                    if (!in_text(item.symbol))
+                    {
+                        item.label = add_symbol(".Lpcrel_hi" + std::to_string(labels_++), RISCVSymbolKind::Label,
+                                                RISCVSection::Text);
+                        marks_.push_back({items_.size(), item.label});
+                    }
+                    return item;
+                case MV:
+                    expect(2);
+                    fixed(item, {MachineInst(ADDI, {ops[0], ops[1], imm(0)})});
+                    return item;
+                case J:
+                case CALL:
+                    expect(1);
+                    if (!symbol_operand(ops[0], item.symbol))
+                        throw EmitError(describe(mi) + " through a register is not supported");
+                    if (!in_text(item.symbol))
+                        item.form = Form::Plt;
+                    else if (mi.opcode() == J)
+                    {
+                        item.form = Form::Jump;
+                        item.level = options_.compress ? 0 : 1;
+                    }
+                    else
+                    {
+                        // C.JAL is RV32C only; RV64 spends its encoding on C.ADDIW
+                        item.form = Form::Call;
+                        item.level = options_.compress && !rv64_ ? 0 : 1;
+                    }
+                    return item;
+                case BEQ:
+                case BNE:
+                case BLT:
+                case BGE:
+                case BLTU:
+                case BGEU:
+                    expect(3);
+                    if (ops[2].is_basic_block())
+                    {
+                        if (!ops[0].is_reg() || !ops[1].is_reg())
+                            throw EmitError(describe(mi) + " needs two registers and a block");
+                        symbol_operand(ops[2], item.symbol);
+                        item.form = Form::Branch;
+                        item.level = compressed_branch_reg(mi) != ZERO ? 0 : 1;
+                        return item;
+                    }
+                    break;
+                default:
+                    break;
+                }
+                fixed(item, {mi});
+                return item;
+            }
+
+            // LUI and ADDI(W) for 32-bit values; wider ones shift in the rest
+            // 12 bits at a time past their trailing zeros
+            void load_immediate(const MachineInst &mi, unsigned rd, int64_t value, std::vector<MachineInst> &out) const
+            {
+                if (!rv64_)
+                {
+                    if (value < INT32_MIN || value > UINT32_MAX)
+                        throw EmitError(describe(mi) + " immediate does not fit 32 bits");
+                    value = static_cast<int32_t>(static_cast<uint32_t>(value));
+                }
+                if (fits_signed(value, 32))
+                {
+                    const int64_t lo = sext12(value);
+                    const int64_t hi = hi20(value);
+                    if (hi == 0)
+                    {
+                        out.emplace_back(ADDI, std::vector<MOperand>{reg(rd, true), reg(ZERO), imm(lo)});
+                        return;
+                    }
+                    out.emplace_back(LUI, std::vector<MOperand>{reg(rd, true), imm(hi)});
+                    if (lo != 0)
+                        out.emplace_back(rv64_ ? ADDIW : ADDI, std::vector<MOperand>{reg(rd, true), reg(rd), imm(lo)});
+                    return;
+                }
+                const int64_t lo = sext12(value);
+                const int64_t upper = static_cast<int64_t>(uint64_t(value) - uint64_t(lo));
+                const int shift = std::countr_zero(uint64_t(upper));
+                load_immediate(mi, rd, upper >> shift, out);
+                out.emplace_back(SLLI, std::vector<MOperand>{reg(rd, true), reg(rd), imm(shift)});
+                if (lo != 0)
+                    out.emplace_back(ADDI, std::vector<MOperand>{reg(rd, true), reg(rd), imm(lo)});
+            }
+
+            void fixed(Item &item, const std::vector<MachineInst> &sequence)
+            {
+                item.code = static_cast<uint32_t>(fixed_.size());
+                for (const MachineInst &mi : sequence)
+                {
+                    check(mi);
+                    uint16_t half;
+                    if (options_.compress && compress(mi, half))
+                        put16(fixed_, half);
+                    else
+                    {
+                        const uint32_t word = tii_->get_binary_encoding(mi);
+                        if (word == 0xFFFFFFFF)
+                            throw EmitError("cannot encode " + describe(mi));
+                        put32(fixed_, word);
+                    }
+                }
+                item.code_size = static_cast<uint32_t>(fixed_.size()) - item.code;
+            }
+
+            static void put16(std::vector<uint8_t> &out, uint16_t half)
+            {
+                out.push_back(static_cast<uint8_t>(half));
+                out.push_back(static_cast<uint8_t>(half >> 8));
+            }
+
+            static void put32(std::vector<uint8_t> &out, uint32_t word)
+            {
+                put16(out, static_cast<uint16_t>(word));
+                put16(out, static_cast<uint16_t>(word >> 16));
+            }
+
+            // The base and offset of a memory access, either `r, off(base)` or
+            // `r, base, off`
+            static void base_offset(const MachineInst &mi, unsigned &base, int64_t &offset)
+            {
+                const auto &ops = mi.operands();
+                if (ops[1].is_mem_ri())
+                {
+                    base = ops[1].mem_ri().base_reg;
+                    offset = ops[1].mem_ri().offset;
+                }
+                else
+                {
+                    base = ops[1].reg();
+                    offset = ops[2].imm();
+                }
+            }
+
+            // Operand shapes and immediate ranges, so get_binary_encoding
+            // never sees something it would silently truncate
+            void check(const MachineInst &mi) const
+            {
+                const unsigned opcode = mi.opcode();
+                if (opcode == RET || opcode == NOP)
+                    return;
+                if (!rv64_ && (opcode == LD || opcode == SD || opcode == ADDIW))
+                    throw EmitError(describe(mi) + " is RV64 only");
+                OpType type;
+                try
+                {
+                    type = opcode_to_type(static_cast<Opcode>(opcode));
+                }
+                catch (const std::invalid_argument &)
+                {
+                    throw EmitError("cannot encode " + describe(mi));
+                }
+                const auto &ops = mi.operands();
+                auto shape = [&](std::initializer_list<bool (MOperand::*)() const noexcept> kinds)
+                {
+                    if (ops.size() != kinds.size())
+                        return false;
+                    size_t i = 0;
+                    for (auto kind : kinds)
+                    {
+                        if (!(ops[i++].*kind)())
+                            return false;
+                    }
+                    return true;
+                };
+                auto range = [&](int64_t value, int64_t lo, int64_t hi, const char *what)
+                {
+                    if (value < lo || value > hi || ((value & 1) && (type == OP_TYPE_B || type == OP_TYPE_J)))
+                        throw EmitError(describe(mi) + " " + what + " is out of range");
+                };
+                const bool memory = shape({&MOperand::is_reg, &MOperand::is_mem_ri});
+                const bool reg_reg_imm = shape({&MOperand::is_reg, &MOperand::is_reg, &MOperand::is_imm});
+                if (is_vector_memory(opcode) || type == OP_TYPE_V)
+                {
+                    if (!tii_->has_vector())
+                        throw EmitError(describe(mi) + " needs the V extension");
+                }
+                if (is_vector_memory(opcode))
+                {
+                    // No offset field, only the base register
+                    if (!memory || ops[1].mem_ri().offset != 0)
+                        throw EmitError(describe(mi) + " needs a register and 0(base)");
+                    return;
+                }
+                switch (type)
+                {
+                case OP_TYPE_R:
+                case OP_TYPE_R4:
+                    if (!shape({&MOperand::is_reg, &MOperand::is_reg, &MOperand::is_reg}))
+                        throw EmitError(describe(mi) + " needs three registers");
+                    return;
+                case OP_TYPE_I:
+                case OP_TYPE_S:
+                {
+                    // Loads, stores and JALR take `r, off(base)` as well as `r, base, off`
+                    const bool accesses = type == OP_TYPE_S || opcode == JALR || (opcode & 0x7F) == 0x03 ||
+                                          (opcode & 0x7F) == 0x07;
+                    if (!reg_reg_imm && !(accesses && memory))
+                        throw EmitError(describe(mi) + " needs registers and an immediate");
+                    unsigned base;
+                    int64_t offset;
+                    base_offset(mi, base, offset);
+                    if (opcode == SLLI || opcode == SRLI || opcode == SRAI)
+                        range(offset, 0, rv64_ ? 63 : 31, "shift amount");
+                    else
+                        range(offset, -2048, 2047, "immediate");
+                    return;
+                }
+                case OP_TYPE_B:
+                    if (!reg_reg_imm)
+                        throw EmitError(describe(mi) + " needs two registers and a block");
+                    range(ops[2].imm(), -4096, 4094, "offset");
+                    return;
+                case OP_TYPE_U:
+                    if (!shape({&MOperand::is_reg, &MOperand::is_imm}))
+                        throw EmitError(describe(mi) + " needs a register and an immediate");
+                    range(ops[1].imm(), 0, 0xFFFFF, "immediate");
+                    return;
+                case OP_TYPE_J:
+                    if (!shape({&MOperand::is_reg, &MOperand::is_imm}))
+                        throw EmitError(describe(mi) + " needs a register and an offset");
+                    range(ops[1].imm(), -(1 << 20), (1 << 20) - 2, "offset");
+                    return;
+                case OP_TYPE_V:
+                    if (opcode == VSETIVLI)
+                    {
+                        if (!shape({&MOperand::is_reg, &MOperand::is_imm, &MOperand::is_imm}))
+                            throw EmitError(describe(mi) + " needs a register, a length and a vtype");
+                        range(ops[1].imm(), 0, 31, "length");
+                        range(ops[2].imm(), 0, 0x3FF, "vtype");
+                    }
+                    else if (opcode == VMV1R_V)
+                    {
+                        if (!shape({&MOperand::is_reg, &MOperand::is_reg}))
+                            throw EmitError(describe(mi) + " needs two registers");
+                    }
+                    else if (!shape({&MOperand::is_reg, &MOperand::is_reg, &MOperand::is_reg}))
+                        throw EmitError(describe(mi) + " needs three registers");
+                    return;
+                }
+            }
+
+            //===------------------- Compressed forms ---------------------===//
+
+            static uint16_t ci(unsigned funct3, unsigned rd, int64_t value, unsigned quadrant)
+            {
+                return static_cast<uint16_t>(funct3 << 13 | bits(value, 5, 5) << 12 | num(rd) << 7 |
+                                             bits(value, 4, 0) << 2 | quadrant);
+            }
+
+            static uint16_t cj(unsigned funct3, int64_t offset)
+            {
+                return static_cast<uint16_t>(funct3 << 13 | bits(offset, 11, 11) << 12 | bits(offset, 4, 4) << 11 |
+                                             bits(offset, 9, 8) << 9 | bits(offset, 10, 10) << 8 |
+                                             bits(offset, 6, 6) << 7 | bits(offset, 7, 7) << 6 |
+                                             bits(offset, 3, 1) << 3 | bits(offset, 5, 5) << 2 | 0x1);
+            }
+
+            static uint16_t cb(unsigned funct3, unsigned rs, int64_t offset)
+            {
+                return static_cast<uint16_t>(funct3 << 13 | bits(offset, 8, 8) << 12 | bits(offset, 4, 3) << 10 |
+                                             cnum(rs) << 7 | bits(offset, 7, 6) << 5 | bits(offset, 2, 1) << 3 |
+                                             bits(offset, 5, 5) << 2 | 0x1);
+            }
+
+            // The register C.BEQZ/C.BNEZ would test, or ZERO if there is none
+            static unsigned compressed_branch_reg(const MachineInst &mi)
+            {
+                const auto &ops = mi.operands();
+                if (mi.opcode() != BEQ && mi.opcode() != BNE)
+                    return ZERO;
+                if (ops[1].reg() == ZERO && creg(ops[0].reg()))
+                    return ops[0].reg();
+                if (ops[0].reg() == ZERO && creg(ops[1].reg()))
+                    return ops[1].reg();
+                return ZERO;
+            }
+
+            bool compress_memory(const MachineInst &mi, uint16_t &half) const
+            {
+                unsigned funct3, scale;
+                bool load, fp = false;
+                switch (mi.opcode())
+                {
+                case LW:
+                    funct3 = 0b010, scale = 4, load = true;
+                    break;
+                case LD:
+                    funct3 = 0b011, scale = 8, load = true;
+                    break;
+                case FLW:
+                    funct3 = 0b011, scale = 4, load = true, fp = true;
+                    break;
+                case FLD:
+                    funct3 = 0b001, scale = 8, load = true, fp = true;
+                    break;
+                case SW:
+                    funct3 = 0b110, scale = 4, load = false;
+                    break;
+                case SD:
+                    funct3 = 0b111, scale = 8, load = false;
+                    break;
+                case FSW:
+                    funct3 = 0b111, scale = 4, load = false, fp = true;
+                    break;
+                case FSD:
+                    funct3 = 0b101, scale = 8, load = false, fp = true;
+                    break;
+                default:
+                    return false;
+                }
+                // C.FLW/C.FSW exist on RV32 only, in the slots RV64 uses for C.LD/C.SD
+                if ((mi.opcode() == FLW || mi.opcode() == FSW) && rv64_)
+                    return false;
+                const unsigned r = mi.operands()[0].reg();
+                unsigned base;
+                int64_t offset;
+                base_offset(mi, base, offset);
+                if (offset < 0 || offset % scale != 0)
+                    return false;
+
+                if (base == SP)
+                {
+                    if (offset >= int64_t(64 * scale) || (load && !fp && r == ZERO))
+                        return false;
+                    if (load && scale == 4)
+                        half = static_cast<uint16_t>(funct3 << 13 | bits(offset, 5, 5) << 12 | num(r) << 7 |
+                                                     bits(offset, 4, 2) << 4 | bits(offset, 7, 6) << 2 | 0x2);
+                    else if (load)
+                        half = static_cast<uint16_t>(funct3 << 13 | bits(offset, 5, 5) << 12 | num(r) << 7 |
+                                                     bits(offset, 4, 3) << 5 | bits(offset, 8, 6) << 2 | 0x2);
+                    else if (scale == 4)
+                        half = static_cast<uint16_t>(funct3 << 13 | bits(offset, 5, 2) << 9 | bits(offset, 7, 6) << 7 |
+                                                     num(r) << 2 | 0x2);
+                    else
+                        half = static_cast<uint16_t>(funct3 << 13 | bits(offset, 5, 3) << 10 | bits(offset, 8, 6) << 7 |
+                                                     num(r) << 2 | 0x2);
+                    return true;
+                }
+                if (!creg(base) || !creg(r) || offset >= int64_t(32 * scale))
+                    return false;
+                if (scale == 4)
+                    half = static_cast<uint16_t>(funct3 << 13 | bits(offset, 5, 3) << 10 | cnum(base) << 7 |
+                                                 bits(offset, 2, 2) << 6 | bits(offset, 6, 6) << 5 | cnum(r) << 2);
+                else
+                    half = static_cast<uint16_t>(funct3 << 13 | bits(offset, 5, 3) << 10 | cnum(base) << 7 |
+                                                 bits(offset, 7, 6) << 5 | cnum(r) << 2);
+                return true;
+            }
+
+            // The 16-bit encoding of `mi` if RVC has one for its operands
+            bool compress(const MachineInst &mi, uint16_t &half) const
+            {
+                const auto &ops = mi.operands();
+                switch (mi.opcode())
+                {
+                case NOP:
+                    half = 0x0001;
+                    return true;
+                case RET:
+                    half = 0x8082; // c.jr ra
+                    return true;
+                case JALR:
+                {
+                    unsigned base;
+                    int64_t offset;
+                    base_offset(mi, base, offset);
+                    if (offset != 0 || base == ZERO || (ops[0].reg() != ZERO && ops[0].reg() != RA))
+                        return false;
+                    half = static_cast<uint16_t>((ops[0].reg() == ZERO ? 0x8002 : 0x9002) | num(base) << 7);
+                    return true;
+                }
+                case ADD:
+                {
+                    const unsigned rd = ops[0].reg(), a = ops[1].reg(), b = ops[2].reg();
+                    if (rd == ZERO)
+                        return false;
+                    if (a == ZERO && b == ZERO)
+                        half = ci(0b010, rd, 0, 0x1); // c.li rd, 0
+                    else if (a == ZERO || b == ZERO)
+                        half = static_cast<uint16_t>(0x8002 | num(rd) << 7 | num(a == ZERO ? b : a) << 2); // c.mv
+                    else if (rd == a || rd == b)
+                        half = static_cast<uint16_t>(0x9002 | num(rd) << 7 | num(rd == a ? b : a) << 2); // c.add
+                    else
+                        return false;
+                    return true;
+                }
+                case SUB:
+                case XOR:
+                case OR:
+                case AND:
+                {
+                    const unsigned rd = ops[0].reg();
+                    unsigned rs = ops[2].reg();
+                    if (rd != ops[1].reg())
+                    {
+                        if (mi.opcode() == SUB || rd != ops[2].reg())
+                            return false;
+                        rs = ops[1].reg();
+                    }
+                    if (!creg(rd) || !creg(rs))
+                        return false;
+                    const unsigned funct2 = mi.opcode() == SUB ? 0 : mi.opcode() == XOR ? 1 : mi.opcode() == OR ? 2 : 3;
+                    half = static_cast<uint16_t>(0x8C01 | cnum(rd) << 7 | funct2 << 5 | cnum(rs) << 2);
+                    return true;
+                }
+                case ADDI:
+                {
+                    const unsigned rd = ops[0].reg(), rs = ops[1].reg();
+                    const int64_t value = ops[2].imm();
+                    if (rd == ZERO)
+                    {
+                        if (rs != ZERO || value != 0)
+                            return false;
+                        half = 0x0001;
+                    }
+                    else if (value == 0 && rs != ZERO)
+                        half = static_cast<uint16_t>(0x8002 | num(rd) << 7 | num(rs) << 2); // c.mv
+                    else if (rs == ZERO && fits_signed(value, 6))
+                        half = ci(0b010, rd, value, 0x1); // c.li
+                    else if (rd == rs && fits_signed(value, 6))
+                        half = ci(0b000, rd, value, 0x1); // c.addi
+                    else if (rd == SP && rs == SP && value % 16 == 0 && fits_signed(value, 10))
+                        half = static_cast<uint16_t>(0x6101 | bits(value, 9, 9) << 12 | bits(value, 4, 4) << 6 |
+                                                     bits(value, 6, 6) << 5 | bits(value, 8, 7) << 3 |
+                                                     bits(value, 5, 5) << 2); // c.addi16sp
+                    else if (rs == SP && creg(rd) && value > 0 && value < 1024 && value % 4 == 0)
+                        half = static_cast<uint16_t>(bits(value, 5, 4) << 11 | bits(value, 9, 6) << 7 |
+                                                     bits(value, 2, 2) << 6 | bits(value, 3, 3) << 5 |
+                                                     cnum(rd) << 2); // c.addi4spn
+                    else
+                        return false;
+                    return true;
+                }
+                case ADDIW:
+                    if (ops[0].reg() == ZERO || ops[0].reg() != ops[1].reg() || !fits_signed(ops[2].imm(), 6))
+                        return false;
+                    half = ci(0b001, ops[0].reg(), ops[2].imm(), 0x1);
+                    return true;
+                case ANDI:
+                case SRLI:
+                case SRAI:
+                {
+                    const unsigned rd = ops[0].reg();
+                    const int64_t value = ops[2].imm();
+                    if (rd != ops[1].reg() || !creg(rd))
+                        return false;
+                    if (mi.opcode() == ANDI ? !fits_signed(value, 6) : value == 0)
+                        return false;
+                    const unsigned funct2 = mi.opcode() == SRLI ? 0 : mi.opcode() == SRAI ? 1 : 2;
+                    half = static_cast<uint16_t>(0x8001 | bits(value, 5, 5) << 12 | funct2 << 10 | cnum(rd) << 7 |
+                                                 bits(value, 4, 0) << 2);
+                    return true;
+                }
+                case SLLI:
+                    if (ops[0].reg() == ZERO || ops[0].reg() != ops[1].reg() || ops[2].imm() == 0)
+                        return false;
+                    half = ci(0b000, ops[0].reg(), ops[2].imm(), 0x2);
+                    return true;
+                case LUI:
+                {
+                    const unsigned rd = ops[0].reg();
+                    const int64_t value = ops[1].imm();
+                    if (rd == ZERO || rd == SP || value == 0 || (value >= 32 && value < 0xFFFE0))
+                        return false;
+                    half = ci(0b011, rd, value, 0x1);
+                    return true;
+                }
+                default:
+                    return compress_memory(mi, half);
+                }
+            }
+
+            //===----------------------- Layout ---------------------------===//
+
+            static uint64_t size(const Item &item)
+            {
+                switch (item.form)
+                {
+                case Form::Fixed:
+                    return item.code_size;
+                case Form::Branch:
+                case Form::Jump:
+                case Form::Call:
+                    return item.level == 0 ? 2 : item.level == 1 ? 4 : 8;
+                default:
+                    return 8;
+                }
+            }
+
+            void layout()
+            {
+                uint64_t offset = 0;
+                for (auto &item : items_)
+                {
+                    item.offset = offset;
+                    offset += size(item);
+                }
+                text_bytes_ = offset;
+                for (const Mark &mark : marks_)
+                    object_.symbols[mark.symbol].offset = mark.item < items_.size() ? items_[mark.item].offset : text_bytes_;
+            }
+
+            int64_t distance(const Item &item, uint64_t from) const
+            {
+                return static_cast<int64_t>(symbol(item.symbol).offset) - static_cast<int64_t>(from);
+            }
+
+            // Whether the target is in reach of the item's current form; the
+            // widest forms always are, or report why not when encoded
+            bool fits(const Item &item) const
+            {
+                const int64_t delta = distance(item, item.offset);
+                switch (item.form)
+                {
+                case Form::Branch:
+                    return item.level == 0 ? fits_signed(delta, 9) : item.level == 1 ? fits_signed(delta, 13) : true;
+                case Form::Call:
+                    return item.level == 0 ? fits_signed(delta, 12) : item.level == 1 ? fits_signed(delta, 21) : true;
+                case Form::Jump:
+                    if (item.level == 0)
+                        return fits_signed(delta, 12);
+                    // Only a tail jump to a function may clobber t1 to go further
+                    if (item.level == 1)
+                        return fits_signed(delta, 21) || symbol(item.symbol).kind != RISCVSymbolKind::Function;
+                    return true;
+                default:
+                    return true;
+                }
+            }
+
+            // Everything starts short; a form only ever grows, which only moves
+            // later offsets up, so this settles after a few rounds
+            void relax()
+            {
+                bool changed = true;
+                while (changed)
+                {
+                    layout();
+                    changed = false;
+                    for (auto &item : items_)
+                    {
+                        if (!fits(item))
+                        {
+                            ++item.level;
+                            changed = true;
+                        }
+                    }
+                }
+
+                for (size_t i = 0; i < function_symbols_.size(); ++i)
+                {
+                    const uint64_t end = i + 1 < function_symbols_.size() ? symbol(function_symbols_[i + 1]).offset
+                                                                          : text_bytes_;
+                    object_.symbols[function_symbols_[i]].size = end - symbol(function_symbols_[i]).offset;
+                }
+            }
+
+            //===----------------------- Encoding -------------------------===//
+
+            uint32_t word(unsigned opcode, const std::vector<MOperand> &ops) const
+            {
+                return tii_->get_binary_encoding(MachineInst(opcode, ops));
+            }
+
+            void reloc(RISCVRelocType type, uint32_t symbol)
+            {
+                object_.text_relocations.push_back({object_.text.size(), symbol, type});
+            }
+
+            static unsigned inverse(unsigned opcode)
+            {
+                switch (opcode)
+                {
+                case BEQ:
+                    return BNE;
+                case BNE:
+                    return BEQ;
+                case BLT:
+                    return BGE;
+                case BGE:
+                    return BLT;
+                case BLTU:
+                    return BGEU;
+                default:
+                    return BLTU;
+                }
+            }
+
+            // AUIPC rd, %pcrel_hi; then an I-type `opcode rd2, rd, %pcrel_lo`
+            void pc_relative(unsigned rd, unsigned opcode, unsigned rd2, int64_t delta)
+            {
+                if (!fits_signed(delta, 32))
+                    throw EmitError("pc-relative offset does not fit 32 bits");
+                put32(object_.text, word(AUIPC, {reg(rd, true), imm(hi20(delta))}));
+                put32(object_.text, word(opcode, {reg(rd2, true), reg(rd), imm(sext12(delta))}));
+            }
+
+            void encode(const Item &item)
+            {
+                const MachineInst &mi = *item.mi;
+                const auto &ops = mi.operands();
+                const int64_t delta = item.form == Form::Fixed ? 0 : distance(item, item.offset);
+                switch (item.form)
+                {
+                case Form::Fixed:
+                    object_.text.insert(object_.text.end(), fixed_.begin() + item.code,
+                                        fixed_.begin() + item.code + item.code_size);
+                    break;
+                case Form::Branch:
+                    if (item.level == 0)
+                        put16(object_.text, cb(mi.opcode() == BEQ ? 0b110 : 0b111, compressed_branch_reg(mi), delta));
+                    else if (item.level == 1)
+                        put32(object_.text, word(mi.opcode(), {ops[0], ops[1], imm(delta)}));
+                    else
+                    {
+                        if (!fits_signed(delta - 4, 21))
+                            throw EmitError(describe(mi) + " target is beyond the range of JAL");
+                        put32(object_.text, word(inverse(mi.opcode()), {ops[0], ops[1], imm(8)}));
+                        put32(object_.text, word(JAL, {reg(ZERO, true), imm(delta - 4)}));
+                    }
+                    break;
+                case Form::Jump:
+                    if (item.level == 0)
+                        put16(object_.text, cj(0b101, delta));
+                    else if (item.level == 1)
+                    {
+                        if (!fits_signed(delta, 21))
+                            throw EmitError(describe(mi) + " to `" + symbol(item.symbol).name +
+                                            "` is beyond the range of JAL");
+                        put32(object_.text, word(JAL, {reg(ZERO, true), imm(delta)}));
+                    }
+                    else
+                        pc_relative(T1, JALR, ZERO, delta);
+                    break;
+                case Form::Call:
+                    if (item.level == 0)
+                        put16(object_.text, cj(0b001, delta));
+                    else if (item.level == 1)
+                        put32(object_.text, word(JAL, {reg(RA, true), imm(delta)}));
+                    else
+                        pc_relative(RA, JALR, RA, delta);
+                    break;
+                case Form::Plt:
+                {
+                    // `call` links through ra; `tail` may only clobber t1
+                    const bool call = mi.opcode() == CALL;
+                    reloc(R_RISCV_CALL_PLT, item.symbol);
+                    pc_relative(call ? RA : T1, JALR, call ? RA : ZERO, 0);
+                    break;
+                }
+                case Form::LoadAddress:
+                    if (in_text(item.symbol))
+                        pc_relative(ops[0].reg(), ADDI, ops[0].reg(), delta);
+                    else
+                    {
+                        reloc(R_RISCV_PCREL_HI20, item.symbol);
+                        object_.text_relocations.push_back({object_.text.size() + 4, item.label, R_RISCV_PCREL_LO12_I});
+                        pc_relative(ops[0].reg(), ADDI, ops[0].reg(), 0);
+                    }
+                    break;
+                }
+            }
+
+            void encode()
+            {
+                object_.text.reserve(text_bytes_);
+                for (const auto &item : items_)
+                    encode(item);
+                MO_ASSERT(object_.text.size() == text_bytes_, "Encoded text does not match its layout");
+            }
+
+            //===------------------------- Data ---------------------------===//
+
+            void emit_data()
+            {
+                const size_t pointer_bytes = rv64_ ? 8 : 4;
+                uint64_t cursor = 0;
+                for (const GlobalVariable *gv : globals_)
+                {
+                    const Type *type = global_value_type(gv);
+                    const uint64_t align = std::max<uint64_t>(type->alignment(), 1);
+                    object_.data_alignment = std::max(object_.data_alignment, align);
+                    cursor = (cursor + align - 1) / align * align;
+                    RISCVSymbol &symbol = object_.symbols[global_symbols_.at(gv)];
+                    symbol.offset = cursor;
+                    symbol.size = type->size();
+                    cursor += type->size();
+                }
+                object_.data.assign(cursor, 0);
+
+                for (const GlobalVariable *gv : globals_)
+                {
+                    if (!gv->initializer())
+                        continue;
+                    const RISCVSymbol &symbol = object_.symbols[global_symbols_.at(gv)];
+                    const std::span<uint8_t> bytes(object_.data.data() + symbol.offset, symbol.size);
+                    std::vector<GlobalAddressField> fields;
+                    std::string err;
+                    if (!write_initializer(gv->initializer(), bytes, false, fields, &err))
+                        throw EmitError(err);
+                    // The bytes stay zero; RELA relocations carry the addend
+                    for (const auto &field : fields)
+                    {
+                        if (field.offset + pointer_bytes > bytes.size())
+                            throw EmitError("address of `" + field.global->name() + "` does not fit in `" +
+                                            gv->name() + "`");
+                        object_.data_relocations.push_back({symbol.offset + field.offset, global_symbols_.at(field.global),
+                                                            rv64_ ? R_RISCV_64 : R_RISCV_32});
+                    }
+                }
+            }
+        };
+    } // namespace
+
+    bool emit_object(const MachineModule &mm, RISCVObject &object, const RISCVEmitOptions &options, std::string *err_msg)
+    {
+        try
+        {
+            Emitter(mm, object, options).run();
+            return true;
+        }
+        catch (const EmitError &e)
+        {
+            if (err_msg)
+                *err_msg = e.what();
+            return false;
+        }
+    }
+} // namespace RISCV
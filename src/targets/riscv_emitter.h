@@ -0,0 +1,34 @@
+// riscv_emitter.h - Encodes an allocated RISC-V module into an ELF object
+#pragma once
+
+#include "../machine.h"
+#include "riscv_object.h"
+#include <string>
+
+namespace RISCV
+{
+    struct RISCVEmitOptions
+    {
+        bool compress = true; // pick 16-bit RVC forms where the operands fit
+    };
+
+    // XLEN and the float ABI follow the ABI of the module's
+    // RISCVTargetInstInfo. Functions are laid out in module order, and the
+    // globals of the IR module (plus any other global an instruction names)
+    // go in .data. Pseudos expand as an assembler would: LI into
+    // LUI/ADDI(W)/SLLI, LA into AUIPC+ADDI, and MV into ADDI.
+    //
+    // Branches, jumps and calls within the module are resolved here, so the
+    // object carries no linker relaxation. They start in their shortest form
+    // and are widened until every target fits:
+    //   Bxx            C.BEQZ/C.BNEZ, Bxx, or the inverted Bxx over a JAL
+    //   J              C.J or JAL x0
+    //   CALL           C.JAL (RV32 only), JAL ra, or AUIPC ra + JALR ra
+    // Calls to undefined functions are AUIPC ra + JALR ra with
+    // R_RISCV_CALL_PLT, and addresses of globals use PCREL_HI20/LO12_I.
+    //
+    // Expects registers to be allocated and frame indices resolved. Returns
+    // false with `err_msg` set when something cannot be encoded.
+    bool emit_object(const MachineModule &mm, RISCVObject &object, const RISCVEmitOptions &options = {},
+                     std::string *err_msg = nullptr);
+} // namespace RISCV
@@ -0,0 +1,235 @@
+#include "riscv_isel.h"
+#include <bit>
+
+namespace RISCV
+{
+    RISCVISelInfo::RISCVISelInfo(const RISCVTargetInstInfo *tii) : TargetISelInfo(tii)
+    {
+        int_class_ = GR64;
+        float_class_ = FP32;
+        double_class_ = FP64;
+        register_bits_ = 64;
+        frame_reg_ = SP;
+        zero_reg_ = ZERO;
+        memory_offset_bits_ = 12;
+        load_imm_opcode_ = LI;
+        jump_opcode_ = J;
+        call_opcode_ = CALL;
+        return_opcode_ = RET;
+        int_arg_regs_ = {A0, A1, A2, A3, A4, A5, A6, A7};
+        fp_arg_regs_ = {F10, F11, F12, F13, F14, F15, F16, F17};
+        fast_int_arg_regs_ = {A0, A1, A2, A3, A4, A5, A6, A7, T3, T4, T5, T6};
+        fast_fp_arg_regs_ = {F10, F11, F12, F13, F14, F15, F16, F17, F28, F29, F30, F31};
+        int_return_reg_ = A0;
+        fp_return_reg_ = F10;
+
+        constexpr int any = ISelPattern::ANY_PREDICATE;
+        const auto reg_imm = [this](::Opcode ir_opcode, unsigned opcode, unsigned imm_bits, bool commutative)
+        {
+            add_pattern({.ir_opcode = ir_opcode, .predicate = any, .form = ISelForm::RegImm, .machine_opcode = opcode,
+                         .imm_bits = imm_bits, .commutative = commutative});
+        };
+        const auto reg_reg = [this](::Opcode ir_opcode, unsigned opcode, ISelType type)
+        {
+            add_pattern({.ir_opcode = ir_opcode, .predicate = any, .form = ISelForm::RegReg, .machine_opcode = opcode,
+                         .type = type});
+        };
+
+        reg_imm(::Opcode::Add, ADDI, 12, true);
+        reg_reg(::Opcode::Add, ADD, ISelType::Int);
+        add_pattern({.ir_opcode = ::Opcode::Sub, .predicate = any, .form = ISelForm::RegImm, .machine_opcode = ADDI,
+                     .imm_bits = 12, .negate_imm = true});
+        reg_reg(::Opcode::Sub, SUB, ISelType::Int);
+        reg_imm(::Opcode::BitAnd, ANDI, 12, true);
+        reg_reg(::Opcode::BitAnd, AND, ISelType::Int);
+        reg_imm(::Opcode::BitOr, ORI, 12, true);
+        reg_reg(::Opcode::BitOr, OR, ISelType::Int);
+        reg_imm(::Opcode::BitXor, XORI, 12, true);
+        reg_reg(::Opcode::BitXor, XOR, ISelType::Int);
+        reg_imm(::Opcode::Shl, SLLI, 6, false);
+        reg_reg(::Opcode::Shl, SLL, ISelType::Int);
+        reg_imm(::Opcode::LShr, SRLI, 6, false);
+        reg_reg(::Opcode::LShr, SRL, ISelType::Int);
+        reg_imm(::Opcode::AShr, SRAI, 6, false);
+        reg_reg(::Opcode::AShr, SRA, ISelType::Int);
+        reg_reg(::Opcode::Mul, MUL, ISelType::Int);
+        reg_reg(::Opcode::SDiv, DIV, ISelType::Int);
+        reg_reg(::Opcode::UDiv, DIVU, ISelType::Int);
+        reg_reg(::Opcode::SRem, REM, ISelType::Int);
+        reg_reg(::Opcode::URem, REMU, ISelType::Int);
+
+        reg_reg(::Opcode::Add, FADD_S, ISelType::F32);
+        reg_reg(::Opcode::Sub, FSUB_S, ISelType::F32);
+        reg_reg(::Opcode::Mul, FMUL_S, ISelType::F32);
+        reg_reg(::Opcode::SDiv, FDIV_S, ISelType::F32);
+        reg_reg(::Opcode::Add, FADD_D, ISelType::F64);
+        reg_reg(::Opcode::Sub, FSUB_D, ISelType::F64);
+        reg_reg(::Opcode::Mul, FMUL_D, ISelType::F64);
+        reg_reg(::Opcode::SDiv, FDIV_D, ISelType::F64);
+
+        // One 128-bit vector register per value, with vl and vtype set
+        // for its element type before each instruction
+        if (tii->has_vector())
+        {
+            vector_class_ = VR;
+            vector_bytes_ = 16;
+            vector_state_reg_ = VTYPE;
+            reg_reg(::Opcode::Add, VADD_VV, ISelType::IntVector);
+            reg_reg(::Opcode::Sub, VSUB_VV, ISelType::IntVector);
+            reg_reg(::Opcode::BitAnd, VAND_VV, ISelType::IntVector);
+            reg_reg(::Opcode::BitOr, VOR_VV, ISelType::IntVector);
+            reg_reg(::Opcode::BitXor, VXOR_VV, ISelType::IntVector);
+            reg_reg(::Opcode::Shl, VSLL_VV, ISelType::IntVector);
+            reg_reg(::Opcode::LShr, VSRL_VV, ISelType::IntVector);
+            reg_reg(::Opcode::AShr, VSRA_VV, ISelType::IntVector);
+            reg_reg(::Opcode::Mul, VMUL_VV, ISelType::IntVector);
+            reg_reg(::Opcode::SDiv, VDIV_VV, ISelType::IntVector);
+            reg_reg(::Opcode::UDiv, VDIVU_VV, ISelType::IntVector);
+            reg_reg(::Opcode::SRem, VREM_VV, ISelType::IntVector);
+            reg_reg(::Opcode::URem, VREMU_VV, ISelType::IntVector);
+            reg_reg(::Opcode::Add, VFADD_VV, ISelType::FloatVector);
+            reg_reg(::Opcode::Sub, VFSUB_VV, ISelType::FloatVector);
+            reg_reg(::Opcode::Mul, VFMUL_VV, ISelType::FloatVector);
+            reg_reg(::Opcode::SDiv, VFDIV_VV, ISelType::FloatVector);
+        }
+
+        // Values of comparisons: `<` directly, `>` with the operands
+        // swapped, and the rest as the inverse of one of those
+        const struct
+        {
+            ICmpInst::Predicate signed_pred, unsigned_pred;
+            bool swap, invert;
+        } relations[] = {
+            {ICmpInst::SLT, ICmpInst::ULT, false, false},
+            {ICmpInst::SGT, ICmpInst::UGT, true, false},
+            {ICmpInst::SLE, ICmpInst::ULE, true, true},
+            {ICmpInst::SGE, ICmpInst::UGE, false, true},
+        };
+        for (const auto &r : relations)
+        {
+            std::vector<std::pair<unsigned, int64_t>> then;
+            if (r.invert)
+                then.emplace_back(XORI, 1);
+            if (!r.swap)
+            {
+                add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = r.signed_pred, .form = ISelForm::RegImm,
+                             .machine_opcode = SLTI, .imm_bits = 12, .then = then});
+                add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = r.unsigned_pred, .form = ISelForm::RegImm,
+                             .machine_opcode = SLTIU, .imm_bits = 12, .then = then});
+            }
+            add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = r.signed_pred, .form = ISelForm::RegReg,
+                         .machine_opcode = SLT, .swap_operands = r.swap, .then = then});
+            add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = r.unsigned_pred, .form = ISelForm::RegReg,
+                         .machine_opcode = SLTU, .swap_operands = r.swap, .then = then});
+        }
+        // Equality through the difference: zero iff equal
+        add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = ICmpInst::EQ, .form = ISelForm::RegImm,
+                     .machine_opcode = XORI, .imm_bits = 12, .commutative = true, .then = {{SLTIU, 1}}});
+        add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = ICmpInst::EQ, .form = ISelForm::RegReg,
+                     .machine_opcode = XOR, .then = {{SLTIU, 1}}});
+        add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = ICmpInst::NE, .form = ISelForm::RegImm,
+                     .machine_opcode = XORI, .imm_bits = 12, .commutative = true, .then = {{SLTIU, 1}, {XORI, 1}}});
+        add_pattern({.ir_opcode = ::Opcode::ICmp, .predicate = ICmpInst::NE, .form = ISelForm::RegReg,
+                     .machine_opcode = XOR, .then = {{SLTIU, 1}, {XORI, 1}}});
+
+        const struct
+        {
+            ICmpInst::Predicate pred;
+            unsigned opcode;
+            bool swap;
+        } branches[] = {
+            {ICmpInst::EQ, BEQ, false},   {ICmpInst::NE, BNE, false},   {ICmpInst::SLT, BLT, false},
+            {ICmpInst::SGE, BGE, false},  {ICmpInst::SGT, BLT, true},   {ICmpInst::SLE, BGE, true},
+            {ICmpInst::ULT, BLTU, false}, {ICmpInst::UGE, BGEU, false}, {ICmpInst::UGT, BLTU, true},
+            {ICmpInst::ULE, BGEU, true},
+        };
+        for (const auto &b : branches)
+        {
+            add_pattern({.ir_opcode = ::Opcode::CondBr, .predicate = b.pred, .form = ISelForm::BranchRegReg,
+                         .machine_opcode = b.opcode, .swap_operands = b.swap});
+        }
+    }
+
+    unsigned RISCVISelInfo::load_opcode(const Type *type) const
+    {
+        if (const VectorType *vector = type->as_vector())
+        {
+            if (vector_bytes_ == 0 || vector->size() != vector_bytes_ || vector->element_type()->size() > 8)
+                return 0;
+            const unsigned loads[] = {VLE8_V, VLE16_V, 0, VLE32_V, 0, 0, 0, VLE64_V};
+            return loads[vector->element_type()->size() - 1];
+        }
+        // Narrow integers are kept zero-extended
+        if (type->is_float())
+            return type->size() == 8 ? FLD : FLW;
+        switch (type->size())
+        {
+        case 1:
+            return LBU;
+        case 2:
+            return LHU;
+        case 4:
+            return LW;
+        case 8:
+            return LD;
+        default:
+            return 0;
+        }
+    }
+
+    unsigned RISCVISelInfo::store_opcode(const Type *type) const
+    {
+        if (const VectorType *vector = type->as_vector())
+        {
+            if (vector_bytes_ == 0 || vector->size() != vector_bytes_ || vector->element_type()->size() > 8)
+                return 0;
+            const unsigned stores[] = {VSE8_V, VSE16_V, 0, VSE32_V, 0, 0, 0, VSE64_V};
+            return stores[vector->element_type()->size() - 1];
+        }
+        if (type->is_float())
+            return type->size() == 8 ? FSD : FSW;
+        switch (type->size())
+        {
+        case 1:
+            return SB;
+        case 2:
+            return SH;
+        case 4:
+            return SW;
+        case 8:
+            return SD;
+        default:
+            return 0;
+        }
+    }
+
+    std::unique_ptr<MachineInst> RISCVISelInfo::build_global_address(unsigned rd, GlobalVariable *global) const
+    {
+        return std::make_unique<MachineInst>(LA, std::vector<MOperand>{MOperand::create_reg(rd, true),
+                                                                        MOperand::create_global(global)});
+    }
+
+    std::unique_ptr<MachineInst> RISCVISelInfo::build_vector_config(const VectorType *type) const
+    {
+        // vsetivli zero, n, e<sew>, m1, ta, ma
+        const unsigned sew = static_cast<unsigned>(std::countr_zero(type->element_type()->size()));
+        auto config = std::make_unique<MachineInst>(VSETIVLI, std::vector<MOperand>{
+                                                                  MOperand::create_reg(ZERO, true),
+                                                                  MOperand::create_imm(type->num_elements()),
+                                                                  MOperand::create_imm(sew << 3 | 0xC0)});
+        config->set_implicit_defs({VTYPE});
+        return config;
+    }
+
+    std::unique_ptr<MachineInst> RISCVISelInfo::build_copy(unsigned rd, unsigned rs, bool is_fp) const
+    {
+        // Same forms as copy_phys_reg
+        if (is_fp)
+            return std::make_unique<MachineInst>(FADD_D, std::vector<MOperand>{MOperand::create_reg(rd, true),
+                                                                                MOperand::create_reg(rs),
+                                                                                MOperand::create_reg(rs)});
+        return std::make_unique<MachineInst>(ADD, std::vector<MOperand>{MOperand::create_reg(rd, true),
+                                                                         MOperand::create_reg(rs),
+                                                                         MOperand::create_reg(ZERO)});
+    }
+} // namespace RISCV
@@ -0,0 +1,24 @@
+// riscv_isel.h - RISC-V instruction selection patterns
+#pragma once
+
+#include "../isel.h"
+#include "riscv_target.h"
+
+namespace RISCV
+{
+    // RV64IMFD under the LP64D calling convention. Comparisons producing a
+    // value go through SLT/SLTU and XORI, and branches compare two registers
+    // directly, with x0 standing in for zero. With the V extension, vectors
+    // of 16 bytes take a V register and a VSETIVLI for their element type
+    class RISCVISelInfo : public TargetISelInfo
+    {
+    public:
+        explicit RISCVISelInfo(const RISCVTargetInstInfo *tii);
+
+        unsigned load_opcode(const Type *type) const override;
+        unsigned store_opcode(const Type *type) const override;
+        std::unique_ptr<MachineInst> build_global_address(unsigned rd, GlobalVariable *global) const override;
+        std::unique_ptr<MachineInst> build_copy(unsigned rd, unsigned rs, bool is_fp) const override;
+        std::unique_ptr<MachineInst> build_vector_config(const VectorType *type) const override;
+    };
+} // namespace RISCV
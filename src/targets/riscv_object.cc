@@ -0,0 +1,305 @@
+#include "riscv_object.h"
+
+#include <algorithm>
+#include <fstream>
+
+namespace RISCV
+{
+    namespace
+    {
+        constexpr uint16_t ET_REL = 1;
+        constexpr uint16_t EM_RISCV = 243;
+        constexpr uint32_t EF_RISCV_RVC = 0x1;
+        constexpr uint32_t EF_RISCV_FLOAT_ABI_SINGLE = 0x2;
+        constexpr uint32_t EF_RISCV_FLOAT_ABI_DOUBLE = 0x4;
+
+        constexpr uint32_t SHT_PROGBITS = 1;
+        constexpr uint32_t SHT_SYMTAB = 2;
+        constexpr uint32_t SHT_STRTAB = 3;
+        constexpr uint32_t SHT_RELA = 4;
+        constexpr uint64_t SHF_WRITE = 0x1;
+        constexpr uint64_t SHF_ALLOC = 0x2;
+        constexpr uint64_t SHF_EXECINSTR = 0x4;
+        constexpr uint64_t SHF_INFO_LINK = 0x40;
+
+        constexpr uint8_t STB_LOCAL = 0;
+        constexpr uint8_t STB_GLOBAL = 1;
+        constexpr uint8_t STT_NOTYPE = 0;
+        constexpr uint8_t STT_OBJECT = 1;
+        constexpr uint8_t STT_FUNC = 2;
+
+        // Section header indices; .rela.* follow the section they patch
+        enum : uint16_t
+        {
+            SEC_NULL,
+            SEC_TEXT,
+            SEC_DATA,
+            SEC_RELA_TEXT,
+            SEC_RELA_DATA,
+            SEC_SYMTAB,
+            SEC_STRTAB,
+            SEC_SHSTRTAB,
+            SECTION_COUNT
+        };
+
+        // Little-endian fields, with addresses and offsets as wide as the class
+        class ELFWriter
+        {
+        public:
+            explicit ELFWriter(bool elf64) : elf64_(elf64) {}
+
+            std::vector<uint8_t> bytes;
+
+            void u8(uint8_t value) { bytes.push_back(value); }
+            void u16(uint16_t value) { put(value, 2); }
+            void u32(uint32_t value) { put(value, 4); }
+            void u64(uint64_t value) { put(value, 8); }
+            void word(uint64_t value) { put(value, elf64_ ? 8 : 4); }
+            void append(const std::vector<uint8_t> &data) { bytes.insert(bytes.end(), data.begin(), data.end()); }
+            void align(size_t alignment)
+            {
+                while (bytes.size() % alignment != 0)
+                    bytes.push_back(0);
+            }
+
+        private:
+            bool elf64_;
+
+            void put(uint64_t value, size_t size)
+            {
+                for (size_t i = 0; i < size; ++i)
+                    bytes.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        };
+
+        class StringTable
+        {
+        public:
+            std::vector<uint8_t> bytes{0};
+
+            uint32_t add(const std::string &name)
+            {
+                if (name.empty())
+                    return 0;
+                const uint32_t offset = static_cast<uint32_t>(bytes.size());
+                bytes.insert(bytes.end(), name.begin(), name.end());
+                bytes.push_back(0);
+                return offset;
+            }
+        };
+
+        bool is_local(RISCVSymbolKind kind) { return kind == RISCVSymbolKind::Block || kind == RISCVSymbolKind::Label; }
+
+        uint8_t symbol_type(RISCVSymbolKind kind)
+        {
+            switch (kind)
+            {
+            case RISCVSymbolKind::Function:
+                return STT_FUNC;
+            case RISCVSymbolKind::Object:
+                return STT_OBJECT;
+            default:
+                return STT_NOTYPE;
+            }
+        }
+
+        uint16_t section_index(RISCVSection section)
+        {
+            switch (section)
+            {
+            case RISCVSection::Text:
+                return SEC_TEXT;
+            case RISCVSection::Data:
+                return SEC_DATA;
+            default:
+                return SEC_NULL;
+            }
+        }
+
+        struct SectionHeader
+        {
+            uint32_t name = 0;
+            uint32_t type = 0;
+            uint64_t flags = 0;
+            uint64_t offset = 0;
+            uint64_t size = 0;
+            uint32_t link = 0;
+            uint32_t info = 0;
+            uint64_t alignment = 0;
+            uint64_t entry_size = 0;
+        };
+    } // namespace
+
+    const RISCVSymbol *RISCVObject::find_symbol(const std::string &name) const
+    {
+        for (const auto &symbol : symbols)
+        {
+            if (symbol.name == name)
+                return &symbol;
+        }
+        return nullptr;
+    }
+
+    std::vector<uint8_t> RISCVObject::to_elf() const
+    {
+        const size_t header_bytes = rv64 ? 64 : 52;
+        const size_t section_header_bytes = rv64 ? 64 : 40;
+        const size_t symbol_bytes = rv64 ? 24 : 16;
+        const size_t rela_bytes = rv64 ? 24 : 12;
+
+        // Index 0 is the null symbol, then locals, then globals
+        std::vector<uint32_t> order;
+        for (uint32_t i = 0; i < symbols.size(); ++i)
+        {
+            if (is_local(symbols[i].kind))
+                order.push_back(i);
+        }
+        const uint32_t first_global = static_cast<uint32_t>(order.size()) + 1;
+        for (uint32_t i = 0; i < symbols.size(); ++i)
+        {
+            if (!is_local(symbols[i].kind))
+                order.push_back(i);
+        }
+        std::vector<uint32_t> elf_index(symbols.size());
+        for (uint32_t i = 0; i < order.size(); ++i)
+            elf_index[order[i]] = i + 1;
+
+        StringTable strtab;
+        ELFWriter symtab(rv64);
+        symtab.bytes.resize(symbol_bytes, 0);
+        for (uint32_t index : order)
+        {
+            const RISCVSymbol &symbol = symbols[index];
+            const uint8_t info = static_cast<uint8_t>(((is_local(symbol.kind) ? STB_LOCAL : STB_GLOBAL) << 4) |
+                                                      symbol_type(symbol.kind));
+            const uint32_t name = strtab.add(symbol.name);
+            const uint16_t shndx = section_index(symbol.section);
+            if (rv64)
+            {
+                symtab.u32(name);
+                symtab.u8(info);
+                symtab.u8(0);
+                symtab.u16(shndx);
+                symtab.u64(symbol.offset);
+                symtab.u64(symbol.size);
+            }
+            else
+            {
+                symtab.u32(name);
+                symtab.u32(static_cast<uint32_t>(symbol.offset));
+                symtab.u32(static_cast<uint32_t>(symbol.size));
+                symtab.u8(info);
+                symtab.u8(0);
+                symtab.u16(shndx);
+            }
+        }
+
+        auto rela = [&](const std::vector<RISCVRelocation> &relocations)
+        {
+            ELFWriter out(rv64);
+            for (const auto &r : relocations)
+            {
+                const uint64_t symbol = elf_index[r.symbol];
+                out.word(r.offset);
+                out.word(rv64 ? (symbol << 32) | r.type : (symbol << 8) | r.type);
+                out.word(static_cast<uint64_t>(r.addend));
+            }
+            return out.bytes;
+        };
+        const std::vector<uint8_t> rela_text = rela(text_relocations);
+        const std::vector<uint8_t> rela_data = rela(data_relocations);
+
+        StringTable shstrtab;
+        SectionHeader sections[SECTION_COUNT];
+        sections[SEC_TEXT] = {shstrtab.add(".text"), SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR};
+        sections[SEC_TEXT].alignment = compressed ? 2 : 4;
+        sections[SEC_DATA] = {shstrtab.add(".data"), SHT_PROGBITS, SHF_ALLOC | SHF_WRITE};
+        sections[SEC_DATA].alignment = std::max<uint64_t>(data_alignment, 1);
+        sections[SEC_RELA_TEXT] = {shstrtab.add(".rela.text"), SHT_RELA, SHF_INFO_LINK};
+        sections[SEC_RELA_TEXT].link = SEC_SYMTAB;
+        sections[SEC_RELA_TEXT].info = SEC_TEXT;
+        sections[SEC_RELA_DATA] = {shstrtab.add(".rela.data"), SHT_RELA, SHF_INFO_LINK};
+        sections[SEC_RELA_DATA].link = SEC_SYMTAB;
+        sections[SEC_RELA_DATA].info = SEC_DATA;
+        sections[SEC_RELA_TEXT].entry_size = sections[SEC_RELA_DATA].entry_size = rela_bytes;
+        sections[SEC_RELA_TEXT].alignment = sections[SEC_RELA_DATA].alignment = rv64 ? 8 : 4;
+        sections[SEC_SYMTAB] = {shstrtab.add(".symtab"), SHT_SYMTAB};
+        sections[SEC_SYMTAB].link = SEC_STRTAB;
+        sections[SEC_SYMTAB].info = first_global;
+        sections[SEC_SYMTAB].entry_size = symbol_bytes;
+        sections[SEC_SYMTAB].alignment = rv64 ? 8 : 4;
+        sections[SEC_STRTAB] = {shstrtab.add(".strtab"), SHT_STRTAB};
+        sections[SEC_SHSTRTAB] = {shstrtab.add(".shstrtab"), SHT_STRTAB};
+        sections[SEC_STRTAB].alignment = sections[SEC_SHSTRTAB].alignment = 1;
+
+        ELFWriter out(rv64);
+        out.bytes.resize(header_bytes, 0);
+        const std::vector<uint8_t> *contents[SECTION_COUNT] = {
+            nullptr, &text, &data, &rela_text, &rela_data, &symtab.bytes, &strtab.bytes, &shstrtab.bytes};
+        for (unsigned i = SEC_TEXT; i < SECTION_COUNT; ++i)
+        {
+            out.align(sections[i].alignment);
+            sections[i].offset = out.bytes.size();
+            sections[i].size = contents[i]->size();
+            out.append(*contents[i]);
+        }
+        out.align(rv64 ? 8 : 4);
+        const uint64_t section_headers = out.bytes.size();
+        for (const SectionHeader &sh : sections)
+        {
+            out.u32(sh.name);
+            out.u32(sh.type);
+            out.word(sh.flags);
+            out.word(0); // sh_addr
+            out.word(sh.offset);
+            out.word(sh.size);
+            out.u32(sh.link);
+            out.u32(sh.info);
+            out.word(sh.alignment);
+            out.word(sh.entry_size);
+        }
+
+        uint32_t flags = compressed ? EF_RISCV_RVC : 0;
+        if (abi == ABIVersion::ILP32F || abi == ABIVersion::LP64F)
+            flags |= EF_RISCV_FLOAT_ABI_SINGLE;
+        else if (abi == ABIVersion::LP64D)
+            flags |= EF_RISCV_FLOAT_ABI_DOUBLE;
+
+        ELFWriter header(rv64);
+        for (uint8_t b : {uint8_t(0x7F), uint8_t('E'), uint8_t('L'), uint8_t('F')})
+            header.u8(b);
+        header.u8(rv64 ? 2 : 1); // EI_CLASS
+        header.u8(1);            // EI_DATA: little-endian
+        header.u8(1);            // EI_VERSION
+        header.bytes.resize(16, 0);
+        header.u16(ET_REL);
+        header.u16(EM_RISCV);
+        header.u32(1);
+        header.word(0); // e_entry
+        header.word(0); // e_phoff
+        header.word(section_headers);
+        header.u32(flags);
+        header.u16(static_cast<uint16_t>(header_bytes));
+        header.u16(0); // e_phentsize
+        header.u16(0); // e_phnum
+        header.u16(static_cast<uint16_t>(section_header_bytes));
+        header.u16(SECTION_COUNT);
+        header.u16(SEC_SHSTRTAB);
+        std::copy(header.bytes.begin(), header.bytes.end(), out.bytes.begin());
+        return out.bytes;
+    }
+
+    bool RISCVObject::write_file(const std::string &path, std::string *err_msg) const
+    {
+        const std::vector<uint8_t> bytes = to_elf();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!out.good())
+        {
+            if (err_msg)
+                *err_msg = "cannot write `" + path + "`";
+            return false;
+        }
+        return true;
+    }
+} // namespace RISCV
@@ -0,0 +1,74 @@
+// riscv_object.h - A RISC-V relocatable object and its ELF encoding
+#pragma once
+
+#include "riscv_target.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace RISCV
+{
+    enum class RISCVSection : uint8_t
+    {
+        Undefined,
+        Text,
+        Data,
+    };
+
+    enum class RISCVSymbolKind : uint8_t
+    {
+        Function,  // global, in .text
+        Block,     // local, a basic block as `function.label`
+        Label,     // local, the AUIPC a %pcrel_lo refers back to
+        Object,    // global, in .data
+        Undefined, // global, defined elsewhere
+    };
+
+    struct RISCVSymbol
+    {
+        std::string name;
+        RISCVSymbolKind kind;
+        RISCVSection section = RISCVSection::Undefined;
+        uint64_t offset = 0; // within its section
+        uint64_t size = 0;
+    };
+
+    // ELF relocation types of the RISC-V psABI that the emitter produces
+    enum RISCVRelocType : uint32_t
+    {
+        R_RISCV_32 = 1,
+        R_RISCV_64 = 2,
+        R_RISCV_CALL_PLT = 19,
+        R_RISCV_PCREL_HI20 = 23,
+        R_RISCV_PCREL_LO12_I = 24,
+    };
+
+    struct RISCVRelocation
+    {
+        uint64_t offset; // within the section it patches
+        uint32_t symbol; // index into RISCVObject::symbols
+        RISCVRelocType type;
+        int64_t addend = 0;
+    };
+
+    struct RISCVObject
+    {
+        bool rv64 = true;
+        bool compressed = true; // RVC encodings were allowed
+        ABIVersion abi = ABIVersion::LP64D;
+        std::vector<uint8_t> text;
+        std::vector<uint8_t> data;
+        uint64_t data_alignment = 1;
+        std::vector<RISCVSymbol> symbols;
+        std::vector<RISCVRelocation> text_relocations;
+        std::vector<RISCVRelocation> data_relocations;
+
+        const RISCVSymbol *find_symbol(const std::string &name) const;
+
+        // An ELF32/ELF64 relocatable object with .text, .data, their .rela
+        // sections, .symtab, .strtab and .shstrtab. Locals come first in the
+        // symbol table, as ELF requires.
+        std::vector<uint8_t> to_elf() const;
+        bool write_file(const std::string &path, std::string *err_msg = nullptr) const;
+    };
+} // namespace RISCV
@@ -0,0 +1,75 @@
+#include "riscv_peephole.h"
+
+namespace RISCV
+{
+    RISCVPeepholeInfo::RISCVPeepholeInfo(const RISCVTargetInstInfo *tii) : TargetPeepholeInfo(tii)
+    {
+        const ABIVersion abi = tii->abi_version();
+        const bool rv64 = abi != ABIVersion::ILP32 && abi != ABIVersion::ILP32F;
+
+        zero_reg_ = ZERO;
+        constant_opcodes_ = {LI};
+        arg_regs_ = {A0, A1, A2, A3, A4, A5, A6, A7, F10, F11, F12, F13, F14, F15, F16, F17};
+        caller_saved_regs_ = {T0, T1, T2, T3, T4, T5, T6, A0, A1, A2, A3, A4, A5, A6, A7,
+                              F0, F1, F2, F3, F4, F5, F6, F7, F10, F11, F12, F13, F14, F15, F16, F17,
+                              F28, F29, F30, F31};
+        if (tii->has_vector())
+        {
+            for (unsigned reg = V0; reg <= VTYPE; ++reg)
+                caller_saved_regs_.insert(reg);
+        }
+        return_regs_ = {A0, A1, F10, F11};
+
+        // `t = a - b` and `t = a ^ b` are zero exactly when a == b
+        for (unsigned compare : {SUB, XOR})
+        {
+            add_pattern({.kind = PeepholeKind::CompareBranch, .opcode = compare, .second_opcode = BEQ,
+                         .result_opcode = BEQ, .commutative = true});
+            add_pattern({.kind = PeepholeKind::CompareBranch, .opcode = compare, .second_opcode = BNE,
+                         .result_opcode = BNE, .commutative = true});
+        }
+        add_pattern({.kind = PeepholeKind::CompareBranch, .opcode = SLT, .second_opcode = BNE, .result_opcode = BLT});
+        add_pattern({.kind = PeepholeKind::CompareBranch, .opcode = SLT, .second_opcode = BEQ, .result_opcode = BGE});
+        add_pattern({.kind = PeepholeKind::CompareBranch, .opcode = SLTU, .second_opcode = BNE, .result_opcode = BLTU});
+        add_pattern({.kind = PeepholeKind::CompareBranch, .opcode = SLTU, .second_opcode = BEQ, .result_opcode = BGEU});
+
+        const auto fold = [this](unsigned opcode, unsigned imm_opcode, unsigned imm_bits, bool commutative)
+        {
+            add_pattern({.kind = PeepholeKind::FoldImmediate, .opcode = opcode, .result_opcode = imm_opcode,
+                         .commutative = commutative, .imm_bits = imm_bits});
+        };
+        fold(ADD, ADDI, 12, true);
+        add_pattern({.kind = PeepholeKind::FoldImmediate, .opcode = SUB, .result_opcode = ADDI, .imm_bits = 12,
+                     .negate_imm = true});
+        fold(AND, ANDI, 12, true);
+        fold(OR, ORI, 12, true);
+        fold(XOR, XORI, 12, true);
+        fold(SLT, SLTI, 12, false);
+        fold(SLTU, SLTIU, 12, false);
+        // Register shifts only read the low log2(XLEN) bits; the 6-bit check
+        // is only exact on RV64
+        if (rv64)
+        {
+            fold(SLL, SLLI, 6, false);
+            fold(SRL, SRLI, 6, false);
+            fold(SRA, SRAI, 6, false);
+        }
+
+        // On RV64, LW sign-extends, which a copy of the stored register does not
+        const auto forward = [this](unsigned store, unsigned load, unsigned bytes)
+        {
+            add_pattern({.kind = PeepholeKind::StoreReload, .opcode = store, .second_opcode = load,
+                         .access_bytes = bytes});
+        };
+        if (rv64)
+            forward(SD, LD, 8);
+        else
+            forward(SW, LW, 4);
+        forward(FSW, FLW, 4);
+        forward(FSD, FLD, 8);
+
+        // Every vector instruction is preceded by the vsetivli for its type,
+        // which runs of the same type only need once
+        add_pattern({.kind = PeepholeKind::RedundantSetup, .opcode = VSETIVLI});
+    }
+} // namespace RISCV
@@ -0,0 +1,17 @@
+// riscv_peephole.h - RISC-V peephole patterns
+#pragma once
+
+#include "../peephole.h"
+#include "riscv_target.h"
+
+namespace RISCV
+{
+    // Branches compare two registers, so SUB/XOR/SLT(U) feeding a branch
+    // against x0 fold into the branch itself, and LI feeds the I-type ALU
+    // forms. XLEN follows the ABI of the RISCVTargetInstInfo
+    class RISCVPeepholeInfo : public TargetPeepholeInfo
+    {
+    public:
+        explicit RISCVPeepholeInfo(const RISCVTargetInstInfo *tii);
+    };
+} // namespace RISCV
@@ -7,8 +7,8 @@ using namespace RISCV;
 // RegisterInfo Implementation
 //===----------------------------------------------------------------------===//
 
-RISCVRegisterInfo::RISCVRegisterInfo(ABIVersion abi)
-    : TargetRegisterInfo(64)
+RISCVRegisterInfo::RISCVRegisterInfo(ABIVersion abi, bool vector)
+    : TargetRegisterInfo(Reg::PC), vector_(vector && abi == ABIVersion::LP64D)
 {
     initializeRegisters(abi);
     initializeRegisterClasses(abi);
@@ -42,6 +42,9 @@ void RISCVRegisterInfo::initializeRegisters(ABIVersion abi)
         reg_descs_[reg].is_allocatable = false;
     }
 
+    // ra 从入口到返回一直保存返回地址；有调用时由序言存入栈帧
+    reg_descs_[Reg::RA].is_allocatable = false;
+
     // 配置被调用者保存的整型寄存器 (s0-s11)
     const std::vector<unsigned> callee_saved_int = {
         Reg::S0, Reg::S1,
@@ -89,6 +92,19 @@ void RISCVRegisterInfo::initializeRegisters(ABIVersion abi)
             reg_descs_[reg].is_allocatable = false;
         }
     }
+
+    // Vector registers only with the V extension; v0 is for masks
+    for (unsigned reg = Reg::V0; reg <= Reg::VTYPE; ++reg)
+    {
+        const bool allocatable = vector_ && reg != Reg::V0 && reg != Reg::VTYPE;
+        reg_descs_[reg].spill_cost = 8;
+        reg_descs_[reg].is_reserved = !allocatable;
+        reg_descs_[reg].is_allocatable = allocatable;
+    }
+    // t2 holds frame addresses an instruction can't reach by itself: vector
+    // spill slots, which take no offset, and slots more than 2 KiB from sp
+    reg_descs_[Reg::T2].is_reserved = true;
+    reg_descs_[Reg::T2].is_allocatable = false;
 }
 
 // 初始化寄存器类
@@ -189,6 +205,17 @@ void RISCVRegisterInfo::initializeRegisterClasses(ABIVersion abi)
         add_register_class(fp64_class); // 双精度浮点
     }
 
+    // One VLEN = 128 register per value, whatever its element type
+    if (vector_)
+    {
+        RegisterClass vr_class = {VR, "VR", {}, 1, 1};
+        for (unsigned reg = Reg::V1; reg <= Reg::V31; ++reg)
+        {
+            vr_class.regs.push_back(reg);
+        }
+        add_register_class(vr_class);
+    }
+
     // 更新寄存器描述符中的寄存器类信息
     for (unsigned reg = 0; reg < reg_descs_.size(); reg++)
     {
@@ -317,6 +344,24 @@ void RISCVRegisterInfo::initializeCallingConventions(ABIVersion abi)
         .stack_align = 4,
         .shadow_space = false,
     };
+    // No vector register survives a call, nor the vl and vtype set before it
+    if (vector_)
+    {
+        for (unsigned reg = Reg::V0; reg <= Reg::VTYPE; ++reg)
+        {
+            call_conventions_[CallingConv::C].caller_saved_regs.insert(reg);
+        }
+    }
+    // Arguments never go on the stack, so `j callee` leaves ra for it to return through
+    call_conventions_[CallingConv::C].supports_tail_call = true;
+
+    // Fast is only for functions internal to the module: the same saved
+    // registers as C, plus t3-t6 and ft8-ft11 for arguments
+    CallingConventionRules &fast = call_conventions_[CallingConv::Fast];
+    fast = call_conventions_[CallingConv::C];
+    fast.arg_passing.int_regs.insert(fast.arg_passing.int_regs.end(), {Reg::T3, Reg::T4, Reg::T5, Reg::T6});
+    if (has_float)
+        fast.arg_passing.fp_regs.insert(fast.arg_passing.fp_regs.end(), {Reg::F28, Reg::F29, Reg::F30, Reg::F31});
 }
 
 //===----------------------------------------------------------------------===//
@@ -360,6 +405,14 @@ const std::map<unsigned, std::string> opcode_names_ = {
     {RISCV::SRA, "sra"},
     {RISCV::OR, "or"},
     {RISCV::AND, "and"},
+    {RISCV::LD, "ld"},
+    {RISCV::SD, "sd"},
+    {RISCV::ADDIW, "addiw"},
+    {RISCV::MUL, "mul"},
+    {RISCV::DIV, "div"},
+    {RISCV::DIVU, "divu"},
+    {RISCV::REM, "rem"},
+    {RISCV::REMU, "remu"},
     {RISCV::RET, "ret"},
     {RISCV::NOP, "nop"},
     {RISCV::LI, "li"},
@@ -379,10 +432,39 @@ const std::map<unsigned, std::string> opcode_names_ = {
     {RISCV::FSUB_D, "fsub.d"},
     {RISCV::FMUL_D, "fmul.d"},
     {RISCV::FDIV_D, "fdiv.d"},
+    {RISCV::VSETIVLI, "vsetivli"},
+    {RISCV::VLE8_V, "vle8.v"},
+    {RISCV::VLE16_V, "vle16.v"},
+    {RISCV::VLE32_V, "vle32.v"},
+    {RISCV::VLE64_V, "vle64.v"},
+    {RISCV::VSE8_V, "vse8.v"},
+    {RISCV::VSE16_V, "vse16.v"},
+    {RISCV::VSE32_V, "vse32.v"},
+    {RISCV::VSE64_V, "vse64.v"},
+    {RISCV::VL1RE8_V, "vl1re8.v"},
+    {RISCV::VS1R_V, "vs1r.v"},
+    {RISCV::VMV1R_V, "vmv1r.v"},
+    {RISCV::VADD_VV, "vadd.vv"},
+    {RISCV::VSUB_VV, "vsub.vv"},
+    {RISCV::VAND_VV, "vand.vv"},
+    {RISCV::VOR_VV, "vor.vv"},
+    {RISCV::VXOR_VV, "vxor.vv"},
+    {RISCV::VSLL_VV, "vsll.vv"},
+    {RISCV::VSRL_VV, "vsrl.vv"},
+    {RISCV::VSRA_VV, "vsra.vv"},
+    {RISCV::VMUL_VV, "vmul.vv"},
+    {RISCV::VDIV_VV, "vdiv.vv"},
+    {RISCV::VDIVU_VV, "vdivu.vv"},
+    {RISCV::VREM_VV, "vrem.vv"},
+    {RISCV::VREMU_VV, "vremu.vv"},
+    {RISCV::VFADD_VV, "vfadd.vv"},
+    {RISCV::VFSUB_VV, "vfsub.vv"},
+    {RISCV::VFMUL_VV, "vfmul.vv"},
+    {RISCV::VFDIV_VV, "vfdiv.vv"},
 };
 
-RISCVTargetInstInfo::RISCVTargetInstInfo(ABIVersion abi)
-    : abi_version_(abi)
+RISCVTargetInstInfo::RISCVTargetInstInfo(ABIVersion abi, bool vector)
+    : abi_version_(abi), vector_(vector && abi == ABIVersion::LP64D)
 {
     // 如果支持浮点，添加浮点指令
     bool has_float = (abi == ABIVersion::ILP32F || abi == ABIVersion::LP64F || abi == ABIVersion::LP64D);
@@ -424,7 +506,15 @@ RISCVTargetInstInfo::RISCVTargetInstInfo(ABIVersion abi)
         {RISCV::SRL, 1},
         {RISCV::SRA, 1},
         {RISCV::OR, 1},
-        {RISCV::AND, 1}};
+        {RISCV::AND, 1},
+        {RISCV::LD, 3},
+        {RISCV::SD, 1},
+        {RISCV::ADDIW, 1},
+        {RISCV::MUL, 3},
+        {RISCV::DIV, 20},
+        {RISCV::DIVU, 20},
+        {RISCV::REM, 20},
+        {RISCV::REMU, 20}};
 
     // 如果支持浮点，添加浮点指令延迟
     if (has_float)
@@ -447,6 +537,21 @@ RISCVTargetInstInfo::RISCVTargetInstInfo(ABIVersion abi)
         inst_latency_[RISCV::FMUL_D] = 6;
         inst_latency_[RISCV::FDIV_D] = 15;
     }
+
+    if (vector_)
+    {
+        for (unsigned op : {RISCV::VLE8_V, RISCV::VLE16_V, RISCV::VLE32_V, RISCV::VLE64_V, RISCV::VL1RE8_V})
+            inst_latency_[op] = 4;
+        for (unsigned op : {RISCV::VADD_VV, RISCV::VSUB_VV, RISCV::VAND_VV, RISCV::VOR_VV, RISCV::VXOR_VV,
+                            RISCV::VSLL_VV, RISCV::VSRL_VV, RISCV::VSRA_VV, RISCV::VMV1R_V})
+            inst_latency_[op] = 2;
+        inst_latency_[RISCV::VMUL_VV] = 4;
+        inst_latency_[RISCV::VFADD_VV] = 5;
+        inst_latency_[RISCV::VFSUB_VV] = 5;
+        inst_latency_[RISCV::VFMUL_VV] = 6;
+        for (unsigned op : {RISCV::VDIV_VV, RISCV::VDIVU_VV, RISCV::VREM_VV, RISCV::VREMU_VV, RISCV::VFDIV_VV})
+            inst_latency_[op] = 24;
+    }
 }
 
 const char *RISCVTargetInstInfo::opcode_name(unsigned opcode) const
@@ -475,6 +580,11 @@ bool RISCVTargetInstInfo::verify_instruction(const MachineInst &MI, std::string
         error_msg = "Unknown opcode";
         return false;
     }
+    if (!vector_ && (opcode_to_type(static_cast<RISCV::Opcode>(opcode)) == OpType::OP_TYPE_V || is_vector_memory(opcode)))
+    {
+        error_msg = "Vector instruction without the V extension";
+        return false;
+    }
 
     // 根据指令类型验证操作数数量和类型
     switch (opcode)
@@ -490,6 +600,11 @@ bool RISCVTargetInstInfo::verify_instruction(const MachineInst &MI, std::string
     case RISCV::SRA:
     case RISCV::OR:
     case RISCV::AND:
+    case RISCV::MUL:
+    case RISCV::DIV:
+    case RISCV::DIVU:
+    case RISCV::REM:
+    case RISCV::REMU:
         if (MI.operands().size() != 3)
         {
             error_msg = "R-type instruction requires 3 operands";
@@ -512,6 +627,7 @@ bool RISCVTargetInstInfo::verify_instruction(const MachineInst &MI, std::string
     case RISCV::LW:
     case RISCV::LBU:
     case RISCV::LHU:
+    case RISCV::LD:
     case RISCV::JALR:
         if (MI.operands().size() != 3)
         {
@@ -524,6 +640,7 @@ bool RISCVTargetInstInfo::verify_instruction(const MachineInst &MI, std::string
     case RISCV::SB:
     case RISCV::SH:
     case RISCV::SW:
+    case RISCV::SD:
         if (MI.operands().size() != 3)
         {
             error_msg = "S-type instruction requires 3 operands";
@@ -638,6 +755,16 @@ uint32_t RISCVTargetInstInfo::get_binary_encoding(const MachineInst &MI) const
         return encode_R(0x33, 0x6, 0x00, MI);
     case RISCV::AND:
         return encode_R(0x33, 0x7, 0x00, MI);
+    case RISCV::MUL:
+        return encode_R(0x33, 0x0, 0x01, MI);
+    case RISCV::DIV:
+        return encode_R(0x33, 0x4, 0x01, MI);
+    case RISCV::DIVU:
+        return encode_R(0x33, 0x5, 0x01, MI);
+    case RISCV::REM:
+        return encode_R(0x33, 0x6, 0x01, MI);
+    case RISCV::REMU:
+        return encode_R(0x33, 0x7, 0x01, MI);
 
     // I类型指令
     case RISCV::ADDI:
@@ -668,6 +795,14 @@ uint32_t RISCVTargetInstInfo::get_binary_encoding(const MachineInst &MI) const
         return encode_I(0x03, 0x4, MI);
     case RISCV::LHU:
         return encode_I(0x03, 0x5, MI);
+    case RISCV::LD:
+        return encode_I(0x03, 0x3, MI);
+    case RISCV::ADDIW:
+        return encode_I(0x1B, 0x0, MI);
+    case RISCV::FLW:
+        return encode_I(0x07, 0x2, MI);
+    case RISCV::FLD:
+        return encode_I(0x07, 0x3, MI);
     case RISCV::JALR:
         return encode_I(0x67, 0x0, MI);
 
@@ -678,6 +813,23 @@ uint32_t RISCVTargetInstInfo::get_binary_encoding(const MachineInst &MI) const
         return encode_S(0x23, 0x1, MI);
     case RISCV::SW:
         return encode_S(0x23, 0x2, MI);
+    case RISCV::SD:
+        return encode_S(0x23, 0x3, MI);
+    case RISCV::FSW:
+        return encode_S(0x27, 0x2, MI);
+    case RISCV::FSD:
+        return encode_S(0x27, 0x3, MI);
+
+    // 浮点运算指令 (舍入模式取动态rm=111)
+    case RISCV::FADD_S:
+    case RISCV::FSUB_S:
+    case RISCV::FMUL_S:
+    case RISCV::FDIV_S:
+    case RISCV::FADD_D:
+    case RISCV::FSUB_D:
+    case RISCV::FMUL_D:
+    case RISCV::FDIV_D:
+        return encode_R(0x53, 0x7, opcode >> 25, MI);
 
     // B类型指令
     case RISCV::BEQ:
@@ -703,6 +855,45 @@ uint32_t RISCVTargetInstInfo::get_binary_encoding(const MachineInst &MI) const
     case RISCV::JAL:
         return encode_J(0x6F, MI);
 
+    // V扩展: 操作码即不含寄存器字段的编码
+    case RISCV::VSETIVLI:
+        return opcode | ((MI.operands()[0].reg() & 0x1F) << 7) | ((MI.operands()[1].imm() & 0x1F) << 15) |
+               ((MI.operands()[2].imm() & 0x3FF) << 20);
+    case RISCV::VMV1R_V:
+        return opcode | ((MI.operands()[0].reg() & 0x1F) << 7) | ((MI.operands()[1].reg() & 0x1F) << 20);
+    case RISCV::VADD_VV:
+    case RISCV::VSUB_VV:
+    case RISCV::VAND_VV:
+    case RISCV::VOR_VV:
+    case RISCV::VXOR_VV:
+    case RISCV::VSLL_VV:
+    case RISCV::VSRL_VV:
+    case RISCV::VSRA_VV:
+    case RISCV::VMUL_VV:
+    case RISCV::VDIV_VV:
+    case RISCV::VDIVU_VV:
+    case RISCV::VREM_VV:
+    case RISCV::VREMU_VV:
+    case RISCV::VFADD_VV:
+    case RISCV::VFSUB_VV:
+    case RISCV::VFMUL_VV:
+    case RISCV::VFDIV_VV:
+        return opcode | ((MI.operands()[0].reg() & 0x1F) << 7) | ((MI.operands()[1].reg() & 0x1F) << 20) |
+               ((MI.operands()[2].reg() & 0x1F) << 15);
+    case RISCV::VLE8_V:
+    case RISCV::VLE16_V:
+    case RISCV::VLE32_V:
+    case RISCV::VLE64_V:
+    case RISCV::VL1RE8_V:
+    case RISCV::VSE8_V:
+    case RISCV::VSE16_V:
+    case RISCV::VSE32_V:
+    case RISCV::VSE64_V:
+    case RISCV::VS1R_V:
+        if (!MI.operands()[1].is_mem_ri() || MI.operands()[1].mem_ri().offset != 0)
+            return 0xFFFFFFFF;
+        return opcode | ((MI.operands()[0].reg() & 0x1F) << 7) | ((MI.operands()[1].mem_ri().base_reg & 0x1F) << 15);
+
     // 伪指令和特殊指令
     case RISCV::RET:
         return 0x8067; // jalr x0, 0(ra)
@@ -750,10 +941,65 @@ bool RISCVTargetInstInfo::is_call(const MachineInst &MI) const
     return MI.opcode() == RISCV::CALL || (MI.opcode() == RISCV::JAL && MI.operands()[0].is_reg() && MI.operands()[0].reg() == Reg::RA);
 }
 
+bool RISCVTargetInstInfo::is_copy(const MachineInst &MI, unsigned &dest_reg, unsigned &src_reg) const
+{
+    const auto &ops = MI.operands();
+    if (ops.size() < 2 || !ops[0].is_reg() || !ops[1].is_reg())
+        return false;
+
+    switch (MI.opcode())
+    {
+    case RISCV::MV: // mv rd, rs
+        if (ops.size() != 2)
+            return false;
+        break;
+    case RISCV::ADD: // add rd, rs, zero
+        if (ops.size() != 3 || !ops[2].is_reg() || ops[2].reg() != Reg::ZERO)
+            return false;
+        break;
+    case RISCV::ADDI: // addi rd, rs, 0
+        if (ops.size() != 3 || !ops[2].is_imm() || ops[2].imm() != 0)
+            return false;
+        break;
+    case RISCV::VMV1R_V: // vmv1r.v vd, vs
+        if (ops.size() != 2)
+            return false;
+        break;
+    default:
+        return false;
+    }
+    dest_reg = ops[0].reg();
+    src_reg = ops[1].reg();
+    return true;
+}
+
+bool RISCVTargetInstInfo::is_trivially_rematerializable(const MachineInst &MI) const
+{
+    const auto &ops = MI.operands();
+    if (ops.empty() || !ops[0].is_reg() || !ops[0].is_def() || !MI.implicit_defs().empty())
+        return false;
+    auto is_constant = [](const MOperand &op) { return op.is_imm() || op.is_global() || op.is_frame_index(); };
+
+    switch (MI.opcode())
+    {
+    case RISCV::LI:  // li rd, imm
+    case RISCV::LA:  // la rd, symbol
+    case RISCV::LUI: // lui rd, imm
+        return ops.size() == 2 && is_constant(ops[1]);
+    case RISCV::ADDI: // addi rd, zero, imm and frame addresses addi rd, sp, fi
+        return ops.size() == 3 && ops[1].is_reg() && (ops[1].reg() == Reg::ZERO || ops[1].reg() == Reg::SP) &&
+               is_constant(ops[2]);
+    default:
+        return false;
+    }
+}
+
 bool RISCVTargetInstInfo::is_legal_immediate(int64_t imm, unsigned operand_size) const
 {
     switch (operand_size)
     {
+    case 6: // RV64 移位量
+        return (imm >= 0 && imm <= 63);
     case 12: // I类型立即数
         return (imm >= -2048 && imm <= 2047);
     case 20: // U类型立即数
@@ -813,6 +1059,15 @@ void RISCVTargetInstInfo::copy_phys_reg(MachineBasicBlock &MBB, MachineBasicBloc
             mii++;
         }
     }
+    else if (dest_reg >= Reg::V0 && dest_reg <= Reg::V31 &&
+             src_reg >= Reg::V0 && src_reg <= Reg::V31)
+    {
+        // 向量寄存器之间的整体复制
+        auto copy_inst = new MachineInst(RISCV::VMV1R_V, {MOperand::create_reg(dest_reg, true),
+                                                          MOperand::create_reg(src_reg, false)});
+        mii = MBB.insert(mii, std::unique_ptr<MachineInst>(copy_inst));
+        mii++;
+    }
     // 其他情况（如混合整型/浮点）需要使用内存进行复制
 }
 bool RISCVTargetInstInfo::legalize_inst(MachineBasicBlock &mbb, MachineBasicBlock::iterator mii, MachineFunction &MF) const
@@ -941,8 +1196,18 @@ uint32_t RISCVTargetInstInfo::encode_I(uint32_t opcode, uint32_t funct3,
                                        const MachineInst &MI) const
 {
     uint32_t rd = MI.operands()[0].reg() & 0x1F;
-    uint32_t rs1 = MI.operands()[1].reg() & 0x1F;
-    uint32_t imm = MI.operands()[2].imm() & 0xFFF;
+    uint32_t rs1, imm;
+    if (MI.operands()[1].is_mem_ri())
+    {
+        // 访存指令: rd, offset(rs1)
+        rs1 = MI.operands()[1].mem_ri().base_reg & 0x1F;
+        imm = MI.operands()[1].mem_ri().offset & 0xFFF;
+    }
+    else
+    {
+        rs1 = MI.operands()[1].reg() & 0x1F;
+        imm = MI.operands()[2].imm() & 0xFFF;
+    }
 
     return (imm << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
 }
@@ -950,9 +1215,19 @@ uint32_t RISCVTargetInstInfo::encode_I(uint32_t opcode, uint32_t funct3,
 uint32_t RISCVTargetInstInfo::encode_S(uint32_t opcode, uint32_t funct3,
                                        const MachineInst &MI) const
 {
-    uint32_t rs1 = MI.operands()[1].reg() & 0x1F;
     uint32_t rs2 = MI.operands()[0].reg() & 0x1F;
-    uint32_t imm = MI.operands()[2].imm() & 0xFFF;
+    uint32_t rs1, imm;
+    if (MI.operands()[1].is_mem_ri())
+    {
+        // 存储指令: rs2, offset(rs1)
+        rs1 = MI.operands()[1].mem_ri().base_reg & 0x1F;
+        imm = MI.operands()[1].mem_ri().offset & 0xFFF;
+    }
+    else
+    {
+        rs1 = MI.operands()[1].reg() & 0x1F;
+        imm = MI.operands()[2].imm() & 0xFFF;
+    }
 
     uint32_t imm11_5 = (imm >> 5) & 0x7F;
     uint32_t imm4_0 = imm & 0x1F;
@@ -1202,6 +1477,43 @@ void RISCVTargetInstInfo::expand_j(MachineBasicBlock &MBB, MachineBasicBlock::it
     MBB.erase(mii);
 }
 
+namespace
+{
+    bool is_vector_reg(const MachineFunction &mf, unsigned reg)
+    {
+        if (MachineFunction::is_physical_reg(reg))
+            return reg >= Reg::V0 && reg <= Reg::V31;
+        return mf.get_vreg_info(reg).register_class_id_ == VR;
+    }
+
+    // Whole-register vector loads and stores take no offset, so the slot
+    // address goes into t2 first; resolve_frame_indices turns the frame
+    // index into the slot's offset from sp
+    MachineBasicBlock::iterator insert_vector_spill(MachineBasicBlock &mbb, MachineBasicBlock::iterator insert_point,
+                                                    unsigned opcode, unsigned reg, int frame_index, int64_t offset)
+    {
+        insert_point = mbb.insert(insert_point, std::make_unique<MachineInst>(
+                                                    RISCV::ADDI, std::vector<MOperand>{
+                                                                     MOperand::create_reg(Reg::T2, true),
+                                                                     MOperand::create_reg(Reg::SP, false),
+                                                                     MOperand::create_frame_index(frame_index)}));
+        if (offset != 0)
+        {
+            insert_point = mbb.insert(std::next(insert_point),
+                                      std::make_unique<MachineInst>(
+                                          RISCV::ADDI, std::vector<MOperand>{MOperand::create_reg(Reg::T2, true),
+                                                                             MOperand::create_reg(Reg::T2, false),
+                                                                             MOperand::create_imm(offset)}));
+        }
+        const bool is_load = opcode == RISCV::VL1RE8_V;
+        auto instr = std::make_unique<MachineInst>(opcode, std::vector<MOperand>{
+                                                               MOperand::create_reg(reg, is_load),
+                                                               MOperand::create_mem_ri(Reg::T2, 0)});
+        instr->set_flag(is_load ? MIFlag::MayLoad : MIFlag::MayStore);
+        return mbb.insert(std::next(insert_point), std::move(instr));
+    }
+}
+
 MachineBasicBlock::iterator RISCVTargetInstInfo::insert_load_from_stack(MachineBasicBlock &mbb,
                                                                         MachineBasicBlock::iterator insert_point,
                                                                         unsigned dest_reg, int frame_index,
@@ -1210,6 +1522,10 @@ MachineBasicBlock::iterator RISCVTargetInstInfo::insert_load_from_stack(MachineB
     // 获取函数和帧索引信息
     MachineFunction *mf = mbb.parent();
     const FrameObjectMetadata *fobjinfo = mf->frame()->get_frame_object(frame_index);
+    if (vector_ && is_vector_reg(*mf, dest_reg))
+    {
+        return insert_vector_spill(mbb, insert_point, RISCV::VL1RE8_V, dest_reg, frame_index, offset);
+    }
 
     // 选择适当的加载指令
     unsigned load_op = RISCV::LW; // 默认使用字加载
@@ -1235,18 +1551,15 @@ MachineBasicBlock::iterator RISCVTargetInstInfo::insert_load_from_stack(MachineB
              abi_version_ == ABIVersion::LP64F ||
              abi_version_ == ABIVersion::LP64D))
         {
-            // 在64位模式下可以使用64位加载，这里简化处理仍使用LW
-            load_op = RISCV::LW;
+            // 64位模式下使用双字加载
+            load_op = RISCV::LD;
         }
     }
 
-    // 使用帧指针或栈指针作为基址寄存器
-    unsigned base_reg = Reg::S0; // 默认使用栈指针
-
-    // 创建内存操作数和指令
+    // 槽位先按帧索引寻址，帧布局定下后由 resolve_frame_indices 换成 [SP + offset]
     std::vector<MOperand> ops;
-    ops.push_back(MOperand::create_reg(dest_reg, true));      // 目标寄存器操作数
-    ops.push_back(MOperand::create_mem_ri(base_reg, offset)); // 内存操作数
+    ops.push_back(MOperand::create_reg(dest_reg, true));                           // 目标寄存器操作数
+    ops.push_back(MOperand::create_mem_fi(frame_index, static_cast<int>(offset))); // 内存操作数
 
     // 创建并插入加载指令
     auto instr = std::make_unique<MachineInst>(load_op, ops);
@@ -1262,6 +1575,10 @@ MachineBasicBlock::iterator RISCVTargetInstInfo::insert_store_to_stack(MachineBa
     // 获取函数和帧索引信息
     MachineFunction *mf = mbb.parent();
     const FrameObjectMetadata *fobjinfo = mf->frame()->get_frame_object(frame_index);
+    if (vector_ && is_vector_reg(*mf, src_reg))
+    {
+        return insert_vector_spill(mbb, insert_point, RISCV::VS1R_V, src_reg, frame_index, offset);
+    }
 
     // 选择适当的存储指令
     unsigned store_op = RISCV::SW; // 默认使用字存储
@@ -1287,18 +1604,15 @@ MachineBasicBlock::iterator RISCVTargetInstInfo::insert_store_to_stack(MachineBa
              abi_version_ == ABIVersion::LP64F ||
              abi_version_ == ABIVersion::LP64D))
         {
-            // 在64位模式下可以使用64位存储，这里简化处理仍使用SW
-            store_op = RISCV::SW;
+            // 64位模式下使用双字存储
+            store_op = RISCV::SD;
         }
     }
 
-    // 使用帧指针或栈指针作为基址寄存器
-    unsigned base_reg = Reg::SP; // 默认使用栈指针
-
-    // 创建内存操作数和指令
+    // 槽位先按帧索引寻址，同上
     std::vector<MOperand> ops;
-    ops.push_back(MOperand::create_reg(src_reg, false));      // 源寄存器操作数
-    ops.push_back(MOperand::create_mem_ri(base_reg, offset)); // 内存操作数
+    ops.push_back(MOperand::create_reg(src_reg, false));                           // 源寄存器操作数
+    ops.push_back(MOperand::create_mem_fi(frame_index, static_cast<int>(offset))); // 内存操作数
 
     // 创建并插入存储指令
     auto instr = std::make_unique<MachineInst>(store_op, ops);
@@ -1662,4 +1976,183 @@ namespace RISCV
         }
     }
 
+    unsigned RISCVTargetInstInfo::get_inverse_branch_opcode(unsigned opcode) const
+    {
+        switch (opcode)
+        {
+        case RISCV::BEQ:
+            return RISCV::BNE;
+        case RISCV::BNE:
+            return RISCV::BEQ;
+        case RISCV::BLT:
+            return RISCV::BGE;
+        case RISCV::BGE:
+            return RISCV::BLT;
+        case RISCV::BLTU:
+            return RISCV::BGEU;
+        case RISCV::BGEU:
+            return RISCV::BLTU;
+        default:
+            return 0;
+        }
+    }
+
+    std::unique_ptr<MachineInst> RISCVTargetInstInfo::build_jump(MachineBasicBlock *target) const
+    {
+        auto mi = std::make_unique<MachineInst>(RISCV::J, std::vector<MOperand>{MOperand::create_basic_block(target)});
+        mi->set_flag(MIFlag::Branch);
+        mi->set_flag(MIFlag::Terminator);
+        return mi;
+    }
+
+    //===------------------------------------------------------------------===//
+    // FrameLowering Implementation
+    //===------------------------------------------------------------------===//
+
+    namespace
+    {
+        int64_t align_to_stack(size_t size) { return static_cast<int64_t>((size + 15) & ~size_t(15)); }
+    }
+
+    MachineBasicBlock::iterator RISCVFrameLowering::adjust_sp(MachineBasicBlock &mbb, MachineBasicBlock::iterator insert,
+                                                              int64_t delta) const
+    {
+        if (delta >= -2048 && delta <= 2047)
+        {
+            return std::next(mbb.insert(insert, std::make_unique<MachineInst>(RISCV::ADDI, std::vector<MOperand>{
+                                                                                           MOperand::create_reg(Reg::SP, true),
+                                                                                           MOperand::create_reg(Reg::SP),
+                                                                                           MOperand::create_imm(delta)})));
+        }
+        insert = mbb.insert(insert, std::make_unique<MachineInst>(RISCV::LI, std::vector<MOperand>{
+                                                                                 MOperand::create_reg(Reg::T2, true),
+                                                                                 MOperand::create_imm(delta)}));
+        return std::next(mbb.insert(std::next(insert), std::make_unique<MachineInst>(RISCV::ADD, std::vector<MOperand>{
+                                                                                                 MOperand::create_reg(Reg::SP, true),
+                                                                                                 MOperand::create_reg(Reg::SP),
+                                                                                                 MOperand::create_reg(Reg::T2)})));
+    }
+
+    void RISCVFrameLowering::emit_prologue(MachineFunction &mf) const
+    {
+        const bool rv64 = tii_->abi_version() == ABIVersion::LP64 || tii_->abi_version() == ABIVersion::LP64F ||
+                          tii_->abi_version() == ABIVersion::LP64D;
+        const unsigned xlen_bytes = rv64 ? 8 : 4;
+        const unsigned flen_bytes = tii_->abi_version() == ABIVersion::LP64D ? 8 : 4;
+
+        // ra only matters to a function that calls; a tail call leaves it for the callee
+        bool calls = false;
+        std::set<unsigned> written;
+        const TargetRegisterInfo *tri = mf.parent() ? mf.parent()->target_reg_info() : nullptr;
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            for (const auto &mi : mbb->instructions())
+            {
+                calls |= mi->has_flag(MIFlag::Call) && !mi->is_tail_call();
+                for (const MOperand &op : mi->operands())
+                {
+                    if (op.is_reg() && op.is_def() && tri && tri->is_callee_saved(mf.call_convention(), op.reg()))
+                        written.insert(op.reg());
+                }
+            }
+        }
+
+        MachineFrame &frame = *mf.frame();
+        std::vector<SavedRegister> saves;
+        if (calls)
+            saves.push_back({Reg::RA, frame.create_spill_slot(rv64 ? GR64 : GR32, xlen_bytes, xlen_bytes)});
+        for (unsigned reg : written)
+        {
+            const bool fp = reg >= Reg::F0 && reg <= Reg::F31;
+            const unsigned bytes = fp ? flen_bytes : xlen_bytes;
+            const unsigned rc = fp ? (bytes == 8 ? FP64 : FP32) : (rv64 ? GR64 : GR32);
+            saves.push_back({reg, frame.create_spill_slot(rc, bytes, bytes)});
+        }
+        frame.set_saved_registers(saves);
+
+        const int64_t size = align_to_stack(frame.get_total_frame_size());
+        if (size == 0)
+            return;
+        MachineBasicBlock &entry = *mf.basic_blocks().front();
+        auto insert = adjust_sp(entry, entry.begin(), -size);
+        for (const SavedRegister &save : saves)
+            insert = std::next(tii_->insert_store_to_stack(entry, insert, save.reg, save.frame_index));
+    }
+
+    void RISCVFrameLowering::emit_epilogue(MachineFunction &mf) const
+    {
+        const MachineFrame &frame = *mf.frame();
+        const int64_t size = align_to_stack(frame.get_total_frame_size());
+        if (size == 0)
+            return;
+        for (auto &mbb : mf.basic_blocks())
+        {
+            for (size_t i = 0; i < mbb->instructions().size(); ++i)
+            {
+                const MachineInst &exit = *mbb->instructions()[i];
+                if (exit.opcode() != RISCV::RET && !exit.is_tail_call())
+                    continue;
+                const size_t before = mbb->instructions().size();
+                auto insert = mbb->begin() + static_cast<std::ptrdiff_t>(i);
+                for (const SavedRegister &save : frame.saved_registers())
+                    insert = std::next(tii_->insert_load_from_stack(*mbb, insert, save.reg, save.frame_index));
+                adjust_sp(*mbb, insert, size);
+                i += mbb->instructions().size() - before;
+            }
+        }
+    }
+
+    void RISCVFrameLowering::legalize_frame_offsets(MachineFunction &mf) const
+    {
+        auto fits = [](int64_t offset) { return offset >= -2048 && offset <= 2047; };
+        for (auto &mbb : mf.basic_blocks())
+        {
+            for (size_t i = 0; i < mbb->instructions().size(); ++i)
+            {
+                MachineInst &mi = *mbb->instructions()[i];
+                if (mi.operands().size() < 2)
+                    continue;
+                const MOperand &base = mi.operands()[1];
+                int64_t offset;
+                if (base.is_mem_ri() && base.mem_ri().base_reg == Reg::SP && !fits(base.mem_ri().offset))
+                {
+                    offset = base.mem_ri().offset;
+                    mi.operand(1) = MOperand::create_mem_ri(Reg::T2, 0);
+                }
+                else if (mi.opcode() == RISCV::ADDI && base.is_reg() && base.reg() == Reg::SP &&
+                         mi.operands()[0].reg() != Reg::SP && mi.operands()[2].is_imm() &&
+                         !fits(mi.operands()[2].imm()))
+                {
+                    // A slot's address; adjust_sp handles sp itself
+                    offset = mi.operands()[2].imm();
+                    mi.operand(1) = MOperand::create_reg(Reg::T2);
+                    mi.operand(2) = MOperand::create_imm(0);
+                }
+                else
+                {
+                    continue;
+                }
+                auto insert = mbb->insert(mbb->begin() + static_cast<std::ptrdiff_t>(i),
+                                          std::make_unique<MachineInst>(RISCV::LI, std::vector<MOperand>{
+                                                                                       MOperand::create_reg(Reg::T2, true),
+                                                                                       MOperand::create_imm(offset)}));
+                mbb->insert(std::next(insert), std::make_unique<MachineInst>(RISCV::ADD, std::vector<MOperand>{
+                                                                                         MOperand::create_reg(Reg::T2, true),
+                                                                                         MOperand::create_reg(Reg::SP),
+                                                                                         MOperand::create_reg(Reg::T2)}));
+                i += 2;
+            }
+        }
+    }
+
+    int RISCVFrameLowering::get_frame_index_offset(const MachineFunction &mf, int frame_index) const
+    {
+        return static_cast<int>(mf.frame()->get_frame_index_offset(frame_index));
+    }
+
+    FrameLayout RISCVFrameLowering::compute_frame_layout(const MachineFunction &mf) const
+    {
+        return {static_cast<int>(align_to_stack(mf.frame()->get_total_frame_size())), 0};
+    }
+
 } // namespace RISCV
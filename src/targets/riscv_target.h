@@ -17,7 +17,8 @@ namespace RISCV
         GR64 = 1, // 64-bit general purpose registers
         FP32 = 2, // 32-bit floating point registers
         FP64 = 3, // 64-bit floating point registers
-        TOTAL_RC = 4
+        VR = 4,   // V extension vector registers, with LP64D only
+        TOTAL_RC = 5
     };
 
     // RISC-V寄存器枚举定义
@@ -92,8 +93,46 @@ namespace RISCV
         F30 = 62, // f30: 浮点临时寄存器
         F31 = 63, // f31: 浮点临时寄存器
 
+        // Vector registers (v0-v31) of the V extension. v0 is kept out of
+        // allocation for the masks of masked instructions
+        V0 = 64,
+        V1 = 65,
+        V2 = 66,
+        V3 = 67,
+        V4 = 68,
+        V5 = 69,
+        V6 = 70,
+        V7 = 71,
+        V8 = 72,
+        V9 = 73,
+        V10 = 74,
+        V11 = 75,
+        V12 = 76,
+        V13 = 77,
+        V14 = 78,
+        V15 = 79,
+        V16 = 80,
+        V17 = 81,
+        V18 = 82,
+        V19 = 83,
+        V20 = 84,
+        V21 = 85,
+        V22 = 86,
+        V23 = 87,
+        V24 = 88,
+        V25 = 89,
+        V26 = 90,
+        V27 = 91,
+        V28 = 92,
+        V29 = 93,
+        V30 = 94,
+        V31 = 95,
+        // vl and vtype as one register: VSETIVLI defines it and every vector
+        // instruction reads it, so the two stay in order
+        VTYPE = 96,
+
         // 特殊寄存器
-        PC = 64 // 程序计数器
+        PC = 97 // 程序计数器
     };
 
     // RISC-V ABI版本
@@ -109,9 +148,13 @@ namespace RISCV
     class RISCVRegisterInfo : public TargetRegisterInfo
     {
     public:
-        explicit RISCVRegisterInfo(ABIVersion abi = ABIVersion::LP64D);
+        // With `vector`, and LP64D, v1-v31 are allocatable as the VR class;
+        // t2 is then kept for the addresses of vector spill slots
+        explicit RISCVRegisterInfo(ABIVersion abi = ABIVersion::LP64D, bool vector = false);
 
     private:
+        bool vector_;
+
         void initializeRegisters(ABIVersion abi);
         void initializeRegisterClasses(ABIVersion abi);
         void initializeCallingConventions(ABIVersion abi);
@@ -232,6 +275,32 @@ namespace RISCV
         // R-type: [funct7(0000000)][rs2][rs1][funct3(111)][rd][opcode]
         AND = 0x7033, // AND
 
+        // RV64I 双字访存
+        // I-type: [imm[11:0]][rs1][funct3(011)][rd][opcode]
+        LD = 0x3003, // Load Double-word
+
+        // S-type: [imm[11:5]][rs2][rs1][funct3(011)][imm[4:0]][opcode]
+        SD = 0x3023, // Store Double-word
+
+        // I-type: [imm[11:0]][rs1][funct3(000)][rd][opcode]
+        ADDIW = 0x1B, // Add Immediate Word (sign-extends the low 32 bits)
+
+        // RV32M/RV64M 乘除法扩展
+        // R-type: [funct7(0000001)][rs2][rs1][funct3(000)][rd][opcode]
+        MUL = 0x02000033, // Multiply
+
+        // R-type: [funct7(0000001)][rs2][rs1][funct3(100)][rd][opcode]
+        DIV = 0x02004033, // Divide
+
+        // R-type: [funct7(0000001)][rs2][rs1][funct3(101)][rd][opcode]
+        DIVU = 0x02005033, // Divide Unsigned
+
+        // R-type: [funct7(0000001)][rs2][rs1][funct3(110)][rd][opcode]
+        REM = 0x02006033, // Remainder
+
+        // R-type: [funct7(0000001)][rs2][rs1][funct3(111)][rd][opcode]
+        REMU = 0x02007033, // Remainder Unsigned
+
         // RV32F/RV64F 浮点指令
         // I-type: [imm[11:0]][rs1][funct3(010)][rd][opcode]
         FLW = 0x2007, // Float Load Word
@@ -290,7 +359,40 @@ namespace RISCV
         CALL = 0x9000006F, // 调用函数 (伪指令)
 
         // J-type (JAL): [imm][rd(x0)][opcode]
-        J = 0x9000007F // 无条件跳转 (伪指令)
+        J = 0x9000007F, // 无条件跳转 (伪指令)
+
+        // V extension, with VLEN = 128. The operands are `vd, vs2, vs1` for
+        // arithmetic, `vd, vs2` for VMV1R_V, `vd, 0(rs1)` for the unit-stride
+        // loads and stores and `rd, avl, vtype` for VSETIVLI
+        VSETIVLI = 0xC0007057, // Set vl and vtype from immediates
+        VLE8_V = 0x02000007,   // Load 8-bit elements
+        VLE16_V = 0x02005007,  // Load 16-bit elements
+        VLE32_V = 0x02006007,  // Load 32-bit elements
+        VLE64_V = 0x02007007,  // Load 64-bit elements
+        VSE8_V = 0x02000027,   // Store 8-bit elements
+        VSE16_V = 0x02005027,  // Store 16-bit elements
+        VSE32_V = 0x02006027,  // Store 32-bit elements
+        VSE64_V = 0x02007027,  // Store 64-bit elements
+        VL1RE8_V = 0x02800007, // Load a whole register, whatever vtype is
+        VS1R_V = 0x02800027,   // Store a whole register
+        VMV1R_V = 0x9E003057,  // Copy a whole register
+        VADD_VV = 0x02000057,
+        VSUB_VV = 0x0A000057,
+        VAND_VV = 0x26000057,
+        VOR_VV = 0x2A000057,
+        VXOR_VV = 0x2E000057,
+        VSLL_VV = 0x96000057,
+        VSRL_VV = 0xA2000057,
+        VSRA_VV = 0xA6000057,
+        VMUL_VV = 0x96002057,
+        VDIV_VV = 0x86002057,
+        VDIVU_VV = 0x82002057,
+        VREM_VV = 0x8E002057,
+        VREMU_VV = 0x8A002057,
+        VFADD_VV = 0x02001057,
+        VFSUB_VV = 0x0A001057,
+        VFMUL_VV = 0x92001057,
+        VFDIV_VV = 0x82001057
     };
 
     enum OpType
@@ -301,10 +403,11 @@ namespace RISCV
         OP_TYPE_B,
         OP_TYPE_U,
         OP_TYPE_J,
-        OP_TYPE_R4
+        OP_TYPE_R4,
+        OP_TYPE_V // vector arithmetic and VSETIVLI: the first operand defined
     };
 
-    OpType opcode_to_type(RISCV::Opcode op)
+    inline OpType opcode_to_type(RISCV::Opcode op)
     {
         switch (op)
         {
@@ -339,8 +442,15 @@ namespace RISCV
         case RISCV::RET: // 伪指令（JALR实现）
         case RISCV::NOP: // 伪指令（ADDI实现）
         case RISCV::LI:  // 伪指令（ADDI实现）
+        case RISCV::LD:
+        case RISCV::ADDIW:
         case RISCV::FLW:
         case RISCV::FLD:
+        case RISCV::VLE8_V:
+        case RISCV::VLE16_V:
+        case RISCV::VLE32_V:
+        case RISCV::VLE64_V:
+        case RISCV::VL1RE8_V:
             return OpType::OP_TYPE_I;
 
         // B-type 指令
@@ -356,8 +466,14 @@ namespace RISCV
         case RISCV::SB:
         case RISCV::SH:
         case RISCV::SW:
+        case RISCV::SD:
         case RISCV::FSW:
         case RISCV::FSD:
+        case RISCV::VSE8_V:
+        case RISCV::VSE16_V:
+        case RISCV::VSE32_V:
+        case RISCV::VSE64_V:
+        case RISCV::VS1R_V:
             return OpType::OP_TYPE_S;
 
         // R-type 指令
@@ -371,6 +487,11 @@ namespace RISCV
         case RISCV::SRA:
         case RISCV::OR:
         case RISCV::AND:
+        case RISCV::MUL:
+        case RISCV::DIV:
+        case RISCV::DIVU:
+        case RISCV::REM:
+        case RISCV::REMU:
         case RISCV::MV: // 伪指令（ADD实现）
             return OpType::OP_TYPE_R;
 
@@ -384,13 +505,33 @@ namespace RISCV
         case RISCV::FMUL_D:
         case RISCV::FDIV_D:
             return OpType::OP_TYPE_R4;
+        case RISCV::VSETIVLI:
+        case RISCV::VMV1R_V:
+        case RISCV::VADD_VV:
+        case RISCV::VSUB_VV:
+        case RISCV::VAND_VV:
+        case RISCV::VOR_VV:
+        case RISCV::VXOR_VV:
+        case RISCV::VSLL_VV:
+        case RISCV::VSRL_VV:
+        case RISCV::VSRA_VV:
+        case RISCV::VMUL_VV:
+        case RISCV::VDIV_VV:
+        case RISCV::VDIVU_VV:
+        case RISCV::VREM_VV:
+        case RISCV::VREMU_VV:
+        case RISCV::VFADD_VV:
+        case RISCV::VFSUB_VV:
+        case RISCV::VFMUL_VV:
+        case RISCV::VFDIV_VV:
+            return OpType::OP_TYPE_V;
 
         default:
             throw std::invalid_argument("Unknown opcode");
         }
     }
 
-    const char *opcode_to_str(RISCV::Opcode op)
+    inline const char *opcode_to_str(RISCV::Opcode op)
     {
         switch (op)
         {
@@ -488,6 +629,22 @@ namespace RISCV
             return "OR";
         case RISCV::AND:
             return "AND";
+        case RISCV::LD:
+            return "LD";
+        case RISCV::SD:
+            return "SD";
+        case RISCV::ADDIW:
+            return "ADDIW";
+        case RISCV::MUL:
+            return "MUL";
+        case RISCV::DIV:
+            return "DIV";
+        case RISCV::DIVU:
+            return "DIVU";
+        case RISCV::REM:
+            return "REM";
+        case RISCV::REMU:
+            return "REMU";
         case RISCV::MV:
             return "MV";
         case RISCV::FADD_S:
@@ -506,15 +663,95 @@ namespace RISCV
             return "FMUL_D";
         case RISCV::FDIV_D:
             return "FDIV_D";
+        case RISCV::VSETIVLI:
+            return "VSETIVLI";
+        case RISCV::VLE8_V:
+            return "VLE8_V";
+        case RISCV::VLE16_V:
+            return "VLE16_V";
+        case RISCV::VLE32_V:
+            return "VLE32_V";
+        case RISCV::VLE64_V:
+            return "VLE64_V";
+        case RISCV::VSE8_V:
+            return "VSE8_V";
+        case RISCV::VSE16_V:
+            return "VSE16_V";
+        case RISCV::VSE32_V:
+            return "VSE32_V";
+        case RISCV::VSE64_V:
+            return "VSE64_V";
+        case RISCV::VL1RE8_V:
+            return "VL1RE8_V";
+        case RISCV::VS1R_V:
+            return "VS1R_V";
+        case RISCV::VMV1R_V:
+            return "VMV1R_V";
+        case RISCV::VADD_VV:
+            return "VADD_VV";
+        case RISCV::VSUB_VV:
+            return "VSUB_VV";
+        case RISCV::VAND_VV:
+            return "VAND_VV";
+        case RISCV::VOR_VV:
+            return "VOR_VV";
+        case RISCV::VXOR_VV:
+            return "VXOR_VV";
+        case RISCV::VSLL_VV:
+            return "VSLL_VV";
+        case RISCV::VSRL_VV:
+            return "VSRL_VV";
+        case RISCV::VSRA_VV:
+            return "VSRA_VV";
+        case RISCV::VMUL_VV:
+            return "VMUL_VV";
+        case RISCV::VDIV_VV:
+            return "VDIV_VV";
+        case RISCV::VDIVU_VV:
+            return "VDIVU_VV";
+        case RISCV::VREM_VV:
+            return "VREM_VV";
+        case RISCV::VREMU_VV:
+            return "VREMU_VV";
+        case RISCV::VFADD_VV:
+            return "VFADD_VV";
+        case RISCV::VFSUB_VV:
+            return "VFSUB_VV";
+        case RISCV::VFMUL_VV:
+            return "VFMUL_VV";
+        case RISCV::VFDIV_VV:
+            return "VFDIV_VV";
         default:
             throw std::invalid_argument("Unknown opcode");
         }
     }
 
+    // The unit-stride and whole-register vector loads and stores
+    inline bool is_vector_memory(unsigned op)
+    {
+        switch (op)
+        {
+        case RISCV::VLE8_V:
+        case RISCV::VLE16_V:
+        case RISCV::VLE32_V:
+        case RISCV::VLE64_V:
+        case RISCV::VL1RE8_V:
+        case RISCV::VSE8_V:
+        case RISCV::VSE16_V:
+        case RISCV::VSE32_V:
+        case RISCV::VSE64_V:
+        case RISCV::VS1R_V:
+            return true;
+        default:
+            return false;
+        }
+    }
+
     class RISCVTargetInstInfo : public TargetInstInfo
     {
     public:
-        RISCVTargetInstInfo(ABIVersion abi = ABIVersion::LP64D);
+        // `vector` enables the V extension, as RISCVRegisterInfo does
+        RISCVTargetInstInfo(ABIVersion abi = ABIVersion::LP64D, bool vector = false);
 
         // TargetInstInfo接口实现
         const char *opcode_name(unsigned opcode) const override;
@@ -525,7 +762,11 @@ namespace RISCV
                            MachineBasicBlock::iterator MI) const override;
         bool is_return(const MachineInst &MI) const override;
         bool is_call(const MachineInst &MI) const override;
+        bool is_copy(const MachineInst &MI, unsigned &dest_reg, unsigned &src_reg) const override;
+        bool is_trivially_rematerializable(const MachineInst &MI) const override;
         bool is_legal_immediate(int64_t imm, unsigned operand_size) const override;
+        ABIVersion abi_version() const { return abi_version_; }
+        bool has_vector() const { return vector_; }
 
         bool is_operand_def(unsigned op, unsigned index) const override
         {
@@ -544,6 +785,7 @@ namespace RISCV
             case OpType::OP_TYPE_I:  // ADDI/LW: rd,rs1,imm
             case OpType::OP_TYPE_R:  // ADD/SUB: rd,rs1,rs2
             case OpType::OP_TYPE_R4: // FADD.D: rd,rs1,rs2,rs3
+            case OpType::OP_TYPE_V:  // VADD.VV: vd,vs2,vs1
                 return index == 0;
             default:
                 return false; // B/S-type和其他未知类型
@@ -570,6 +812,8 @@ namespace RISCV
                 return index == 1 || index == 2;
             case OpType::OP_TYPE_R4: // FADD.D: rd,rs1,rs2,rs3
                 return index >= 1 && index <= 3;
+            case OpType::OP_TYPE_V: // VADD.VV: vd,vs2,vs1
+                return index >= 1;
             default:
                 return false; // U/J-type和其他未知类型
             }
@@ -597,6 +841,8 @@ namespace RISCV
             MachineInst *terminator,
             std::unordered_set<MachineBasicBlock *> &branch_targets,
             MachineBasicBlock *&fall_through) const override;
+        unsigned get_inverse_branch_opcode(unsigned opcode) const override;
+        std::unique_ptr<MachineInst> build_jump(MachineBasicBlock *target) const override;
 
     private:
         // 指令编码辅助函数
@@ -624,10 +870,40 @@ namespace RISCV
 
         // 当前目标ABI版本
         ABIVersion abi_version_;
+        bool vector_;
         // 指令名称映射
         // 指令延迟表
         std::map<unsigned, unsigned> inst_latency_;
     };
 
+    // Frames are addressed off sp, which the prologue moves down by the
+    // frame size rounded up to 16 bytes and every ret and tail call moves
+    // back. A function that makes a call saves ra in its frame, and one that
+    // writes a callee-saved register saves that register too; both are
+    // loaded back before it leaves
+    class RISCVFrameLowering : public TargetFrameLowering
+    {
+    public:
+        explicit RISCVFrameLowering(const RISCVTargetInstInfo *tii) : tii_(tii) {}
+
+        void emit_prologue(MachineFunction &mf) const override;
+        void emit_epilogue(MachineFunction &mf) const override;
+        int get_frame_index_offset(const MachineFunction &mf, int frame_index) const override;
+        FrameLayout compute_frame_layout(const MachineFunction &mf) const override;
+        void emit_stack_protector(MachineFunction &, int) const override {}
+        // Offsets from sp past ADDI's 12 bits go through t2, which is never
+        // allocated: `lw a0, 4096(sp)` becomes `li t2, 4096; add t2, sp, t2;
+        // lw a0, 0(t2)`
+        void legalize_frame_offsets(MachineFunction &mf) const override;
+
+    private:
+        // `sp = sp + delta`, through t2 when delta doesn't fit ADDI; returns
+        // the position after it
+        MachineBasicBlock::iterator adjust_sp(MachineBasicBlock &mbb, MachineBasicBlock::iterator insert,
+                                              int64_t delta) const;
+
+        const RISCVTargetInstInfo *tii_;
+    };
+
     void build_cfg_from_instructions(MachineFunction &mf);
 }; // namespace RISCV
@@ -0,0 +1,104 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <utility>
+
+#include "mo_debug.h"
+
+ThreadPool::ThreadPool(unsigned num_threads)
+{
+    if (num_threads == 0)
+    {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    workers_.reserve(num_threads);
+    for (unsigned i = 0; i < num_threads; ++i)
+    {
+        workers_.emplace_back([this, i]
+                              { run(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_ready_.notify_all();
+    for (auto &worker : workers_)
+    {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t, unsigned)> &fn)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    MO_ASSERT(job_ == nullptr, "ThreadPool::parallel_for is not reentrant");
+    job_ = &fn;
+    job_count_ = count;
+    next_index_ = 0;
+    error_ = nullptr;
+    generation_++;
+    work_ready_.notify_all();
+
+    work_done_.wait(lock, [this]
+                    { return next_index_ >= job_count_ && active_ == 0; });
+    job_ = nullptr;
+
+    if (error_)
+    {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+void ThreadPool::run(unsigned worker)
+{
+    size_t seen_generation = 0;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true)
+    {
+        work_ready_.wait(lock, [&]
+                         { return stopping_ || (generation_ != seen_generation && job_); });
+        if (stopping_)
+        {
+            return;
+        }
+        seen_generation = generation_;
+
+        active_++;
+        while (next_index_ < job_count_)
+        {
+            const size_t index = next_index_++;
+            const auto *job = job_;
+            lock.unlock();
+            try
+            {
+                (*job)(index, worker);
+            }
+            catch (...)
+            {
+                lock.lock();
+                if (!error_ || index < error_index_)
+                {
+                    error_ = std::current_exception();
+                    error_index_ = index;
+                }
+                continue;
+            }
+            lock.lock();
+        }
+        active_--;
+
+        if (active_ == 0)
+        {
+            work_done_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,46 @@
+// thread_pool.h -- Fixed-size worker pool for data-parallel compiler phases
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // 0 picks one thread per hardware core
+    explicit ThreadPool(unsigned num_threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers_.size()); }
+
+    // Calls fn(index, worker) for every index in [0, count) and waits for all of
+    // them. `worker` is in [0, size()) and no two calls with the same worker run
+    // at once, so callers can keep per-worker state. If any call throws, the
+    // exception of the lowest index is rethrown once everything has finished.
+    void parallel_for(size_t count, const std::function<void(size_t index, unsigned worker)> &fn);
+
+private:
+    void run(unsigned worker);
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable work_ready_;
+    std::condition_variable work_done_;
+
+    // Current job, guarded by mutex_
+    const std::function<void(size_t, unsigned)> *job_ = nullptr;
+    size_t job_count_ = 0;
+    size_t next_index_ = 0;
+    size_t generation_ = 0;
+    unsigned active_ = 0;
+    size_t error_index_ = 0;
+    std::exception_ptr error_;
+    bool stopping_ = false;
+};
@@ -0,0 +1,213 @@
+#include "cloning.h"
+
+#include "../mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    BasicBlock *remap_block(const ValueMap &map, BasicBlock *bb)
+    {
+        return static_cast<BasicBlock *>(remap_value(map, bb));
+    }
+
+    Instruction *clone_cast(const Instruction &inst, Value *val, BasicBlock *parent)
+    {
+        Type *type = inst.type();
+        const std::string &name = inst.name();
+        switch (inst.opcode())
+        {
+        case Opcode::ZExt:
+            return ZExtInst::create(val, type, parent, name);
+        case Opcode::SExt:
+            return SExtInst::create(val, type, parent, name);
+        case Opcode::Trunc:
+            return TruncInst::create(val, type, parent, name);
+        case Opcode::SIToFP:
+            return SIToFPInst::create(val, type, parent, name);
+        case Opcode::FPToSI:
+            return FPToSIInst::create(val, type, parent, name);
+        case Opcode::FPExt:
+            return FPExtInst::create(val, type, parent, name);
+        case Opcode::FPTrunc:
+            return FPTruncInst::create(val, type, parent, name);
+        case Opcode::BitCast:
+            return BitCastInst::create(val, type, parent, name);
+        case Opcode::PtrToInt:
+            return PtrToIntInst::create(val, type, parent, name);
+        case Opcode::IntToPtr:
+            return IntToPtrInst::create(val, type, parent, name);
+        case Opcode::FPToUI:
+            return FPToUIInst::create(val, type, parent, name);
+        case Opcode::UIToFP:
+            return UIToFPInst::create(val, type, parent, name);
+        default:
+            return nullptr;
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Cloning Implementation
+//===----------------------------------------------------------------------===//
+
+Value *remap_value(const ValueMap &map, Value *value)
+{
+    auto it = map.find(value);
+    return it == map.end() ? value : it->second;
+}
+
+Instruction *clone_instruction(const Instruction &inst, BasicBlock *parent, const ValueMap &map)
+{
+    auto op = [&](unsigned i)
+    { return remap_value(map, inst.operand(i)); };
+    const std::string &name = inst.name();
+
+    switch (inst.opcode())
+    {
+    case Opcode::Add:
+    case Opcode::Sub:
+    case Opcode::Mul:
+    case Opcode::UDiv:
+    case Opcode::SDiv:
+    case Opcode::URem:
+    case Opcode::SRem:
+    case Opcode::BitAnd:
+    case Opcode::BitOr:
+    case Opcode::BitXor:
+    case Opcode::Shl:
+    case Opcode::LShr:
+    case Opcode::AShr:
+        return BinaryInst::create(inst.opcode(), op(0), op(1), parent, name);
+    case Opcode::Neg:
+    case Opcode::Not:
+    case Opcode::FNeg:
+    case Opcode::BitNot:
+        return UnaryInst::create(inst.opcode(), op(0), parent, name);
+    case Opcode::ICmp:
+    {
+        auto *cmp = ICmpInst::create(static_cast<const ICmpInst &>(inst).predicate(), op(0), op(1), parent);
+        cmp->set_name(name);
+        return cmp;
+    }
+    case Opcode::FCmp:
+        return FCmpInst::create(static_cast<const FCmpInst &>(inst).predicate(), op(0), op(1), parent, name);
+    case Opcode::Alloca:
+        return AllocaInst::create(static_cast<const AllocaInst &>(inst).allocated_type(), parent, name);
+    case Opcode::Load:
+        return LoadInst::create(op(0), parent, name);
+    case Opcode::Store:
+        return StoreInst::create(op(0), op(1), parent);
+    case Opcode::GetElementPtr:
+    {
+        std::vector<Value *> indices;
+        for (unsigned i = 1; i < inst.num_operands(); ++i)
+        {
+            indices.push_back(op(i));
+        }
+        return GetElementPtrInst::create(op(0), std::move(indices), parent, name);
+    }
+    case Opcode::Br:
+    case Opcode::CondBr:
+    {
+        const auto &branch = static_cast<const BranchInst &>(inst);
+        if (branch.is_conditional())
+        {
+            BranchInst *copy = BranchInst::create_cond(op(0), remap_block(map, branch.get_true_successor()),
+                                                       remap_block(map, branch.get_false_successor()), parent);
+            if (branch.has_branch_weights())
+                copy->set_branch_weights(branch.true_weight(), branch.false_weight());
+            return copy;
+        }
+        return BranchInst::create(remap_block(map, branch.get_true_successor()), parent);
+    }
+    case Opcode::Ret:
+        return ReturnInst::create(inst.num_operands() ? op(0) : nullptr, parent);
+    case Opcode::Unreachable:
+        return UnreachableInst::create(parent);
+    case Opcode::Phi:
+    {
+        auto *phi = PhiInst::create(inst.type(), parent);
+        phi->set_name(name);
+        return phi;
+    }
+    case Opcode::Call:
+    {
+        std::vector<Value *> args;
+        for (unsigned i = 1; i < inst.num_operands(); ++i)
+        {
+            args.push_back(op(i));
+        }
+        return CallInst::create(op(0), inst.type(), args, parent, name);
+    }
+    default:
+        break;
+    }
+
+    Instruction *cast = clone_cast(inst, op(0), parent);
+    MO_ASSERT(cast, "Cannot clone instruction with opcode %d", static_cast<int>(inst.opcode()));
+    return cast;
+}
+
+std::vector<BasicBlock *> clone_blocks(const std::vector<BasicBlock *> &blocks, Function &into,
+                                       ValueMap &map, const std::string &suffix)
+{
+    std::vector<BasicBlock *> copies;
+    copies.reserve(blocks.size());
+    for (BasicBlock *bb : blocks)
+    {
+        copies.push_back(into.create_basic_block(bb->name() + suffix));
+        if (bb->has_profile_count())
+            copies.back()->set_profile_count(bb->profile_count());
+        map[bb] = copies.back();
+    }
+
+    // Operands defined in a later block are still the originals here...
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        for (const Instruction &inst : *blocks[i])
+        {
+            Instruction *copy = clone_instruction(inst, copies[i], map);
+            if (!copy->name().empty())
+            {
+                copy->set_name(copy->name() + suffix);
+            }
+            copies[i]->append(copy);
+            map[&inst] = copy;
+        }
+    }
+
+    // ...and are patched up once every copy exists
+    for (size_t i = 0; i < blocks.size(); ++i)
+    {
+        const Instruction *inst = blocks[i]->first_instruction();
+        for (Instruction *copy = copies[i]->first_instruction(); copy; copy = copy->next(), inst = inst->next())
+        {
+            if (inst->opcode() == Opcode::Phi)
+            {
+                const auto *phi = static_cast<const PhiInst *>(inst);
+                for (unsigned k = 0; k < phi->num_incoming(); ++k)
+                {
+                    auto it = map.find(phi->get_incoming_block(k));
+                    if (it != map.end())
+                    {
+                        static_cast<PhiInst *>(copy)->add_incoming(remap_value(map, phi->get_incoming_value(k)),
+                                                                   static_cast<BasicBlock *>(it->second));
+                    }
+                }
+                continue;
+            }
+            for (unsigned k = 0; k < copy->num_operands(); ++k)
+            {
+                Value *mapped = remap_value(map, inst->operand(k));
+                if (copy->operand(k) != mapped)
+                {
+                    copy->set_operand(k, mapped);
+                }
+            }
+        }
+    }
+    return copies;
+}
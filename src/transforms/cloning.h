@@ -0,0 +1,33 @@
+// cloning.h - Copies of instructions and groups of basic blocks
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../ir.h"
+
+//===----------------------------------------------------------------------===//
+//                             Cloning
+//===----------------------------------------------------------------------===//
+//
+// Maps values of the original code to their counterparts in the copy.
+// Anything without an entry (constants, globals, functions, values defined
+// outside the copied region) stands for itself.
+using ValueMap = std::unordered_map<const Value *, Value *>;
+
+Value *remap_value(const ValueMap &map, Value *value);
+
+// Copies `inst` into `parent` with its operands remapped through `map`,
+// without inserting it. Branch targets have to be mapped already; phis come
+// back without incoming edges.
+Instruction *clone_instruction(const Instruction &inst, BasicBlock *parent, const ValueMap &map);
+
+// Copies `blocks` into new blocks of `into`, named after the originals plus
+// `suffix`, and records every block and instruction copy in `map`. Operands
+// are remapped once all copies exist, so the order of `blocks` is free. Phi
+// edges from blocks outside `blocks` are dropped. Profile counts and branch
+// weights are copied as they are, for the caller to scale. Returns the new
+// blocks in the order of `blocks`.
+std::vector<BasicBlock *> clone_blocks(const std::vector<BasicBlock *> &blocks, Function &into,
+                                       ValueMap &map, const std::string &suffix);
@@ -0,0 +1,150 @@
+#include "dce.h"
+#include <unordered_set>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // Collects `root` and every address derived from it, failing if any of
+    // them is used for anything but being stored through
+    bool collect_write_only_slot(Instruction *root, std::vector<Instruction *> &dead)
+    {
+        std::vector<Instruction *> addresses{root};
+        while (!addresses.empty())
+        {
+            Instruction *address = addresses.back();
+            addresses.pop_back();
+            dead.push_back(address);
+            for (Use *use : address->uses())
+            {
+                auto *user = static_cast<Instruction *>(use->user());
+                switch (user->opcode())
+                {
+                case Opcode::Store:
+                    if (static_cast<StoreInst *>(user)->pointer() != address || static_cast<StoreInst *>(user)->value() == address)
+                        return false;
+                    dead.push_back(user);
+                    break;
+                case Opcode::GetElementPtr:
+                    if (static_cast<GetElementPtrInst *>(user)->base_pointer() != address)
+                        return false;
+                    addresses.push_back(user);
+                    break;
+                case Opcode::BitCast:
+                    addresses.push_back(user);
+                    break;
+                default:
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    // Drops every operand first, so the instructions can go in any order
+    unsigned erase_all(std::vector<Instruction *> &dead)
+    {
+        std::unordered_set<Instruction *> unique(dead.begin(), dead.end());
+        for (Instruction *inst : unique)
+        {
+            inst->drop_all_references();
+        }
+        for (Instruction *inst : unique)
+        {
+            inst->parent()->erase(inst);
+        }
+        return static_cast<unsigned>(unique.size());
+    }
+
+    unsigned eliminate_dead_slots(Function &func)
+    {
+        std::vector<Instruction *> dead;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                if (inst.opcode() != Opcode::Alloca)
+                {
+                    continue;
+                }
+                std::vector<Instruction *> slot;
+                if (collect_write_only_slot(&inst, slot))
+                {
+                    dead.insert(dead.end(), slot.begin(), slot.end());
+                }
+            }
+        }
+        return erase_all(dead);
+    }
+
+    unsigned eliminate_dead_instructions(Function &func)
+    {
+        std::unordered_set<const Instruction *> live;
+        std::vector<Instruction *> worklist;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                if (has_side_effects(&inst) && live.insert(&inst).second)
+                    worklist.push_back(&inst);
+            }
+        }
+        while (!worklist.empty())
+        {
+            Instruction *inst = worklist.back();
+            worklist.pop_back();
+            for (Value *operand : inst->operands())
+            {
+                auto *def = dynamic_cast<Instruction *>(operand);
+                if (def && live.insert(def).second)
+                    worklist.push_back(def);
+            }
+        }
+
+        std::vector<Instruction *> dead;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                if (!live.count(&inst))
+                    dead.push_back(&inst);
+            }
+        }
+        return erase_all(dead);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             DeadCodeElimination Implementation
+//===----------------------------------------------------------------------===//
+
+bool has_side_effects(const Instruction *inst)
+{
+    switch (inst->opcode())
+    {
+    case Opcode::Store:
+    case Opcode::Call:
+    case Opcode::Br:
+    case Opcode::CondBr:
+    case Opcode::Ret:
+    case Opcode::Unreachable:
+        return true;
+    default:
+        return false;
+    }
+}
+
+unsigned eliminate_dead_code(Function &func)
+{
+    // Slots first: their stores are roots of the second sweep
+    const unsigned removed = eliminate_dead_slots(func);
+    return removed + eliminate_dead_instructions(func);
+}
+
+PreservedAnalyses DeadCodeEliminationPass::run(Function &func, AnalysisManager &)
+{
+    return eliminate_dead_code(func) ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
@@ -0,0 +1,32 @@
+// dce.h - Dead code and dead store elimination
+#pragma once
+
+#include "../ir.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             DeadCodeElimination
+//===----------------------------------------------------------------------===//
+//
+// Aggressive DCE: every instruction is assumed dead until it is needed by
+// one with an effect (a store, call or terminator), directly or through a
+// chain of operands, so dead cycles of phis go too. Branches are kept as they
+// are; removing control flow is SimplifyCFG's job.
+//
+// Stack slots that are only ever written count as dead as well: an alloca
+// whose address is used by nothing but stores into it (possibly through GEPs
+// and bitcasts of it) disappears together with those stores.
+
+// Whether `inst` does anything besides producing its value
+bool has_side_effects(const Instruction *inst);
+
+// Runs both eliminations and returns how many instructions were removed
+unsigned eliminate_dead_code(Function &func);
+
+// Keeps the CFG intact
+class DeadCodeEliminationPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "dce"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
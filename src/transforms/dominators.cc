@@ -0,0 +1,223 @@
+#include "dominators.h"
+#include <limits>
+
+namespace
+{
+    constexpr unsigned UNDEFINED = std::numeric_limits<unsigned>::max();
+    const std::vector<BasicBlock *> NO_BLOCKS;
+}
+
+//===----------------------------------------------------------------------===//
+//                             DominatorTree Implementation
+//===----------------------------------------------------------------------===//
+
+DominatorTree::DominatorTree(const Function &func)
+{
+    if (func.basic_blocks().empty())
+    {
+        return;
+    }
+
+    // Post-order walk from the entry, kept explicit so deep CFGs do not
+    // exhaust the stack
+    std::vector<BasicBlock *> post_order;
+    std::vector<std::pair<BasicBlock *, size_t>> stack;
+    std::unordered_map<const BasicBlock *, bool> visited;
+    BasicBlock *entry = func.basic_blocks().front();
+    stack.emplace_back(entry, 0);
+    visited[entry] = true;
+    while (!stack.empty())
+    {
+        auto &[bb, next] = stack.back();
+        if (next < bb->successors().size())
+        {
+            BasicBlock *succ = bb->successors()[next++];
+            if (!visited[succ])
+            {
+                visited[succ] = true;
+                stack.emplace_back(succ, 0);
+            }
+            continue;
+        }
+        post_order.push_back(bb);
+        stack.pop_back();
+    }
+
+    rpo_.assign(post_order.rbegin(), post_order.rend());
+    for (unsigned i = 0; i < rpo_.size(); ++i)
+    {
+        index_[rpo_[i]] = i;
+    }
+
+    // Walks up from two blocks until their paths meet; a lower RPO index is
+    // closer to the entry
+    auto intersect = [this](unsigned a, unsigned b)
+    {
+        while (a != b)
+        {
+            while (a > b)
+                a = idom_[a];
+            while (b > a)
+                b = idom_[b];
+        }
+        return a;
+    };
+
+    idom_.assign(rpo_.size(), UNDEFINED);
+    idom_[0] = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (unsigned i = 1; i < rpo_.size(); ++i)
+        {
+            unsigned new_idom = UNDEFINED;
+            for (BasicBlock *pred : rpo_[i]->predecessors())
+            {
+                auto it = index_.find(pred);
+                if (it == index_.end() || idom_[it->second] == UNDEFINED)
+                {
+                    continue;
+                }
+                new_idom = new_idom == UNDEFINED ? it->second : intersect(it->second, new_idom);
+            }
+            if (idom_[i] != new_idom)
+            {
+                idom_[i] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    children_.resize(rpo_.size());
+    for (unsigned i = 1; i < rpo_.size(); ++i)
+    {
+        children_[idom_[i]].push_back(rpo_[i]);
+    }
+
+    tree_in_.resize(rpo_.size());
+    tree_out_.resize(rpo_.size());
+    unsigned clock = 0;
+    std::vector<std::pair<unsigned, size_t>> tree_stack{{0, 0}};
+    tree_in_[0] = clock++;
+    while (!tree_stack.empty())
+    {
+        auto &[node, next] = tree_stack.back();
+        if (next < children_[node].size())
+        {
+            unsigned child = index_[children_[node][next++]];
+            tree_in_[child] = clock++;
+            tree_stack.emplace_back(child, 0);
+            continue;
+        }
+        tree_out_[node] = clock++;
+        tree_stack.pop_back();
+    }
+}
+
+BasicBlock *DominatorTree::idom(const BasicBlock *bb) const
+{
+    auto it = index_.find(bb);
+    if (it == index_.end() || it->second == 0)
+    {
+        return nullptr;
+    }
+    return rpo_[idom_[it->second]];
+}
+
+const std::vector<BasicBlock *> &DominatorTree::children(const BasicBlock *bb) const
+{
+    auto it = index_.find(bb);
+    return it == index_.end() ? NO_BLOCKS : children_[it->second];
+}
+
+bool DominatorTree::dominates(const BasicBlock *a, const BasicBlock *b) const
+{
+    auto ia = index_.find(a), ib = index_.find(b);
+    if (ia == index_.end() || ib == index_.end())
+    {
+        return false;
+    }
+    return tree_in_[ia->second] <= tree_in_[ib->second] && tree_out_[ib->second] <= tree_out_[ia->second];
+}
+
+//===----------------------------------------------------------------------===//
+//                             DominanceFrontier Implementation
+//===----------------------------------------------------------------------===//
+
+DominanceFrontier::DominanceFrontier(const DominatorTree &dom_tree)
+    : dom_tree_(dom_tree), frontiers_(dom_tree.reverse_post_order().size())
+{
+    // A join point is in the frontier of every block on the dominator tree
+    // path from each predecessor up to (not including) its immediate dominator
+    for (BasicBlock *bb : dom_tree.reverse_post_order())
+    {
+        if (bb->predecessors().size() < 2)
+        {
+            continue;
+        }
+        BasicBlock *idom = dom_tree.idom(bb);
+        for (BasicBlock *pred : bb->predecessors())
+        {
+            if (!dom_tree.is_reachable(pred))
+            {
+                continue;
+            }
+            for (BasicBlock *runner = pred; runner && runner != idom; runner = dom_tree.idom(runner))
+            {
+                auto &frontier = frontiers_[dom_tree.rpo_index(runner)];
+                if (!frontier.empty() && frontier.back() == bb)
+                {
+                    break; // the walk from an earlier predecessor got here already
+                }
+                frontier.push_back(bb);
+            }
+        }
+    }
+}
+
+const std::vector<BasicBlock *> &DominanceFrontier::frontier(const BasicBlock *bb) const
+{
+    return dom_tree_.is_reachable(bb) ? frontiers_[dom_tree_.rpo_index(bb)] : NO_BLOCKS;
+}
+
+std::vector<BasicBlock *> DominanceFrontier::iterated(const std::vector<BasicBlock *> &blocks) const
+{
+    const auto &rpo = dom_tree_.reverse_post_order();
+    std::vector<bool> in_result(rpo.size(), false);
+    std::vector<bool> queued(rpo.size(), false);
+    std::vector<unsigned> worklist;
+    for (BasicBlock *bb : blocks)
+    {
+        if (dom_tree_.is_reachable(bb) && !queued[dom_tree_.rpo_index(bb)])
+        {
+            queued[dom_tree_.rpo_index(bb)] = true;
+            worklist.push_back(dom_tree_.rpo_index(bb));
+        }
+    }
+
+    // A phi is itself a definition, so frontiers of frontier blocks count too
+    while (!worklist.empty())
+    {
+        unsigned node = worklist.back();
+        worklist.pop_back();
+        for (BasicBlock *join : frontiers_[node])
+        {
+            unsigned index = dom_tree_.rpo_index(join);
+            in_result[index] = true;
+            if (!queued[index])
+            {
+                queued[index] = true;
+                worklist.push_back(index);
+            }
+        }
+    }
+
+    std::vector<BasicBlock *> result;
+    for (unsigned i = 0; i < rpo.size(); ++i)
+    {
+        if (in_result[i])
+            result.push_back(rpo[i]);
+    }
+    return result;
+}
@@ -0,0 +1,66 @@
+// dominators.h - Dominator tree and dominance frontiers of IR functions
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "../ir.h"
+
+//===----------------------------------------------------------------------===//
+//                             DominatorTree
+//===----------------------------------------------------------------------===//
+
+// Immediate dominators of the blocks reachable from the entry block, computed
+// with the iterative algorithm of Cooper, Harvey and Kennedy over reverse
+// post-order. Blocks that cannot be reached have no dominator and dominate
+// nothing; passes are expected to skip or delete them. The tree is a snapshot:
+// it has to be rebuilt once the CFG changes.
+class DominatorTree
+{
+public:
+    explicit DominatorTree(const Function &func);
+
+    bool is_reachable(const BasicBlock *bb) const { return index_.count(bb) != 0; }
+    // Null for the entry block and for unreachable blocks
+    BasicBlock *idom(const BasicBlock *bb) const;
+    const std::vector<BasicBlock *> &children(const BasicBlock *bb) const;
+    // Whether every path from the entry to `b` passes through `a`; O(1)
+    bool dominates(const BasicBlock *a, const BasicBlock *b) const;
+
+    BasicBlock *root() const { return rpo_.empty() ? nullptr : rpo_.front(); }
+    // Reachable blocks, each after all of its dominators
+    const std::vector<BasicBlock *> &reverse_post_order() const { return rpo_; }
+    // Position of `bb` in reverse_post_order(); `bb` must be reachable
+    unsigned rpo_index(const BasicBlock *bb) const { return index_.at(bb); }
+
+private:
+    std::unordered_map<const BasicBlock *, unsigned> index_;
+    std::vector<BasicBlock *> rpo_;
+    std::vector<unsigned> idom_; // by RPO index
+    std::vector<std::vector<BasicBlock *>> children_;
+    // Pre/post order numbers of a walk over the tree, for dominates()
+    std::vector<unsigned> tree_in_;
+    std::vector<unsigned> tree_out_;
+};
+
+//===----------------------------------------------------------------------===//
+//                             DominanceFrontier
+//===----------------------------------------------------------------------===//
+
+// For each reachable block B, the blocks where the dominance of B ends: the
+// join points a definition in B has to be merged at with a phi.
+class DominanceFrontier
+{
+public:
+    explicit DominanceFrontier(const DominatorTree &dom_tree);
+
+    const std::vector<BasicBlock *> &frontier(const BasicBlock *bb) const;
+
+    // Iterated frontier of `blocks`: every block that needs a phi when each
+    // of `blocks` defines the value. Sorted in reverse post-order.
+    std::vector<BasicBlock *> iterated(const std::vector<BasicBlock *> &blocks) const;
+
+private:
+    const DominatorTree &dom_tree_;
+    std::vector<std::vector<BasicBlock *>> frontiers_; // by RPO index
+};
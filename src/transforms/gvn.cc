@@ -0,0 +1,290 @@
+#include "gvn.h"
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "../open_hash_map.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    struct ExprKey
+    {
+        Opcode opcode;
+        Type *type;
+        int predicate;
+        std::vector<Value *> operands;
+
+        bool operator==(const ExprKey &other) const
+        {
+            return opcode == other.opcode && type == other.type && predicate == other.predicate && operands == other.operands;
+        }
+    };
+
+    struct ExprKeyHash
+    {
+        size_t operator()(const ExprKey &key) const
+        {
+            uint64_t hash = hash_combine(static_cast<uint64_t>(key.opcode), hash_pointer(key.type));
+            hash = hash_combine(hash, static_cast<uint64_t>(key.predicate));
+            for (Value *operand : key.operands)
+            {
+                hash = hash_combine(hash, hash_pointer(operand));
+            }
+            return hash;
+        }
+    };
+
+    bool is_pure(Opcode opc)
+    {
+        switch (opc)
+        {
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::UDiv:
+        case Opcode::SDiv:
+        case Opcode::URem:
+        case Opcode::SRem:
+        case Opcode::Neg:
+        case Opcode::Not:
+        case Opcode::FNeg:
+        case Opcode::GetElementPtr:
+        case Opcode::ICmp:
+        case Opcode::FCmp:
+        case Opcode::ZExt:
+        case Opcode::SExt:
+        case Opcode::Trunc:
+        case Opcode::SIToFP:
+        case Opcode::FPToSI:
+        case Opcode::FPExt:
+        case Opcode::FPTrunc:
+        case Opcode::BitCast:
+        case Opcode::PtrToInt:
+        case Opcode::IntToPtr:
+        case Opcode::FPToUI:
+        case Opcode::UIToFP:
+        case Opcode::BitAnd:
+        case Opcode::BitOr:
+        case Opcode::BitXor:
+        case Opcode::BitNot:
+        case Opcode::Shl:
+        case Opcode::LShr:
+        case Opcode::AShr:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    ExprKey make_key(const Instruction *inst)
+    {
+        ExprKey key{inst->opcode(), inst->type(), -1, {}};
+        bool commutative = false;
+        switch (inst->opcode())
+        {
+        case Opcode::Add:
+        case Opcode::Mul:
+        case Opcode::BitAnd:
+        case Opcode::BitOr:
+        case Opcode::BitXor:
+            commutative = true;
+            break;
+        case Opcode::ICmp:
+        {
+            auto pred = static_cast<const ICmpInst *>(inst)->predicate();
+            key.predicate = pred;
+            commutative = pred == ICmpInst::EQ || pred == ICmpInst::NE;
+            break;
+        }
+        case Opcode::FCmp:
+        {
+            auto pred = static_cast<const FCmpInst *>(inst)->predicate();
+            key.predicate = pred;
+            commutative = pred == FCmpInst::EQ || pred == FCmpInst::NE || pred == FCmpInst::OEQ || pred == FCmpInst::ONE;
+            break;
+        }
+        default:
+            break;
+        }
+        key.operands.assign(inst->operands().begin(), inst->operands().end());
+        if (commutative && key.operands.size() == 2 && std::less<Value *>{}(key.operands[1], key.operands[0]))
+        {
+            std::swap(key.operands[0], key.operands[1]);
+        }
+        return key;
+    }
+
+    struct AvailableLoad
+    {
+        Value *value;
+        unsigned generation;
+    };
+
+    // Tables of the values available on the current dominator tree path;
+    // entries added while visiting a block are dropped when its subtree is done
+    class ScopedTables
+    {
+    public:
+        Value *find_expr(const ExprKey &key) const
+        {
+            auto it = exprs_.find(key);
+            return it == exprs_.end() ? nullptr : it->second.back();
+        }
+        void add_expr(ExprKey key, Value *value, std::vector<const ExprKey *> &undo)
+        {
+            auto it = exprs_.try_emplace(std::move(key)).first;
+            it->second.push_back(value);
+            undo.push_back(&it->first);
+        }
+        void pop_exprs(const std::vector<const ExprKey *> &undo)
+        {
+            for (auto it = undo.rbegin(); it != undo.rend(); ++it)
+            {
+                auto entry = exprs_.find(**it);
+                entry->second.pop_back();
+                if (entry->second.empty())
+                    exprs_.erase(entry);
+            }
+        }
+
+        const AvailableLoad *find_load(const Value *ptr) const
+        {
+            auto it = loads_.find(ptr);
+            return it == loads_.end() ? nullptr : &it->second.back();
+        }
+        void add_load(const Value *ptr, AvailableLoad load, std::vector<const Value *> &undo)
+        {
+            loads_[ptr].push_back(load);
+            undo.push_back(ptr);
+        }
+        void pop_loads(const std::vector<const Value *> &undo)
+        {
+            for (auto it = undo.rbegin(); it != undo.rend(); ++it)
+            {
+                auto entry = loads_.find(*it);
+                entry->second.pop_back();
+                if (entry->second.empty())
+                    loads_.erase(entry);
+            }
+        }
+
+    private:
+        std::unordered_map<ExprKey, std::vector<Value *>, ExprKeyHash> exprs_;
+        std::unordered_map<const Value *, std::vector<AvailableLoad>> loads_;
+    };
+
+    struct StackNode
+    {
+        BasicBlock *bb;
+        unsigned generation; // on entry; the end-of-block value once visited
+        size_t next_child = 0;
+        bool visited = false;
+        std::vector<const ExprKey *> expr_undo = {};
+        std::vector<const Value *> load_undo = {};
+    };
+}
+
+//===----------------------------------------------------------------------===//
+//                             GVN Implementation
+//===----------------------------------------------------------------------===//
+
+unsigned eliminate_common_subexpressions(Function &, const DominatorTree &dom_tree)
+{
+    if (!dom_tree.root())
+    {
+        return 0;
+    }
+
+    ScopedTables tables;
+    unsigned replaced = 0;
+    std::vector<StackNode> stack;
+    stack.push_back({dom_tree.root(), 0});
+    while (!stack.empty())
+    {
+        StackNode &node = stack.back();
+        if (!node.visited)
+        {
+            node.visited = true;
+            unsigned generation = node.generation;
+            if (node.bb->predecessors().size() > 1)
+            {
+                ++generation;
+            }
+
+            for (Instruction *inst = node.bb->first_instruction(), *next; inst; inst = next)
+            {
+                next = inst->next();
+                switch (inst->opcode())
+                {
+                case Opcode::Load:
+                {
+                    Value *ptr = static_cast<LoadInst *>(inst)->pointer();
+                    const AvailableLoad *available = tables.find_load(ptr);
+                    if (available && available->generation == generation && available->value->type() == inst->type())
+                    {
+                        inst->replace_all_uses_with(available->value);
+                        node.bb->erase(inst);
+                        ++replaced;
+                    }
+                    else
+                    {
+                        tables.add_load(ptr, {inst, generation}, node.load_undo);
+                    }
+                    continue;
+                }
+                case Opcode::Store:
+                {
+                    auto *store = static_cast<StoreInst *>(inst);
+                    ++generation;
+                    tables.add_load(store->pointer(), {store->value(), generation}, node.load_undo);
+                    continue;
+                }
+                case Opcode::Call:
+                    ++generation;
+                    continue;
+                default:
+                    break;
+                }
+                if (!is_pure(inst->opcode()))
+                {
+                    continue;
+                }
+                ExprKey key = make_key(inst);
+                if (Value *existing = tables.find_expr(key))
+                {
+                    inst->replace_all_uses_with(existing);
+                    node.bb->erase(inst);
+                    ++replaced;
+                }
+                else
+                {
+                    tables.add_expr(std::move(key), inst, node.expr_undo);
+                }
+            }
+            node.generation = generation;
+        }
+
+        const auto &children = dom_tree.children(node.bb);
+        if (node.next_child < children.size())
+        {
+            BasicBlock *child = children[node.next_child++];
+            const unsigned generation = node.generation;
+            stack.push_back({child, generation}); // invalidates `node`
+            continue;
+        }
+        tables.pop_exprs(node.expr_undo);
+        tables.pop_loads(node.load_undo);
+        stack.pop_back();
+    }
+    return replaced;
+}
+
+PreservedAnalyses GVNPass::run(Function &func, AnalysisManager &analyses)
+{
+    const unsigned replaced = eliminate_common_subexpressions(func, analyses.dominator_tree(func));
+    return replaced ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
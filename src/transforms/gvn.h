@@ -0,0 +1,34 @@
+// gvn.h - Dominator-scoped value numbering and redundant load elimination
+#pragma once
+
+#include "../ir.h"
+#include "dominators.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             GVN
+//===----------------------------------------------------------------------===//
+//
+// Walks the dominator tree with a scoped table of the pure instructions seen
+// on the way down (arithmetic, comparisons, casts, GEPs), keyed by opcode,
+// type, predicate and operands, with the operands of commutative operations
+// in a canonical order. An instruction equal to one in a dominating position
+// is replaced by it, so the member address chains IRGenerator rebuilds on
+// every field access collapse into one.
+//
+// Loads get a "memory generation" check: the generation goes up at every
+// store and call, and at blocks with several predecessors, where another path
+// may have written memory. A load is reused while the generation it was
+// seen in is still current; a store makes its value available to later
+// loads of the same pointer.
+
+// Returns how many instructions were replaced
+unsigned eliminate_common_subexpressions(Function &func, const DominatorTree &dom_tree);
+
+// Keeps the CFG intact
+class GVNPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "gvn"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
@@ -0,0 +1,352 @@
+#include "inliner.h"
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "../mo_debug.h"
+#include "cloning.h"
+#include "dce.h"
+#include "gvn.h"
+#include "mem2reg.h"
+#include "simplify_cfg.h"
+#include "sroa.h"
+#include "tail_calls.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    unsigned count_instructions(const Function &func)
+    {
+        unsigned count = 0;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            for (const Instruction &inst : *bb)
+            {
+                // Slots and phis end up as registers or frame offsets
+                count += inst.opcode() != Opcode::Alloca && inst.opcode() != Opcode::Phi;
+            }
+        }
+        return count;
+    }
+
+    bool calls_itself(const Function &func)
+    {
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            for (const Instruction &inst : *bb)
+            {
+                if (inst.opcode() == Opcode::Call && inst.operand(0) == &func)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    bool is_constant_argument(const Value *arg)
+    {
+        // A constant function argument turns indirect calls in the copy
+        // into direct ones
+        return (dynamic_cast<const Constant *>(arg) && !dynamic_cast<const GlobalVariable *>(arg)) ||
+               dynamic_cast<const Function *>(arg);
+    }
+
+    std::vector<Function *> direct_callees(const Function &func)
+    {
+        std::vector<Function *> callees;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            for (const Instruction &inst : *bb)
+            {
+                if (inst.opcode() != Opcode::Call)
+                    continue;
+                if (Function *callee = static_cast<const CallInst &>(inst).called_function())
+                    callees.push_back(callee);
+            }
+        }
+        return callees;
+    }
+
+    // Functions with callees first; call graph cycles are cut wherever the
+    // walk first comes back to a function still on the stack
+    std::vector<Function *> bottom_up_order(const Module &module)
+    {
+        enum class State : uint8_t
+        {
+            OnStack,
+            Done
+        };
+        struct Frame
+        {
+            Function *func;
+            std::vector<Function *> callees;
+            size_t next = 0;
+        };
+
+        std::vector<Function *> order;
+        std::unordered_map<const Function *, State> state;
+        std::vector<Frame> stack;
+        for (Function *root : module.functions())
+        {
+            if (state.count(root))
+                continue;
+            state[root] = State::OnStack;
+            stack.push_back({root, direct_callees(*root)});
+            while (!stack.empty())
+            {
+                Frame &frame = stack.back();
+                if (frame.next < frame.callees.size())
+                {
+                    Function *callee = frame.callees[frame.next++];
+                    if (state.try_emplace(callee, State::OnStack).second)
+                    {
+                        std::vector<Function *> callees = direct_callees(*callee);
+                        stack.push_back({callee, std::move(callees)}); // invalidates `frame`
+                    }
+                    continue;
+                }
+                state[frame.func] = State::Done;
+                order.push_back(frame.func);
+                stack.pop_back();
+            }
+        }
+        return order;
+    }
+
+    // The callee's counts are over all its calls; the copy only runs for
+    // the `calls` of one site
+    void scale_profile(const std::vector<BasicBlock *> &body, const BasicBlock *callee_entry, uint64_t calls)
+    {
+        if (!callee_entry->has_profile_count())
+        {
+            for (BasicBlock *bb : body)
+                bb->clear_profile_count();
+            return;
+        }
+        const double scale = callee_entry->profile_count() ? double(calls) / double(callee_entry->profile_count()) : 0;
+        auto scaled = [scale](uint64_t count) { return static_cast<uint64_t>(double(count) * scale + 0.5); };
+        for (BasicBlock *bb : body)
+        {
+            if (bb->has_profile_count())
+                bb->set_profile_count(scaled(bb->profile_count()));
+            auto *branch = dynamic_cast<BranchInst *>(bb->get_terminator());
+            if (branch && branch->has_branch_weights())
+                branch->set_branch_weights(scaled(branch->true_weight()), scaled(branch->false_weight()));
+        }
+    }
+
+    // Moves everything after `call` into a new block that takes over the
+    // outgoing edges of the call's block
+    BasicBlock *split_after(CallInst *call)
+    {
+        BasicBlock *bb = call->parent();
+        BasicBlock *rest = bb->parent_function()->create_basic_block(bb->name() + ".cont");
+        while (Instruction *inst = call->next())
+        {
+            rest->append(bb->remove(inst).release());
+        }
+        while (!bb->successors().empty())
+        {
+            BasicBlock *succ = bb->successors().front();
+            for (Instruction *inst = succ->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+            {
+                static_cast<PhiInst *>(inst)->replace_incoming_block(bb, rest);
+            }
+            bb->remove_successor(succ);
+            rest->add_successor(succ);
+        }
+        return rest;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Inliner Implementation
+//===----------------------------------------------------------------------===//
+
+bool is_inlinable(const CallInst &call)
+{
+    Function *callee = call.called_function();
+    if (!callee || callee->basic_blocks().empty())
+    {
+        return false;
+    }
+    return callee != call.parent()->parent_function() &&
+           callee->num_args() + 1 == call.num_operands() &&
+           callee->entry_block()->predecessors().empty() &&
+           !calls_itself(*callee);
+}
+
+int inline_cost(const CallInst &call, const InlineParams &params)
+{
+    const Function *callee = call.called_function();
+    // The call and the argument moves go away
+    int cost = static_cast<int>(count_instructions(*callee)) - static_cast<int>(call.num_operands());
+    for (unsigned i = 1; i < call.num_operands(); ++i)
+    {
+        if (is_constant_argument(call.operand(i)))
+            cost -= params.constant_arg_bonus;
+    }
+    if (callee->is_instance_method())
+    {
+        cost -= params.instance_method_bonus;
+    }
+    return cost;
+}
+
+void inline_call(CallInst *call, const DominatorTree &callee_dom_tree)
+{
+    MO_ASSERT(is_inlinable(*call), "Call is not inlinable");
+    Function *callee = call->called_function();
+    BasicBlock *call_bb = call->parent();
+    Function *caller = call_bb->parent_function();
+
+    ValueMap map;
+    for (size_t i = 0; i < callee->num_args(); ++i)
+    {
+        map[callee->arg(i)] = call->operand(i + 1);
+    }
+    BasicBlock *rest = split_after(call);
+    const std::vector<BasicBlock *> body = clone_blocks(callee_dom_tree.reverse_post_order(), *caller, map, "." + callee->name());
+    if (call_bb->has_profile_count())
+    {
+        rest->set_profile_count(call_bb->profile_count());
+        scale_profile(body, callee->entry_block(), call_bb->profile_count());
+    }
+    call_bb->append(BranchInst::create(body.front(), call_bb));
+
+    BasicBlock *caller_entry = caller->entry_block();
+    std::vector<std::pair<Value *, BasicBlock *>> returns;
+    for (BasicBlock *bb : body)
+    {
+        for (Instruction *inst = bb->first_instruction(), *next; inst; inst = next)
+        {
+            next = inst->next();
+            if (inst->opcode() == Opcode::Alloca)
+            {
+                caller_entry->insert_before(caller_entry->first_instruction(), bb->remove(inst));
+            }
+        }
+        auto *ret = dynamic_cast<ReturnInst *>(bb->get_terminator());
+        if (!ret)
+        {
+            continue;
+        }
+        returns.emplace_back(ret->value(), bb);
+        bb->erase(ret);
+        bb->append(BranchInst::create(rest, bb));
+    }
+
+    if (call->has_uses())
+    {
+        Value *result;
+        if (returns.size() == 1)
+        {
+            result = returns.front().first;
+        }
+        else if (returns.empty())
+        {
+            // The callee never returns, so neither does anything reading this
+            result = caller->parent_module()->get_constant_zero(call->type());
+        }
+        else
+        {
+            auto *phi = PhiInst::create(call->type(), rest);
+            for (const auto &[value, bb] : returns)
+            {
+                phi->add_incoming(value, bb);
+            }
+            rest->insert_before(rest->first_instruction(), std::unique_ptr<Instruction>(phi));
+            result = phi;
+        }
+        call->replace_all_uses_with(result);
+    }
+    call_bb->erase(call);
+}
+
+void inline_call(CallInst *call)
+{
+    DominatorTree dom_tree(*call->called_function());
+    inline_call(call, dom_tree);
+}
+
+unsigned inline_calls(Module &module, AnalysisManager &analyses, const InlineParams &params)
+{
+    unsigned inlined = 0;
+    for (Function *caller : bottom_up_order(module))
+    {
+        if (caller->basic_blocks().empty())
+        {
+            continue;
+        }
+
+        // Hotness is decided up front; inlining moves the sites to new blocks
+        const LoopInfo &loops = analyses.loop_info(*caller);
+        std::vector<std::pair<CallInst *, int>> sites;
+        for (BasicBlock *bb : caller->basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                if (inst.opcode() != Opcode::Call)
+                    continue;
+                auto &call = static_cast<CallInst &>(inst);
+                if (!is_inlinable(call))
+                    continue;
+                bool hot = loops.loop_depth(bb) > 0 || (params.is_hot && params.is_hot(call));
+                if (bb->has_profile_count())
+                {
+                    if (bb->profile_count() == 0)
+                    {
+                        sites.emplace_back(&call, params.cold_threshold);
+                        continue;
+                    }
+                    hot = bb->profile_count() >= params.hot_count;
+                }
+                sites.emplace_back(&call, hot ? params.hot_threshold : params.threshold);
+            }
+        }
+
+        unsigned size = count_instructions(*caller);
+        bool changed = false;
+        for (auto [call, limit] : sites)
+        {
+            if (inline_cost(*call, params) > limit)
+            {
+                continue;
+            }
+            Function *callee = call->called_function();
+            const unsigned callee_size = count_instructions(*callee);
+            if (size + callee_size > params.max_caller_size)
+            {
+                continue;
+            }
+            inline_call(call, analyses.dominator_tree(*callee));
+            size += callee_size;
+            ++inlined;
+            changed = true;
+        }
+        if (changed)
+        {
+            analyses.invalidate(*caller, PreservedAnalyses::none());
+        }
+    }
+    return inlined;
+}
+
+PreservedAnalyses InlinerPass::run(Module &module, AnalysisManager &analyses)
+{
+    return inline_calls(module, analyses, params_) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+void add_inliner_passes(PassManager &pm, InlineParams params)
+{
+    pm.add(std::make_unique<InlinerPass>(std::move(params)));
+    pm.add(std::make_unique<SimplifyCFGPass>());
+    pm.add(std::make_unique<SROAPass>());
+    pm.add(std::make_unique<Mem2RegPass>());
+    pm.add(std::make_unique<GVNPass>());
+    pm.add(std::make_unique<DeadCodeEliminationPass>());
+    pm.add(std::make_unique<SimplifyCFGPass>());
+    pm.add(std::make_unique<TailCallPass>());
+}
@@ -0,0 +1,75 @@
+// inliner.h - Inlining of small direct calls
+#pragma once
+
+#include <functional>
+
+#include "../ir.h"
+#include "dominators.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Inliner
+//===----------------------------------------------------------------------===//
+//
+// Replaces direct calls with a copy of the callee's body. The call's block
+// is split after the call, the copy goes in between, and each `ret` of the
+// copy becomes a branch to the rest of the block, with a phi collecting the
+// returned values. The callee's allocas move to the caller's entry block so
+// mem2reg can promote them along with the caller's own.
+//
+// The cost of a call site is the callee's instruction count minus what the
+// call itself costs, minus bonuses for constant arguments and for methods,
+// whose `self` accesses fold away once inlined. Sites inside loops, or that
+// `InlineParams::is_hot` reports, get the higher threshold. A site with a
+// profile count is judged by it instead: one that ran `hot_count` times is
+// hot, and one that never ran only takes callees within `cold_threshold`.
+// The copied blocks get the callee's counts scaled to the site's.
+
+struct InlineParams
+{
+    int threshold = 40;
+    int hot_threshold = 120;
+    int cold_threshold = 0;
+    uint64_t hot_count = 1000;
+    int constant_arg_bonus = 10;
+    int instance_method_bonus = 10;
+    // A caller stops taking in callees once it has this many instructions
+    unsigned max_caller_size = 3000;
+    // Profile or annotation hint; may be left empty
+    std::function<bool(const CallInst &)> is_hot;
+};
+
+// Whether `call` is direct and its callee has a body, is not recursive and
+// is not the caller itself
+bool is_inlinable(const CallInst &call);
+
+// Lower is more worth inlining; only meaningful for inlinable calls
+int inline_cost(const CallInst &call, const InlineParams &params);
+
+// Inlines an inlinable `call`, which is erased
+void inline_call(CallInst *call, const DominatorTree &callee_dom_tree);
+void inline_call(CallInst *call);
+
+// Inlines the call sites of `module` under the cost model; callees are
+// visited before their callers, so a caller sees them already inlined into.
+// Returns how many calls were inlined
+unsigned inline_calls(Module &module, AnalysisManager &analyses, const InlineParams &params = {});
+
+class InlinerPass : public ModulePass
+{
+public:
+    explicit InlinerPass(InlineParams params = {}) : params_(std::move(params)) {}
+
+    const char *name() const override { return "inline"; }
+    PreservedAnalyses run(Module &module, AnalysisManager &analyses) override;
+
+private:
+    InlineParams params_;
+};
+
+// Adds the inliner followed by the passes that clean up after it:
+// SimplifyCFG joins the split blocks back up, SROA and mem2reg promote the
+// copied parameter slots and the fields of struct locals, GVN and DCE fold what constant arguments made redundant,
+// and a last SimplifyCFG drops the branches they decided. Calls left in tail
+// position are marked at the very end, once nothing moves any more
+void add_inliner_passes(PassManager &pm, InlineParams params = {});
@@ -0,0 +1,245 @@
+#include "licm.h"
+#include <vector>
+
+#include "../mo_debug.h"
+#include "loop_simplify.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    bool is_nonzero_divisor(const Value *divisor, bool is_signed)
+    {
+        auto *constant = dynamic_cast<const ConstantInt *>(divisor);
+        if (!constant)
+            return false;
+        const uint8_t bits = constant->type()->bit_width();
+        const uint64_t value = truncate_value(constant->value(), bits, true);
+        if (value == 0)
+            return false;
+        // INT_MIN / -1 overflows
+        return !is_signed || truncate_value(constant->value(), bits, false) != ~0ULL;
+    }
+
+    // Whether `inst` may run on a path where it wasn't going to without
+    // trapping or touching memory
+    bool is_speculatable(const Instruction &inst)
+    {
+        switch (inst.opcode())
+        {
+        case Opcode::UDiv:
+        case Opcode::URem:
+            return is_nonzero_divisor(inst.operand(1), false);
+        case Opcode::SDiv:
+        case Opcode::SRem:
+            return is_nonzero_divisor(inst.operand(1), true);
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::Neg:
+        case Opcode::Not:
+        case Opcode::FNeg:
+        case Opcode::GetElementPtr:
+        case Opcode::ICmp:
+        case Opcode::FCmp:
+        case Opcode::ZExt:
+        case Opcode::SExt:
+        case Opcode::Trunc:
+        case Opcode::SIToFP:
+        case Opcode::FPToSI:
+        case Opcode::FPExt:
+        case Opcode::FPTrunc:
+        case Opcode::BitCast:
+        case Opcode::PtrToInt:
+        case Opcode::IntToPtr:
+        case Opcode::FPToUI:
+        case Opcode::UIToFP:
+        case Opcode::BitAnd:
+        case Opcode::BitOr:
+        case Opcode::BitXor:
+        case Opcode::BitNot:
+        case Opcode::Shl:
+        case Opcode::LShr:
+        case Opcode::AShr:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // The alloca, global or other value `ptr` is an address into
+    const Value *underlying_object(const Value *ptr)
+    {
+        while (true)
+        {
+            if (auto *gep = dynamic_cast<const GetElementPtrInst *>(ptr))
+                ptr = gep->base_pointer();
+            else if (auto *cast = dynamic_cast<const BitCastInst *>(ptr))
+                ptr = cast->operand(0);
+            else
+                return ptr;
+        }
+    }
+
+    bool is_identified_object(const Value *object)
+    {
+        return dynamic_cast<const AllocaInst *>(object) || dynamic_cast<const GlobalVariable *>(object);
+    }
+
+    // Whether `ptr` is an alloca or global, or constant indices off one
+    bool is_dereferenceable(const Value *ptr)
+    {
+        while (auto *gep = dynamic_cast<const GetElementPtrInst *>(ptr))
+        {
+            for (unsigned i = 1; i < gep->num_operands(); ++i)
+            {
+                if (!dynamic_cast<const ConstantInt *>(gep->operand(i)))
+                    return false;
+            }
+            ptr = gep->base_pointer();
+        }
+        return is_identified_object(ptr);
+    }
+
+    // What the body of a loop may write
+    struct LoopMemory
+    {
+        bool has_calls = false;
+        bool has_unknown_stores = false;
+        std::vector<const Value *> stored_objects;
+
+        explicit LoopMemory(const Loop &loop)
+        {
+            for (BasicBlock *bb : loop.blocks())
+            {
+                for (const Instruction &inst : *bb)
+                {
+                    if (inst.opcode() == Opcode::Call)
+                    {
+                        has_calls = true;
+                    }
+                    else if (auto *store = dynamic_cast<const StoreInst *>(&inst))
+                    {
+                        const Value *object = underlying_object(store->pointer());
+                        if (is_identified_object(object))
+                            stored_objects.push_back(object);
+                        else
+                            has_unknown_stores = true;
+                    }
+                }
+            }
+        }
+
+        bool may_write(const Value *ptr) const
+        {
+            if (has_calls || has_unknown_stores)
+                return true;
+            const Value *object = underlying_object(ptr);
+            if (!is_identified_object(object))
+                return !stored_objects.empty();
+            for (const Value *stored : stored_objects)
+            {
+                if (stored == object)
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    bool runs_on_every_trip(const BasicBlock *bb, const std::vector<BasicBlock *> &exiting, const DominatorTree &dom_tree)
+    {
+        for (const BasicBlock *exit : exiting)
+        {
+            if (!dom_tree.dominates(bb, exit))
+                return false;
+        }
+        return true;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             LICM Implementation
+//===----------------------------------------------------------------------===//
+
+bool is_loop_invariant(const Instruction &inst, const Loop &loop)
+{
+    for (unsigned i = 0; i < inst.num_operands(); ++i)
+    {
+        auto *def = dynamic_cast<const Instruction *>(inst.operand(i));
+        if (def && loop.contains(def->parent()))
+            return false;
+    }
+    return true;
+}
+
+unsigned hoist_loop_invariants(Loop &loop, BasicBlock *preheader, const DominatorTree &dom_tree)
+{
+    const LoopMemory memory(loop);
+    std::vector<BasicBlock *> exiting;
+    for (BasicBlock *bb : loop.blocks())
+    {
+        for (BasicBlock *succ : bb->successors())
+        {
+            if (!loop.contains(succ))
+            {
+                exiting.push_back(bb);
+                break;
+            }
+        }
+    }
+
+    // Blocks come in reverse post-order, so the operands an instruction
+    // waits for have been moved by the time it is looked at
+    unsigned hoisted = 0;
+    for (BasicBlock *bb : loop.blocks())
+    {
+        Instruction *next = nullptr;
+        for (Instruction *inst = bb->first_non_phi(); inst; inst = next)
+        {
+            next = inst->next();
+            if (!is_loop_invariant(*inst, loop))
+            {
+                continue;
+            }
+            bool movable = is_speculatable(*inst);
+            if (auto *load = dynamic_cast<LoadInst *>(inst))
+            {
+                movable = !memory.may_write(load->pointer()) &&
+                          (is_dereferenceable(load->pointer()) || runs_on_every_trip(bb, exiting, dom_tree));
+            }
+            if (!movable)
+            {
+                continue;
+            }
+            preheader->insert_before(preheader->get_terminator(), bb->remove(inst));
+            ++hoisted;
+        }
+    }
+    return hoisted;
+}
+
+unsigned hoist_loop_invariants(Function &func, const LoopInfo &loops, const DominatorTree &dom_tree)
+{
+    unsigned hoisted = 0;
+    for (Loop *loop : loops_innermost_first(loops))
+    {
+        if (BasicBlock *preheader = loop_preheader(*loop))
+            hoisted += hoist_loop_invariants(*loop, preheader, dom_tree);
+    }
+    MO_DEBUG("licm: hoisted %u instructions in %s\n", hoisted, func.name().c_str());
+    return hoisted;
+}
+
+PreservedAnalyses LICMPass::run(Function &func, AnalysisManager &analyses)
+{
+    bool added_preheaders = false;
+    const LoopInfo &loops = simplified_loop_info(func, analyses, added_preheaders);
+    const bool hoisted = hoist_loop_invariants(func, loops, analyses.dominator_tree(func)) != 0;
+    if (added_preheaders)
+    {
+        return PreservedAnalyses::none();
+    }
+    return hoisted ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
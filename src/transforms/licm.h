@@ -0,0 +1,46 @@
+// licm.h - Loop-invariant code motion
+#pragma once
+
+#include "../ir.h"
+#include "dominators.h"
+#include "loop_info.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             LICM
+//===----------------------------------------------------------------------===//
+//
+// IRGenerator re-evaluates everything a loop body mentions on every trip:
+// member address chains off a pointer that never changes, `sizeof`
+// arithmetic, loads of constants. An instruction whose operands are all
+// defined outside a loop computes the same value on every iteration, so it
+// is moved to the loop's preheader (see loop_simplify.h), where it runs
+// once. Loops are visited innermost first, so a value hoisted out of an
+// inner loop can keep going out of the loops around it.
+//
+// The preheader runs even when the loop body doesn't, so only instructions
+// that can't trap are moved: the arithmetic, comparisons, casts and GEPs
+// GVN also treats as pure, and divisions by a constant other than 0 and -1.
+// A load is moved when nothing in the loop can write what it reads: the loop
+// has no calls, and every store goes to a different alloca or global than
+// the one the load's address is derived from. It must also run on every
+// trip, i.e. its block dominates every block leaving the loop, unless it
+// reads an alloca or global at constant indices, which is always valid.
+
+// Whether `inst` computes the same value on every iteration of `loop`
+bool is_loop_invariant(const Instruction &inst, const Loop &loop);
+
+// Hoists the invariant instructions of `loop` into `preheader`, and returns
+// how many it moved
+unsigned hoist_loop_invariants(Loop &loop, BasicBlock *preheader, const DominatorTree &dom_tree);
+
+// Every loop of `func` with a preheader, inner loops first
+unsigned hoist_loop_invariants(Function &func, const LoopInfo &loops, const DominatorTree &dom_tree);
+
+// Adds preheaders first, so the CFG is kept only when none were missing
+class LICMPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "licm"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
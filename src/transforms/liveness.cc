@@ -0,0 +1,129 @@
+#include "liveness.h"
+
+//===----------------------------------------------------------------------===//
+//                             Liveness Implementation
+//===----------------------------------------------------------------------===//
+
+Liveness::Liveness(const Function &func, const DominatorTree &dom_tree)
+    : dom_tree_(dom_tree)
+{
+    const auto &rpo = dom_tree.reverse_post_order();
+    for (Argument *arg : func.args())
+    {
+        numbers_.emplace(arg, values_.size());
+        values_.push_back(arg);
+    }
+    for (BasicBlock *bb : rpo)
+    {
+        for (Instruction &inst : *bb)
+        {
+            numbers_.emplace(&inst, values_.size());
+            values_.push_back(&inst);
+        }
+    }
+
+    const size_t words = (values_.size() + 63) / 64;
+    std::vector<BitVector> gen(rpo.size(), BitVector(words));
+    std::vector<BitVector> kill(rpo.size(), BitVector(words));
+    std::vector<BitVector> phi_out(rpo.size(), BitVector(words));
+    live_in_.assign(rpo.size(), BitVector(words));
+    live_out_.assign(rpo.size(), BitVector(words));
+
+    for (unsigned b = 0; b < rpo.size(); ++b)
+    {
+        for (Instruction &inst : *rpo[b])
+        {
+            set(kill[b], numbers_.at(&inst));
+            if (auto *phi = dynamic_cast<PhiInst *>(&inst))
+            {
+                for (unsigned i = 0; i < phi->num_incoming(); ++i)
+                {
+                    auto it = numbers_.find(phi->get_incoming_value(i));
+                    BasicBlock *pred = phi->get_incoming_block(i);
+                    if (it != numbers_.end() && dom_tree.is_reachable(pred))
+                        set(phi_out[dom_tree.rpo_index(pred)], it->second);
+                }
+                continue;
+            }
+            // In SSA form a value defined in this block is defined before its
+            // non-phi uses here, so any operand not yet killed is upward exposed
+            for (Value *operand : inst.operands())
+            {
+                auto it = numbers_.find(operand);
+                if (it != numbers_.end() && !test(kill[b], it->second))
+                    set(gen[b], it->second);
+            }
+        }
+    }
+
+    // Backward dataflow, visiting blocks in post-order so most successors
+    // are final before their predecessors
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (unsigned b = rpo.size(); b-- > 0;)
+        {
+            BitVector out = phi_out[b];
+            for (BasicBlock *succ : rpo[b]->successors())
+            {
+                if (!dom_tree.is_reachable(succ))
+                    continue;
+                const BitVector &succ_in = live_in_[dom_tree.rpo_index(succ)];
+                for (size_t w = 0; w < words; ++w)
+                    out[w] |= succ_in[w];
+            }
+            BitVector in(words);
+            for (size_t w = 0; w < words; ++w)
+                in[w] = gen[b][w] | (out[w] & ~kill[b][w]);
+
+            if (in != live_in_[b] || out != live_out_[b])
+            {
+                live_in_[b] = std::move(in);
+                live_out_[b] = std::move(out);
+                changed = true;
+            }
+        }
+    }
+}
+
+bool Liveness::query(const std::vector<BitVector> &sets, const Value *value, const BasicBlock *bb) const
+{
+    auto it = numbers_.find(value);
+    if (it == numbers_.end() || !dom_tree_.is_reachable(bb))
+    {
+        return false;
+    }
+    return test(sets[dom_tree_.rpo_index(bb)], it->second);
+}
+
+bool Liveness::is_live_in(const Value *value, const BasicBlock *bb) const
+{
+    return query(live_in_, value, bb);
+}
+
+bool Liveness::is_live_out(const Value *value, const BasicBlock *bb) const
+{
+    return query(live_out_, value, bb);
+}
+
+std::vector<Value *> Liveness::collect(const BitVector &bits) const
+{
+    std::vector<Value *> result;
+    for (unsigned i = 0; i < values_.size(); ++i)
+    {
+        if (test(bits, i))
+            result.push_back(values_[i]);
+    }
+    return result;
+}
+
+std::vector<Value *> Liveness::live_in(const BasicBlock *bb) const
+{
+    return dom_tree_.is_reachable(bb) ? collect(live_in_[dom_tree_.rpo_index(bb)]) : std::vector<Value *>{};
+}
+
+std::vector<Value *> Liveness::live_out(const BasicBlock *bb) const
+{
+    return dom_tree_.is_reachable(bb) ? collect(live_out_[dom_tree_.rpo_index(bb)]) : std::vector<Value *>{};
+}
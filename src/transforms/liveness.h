@@ -0,0 +1,43 @@
+// liveness.h - Block-level liveness of SSA values
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "../ir.h"
+#include "dominators.h"
+
+//===----------------------------------------------------------------------===//
+//                             Liveness
+//===----------------------------------------------------------------------===//
+
+// Live-in and live-out sets of the reachable blocks, over the values a block
+// can refer to from elsewhere: arguments and instructions. Phis follow the
+// usual SSA reading: an incoming value is live out of its predecessor only,
+// and the phi itself is defined at the top of its block, not live into it.
+// The sets are bit vectors over a numbering of the function's values.
+class Liveness
+{
+public:
+    Liveness(const Function &func, const DominatorTree &dom_tree);
+
+    bool is_live_in(const Value *value, const BasicBlock *bb) const;
+    bool is_live_out(const Value *value, const BasicBlock *bb) const;
+    std::vector<Value *> live_in(const BasicBlock *bb) const;
+    std::vector<Value *> live_out(const BasicBlock *bb) const;
+
+private:
+    using BitVector = std::vector<uint64_t>;
+
+    static bool test(const BitVector &bits, unsigned i) { return bits[i / 64] >> (i % 64) & 1; }
+    static void set(BitVector &bits, unsigned i) { bits[i / 64] |= uint64_t(1) << (i % 64); }
+    std::vector<Value *> collect(const BitVector &bits) const;
+    bool query(const std::vector<BitVector> &sets, const Value *value, const BasicBlock *bb) const;
+
+    const DominatorTree &dom_tree_;
+    std::unordered_map<const Value *, unsigned> numbers_;
+    std::vector<Value *> values_;
+    std::vector<BitVector> live_in_;  // by RPO index
+    std::vector<BitVector> live_out_; // by RPO index
+};
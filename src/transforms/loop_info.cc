@@ -0,0 +1,109 @@
+#include "loop_info.h"
+
+//===----------------------------------------------------------------------===//
+//                             Loop Implementation
+//===----------------------------------------------------------------------===//
+
+bool Loop::contains(const BasicBlock *bb) const
+{
+    return dom_tree_->is_reachable(bb) && members_[dom_tree_->rpo_index(bb)];
+}
+
+//===----------------------------------------------------------------------===//
+//                             LoopInfo Implementation
+//===----------------------------------------------------------------------===//
+
+LoopInfo::LoopInfo(const DominatorTree &dom_tree)
+    : dom_tree_(dom_tree), innermost_(dom_tree.reverse_post_order().size(), nullptr)
+{
+    const auto &rpo = dom_tree.reverse_post_order();
+
+    // A header dominates every block of its loop, including the headers of
+    // nested loops, so walking in reverse post-order finds outer loops first
+    for (BasicBlock *header : rpo)
+    {
+        std::vector<BasicBlock *> latches;
+        for (BasicBlock *pred : header->predecessors())
+        {
+            if (dom_tree.dominates(header, pred))
+                latches.push_back(pred);
+        }
+        if (latches.empty())
+        {
+            continue;
+        }
+
+        auto loop = std::make_unique<Loop>();
+        loop->header_ = header;
+        loop->latches_ = latches;
+        loop->dom_tree_ = &dom_tree;
+        loop->members_.assign(rpo.size(), false);
+        loop->members_[dom_tree.rpo_index(header)] = true;
+
+        std::vector<BasicBlock *> worklist = latches;
+        while (!worklist.empty())
+        {
+            BasicBlock *bb = worklist.back();
+            worklist.pop_back();
+            const unsigned index = dom_tree.rpo_index(bb);
+            if (loop->members_[index])
+            {
+                continue;
+            }
+            loop->members_[index] = true;
+            for (BasicBlock *pred : bb->predecessors())
+            {
+                if (dom_tree.is_reachable(pred))
+                    worklist.push_back(pred);
+            }
+        }
+
+        loop->blocks_.push_back(header);
+        for (unsigned i = 0; i < rpo.size(); ++i)
+        {
+            if (loop->members_[i] && rpo[i] != header)
+                loop->blocks_.push_back(rpo[i]);
+        }
+
+        // Loops containing this header form a chain; the innermost of them
+        // has the latest header
+        for (size_t j = loops_.size(); j-- > 0;)
+        {
+            if (loops_[j]->contains(header))
+            {
+                loop->parent_ = loops_[j].get();
+                loop->depth_ = loop->parent_->depth_ + 1;
+                loop->parent_->children_.push_back(loop.get());
+                break;
+            }
+        }
+        if (!loop->parent_)
+        {
+            top_level_.push_back(loop.get());
+        }
+
+        // Inner loops come later and overwrite their blocks
+        for (BasicBlock *bb : loop->blocks_)
+        {
+            innermost_[dom_tree.rpo_index(bb)] = loop.get();
+        }
+        loops_.push_back(std::move(loop));
+    }
+}
+
+Loop *LoopInfo::loop_for(const BasicBlock *bb) const
+{
+    return dom_tree_.is_reachable(bb) ? innermost_[dom_tree_.rpo_index(bb)] : nullptr;
+}
+
+unsigned LoopInfo::loop_depth(const BasicBlock *bb) const
+{
+    Loop *loop = loop_for(bb);
+    return loop ? loop->depth() : 0;
+}
+
+bool LoopInfo::is_loop_header(const BasicBlock *bb) const
+{
+    Loop *loop = loop_for(bb);
+    return loop && loop->header() == bb;
+}
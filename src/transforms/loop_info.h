@@ -0,0 +1,69 @@
+// loop_info.h - Natural loops of IR functions
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "../ir.h"
+#include "dominators.h"
+
+//===----------------------------------------------------------------------===//
+//                             Loop
+//===----------------------------------------------------------------------===//
+
+// A natural loop: the header plus every block that reaches one of its back
+// edges (latch -> header, where the header dominates the latch) without going
+// through the header. Loops sharing a header are one loop with several latches.
+class Loop
+{
+public:
+    BasicBlock *header() const { return header_; }
+    const std::vector<BasicBlock *> &latches() const { return latches_; }
+    // Header first, the rest in reverse post-order
+    const std::vector<BasicBlock *> &blocks() const { return blocks_; }
+    bool contains(const BasicBlock *bb) const;
+
+    Loop *parent() const { return parent_; }
+    const std::vector<Loop *> &children() const { return children_; }
+    // 1 for outermost loops
+    unsigned depth() const { return depth_; }
+
+private:
+    friend class LoopInfo;
+
+    BasicBlock *header_ = nullptr;
+    std::vector<BasicBlock *> latches_;
+    std::vector<BasicBlock *> blocks_;
+    std::vector<bool> members_; // by RPO index
+    const DominatorTree *dom_tree_ = nullptr;
+    Loop *parent_ = nullptr;
+    std::vector<Loop *> children_;
+    unsigned depth_ = 1;
+};
+
+//===----------------------------------------------------------------------===//
+//                             LoopInfo
+//===----------------------------------------------------------------------===//
+
+// The loop nest of a function. Keeps a reference to the dominator tree it was
+// built from, so it has to be dropped together with that tree.
+class LoopInfo
+{
+public:
+    explicit LoopInfo(const DominatorTree &dom_tree);
+
+    // Outermost loops, in the order of their headers in reverse post-order
+    const std::vector<Loop *> &top_level() const { return top_level_; }
+    size_t num_loops() const { return loops_.size(); }
+    // Innermost loop containing `bb`, or null
+    Loop *loop_for(const BasicBlock *bb) const;
+    // Number of loops containing `bb`
+    unsigned loop_depth(const BasicBlock *bb) const;
+    bool is_loop_header(const BasicBlock *bb) const;
+
+private:
+    const DominatorTree &dom_tree_;
+    std::vector<std::unique_ptr<Loop>> loops_;
+    std::vector<Loop *> top_level_;
+    std::vector<Loop *> innermost_; // by RPO index
+};
@@ -0,0 +1,25 @@
+#include "loop_passes.h"
+
+#include "dce.h"
+#include "gvn.h"
+#include "licm.h"
+#include "loop_simplify.h"
+#include "loop_strength_reduce.h"
+#include "loop_unroll.h"
+#include "simplify_cfg.h"
+#include "vectorize.h"
+
+void add_loop_passes(PassManager &pm, unsigned vector_bytes)
+{
+    pm.add(std::make_unique<LoopSimplifyPass>());
+    pm.add(std::make_unique<LICMPass>());
+    if (vector_bytes)
+        pm.add(std::make_unique<LoopVectorizePass>(vector_bytes));
+    pm.add(std::make_unique<LoopStrengthReducePass>());
+    pm.add(std::make_unique<LoopUnrollPass>());
+    pm.add(std::make_unique<GVNPass>());
+    if (vector_bytes)
+        pm.add(std::make_unique<SLPVectorizePass>(vector_bytes));
+    pm.add(std::make_unique<DeadCodeEliminationPass>());
+    pm.add(std::make_unique<SimplifyCFGPass>());
+}
@@ -0,0 +1,21 @@
+// loop_passes.h - The loop optimization pipeline
+#pragma once
+
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Loop Passes
+//===----------------------------------------------------------------------===//
+
+// Adds the loop passes and their cleanup, for functions already in SSA form
+// (after mem2reg, e.g. through add_inliner_passes). LICM goes first, so the
+// bases strength reduction steps from are outside the loop by the time it
+// looks; unrolling comes last, copying the reduced body. GVN and DCE then
+// merge what the copies recompute and drop induction variables nothing
+// reads any more, and SimplifyCFG joins the copied blocks back up.
+//
+// For a target with vector registers of `vector_bytes`, loops are vectorized
+// right after LICM, while their addresses still index by the induction
+// variable, and the stores unrolling lined up are grouped by the SLP
+// vectorizer once GVN has merged their addresses. 0 leaves both out
+void add_loop_passes(PassManager &pm, unsigned vector_bytes = 0);
@@ -0,0 +1,181 @@
+#include "loop_simplify.h"
+
+#include "../mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    std::vector<BasicBlock *> outside_predecessors(const Loop &loop)
+    {
+        std::vector<BasicBlock *> result;
+        for (BasicBlock *pred : loop.header()->predecessors())
+        {
+            if (!loop.contains(pred))
+                result.push_back(pred);
+        }
+        return result;
+    }
+
+    void collect_post_order(Loop *loop, std::vector<Loop *> &order)
+    {
+        for (Loop *child : loop->children())
+        {
+            collect_post_order(child, order);
+        }
+        order.push_back(loop);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Loop Simplify Implementation
+//===----------------------------------------------------------------------===//
+
+BasicBlock *loop_preheader(const Loop &loop)
+{
+    const std::vector<BasicBlock *> outside = outside_predecessors(loop);
+    if (outside.size() != 1 || outside[0]->successors().size() != 1)
+    {
+        return nullptr;
+    }
+    return outside[0];
+}
+
+BasicBlock *insert_preheader(const Loop &loop)
+{
+    if (BasicBlock *existing = loop_preheader(loop))
+    {
+        return existing;
+    }
+    const std::vector<BasicBlock *> outside = outside_predecessors(loop);
+    if (outside.empty())
+    {
+        return nullptr;
+    }
+    for (BasicBlock *pred : outside)
+    {
+        if (!dynamic_cast<BranchInst *>(pred->get_terminator()))
+            return nullptr;
+    }
+
+    BasicBlock *header = loop.header();
+    BasicBlock *preheader = header->parent_function()->create_basic_block(header->name() + ".preheader");
+    for (Instruction *inst = header->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+    {
+        auto *phi = static_cast<PhiInst *>(inst);
+        if (outside.size() == 1)
+        {
+            phi->replace_incoming_block(outside[0], preheader);
+            continue;
+        }
+        PhiInst *merged = PhiInst::create(phi->type(), preheader);
+        merged->set_name(phi->name() + ".ph");
+        for (BasicBlock *pred : outside)
+        {
+            for (unsigned i = 0; i < phi->num_incoming(); ++i)
+            {
+                if (phi->get_incoming_block(i) == pred)
+                {
+                    merged->add_incoming(phi->get_incoming_value(i), pred);
+                    break;
+                }
+            }
+            phi->remove_incoming(pred);
+        }
+        preheader->append(merged);
+        phi->add_incoming(merged, preheader);
+    }
+
+    // Runs once for every entry into the loop
+    bool counted = header->has_profile_count();
+    uint64_t entries = 0;
+    for (BasicBlock *pred : outside)
+    {
+        auto *branch = static_cast<BranchInst *>(pred->get_terminator());
+        counted = counted && pred->has_profile_count() && (!branch->is_conditional() || branch->has_branch_weights());
+        entries += branch->edge_weight(header);
+        branch->replace_successor(header, preheader);
+    }
+    if (counted)
+        preheader->set_profile_count(entries);
+    preheader->append(BranchInst::create(header, preheader));
+    return preheader;
+}
+
+unsigned insert_preheaders(Function &func, const LoopInfo &loops)
+{
+    // New blocks only ever sit in front of their own header, so the other
+    // loops still see the predecessors they were built with
+    unsigned inserted = 0;
+    for (Loop *loop : loops_innermost_first(loops))
+    {
+        if (loop_preheader(*loop))
+        {
+            continue;
+        }
+        inserted += insert_preheader(*loop) != nullptr;
+    }
+    MO_DEBUG("loop-simplify: inserted %u preheaders in %s\n", inserted, func.name().c_str());
+    return inserted;
+}
+
+bool match_induction_variable(const Loop &loop, const BasicBlock *preheader, PhiInst *phi, InductionVariable &iv)
+{
+    if (phi->parent() != loop.header() || loop.latches().size() != 1 || phi->num_incoming() != 2)
+    {
+        return false;
+    }
+    const BasicBlock *latch = loop.latches().front();
+    Value *init = nullptr;
+    Value *back = nullptr;
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        if (phi->get_incoming_block(i) == preheader)
+            init = phi->get_incoming_value(i);
+        else if (phi->get_incoming_block(i) == latch)
+            back = phi->get_incoming_value(i);
+    }
+    auto *next = dynamic_cast<BinaryInst *>(back);
+    if (!init || !next || next->opcode() != Opcode::Add)
+    {
+        return false;
+    }
+    auto *step = dynamic_cast<ConstantInt *>(next->left() == phi ? next->right() : next->left());
+    if (!step || (next->left() != phi && next->right() != phi))
+    {
+        return false;
+    }
+    iv = {phi, init, next, step};
+    return true;
+}
+
+std::vector<Loop *> loops_innermost_first(const LoopInfo &loops)
+{
+    std::vector<Loop *> order;
+    order.reserve(loops.num_loops());
+    for (Loop *loop : loops.top_level())
+    {
+        collect_post_order(loop, order);
+    }
+    return order;
+}
+
+const LoopInfo &simplified_loop_info(Function &func, AnalysisManager &analyses, bool &changed)
+{
+    if (!insert_preheaders(func, analyses.loop_info(func)))
+    {
+        return analyses.loop_info(func);
+    }
+    changed = true;
+    analyses.invalidate(func, PreservedAnalyses::none());
+    return analyses.loop_info(func);
+}
+
+PreservedAnalyses LoopSimplifyPass::run(Function &func, AnalysisManager &analyses)
+{
+    bool changed = false;
+    simplified_loop_info(func, analyses, changed);
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
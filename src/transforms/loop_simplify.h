@@ -0,0 +1,63 @@
+// loop_simplify.h - Preheaders and induction variables of natural loops
+#pragma once
+
+#include <vector>
+
+#include "../ir.h"
+#include "loop_info.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Loop Simplify
+//===----------------------------------------------------------------------===//
+//
+// The loop passes move code out of a loop and set up values before it, so
+// they need one block that runs right before the header every time the loop
+// is entered: the preheader. IRGenerator's loops usually have one already,
+// the block that falls into the condition, but a loop entered from several
+// places (after inlining or SimplifyCFG, or a `continue` target reached from
+// a branch) doesn't. A new "<header>.preheader" block then takes over every
+// edge from outside the loop; header phis with several outside incoming
+// values get a phi of their own in it.
+//
+// Loops headed by the entry block can't be given one and are left alone.
+
+// The single predecessor of `loop`'s header from outside the loop, when its
+// only successor is the header; null otherwise
+BasicBlock *loop_preheader(const Loop &loop);
+
+// Gives `loop` a preheader and returns it; null when its header has no
+// predecessor from outside the loop or one of them doesn't end in a branch
+BasicBlock *insert_preheader(const Loop &loop);
+
+// Gives every loop of `loops` a preheader, and returns how many blocks it
+// created. `loops` is stale afterwards as soon as one was
+unsigned insert_preheaders(Function &func, const LoopInfo &loops);
+
+// A header phi that starts at `init` and comes back from the single latch
+// of its loop as `phi + step`
+struct InductionVariable
+{
+    PhiInst *phi = nullptr;
+    Value *init = nullptr;
+    BinaryInst *next = nullptr;
+    ConstantInt *step = nullptr;
+};
+
+// Fills `iv` and returns true when `phi` is a basic induction variable of
+// `loop`, whose preheader is `preheader`
+bool match_induction_variable(const Loop &loop, const BasicBlock *preheader, PhiInst *phi, InductionVariable &iv);
+
+// Every loop of `loops`, inner loops before the loops containing them
+std::vector<Loop *> loops_innermost_first(const LoopInfo &loops);
+
+// Returns the LoopInfo of `func` once every loop has a preheader, rebuilt
+// through `analyses` when blocks had to be added; sets `changed` then
+const LoopInfo &simplified_loop_info(Function &func, AnalysisManager &analyses, bool &changed);
+
+class LoopSimplifyPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "loop-simplify"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
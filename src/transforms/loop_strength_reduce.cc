@@ -0,0 +1,128 @@
+#include "loop_strength_reduce.h"
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "../mo_debug.h"
+#include "loop_simplify.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    bool is_defined_outside(const Value *value, const Loop &loop)
+    {
+        auto *inst = dynamic_cast<const Instruction *>(value);
+        return !inst || !loop.contains(inst->parent());
+    }
+
+    // The induction variable `gep` is indexed by last, when everything else
+    // it uses is invariant in `loop`
+    const InductionVariable *stepped_index(const GetElementPtrInst &gep, const Loop &loop,
+                                           const std::unordered_map<const Value *, InductionVariable> &ivs)
+    {
+        const unsigned last = gep.num_operands() - 1;
+        if (last < 1)
+            return nullptr;
+        auto it = ivs.find(gep.operand(last));
+        if (it == ivs.end())
+            return nullptr;
+        for (unsigned i = 0; i < last; ++i)
+        {
+            if (!is_defined_outside(gep.operand(i), loop))
+                return nullptr;
+        }
+        return &it->second;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Loop Strength Reduction Implementation
+//===----------------------------------------------------------------------===//
+
+unsigned reduce_loop_strength(Loop &loop, BasicBlock *preheader)
+{
+    if (loop.latches().size() != 1)
+    {
+        return 0;
+    }
+    BasicBlock *header = loop.header();
+    BasicBlock *latch = loop.latches().front();
+
+    std::unordered_map<const Value *, InductionVariable> ivs;
+    for (Instruction *inst = header->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+    {
+        InductionVariable iv;
+        if (match_induction_variable(loop, preheader, static_cast<PhiInst *>(inst), iv))
+            ivs[inst] = iv;
+    }
+    if (ivs.empty())
+    {
+        return 0;
+    }
+
+    std::vector<GetElementPtrInst *> geps;
+    for (BasicBlock *bb : loop.blocks())
+    {
+        for (Instruction &inst : *bb)
+        {
+            auto *gep = dynamic_cast<GetElementPtrInst *>(&inst);
+            if (gep && stepped_index(*gep, loop, ivs))
+                geps.push_back(gep);
+        }
+    }
+
+    // One pointer per distinct base and indices
+    std::map<std::vector<Value *>, PhiInst *> pointers;
+    for (GetElementPtrInst *gep : geps)
+    {
+        const InductionVariable &iv = *stepped_index(*gep, loop, ivs);
+        std::vector<Value *> key(gep->operands().begin(), gep->operands().end());
+        PhiInst *&pointer = pointers[key];
+        if (!pointer)
+        {
+            std::vector<Value *> indices(key.begin() + 1, key.end());
+            indices.back() = iv.init;
+            auto *start = GetElementPtrInst::create(gep->base_pointer(), indices, preheader, gep->name() + ".start");
+            preheader->insert_before(preheader->get_terminator(), std::unique_ptr<Instruction>(start));
+
+            pointer = PhiInst::create(gep->type(), header);
+            pointer->set_name(gep->name() + ".iv");
+            header->insert_before(header->first_instruction(), std::unique_ptr<Instruction>(pointer));
+
+            auto *step = GetElementPtrInst::create(pointer, {iv.step}, latch, gep->name() + ".next");
+            latch->insert_before(latch->get_terminator(), std::unique_ptr<Instruction>(step));
+            pointer->add_incoming(start, preheader);
+            pointer->add_incoming(step, latch);
+        }
+        gep->replace_all_uses_with(pointer);
+        gep->parent()->erase(gep);
+    }
+    return static_cast<unsigned>(geps.size());
+}
+
+unsigned reduce_loop_strength(Function &func, const LoopInfo &loops)
+{
+    unsigned reduced = 0;
+    for (Loop *loop : loops_innermost_first(loops))
+    {
+        if (BasicBlock *preheader = loop_preheader(*loop))
+            reduced += reduce_loop_strength(*loop, preheader);
+    }
+    MO_DEBUG("loop-reduce: replaced %u indexed addresses in %s\n", reduced, func.name().c_str());
+    return reduced;
+}
+
+PreservedAnalyses LoopStrengthReducePass::run(Function &func, AnalysisManager &analyses)
+{
+    bool added_preheaders = false;
+    const LoopInfo &loops = simplified_loop_info(func, analyses, added_preheaders);
+    const bool reduced = reduce_loop_strength(func, loops) != 0;
+    if (added_preheaders)
+    {
+        return PreservedAnalyses::none();
+    }
+    return reduced ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
@@ -0,0 +1,38 @@
+// loop_strength_reduce.h - Pointer induction variables for indexed addresses
+#pragma once
+
+#include "../ir.h"
+#include "loop_info.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Loop Strength Reduction
+//===----------------------------------------------------------------------===//
+//
+// `a[i]` in a loop over `i` is `gep a, [0, i]`, which instruction selection
+// turns into a multiply by the element size and an add on every trip. When
+// `i` is a basic induction variable, a header phi that starts at `init` in
+// the preheader and comes back from the loop's single latch as `i + c` for
+// a constant `c`, the address moves by `c` elements per trip. The GEP is
+// then replaced by a pointer phi that starts at `gep a, [0, init]` in the
+// preheader and steps by `gep p, [c]` at the end of the latch.
+//
+// The induction variable has to be the last index, so the step is one
+// element of the type the GEP addresses, and the base and the other indices
+// have to be defined outside the loop. GEPs with the same base and indices
+// share one pointer. `i` itself stays for the loop condition and any other
+// use; DCE drops it when nothing else needs it.
+
+// Replaces the GEPs of `loop` indexed by its induction variables, and
+// returns how many it replaced. `preheader` must be the loop's preheader
+unsigned reduce_loop_strength(Loop &loop, BasicBlock *preheader);
+
+// Every loop of `func` with a preheader
+unsigned reduce_loop_strength(Function &func, const LoopInfo &loops);
+
+class LoopStrengthReducePass : public FunctionPass
+{
+public:
+    const char *name() const override { return "loop-reduce"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
@@ -0,0 +1,300 @@
+#include "loop_unroll.h"
+#include <string>
+#include <vector>
+
+#include "../mo_debug.h"
+#include "cloning.h"
+#include "loop_simplify.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // The pieces of a loop in the shape the unroller takes
+    struct LoopShape
+    {
+        BasicBlock *header = nullptr;
+        BasicBlock *latch = nullptr;
+        BasicBlock *body_entry = nullptr;
+        ICmpInst *cond = nullptr;
+        bool stays_on_true = true;
+        InductionVariable iv;
+    };
+
+    bool match_shape(const Loop &loop, LoopShape &shape)
+    {
+        const BasicBlock *preheader = loop_preheader(loop);
+        if (!preheader || loop.latches().size() != 1 || !loop.children().empty())
+            return false;
+        shape.header = loop.header();
+        shape.latch = loop.latches().front();
+        if (shape.latch == shape.header)
+            return false;
+
+        auto *back = dynamic_cast<BranchInst *>(shape.latch->get_terminator());
+        auto *exit = dynamic_cast<BranchInst *>(shape.header->get_terminator());
+        if (!back || back->is_conditional() || !exit || !exit->is_conditional())
+            return false;
+        shape.stays_on_true = loop.contains(exit->get_true_successor());
+        shape.body_entry = shape.stays_on_true ? exit->get_true_successor() : exit->get_false_successor();
+        if (loop.contains(shape.stays_on_true ? exit->get_false_successor() : exit->get_true_successor()))
+            return false;
+        if (shape.body_entry->predecessors().size() != 1 || shape.body_entry->first_instruction()->opcode() == Opcode::Phi)
+            return false;
+        // The header is the only way out
+        for (BasicBlock *bb : loop.blocks())
+        {
+            if (bb == shape.header)
+                continue;
+            for (BasicBlock *succ : bb->successors())
+            {
+                if (!loop.contains(succ))
+                    return false;
+            }
+        }
+
+        shape.cond = dynamic_cast<ICmpInst *>(exit->operand(0));
+        if (!shape.cond)
+            return false;
+        for (unsigned i = 0; i < 2; ++i)
+        {
+            auto *phi = dynamic_cast<PhiInst *>(shape.cond->operand(i));
+            if (phi && dynamic_cast<ConstantInt *>(shape.cond->operand(1 - i)) &&
+                match_induction_variable(loop, preheader, phi, shape.iv))
+                return dynamic_cast<ConstantInt *>(shape.iv.init) != nullptr;
+        }
+        return false;
+    }
+
+    bool evaluate(ICmpInst::Predicate pred, uint64_t lhs, uint64_t rhs, uint8_t bits)
+    {
+        const uint64_t ul = truncate_value(lhs, bits, true);
+        const uint64_t ur = truncate_value(rhs, bits, true);
+        const auto sl = static_cast<int64_t>(truncate_value(lhs, bits, false));
+        const auto sr = static_cast<int64_t>(truncate_value(rhs, bits, false));
+        switch (pred)
+        {
+        case ICmpInst::EQ:
+            return ul == ur;
+        case ICmpInst::NE:
+            return ul != ur;
+        case ICmpInst::SLT:
+            return sl < sr;
+        case ICmpInst::SLE:
+            return sl <= sr;
+        case ICmpInst::SGT:
+            return sl > sr;
+        case ICmpInst::SGE:
+            return sl >= sr;
+        case ICmpInst::ULT:
+            return ul < ur;
+        case ICmpInst::ULE:
+            return ul <= ur;
+        case ICmpInst::UGT:
+            return ul > ur;
+        case ICmpInst::UGE:
+            return ul >= ur;
+        }
+        return false;
+    }
+
+    uint64_t trip_count(const LoopShape &shape)
+    {
+        const ICmpInst &cond = *shape.cond;
+        const bool iv_on_left = cond.operand(0) == shape.iv.phi;
+        const uint64_t bound = static_cast<ConstantInt *>(cond.operand(iv_on_left ? 1 : 0))->value();
+        const uint8_t bits = shape.iv.phi->type()->bit_width();
+        const uint64_t step = shape.iv.step->value();
+
+        uint64_t value = static_cast<ConstantInt *>(shape.iv.init)->value();
+        for (uint64_t trips = 0; trips <= MAX_TRIP_COUNT; ++trips)
+        {
+            const bool taken = iv_on_left ? evaluate(cond.predicate(), value, bound, bits)
+                                          : evaluate(cond.predicate(), bound, value, bits);
+            if (taken != shape.stays_on_true)
+                return trips;
+            value = truncate_value(value + step, bits, true);
+        }
+        return 0;
+    }
+
+    // Instructions in `loop`, or 0 when it has an alloca, which a copy
+    // would give a slot of its own
+    unsigned loop_size(const Loop &loop)
+    {
+        unsigned size = 0;
+        for (BasicBlock *bb : loop.blocks())
+        {
+            for (const Instruction &inst : *bb)
+            {
+                if (inst.opcode() == Opcode::Alloca)
+                    return 0;
+                ++size;
+            }
+        }
+        return size;
+    }
+
+    // Each of `factor` copies of a loop block runs a factor-th of the times
+    // the original did; the exit edge of the header still runs as often
+    void divide_profile(BasicBlock *bb, unsigned factor, const LoopShape &shape)
+    {
+        if (bb->has_profile_count())
+            bb->set_profile_count(bb->profile_count() / factor);
+        auto *branch = dynamic_cast<BranchInst *>(bb->get_terminator());
+        if (!branch || !branch->has_branch_weights())
+            return;
+        const bool header = bb == shape.header;
+        const bool keep_true = header && !shape.stays_on_true;
+        const bool keep_false = header && shape.stays_on_true;
+        branch->set_branch_weights(keep_true ? branch->true_weight() : branch->true_weight() / factor,
+                                   keep_false ? branch->false_weight() : branch->false_weight() / factor);
+    }
+
+    unsigned latch_incoming(const PhiInst *phi, const BasicBlock *latch)
+    {
+        for (unsigned i = 0; i < phi->num_incoming(); ++i)
+        {
+            if (phi->get_incoming_block(i) == latch)
+                return i;
+        }
+        MO_UNREACHABLE();
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Loop Unroll Implementation
+//===----------------------------------------------------------------------===//
+
+uint64_t constant_trip_count(const Loop &loop)
+{
+    LoopShape shape;
+    return match_shape(loop, shape) ? trip_count(shape) : 0;
+}
+
+unsigned unroll_factor(const Loop &loop)
+{
+    const uint64_t trips = constant_trip_count(loop);
+    if (trips < 2)
+    {
+        return 1;
+    }
+    const unsigned size = loop_size(loop);
+    if (size == 0)
+    {
+        return 1;
+    }
+    const BasicBlock *preheader = loop_preheader(loop);
+    if (preheader->has_profile_count() && preheader->profile_count() == 0)
+    {
+        return 1;
+    }
+    const bool hot = loop.header()->has_profile_count() && loop.header()->profile_count() >= HOT_LOOP_COUNT;
+    const unsigned budget = hot ? MAX_HOT_UNROLLED_SIZE : MAX_UNROLLED_SIZE;
+    if (trips <= MAX_UNROLL_FACTOR && size * trips <= budget)
+    {
+        return static_cast<unsigned>(trips);
+    }
+    for (unsigned factor = MAX_UNROLL_FACTOR; factor > 1; --factor)
+    {
+        if (trips % factor == 0 && size * factor <= budget)
+            return factor;
+    }
+    return 1;
+}
+
+bool unroll_loop(Loop &loop)
+{
+    const unsigned factor = unroll_factor(loop);
+    LoopShape shape;
+    if (factor < 2 || !match_shape(loop, shape))
+    {
+        return false;
+    }
+    BasicBlock *header = shape.header;
+    Function &func = *header->parent_function();
+    const std::vector<BasicBlock *> body(loop.blocks().begin() + 1, loop.blocks().end());
+    std::vector<PhiInst *> phis;
+    for (Instruction *inst = header->first_instruction(); inst->opcode() == Opcode::Phi; inst = inst->next())
+    {
+        phis.push_back(static_cast<PhiInst *>(inst));
+    }
+
+    // Copy k starts from the values copy k - 1 sends back to the header;
+    // the header's own phis and condition aren't needed in between
+    ValueMap previous;
+    std::vector<BasicBlock *> latches{shape.latch};
+    std::vector<BasicBlock *> headers{header};
+    std::vector<BasicBlock *> copied; // the copies of `body`
+    for (unsigned k = 1; k < factor; ++k)
+    {
+        const std::string suffix = ".unroll" + std::to_string(k);
+        ValueMap map;
+        for (PhiInst *phi : phis)
+        {
+            map[phi] = remap_value(previous, phi->get_incoming_value(latch_incoming(phi, shape.latch)));
+        }
+
+        BasicBlock *copy_header = func.create_basic_block(header->name() + suffix);
+        if (header->has_profile_count())
+            copy_header->set_profile_count(header->profile_count());
+        for (Instruction *inst = header->first_non_phi(); inst != header->get_terminator(); inst = inst->next())
+        {
+            Instruction *copy = clone_instruction(*inst, copy_header, map);
+            if (!copy->name().empty())
+                copy->set_name(copy->name() + suffix);
+            copy_header->append(copy);
+            map[inst] = copy;
+        }
+        const std::vector<BasicBlock *> copies = clone_blocks(body, func, map, suffix);
+        copy_header->append(BranchInst::create(static_cast<BasicBlock *>(map.at(shape.body_entry)), copy_header));
+        copied.insert(copied.end(), copies.begin(), copies.end());
+
+        headers.push_back(copy_header);
+        latches.push_back(static_cast<BasicBlock *>(map.at(shape.latch)));
+        previous = std::move(map);
+    }
+
+    // Chained up only now, so every copy was made from a latch still
+    // branching to the header
+    for (unsigned k = 1; k < factor; ++k)
+    {
+        static_cast<BranchInst *>(latches[k - 1]->get_terminator())->replace_successor(header, headers[k]);
+    }
+
+    for (PhiInst *phi : phis)
+    {
+        const unsigned i = latch_incoming(phi, shape.latch);
+        phi->set_operand(2 * i, remap_value(previous, phi->get_incoming_value(i)));
+        phi->set_operand(2 * i + 1, latches.back());
+    }
+
+    for (BasicBlock *bb : headers)
+        divide_profile(bb, factor, shape);
+    for (BasicBlock *bb : body)
+        divide_profile(bb, factor, shape);
+    for (BasicBlock *bb : copied)
+        divide_profile(bb, factor, shape);
+    return true;
+}
+
+unsigned unroll_loops(Function &func, const LoopInfo &loops)
+{
+    unsigned unrolled = 0;
+    for (Loop *loop : loops_innermost_first(loops))
+    {
+        unrolled += unroll_loop(*loop);
+    }
+    MO_DEBUG("loop-unroll: unrolled %u loops in %s\n", unrolled, func.name().c_str());
+    return unrolled;
+}
+
+PreservedAnalyses LoopUnrollPass::run(Function &func, AnalysisManager &analyses)
+{
+    bool changed = false;
+    const LoopInfo &loops = simplified_loop_info(func, analyses, changed);
+    changed |= unroll_loops(func, loops) != 0;
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
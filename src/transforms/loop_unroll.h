@@ -0,0 +1,58 @@
+// loop_unroll.h - Partial unrolling of loops with constant trip counts
+#pragma once
+
+#include <cstdint>
+
+#include "../ir.h"
+#include "loop_info.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Loop Unroll
+//===----------------------------------------------------------------------===//
+//
+// A short loop spends much of each trip on the compare, the branch back and
+// the induction update. When the trip count of an innermost loop is a known
+// constant, its body is copied so each trip of the new loop does `factor`
+// trips of the old one, with the conditions between the copies dropped: the
+// factor divides the trip count, so they would all have been true. A loop
+// running no more than MAX_UNROLL_FACTOR times is copied out completely and
+// only checks its condition once more on the way out.
+//
+// The loop has to be in the shape IRGenerator gives `while` and `for`: one
+// latch branching back to a header that ends in the only exit, a compare of
+// a basic induction variable with a constant start and step against a
+// constant bound (see match_induction_variable). The body is copied only
+// while the unrolled loop stays within MAX_UNROLLED_SIZE instructions.
+//
+// With a profile, a loop that was never entered stays as it is, and one
+// whose header ran at least HOT_LOOP_COUNT times may grow to
+// MAX_HOT_UNROLLED_SIZE. The counts of the unrolled blocks are divided
+// among the copies.
+
+constexpr unsigned MAX_UNROLL_FACTOR = 8;
+constexpr unsigned MAX_UNROLLED_SIZE = 128;
+constexpr unsigned MAX_HOT_UNROLLED_SIZE = 256;
+constexpr uint64_t HOT_LOOP_COUNT = 1000;
+
+// Number of times the body of `loop` runs, or 0 when it isn't a known
+// constant of at most MAX_TRIP_COUNT
+constexpr uint64_t MAX_TRIP_COUNT = 1024;
+uint64_t constant_trip_count(const Loop &loop);
+
+// How many copies of the body unroll_loop would make for `loop`; 1 when it
+// leaves it alone
+unsigned unroll_factor(const Loop &loop);
+
+// Unrolls `loop` by unroll_factor(loop), and returns whether it did
+bool unroll_loop(Loop &loop);
+
+// Every innermost loop of `func`; returns how many were unrolled
+unsigned unroll_loops(Function &func, const LoopInfo &loops);
+
+class LoopUnrollPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "loop-unroll"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
@@ -0,0 +1,347 @@
+#include "mem2reg.h"
+#include <unordered_map>
+#include <vector>
+
+#include "../mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // Loads and stores of one promoted alloca, grouped by block
+    struct AllocaInfo
+    {
+        AllocaInst *alloca;
+        std::vector<BasicBlock *> def_blocks;
+        std::vector<BasicBlock *> use_blocks;
+    };
+
+    bool is_scalar_slot(const Type *type)
+    {
+        return type->is_integer() || type->is_float() || type->is_pointer();
+    }
+
+    // The alloca touched by `inst` if it is a load or store of a promoted slot
+    template <typename Map>
+    auto find_slot(const Map &slots, Instruction *inst) -> decltype(slots.end())
+    {
+        if (auto *load = dynamic_cast<LoadInst *>(inst))
+            return slots.find(load->pointer());
+        if (auto *store = dynamic_cast<StoreInst *>(inst))
+            return slots.find(store->pointer());
+        return slots.end();
+    }
+
+    // Blocks where the slot is live on entry: it is loaded there before any
+    // store, or flows through without a store to a block where it is
+    std::vector<bool> live_in_blocks(const AllocaInfo &info, const DominatorTree &dom_tree)
+    {
+        const size_t num_blocks = dom_tree.reverse_post_order().size();
+        std::vector<bool> defines(num_blocks, false), live(num_blocks, false);
+        for (BasicBlock *bb : info.def_blocks)
+        {
+            defines[dom_tree.rpo_index(bb)] = true;
+        }
+
+        std::vector<BasicBlock *> worklist;
+        for (BasicBlock *bb : info.use_blocks)
+        {
+            const unsigned index = dom_tree.rpo_index(bb);
+            if (live[index])
+            {
+                continue;
+            }
+            // A use block that also stores is live-in only if a load comes first
+            bool load_first = !defines[index];
+            for (Instruction *inst = bb->first_instruction(); !load_first && inst; inst = inst->next())
+            {
+                if (auto *store = dynamic_cast<StoreInst *>(inst); store && store->pointer() == info.alloca)
+                    break;
+                if (auto *load = dynamic_cast<LoadInst *>(inst); load && load->pointer() == info.alloca)
+                    load_first = true;
+            }
+            if (load_first)
+            {
+                live[index] = true;
+                worklist.push_back(bb);
+            }
+        }
+
+        while (!worklist.empty())
+        {
+            BasicBlock *bb = worklist.back();
+            worklist.pop_back();
+            for (BasicBlock *pred : bb->predecessors())
+            {
+                if (!dom_tree.is_reachable(pred))
+                {
+                    continue;
+                }
+                const unsigned index = dom_tree.rpo_index(pred);
+                if (!live[index] && !defines[index])
+                {
+                    live[index] = true;
+                    worklist.push_back(pred);
+                }
+            }
+        }
+        return live;
+    }
+
+    // Replaces phis whose incoming values are all one value (or the phi
+    // itself) by that value, until no such phi is left
+    void remove_trivial_phis(std::vector<PhiInst *> &phis)
+    {
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (PhiInst *&phi : phis)
+            {
+                if (!phi)
+                {
+                    continue;
+                }
+                Value *same = nullptr;
+                bool trivial = true;
+                for (unsigned i = 0; i < phi->num_incoming(); ++i)
+                {
+                    Value *incoming = phi->get_incoming_value(i);
+                    if (incoming == phi || incoming == same)
+                        continue;
+                    if (same)
+                    {
+                        trivial = false;
+                        break;
+                    }
+                    same = incoming;
+                }
+                if (!trivial || !same)
+                {
+                    continue;
+                }
+                phi->replace_all_uses_with(same);
+                phi->parent()->erase(phi);
+                phi = nullptr;
+                changed = true;
+            }
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Mem2Reg Implementation
+//===----------------------------------------------------------------------===//
+
+bool is_alloca_promotable(const AllocaInst *alloca)
+{
+    Type *slot_type = alloca->allocated_type();
+    if (!is_scalar_slot(slot_type))
+    {
+        return false;
+    }
+    for (Use *use : alloca->uses())
+    {
+        User *user = use->user();
+        if (auto *load = dynamic_cast<LoadInst *>(user))
+        {
+            if (load->type() != slot_type)
+                return false;
+            continue;
+        }
+        // Storing the address itself (or storing through a slot into another
+        // one) lets it escape
+        auto *store = dynamic_cast<StoreInst *>(user);
+        if (!store || store->pointer() != alloca || store->value() == alloca || store->value()->type() != slot_type)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned promote_allocas(Function &func, const DominatorTree &dom_tree, const DominanceFrontier &frontier)
+{
+    std::vector<AllocaInfo> infos;
+    std::unordered_map<const Value *, unsigned> slots;
+    for (BasicBlock *bb : func.basic_blocks())
+    {
+        for (Instruction &inst : *bb)
+        {
+            auto *alloca = dynamic_cast<AllocaInst *>(&inst);
+            if (alloca && is_alloca_promotable(alloca))
+            {
+                slots.emplace(alloca, infos.size());
+                infos.push_back({alloca, {}, {}});
+            }
+        }
+    }
+    if (infos.empty())
+    {
+        return 0;
+    }
+
+    // Loads and stores in unreachable blocks never run, so they need no
+    // reaching value; drop them before anything looks at the slot
+    for (BasicBlock *bb : func.basic_blocks())
+    {
+        if (dom_tree.is_reachable(bb))
+        {
+            continue;
+        }
+        for (Instruction *inst = bb->first_instruction(), *next; inst; inst = next)
+        {
+            next = inst->next();
+            auto it = find_slot(slots, inst);
+            if (it == slots.end())
+            {
+                continue;
+            }
+            if (dynamic_cast<LoadInst *>(inst))
+            {
+                Type *slot_type = infos[it->second].alloca->allocated_type();
+                inst->replace_all_uses_with(func.parent_module()->get_constant_zero(slot_type));
+            }
+            bb->erase(inst);
+        }
+    }
+
+    for (BasicBlock *bb : dom_tree.reverse_post_order())
+    {
+        for (Instruction &inst : *bb)
+        {
+            auto it = find_slot(slots, &inst);
+            if (it == slots.end())
+            {
+                continue;
+            }
+            auto &blocks = dynamic_cast<LoadInst *>(&inst) ? infos[it->second].use_blocks : infos[it->second].def_blocks;
+            if (blocks.empty() || blocks.back() != bb)
+            {
+                blocks.push_back(bb);
+            }
+        }
+    }
+
+    // Phi placement
+    std::vector<PhiInst *> phis;
+    std::unordered_map<const PhiInst *, unsigned> phi_slots;
+    for (unsigned slot = 0; slot < infos.size(); ++slot)
+    {
+        const AllocaInfo &info = infos[slot];
+        if (info.use_blocks.empty())
+        {
+            continue;
+        }
+        const std::vector<bool> live = live_in_blocks(info, dom_tree);
+        for (BasicBlock *join : frontier.iterated(info.def_blocks))
+        {
+            if (!live[dom_tree.rpo_index(join)])
+            {
+                continue;
+            }
+            auto *phi = PhiInst::create(info.alloca->allocated_type(), join);
+            phi->set_name(info.alloca->name());
+            join->insert_after(nullptr, std::unique_ptr<Instruction>(phi));
+            phis.push_back(phi);
+            phi_slots.emplace(phi, slot);
+        }
+    }
+
+    // Renaming: walk the dominator tree carrying the value each slot holds
+    Module *module = func.parent_module();
+    std::vector<Value *> entry_values(infos.size());
+    for (unsigned slot = 0; slot < infos.size(); ++slot)
+    {
+        entry_values[slot] = module->get_constant_zero(infos[slot].alloca->allocated_type());
+    }
+
+    std::vector<std::pair<BasicBlock *, std::vector<Value *>>> stack;
+    stack.emplace_back(dom_tree.root(), std::move(entry_values));
+    while (!stack.empty())
+    {
+        auto [bb, values] = std::move(stack.back());
+        stack.pop_back();
+
+        for (Instruction *inst = bb->first_instruction(), *next; inst; inst = next)
+        {
+            next = inst->next();
+            if (auto *phi = dynamic_cast<PhiInst *>(inst))
+            {
+                auto it = phi_slots.find(phi);
+                if (it != phi_slots.end())
+                    values[it->second] = phi;
+                continue;
+            }
+            auto it = find_slot(slots, inst);
+            if (it == slots.end())
+            {
+                continue;
+            }
+            if (auto *store = dynamic_cast<StoreInst *>(inst))
+            {
+                values[it->second] = store->value();
+            }
+            else
+            {
+                inst->replace_all_uses_with(values[it->second]);
+            }
+            bb->erase(inst);
+        }
+
+        for (BasicBlock *succ : bb->successors())
+        {
+            for (Instruction *inst = succ->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+            {
+                auto *phi = static_cast<PhiInst *>(inst);
+                auto it = phi_slots.find(phi);
+                if (it != phi_slots.end())
+                    phi->add_incoming(values[it->second], bb);
+            }
+        }
+
+        for (BasicBlock *child : dom_tree.children(bb))
+        {
+            stack.emplace_back(child, values);
+        }
+    }
+
+    remove_trivial_phis(phis);
+
+    for (const AllocaInfo &info : infos)
+    {
+        MO_ASSERT(!info.alloca->has_uses(), "Promoted alloca %s still has uses", info.alloca->name().c_str());
+        info.alloca->parent()->erase(info.alloca);
+    }
+    MO_DEBUG("mem2reg: promoted %zu allocas in %s, %zu phis\n", infos.size(), func.name().c_str(), phis.size());
+    return static_cast<unsigned>(infos.size());
+}
+
+unsigned promote_allocas(Function &func)
+{
+    if (func.basic_blocks().empty())
+    {
+        return 0;
+    }
+    DominatorTree dom_tree(func);
+    DominanceFrontier frontier(dom_tree);
+    return promote_allocas(func, dom_tree, frontier);
+}
+
+unsigned promote_allocas(Module &module)
+{
+    unsigned promoted = 0;
+    for (Function *func : module.functions())
+    {
+        promoted += promote_allocas(*func);
+    }
+    return promoted;
+}
+
+PreservedAnalyses Mem2RegPass::run(Function &func, AnalysisManager &analyses)
+{
+    const unsigned promoted = promote_allocas(func, analyses.dominator_tree(func), analyses.dominance_frontier(func));
+    return promoted ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
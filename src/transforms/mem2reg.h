@@ -0,0 +1,35 @@
+// mem2reg.h - Promotion of stack slots to SSA registers
+#pragma once
+
+#include "../ir.h"
+#include "dominators.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Mem2Reg
+//===----------------------------------------------------------------------===//
+//
+// IRGenerator gives every local an AllocaInst and reads and writes it with
+// loads and stores. This pass rewrites the slots whose address never escapes
+// into SSA values: phis go at the iterated dominance frontier of the blocks
+// storing to the slot (pruned to blocks where the slot is live), then a walk
+// over the dominator tree replaces each load with the value reaching it.
+// A load with no store on some path reads zero of the slot type.
+
+// Whether `alloca` holds a scalar (integer, float or pointer) that is only
+// ever loaded from and stored to, so no other instruction sees its address
+bool is_alloca_promotable(const AllocaInst *alloca);
+
+// Promotes the promotable allocas of `func` and returns how many it rewrote
+unsigned promote_allocas(Function &func, const DominatorTree &dom_tree, const DominanceFrontier &frontier);
+unsigned promote_allocas(Function &func);
+// Every function of `module` that has a body
+unsigned promote_allocas(Module &module);
+
+// Pipeline wrapper; keeps the CFG, so dominance and loops stay cached
+class Mem2RegPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "mem2reg"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
@@ -0,0 +1,148 @@
+#include "pass_manager.h"
+
+#include "../phase_stats.h"
+
+//===----------------------------------------------------------------------===//
+//                             AnalysisManager Implementation
+//===----------------------------------------------------------------------===//
+
+const DominatorTree &AnalysisManager::dominator_tree(const Function &func)
+{
+    auto &analyses = cache_[&func];
+    if (!analyses.dom_tree)
+    {
+        PhaseTimer timer("domtree");
+        analyses.dom_tree = std::make_unique<DominatorTree>(func);
+        computed_[static_cast<unsigned>(AnalysisKind::DominatorTree)]++;
+    }
+    return *analyses.dom_tree;
+}
+
+const DominanceFrontier &AnalysisManager::dominance_frontier(const Function &func)
+{
+    const DominatorTree &dom_tree = dominator_tree(func);
+    auto &analyses = cache_[&func];
+    if (!analyses.frontier)
+    {
+        PhaseTimer timer("domfrontier");
+        analyses.frontier = std::make_unique<DominanceFrontier>(dom_tree);
+        computed_[static_cast<unsigned>(AnalysisKind::DominanceFrontier)]++;
+    }
+    return *analyses.frontier;
+}
+
+const LoopInfo &AnalysisManager::loop_info(const Function &func)
+{
+    const DominatorTree &dom_tree = dominator_tree(func);
+    auto &analyses = cache_[&func];
+    if (!analyses.loops)
+    {
+        PhaseTimer timer("loops");
+        analyses.loops = std::make_unique<LoopInfo>(dom_tree);
+        computed_[static_cast<unsigned>(AnalysisKind::LoopInfo)]++;
+    }
+    return *analyses.loops;
+}
+
+const Liveness &AnalysisManager::liveness(const Function &func)
+{
+    const DominatorTree &dom_tree = dominator_tree(func);
+    auto &analyses = cache_[&func];
+    if (!analyses.liveness)
+    {
+        PhaseTimer timer("ir-liveness");
+        analyses.liveness = std::make_unique<Liveness>(func, dom_tree);
+        computed_[static_cast<unsigned>(AnalysisKind::Liveness)]++;
+    }
+    return *analyses.liveness;
+}
+
+void AnalysisManager::invalidate(FunctionAnalyses &analyses, const PreservedAnalyses &preserved)
+{
+    // Everything else refers to the dominator tree, so it goes first
+    if (!preserved.preserved(AnalysisKind::DominatorTree))
+    {
+        analyses = FunctionAnalyses{};
+        return;
+    }
+    if (!preserved.preserved(AnalysisKind::DominanceFrontier))
+        analyses.frontier.reset();
+    if (!preserved.preserved(AnalysisKind::LoopInfo))
+        analyses.loops.reset();
+    if (!preserved.preserved(AnalysisKind::Liveness))
+        analyses.liveness.reset();
+}
+
+void AnalysisManager::invalidate(const Function &func, const PreservedAnalyses &preserved)
+{
+    auto it = cache_.find(&func);
+    if (it != cache_.end())
+    {
+        invalidate(it->second, preserved);
+    }
+}
+
+void AnalysisManager::invalidate_all(const PreservedAnalyses &preserved)
+{
+    if (!preserved.preserved(AnalysisKind::DominatorTree))
+    {
+        // Module passes may have deleted functions; drop their keys as well
+        cache_.clear();
+        return;
+    }
+    for (auto &[func, analyses] : cache_)
+    {
+        invalidate(analyses, preserved);
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             PassManager Implementation
+//===----------------------------------------------------------------------===//
+
+void PassManager::add(std::unique_ptr<FunctionPass> pass)
+{
+    passes_.push_back({std::move(pass), nullptr});
+}
+
+void PassManager::add(std::unique_ptr<ModulePass> pass)
+{
+    passes_.push_back({nullptr, std::move(pass)});
+}
+
+bool PassManager::run(Module &module)
+{
+    bool changed = false;
+    for (auto &entry : passes_)
+    {
+        if (entry.module_pass)
+        {
+            PhaseTimer timer(entry.module_pass->name());
+            PreservedAnalyses preserved = entry.module_pass->run(module, analyses_);
+            analyses_.invalidate_all(preserved);
+            if (!preserved.all_preserved())
+            {
+                timer.count("changed", 1);
+                changed = true;
+            }
+            continue;
+        }
+
+        PhaseTimer timer(entry.function_pass->name());
+        for (Function *func : module.functions())
+        {
+            if (func->basic_blocks().empty())
+            {
+                continue;
+            }
+            PreservedAnalyses preserved = entry.function_pass->run(*func, analyses_);
+            analyses_.invalidate(*func, preserved);
+            if (!preserved.all_preserved())
+            {
+                timer.count("changed", 1);
+                changed = true;
+            }
+        }
+    }
+    return changed;
+}
@@ -0,0 +1,153 @@
+// pass_manager.h - IR pass pipeline with cached function analyses
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "../ir.h"
+#include "dominators.h"
+#include "liveness.h"
+#include "loop_info.h"
+
+//===----------------------------------------------------------------------===//
+//                             PreservedAnalyses
+//===----------------------------------------------------------------------===//
+
+enum class AnalysisKind : uint8_t
+{
+    DominatorTree,
+    DominanceFrontier,
+    LoopInfo,
+    Liveness,
+};
+
+// What a pass left intact, returned by every run. A pass that changed nothing
+// returns all(); one that only rewrote instructions without touching branches
+// returns cfg(). Use-def chains are not an analysis: the IR keeps its use
+// lists up to date on every operand change, so they are always valid.
+class PreservedAnalyses
+{
+public:
+    static PreservedAnalyses all() { return PreservedAnalyses(ALL); }
+    static PreservedAnalyses none() { return PreservedAnalyses(0); }
+    // Everything that only depends on the shape of the CFG
+    static PreservedAnalyses cfg()
+    {
+        return none().preserve(AnalysisKind::DominatorTree).preserve(AnalysisKind::DominanceFrontier).preserve(AnalysisKind::LoopInfo);
+    }
+
+    PreservedAnalyses &preserve(AnalysisKind kind)
+    {
+        bits_ |= bit(kind);
+        return *this;
+    }
+    PreservedAnalyses &intersect(const PreservedAnalyses &other)
+    {
+        bits_ &= other.bits_;
+        return *this;
+    }
+
+    bool preserved(AnalysisKind kind) const { return bits_ & bit(kind); }
+    bool all_preserved() const { return bits_ == ALL; }
+
+private:
+    static constexpr uint32_t ALL = (1u << 4) - 1;
+    static constexpr uint32_t bit(AnalysisKind kind) { return 1u << static_cast<unsigned>(kind); }
+
+    explicit PreservedAnalyses(uint32_t bits) : bits_(bits) {}
+
+    uint32_t bits_;
+};
+
+//===----------------------------------------------------------------------===//
+//                             AnalysisManager
+//===----------------------------------------------------------------------===//
+
+// Computes function analyses on first request and caches them per function
+// until a pass reports it did not preserve them. Analyses built on the
+// dominator tree are dropped with it. Each computation runs under a
+// PhaseTimer named after the analysis.
+class AnalysisManager
+{
+public:
+    const DominatorTree &dominator_tree(const Function &func);
+    const DominanceFrontier &dominance_frontier(const Function &func);
+    const LoopInfo &loop_info(const Function &func);
+    const Liveness &liveness(const Function &func);
+
+    void invalidate(const Function &func, const PreservedAnalyses &preserved);
+    void invalidate_all(const PreservedAnalyses &preserved);
+    // Forgets `func` entirely, e.g. before it is deleted
+    void forget(const Function &func) { cache_.erase(&func); }
+
+    // Number of times `kind` was computed, for tests and statistics
+    uint64_t num_computed(AnalysisKind kind) const { return computed_[static_cast<unsigned>(kind)]; }
+
+private:
+    struct FunctionAnalyses
+    {
+        std::unique_ptr<DominatorTree> dom_tree;
+        std::unique_ptr<DominanceFrontier> frontier;
+        std::unique_ptr<LoopInfo> loops;
+        std::unique_ptr<Liveness> liveness;
+    };
+
+    void invalidate(FunctionAnalyses &analyses, const PreservedAnalyses &preserved);
+
+    std::unordered_map<const Function *, FunctionAnalyses> cache_;
+    uint64_t computed_[4] = {};
+};
+
+//===----------------------------------------------------------------------===//
+//                             Passes
+//===----------------------------------------------------------------------===//
+
+class FunctionPass
+{
+public:
+    virtual ~FunctionPass() = default;
+    // Also the phase name the pass is timed under; must be a string literal
+    virtual const char *name() const = 0;
+    virtual PreservedAnalyses run(Function &func, AnalysisManager &analyses) = 0;
+};
+
+class ModulePass
+{
+public:
+    virtual ~ModulePass() = default;
+    virtual const char *name() const = 0;
+    // Preserved analyses apply to every function of the module
+    virtual PreservedAnalyses run(Module &module, AnalysisManager &analyses) = 0;
+};
+
+//===----------------------------------------------------------------------===//
+//                             PassManager
+//===----------------------------------------------------------------------===//
+
+// Runs passes in the order they were added. A function pass runs over every
+// function with a body before the next pass starts, and each pass is timed as
+// one phase across the module, with a "changed" counter of the functions it
+// rewrote. Analyses survive from one pass to the next unless invalidated.
+class PassManager
+{
+public:
+    void add(std::unique_ptr<FunctionPass> pass);
+    void add(std::unique_ptr<ModulePass> pass);
+
+    // Whether any pass changed the module
+    bool run(Module &module);
+
+    AnalysisManager &analyses() { return analyses_; }
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<FunctionPass> function_pass;
+        std::unique_ptr<ModulePass> module_pass;
+    };
+
+    std::vector<Entry> passes_;
+    AnalysisManager analyses_;
+};
@@ -0,0 +1,359 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "../mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    constexpr const char *PROFILE_HEADER = "# mo profile v1";
+    constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+    constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+    bool fail(std::string *err_msg, std::string message)
+    {
+        if (err_msg)
+            *err_msg = std::move(message);
+        return false;
+    }
+
+    void hash(uint64_t &h, uint64_t value)
+    {
+        for (unsigned i = 0; i < 8; ++i)
+        {
+            h ^= (value >> (8 * i)) & 0xff;
+            h *= FNV_PRIME;
+        }
+    }
+
+    // Conditional branches with two different successors, in block order
+    std::vector<BranchInst *> counted_branches(const Function &func)
+    {
+        std::vector<BranchInst *> branches;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            auto *branch = dynamic_cast<BranchInst *>(bb->get_terminator());
+            if (branch && branch->is_conditional() && branch->get_true_successor() != branch->get_false_successor())
+                branches.push_back(branch);
+        }
+        return branches;
+    }
+
+    // Adds one to counters[index] before `before`, or at the end of `bb`
+    void increment(GlobalVariable *counters, size_t index, BasicBlock *bb, Instruction *before)
+    {
+        Module &m = *bb->parent_function()->parent_module();
+        IntegerType *i32 = m.get_integer_type(32);
+        auto *slot = GetElementPtrInst::create(
+            counters, {m.get_constant_int(i32, 0), m.get_constant_int(i32, index)}, bb, "prof.slot");
+        auto *count = LoadInst::create(slot, bb, "prof.count");
+        auto *type = static_cast<IntegerType *>(count->type());
+        auto *bumped = BinaryInst::create(Opcode::Add, count, m.get_constant_int(type, 1), bb, "prof.next");
+        auto *store = StoreInst::create(bumped, slot, bb);
+        for (Instruction *inst : std::initializer_list<Instruction *>{slot, count, bumped, store})
+        {
+            if (before)
+                bb->insert_before(before, std::unique_ptr<Instruction>(inst));
+            else
+                bb->append(inst);
+        }
+    }
+
+    // First instruction past the phis and, in the entry block, the allocas
+    Instruction *counter_position(BasicBlock *bb, bool entry)
+    {
+        Instruction *inst = bb->first_non_phi();
+        while (entry && inst && inst->opcode() == Opcode::Alloca)
+            inst = inst->next();
+        return inst;
+    }
+
+    bool read_counts(std::istringstream &words, std::vector<uint64_t> &counts)
+    {
+        uint64_t count;
+        while (words >> count)
+            counts.push_back(count);
+        return words.eof();
+    }
+} // namespace
+
+//===----------------------------------------------------------------------===//
+//                             Profile Implementation
+//===----------------------------------------------------------------------===//
+
+void Profile::merge(const Profile &other)
+{
+    for (const auto &[name, theirs] : other.functions)
+    {
+        auto [it, inserted] = functions.emplace(name, theirs);
+        if (inserted)
+            continue;
+        FunctionProfile &ours = it->second;
+        if (ours.checksum != theirs.checksum || ours.block_counts.size() != theirs.block_counts.size() ||
+            ours.taken_counts.size() != theirs.taken_counts.size())
+        {
+            MO_DEBUG("profile: not merging `%s`, its CFG changed\n", name.c_str());
+            continue;
+        }
+        for (size_t i = 0; i < ours.block_counts.size(); ++i)
+            ours.block_counts[i] += theirs.block_counts[i];
+        for (size_t i = 0; i < ours.taken_counts.size(); ++i)
+            ours.taken_counts[i] += theirs.taken_counts[i];
+    }
+}
+
+void Profile::write(std::ostream &os) const
+{
+    os << PROFILE_HEADER << '\n';
+    for (const auto &[name, func] : functions)
+    {
+        os << "function " << name << ' ' << func.checksum << "\nblocks";
+        for (uint64_t count : func.block_counts)
+            os << ' ' << count;
+        os << "\ntaken";
+        for (uint64_t count : func.taken_counts)
+            os << ' ' << count;
+        os << '\n';
+    }
+}
+
+bool Profile::read(std::istream &is, Profile &profile, std::string *err_msg)
+{
+    std::string line;
+    if (!std::getline(is, line) || line != PROFILE_HEADER)
+        return fail(err_msg, "not a profile");
+
+    Profile result;
+    FunctionProfile *current = nullptr;
+    unsigned line_no = 1;
+    while (std::getline(is, line))
+    {
+        ++line_no;
+        std::istringstream words(line);
+        std::string key;
+        if (!(words >> key))
+            continue;
+        const std::string where = "line " + std::to_string(line_no) + ": ";
+        if (key == "function")
+        {
+            std::string name;
+            uint64_t checksum;
+            if (!(words >> name >> checksum))
+                return fail(err_msg, where + "expected a function name and checksum");
+            current = &result.functions[name];
+            current->checksum = checksum;
+        }
+        else if (key == "blocks" || key == "taken")
+        {
+            if (!current)
+                return fail(err_msg, where + "counts before any function");
+            if (!read_counts(words, key == "blocks" ? current->block_counts : current->taken_counts))
+                return fail(err_msg, where + "bad count");
+        }
+        else
+        {
+            return fail(err_msg, where + "unknown entry `" + key + "`");
+        }
+    }
+    profile = std::move(result);
+    return true;
+}
+
+bool Profile::write_file(const std::string &path, std::string *err_msg) const
+{
+    std::ofstream out(path, std::ios::trunc);
+    write(out);
+    if (!out.good())
+        return fail(err_msg, "cannot write `" + path + "`");
+    return true;
+}
+
+bool Profile::read_file(const std::string &path, Profile &profile, std::string *err_msg)
+{
+    std::ifstream in(path);
+    if (!in)
+        return fail(err_msg, "cannot open `" + path + "`");
+    return read(in, profile, err_msg);
+}
+
+uint64_t cfg_checksum(const Function &func)
+{
+    std::unordered_map<const BasicBlock *, uint64_t> index;
+    for (BasicBlock *bb : func.basic_blocks())
+        index.emplace(bb, index.size());
+
+    uint64_t h = FNV_OFFSET;
+    hash(h, index.size());
+    for (BasicBlock *bb : func.basic_blocks())
+    {
+        auto *branch = dynamic_cast<BranchInst *>(bb->get_terminator());
+        if (!branch)
+        {
+            hash(h, 0);
+            continue;
+        }
+        hash(h, branch->is_conditional() ? 2 : 1);
+        hash(h, index.at(branch->get_true_successor()));
+        if (branch->is_conditional())
+            hash(h, index.at(branch->get_false_successor()));
+    }
+    return h;
+}
+
+//===----------------------------------------------------------------------===//
+//                             Instrumentation Implementation
+//===----------------------------------------------------------------------===//
+
+CounterLayout counter_layout(const Module &module)
+{
+    CounterLayout layout;
+    for (Function *func : module.functions())
+    {
+        if (func->basic_blocks().empty())
+            continue;
+        FunctionCounters counters;
+        counters.name = func->name();
+        counters.checksum = cfg_checksum(*func);
+        counters.first = layout.size;
+        counters.blocks = func->basic_blocks().size();
+        counters.branches = counted_branches(*func).size();
+        layout.size += counters.blocks + counters.branches;
+        layout.functions.push_back(std::move(counters));
+    }
+    return layout;
+}
+
+CounterLayout instrument_module(Module &module, unsigned counter_bits)
+{
+    MO_ASSERT(counter_bits == 32 || counter_bits == 64, "Profile counters are 32 or 64 bits");
+    CounterLayout layout = counter_layout(module);
+    if (layout.size == 0)
+        return layout;
+
+    ArrayType *array = module.get_array_type(module.get_integer_type(counter_bits), layout.size);
+    GlobalVariable *counters = module.create_global_variable(
+        module.get_pointer_type(array), false, module.get_constant_aggregate_zero(array), PROFILE_COUNTERS);
+
+    size_t next = 0;
+    for (Function *func : module.functions())
+    {
+        if (func->basic_blocks().empty())
+            continue;
+        const FunctionCounters &layout_of = layout.functions[next++];
+        const std::vector<BasicBlock *> blocks = func->basic_blocks();
+        const std::vector<BranchInst *> branches = counted_branches(*func);
+
+        for (size_t i = 0; i < blocks.size(); ++i)
+        {
+            BasicBlock *bb = blocks[i];
+            increment(counters, layout_of.first + i, bb, counter_position(bb, i == 0));
+        }
+        for (size_t i = 0; i < branches.size(); ++i)
+        {
+            BranchInst *branch = branches[i];
+            BasicBlock *from = branch->parent();
+            BasicBlock *to = branch->get_true_successor();
+            BasicBlock *taken = func->create_basic_block(from->name() + ".taken");
+            for (Instruction *inst = to->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+                static_cast<PhiInst *>(inst)->replace_incoming_block(from, taken);
+            branch->replace_successor(to, taken);
+            increment(counters, layout_of.first + layout_of.blocks + i, taken, nullptr);
+            taken->append(BranchInst::create(to, taken));
+        }
+    }
+    return layout;
+}
+
+Profile profile_from_counters(const CounterLayout &layout, const std::vector<uint64_t> &counters)
+{
+    Profile profile;
+    for (const FunctionCounters &func : layout.functions)
+    {
+        const size_t end = func.first + func.blocks + func.branches;
+        if (end > counters.size())
+            continue;
+        FunctionProfile &entry = profile.functions[func.name];
+        entry.checksum = func.checksum;
+        auto first = counters.begin() + static_cast<std::ptrdiff_t>(func.first);
+        auto branches = first + static_cast<std::ptrdiff_t>(func.blocks);
+        entry.block_counts.assign(first, branches);
+        entry.taken_counts.assign(branches, counters.begin() + static_cast<std::ptrdiff_t>(end));
+    }
+    return profile;
+}
+
+bool counters_from_bytes(std::span<const uint8_t> bytes, unsigned counter_bits, std::vector<uint64_t> &counters)
+{
+    const size_t width = counter_bits / 8;
+    if ((counter_bits != 32 && counter_bits != 64) || bytes.size() % width != 0)
+        return false;
+    counters.assign(bytes.size() / width, 0);
+    for (size_t i = 0; i < counters.size(); ++i)
+    {
+        for (size_t b = 0; b < width; ++b)
+            counters[i] |= uint64_t(bytes[i * width + b]) << (8 * b);
+    }
+    return true;
+}
+
+//===----------------------------------------------------------------------===//
+//                             Applying Implementation
+//===----------------------------------------------------------------------===//
+
+ProfileStats apply_profile(Module &module, const Profile &profile)
+{
+    ProfileStats stats;
+    for (Function *func : module.functions())
+    {
+        if (func->basic_blocks().empty())
+            continue;
+        auto it = profile.functions.find(func->name());
+        if (it == profile.functions.end())
+        {
+            ++stats.missing;
+            continue;
+        }
+        const FunctionProfile &counts = it->second;
+        const std::vector<BasicBlock *> &blocks = func->basic_blocks();
+        const std::vector<BranchInst *> branches = counted_branches(*func);
+        if (counts.checksum != cfg_checksum(*func) || counts.block_counts.size() != blocks.size() ||
+            counts.taken_counts.size() != branches.size())
+        {
+            MO_DEBUG("profile: `%s` changed since it was profiled\n", func->name().c_str());
+            ++stats.stale;
+            continue;
+        }
+
+        for (size_t i = 0; i < blocks.size(); ++i)
+            blocks[i]->set_profile_count(counts.block_counts[i]);
+        for (size_t i = 0; i < branches.size(); ++i)
+        {
+            const uint64_t total = branches[i]->parent()->profile_count();
+            const uint64_t taken = std::min(counts.taken_counts[i], total);
+            branches[i]->set_branch_weights(taken, total - taken);
+        }
+        ++stats.applied;
+    }
+    return stats;
+}
+
+PreservedAnalyses InstrumentProfilePass::run(Module &module, AnalysisManager &)
+{
+    layout_ = instrument_module(module, counter_bits_);
+    return layout_.size == 0 ? PreservedAnalyses::all() : PreservedAnalyses::none();
+}
+
+PreservedAnalyses ApplyProfilePass::run(Module &module, AnalysisManager &)
+{
+    stats_ = apply_profile(module, profile_);
+    return PreservedAnalyses::all();
+}
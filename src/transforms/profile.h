@@ -0,0 +1,154 @@
+// profile.h - Block and edge counters for profile-guided optimization
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../ir.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Profiles
+//===----------------------------------------------------------------------===//
+//
+// A profile is how often each block of each function ran, and how often
+// each conditional branch went to its true successor, counted by a build
+// instrumented for it. Branches count in block order and skip the ones
+// whose successors are the same block. Each function carries a checksum of
+// its CFG, so a profile taken from different code is noticed and dropped
+// instead of being attached to the wrong blocks.
+//
+// Profiles are written as text:
+//
+//   # mo profile v1
+//   function <name> <checksum>
+//   blocks <count>...
+//   taken <count>...
+//
+// and runs of the same code merge by adding their counts.
+
+struct FunctionProfile
+{
+    uint64_t checksum = 0;
+    std::vector<uint64_t> block_counts;
+    std::vector<uint64_t> taken_counts; // one per counted branch
+};
+
+struct Profile
+{
+    std::map<std::string, FunctionProfile> functions;
+
+    // Adds the counts of `other`; functions whose checksums differ keep
+    // the counts they had
+    void merge(const Profile &other);
+
+    void write(std::ostream &os) const;
+    static bool read(std::istream &is, Profile &profile, std::string *err_msg = nullptr);
+    bool write_file(const std::string &path, std::string *err_msg = nullptr) const;
+    static bool read_file(const std::string &path, Profile &profile, std::string *err_msg = nullptr);
+};
+
+// Hash of the block count and the successors of every block of `func`
+uint64_t cfg_checksum(const Function &func);
+
+//===----------------------------------------------------------------------===//
+//                             Instrumentation
+//===----------------------------------------------------------------------===//
+//
+// Instrumentation gives the module one global array of counters, zeroed at
+// load, and has every block of every function add one to its own counter
+// first thing, after its phis and, in the entry block, its allocas. The
+// true edge of each counted branch goes through a block of its own that
+// adds to the branch's counter; the false edge is what is left of the
+// block's count. The functions' counters follow each other in module
+// order, blocks first.
+//
+// Nothing in the module reads the counters back. A test or a VM reads the
+// array through its symbol once the program ran (counters_from_bytes for a
+// raw memory dump) and profile_from_counters turns it into a Profile.
+// Instrumenting has to happen at the same point of the pipeline as
+// applying the profile later, or the checksums won't match.
+
+constexpr const char *PROFILE_COUNTERS = "__mo_profile_counters";
+
+struct FunctionCounters
+{
+    std::string name;
+    uint64_t checksum = 0;
+    size_t first = 0; // index of the first block counter
+    size_t blocks = 0;
+    size_t branches = 0;
+};
+
+struct CounterLayout
+{
+    std::vector<FunctionCounters> functions;
+    size_t size = 0;
+};
+
+// Where instrument_module puts the counters of each function of `module`,
+// which isn't instrumented yet
+CounterLayout counter_layout(const Module &module);
+
+// Adds counters of `counter_bits` (32 or 64) bits and returns their layout.
+// 32 bits suit targets whose loads and stores are word-sized
+CounterLayout instrument_module(Module &module, unsigned counter_bits = 64);
+
+Profile profile_from_counters(const CounterLayout &layout, const std::vector<uint64_t> &counters);
+
+// Little-endian counters of `counter_bits` bits; false if `bytes` isn't a
+// whole number of them
+bool counters_from_bytes(std::span<const uint8_t> bytes, unsigned counter_bits, std::vector<uint64_t> &counters);
+
+//===----------------------------------------------------------------------===//
+//                             Applying a Profile
+//===----------------------------------------------------------------------===//
+//
+// Applying sets the profile count of every block and the branch weights of
+// every counted branch, which the inliner, the unroller, block placement
+// and the register allocator's spill costs go by. Functions missing from
+// the profile or with a different checksum are left without counts, and
+// those passes fall back to their static estimates for them.
+
+struct ProfileStats
+{
+    unsigned applied = 0;
+    unsigned stale = 0;   // checksum or counter count didn't match
+    unsigned missing = 0; // not in the profile
+};
+
+ProfileStats apply_profile(Module &module, const Profile &profile);
+
+class InstrumentProfilePass : public ModulePass
+{
+public:
+    explicit InstrumentProfilePass(unsigned counter_bits = 64) : counter_bits_(counter_bits) {}
+
+    const char *name() const override { return "instrument-profile"; }
+    PreservedAnalyses run(Module &module, AnalysisManager &analyses) override;
+
+    const CounterLayout &layout() const { return layout_; }
+
+private:
+    unsigned counter_bits_;
+    CounterLayout layout_;
+};
+
+class ApplyProfilePass : public ModulePass
+{
+public:
+    explicit ApplyProfilePass(Profile profile) : profile_(std::move(profile)) {}
+
+    const char *name() const override { return "apply-profile"; }
+    PreservedAnalyses run(Module &module, AnalysisManager &analyses) override;
+
+    const ProfileStats &stats() const { return stats_; }
+
+private:
+    Profile profile_;
+    ProfileStats stats_;
+};
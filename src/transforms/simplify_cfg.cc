@@ -0,0 +1,240 @@
+#include "simplify_cfg.h"
+#include <unordered_set>
+#include <vector>
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    bool has_phis(const BasicBlock *bb)
+    {
+        return bb->first_instruction() && bb->first_instruction()->opcode() == Opcode::Phi;
+    }
+
+    BranchInst *branch_of(const BasicBlock *bb)
+    {
+        return dynamic_cast<BranchInst *>(bb->get_terminator());
+    }
+
+    // Swaps the terminator of `bb` for `br target`; the other edges of the
+    // old branch must already be gone
+    void replace_with_branch(BasicBlock *bb, BranchInst *old_branch, BasicBlock *target)
+    {
+        bb->erase(old_branch);
+        bb->append(BranchInst::create(target, bb));
+    }
+
+    bool fold_branches(Function &func)
+    {
+        bool changed = false;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            BranchInst *branch = branch_of(bb);
+            if (!branch || !branch->is_conditional())
+            {
+                continue;
+            }
+            BasicBlock *true_bb = branch->get_true_successor();
+            BasicBlock *false_bb = branch->get_false_successor();
+            BasicBlock *taken;
+            if (true_bb == false_bb)
+            {
+                taken = true_bb;
+            }
+            else if (auto *cond = dynamic_cast<ConstantInt *>(branch->operand(0)))
+            {
+                taken = cond->value() & 1 ? true_bb : false_bb;
+                BasicBlock *not_taken = taken == true_bb ? false_bb : true_bb;
+                for (Instruction *inst = not_taken->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+                {
+                    static_cast<PhiInst *>(inst)->remove_incoming(bb);
+                }
+                bb->remove_successor(not_taken);
+            }
+            else
+            {
+                continue;
+            }
+            replace_with_branch(bb, branch, taken);
+            changed = true;
+        }
+        return changed;
+    }
+
+    bool remove_unreachable_blocks(Function &func)
+    {
+        std::unordered_set<BasicBlock *> reachable;
+        std::vector<BasicBlock *> worklist{func.basic_blocks().front()};
+        reachable.insert(worklist.back());
+        while (!worklist.empty())
+        {
+            BasicBlock *bb = worklist.back();
+            worklist.pop_back();
+            for (BasicBlock *succ : bb->successors())
+            {
+                if (reachable.insert(succ).second)
+                    worklist.push_back(succ);
+            }
+        }
+
+        std::vector<BasicBlock *> dead;
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            if (!reachable.count(bb))
+                dead.push_back(bb);
+        }
+        if (dead.empty())
+        {
+            return false;
+        }
+
+        // Cut every edge and operand out of the dead region before deleting
+        // anything, since dead blocks may refer to each other
+        for (BasicBlock *bb : dead)
+        {
+            while (!bb->successors().empty())
+            {
+                BasicBlock *succ = bb->successors().back();
+                for (Instruction *inst = succ->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+                {
+                    static_cast<PhiInst *>(inst)->remove_incoming(bb);
+                }
+                bb->remove_successor(succ);
+            }
+            for (Instruction &inst : *bb)
+            {
+                inst.drop_all_references();
+            }
+        }
+        for (BasicBlock *bb : dead)
+        {
+            func.erase_basic_block(bb);
+        }
+        return true;
+    }
+
+    bool bypass_forwarding_blocks(Function &func)
+    {
+        bool changed = false;
+        const std::vector<BasicBlock *> blocks = func.basic_blocks();
+        for (BasicBlock *bb : blocks)
+        {
+            BranchInst *branch = dynamic_cast<BranchInst *>(bb->first_instruction());
+            if (bb == blocks.front() || !branch || branch != bb->last_instruction() || branch->is_conditional())
+            {
+                continue;
+            }
+            BasicBlock *target = branch->get_true_successor();
+            // Predecessors arriving straight at a phi would need their own
+            // incoming values, which this block cannot tell apart
+            if (target == bb || has_phis(target) || bb->predecessors().empty())
+            {
+                continue;
+            }
+            const std::vector<BasicBlock *> preds = bb->predecessors();
+            bool all_redirected = true;
+            for (BasicBlock *pred : preds)
+            {
+                if (BranchInst *pred_branch = branch_of(pred))
+                    pred_branch->replace_successor(bb, target);
+                else
+                    all_redirected = false;
+            }
+            changed |= all_redirected || preds.size() != bb->predecessors().size();
+            if (all_redirected)
+            {
+                func.erase_basic_block(bb);
+            }
+        }
+        return changed;
+    }
+
+    bool merge_straight_line_blocks(Function &func)
+    {
+        bool changed = false;
+        std::unordered_set<BasicBlock *> erased;
+        const std::vector<BasicBlock *> blocks = func.basic_blocks();
+        for (BasicBlock *bb : blocks)
+        {
+            if (erased.count(bb))
+            {
+                continue;
+            }
+            // Keep absorbing the successor while the chain goes on
+            while (true)
+            {
+                BranchInst *branch = branch_of(bb);
+                if (!branch || branch->is_conditional())
+                {
+                    break;
+                }
+                BasicBlock *succ = branch->get_true_successor();
+                if (succ == bb || succ == blocks.front() || succ->predecessors().size() != 1)
+                {
+                    break;
+                }
+
+                // With a single predecessor every phi has a single input
+                while (has_phis(succ))
+                {
+                    auto *phi = static_cast<PhiInst *>(succ->first_instruction());
+                    phi->replace_all_uses_with(phi->get_incoming_value(0));
+                    succ->erase(phi);
+                }
+                bb->erase(branch);
+                bb->remove_successor(succ);
+                while (Instruction *inst = succ->first_instruction())
+                {
+                    bb->append(succ->remove(inst).release());
+                }
+                while (!succ->successors().empty())
+                {
+                    BasicBlock *next = succ->successors().front();
+                    for (Instruction *inst = next->first_instruction(); inst && inst->opcode() == Opcode::Phi; inst = inst->next())
+                    {
+                        static_cast<PhiInst *>(inst)->replace_incoming_block(succ, bb);
+                    }
+                    succ->remove_successor(next);
+                    bb->add_successor(next);
+                }
+                erased.insert(succ);
+                func.erase_basic_block(succ);
+                changed = true;
+            }
+        }
+        return changed;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             SimplifyCFG Implementation
+//===----------------------------------------------------------------------===//
+
+bool simplify_cfg(Function &func)
+{
+    if (func.basic_blocks().empty())
+    {
+        return false;
+    }
+    bool changed = false;
+    while (true)
+    {
+        bool round = fold_branches(func);
+        round |= remove_unreachable_blocks(func);
+        round |= bypass_forwarding_blocks(func);
+        round |= merge_straight_line_blocks(func);
+        if (!round)
+        {
+            break;
+        }
+        changed = true;
+    }
+    return changed;
+}
+
+PreservedAnalyses SimplifyCFGPass::run(Function &func, AnalysisManager &)
+{
+    return simplify_cfg(func) ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
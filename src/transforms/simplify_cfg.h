@@ -0,0 +1,29 @@
+// simplify_cfg.h - Control flow graph cleanup
+#pragma once
+
+#include "../ir.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             SimplifyCFG
+//===----------------------------------------------------------------------===//
+//
+// Repeats until nothing changes:
+//  - a conditional branch on a constant, or with both arms on one block,
+//    becomes an unconditional branch;
+//  - blocks the entry cannot reach are deleted, including the `unreachable`
+//    placeholders IRGenerator leaves behind;
+//  - a block holding nothing but a branch is bypassed when its target has
+//    no phis to keep apart;
+//  - a block with one predecessor that has it as its only successor is
+//    merged into that predecessor.
+
+// Returns whether the function changed
+bool simplify_cfg(Function &func);
+
+class SimplifyCFGPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "simplifycfg"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
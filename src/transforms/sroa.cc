@@ -0,0 +1,299 @@
+#include "sroa.h"
+#include <map>
+#include <vector>
+
+#include "../mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    bool is_zero_index(const Value *index)
+    {
+        auto *constant = dynamic_cast<const ConstantInt *>(index);
+        return constant && constant->value() == 0;
+    }
+
+    uint64_t num_fields(const Type *type)
+    {
+        if (auto *st = dynamic_cast<const StructType *>(type))
+            return st->is_opaque() ? 0 : st->members().size();
+        if (auto *array = dynamic_cast<const ArrayType *>(type))
+            return array->num_elements() <= MAX_SROA_ELEMENTS ? array->num_elements() : 0;
+        return 0;
+    }
+
+    Type *field_type(Type *type, uint64_t field)
+    {
+        if (auto *st = dynamic_cast<StructType *>(type))
+            return st->get_member_type(static_cast<unsigned>(field));
+        return static_cast<ArrayType *>(type)->element_type();
+    }
+
+    // Field of `aggregate` that `gep` off its alloca selects, or -1 when the
+    // indices aren't a constant zero then a constant field
+    int64_t selected_field(const GetElementPtrInst *gep, const Type *aggregate)
+    {
+        if (gep->num_operands() < 3 || !is_zero_index(gep->operand(1)))
+            return -1;
+        auto *field = dynamic_cast<const ConstantInt *>(gep->operand(2));
+        if (!field || field->value() >= num_fields(aggregate))
+            return -1;
+        return static_cast<int64_t>(field->value());
+    }
+
+    // Whether the address `ptr` of a field is only read, written or indexed
+    // from zero, so it can't be moved to a neighbouring field
+    bool stays_in_field(const Value *ptr)
+    {
+        for (Use *use : ptr->uses())
+        {
+            User *user = use->user();
+            if (dynamic_cast<LoadInst *>(user))
+                continue;
+            if (auto *store = dynamic_cast<StoreInst *>(user))
+            {
+                if (store->value() == ptr)
+                    return false;
+                continue;
+            }
+            auto *gep = dynamic_cast<GetElementPtrInst *>(user);
+            if (!gep || gep->base_pointer() != ptr || gep->num_operands() < 2 || !is_zero_index(gep->operand(1)))
+                return false;
+            for (unsigned i = 1; i < gep->num_operands(); ++i)
+            {
+                if (gep->operand(i) == ptr)
+                    return false;
+            }
+            if (!stays_in_field(gep))
+                return false;
+        }
+        return true;
+    }
+
+    // Replaces `alloca` by one alloca per field it uses and returns them
+    std::vector<AllocaInst *> split(AllocaInst *alloca)
+    {
+        Type *aggregate = alloca->allocated_type();
+        BasicBlock *bb = alloca->parent();
+        Module *module = bb->parent_function()->parent_module();
+
+        std::vector<GetElementPtrInst *> geps;
+        for (Use *use : alloca->uses())
+            geps.push_back(static_cast<GetElementPtrInst *>(use->user()));
+
+        std::map<uint64_t, AllocaInst *> fields;
+        for (GetElementPtrInst *gep : geps)
+        {
+            const uint64_t field = static_cast<uint64_t>(selected_field(gep, aggregate));
+            AllocaInst *&slot = fields[field];
+            if (!slot)
+            {
+                slot = AllocaInst::create(field_type(aggregate, field), bb, alloca->name() + "." + std::to_string(field));
+                bb->insert_before(alloca, std::unique_ptr<Instruction>(slot));
+            }
+
+            Value *replacement = slot;
+            if (gep->num_operands() > 3)
+            {
+                // The rest of the path now starts from the field's own slot
+                std::vector<Value *> indices{module->get_constant_int(32, 0)};
+                for (unsigned i = 3; i < gep->num_operands(); ++i)
+                    indices.push_back(gep->operand(i));
+                auto *rest = GetElementPtrInst::create(slot, indices, gep->parent(), gep->name());
+                gep->parent()->insert_before(gep, std::unique_ptr<Instruction>(rest));
+                replacement = rest;
+            }
+            gep->replace_all_uses_with(replacement);
+            gep->parent()->erase(gep);
+        }
+        bb->erase(alloca);
+
+        std::vector<AllocaInst *> result;
+        for (const auto &[field, slot] : fields)
+            result.push_back(slot);
+        return result;
+    }
+
+    // Fields a copy of `type` goes through one by one, 0 for a value that is
+    // loaded and stored whole
+    uint64_t copied_fields(const Type *type)
+    {
+        if (auto *st = dynamic_cast<const StructType *>(type))
+            return st->is_opaque() ? 0 : st->members().size();
+        if (auto *array = dynamic_cast<const ArrayType *>(type))
+            return array->num_elements();
+        return 0;
+    }
+
+    // Whether every user of `load` is a store of it into memory, all in its
+    // block before anything else writes memory, so the fields can be read
+    // at the stores instead
+    bool is_aggregate_copy(const LoadInst *load)
+    {
+        if (copied_fields(load->type()) == 0 || !load->has_uses())
+            return false;
+        size_t stores = 0;
+        for (Use *use : load->uses())
+        {
+            auto *store = dynamic_cast<StoreInst *>(use->user());
+            if (!store || store->value() != load || store->pointer() == load || store->parent() != load->parent())
+                return false;
+            ++stores;
+        }
+        for (Instruction *inst = load->next(); inst && stores > 0; inst = inst->next())
+        {
+            auto *store = dynamic_cast<StoreInst *>(inst);
+            if (store && store->value() == load)
+                --stores;
+            else if (inst->opcode() == Opcode::Store || inst->opcode() == Opcode::Call)
+                return false;
+        }
+        return stores == 0;
+    }
+
+    // Copies the scalar fields of the `type` at `src` to `dst` ahead of `pos`
+    void copy_fields(Type *type, Value *src, Value *dst, Instruction *pos)
+    {
+        BasicBlock *bb = pos->parent();
+        Module *module = bb->parent_function()->parent_module();
+        for (uint64_t i = 0; i < copied_fields(type); ++i)
+        {
+            const std::vector<Value *> indices{module->get_constant_int(32, 0), module->get_constant_int(32, i)};
+            const std::string suffix = "." + std::to_string(i);
+            auto *from = GetElementPtrInst::create(src, indices, bb, src->name() + suffix);
+            bb->insert_before(pos, std::unique_ptr<Instruction>(from));
+            auto *to = GetElementPtrInst::create(dst, indices, bb, dst->name() + suffix);
+            bb->insert_before(pos, std::unique_ptr<Instruction>(to));
+
+            Type *field = field_type(type, i);
+            if (copied_fields(field) > 0)
+            {
+                copy_fields(field, from, to, pos);
+                continue;
+            }
+            auto *value = LoadInst::create(from, bb, from->name() + ".val");
+            bb->insert_before(pos, std::unique_ptr<Instruction>(value));
+            bb->insert_before(pos, std::unique_ptr<Instruction>(StoreInst::create(value, to, bb)));
+        }
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             SROA Implementation
+//===----------------------------------------------------------------------===//
+
+bool is_alloca_splittable(const AllocaInst *alloca)
+{
+    const Type *aggregate = alloca->allocated_type();
+    if (num_fields(aggregate) == 0 || !alloca->has_uses())
+    {
+        return false;
+    }
+    for (Use *use : alloca->uses())
+    {
+        auto *gep = dynamic_cast<GetElementPtrInst *>(use->user());
+        if (!gep || gep->base_pointer() != alloca || selected_field(gep, aggregate) < 0)
+        {
+            return false;
+        }
+        for (unsigned i = 1; i < gep->num_operands(); ++i)
+        {
+            if (gep->operand(i) == alloca)
+                return false;
+        }
+        if (!stays_in_field(gep))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+unsigned split_aggregate_allocas(Function &func)
+{
+    std::vector<AllocaInst *> worklist;
+    for (BasicBlock *bb : func.basic_blocks())
+    {
+        for (Instruction &inst : *bb)
+        {
+            if (auto *alloca = dynamic_cast<AllocaInst *>(&inst))
+                worklist.push_back(alloca);
+        }
+    }
+
+    unsigned split_count = 0;
+    while (!worklist.empty())
+    {
+        AllocaInst *alloca = worklist.back();
+        worklist.pop_back();
+        if (!is_alloca_splittable(alloca))
+        {
+            continue;
+        }
+        for (AllocaInst *field : split(alloca))
+        {
+            worklist.push_back(field);
+        }
+        ++split_count;
+    }
+    MO_DEBUG("sroa: split %u allocas in %s\n", split_count, func.name().c_str());
+    return split_count;
+}
+
+unsigned split_aggregate_allocas(Module &module)
+{
+    unsigned split_count = 0;
+    for (Function *func : module.functions())
+    {
+        split_count += split_aggregate_allocas(*func);
+    }
+    return split_count;
+}
+
+unsigned lower_aggregate_copies(Function &func)
+{
+    std::vector<LoadInst *> copies;
+    for (BasicBlock *bb : func.basic_blocks())
+    {
+        for (Instruction &inst : *bb)
+        {
+            auto *load = dynamic_cast<LoadInst *>(&inst);
+            if (load && is_aggregate_copy(load))
+                copies.push_back(load);
+        }
+    }
+
+    for (LoadInst *load : copies)
+    {
+        std::vector<StoreInst *> stores;
+        for (Use *use : load->uses())
+            stores.push_back(static_cast<StoreInst *>(use->user()));
+        for (StoreInst *store : stores)
+        {
+            copy_fields(load->type(), load->pointer(), store->pointer(), store);
+            store->parent()->erase(store);
+        }
+        load->parent()->erase(load);
+    }
+    MO_DEBUG("sroa: lowered %zu aggregate copies in %s\n", copies.size(), func.name().c_str());
+    return static_cast<unsigned>(copies.size());
+}
+
+unsigned lower_aggregate_copies(Module &module)
+{
+    unsigned copy_count = 0;
+    for (Function *func : module.functions())
+    {
+        copy_count += lower_aggregate_copies(*func);
+    }
+    return copy_count;
+}
+
+PreservedAnalyses SROAPass::run(Function &func, AnalysisManager &analyses)
+{
+    (void)analyses;
+    return split_aggregate_allocas(func) ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
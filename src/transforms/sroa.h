@@ -0,0 +1,50 @@
+// sroa.h - Scalar replacement of aggregates
+#pragma once
+
+#include "../ir.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             SROA
+//===----------------------------------------------------------------------===//
+//
+// IRGenerator keeps structs and arrays in stack slots and copies them field
+// by field through GEPs, which Mem2Reg can't promote since it only takes
+// scalar slots. This pass splits an aggregate alloca into one alloca per
+// field when every use of it is a GEP selecting a field with constant
+// indices, and the field addresses are only loaded from, stored to or
+// indexed further from zero, so nothing can reach one field from another.
+// The new allocas are split again when they are aggregates themselves, and
+// fields nothing addresses are dropped. Run Mem2Reg afterwards to turn the
+// scalar fields into SSA values.
+//
+// Arrays are split only up to MAX_SROA_ELEMENTS elements, so a large buffer
+// indexed with constants doesn't turn into as many slots.
+
+constexpr uint64_t MAX_SROA_ELEMENTS = 32;
+
+// Whether `alloca` holds an aggregate whose uses all allow splitting it
+bool is_alloca_splittable(const AllocaInst *alloca);
+
+// Splits the splittable allocas of `func`, and returns how many it split
+unsigned split_aggregate_allocas(Function &func);
+// Every function of `module` that has a body
+unsigned split_aggregate_allocas(Module &module);
+
+// IRGenerator also copies whole structs and arrays, loading the aggregate
+// from one slot and storing it to another (`let w: S = S { ... }`), and no
+// target selects an aggregate load or store. This rewrites each such copy,
+// a load whose only users are stores of it before anything else writes
+// memory, into a load and a store per scalar field through GEPs, which also
+// leaves both slots splittable. Runs at every optimization level, ahead of
+// instruction selection; returns how many copies it rewrote.
+unsigned lower_aggregate_copies(Function &func);
+unsigned lower_aggregate_copies(Module &module);
+
+// Pipeline wrapper; only rewrites instructions, so the CFG is kept
+class SROAPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "sroa"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
@@ -0,0 +1,102 @@
+#include "tail_calls.h"
+
+#include "../mo_debug.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // Whether the address `ptr` into the frame is only loaded from, stored
+    // to or indexed, so it can't outlive the frame
+    bool stays_in_frame(const Value *ptr)
+    {
+        for (Use *use : ptr->uses())
+        {
+            User *user = use->user();
+            if (dynamic_cast<LoadInst *>(user))
+                continue;
+            if (auto *store = dynamic_cast<StoreInst *>(user))
+            {
+                if (store->value() == ptr)
+                    return false;
+                continue;
+            }
+            auto *gep = dynamic_cast<GetElementPtrInst *>(user);
+            if (!gep || gep->base_pointer() != ptr || !stays_in_frame(gep))
+                return false;
+        }
+        return true;
+    }
+
+    bool frame_escapes(const Function &func)
+    {
+        for (BasicBlock *bb : func.basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                if (dynamic_cast<AllocaInst *>(&inst) && !stays_in_frame(&inst))
+                    return true;
+            }
+        }
+        return false;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Tail Calls Implementation
+//===----------------------------------------------------------------------===//
+
+bool is_tail_call_candidate(const CallInst &call)
+{
+    Function *callee = call.called_function();
+    if (!callee || callee->has_hidden_retval())
+    {
+        return false;
+    }
+    auto *ret = dynamic_cast<const ReturnInst *>(call.next());
+    if (!ret || (ret->value() && ret->value() != &call))
+    {
+        return false;
+    }
+    const Function *caller = call.parent()->parent_function();
+    return !caller->has_hidden_retval() && !frame_escapes(*caller);
+}
+
+unsigned mark_tail_calls(Function &func)
+{
+    unsigned marked = 0;
+    for (BasicBlock *bb : func.basic_blocks())
+    {
+        // Only the instruction before the return can qualify
+        Instruction *last = bb->last_instruction();
+        auto *call = last ? dynamic_cast<CallInst *>(last->prev()) : nullptr;
+        if (!call)
+        {
+            continue;
+        }
+        const bool tail = is_tail_call_candidate(*call);
+        call->set_tail_call(tail);
+        marked += tail;
+    }
+    MO_DEBUG("tailcall: marked %u calls in %s\n", marked, func.name().c_str());
+    return marked;
+}
+
+unsigned mark_tail_calls(Module &module)
+{
+    unsigned marked = 0;
+    for (Function *func : module.functions())
+    {
+        marked += mark_tail_calls(*func);
+    }
+    return marked;
+}
+
+PreservedAnalyses TailCallPass::run(Function &func, AnalysisManager &analyses)
+{
+    (void)analyses;
+    mark_tail_calls(func);
+    return PreservedAnalyses::all();
+}
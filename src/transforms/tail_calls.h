@@ -0,0 +1,43 @@
+// tail_calls.h - Marks calls the backend can turn into jumps
+#pragma once
+
+#include "../ir.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Tail Calls
+//===----------------------------------------------------------------------===//
+//
+// A call whose result is returned right away, or that is followed by a
+// `ret void`, leaves nothing for the caller to do once it comes back. When
+// nothing in the caller's frame can be reached from the callee either, the
+// frame may be torn down before the call and the call replaced by a jump,
+// so the callee returns straight to our caller. This pass finds such calls
+// and sets CallInst::is_tail_call on them; instruction selection does the
+// lowering when the calling convention allows it
+// (CallingConventionRules::supports_tail_call).
+//
+// A call is marked when it is direct, it comes right before the ReturnInst
+// of its block, which returns either its value or nothing, neither side
+// returns through a hidden pointer, and no alloca of the caller has its
+// address used for anything but loads, stores and GEPs off it. That last
+// rule also keeps pointers into the frame away from the arguments.
+//
+// Run it last: anything placed between the call and the return afterwards
+// makes the mark wrong.
+
+// Whether `call` may reuse its caller's frame
+bool is_tail_call_candidate(const CallInst &call);
+
+// Marks the tail calls of `func`, and returns how many it marked
+unsigned mark_tail_calls(Function &func);
+// Every function of `module` that has a body
+unsigned mark_tail_calls(Module &module);
+
+// Pipeline wrapper; only sets flags, so every analysis is kept
+class TailCallPass : public FunctionPass
+{
+public:
+    const char *name() const override { return "tailcall"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+};
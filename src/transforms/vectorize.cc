@@ -0,0 +1,774 @@
+#include "vectorize.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../mo_debug.h"
+#include "loop_simplify.h"
+
+//===----------------------------------------------------------------------===//
+//                             Helpers
+//===----------------------------------------------------------------------===//
+
+namespace
+{
+    // The alloca, global or other value `ptr` is an address into
+    const Value *underlying_object(const Value *ptr)
+    {
+        while (true)
+        {
+            if (auto *gep = dynamic_cast<const GetElementPtrInst *>(ptr))
+                ptr = gep->base_pointer();
+            else if (auto *cast = dynamic_cast<const BitCastInst *>(ptr))
+                ptr = cast->operand(0);
+            else
+                return ptr;
+        }
+    }
+
+    bool is_identified_object(const Value *object)
+    {
+        return dynamic_cast<const AllocaInst *>(object) || dynamic_cast<const GlobalVariable *>(object);
+    }
+
+    // Whether `a` and `b` are addresses into different allocas or globals
+    bool distinct_objects(const Value *a, const Value *b)
+    {
+        const Value *oa = underlying_object(a);
+        const Value *ob = underlying_object(b);
+        return oa != ob && is_identified_object(oa) && is_identified_object(ob);
+    }
+
+    int64_t signed_value(const ConstantInt *c)
+    {
+        const unsigned bits = c->type()->bit_width();
+        const uint64_t value = c->value();
+        if (bits >= 64)
+            return static_cast<int64_t>(value);
+        const uint64_t sign = uint64_t(1) << (bits - 1);
+        return static_cast<int64_t>((value ^ sign) - sign);
+    }
+
+    // Integers of whole bytes and floats, the types a vector has lanes of
+    bool is_lane_type(const Type *type)
+    {
+        return (type->type_id() == Type::IntTy && type->bit_width() >= 8 && type->bit_width() % 8 == 0) ||
+               type->type_id() == Type::FpTy;
+    }
+
+    bool is_lanewise(const Instruction &inst)
+    {
+        if (!dynamic_cast<const BinaryInst *>(&inst) || !is_lane_type(inst.type()))
+            return false;
+        switch (inst.opcode())
+        {
+        case Opcode::Add:
+        case Opcode::Sub:
+        case Opcode::Mul:
+        case Opcode::SDiv:
+            return true;
+        case Opcode::UDiv:
+        case Opcode::SRem:
+        case Opcode::URem:
+        case Opcode::BitAnd:
+        case Opcode::BitOr:
+        case Opcode::BitXor:
+        case Opcode::Shl:
+        case Opcode::LShr:
+        case Opcode::AShr:
+            return !inst.type()->is_float();
+        default:
+            return false;
+        }
+    }
+
+    std::string suffixed(const Value *value, const char *suffix)
+    {
+        return value->name().empty() ? "" : value->name() + suffix;
+    }
+
+    void insert(Instruction *inst, Instruction *before)
+    {
+        before->parent()->insert_before(before, std::unique_ptr<Instruction>(inst));
+    }
+
+    // `value` in every lane of a `type`, through a stack slot written right
+    // before `at`
+    Value *broadcast(Value *value, VectorType *type, Instruction *at)
+    {
+        Function &func = *at->parent()->parent_function();
+        Module &m = *func.parent_module();
+        BasicBlock *entry = func.entry_block();
+        auto *slot = AllocaInst::create(type, entry, suffixed(value, ".splat.slot"));
+        entry->insert_before(entry->first_instruction(), std::unique_ptr<Instruction>(slot));
+
+        IntegerType *i32 = m.get_integer_type(32);
+        for (uint64_t lane = 0; lane < type->num_elements(); ++lane)
+        {
+            auto *element = GetElementPtrInst::create(slot, {m.get_constant_int(i32, 0), m.get_constant_int(i32, lane)},
+                                                      at->parent());
+            insert(element, at);
+            insert(StoreInst::create(value, element, at->parent()), at);
+        }
+        auto *splat = LoadInst::create(slot, at->parent(), suffixed(value, ".splat"));
+        insert(splat, at);
+        return splat;
+    }
+
+    BitCastInst *vector_pointer(Value *ptr, VectorType *type, Instruction *at)
+    {
+        Module &m = *at->parent()->parent_function()->parent_module();
+        auto *cast = BitCastInst::create(ptr, m.get_pointer_type(type), at->parent(), suffixed(ptr, ".vec.ptr"));
+        insert(cast, at);
+        return cast;
+    }
+
+    //===------------------------- Loops --------------------------===//
+
+    bool is_defined_outside(const Value *value, const Loop &loop)
+    {
+        auto *inst = dynamic_cast<const Instruction *>(value);
+        return !inst || !loop.contains(inst->parent());
+    }
+
+    // The loop in the shape vectorize_loop takes
+    struct LoopPlan
+    {
+        BasicBlock *preheader = nullptr;
+        BasicBlock *header = nullptr;
+        InductionVariable iv;
+        ICmpInst::Predicate predicate = ICmpInst::SLT;
+        Value *bound = nullptr;
+        // What the body computes, in order, minus the induction update
+        std::vector<Instruction *> insts;
+        // Address of every access, and whether it's stored to
+        std::vector<std::pair<GetElementPtrInst *, bool>> accesses;
+        unsigned factor = 1;
+    };
+
+    // `gep base, ..., iv` with everything but `iv` invariant in `loop`
+    bool is_consecutive(const Instruction &inst, const Loop &loop, const PhiInst *iv)
+    {
+        auto *gep = dynamic_cast<const GetElementPtrInst *>(&inst);
+        if (!gep || gep->num_operands() < 2)
+            return false;
+        const unsigned last = gep->num_operands() - 1;
+        if (gep->operand(last) != iv)
+            return false;
+        for (unsigned i = 0; i < last; ++i)
+        {
+            if (!is_defined_outside(gep->operand(i), loop))
+                return false;
+        }
+        return true;
+    }
+
+    bool plan_loop(const Loop &loop, unsigned vector_bytes, LoopPlan &plan)
+    {
+        plan.preheader = loop_preheader(loop);
+        plan.header = loop.header();
+        if (!plan.preheader || !loop.children().empty() || loop.latches().size() != 1)
+            return false;
+        BasicBlock *header = plan.header;
+        BasicBlock *latch = loop.latches().front();
+
+        auto *exit = dynamic_cast<BranchInst *>(header->get_terminator());
+        if (!exit || !exit->is_conditional() || !loop.contains(exit->get_true_successor()) ||
+            loop.contains(exit->get_false_successor()))
+            return false;
+        auto *cond = dynamic_cast<ICmpInst *>(exit->operand(0));
+        auto *phi = dynamic_cast<PhiInst *>(header->first_instruction());
+        if (!cond || !phi || cond->parent() != header || !match_induction_variable(loop, plan.preheader, phi, plan.iv) ||
+            plan.iv.step->value() != 1)
+            return false;
+        // Nothing else in the header: no other phi, nothing the exit sees
+        for (Instruction &inst : *header)
+        {
+            if (&inst != phi && &inst != cond && &inst != exit)
+                return false;
+        }
+        plan.predicate = cond->predicate();
+        plan.bound = cond->operand(1);
+        if (cond->operand(0) != phi || !is_defined_outside(plan.bound, loop) ||
+            (plan.predicate != ICmpInst::SLT && plan.predicate != ICmpInst::ULT && plan.predicate != ICmpInst::NE))
+            return false;
+
+        // The rest falls from block to block down to the latch
+        std::vector<BasicBlock *> body;
+        for (BasicBlock *bb = exit->get_true_successor(); bb != header;)
+        {
+            auto *br = dynamic_cast<BranchInst *>(bb->get_terminator());
+            if (!loop.contains(bb) || bb->predecessors().size() != 1 || !br || br->is_conditional())
+                return false;
+            body.push_back(bb);
+            if (br->get_true_successor() == header && bb != latch)
+                return false;
+            bb = br->get_true_successor();
+        }
+        if (body.size() + 1 != loop.blocks().size())
+            return false;
+
+        std::unordered_set<const Value *> widened;
+        size_t element_size = 0;
+        auto same_size = [&](const Type *type)
+        {
+            if (!element_size)
+                element_size = type->size();
+            return type->size() == element_size;
+        };
+        auto is_operand = [&](const Value *value)
+        { return widened.count(value) || (is_defined_outside(value, loop) && is_lane_type(value->type())); };
+
+        bool stores = false;
+        for (BasicBlock *bb : body)
+        {
+            for (Instruction &inst : *bb)
+            {
+                if (&inst == bb->get_terminator() || &inst == plan.iv.next)
+                    continue;
+                if (auto *gep = dynamic_cast<GetElementPtrInst *>(&inst))
+                {
+                    if (!is_consecutive(*gep, loop, phi))
+                        return false;
+                    for (User *user : gep->users())
+                    {
+                        auto *access = dynamic_cast<Instruction *>(user);
+                        const bool is_address = access && (access->opcode() == Opcode::Load ||
+                                                           (access->opcode() == Opcode::Store && access->operand(0) != gep));
+                        if (!is_address)
+                            return false;
+                        plan.accesses.emplace_back(gep, access->opcode() == Opcode::Store);
+                    }
+                }
+                else if (auto *load = dynamic_cast<LoadInst *>(&inst))
+                {
+                    if (!widened.count(load->operand(0)) || !is_lane_type(load->type()) || !same_size(load->type()))
+                        return false;
+                }
+                else if (auto *store = dynamic_cast<StoreInst *>(&inst))
+                {
+                    if (!widened.count(store->pointer()) || !is_operand(store->value()) ||
+                        !same_size(store->value()->type()))
+                        return false;
+                    stores = true;
+                }
+                else if (is_lanewise(inst))
+                {
+                    if (!is_operand(inst.operand(0)) || !is_operand(inst.operand(1)) || !same_size(inst.type()))
+                        return false;
+                }
+                else
+                {
+                    return false;
+                }
+                widened.insert(&inst);
+                plan.insts.push_back(&inst);
+            }
+        }
+
+        // The induction variable only counts and indexes
+        for (User *user : phi->users())
+        {
+            auto *inst = dynamic_cast<Instruction *>(user);
+            if (inst && loop.contains(inst->parent()) && inst != cond && inst != plan.iv.next &&
+                !widened.count(inst))
+                return false;
+        }
+        if (!stores || vector_bytes % element_size != 0 || vector_bytes / element_size < 2)
+            return false;
+        plan.factor = static_cast<unsigned>(vector_bytes / element_size);
+        return true;
+    }
+
+    // `gep base, ..., index` with the other operands of `like`
+    GetElementPtrInst *reindexed(GetElementPtrInst *like, Value *index, BasicBlock *bb, const char *suffix)
+    {
+        std::vector<Value *> indices(like->operands().begin() + 1, like->operands().end());
+        indices.back() = index;
+        auto *gep = GetElementPtrInst::create(like->base_pointer(), indices, bb, suffixed(like, suffix));
+        bb->append(gep);
+        return gep;
+    }
+
+    // The stored ranges, [start, end) over the scalar loop, overlap no other
+    // range the loop reads or writes, unless they are known apart
+    Value *ranges_apart(const LoopPlan &plan, BasicBlock *check)
+    {
+        std::map<std::vector<Value *>, std::pair<GetElementPtrInst *, bool>> ranges;
+        for (const auto &[gep, is_store] : plan.accesses)
+        {
+            std::vector<Value *> key(gep->operands().begin(), gep->operands().end() - 1);
+            auto [it, inserted] = ranges.emplace(key, std::make_pair(gep, is_store));
+            it->second.second |= is_store;
+        }
+
+        std::map<GetElementPtrInst *, std::pair<Value *, Value *>> bounds;
+        auto range = [&](GetElementPtrInst *gep)
+        {
+            auto it = bounds.find(gep);
+            if (it == bounds.end())
+            {
+                Value *start = reindexed(gep, plan.iv.init, check, ".start");
+                Value *end = reindexed(gep, plan.bound, check, ".end");
+                it = bounds.emplace(gep, std::make_pair(start, end)).first;
+            }
+            return it->second;
+        };
+        auto compare = [&](ICmpInst::Predicate pred, Value *lhs, Value *rhs)
+        {
+            ICmpInst *cmp = ICmpInst::create(pred, lhs, rhs, check);
+            check->append(cmp);
+            return cmp;
+        };
+
+        Value *apart = nullptr;
+        for (auto a = ranges.begin(); a != ranges.end(); ++a)
+        {
+            for (auto b = std::next(a); b != ranges.end(); ++b)
+            {
+                GetElementPtrInst *x = a->second.first;
+                GetElementPtrInst *y = b->second.first;
+                if ((!a->second.second && !b->second.second) || distinct_objects(x, y))
+                    continue;
+                const auto [x_start, x_end] = range(x);
+                const auto [y_start, y_end] = range(y);
+                Value *pair_apart = BinaryInst::create(Opcode::BitOr, compare(ICmpInst::ULE, x_end, y_start),
+                                                       compare(ICmpInst::ULE, y_end, x_start), check, "vec.apart");
+                check->append(static_cast<Instruction *>(pair_apart));
+                if (apart)
+                {
+                    pair_apart = BinaryInst::create(Opcode::BitAnd, apart, pair_apart, check, "vec.apart");
+                    check->append(static_cast<Instruction *>(pair_apart));
+                }
+                apart = pair_apart;
+            }
+        }
+        return apart;
+    }
+
+    //===-------------------------- SLP ---------------------------===//
+
+    // `gep base, ..., c`, an element at a constant last index
+    struct Element
+    {
+        std::vector<Value *> prefix;
+        int64_t index = 0;
+    };
+
+    bool element_of(Value *ptr, Element &element)
+    {
+        auto *gep = dynamic_cast<GetElementPtrInst *>(ptr);
+        if (!gep || gep->num_operands() < 2)
+            return false;
+        auto *c = dynamic_cast<ConstantInt *>(gep->operand(gep->num_operands() - 1));
+        if (!c)
+            return false;
+        element.prefix.assign(gep->operands().begin(), gep->operands().end() - 1);
+        element.index = signed_value(c);
+        return true;
+    }
+
+    // How the lanes of one vector value are built
+    struct Node
+    {
+        enum Kind : uint8_t
+        {
+            Splat,
+            Loads,
+            Lanewise
+        };
+        Kind kind;
+        std::vector<Value *> lanes;
+        std::unique_ptr<Node> lhs, rhs;
+        Value *vector = nullptr;
+    };
+
+    class GroupVectorizer
+    {
+    public:
+        GroupVectorizer(BasicBlock &bb, const std::vector<StoreInst *> &stores) : bb_(bb), stores_(stores)
+        {
+            size_t position = 0;
+            for (Instruction &inst : bb_)
+            {
+                positions_[&inst] = position++;
+            }
+        }
+
+        bool run()
+        {
+            std::vector<Value *> values;
+            for (StoreInst *store : stores_)
+            {
+                values.push_back(store->value());
+            }
+            std::unique_ptr<Node> root = build(values, 0);
+            if (!root || root->kind == Node::Splat || !memory_is_safe())
+                return false;
+
+            Instruction *last = stores_.front();
+            for (StoreInst *store : stores_)
+            {
+                if (positions_.at(store) > positions_.at(last))
+                    last = store;
+            }
+            VectorType *type = bb_.parent_function()->parent_module()->get_vector_type(values.front()->type(),
+                                                                                        values.size());
+            Value *value = emit(*root, type, last);
+            insert(StoreInst::create(value, vector_pointer(stores_.front()->pointer(), type, last), &bb_), last);
+            for (StoreInst *store : stores_)
+            {
+                bb_.erase(store);
+            }
+            return true;
+        }
+
+    private:
+        static constexpr unsigned MAX_DEPTH = 8;
+
+        BasicBlock &bb_;
+        const std::vector<StoreInst *> &stores_;
+        std::unordered_map<const Instruction *, size_t> positions_;
+        std::unordered_set<const Instruction *> tree_loads_;
+
+        bool in_block(const Value *value) const
+        {
+            auto *inst = dynamic_cast<const Instruction *>(value);
+            return inst && inst->parent() == &bb_;
+        }
+
+        std::unique_ptr<Node> build(const std::vector<Value *> &lanes, unsigned depth)
+        {
+            auto node = std::make_unique<Node>();
+            node->lanes = lanes;
+            if (std::all_of(lanes.begin(), lanes.end(), [&](Value *v) { return v == lanes.front(); }))
+            {
+                node->kind = Node::Splat;
+                return node;
+            }
+            if (depth == MAX_DEPTH || !std::all_of(lanes.begin(), lanes.end(), [&](Value *v) { return in_block(v); }))
+                return nullptr;
+
+            auto *front = static_cast<Instruction *>(lanes.front());
+            for (Value *lane : lanes)
+            {
+                auto *inst = static_cast<Instruction *>(lane);
+                if (inst->opcode() != front->opcode() || inst->type() != front->type())
+                    return nullptr;
+            }
+            if (front->opcode() == Opcode::Load)
+            {
+                Element first;
+                if (!element_of(front->operand(0), first))
+                    return nullptr;
+                for (size_t lane = 0; lane < lanes.size(); ++lane)
+                {
+                    Element element;
+                    if (!element_of(static_cast<Instruction *>(lanes[lane])->operand(0), element) ||
+                        element.prefix != first.prefix || element.index != first.index + static_cast<int64_t>(lane))
+                        return nullptr;
+                    tree_loads_.insert(static_cast<Instruction *>(lanes[lane]));
+                }
+                node->kind = Node::Loads;
+                return node;
+            }
+            if (!is_lanewise(*front))
+                return nullptr;
+            std::vector<Value *> lhs, rhs;
+            for (Value *lane : lanes)
+            {
+                lhs.push_back(static_cast<Instruction *>(lane)->operand(0));
+                rhs.push_back(static_cast<Instruction *>(lane)->operand(1));
+            }
+            node->kind = Node::Lanewise;
+            node->lhs = build(lhs, depth + 1);
+            node->rhs = node->lhs ? build(rhs, depth + 1) : nullptr;
+            return node->rhs ? std::move(node) : nullptr;
+        }
+
+        // The vector loads read what the scalar ones did, although they
+        // happen where the last store was: a load after the first of the
+        // stores must not see any of them
+        bool memory_is_safe() const
+        {
+            const Value *stored = stores_.front()->pointer();
+            size_t first_store = positions_.size(), end = 0;
+            for (StoreInst *store : stores_)
+            {
+                first_store = std::min(first_store, positions_.at(store));
+                end = std::max(end, positions_.at(store));
+            }
+            size_t begin = first_store;
+            for (const Instruction *load : tree_loads_)
+            {
+                begin = std::min(begin, positions_.at(load));
+            }
+
+            std::unordered_set<const Instruction *> group(stores_.begin(), stores_.end());
+            for (const Instruction &inst : bb_)
+            {
+                const size_t position = positions_.at(&inst);
+                if (position < begin || position > end || group.count(&inst))
+                    continue;
+                if (inst.opcode() == Opcode::Call || inst.opcode() == Opcode::Store)
+                    return false;
+                if (inst.opcode() == Opcode::Load && position > first_store &&
+                    !distinct_objects(inst.operand(0), stored))
+                    return false;
+            }
+            return true;
+        }
+
+        Value *emit(Node &node, VectorType *type, Instruction *at)
+        {
+            switch (node.kind)
+            {
+            case Node::Splat:
+                return broadcast(node.lanes.front(), type, at);
+            case Node::Loads:
+            {
+                Value *ptr = static_cast<Instruction *>(node.lanes.front())->operand(0);
+                auto *load = LoadInst::create(vector_pointer(ptr, type, at), &bb_, suffixed(node.lanes.front(), ".vec"));
+                insert(load, at);
+                return load;
+            }
+            case Node::Lanewise:
+            {
+                Value *lhs = emit(*node.lhs, type, at);
+                Value *rhs = emit(*node.rhs, type, at);
+                auto *front = static_cast<Instruction *>(node.lanes.front());
+                auto *op = BinaryInst::create(front->opcode(), lhs, rhs, &bb_, suffixed(front, ".vec"));
+                insert(op, at);
+                return op;
+            }
+            }
+            return nullptr;
+        }
+    };
+
+    bool vectorize_one_group(BasicBlock &bb, unsigned vector_bytes)
+    {
+        // Stores by the elements they write
+        std::map<std::pair<std::vector<Value *>, Type *>, std::map<int64_t, StoreInst *>> elements;
+        std::set<std::pair<std::vector<Value *>, Type *>> clobbered;
+        for (Instruction &inst : bb)
+        {
+            auto *store = dynamic_cast<StoreInst *>(&inst);
+            Element element;
+            if (!store || !is_lane_type(store->value()->type()) || !element_of(store->pointer(), element))
+                continue;
+            auto key = std::make_pair(element.prefix, store->value()->type());
+            if (!elements[key].emplace(element.index, store).second)
+                clobbered.insert(key);
+        }
+
+        for (const auto &[key, stores] : elements)
+        {
+            const size_t size = key.second->size();
+            if (clobbered.count(key) || vector_bytes % size != 0 || vector_bytes / size < 2)
+                continue;
+            const size_t factor = vector_bytes / size;
+            for (auto start = stores.begin(); start != stores.end(); ++start)
+            {
+                std::vector<StoreInst *> group;
+                for (auto it = start; it != stores.end() && group.size() < factor &&
+                                      it->first == start->first + static_cast<int64_t>(group.size());
+                     ++it)
+                {
+                    group.push_back(it->second);
+                }
+                if (group.size() != factor)
+                    continue;
+                if (GroupVectorizer(bb, group).run())
+                    return true;
+            }
+        }
+        return false;
+    }
+}
+
+//===----------------------------------------------------------------------===//
+//                             Loop Vectorize Implementation
+//===----------------------------------------------------------------------===//
+
+unsigned vectorization_factor(const Loop &loop, unsigned vector_bytes)
+{
+    LoopPlan plan;
+    return plan_loop(loop, vector_bytes, plan) ? plan.factor : 1;
+}
+
+bool vectorize_loop(Loop &loop, unsigned vector_bytes)
+{
+    LoopPlan plan;
+    if (!plan_loop(loop, vector_bytes, plan))
+    {
+        return false;
+    }
+    BasicBlock *header = plan.header;
+    Function &func = *header->parent_function();
+    Module &m = *func.parent_module();
+    auto *iv_type = static_cast<IntegerType *>(plan.iv.phi->type());
+    Value *init = plan.iv.init;
+    Value *bound = plan.bound;
+    const std::string name = header->name();
+
+    BasicBlock *check = func.create_basic_block(name + ".vec.check");
+    BasicBlock *vector_ph = func.create_basic_block(name + ".vec.ph");
+    BasicBlock *body = func.create_basic_block(name + ".vec.body");
+    BasicBlock *scalar_ph = func.create_basic_block(name + ".scalar.ph");
+
+    // At least `factor` iterations, counted the way the loop counts them.
+    // A bound the start is already past sends everything to the scalar loop
+    auto append = [](BasicBlock *bb, Instruction *inst, const std::string &inst_name)
+    {
+        inst->set_name(inst_name);
+        bb->append(inst);
+        return inst;
+    };
+    ConstantInt *factor = m.get_constant_int(iv_type, plan.factor);
+    Instruction *count = append(check, BinaryInst::create(Opcode::Sub, bound, init, check), "vec.count");
+    Instruction *entered = append(check,
+                                  ICmpInst::create(plan.predicate == ICmpInst::SLT ? ICmpInst::SLT : ICmpInst::ULT,
+                                                   init, bound, check),
+                                  "vec.entered");
+    Instruction *enough = append(check,
+                                 ICmpInst::create(plan.predicate == ICmpInst::SLT ? ICmpInst::SGE : ICmpInst::UGE,
+                                                  count, factor, check),
+                                 "vec.enough");
+    Value *ok = append(check, BinaryInst::create(Opcode::BitAnd, entered, enough, check), "vec.ok");
+    if (Value *apart = ranges_apart(plan, check))
+    {
+        ok = append(check, BinaryInst::create(Opcode::BitAnd, ok, apart, check), "vec.ok");
+    }
+    Instruction *rem = append(check,
+                              BinaryInst::create(Opcode::BitAnd, count, m.get_constant_int(iv_type, plan.factor - 1),
+                                                 check),
+                              "vec.rem");
+    Instruction *end = append(check, BinaryInst::create(Opcode::Sub, bound, rem, check), "vec.end");
+    check->append(BranchInst::create_cond(ok, vector_ph, scalar_ph, check));
+
+    vector_ph->append(BranchInst::create(body, vector_ph));
+
+    // One trip of the vector loop for every `factor` of the scalar one
+    PhiInst *index = PhiInst::create(iv_type, body);
+    index->set_name(suffixed(plan.iv.phi, ".vec"));
+    body->append(index);
+    std::unordered_map<const Value *, Value *> vectors;
+    std::unordered_map<const Value *, Value *> splats;
+    auto vector_of = [&](Value *value)
+    {
+        auto it = vectors.find(value);
+        if (it != vectors.end())
+            return it->second;
+        Value *&splat = splats[value];
+        if (!splat)
+            splat = broadcast(value, m.get_vector_type(value->type(), plan.factor), vector_ph->get_terminator());
+        return splat;
+    };
+    for (Instruction *inst : plan.insts)
+    {
+        Instruction *widened = nullptr;
+        if (auto *gep = dynamic_cast<GetElementPtrInst *>(inst))
+        {
+            auto *element = static_cast<PointerType *>(gep->type())->element_type();
+            GetElementPtrInst *lane0 = reindexed(gep, index, body, ".vec");
+            widened = BitCastInst::create(lane0, m.get_pointer_type(m.get_vector_type(element, plan.factor)), body,
+                                          suffixed(gep, ".vec.ptr"));
+        }
+        else if (auto *load = dynamic_cast<LoadInst *>(inst))
+            widened = LoadInst::create(vectors.at(load->operand(0)), body, suffixed(load, ".vec"));
+        else if (auto *store = dynamic_cast<StoreInst *>(inst))
+            widened = StoreInst::create(vector_of(store->value()), vectors.at(store->pointer()), body);
+        else
+            widened = BinaryInst::create(inst->opcode(), vector_of(inst->operand(0)), vector_of(inst->operand(1)), body,
+                                         suffixed(inst, ".vec"));
+        body->append(widened);
+        vectors[inst] = widened;
+    }
+    Instruction *next = append(body, BinaryInst::create(Opcode::Add, index, factor, body), suffixed(index, ".next"));
+    Instruction *more = append(body, ICmpInst::create(ICmpInst::NE, next, end, body), "vec.more");
+    body->append(BranchInst::create_cond(more, body, scalar_ph, body));
+    index->add_incoming(init, vector_ph);
+    index->add_incoming(next, body);
+
+    // The scalar loop picks up where the vector loop left off
+    PhiInst *resume = PhiInst::create(iv_type, scalar_ph);
+    resume->set_name(suffixed(plan.iv.phi, ".resume"));
+    scalar_ph->append(resume);
+    resume->add_incoming(init, check);
+    resume->add_incoming(end, body);
+    scalar_ph->append(BranchInst::create(header, scalar_ph));
+
+    static_cast<BranchInst *>(plan.preheader->get_terminator())->replace_successor(header, check);
+    PhiInst *phi = plan.iv.phi;
+    for (unsigned i = 0; i < phi->num_incoming(); ++i)
+    {
+        if (phi->get_incoming_block(i) == plan.preheader)
+        {
+            phi->set_operand(2 * i, resume);
+            phi->set_operand(2 * i + 1, scalar_ph);
+        }
+    }
+    return true;
+}
+
+unsigned vectorize_loops(Function &func, const LoopInfo &loops, unsigned vector_bytes)
+{
+    unsigned vectorized = 0;
+    for (Loop *loop : loops_innermost_first(loops))
+    {
+        vectorized += vectorize_loop(*loop, vector_bytes);
+    }
+    MO_DEBUG("loop-vectorize: vectorized %u loops in %s\n", vectorized, func.name().c_str());
+    return vectorized;
+}
+
+PreservedAnalyses LoopVectorizePass::run(Function &func, AnalysisManager &analyses)
+{
+    if (vector_bytes_ == 0)
+    {
+        return PreservedAnalyses::all();
+    }
+    bool changed = false;
+    const LoopInfo &loops = simplified_loop_info(func, analyses, changed);
+    changed |= vectorize_loops(func, loops, vector_bytes_) != 0;
+    return changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
+}
+
+//===----------------------------------------------------------------------===//
+//                             SLP Vectorize Implementation
+//===----------------------------------------------------------------------===//
+
+unsigned vectorize_slp(BasicBlock &bb, unsigned vector_bytes)
+{
+    unsigned groups = 0;
+    while (vectorize_one_group(bb, vector_bytes))
+    {
+        ++groups;
+    }
+    return groups;
+}
+
+unsigned vectorize_slp(Function &func, unsigned vector_bytes)
+{
+    unsigned groups = 0;
+    for (BasicBlock *bb : func.basic_blocks())
+    {
+        groups += vectorize_slp(*bb, vector_bytes);
+    }
+    MO_DEBUG("slp-vectorizer: replaced %u store groups in %s\n", groups, func.name().c_str());
+    return groups;
+}
+
+PreservedAnalyses SLPVectorizePass::run(Function &func, AnalysisManager &)
+{
+    if (vector_bytes_ == 0)
+    {
+        return PreservedAnalyses::all();
+    }
+    return vectorize_slp(func, vector_bytes_) ? PreservedAnalyses::cfg() : PreservedAnalyses::all();
+}
@@ -0,0 +1,87 @@
+// vectorize.h - Loop and straight-line (SLP) vectorization
+#pragma once
+
+#include "../ir.h"
+#include "loop_info.h"
+#include "pass_manager.h"
+
+//===----------------------------------------------------------------------===//
+//                             Loop Vectorize
+//===----------------------------------------------------------------------===//
+//
+// A loop that reads and writes consecutive array elements does the same
+// operation on each element in turn. When the target has vector registers
+// of `vector_bytes`, VF = vector_bytes / element size iterations are done
+// at once on VectorType values: the element loads and stores become loads
+// and stores of <VF x T> through the same address, and the arithmetic
+// between them works on vectors. Values the loop doesn't change go into
+// all lanes of a vector once, before the loop, through a stack slot.
+//
+// The loop has to be in the shape IRGenerator gives `for (i = a; i < n;
+// i++)` after mem2reg: a header with the induction variable as its only
+// phi, ending in the only exit, and a body of blocks that just fall into
+// each other. Every address is `gep base, ..., i` with the rest invariant,
+// every value computed in the loop stays in it, and all accesses have the
+// same element size. The vector loop runs while at least VF iterations
+// are left and the scalar loop finishes off the rest:
+//
+//   vec.check:  enough iterations, and the stored ranges overlap no other?
+//   vec.ph:     invariants broadcast
+//   vec.body:   VF iterations at a time, down to the last full VF
+//   scalar.ph:  the original loop, resuming where vec.body stopped
+//
+// Accesses to different allocas or globals never overlap; for the rest,
+// vec.check compares the address ranges the loop covers.
+
+// Iterations vectorize_loop would do at once for `loop`; 1 when it leaves
+// it alone
+unsigned vectorization_factor(const Loop &loop, unsigned vector_bytes);
+
+// Vectorizes `loop` and returns whether it did
+bool vectorize_loop(Loop &loop, unsigned vector_bytes);
+
+// Every innermost loop of `func`; returns how many were vectorized
+unsigned vectorize_loops(Function &func, const LoopInfo &loops, unsigned vector_bytes);
+
+class LoopVectorizePass : public FunctionPass
+{
+public:
+    explicit LoopVectorizePass(unsigned vector_bytes) : vector_bytes_(vector_bytes) {}
+
+    const char *name() const override { return "loop-vectorize"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+
+private:
+    unsigned vector_bytes_;
+};
+
+//===----------------------------------------------------------------------===//
+//                             SLP Vectorize
+//===----------------------------------------------------------------------===//
+//
+// Straight-line code does the same thing to neighbouring elements too,
+// `a[0] = b[0] + c[0]; a[1] = b[1] + c[1]; ...`, most of all after
+// unrolling. VF stores to consecutive constant indices off the same base,
+// in one block, become one vector store when the values stored are built
+// alike in every lane: loads from consecutive elements, the same operation
+// on such values, or one value in all lanes. The vector code goes where the
+// last of the stores was, so the loads it replaces must not see any of the
+// earlier stores: they read either exactly the stored elements or another
+// alloca or global, and nothing else in between touches memory.
+
+// Replaces groups of stores in `bb`, and returns how many groups
+unsigned vectorize_slp(BasicBlock &bb, unsigned vector_bytes);
+
+unsigned vectorize_slp(Function &func, unsigned vector_bytes);
+
+class SLPVectorizePass : public FunctionPass
+{
+public:
+    explicit SLPVectorizePass(unsigned vector_bytes) : vector_bytes_(vector_bytes) {}
+
+    const char *name() const override { return "slp-vectorizer"; }
+    PreservedAnalyses run(Function &func, AnalysisManager &analyses) override;
+
+private:
+    unsigned vector_bytes_;
+};
@@ -2,18 +2,40 @@
 #include "type_checker.h"
 #include "lexer.h"
 #include "mo_debug.h"
+#include "phase_stats.h"
 
 #include <cassert>
 #include <algorithm>
+#include <iterator>
 #include <unordered_set>
 
 using namespace ast;
 
 TypeChecker::TypeChecker(ast::Program *program)
-    : program_(program),
-      global_scope_(std::make_unique<Scope>(nullptr))
+    : program_(nullptr)
 {
-    current_scope_ = global_scope_.get();
+    set_program(program);
+}
+
+void TypeChecker::set_program(ast::Program *program)
+{
+    program_ = program;
+    types_ = nullptr;
+    if (program_)
+    {
+        // Types interned while checking are shared with the nodes, so they must
+        // live as long as the program itself
+        if (!program_->types)
+        {
+            program_->types = std::make_unique<TypeContext>();
+        }
+        types_ = program_->types.get();
+        // The parser's table, which the identifiers' symbols index
+        if (program_->symbols)
+        {
+            scope_.use_symbol_table(program_->symbols.get());
+        }
+    }
 }
 
 TypeChecker::TypeCheckResult TypeChecker::check()
@@ -22,6 +44,7 @@ TypeChecker::TypeCheckResult TypeChecker::check()
     {
         return {false, {"Program not set"}};
     }
+    PhaseTimer timer("typecheck");
 
     for (auto &struct_ : program_->structs)
     {
@@ -41,33 +64,82 @@ TypeChecker::TypeCheckResult TypeChecker::check()
     for (auto &global : program_->globals)
     {
         visit(*global);
-        global_scope_->insert_variable(global->name, global->type->clone());
+        scope_.insert_variable(global->name, types_->intern(*global->type), global->symbol);
     }
 
+    // Every signature is visible to every body, so bodies can be checked in any order
     for (auto &func : program_->functions)
     {
-        visit(*func);
+        declare_function(*func);
     }
+    check_function_bodies();
 
+    timer.count("functions", program_->functions.size());
+    timer.count("errors", errors_.size());
     return {errors_.empty(), std::move(errors_)};
 }
 
+void TypeChecker::check_function_bodies()
+{
+    auto &functions = program_->functions;
+    if (!pool_ || pool_->size() < 2 || functions.size() < 2)
+    {
+        for (auto &func : functions)
+        {
+            check_function_body(*func);
+        }
+        return;
+    }
+
+    // Struct types are built lazily on first use; build them now, before the
+    // workers start sharing the declarations.
+    for (auto &struct_ : program_->structs)
+    {
+        struct_->type();
+    }
+
+    // Bodies only read the global scope, so each worker checks with its own copy
+    // of this checker. Errors are buffered per function and appended in source order.
+    std::vector<std::unique_ptr<TypeChecker>> workers(pool_->size());
+    std::vector<std::vector<std::string>> errors(functions.size());
+    pool_->parallel_for(functions.size(), [&](size_t index, unsigned worker)
+                        {
+                            auto &checker = workers[worker];
+                            if (!checker)
+                            {
+                                checker = std::make_unique<TypeChecker>(*this);
+                                checker->pool_ = nullptr;
+                                checker->errors_.clear();
+                            }
+                            checker->check_function_body(*functions[index]);
+                            errors[index] = std::move(checker->errors_);
+                            checker->errors_.clear(); });
+
+    for (auto &buffer : errors)
+    {
+        errors_.insert(errors_.end(), std::make_move_iterator(buffer.begin()), std::make_move_iterator(buffer.end()));
+    }
+}
+
 // Scope management implementation
 void TypeChecker::push_scope()
 {
-    current_scope_ = new Scope{current_scope_};
+    scope_.push();
 }
 
 void TypeChecker::pop_scope()
 {
-    assert(current_scope_ != global_scope_.get() && "Cannot pop global scope");
-    auto tmp = current_scope_;
-    current_scope_ = current_scope_->parent();
-    delete tmp;
+    assert(!scope_.is_global() && "Cannot pop global scope");
+    scope_.pop();
 }
 
 bool TypeChecker::types_equal(const Type &t1, const Type &t2) const
 {
+    if (&t1 == &t2)
+        return true;
+    // Interned types are unique per structure, so distinct pointers mean distinct types
+    if (t1.is_interned() && t2.is_interned())
+        return false;
     return t1.equals(&t2);
 }
 
@@ -205,7 +277,7 @@ void TypeChecker::visit(SizeofExpr &expr)
     }
 
     // sizeof always returns integer
-    expr.type = Type::create_int(64, true);
+    expr.type = types_->get_int(64, true)->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
@@ -223,7 +295,7 @@ void TypeChecker::visit(AddressOfExpr &expr)
         return;
     }
 
-    expr.type = Type::create_pointer(expr.operand->type->clone());
+    expr.type = types_->get_pointer(types_->intern(*expr.operand->type))->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
@@ -248,7 +320,7 @@ void TypeChecker::visit(VariableExpr &expr)
 {
     expr.expr_category = Expr::Category::LValue;
 
-    if (auto type = current_scope_->resolve_variable(expr.identifier))
+    if (auto type = scope_.resolve_variable(expr.identifier, expr.symbol))
     {
         expr.type = type->clone();
     }
@@ -256,31 +328,31 @@ void TypeChecker::visit(VariableExpr &expr)
     {
         add_error("Undefined symbol '" + expr.identifier + "'");
         MO_DEBUG("Undefined symbol: %s", expr.identifier.c_str());
-        expr.type = Type::create_placeholder();
+        expr.type = types_->get_placeholder()->clone();
     }
 }
 
 void TypeChecker::visit(IntegerLiteralExpr &expr)
 {
-    expr.type = Type::create_int();
+    expr.type = types_->get_int()->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
 void TypeChecker::visit(BooleanLiteralExpr &expr)
 {
-    expr.type = Type::create_bool();
+    expr.type = types_->get_bool()->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
 void TypeChecker::visit(FloatLiteralExpr &expr)
 {
-    expr.type = Type::create_float();
+    expr.type = types_->get_float()->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
 void TypeChecker::visit(StringLiteralExpr &expr)
 {
-    expr.type = Type::create_string();
+    expr.type = types_->get_string()->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
@@ -305,18 +377,18 @@ void TypeChecker::visit(StructDecl &decl)
             }
         }
 
-        if (types_equal(*field.type, *Type::create_void()))
+        if (types_equal(*field.type, *types_->get_void()))
         {
             add_error("Field '" + field.name + "' cannot have void type");
         }
     }
     MO_DEBUG("Struct '%s':", decl.name.c_str());
-    auto struct_ty = decl.type()->clone();
+    const Type *struct_ty = types_->intern(*decl.type());
     for (auto &field : *struct_ty->as_struct())
     {
         MO_DEBUG("  %s: %s", field.name.c_str(), field.type->to_string().c_str());
     }
-    if (!current_scope_->insert_type(decl.name, std::move(struct_ty)))
+    if (!scope_.insert_type(decl.name, struct_ty))
     {
         add_error("Duplicate struct name: " + decl.name);
         MO_DEBUG("Duplicate struct name: %s", decl.name.c_str());
@@ -363,7 +435,7 @@ void TypeChecker::visit(GlobalDecl &decl)
     if (auto alias = decl.type->as_alias())
     {
         auto name = alias->name();
-        if (auto type = current_scope_->resolve_type(name))
+        if (auto type = scope_.resolve_type(name))
         {
             decl.type = type->clone();
         }
@@ -373,7 +445,8 @@ void TypeChecker::visit(GlobalDecl &decl)
         }
     }
 
-    if (!global_scope_->insert_variable(decl.name, decl.type->clone()))
+    MO_ASSERT(scope_.is_global(), "Global variable not at global scope");
+    if (!scope_.insert_variable(decl.name, types_->intern(*decl.type)))
     {
         add_error("Duplicate global variable name: " + decl.name);
     }
@@ -420,7 +493,7 @@ void TypeChecker::visit(TypeAliasDecl &decl)
         MO_ASSERT(false, "Invalid target type for alias: %s", decl.name.c_str());
     }
 
-    if (!current_scope_->insert_type(decl.name, decl.type->clone()))
+    if (!scope_.insert_type(decl.name, types_->intern(*decl.type)))
     {
         add_error("Duplicate alias: " + decl.name);
         MO_ASSERT(false, "Duplicate alias: %s", decl.name.c_str());
@@ -545,7 +618,7 @@ void TypeChecker::visit(BinaryExpr &expr)
             else if (auto rhs_float_ty = expr.right->type->as_float()) // int +-*/ float = float
             {
                 add_error_numeric();
-                expr.type = Type::create_float(static_cast<uint8_t>(rhs_float_ty->bit_width()));
+                expr.type = types_->get_float(static_cast<uint8_t>(rhs_float_ty->bit_width()))->clone();
             }
             else
             {
@@ -614,7 +687,7 @@ void TypeChecker::visit(BinaryExpr &expr)
             add_error("Comparison requires numeric operands");
         }
 
-        expr.type = Type::create_bool(); // Comparison result is bool
+        expr.type = types_->get_bool()->clone(); // Comparison result is bool
         expr.expr_category = Expr::Category::RValue;
         break;
     }
@@ -627,7 +700,7 @@ void TypeChecker::visit(BinaryExpr &expr)
         {
             add_error("Logical operators require boolean operands");
         }
-        expr.type = Type::create_bool(); // Logical result is bool
+        expr.type = types_->get_bool()->clone(); // Logical result is bool
         expr.expr_category = Expr::Category::RValue;
         break;
     }
@@ -645,7 +718,7 @@ void TypeChecker::visit(BinaryExpr &expr)
         {
             add_error("Bitwise operators require integer operands");
         }
-        expr.type = Type::create_int();
+        expr.type = types_->get_int()->clone();
         expr.expr_category = Expr::Category::RValue;
         break;
     }
@@ -692,7 +765,7 @@ void TypeChecker::visit(UnaryExpr &expr)
         {
             add_error("Cannot take address of rvalue");
         }
-        expr.type = Type::create_pointer(expr.operand->type->clone());
+        expr.type = types_->get_pointer(types_->intern(*expr.operand->type))->clone();
         expr.expr_category = Expr::Category::RValue;
         break;
 
@@ -709,7 +782,7 @@ void TypeChecker::visit(UnaryExpr &expr)
     }
 
     case TokenType::Not:
-        expr.type = Type::create_bool();
+        expr.type = types_->get_bool()->clone();
         expr.expr_category = Expr::Category::RValue;
         break;
 
@@ -827,7 +900,7 @@ void TypeChecker::visit(VarDeclStmt &stmt)
         if (!stmt.init_expr->type)
         {
             add_error("Cannot deduce variable type from invalid initializer: " + stmt.name);
-            stmt.type = Type::create_placeholder(); // Create a placeholder for unknown type
+            stmt.type = types_->get_placeholder()->clone(); // Create a placeholder for unknown type
         }
         else
         {
@@ -861,7 +934,7 @@ void TypeChecker::visit(VarDeclStmt &stmt)
     }
 
     // Check for variable redeclaration
-    if (current_scope_->resolve_variable(stmt.name))
+    if (scope_.resolve_variable(stmt.name, stmt.symbol))
     {
         add_error("Redeclaration of variable: " + stmt.name);
         return;
@@ -869,7 +942,7 @@ void TypeChecker::visit(VarDeclStmt &stmt)
 
     // Register the variable in the current scope
     assert(!stmt.name.empty() && "Variable name must be set");
-    if (!current_scope_->insert_variable(stmt.name, stmt.type->clone()))
+    if (!scope_.insert_variable(stmt.name, types_->intern(*stmt.type), stmt.symbol))
     {
         add_error("Failed to register variable in scope: " + stmt.name);
     }
@@ -922,19 +995,34 @@ void TypeChecker::visit(BlockStmt &stmt)
 // Function declaration handling
 void TypeChecker::visit(FunctionDecl &func)
 {
-    func.return_type = resolve_alias(*func.return_type);
+    declare_function(func);
+    check_function_body(func);
+}
 
-    // Check for duplicate function name
-    auto prev_return_type = current_return_type_;
-    current_return_type_ = func.return_type.get();
+void TypeChecker::declare_function(FunctionDecl &func)
+{
+    func.return_type = resolve_alias(*func.return_type);
 
     // To handle recursive function calls, we need to add current function to the
     // current scope before checking its body.
     assert(!func.name.empty() && "Function name must be set");
-    if (!current_scope_->insert_variable(func.name, func.type()))
+    std::vector<const Type *> param_types;
+    param_types.reserve(func.params.size());
+    for (const auto &param : func.params)
+    {
+        param_types.push_back(types_->intern(*param.type));
+    }
+    const Type *func_type = types_->get_function(types_->intern(*func.return_type), param_types);
+    if (!scope_.insert_variable(func.name, func_type))
     {
         add_error("Duplicate function name: " + func.name);
     }
+}
+
+void TypeChecker::check_function_body(FunctionDecl &func)
+{
+    auto prev_return_type = current_return_type_;
+    current_return_type_ = func.return_type.get();
 
     push_scope();
 
@@ -942,7 +1030,7 @@ void TypeChecker::visit(FunctionDecl &func)
     for (auto &param : func.params)
     {
         assert(!param.name.empty() && "Parameter name must be set");
-        if (!current_scope_->insert_variable(param.name, param.type->clone()))
+        if (!scope_.insert_variable(param.name, types_->intern(*param.type)))
         {
             add_error("Duplicate parameter name: " + param.name);
         }
@@ -963,7 +1051,7 @@ void TypeChecker::visit(MemberAccessExpr &expr)
     if (!expr.object->type)
     {
         MO_ASSERT(false, "Member access on invalid object");
-        expr.type = Type::create_placeholder();
+        expr.type = types_->get_placeholder()->clone();
         return;
     }
 
@@ -971,7 +1059,7 @@ void TypeChecker::visit(MemberAccessExpr &expr)
     {
         add_error("Member access on non-struct type");
         MO_WARN("Member access on non-struct type: %s", expr.object->type->to_string().c_str());
-        expr.type = Type::create_placeholder();
+        expr.type = types_->get_placeholder()->clone();
         return;
     }
 
@@ -983,7 +1071,7 @@ void TypeChecker::visit(MemberAccessExpr &expr)
     if (!struct_type)
     {
         add_error("Member access on non-struct type");
-        expr.type = Type::create_placeholder();
+        expr.type = types_->get_placeholder()->clone();
         return;
     }
 
@@ -1027,7 +1115,7 @@ void TypeChecker::visit(MemberAccessExpr &expr)
     {
         add_error("No member '" + expr.member + "' in struct '" + struct_type->name() + "'");
         MO_WARN("No member '%s' in struct '%s'", expr.member.c_str(), struct_type->name().c_str());
-        expr.type = Type::create_placeholder();
+        expr.type = types_->get_placeholder()->clone();
         return;
     }
 
@@ -1078,7 +1166,7 @@ void TypeChecker::visit(ArrayAccessExpr &expr)
     }
     default:
         add_error("Subscripted value is not array or pointer");
-        expr.type = Type::create_placeholder();
+        expr.type = types_->get_placeholder()->clone();
     }
 }
 
@@ -1099,20 +1187,21 @@ void TypeChecker::visit(InitListExpr &expr)
     }
 
     // Create array type (size may be unknown)
-    expr.type = Type::create_array(common_type ? common_type->clone() : Type::create_placeholder(), expr.members.size());
+    const Type *element_type = common_type ? types_->intern(*common_type) : types_->get_placeholder();
+    expr.type = types_->get_array(element_type, expr.members.size())->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
 void TypeChecker::visit(TupleExpr &expr)
 {
-    std::vector<TypePtr> elem_types;
+    std::vector<const Type *> elem_types;
     for (auto &member : expr.elements)
     {
         check_expr(*member);
         MO_ASSERT(member->type != nullptr, "Tuple element must have a type");
-        elem_types.push_back(member->type->clone());
+        elem_types.push_back(types_->intern(*member->type));
     }
-    expr.type = Type::create_tuple(std::move(elem_types));
+    expr.type = types_->get_tuple(elem_types)->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
@@ -1200,14 +1289,14 @@ bool TypeChecker::is_convertible(const Type &from,
     // Preserves strict/explicit flags during resolution
     if (from.kind() == Type::Kind::Alias)
     {
-        auto resolved = resolve_alias(*from.clone());
+        auto resolved = resolve_alias(from);
         return is_convertible(*resolved, to, is_strict, is_explicit);
     }
 
     // Rule 8: Type alias resolution (reverse)
     if (to.kind() == Type::Kind::Alias)
     {
-        auto resolved = resolve_alias(*to.clone());
+        auto resolved = resolve_alias(to);
         return is_convertible(from, *resolved, is_strict, is_explicit);
     }
 
@@ -1218,22 +1307,18 @@ bool TypeChecker::is_convertible(const Type &from,
 // Function pointer handling
 void TypeChecker::visit(FunctionPointerExpr &expr)
 {
-    // Verify parameter types
+    // Verify parameter types and build the function type
+    std::vector<const Type *> params;
     for (auto &param : expr.param_types)
     {
-        if (!param->clone())
+        if (!param)
         {
             add_error("Invalid parameter type in function pointer");
+            continue;
         }
+        params.push_back(types_->intern(*param));
     }
-
-    // Build function type
-    std::vector<TypePtr> params;
-    for (auto &param : expr.param_types)
-    {
-        params.push_back(param->clone());
-    }
-    expr.type = Type::create_function(expr.return_type->clone(), std::move(params));
+    expr.type = types_->get_function(types_->intern(*expr.return_type), params)->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
@@ -1247,7 +1332,7 @@ void TypeChecker::check_expr_safe(Expr &expr)
     catch (const std::exception &e)
     {
         // Create dummy type to prevent cascading errors
-        expr.type = Type::create_placeholder();
+        expr.type = types_->get_placeholder()->clone();
         expr.expr_category = Expr::Category::RValue;
         add_error("Critical error in expression: " + std::string(e.what()));
     }
@@ -1299,31 +1384,28 @@ void TypeChecker::visit(StructLiteralExpr &expr)
     MO_DEBUG("struct_type has %zu members", struct_type->member_count());
     for (size_t i = 0; i < struct_type->member_count(); ++i)
     {
-        const auto &member = struct_type->get_member(i); // no error
-        printf("member ptr: %p\n", &member);
-        printf("mem.type ptr: %p\n", &member.type);
-        printf("type %s\n", member.type->to_string().c_str()); // Segmentation fault.
-        printf("member %s\n", member.name.c_str());            // Segmentation fault.
-        if (!initialized_members.count(member.name))           // Segmentation fault.
+        const auto &member = struct_type->get_member(i);
+        MO_DEBUG("member %s: %s", member.name.c_str(), member.type->to_string().c_str());
+        if (!initialized_members.count(member.name))
         {
             add_error("Missing initialization for member '" + member.name + "'");
         }
     }
 
-    expr.type = struct_decl->type()->clone();
+    expr.type = types_->intern(*struct_decl->type())->clone();
     expr.expr_category = Expr::Category::RValue;
 }
 
-// Alias resolution
+// Alias resolution. Returns a handle to the canonical resolved type.
 TypePtr TypeChecker::resolve_alias(const Type &type) const
 {
-    if (!type.is_alias())
+    const Type *current = types_->intern(type);
+    if (!current->is_alias())
     {
-        return type.clone();
+        return current->clone();
     }
 
     std::unordered_set<std::string> visited;
-    TypePtr current = type.clone();
 
     while (auto alias = current->as_alias())
     {
@@ -1338,13 +1420,13 @@ TypePtr TypeChecker::resolve_alias(const Type &type) const
         visited.insert(name);
 
         // resolve target
-        TypePtr resolved = current_scope_->resolve_type(name);
+        const Type *resolved = scope_.resolve_type(name);
         if (!resolved)
         {
             add_error("Unresolved alias: ", name);
             return nullptr;
         }
-        current = std::move(resolved->clone());
+        current = resolved;
     }
 
     if (auto fin = current->as_alias())
@@ -1353,7 +1435,7 @@ TypePtr TypeChecker::resolve_alias(const Type &type) const
         return nullptr;
     }
 
-    return current;
+    return current->clone();
 }
 
 StructDecl *TypeChecker::find_struct(const std::string &name) const
@@ -8,6 +8,7 @@
 
 #include "ast.h"
 #include "ast_scope.h"
+#include "thread_pool.h"
 
 class TypeChecker
 {
@@ -19,14 +20,19 @@ public:
     };
 
     explicit TypeChecker(ast::Program *program = nullptr);
-    void set_program(ast::Program *program) { program_ = program; }
+    void set_program(ast::Program *program);
     TypeCheckResult check();
 
+    // Checks function bodies on `pool` once all signatures are declared. Errors
+    // are reported in source order either way. nullptr checks sequentially.
+    void set_thread_pool(ThreadPool *pool) { pool_ = pool; }
+
 protected:
     ast::Program *program_;
+    ast::TypeContext *types_ = nullptr; // owned by program_
+    ThreadPool *pool_ = nullptr;
     mutable std::vector<std::string> errors_;
-    std::unique_ptr<ast::Scope> global_scope_;
-    ast::Scope *current_scope_ = nullptr;
+    ast::Scope scope_;
     ast::Type *current_return_type_ = nullptr;
     int loop_depth_ = 0; // Track nested loop depth
 
@@ -40,7 +46,7 @@ protected:
         errors_.push_back(ss.str());
     }
 
-    // Type system helpers
+    // Type system helpers. Types are interned in types_, so most comparisons are by pointer.
     bool types_equal(const ast::Type &t1, const ast::Type &t2) const;
     bool is_convertible(const ast::Type &from, const ast::Type &to, bool is_strict = true, bool is_explicit = false) const;
     bool verify_assignable(const ast::Expr &target, const ast::Expr &value);
@@ -54,6 +60,10 @@ protected:
     void check_expr_safe(ast::Expr &expr);
     void check_stmt(ast::Statement &stmt);
 
+    void declare_function(ast::FunctionDecl &func);
+    void check_function_body(ast::FunctionDecl &func);
+    void check_function_bodies();
+
     void visit(ast::FunctionDecl &decl);
     void visit(ast::StructDecl &decl);
     void visit(ast::ImplBlock &impl);
@@ -0,0 +1,72 @@
+#include "asimov_batch.h"
+#include "../phase_stats.h"
+#include "../thread_pool.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace ASIMOV
+{
+
+    static ASIMOVJobResult run_job(const ASIMOVJob &job)
+    {
+        ASIMOVJobResult result;
+        std::ostringstream output;
+        try
+        {
+            ASIMOVVM vm(job.program);
+            vm.set_diagnostics(output);
+            for (auto [reg, value] : job.registers)
+            {
+                vm.set_register(reg, value);
+            }
+            for (auto [address, value] : job.memory)
+            {
+                vm.store_word(address, value);
+            }
+
+            vm.run(job.start_address.value_or(job.program->load_address()));
+
+            result.registers = vm.registers();
+            for (auto [address, words] : job.dumps)
+            {
+                auto &dump = result.dumps.emplace_back();
+                dump.reserve(words);
+                for (size_t i = 0; i < words; ++i)
+                {
+                    dump.push_back(vm.load_word(static_cast<uint32_t>(address + i * 4)));
+                }
+            }
+            result.successful = true;
+        }
+        catch (const std::exception &e)
+        {
+            result.error_message = e.what();
+        }
+        result.output = output.str();
+        return result;
+    }
+
+    std::vector<ASIMOVJobResult> run_jobs(std::span<const ASIMOVJob> jobs, ThreadPool *pool)
+    {
+        PhaseTimer timer("vm_jobs");
+        std::vector<ASIMOVJobResult> results(jobs.size());
+        auto run = [&](size_t index, unsigned)
+        {
+            results[index] = run_job(jobs[index]);
+        };
+        if (pool)
+        {
+            pool->parallel_for(jobs.size(), run);
+        }
+        else
+        {
+            for (size_t i = 0; i < jobs.size(); ++i)
+            {
+                run(i, 0);
+            }
+        }
+        timer.count("jobs", jobs.size());
+        return results;
+    }
+
+} // namespace ASIMOV
@@ -0,0 +1,44 @@
+#ifndef ASIMOV_BATCH_H
+#define ASIMOV_BATCH_H
+
+#include "asimov_vm.h"
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+class ThreadPool;
+
+namespace ASIMOV
+{
+    // 一次虚拟机运行：共享的程序加上本次的输入
+    struct ASIMOVJob
+    {
+        std::shared_ptr<const ASIMOVProgram> program;
+        // 起始地址，缺省为程序的装载地址
+        std::optional<uint32_t> start_address;
+        std::vector<std::pair<Reg, int32_t>> registers;     // 运行前写入的寄存器
+        std::vector<std::pair<uint32_t, uint32_t>> memory;  // 运行前写入的内存字（地址，值）
+        std::vector<std::pair<uint32_t, size_t>> dumps;     // 运行后按字读回的内存（地址，字数）
+    };
+
+    struct ASIMOVJobResult
+    {
+        bool successful = false;
+        std::string error_message;                   // 运行时抛出的异常
+        std::array<int32_t, Reg::TOTAL_REG> registers{};
+        std::vector<std::vector<uint32_t>> dumps;    // 与 ASIMOVJob::dumps 一一对应
+        std::string output;                          // 除零等诊断输出
+    };
+
+    // 每个任务一个独立的 ASIMOVVM：内存各自一份，预解码的程序共享。
+    // 有线程池时并行执行；结果按任务顺序返回，一个任务出错不影响其他任务
+    std::vector<ASIMOVJobResult> run_jobs(std::span<const ASIMOVJob> jobs, ThreadPool *pool = nullptr);
+
+} // namespace ASIMOV
+
+#endif // ASIMOV_BATCH_H
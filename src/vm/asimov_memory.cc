@@ -0,0 +1,69 @@
+#include "asimov_memory.h"
+#include "../mo_debug.h"
+
+namespace ASIMOV
+{
+
+    ASIMOVMemory::ASIMOVMemory(size_t size)
+        : size_(size), last_word_(size >= 4 ? static_cast<uint32_t>(size - 4) : 0)
+    {
+        MO_ASSERT(size <= MAX_SIZE, "Memory size exceeds the 32-bit address space");
+        const size_t words = (size + 3) / 4;
+        if (size <= DENSE_LIMIT)
+        {
+            dense_words_.resize(words);
+            dense_ = dense_words_.data();
+        }
+        else
+        {
+            pages_.resize((words + PAGE_WORDS - 1) >> PAGE_SHIFT);
+        }
+    }
+
+    size_t ASIMOVMemory::resident_bytes() const
+    {
+        if (dense_)
+            return dense_words_.size() * 4;
+        size_t pages = 0;
+        for (const auto &page : pages_)
+        {
+            pages += page != nullptr;
+        }
+        return pages * PAGE_WORDS * 4;
+    }
+
+    uint32_t *ASIMOVMemory::page_for(size_t index)
+    {
+        auto &page = pages_[index >> PAGE_SHIFT];
+        if (!page)
+        {
+            // 值初始化即清零
+            page = std::make_unique<uint32_t[]>(PAGE_WORDS);
+        }
+        return page.get();
+    }
+
+    uint8_t ASIMOVMemory::read_byte(uint32_t address) const
+    {
+        return (word(address >> 2) >> (24 - 8 * (address & 3))) & 0xFF;
+    }
+
+    // 大端：地址较低的字节在字的高位
+    uint32_t ASIMOVMemory::read_unaligned(uint32_t address) const
+    {
+        const size_t index = address >> 2;
+        const unsigned shift = 8 * (address & 3);
+        return (word(index) << shift) | (word(index + 1) >> (32 - shift));
+    }
+
+    void ASIMOVMemory::write_unaligned(uint32_t address, uint32_t value)
+    {
+        const size_t index = address >> 2;
+        const unsigned shift = 8 * (address & 3);
+        uint32_t &first = word_ref(index);
+        first = (first & ~(0xFFFFFFFFu >> shift)) | (value >> shift);
+        uint32_t &second = word_ref(index + 1);
+        second = (second & (0xFFFFFFFFu >> shift)) | (value << (32 - shift));
+    }
+
+} // namespace ASIMOV
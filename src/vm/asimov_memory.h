@@ -0,0 +1,77 @@
+#ifndef ASIMOV_MEMORY_H
+#define ASIMOV_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace ASIMOV
+{
+    // 虚拟机的字寻址内存。按 32 位字以本机字节序存放，对齐访问直接读写一个字；
+    // 非对齐访问由相邻两个字拼出，字节序（大端）只在这里和按字节读取时体现。
+    //
+    // 不超过 DENSE_LIMIT 的内存一次分配完；更大的地址空间按 PAGE_WORDS 分页，
+    // 页在第一次写入时才分配并清零，未分配的页读出 0。
+    class ASIMOVMemory
+    {
+    public:
+        static constexpr size_t PAGE_SHIFT = 14; // 每页 16K 个字（64 KiB）
+        static constexpr size_t PAGE_WORDS = size_t(1) << PAGE_SHIFT;
+        static constexpr size_t DENSE_LIMIT = size_t(16) << 20;
+        static constexpr size_t MAX_SIZE = size_t(1) << 32; // 地址是 32 位的
+
+        explicit ASIMOVMemory(size_t size);
+
+        size_t size() const { return size_; }
+        bool paged() const { return dense_ == nullptr; }
+        // 已分配的字节数，分页内存只统计写过的页
+        size_t resident_bytes() const;
+
+        // 一次比较：[address, address + 4) 是否在内存内
+        bool in_range(uint32_t address) const { return size_ >= 4 && address <= last_word_; }
+
+        // 调用者先检查 in_range
+        uint32_t read(uint32_t address) const
+        {
+            if ((address & 3) == 0) [[likely]]
+                return word(address >> 2);
+            return read_unaligned(address);
+        }
+        void write(uint32_t address, uint32_t value)
+        {
+            if ((address & 3) == 0) [[likely]]
+                word_ref(address >> 2) = value;
+            else
+                write_unaligned(address, value);
+        }
+        uint8_t read_byte(uint32_t address) const;
+
+    private:
+        size_t size_;
+        uint32_t last_word_; // 最后一个完整字的地址
+        std::vector<uint32_t> dense_words_;
+        uint32_t *dense_ = nullptr;
+        std::vector<std::unique_ptr<uint32_t[]>> pages_;
+
+        uint32_t word(size_t index) const
+        {
+            if (dense_) [[likely]]
+                return dense_[index];
+            const auto &page = pages_[index >> PAGE_SHIFT];
+            return page ? page[index & (PAGE_WORDS - 1)] : 0;
+        }
+        uint32_t &word_ref(size_t index)
+        {
+            if (dense_) [[likely]]
+                return dense_[index];
+            return page_for(index)[index & (PAGE_WORDS - 1)];
+        }
+        uint32_t *page_for(size_t index);
+        uint32_t read_unaligned(uint32_t address) const;
+        void write_unaligned(uint32_t address, uint32_t value);
+    };
+
+} // namespace ASIMOV
+
+#endif // ASIMOV_MEMORY_H
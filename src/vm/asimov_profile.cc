@@ -0,0 +1,145 @@
+#include "asimov_profile.h"
+#include "../machine.h"
+#include "../targets/asimov_target.h"
+#include "asimov_vm.h"
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+namespace ASIMOV
+{
+
+    ASIMOVProfile::ASIMOVProfile(const TargetInstInfo &tii)
+        : latencies_(CALL + 1), opcode_counts_(CALL + 1)
+    {
+        for (unsigned opcode = 0; opcode < latencies_.size(); ++opcode)
+        {
+            latencies_[opcode] = tii.get_instruction_latency(opcode);
+        }
+    }
+
+    uint64_t ASIMOVProfile::opcode_count(unsigned opcode) const
+    {
+        return opcode < opcode_counts_.size() ? opcode_counts_[opcode] : 0;
+    }
+
+    ASIMOVProfile::PCCounter *ASIMOVProfile::new_pc_page(size_t page)
+    {
+        if (page >= pc_pages_.size())
+            pc_pages_.resize(page + 1);
+        if (!pc_pages_[page])
+            pc_pages_[page] = std::make_unique<PCCounter[]>(PAGE_WORDS);
+        return pc_pages_[page].get();
+    }
+
+    const ASIMOVProfile::PCCounter *ASIMOVProfile::find_pc_counter(uint32_t address) const
+    {
+        const uint32_t index = address >> 2;
+        const size_t page = index >> PAGE_SHIFT;
+        if (page >= pc_pages_.size() || !pc_pages_[page])
+            return nullptr;
+        return &pc_pages_[page][index & (PAGE_WORDS - 1)];
+    }
+
+    uint64_t ASIMOVProfile::hits(uint32_t address) const
+    {
+        const PCCounter *counter = find_pc_counter(address);
+        return counter ? counter->hits : 0;
+    }
+
+    uint64_t ASIMOVProfile::cycles_at(uint32_t address) const
+    {
+        const PCCounter *counter = find_pc_counter(address);
+        return counter ? counter->cycles : 0;
+    }
+
+    std::vector<ASIMOVFlatEntry> ASIMOVProfile::flat_profile(const ASIMOVLabelMap &labels) const
+    {
+        // 0 号是第一个标签之前的地址
+        std::vector<ASIMOVFlatEntry> entries(labels.size() + 1);
+        entries[0].label = "<unknown>";
+        for (size_t i = 0; i < labels.size(); ++i)
+        {
+            entries[i + 1].address = labels[i].first;
+            entries[i + 1].label = labels[i].second;
+        }
+
+        for (size_t page = 0; page < pc_pages_.size(); ++page)
+        {
+            if (!pc_pages_[page])
+                continue;
+            for (uint32_t i = 0; i < PAGE_WORDS; ++i)
+            {
+                const PCCounter &counter = pc_pages_[page][i];
+                if (!counter.hits)
+                    continue;
+                const uint32_t address = static_cast<uint32_t>(((page << PAGE_SHIFT) + i) * 4);
+                auto it = std::upper_bound(labels.begin(), labels.end(), address,
+                                           [](uint32_t a, const auto &label)
+                                           { return a < label.first; });
+                ASIMOVFlatEntry &entry = entries[it - labels.begin()];
+                entry.instructions += counter.hits;
+                entry.cycles += counter.cycles;
+            }
+        }
+
+        std::erase_if(entries, [](const ASIMOVFlatEntry &entry)
+                      { return entry.instructions == 0; });
+        std::stable_sort(entries.begin(), entries.end(), [](const ASIMOVFlatEntry &a, const ASIMOVFlatEntry &b)
+                         { return a.cycles > b.cycles; });
+        return entries;
+    }
+
+    void ASIMOVProfile::print_flat_profile(std::ostream &os, const ASIMOVLabelMap &labels) const
+    {
+        os << "  cycles      %   instrs  label" << std::endl;
+        for (const ASIMOVFlatEntry &entry : flat_profile(labels))
+        {
+            const double percent = cycles_ ? 100.0 * entry.cycles / cycles_ : 0.0;
+            os << std::setw(8) << entry.cycles << " " << std::setw(6) << std::fixed << std::setprecision(2)
+               << percent << " " << std::setw(8) << entry.instructions << "  " << entry.label << std::endl;
+        }
+        os << "instructions: " << instructions_ << ", cycles: " << cycles_
+           << ", loads: " << loads_ << ", stores: " << stores_ << std::endl;
+    }
+
+    void ASIMOVProfile::reset()
+    {
+        std::fill(opcode_counts_.begin(), opcode_counts_.end(), 0);
+        instructions_ = cycles_ = loads_ = stores_ = 0;
+        branches_.clear();
+        pc_pages_.clear();
+    }
+
+    ASIMOVLabelMap block_addresses(const MachineFunction &mf, uint32_t base_address)
+    {
+        const TargetInstInfo *tii = mf.parent()->target_inst_info();
+        ASIMOVLabelMap labels;
+        uint32_t address = base_address;
+        for (const auto &bb : mf.basic_blocks())
+        {
+            labels.emplace_back(address, bb->label());
+            for (const auto &mi : bb->instructions())
+            {
+                address += tii->get_inst_size(*mi);
+            }
+        }
+        return labels;
+    }
+
+    std::vector<uint64_t> read_counters(const ASIMOVVM &vm, const ASIMOVImage &image, uint32_t load_address,
+                                        const std::string &symbol, size_t count)
+    {
+        std::vector<uint64_t> counters;
+        const ASIMOVSymbol *found = image.find_symbol(symbol);
+        if (!found)
+            return counters;
+        const uint32_t base = load_address + found->offset;
+        for (size_t i = 0; i < count; ++i)
+        {
+            counters.push_back(vm.load_word(base + static_cast<uint32_t>(4 * i)));
+        }
+        return counters;
+    }
+
+} // namespace ASIMOV
@@ -0,0 +1,123 @@
+#ifndef ASIMOV_PROFILE_H
+#define ASIMOV_PROFILE_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class MachineFunction;
+class TargetInstInfo;
+
+namespace ASIMOV
+{
+    struct ASIMOVImage;
+    class ASIMOVVM;
+
+    struct ASIMOVBranchStats
+    {
+        uint64_t taken = 0;
+        uint64_t not_taken = 0;
+    };
+
+    // 按标签汇总的一行平面剖析结果
+    struct ASIMOVFlatEntry
+    {
+        std::string label;
+        uint32_t address = 0; // 标签地址
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+    };
+
+    // 标签的起始地址，按地址升序
+    using ASIMOVLabelMap = std::vector<std::pair<uint32_t, std::string>>;
+
+    // ASIMOVVM 的剖析数据：执行的指令数和模拟周期数（按
+    // TargetInstInfo::get_instruction_latency 计）、各操作码的执行次数、
+    // 每个 PC 的命中次数和周期、每条条件跳转的跳转/不跳转次数以及访存量。
+    // 通过 ASIMOVVM::set_profile 挂上后才收集，连续多次运行会累加。
+    class ASIMOVProfile
+    {
+    public:
+        explicit ASIMOVProfile(const TargetInstInfo &tii);
+
+        uint64_t instructions() const { return instructions_; }
+        uint64_t cycles() const { return cycles_; }
+        uint64_t opcode_count(unsigned opcode) const;
+        uint64_t hits(uint32_t address) const;
+        uint64_t cycles_at(uint32_t address) const;
+        const std::map<uint32_t, ASIMOVBranchStats> &branches() const { return branches_; }
+        uint64_t loads() const { return loads_; }
+        uint64_t stores() const { return stores_; }
+        uint64_t bytes_read() const { return loads_ * 4; }
+        uint64_t bytes_written() const { return stores_ * 4; }
+
+        // 按周期数从高到低；第一个标签之前的地址归到 "<unknown>"
+        std::vector<ASIMOVFlatEntry> flat_profile(const ASIMOVLabelMap &labels) const;
+        void print_flat_profile(std::ostream &os, const ASIMOVLabelMap &labels) const;
+
+        void reset();
+
+        // 虚拟机在执行每条原始指令、条件跳转和访存时调用
+        void record(uint32_t address, unsigned opcode)
+        {
+            const uint64_t latency = latencies_[opcode];
+            ++instructions_;
+            cycles_ += latency;
+            ++opcode_counts_[opcode];
+            PCCounter &counter = pc_counter(address >> 2);
+            ++counter.hits;
+            counter.cycles += latency;
+        }
+        void record_branch(uint32_t address, bool taken)
+        {
+            ASIMOVBranchStats &stats = branches_[address];
+            ++(taken ? stats.taken : stats.not_taken);
+        }
+        void record_load() { ++loads_; }
+        void record_store() { ++stores_; }
+
+    private:
+        struct PCCounter
+        {
+            uint64_t hits = 0;
+            uint64_t cycles = 0;
+        };
+        static constexpr unsigned PAGE_SHIFT = 12;
+        static constexpr uint32_t PAGE_WORDS = 1u << PAGE_SHIFT;
+
+        std::vector<uint64_t> latencies_;
+        std::vector<uint64_t> opcode_counts_;
+        uint64_t instructions_ = 0;
+        uint64_t cycles_ = 0;
+        uint64_t loads_ = 0;
+        uint64_t stores_ = 0;
+        std::map<uint32_t, ASIMOVBranchStats> branches_;
+        // 按字下标分页的 PC 计数器
+        std::vector<std::unique_ptr<PCCounter[]>> pc_pages_;
+
+        PCCounter &pc_counter(uint32_t index)
+        {
+            const size_t page = index >> PAGE_SHIFT;
+            if (page >= pc_pages_.size() || !pc_pages_[page]) [[unlikely]]
+                return new_pc_page(page)[index & (PAGE_WORDS - 1)];
+            return pc_pages_[page][index & (PAGE_WORDS - 1)];
+        }
+        PCCounter *new_pc_page(size_t page);
+        const PCCounter *find_pc_counter(uint32_t address) const;
+    };
+
+    // 把函数的基本块按顺序放在 base_address 开始处，得到各块标签的地址
+    ASIMOVLabelMap block_addresses(const MachineFunction &mf, uint32_t base_address = 0);
+
+    // 运行结束后读出镜像里 `symbol` 处的 count 个 32 位计数器，例如插桩
+    // 留下的 PROFILE_COUNTERS（见 transforms/profile.h）；找不到符号时返回空
+    std::vector<uint64_t> read_counters(const ASIMOVVM &vm, const ASIMOVImage &image, uint32_t load_address,
+                                        const std::string &symbol, size_t count);
+
+} // namespace ASIMOV
+
+#endif // ASIMOV_PROFILE_H
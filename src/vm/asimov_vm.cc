@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <bit>
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -9,16 +11,48 @@
 namespace ASIMOV
 {
 
-    ASIMOVVM::ASIMOVVM(size_t memory_size) : memory_size_(memory_size), memory_(memory_size), pc_(0)
+    ASIMOVVM::ASIMOVVM(size_t memory_size) : memory_size_(memory_size), memory_(memory_size), pc_(0),
+                                               decoded_pages_((memory_size / 4 + DECODE_PAGE_WORDS - 1) >> DECODE_PAGE_SHIFT),
+                                               owned_pages_(decoded_pages_.size())
     {
         MO_ASSERT(memory_size % 4 == 0, "Memory size must be a multiple of 4");
-        MO_ASSERT(memory_.size() == memory_size, "Memory allocation failed");
         MO_DEBUG("ASIMOVVM initialized with memory size %lu bytes, PC=0x%08X", memory_size, pc_);
 
         // 初始化寄存器
         registers_.fill(0);
     }
 
+    ASIMOVVM::ASIMOVVM(std::shared_ptr<const ASIMOVProgram> program) : ASIMOVVM(program->memory_size())
+    {
+        // 直接写内存，不作废共享的解码页
+        const ASIMOVVM &image = program->image_;
+        for (size_t i = 0; i < program->words_.size(); ++i)
+        {
+            memory_.write(static_cast<uint32_t>(program->load_address_ + i * 4), program->words_[i]);
+        }
+        decoded_pages_ = image.decoded_pages_;
+        decode_errors_ = image.decode_errors_;
+        pc_ = program->load_address_;
+        program_ = std::move(program);
+    }
+
+    ASIMOVProgram::ASIMOVProgram(std::vector<uint32_t> words, uint32_t load_address, size_t memory_size)
+        : words_(std::move(words)), load_address_(load_address), image_(memory_size)
+    {
+        image_.load_program(words_, load_address_);
+        if (words_.empty())
+            return;
+
+        // 解码覆盖程序的整页，实例执行页内任何地址都不必再解码
+        const uint32_t memory_words = static_cast<uint32_t>(memory_size / 4);
+        const uint32_t first = (load_address_ / 4) & ~(ASIMOVVM::DECODE_PAGE_WORDS - 1);
+        const uint32_t last = static_cast<uint32_t>(load_address_ / 4 + words_.size() - 1) | (ASIMOVVM::DECODE_PAGE_WORDS - 1);
+        for (uint32_t index = first; index <= last && index < memory_words; ++index)
+        {
+            image_.decode(index);
+        }
+    }
+
     void ASIMOVVM::load_program(const std::vector<uint32_t> &program, uint32_t start_address)
     {
         if (start_address + program.size() * 4 > memory_size_)
@@ -34,35 +68,19 @@ namespace ASIMOV
         pc_ = start_address;
     }
 
-    void ASIMOVVM::run(uint32_t start_address)
+    uint32_t ASIMOVVM::load_image(const ASIMOVImage &image, uint32_t load_address)
     {
-        pc_ = start_address;
-
-        MO_DEBUG("Starting execution at PC=0x%08X", start_address);
-
-        while (true)
+        std::vector<uint32_t> words;
+        std::string err_msg;
+        if (!image.link(load_address, words, &err_msg))
         {
-            // 1. Fetch
-            uint32_t instruction = read_memory(pc_);
-
-            // 2. Decode and Execute
-            execute_instruction(instruction);
-
-            // 3. Update PC (unless the instruction modifies it)
-            //    HALT 指令会停止执行
-            if (instruction == 0xFFFFFFFF)
-            {
-                break;
-            }
-
-            if (pc_ == memory_size_ - 4)
-            {
-                MO_WARN("PC overflowed, stopping execution");
-                break;
-            }
-
-            pc_ += 4;
+            throw std::runtime_error("Cannot load image: " + err_msg);
         }
+        load_program(words, load_address);
+        // 栈从内存末端向下增长
+        write_register(R7, static_cast<int32_t>(memory_size_));
+        pc_ = load_address + image.entry;
+        return pc_;
     }
 
     bool is_int_register(Reg reg)
@@ -77,338 +95,494 @@ namespace ASIMOV
         return reg_num >= static_cast<unsigned>(Reg::F0) && reg_num < static_cast<unsigned>(Reg::TOTAL_REG);
     }
 
-    // 验证整型寄存器
-    void validate_int_register(Reg reg)
+    static std::string register_error(unsigned reg, const char *kind)
+    {
+        std::stringstream ss;
+        ss << "Register " << reg << " is not " << kind << " register";
+        return ss.str();
+    }
+
+    static std::string read_error(uint32_t address)
     {
-        if (!is_int_register(reg))
+        std::stringstream ss;
+        ss << "Memory address " << std::hex << address << "H (" << std::dec
+           << address << ") cannot be read (out of range)";
+        return ss.str();
+    }
+
+    void ASIMOVVM::trap(DecodedInst &inst, std::string message)
+    {
+        inst.op = DecodedOp::Trap;
+        inst.imm = static_cast<int32_t>(decode_errors_.size());
+        decode_errors_.push_back(std::move(message));
+    }
+
+    void ASIMOVVM::invalidate_decoded(uint32_t address)
+    {
+        // 非对齐写会跨两个字；前一个字可能是以它为数据字的 MOVD 或融合指令
+        const uint32_t first = address / 4 ? address / 4 - 1 : 0;
+        const uint32_t last = (address + 3) / 4;
+        for (uint32_t i = first; i <= last; ++i)
         {
-            std::stringstream ss;
-            ss << "Register " << static_cast<unsigned>(reg) << " is not an integer register";
-            throw std::runtime_error(ss.str());
+            const DecodedInst *page = decoded_pages_[i >> DECODE_PAGE_SHIFT];
+            if (page && page[i & (DECODE_PAGE_WORDS - 1)].op != DecodedOp::Undecoded)
+                decoded_page(i)[i & (DECODE_PAGE_WORDS - 1)].op = DecodedOp::Undecoded;
         }
     }
 
-    // 验证浮点寄存器
-    void validate_float_register(Reg reg)
+    ASIMOVVM::DecodedInst *ASIMOVVM::decoded_page(uint32_t index)
     {
-        if (!is_float_register(reg))
+        const size_t p = index >> DECODE_PAGE_SHIFT;
+        if (!owned_pages_[p])
         {
-            std::stringstream ss;
-            ss << "Register " << static_cast<unsigned>(reg) << " is not a float register";
-            throw std::runtime_error(ss.str());
+            owned_pages_[p] = std::make_unique<DecodedInst[]>(DECODE_PAGE_WORDS);
+            if (decoded_pages_[p])
+                std::copy(decoded_pages_[p], decoded_pages_[p] + DECODE_PAGE_WORDS, owned_pages_[p].get());
+            decoded_pages_[p] = owned_pages_[p].get();
         }
+        return decoded_pages_[p];
     }
 
-    void ASIMOVVM::execute_instruction(uint32_t instruction)
+    void ASIMOVVM::decode(uint32_t index)
     {
-        Opcode opcode = static_cast<Opcode>((instruction >> 24) & 0xFF);
-        MO_DEBUG("Executing instruction: %s", opcode_to_str(opcode));
-        switch (opcode)
-        {
-        case ADD:
+        DecodedInst inst = decode_word(index);
+        switch (inst.op)
         {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
-
-            validate_int_register(rd_reg);
-            validate_int_register(rs1_reg);
-            validate_int_register(rs2_reg);
-
-            int32_t val1 = read_register(rs1_reg);
-            int32_t val2 = read_register(rs2_reg);
-            write_register(rd_reg, val1 + val2);
+        case DecodedOp::Add:
+        case DecodedOp::Sub:
+        case DecodedOp::Load:
+            if (memory_.in_range((index + 1) * 4))
+                fuse(inst, decode_word(index + 1));
             break;
-        }
-        case SUB:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
-
-            validate_int_register(rd_reg);
-            validate_int_register(rs1_reg);
-            validate_int_register(rs2_reg);
-
-            int32_t val1 = read_register(rs1_reg);
-            int32_t val2 = read_register(rs2_reg);
-            write_register(rd_reg, val1 - val2);
+        default:
             break;
         }
-        case MUL:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
-
-            validate_int_register(rd_reg);
-            validate_int_register(rs1_reg);
-            validate_int_register(rs2_reg);
+        decoded_page(index)[index & (DECODE_PAGE_WORDS - 1)] = inst;
+    }
 
-            int32_t val1 = read_register(rs1_reg);
-            int32_t val2 = read_register(rs2_reg);
-            write_register(rd_reg, val1 * val2);
+    void ASIMOVVM::fuse(DecodedInst &first, const DecodedInst &next)
+    {
+        const bool add = first.op == DecodedOp::Add;
+        switch (next.op)
+        {
+        case DecodedOp::Jz:
+        case DecodedOp::Jnz:
+            // 算术后紧跟的条件跳转，通常是循环计数器的递减和回跳
+            if (first.op == DecodedOp::Load)
+                return;
+            if (next.op == DecodedOp::Jz)
+                first.op = add ? DecodedOp::AddJz : DecodedOp::SubJz;
+            else
+                first.op = add ? DecodedOp::AddJnz : DecodedOp::SubJnz;
+            first.x1 = next.rd;
+            first.imm = next.imm;
+            break;
+        case DecodedOp::Add:
+            if (first.op != DecodedOp::Load)
+                return;
+            first.op = DecodedOp::LoadAdd;
+            first.x1 = next.rd;
+            first.x2 = next.rs1;
+            first.x3 = next.rs2;
+            break;
+        case DecodedOp::Store:
+            if (!add)
+                return;
+            first.op = DecodedOp::AddStore;
+            first.x1 = next.rd;
+            first.x2 = next.rs1;
+            first.imm = next.imm;
+            break;
+        default:
             break;
         }
-        case DIV:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
+    }
 
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
+    ASIMOVVM::DecodedInst ASIMOVVM::decode_word(uint32_t index)
+    {
+        const uint32_t address = index * 4;
+        const uint32_t instruction = read_memory(address);
+        const Opcode opcode = static_cast<Opcode>((instruction >> 24) & 0xFF);
 
-            validate_int_register(rd_reg);
-            validate_int_register(rs1_reg);
-            validate_int_register(rs2_reg);
+        DecodedInst inst;
+        inst.rd = (instruction >> 16) & 0xFF;
+        inst.rs1 = (instruction >> 8) & 0xFF;
+        inst.rs2 = instruction & 0xFF;
 
-            int32_t val1 = read_register(rs1_reg);
-            int32_t val2 = read_register(rs2_reg);
-            if (val2 == 0)
+        // 按旧解释器的顺序校验，第一个出错的寄存器决定错误信息
+        auto int_regs = [&](std::initializer_list<unsigned> regs)
+        {
+            for (unsigned reg : regs)
             {
-                std::cerr << "Division by zero!" << std::endl;
-                break;
+                if (!is_int_register(static_cast<Reg>(reg)))
+                {
+                    trap(inst, register_error(reg, "an integer"));
+                    return false;
+                }
             }
-            write_register(rd_reg, val1 / val2);
-            break;
-        }
-        case FADD:
+            return true;
+        };
+        auto float_regs = [&]()
         {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
-
-            validate_float_register(rd_reg);
-            validate_float_register(rs1_reg);
-            validate_float_register(rs2_reg);
-
-            uint32_t v1 = read_register(rs1_reg);
-            float val1 = *reinterpret_cast<float *>(&v1);
-            uint32_t v2 = read_register(rs2_reg);
-            float val2 = *reinterpret_cast<float *>(&v2);
-            float result = val1 + val2;
-            write_register(rd_reg, *reinterpret_cast<uint32_t *>(&result));
-            break;
-        }
-        case FSUB:
+            for (unsigned reg : {inst.rd, inst.rs1, inst.rs2})
+            {
+                if (!is_float_register(static_cast<Reg>(reg)))
+                {
+                    trap(inst, register_error(reg, "a float"));
+                    return false;
+                }
+            }
+            return true;
+        };
+        auto jump_target = [&](uint32_t target, const char *name)
         {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
-
-            validate_float_register(rd_reg);
-            validate_float_register(rs1_reg);
-            validate_float_register(rs2_reg);
-
-            uint32_t v1 = read_register(rs1_reg);
-            float val1 = *reinterpret_cast<float *>(&v1);
-            uint32_t v2 = read_register(rs2_reg);
-            float val2 = *reinterpret_cast<float *>(&v2);
-            float result = val1 - val2;
-            write_register(rd_reg, *reinterpret_cast<uint32_t *>(&result));
-            break;
-        }
-        case FMUL:
+            if (target % 4 != 0)
+            {
+                trap(inst, std::string(name) + " target must be a multiple of 4");
+                return;
+            }
+            inst.imm = static_cast<int32_t>(target / 4);
+        };
+
+        switch (opcode)
         {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
-
-            validate_float_register(rd_reg);
-            validate_float_register(rs1_reg);
-            validate_float_register(rs2_reg);
-
-            uint32_t v1 = read_register(rs1_reg);
-            float val1 = *reinterpret_cast<float *>(&v1);
-            uint32_t v2 = read_register(rs2_reg);
-            float val2 = *reinterpret_cast<float *>(&v2);
-            float result = val1 * val2;
-            write_register(rd_reg, *reinterpret_cast<uint32_t *>(&result));
+        case ADD:
+        case SUB:
+        case MUL:
+        case DIV:
+            inst.op = static_cast<DecodedOp>(static_cast<unsigned>(DecodedOp::Add) + (opcode - ADD));
+            int_regs({inst.rd, inst.rs1, inst.rs2});
             break;
-        }
+        case FADD:
+        case FSUB:
+        case FMUL:
         case FDIV:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-            unsigned rs2 = instruction & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            Reg rs2_reg = static_cast<Reg>(rs2);
-
-            validate_float_register(rd_reg);
-            validate_float_register(rs1_reg);
-            validate_float_register(rs2_reg);
-
-            uint32_t v1 = read_register(rs1_reg);
-            float val1 = *reinterpret_cast<float *>(&v1);
-            uint32_t v2 = read_register(rs2_reg);
-            float val2 = *reinterpret_cast<float *>(&v2);
-            if (val2 == 0.0f)
-            {
-                std::cerr << "Division by zero!" << std::endl;
-                break;
-            }
-            float result = val1 / val2;
-            write_register(rd_reg, *reinterpret_cast<uint32_t *>(&result));
+            inst.op = static_cast<DecodedOp>(static_cast<unsigned>(DecodedOp::FAdd) + (opcode - FADD));
+            float_regs();
             break;
-        }
         case MOVW:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            Reg rd_reg = static_cast<Reg>(rd);
-            validate_int_register(rd_reg);
-
-            int32_t imm = instruction & 0xFFFF;
-            write_register(rd_reg, imm);
+            inst.op = DecodedOp::Movw;
+            inst.imm = instruction & 0xFFFF;
+            int_regs({inst.rd});
             break;
-        }
         case MOVD:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            Reg rd_reg = static_cast<Reg>(rd);
-
-            uint32_t imm = read_memory(pc_ + 4);
-            // 直接存储原始32位值到寄存器
-            write_register(rd_reg, imm);
-            pc_ += 4; // 跳过立即数字
+            inst.op = DecodedOp::Movd;
+            if (inst.rd >= static_cast<unsigned>(Reg::TOTAL_REG))
+                trap(inst, register_error(inst.rd, "a"));
+            else if (address + 8 > memory_size_)
+                trap(inst, read_error(address + 4));
+            else
+                inst.imm = static_cast<int32_t>(read_memory(address + 4));
             break;
-        }
         case LOAD:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-
-            validate_int_register(rd_reg);
-            validate_int_register(rs1_reg);
-
-            int32_t offset = instruction & 0xFF;
-            int32_t address = read_register(rs1_reg) + offset;
-            int32_t value = read_memory(address);
-            write_register(rd_reg, value);
-            break;
-        }
         case STORE:
-        {
-            unsigned rd = (instruction >> 16) & 0xFF;
-            unsigned rs1 = (instruction >> 8) & 0xFF;
-
-            Reg rd_reg = static_cast<Reg>(rd);
-            Reg rs1_reg = static_cast<Reg>(rs1);
-
-            validate_int_register(rd_reg);
-            validate_int_register(rs1_reg);
-
-            int32_t offset = instruction & 0xFF;
-            int32_t address = read_register(rs1_reg) + offset;
-            int32_t value = read_register(rd_reg);
-            write_memory(address, value);
+            inst.op = opcode == LOAD ? DecodedOp::Load : DecodedOp::Store;
+            inst.imm = instruction & 0xFF;
+            int_regs({inst.rd, inst.rs1});
             break;
-        }
         case JMP:
-        {
-            int32_t target = instruction & 0xFFFFFF;
-            if (target % 4 != 0)
-            {
-                throw std::runtime_error("JMP target must be a multiple of 4");
-            }
-            pc_ = target - 4; // 下一次循环会 +4
+            inst.op = DecodedOp::Jmp;
+            jump_target(instruction & 0xFFFFFF, "JMP");
             break;
-        }
         case JZ:
-        {
-            unsigned rs1 = (instruction >> 16) & 0xFF;
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            validate_int_register(rs1_reg);
-
-            int32_t target = instruction & 0xFFFF;
-            if (target % 4 != 0)
-            {
-                throw std::runtime_error("JZ target must be a multiple of 4");
-            }
-            if (read_register(rs1_reg) == 0)
-            {
-                pc_ = target - 4; // 下一次循环会 +4
-            }
-            break;
-        }
         case JNZ:
-        {
-            unsigned rs1 = (instruction >> 16) & 0xFF;
-            Reg rs1_reg = static_cast<Reg>(rs1);
-            validate_int_register(rs1_reg);
-
-            int32_t target = instruction & 0xFFFF;
-            if (target % 4 != 0)
-            {
-                throw std::runtime_error("JNZ target must be a multiple of 4");
-            }
-            if (read_register(rs1_reg) != 0)
-            {
-                pc_ = target - 4; // 下一次循环会 +4
-            }
+            inst.op = opcode == JZ ? DecodedOp::Jz : DecodedOp::Jnz;
+            if (int_regs({inst.rd}))
+                jump_target(instruction & 0xFFFF, opcode == JZ ? "JZ" : "JNZ");
             break;
-        }
         case HALT:
-            return;
+            // 只有全 1 的字才停机，其余 HALT 编码什么也不做
+            inst.op = instruction == 0xFFFFFFFF ? DecodedOp::Halt : DecodedOp::Nop;
+            break;
         case RET:
-            MO_ERROR("Pseudo-instruction RET should not be executed");
-            return;
+            inst.op = DecodedOp::Ret;
+            break;
         default:
-            std::cerr << "Unknown opcode: " << std::hex << opcode << "H"
-                      << std::dec << "(" << opcode << ")" << std::endl;
-            MO_UNREACHABLE();
+            inst.op = DecodedOp::Unknown;
+            inst.imm = opcode;
             break;
         }
+        return inst;
     }
 
-    uint32_t ASIMOVVM::read_memory(uint32_t address) const
+    // GCC/Clang 用 computed goto 直接跳到下一条指令的处理例程，
+    // 其他编译器退回到 switch 分派
+#if defined(__GNUC__)
+#define ASIMOV_VM_THREADED 1
+#endif
+
+    // 每个解码项执行的原始指令：操作码和（融合时）第二条的操作码，-1 表示没有
+    static constexpr std::array<std::pair<int, int>, 27> PROFILE_OPCODES = {{
+        {-1, -1},       // Undecoded
+        {ADD, -1},      // Add
+        {SUB, -1},      // Sub
+        {MUL, -1},      // Mul
+        {DIV, -1},      // Div
+        {FADD, -1},     // FAdd
+        {FSUB, -1},     // FSub
+        {FMUL, -1},     // FMul
+        {FDIV, -1},     // FDiv
+        {MOVW, -1},     // Movw
+        {MOVD, -1},     // Movd
+        {LOAD, -1},     // Load
+        {STORE, -1},    // Store
+        {JMP, -1},      // Jmp
+        {JZ, -1},       // Jz
+        {JNZ, -1},      // Jnz
+        {HALT, -1},     // Halt
+        {HALT, -1},     // Nop（不是全 1 的 HALT 编码）
+        {RET, -1},      // Ret
+        {-1, -1},       // Trap
+        {-1, -1},       // Unknown
+        {ADD, JZ},      // AddJz
+        {ADD, JNZ},     // AddJnz
+        {SUB, JZ},      // SubJz
+        {SUB, JNZ},     // SubJnz
+        {LOAD, ADD},    // LoadAdd
+        {ADD, STORE},   // AddStore
+    }};
+
+    void ASIMOVVM::profile_step(uint32_t index, const DecodedInst &inst)
     {
-        if (address + 4 > memory_size_)
+        static_assert(PROFILE_OPCODES.size() == static_cast<size_t>(DecodedOp::AddStore) + 1);
+        auto [first, second] = PROFILE_OPCODES[static_cast<unsigned>(inst.op)];
+        if (first >= 0)
+            profile_->record(index * 4, first);
+        if (second >= 0)
+            profile_->record((index + 1) * 4, second);
+    }
+
+    void ASIMOVVM::run(uint32_t start_address)
+    {
+        if (start_address % 4 != 0)
         {
+            throw std::runtime_error("Start address must be a multiple of 4");
+        }
+        pc_ = start_address;
+
+        MO_DEBUG("Starting execution at PC=0x%08X", start_address);
+        if (profile_)
+            run_loop<true>(start_address);
+        else
+            run_loop<false>(start_address);
+    }
+
+    template <bool Profile>
+    void ASIMOVVM::run_loop(uint32_t start_address)
+    {
+        const uint32_t memory_words = static_cast<uint32_t>(memory_size_ / 4);
+        if (start_address / 4 >= memory_words)
+        {
+            read_memory(start_address); // 抛出越界异常
+        }
+
+        // 当前解码页覆盖 [base, base + num_words)，页内的转移不查页表
+        uint32_t index = start_address / 4;
+        uint32_t base = index & ~(DECODE_PAGE_WORDS - 1);
+        DecodedInst *code = code_page(index);
+        uint32_t num_words = std::min(DECODE_PAGE_WORDS, memory_words - base);
+        int32_t *const regs = registers_.data();
+        const DecodedInst *inst = nullptr;
+
+#ifdef ASIMOV_VM_THREADED
+        static const void *const handlers[] = {
+            &&op_Undecoded, &&op_Add, &&op_Sub, &&op_Mul, &&op_Div,
+            &&op_FAdd, &&op_FSub, &&op_FMul, &&op_FDiv, &&op_Movw,
+            &&op_Movd, &&op_Load, &&op_Store, &&op_Jmp, &&op_Jz,
+            &&op_Jnz, &&op_Halt, &&op_Nop, &&op_Ret, &&op_Trap,
+            &&op_Unknown, &&op_AddJz, &&op_AddJnz, &&op_SubJz, &&op_SubJnz,
+            &&op_LoadAdd, &&op_AddStore,
+        };
+        static_assert(sizeof(handlers) / sizeof(handlers[0]) == static_cast<size_t>(DecodedOp::AddStore) + 1);
+#define VM_OP(name) op_##name
+#define VM_DISPATCH()                                          \
+    do                                                         \
+    {                                                          \
+        if constexpr (Profile)                                 \
+            profile_step(index, *inst);                        \
+        goto *handlers[static_cast<unsigned>(inst->op)];       \
+    } while (0)
+#else
+#define VM_OP(name) case DecodedOp::name
+#define VM_DISPATCH() goto dispatch
+#endif
+        // 执行完最后一个内存字就停止，越界的跳转目标在取指时报错
+#define VM_NEXT(target)                   \
+    do                                    \
+    {                                     \
+        index = (target);                 \
+        if (index - base >= num_words)    \
+            goto out_of_code;             \
+        inst = &code[index - base];       \
+        VM_DISPATCH();                    \
+    } while (0)
+
+        inst = &code[index - base];
+#ifdef ASIMOV_VM_THREADED
+        VM_DISPATCH();
+#else
+    dispatch:
+        if constexpr (Profile)
+            profile_step(index, *inst);
+        switch (inst->op)
+        {
+#endif
+        VM_OP(Undecoded):
+            decode(index);
+            code = decoded_pages_[index >> DECODE_PAGE_SHIFT]; // 共享页可能已被复制
+            inst = &code[index - base];
+            VM_DISPATCH();
+        VM_OP(Add):
+            regs[inst->rd] = regs[inst->rs1] + regs[inst->rs2];
+            VM_NEXT(index + 1);
+        VM_OP(Sub):
+            regs[inst->rd] = regs[inst->rs1] - regs[inst->rs2];
+            VM_NEXT(index + 1);
+        VM_OP(Mul):
+            regs[inst->rd] = regs[inst->rs1] * regs[inst->rs2];
+            VM_NEXT(index + 1);
+        VM_OP(Div):
+            if (regs[inst->rs2] == 0)
+                *diagnostics_ << "Division by zero!" << std::endl;
+            else
+                regs[inst->rd] = regs[inst->rs1] / regs[inst->rs2];
+            VM_NEXT(index + 1);
+        VM_OP(FAdd):
+            regs[inst->rd] = std::bit_cast<int32_t>(std::bit_cast<float>(regs[inst->rs1]) + std::bit_cast<float>(regs[inst->rs2]));
+            VM_NEXT(index + 1);
+        VM_OP(FSub):
+            regs[inst->rd] = std::bit_cast<int32_t>(std::bit_cast<float>(regs[inst->rs1]) - std::bit_cast<float>(regs[inst->rs2]));
+            VM_NEXT(index + 1);
+        VM_OP(FMul):
+            regs[inst->rd] = std::bit_cast<int32_t>(std::bit_cast<float>(regs[inst->rs1]) * std::bit_cast<float>(regs[inst->rs2]));
+            VM_NEXT(index + 1);
+        VM_OP(FDiv):
+            if (std::bit_cast<float>(regs[inst->rs2]) == 0.0f)
+                *diagnostics_ << "Division by zero!" << std::endl;
+            else
+                regs[inst->rd] = std::bit_cast<int32_t>(std::bit_cast<float>(regs[inst->rs1]) / std::bit_cast<float>(regs[inst->rs2]));
+            VM_NEXT(index + 1);
+        VM_OP(Movw):
+            regs[inst->rd] = inst->imm;
+            VM_NEXT(index + 1);
+        VM_OP(Movd):
+            regs[inst->rd] = inst->imm;
+            VM_NEXT(index + 2); // 跳过立即数字
+        VM_OP(Load):
+            if constexpr (Profile)
+                profile_->record_load();
+            regs[inst->rd] = static_cast<int32_t>(read_memory(static_cast<uint32_t>(regs[inst->rs1] + inst->imm)));
+            VM_NEXT(index + 1);
+        VM_OP(Store):
+            if constexpr (Profile)
+                profile_->record_store();
+            // 可能改写 code 中的项（自修改代码），之后不再读 inst
+            write_memory(static_cast<uint32_t>(regs[inst->rs1] + inst->imm), regs[inst->rd]);
+            code = decoded_pages_[base >> DECODE_PAGE_SHIFT];
+            VM_NEXT(index + 1);
+        VM_OP(Jmp):
+            VM_NEXT(static_cast<uint32_t>(inst->imm));
+        VM_OP(Jz):
+            if constexpr (Profile)
+                profile_->record_branch(index * 4, regs[inst->rd] == 0);
+            VM_NEXT(regs[inst->rd] == 0 ? static_cast<uint32_t>(inst->imm) : index + 1);
+        VM_OP(Jnz):
+            if constexpr (Profile)
+                profile_->record_branch(index * 4, regs[inst->rd] != 0);
+            VM_NEXT(regs[inst->rd] != 0 ? static_cast<uint32_t>(inst->imm) : index + 1);
+        VM_OP(Halt):
+            pc_ = index * 4;
+            return;
+        VM_OP(Nop):
+            VM_NEXT(index + 1);
+        VM_OP(Ret):
+            MO_ERROR("Pseudo-instruction RET should not be executed");
+            VM_NEXT(index + 1);
+        VM_OP(Trap):
+            pc_ = index * 4;
+            throw std::runtime_error(decode_errors_[inst->imm]);
+        VM_OP(Unknown):
+        {
+            pc_ = index * 4;
             std::stringstream ss;
-            ss << "Memory address " << std::hex << address << "H (" << std::dec
-               << address << ") cannot be read (out of range)";
-            MO_ERROR(ss.str().c_str());
+            ss << "Unknown opcode: " << std::hex << inst->imm << "H"
+               << std::dec << "(" << inst->imm << ")";
             throw std::runtime_error(ss.str());
         }
+        VM_OP(AddJz):
+            regs[inst->rd] = regs[inst->rs1] + regs[inst->rs2];
+            if constexpr (Profile)
+                profile_->record_branch((index + 1) * 4, regs[inst->x1] == 0);
+            VM_NEXT(regs[inst->x1] == 0 ? static_cast<uint32_t>(inst->imm) : index + 2);
+        VM_OP(AddJnz):
+            regs[inst->rd] = regs[inst->rs1] + regs[inst->rs2];
+            if constexpr (Profile)
+                profile_->record_branch((index + 1) * 4, regs[inst->x1] != 0);
+            VM_NEXT(regs[inst->x1] != 0 ? static_cast<uint32_t>(inst->imm) : index + 2);
+        VM_OP(SubJz):
+            regs[inst->rd] = regs[inst->rs1] - regs[inst->rs2];
+            if constexpr (Profile)
+                profile_->record_branch((index + 1) * 4, regs[inst->x1] == 0);
+            VM_NEXT(regs[inst->x1] == 0 ? static_cast<uint32_t>(inst->imm) : index + 2);
+        VM_OP(SubJnz):
+            regs[inst->rd] = regs[inst->rs1] - regs[inst->rs2];
+            if constexpr (Profile)
+                profile_->record_branch((index + 1) * 4, regs[inst->x1] != 0);
+            VM_NEXT(regs[inst->x1] != 0 ? static_cast<uint32_t>(inst->imm) : index + 2);
+        VM_OP(LoadAdd):
+            if constexpr (Profile)
+                profile_->record_load();
+            regs[inst->rd] = static_cast<int32_t>(read_memory(static_cast<uint32_t>(regs[inst->rs1] + inst->imm)));
+            regs[inst->x1] = regs[inst->x2] + regs[inst->x3];
+            VM_NEXT(index + 2);
+        VM_OP(AddStore):
+            if constexpr (Profile)
+                profile_->record_store();
+            regs[inst->rd] = regs[inst->rs1] + regs[inst->rs2];
+            write_memory(static_cast<uint32_t>(regs[inst->x2] + inst->imm), regs[inst->x1]);
+            code = decoded_pages_[base >> DECODE_PAGE_SHIFT];
+            VM_NEXT(index + 2);
+#ifndef ASIMOV_VM_THREADED
+        }
+#endif
 
-        return (memory_[address] << 24) | (memory_[address + 1] << 16) |
-               (memory_[address + 2] << 8) | memory_[address + 3];
+    out_of_code:
+        if (index < memory_words)
+        {
+            base = index & ~(DECODE_PAGE_WORDS - 1);
+            code = code_page(index);
+            num_words = std::min(DECODE_PAGE_WORDS, memory_words - base);
+            inst = &code[index - base];
+            VM_DISPATCH();
+        }
+        if (index == memory_words)
+        {
+            pc_ = memory_size_ - 4;
+            MO_WARN("PC overflowed, stopping execution");
+            return;
+        }
+        pc_ = index * 4;
+        read_memory(pc_); // 抛出越界异常
+
+#undef VM_NEXT
+#undef VM_DISPATCH
+#undef VM_OP
+    }
+
+    uint32_t ASIMOVVM::read_memory(uint32_t address) const
+    {
+        if (!memory_.in_range(address)) [[unlikely]]
+        {
+            std::string message = read_error(address);
+            MO_ERROR(message.c_str());
+            throw std::runtime_error(message);
+        }
+        return memory_.read(address);
     }
 
     void ASIMOVVM::write_memory(uint32_t address, uint32_t value)
     {
-        if (address + 4 > memory_size_)
+        if (!memory_.in_range(address)) [[unlikely]]
         {
             std::stringstream ss;
             ss << "Memory address " << std::hex << "H (" << std::dec
@@ -417,10 +591,8 @@ namespace ASIMOV
             throw std::runtime_error(ss.str());
         }
 
-        memory_[address] = (value >> 24) & 0xFF;
-        memory_[address + 1] = (value >> 16) & 0xFF;
-        memory_[address + 2] = (value >> 8) & 0xFF;
-        memory_[address + 3] = value & 0xFF;
+        memory_.write(address, value);
+        invalidate_decoded(address);
     }
 
     int32_t ASIMOVVM::read_register(Reg reg) const
@@ -433,24 +605,24 @@ namespace ASIMOV
         registers_[reg] = value;
     }
 
-    void ASIMOVVM::dump_registers() const
+    void ASIMOVVM::dump_registers(std::ostream &os) const
     {
-        std::cout << "Registers:" << std::endl;
+        os << "Registers:" << std::endl;
         for (int i = 0; i < static_cast<int>(Reg::TOTAL_REG); ++i)
         {
-            std::cout << "R" << i << ": " << registers_[i] << std::endl;
+            os << "R" << i << ": " << registers_[i] << std::endl;
         }
     }
 
-    void ASIMOVVM::dump_memory(uint32_t start_address, size_t size) const
+    void ASIMOVVM::dump_memory(uint32_t start_address, size_t size, std::ostream &os) const
     {
-        std::cout << "Memory from " << start_address << " to " << start_address + size << ":" << std::endl;
+        os << "Memory from " << start_address << " to " << start_address + size << ":" << std::endl;
         for (size_t i = 0; i < size; ++i)
         {
-            std::cout << std::hex << (int)memory_[start_address + i] << " ";
+            os << std::hex << (int)memory_.read_byte(start_address + i) << " ";
         }
 
-        std::cout << std::endl;
+        os << std::endl;
     }
 
 } // namespace ASIMOV
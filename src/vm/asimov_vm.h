@@ -1,35 +1,140 @@
 #ifndef ASIMOV_VM_H
 #define ASIMOV_VM_H
 
+#include "../targets/asimov_image.h"
 #include "../targets/asimov_target.h"
+#include "asimov_memory.h"
+#include "asimov_profile.h"
 #include <array>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace ASIMOV
 {
+    class ASIMOVProgram;
+
     class ASIMOVVM
     {
         friend class ASIMOVVMTest;
+        friend class ASIMOVProgram;
     public:
-        ASIMOVVM(size_t memory_size = 4096); // 默认内存大小为4K字节
+        // 默认内存大小为4K字节；超过 ASIMOVMemory::DENSE_LIMIT 的内存按页懒分配
+        ASIMOVVM(size_t memory_size = 4096);
+        // 装载共享的预解码程序：内存是自己的，解码页与其他实例共享，
+        // 直到本实例改写了页内的代码才复制一份
+        explicit ASIMOVVM(std::shared_ptr<const ASIMOVProgram> program);
         ~ASIMOVVM() {}
 
         void load_program(const std::vector<uint32_t> &program, uint32_t start_address = 0);
+        // 按 load_address 重定位后装入映像，并让栈指针 R7 指向内存末端，
+        // 返回入口地址；重定位失败时抛出异常
+        uint32_t load_image(const ASIMOVImage &image, uint32_t load_address);
         void run(uint32_t start_address = 0);
 
+        const std::array<int32_t, Reg::TOTAL_REG> &registers() const { return registers_; }
+        void set_register(Reg reg, int32_t value) { write_register(reg, value); }
+        uint32_t load_word(uint32_t address) const { return read_memory(address); }
+        void store_word(uint32_t address, uint32_t value) { write_memory(address, value); }
+
+        // 除零等运行时诊断的输出流，默认 std::cerr
+        void set_diagnostics(std::ostream &os) { diagnostics_ = &os; }
+        // 挂上剖析数据后 run 走带计数的解释循环，nullptr 关闭；
+        // 不剖析时用的循环里没有任何计数代码
+        void set_profile(ASIMOVProfile *profile) { profile_ = profile; }
+
         // 调试辅助函数
-        void dump_registers() const;
-        void dump_memory(uint32_t start_address, size_t size) const;
+        void dump_registers(std::ostream &os = std::cout) const;
+        void dump_memory(uint32_t start_address, size_t size, std::ostream &os = std::cout) const;
 
     private:
         size_t memory_size_;
-        std::vector<uint8_t> memory_;
+        ASIMOVMemory memory_;
 
         std::array<int32_t, Reg::TOTAL_REG> registers_;
 
         uint32_t pc_;
-    
-        void execute_instruction(uint32_t instruction);
+        std::ostream *diagnostics_ = &std::cerr;
+        ASIMOVProfile *profile_ = nullptr;
+
+        // 预解码后的指令处理例程
+        enum class DecodedOp : uint8_t
+        {
+            Undecoded, // 尚未解码（或所在字被改写），执行时先解码
+            Add,
+            Sub,
+            Mul,
+            Div,
+            FAdd,
+            FSub,
+            FMul,
+            FDiv,
+            Movw,
+            Movd,
+            Load,
+            Store,
+            Jmp,
+            Jz,
+            Jnz,
+            Halt,
+            Nop,
+            Ret,
+            Trap,    // 非法寄存器/跳转目标等，执行时抛出 decode_errors_[imm]
+            Unknown, // 未知操作码
+            // 超级指令：与下一个字融合执行，第二条指令的寄存器放在 x1..x3
+            AddJz,
+            AddJnz,
+            SubJz,
+            SubJnz,
+            LoadAdd,
+            AddStore,
+        };
+
+        // 每个内存字一项，下标为地址 / 4。寄存器在解码时已校验，
+        // 立即数、跳转目标（字下标）和 MOVD 的数据字都放在 imm 中。
+        // 超级指令仍然只占第一个字的项，跳到第二个字时执行它自己的项
+        struct DecodedInst
+        {
+            DecodedOp op = DecodedOp::Undecoded;
+            uint8_t rd = 0;
+            uint8_t rs1 = 0;
+            uint8_t rs2 = 0;
+            uint8_t x1 = 0;
+            uint8_t x2 = 0;
+            uint8_t x3 = 0;
+            int32_t imm = 0;
+        };
+
+        // 按页懒分配，只有执行过的代码所在的页才有解码表。decoded_pages_ 是
+        // 执行时查的页表，可能指向 program_ 的只读页；owned_pages_ 是本实例的页
+        static constexpr unsigned DECODE_PAGE_SHIFT = 12;
+        static constexpr uint32_t DECODE_PAGE_WORDS = 1u << DECODE_PAGE_SHIFT;
+        std::vector<DecodedInst *> decoded_pages_;
+        std::vector<std::unique_ptr<DecodedInst[]>> owned_pages_;
+        std::shared_ptr<const ASIMOVProgram> program_;
+        std::vector<std::string> decode_errors_;
+
+        template <bool Profile>
+        void run_loop(uint32_t start_address);
+        void profile_step(uint32_t index, const DecodedInst &inst);
+
+        void decode(uint32_t index);
+        // 第 index 个字所在的可写解码页，必要时分配或从共享页复制
+        DecodedInst *decoded_page(uint32_t index);
+        // 只用于执行的解码页，共享页直接返回
+        DecodedInst *code_page(uint32_t index)
+        {
+            DecodedInst *page = decoded_pages_[index >> DECODE_PAGE_SHIFT];
+            return page ? page : decoded_page(index);
+        }
+        DecodedInst decode_word(uint32_t index);
+        // 把 next 融合进 first，first 不变则表示这一对不能融合
+        static void fuse(DecodedInst &first, const DecodedInst &next);
+        // 写内存后作废受影响的字，以及可能把它当作 MOVD 数据字的前一个字
+        void invalidate_decoded(uint32_t address);
+        void trap(DecodedInst &inst, std::string message);
 
         uint32_t read_memory(uint32_t address) const;
         void write_memory(uint32_t address, uint32_t value);
@@ -37,6 +142,25 @@ namespace ASIMOV
         void write_register(Reg reg, int32_t value);
     };
 
+    // 装载到某个地址、并已整页预解码的只读程序。多个 ASIMOVVM 实例
+    // （可以在不同线程上）共享同一个 ASIMOVProgram
+    class ASIMOVProgram
+    {
+    public:
+        ASIMOVProgram(std::vector<uint32_t> words, uint32_t load_address = 0, size_t memory_size = 4096);
+
+        const std::vector<uint32_t> &words() const { return words_; }
+        uint32_t load_address() const { return load_address_; }
+        size_t memory_size() const { return image_.memory_size_; }
+
+    private:
+        friend class ASIMOVVM;
+
+        std::vector<uint32_t> words_;
+        uint32_t load_address_;
+        ASIMOVVM image_; // 装载并解码好的映像，构造后不再改动
+    };
+
 } // namespace ASIMOV
 
 #endif // ASIMOV_VM_H
@@ -0,0 +1,117 @@
+// vreg_table.h - Flat tables keyed by virtual register
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// Registers numbered below this are physical, the rest virtual
+constexpr unsigned FIRST_VIRT_REG = 1000;
+
+//===----------------------------------------------------------------------===//
+//                             VRegTable
+//===----------------------------------------------------------------------===//
+
+// One slot per virtual register, at vreg - FIRST_VIRT_REG, holding EMPTY
+// where nothing has been recorded. Functions number their vregs densely, so
+// a lookup is an index and the table is as long as the highest vreg seen.
+// Iterating visits the recorded (vreg, value) pairs in vreg order.
+template <typename T, T EMPTY>
+class VRegTable
+{
+public:
+    static constexpr T EMPTY_SLOT = EMPTY;
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<unsigned, T>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        const_iterator(const std::vector<T> *slots, size_t index) : slots_(slots), index_(index) { skip_empty(); }
+
+        value_type operator*() const { return {FIRST_VIRT_REG + static_cast<unsigned>(index_), (*slots_)[index_]}; }
+        const_iterator &operator++()
+        {
+            ++index_;
+            skip_empty();
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            ++*this;
+            return old;
+        }
+        bool operator==(const const_iterator &other) const { return index_ == other.index_; }
+        bool operator!=(const const_iterator &other) const { return index_ != other.index_; }
+
+    private:
+        void skip_empty()
+        {
+            while (index_ < slots_->size() && (*slots_)[index_] == EMPTY)
+                ++index_;
+        }
+
+        const std::vector<T> *slots_;
+        size_t index_;
+    };
+
+    bool contains(unsigned vreg) const
+    {
+        const size_t index = vreg - FIRST_VIRT_REG;
+        return vreg >= FIRST_VIRT_REG && index < slots_.size() && slots_[index] != EMPTY;
+    }
+    size_t count(unsigned vreg) const { return contains(vreg); }
+
+    // The recorded value, or EMPTY
+    T lookup(unsigned vreg) const { return contains(vreg) ? slots_[vreg - FIRST_VIRT_REG] : EMPTY; }
+    T at(unsigned vreg) const
+    {
+        if (!contains(vreg))
+            throw std::out_of_range("vreg has no entry");
+        return slots_[vreg - FIRST_VIRT_REG];
+    }
+
+    void set(unsigned vreg, T value)
+    {
+        const size_t index = vreg - FIRST_VIRT_REG;
+        if (index >= slots_.size())
+            slots_.resize(index + 1, EMPTY);
+        if (slots_[index] == EMPTY && value != EMPTY)
+            ++size_;
+        else if (slots_[index] != EMPTY && value == EMPTY)
+            --size_;
+        slots_[index] = value;
+    }
+    void erase(unsigned vreg)
+    {
+        if (contains(vreg))
+            set(vreg, EMPTY);
+    }
+    void clear()
+    {
+        slots_.clear();
+        size_ = 0;
+    }
+
+    // Entries recorded
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    // Every slot, EMPTY ones included, for passes that index it themselves
+    std::span<const T> slots() const { return slots_; }
+
+    const_iterator begin() const { return {&slots_, 0}; }
+    const_iterator end() const { return {&slots_, slots_.size()}; }
+
+private:
+    std::vector<T> slots_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,106 @@
+#include <gtest/gtest.h>
+
+#include "src/thread_pool.h"
+#include "src/vm/asimov_batch.h"
+
+namespace ASIMOV
+{
+
+    static uint32_t r_type(Opcode op, unsigned rd, unsigned rs1, unsigned rs2)
+    {
+        return (op << 24) | (rd << 16) | (rs1 << 8) | rs2;
+    }
+    static uint32_t movw(unsigned rd, unsigned imm) { return (MOVW << 24) | (rd << 16) | (imm & 0xFFFF); }
+    static uint32_t mem(Opcode op, unsigned rd, unsigned rs1, unsigned offset)
+    {
+        return (op << 24) | (rd << 16) | (rs1 << 8) | (offset & 0xFF);
+    }
+    static uint32_t jnz(unsigned rs, unsigned target) { return (JNZ << 24) | (rs << 16) | (target & 0xFFFF); }
+    static constexpr uint32_t HALT_WORD = 0xFFFFFFFF;
+
+    // R0 = [R1] + [R1 + 4] + ... 共 R2 个字，结果再写回 [R1 + 4 * R2]
+    static std::shared_ptr<const ASIMOVProgram> sum_program()
+    {
+        return std::make_shared<const ASIMOVProgram>(std::vector<uint32_t>{
+            movw(R0, 0),              // 0
+            movw(R3, 1),              // 4
+            movw(R4, 4),              // 8
+            mem(LOAD, R6, R1, 0),     // 12: 循环
+            r_type(ADD, R0, R0, R6),  // 16
+            r_type(ADD, R1, R1, R4),  // 20
+            r_type(SUB, R2, R2, R3),  // 24
+            jnz(R2, 12),              // 28
+            mem(STORE, R0, R1, 0),    // 32
+            HALT_WORD,
+        });
+    }
+
+    static ASIMOVJob sum_job(std::shared_ptr<const ASIMOVProgram> program, unsigned n)
+    {
+        ASIMOVJob job;
+        job.program = std::move(program);
+        job.registers = {{R1, 512}, {R2, static_cast<int32_t>(n)}};
+        for (unsigned i = 0; i < n; ++i)
+            job.memory.emplace_back(512 + i * 4, i + 1);
+        job.dumps = {{512 + n * 4, 1}};
+        return job;
+    }
+
+    TEST(ASIMOVBatchTest, ParallelJobsAreIsolated)
+    {
+        auto program = sum_program();
+        std::vector<ASIMOVJob> jobs;
+        for (unsigned n = 1; n <= 64; ++n)
+            jobs.push_back(sum_job(program, n));
+
+        // 越界的数据地址只让这一个任务失败
+        ASIMOVJob bad = sum_job(program, 1);
+        bad.registers[0].second = 8192;
+        bad.memory.clear();
+        jobs.push_back(bad);
+
+        // 改写自己的代码：第二个 ADD 变成 SUB，不影响共享同一程序的其他任务
+        ASIMOVJob patched = sum_job(program, 3);
+        patched.memory.emplace_back(16, r_type(SUB, R0, R0, R6));
+        jobs.push_back(patched);
+
+        ThreadPool pool(4);
+        auto parallel = run_jobs(jobs, &pool);
+        auto serial = run_jobs(jobs);
+        ASSERT_EQ(parallel.size(), jobs.size());
+        for (unsigned n = 1; n <= 64; ++n)
+        {
+            const auto &result = parallel[n - 1];
+            ASSERT_TRUE(result.successful) << result.error_message;
+            EXPECT_EQ(result.registers[R0], static_cast<int32_t>(n * (n + 1) / 2));
+            ASSERT_EQ(result.dumps.size(), 1u);
+            EXPECT_EQ(result.dumps[0], std::vector<uint32_t>{n * (n + 1) / 2});
+            EXPECT_EQ(result.registers, serial[n - 1].registers);
+        }
+        EXPECT_FALSE(parallel[64].successful);
+        EXPECT_NE(parallel[64].error_message.find("out of range"), std::string::npos);
+        ASSERT_TRUE(parallel[65].successful);
+        EXPECT_EQ(parallel[65].registers[R0], -6);
+    }
+
+    TEST(ASIMOVBatchTest, CapturesDiagnosticsPerJob)
+    {
+        auto program = std::make_shared<const ASIMOVProgram>(std::vector<uint32_t>{
+            r_type(DIV, R0, R1, R2), // R2 为 0 时只输出诊断
+            HALT_WORD,
+        });
+        std::vector<ASIMOVJob> jobs(2);
+        jobs[0].program = program;
+        jobs[0].registers = {{R1, 6}, {R2, 0}};
+        jobs[1].program = program;
+        jobs[1].registers = {{R1, 6}, {R2, 3}};
+
+        auto results = run_jobs(jobs);
+        ASSERT_TRUE(results[0].successful);
+        EXPECT_EQ(results[0].output, "Division by zero!\n");
+        EXPECT_EQ(results[0].registers[R0], 0);
+        EXPECT_EQ(results[1].output, "");
+        EXPECT_EQ(results[1].registers[R0], 2);
+    }
+
+} // namespace ASIMOV
@@ -0,0 +1,213 @@
+#include <gtest/gtest.h>
+
+#include "src/ir.h"
+#include "src/machine.h"
+#include "src/targets/asimov_emitter.h"
+#include "src/targets/asimov_target.h"
+#include "src/vm/asimov_vm.h"
+
+namespace ASIMOV
+{
+    class ASIMOVEmitterTest : public ::testing::Test
+    {
+    protected:
+        ASIMOVRegisterInfo tri_;
+        ASIMOVTargetInstInfo tii_;
+        Module module_;
+        MachineModule mm_{&module_};
+
+        void SetUp() override { mm_.set_target_info(&tri_, &tii_); }
+
+        MachineFunction *function(const std::string &name)
+        {
+            return mm_.create_machine_function(module_.create_function(name, module_.get_void_type(), {}));
+        }
+
+        GlobalVariable *global_int(const std::string &name, uint64_t value)
+        {
+            IntegerType *i32 = module_.get_integer_type(32);
+            return module_.create_global_variable(i32, false, module_.get_constant_int(i32, value), name);
+        }
+
+        static void emit(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+        {
+            bb->append(std::make_unique<MachineInst>(opcode, ops));
+        }
+        static MOperand reg(unsigned r, bool def = false) { return MOperand::create_reg(r, def); }
+        static MOperand imm(int64_t value) { return MOperand::create_imm(value); }
+
+        // R0 = 5 + 4 + 3 + 2 + 1 + g, written back to g
+        MachineFunction *sum_loop(GlobalVariable *g)
+        {
+            MachineFunction *mf = function("main");
+            MachineBasicBlock *entry = mf->create_block("entry");
+            MachineBasicBlock *loop = mf->create_block("loop");
+            MachineBasicBlock *exit = mf->create_block("exit");
+            emit(entry, LI, {reg(R1, true), imm(5)});
+            emit(entry, LI, {reg(R0, true), imm(0)});
+            emit(entry, LI, {reg(R2, true), MOperand::create_global(g)});
+            emit(entry, LOAD, {reg(R3, true), MOperand::create_mem_ri(R2, 0)});
+            emit(loop, ADD, {reg(R0, true), reg(R0), reg(R1)});
+            emit(loop, SUB, {reg(R1, true), reg(R1), imm(1)});
+            emit(loop, JNZ, {reg(R1), MOperand::create_basic_block(loop)});
+            emit(exit, ADD, {reg(R0, true), reg(R0), reg(R3)});
+            emit(exit, STORE, {reg(R0), MOperand::create_mem_ri(R2, 0)});
+            emit(exit, RET, {});
+            return mf;
+        }
+    };
+
+    TEST_F(ASIMOVEmitterTest, EmitsRunnableImage)
+    {
+        GlobalVariable *g = global_int("g", 42);
+        sum_loop(g);
+
+        ASIMOVImage image;
+        std::string err;
+        ASSERT_TRUE(emit_image(mm_, image, {.entry = "main"}, &err)) << err;
+        // Every address fits 16 bits; only SUB's immediate needs an extra word
+        EXPECT_EQ(image.text.size(), 11u);
+        ASSERT_NE(image.find_symbol("main.loop"), nullptr);
+        EXPECT_EQ(image.find_symbol("main.loop")->offset, 16u);
+        const ASIMOVSymbol *symbol = image.find_symbol("g");
+        ASSERT_NE(symbol, nullptr);
+        EXPECT_EQ(symbol->kind, ASIMOVSymbolKind::Object);
+        EXPECT_EQ(symbol->offset, 44u);
+        ASSERT_EQ(image.data.size(), 4u);
+        EXPECT_EQ(image.data[3], 42);
+
+        // Loaded somewhere else, every absolute address moves with it
+        for (uint32_t base : {0u, 0x100u})
+        {
+            ASIMOVVM vm(4096);
+            vm.run(vm.load_image(image, base));
+            EXPECT_EQ(vm.registers()[R0], 57) << base;
+            EXPECT_EQ(vm.load_word(base + symbol->offset), 57u) << base;
+            EXPECT_EQ(read_counters(vm, image, base, "g", 1), std::vector<uint64_t>{57}) << base;
+            EXPECT_TRUE(read_counters(vm, image, base, "missing", 1).empty());
+        }
+
+        std::vector<uint32_t> words;
+        EXPECT_FALSE(image.link(0x10000, words, &err));
+        EXPECT_NE(err.find("does not fit"), std::string::npos) << err;
+    }
+
+    TEST_F(ASIMOVEmitterTest, WidensFarBranchesAndAddresses)
+    {
+        GlobalVariable *g = global_int("g", 9);
+        MachineFunction *mf = function("main");
+        MachineBasicBlock *entry = mf->create_block("entry");
+        MachineBasicBlock *far = mf->create_block("far");
+        emit(entry, JZ, {reg(R0), MOperand::create_basic_block(far)});
+        for (int i = 0; i < 20000; ++i)
+            emit(entry, NOP, {});
+        emit(far, LI, {reg(R1, true), MOperand::create_global(g)});
+        emit(far, LOAD, {reg(R2, true), MOperand::create_mem_ri(R1, 0)});
+        emit(far, LI, {reg(R0, true), imm(7)});
+        emit(far, RET, {});
+
+        ASIMOVImage image;
+        std::string err;
+        ASSERT_TRUE(emit_image(mm_, image, {}, &err)) << err;
+        // JNZ over a JMP, then MOVD with the address of g as its data word
+        EXPECT_EQ(image.text[0] >> 24, unsigned(JNZ));
+        EXPECT_EQ(image.text[0] & 0xFFFF, 8u);
+        EXPECT_EQ(image.text[1] >> 24, unsigned(JMP));
+        const uint32_t far_offset = image.find_symbol("main.far")->offset;
+        EXPECT_EQ(far_offset, (2 + 20000) * 4u);
+        EXPECT_EQ(image.text[1] & 0xFFFFFF, far_offset);
+        EXPECT_EQ(image.text[far_offset / 4] >> 24, unsigned(MOVD));
+        EXPECT_EQ(image.text[far_offset / 4 + 1], image.find_symbol("g")->offset);
+
+        ASIMOVVM vm(128 * 1024);
+        vm.run(vm.load_image(image, 0));
+        EXPECT_EQ(vm.registers()[R0], 7);
+        EXPECT_EQ(vm.registers()[R2], 9);
+    }
+
+    TEST_F(ASIMOVEmitterTest, RelocatesPointersInData)
+    {
+        GlobalVariable *g = global_int("g", 1);
+        module_.create_global_variable(module_.get_pointer_type(module_.get_integer_type(32)), false, g, "p");
+        MachineFunction *mf = function("main");
+        emit(mf->create_block("entry"), HALT, {});
+
+        ASIMOVImage image;
+        std::string err;
+        ASSERT_TRUE(emit_image(mm_, image, {}, &err)) << err;
+        const ASIMOVSymbol *p = image.find_symbol("p");
+        ASSERT_NE(p, nullptr);
+        ASSERT_EQ(p->offset % 4, 0u);
+        ASSERT_EQ(image.relocations.size(), 1u);
+        EXPECT_EQ(image.relocations[0].offset, p->offset);
+
+        std::vector<uint32_t> words;
+        ASSERT_TRUE(image.link(0x200, words, &err)) << err;
+        EXPECT_EQ(words[p->offset / 4], 0x200 + image.find_symbol("g")->offset);
+    }
+
+    TEST_F(ASIMOVEmitterTest, RoundTripsThroughFile)
+    {
+        sum_loop(global_int("g", 42));
+        MachineFunction *helper = function("helper");
+        emit(helper->create_block("entry"), CALL, {MOperand::create_external_sym("putchar")});
+
+        ASIMOVImage image;
+        std::string err;
+        ASSERT_TRUE(emit_image(mm_, image, {.base_address = 0x40, .entry = "main"}, &err)) << err;
+        EXPECT_EQ(image.find_symbol("putchar")->kind, ASIMOVSymbolKind::Undefined);
+
+        const std::string path = ::testing::TempDir() + "asimov_emitter_test.img";
+        ASSERT_TRUE(image.write_file(path, &err)) << err;
+        ASIMOVImage loaded;
+        ASSERT_TRUE(ASIMOVImage::read_file(path, loaded, &err)) << err;
+        std::remove(path.c_str());
+        EXPECT_EQ(loaded.base_address, 0x40u);
+        EXPECT_EQ(loaded.entry, image.entry);
+        EXPECT_EQ(loaded.text, image.text);
+        EXPECT_EQ(loaded.data, image.data);
+        ASSERT_EQ(loaded.symbols.size(), image.symbols.size());
+        for (size_t i = 0; i < image.symbols.size(); ++i)
+        {
+            EXPECT_EQ(loaded.symbols[i].name, image.symbols[i].name);
+            EXPECT_EQ(loaded.symbols[i].offset, image.symbols[i].offset);
+            EXPECT_EQ(loaded.symbols[i].kind, image.symbols[i].kind);
+        }
+        ASSERT_EQ(loaded.relocations.size(), image.relocations.size());
+        EXPECT_EQ(loaded.serialize(), image.serialize());
+
+        std::vector<uint32_t> words;
+        EXPECT_FALSE(loaded.link(0, words, &err));
+        EXPECT_NE(err.find("putchar"), std::string::npos) << err;
+        const std::unordered_map<std::string, uint32_t> externals = {{"putchar", 0x800}};
+        EXPECT_TRUE(loaded.link(0, words, &err, &externals)) << err;
+
+        std::vector<uint8_t> bytes = image.serialize();
+        bytes.pop_back();
+        EXPECT_FALSE(ASIMOVImage::parse(bytes, loaded, &err));
+        bytes = image.serialize();
+        bytes[0] = 'X';
+        EXPECT_FALSE(ASIMOVImage::parse(bytes, loaded, &err));
+    }
+
+    TEST_F(ASIMOVEmitterTest, RejectsWhatCannotBeEncoded)
+    {
+        MachineFunction *mf = function("main");
+        MachineBasicBlock *entry = mf->create_block("entry");
+        const unsigned vreg = mf->create_vreg(GR32);
+        emit(entry, ADD, {reg(vreg, true), reg(R0), reg(R1)});
+
+        ASIMOVImage image;
+        std::string err;
+        EXPECT_FALSE(emit_image(mm_, image, {}, &err));
+        EXPECT_NE(err.find("virtual register"), std::string::npos) << err;
+
+        entry->instructions().back()->operand(0) = reg(R0, true);
+        EXPECT_FALSE(emit_image(mm_, image, {.entry = "missing"}, &err));
+        EXPECT_NE(err.find("missing"), std::string::npos) << err;
+
+        emit(entry, JMP, {reg(R7)});
+        EXPECT_FALSE(emit_image(mm_, image, {}, &err));
+        EXPECT_NE(err.find("through a register"), std::string::npos) << err;
+    }
+} // namespace ASIMOV
@@ -87,6 +87,16 @@ namespace ASIMOV
         {
             vm.write_memory(address, value);
         }
+
+        static int32_t register_value(const ASIMOVVM &machine, Reg reg)
+        {
+            return machine.read_register(reg);
+        }
+
+        static size_t resident_bytes(const ASIMOVVM &machine)
+        {
+            return machine.memory_.resident_bytes();
+        }
     };
 
     // 测试 ADD 指令
@@ -314,4 +324,218 @@ namespace ASIMOV
         EXPECT_EQ(get_register_value(R0), 2);
     }
 
+    // 测试循环：预解码的指令被反复执行
+    TEST_F(ASIMOVVMTest, LoopInstruction)
+    {
+        std::vector<uint32_t> program = {
+            asimv_inst(MOVW, R1, 0, 0, 100), // 0:  R1 = 100（计数器）
+            asimv_inst(MOVW, R2, 0, 0, 1),   // 4:  R2 = 1
+            asimv_inst(MOVW, R0, 0, 0, 0),   // 8:  R0 = 0
+            asimv_inst(ADD, R0, R0, R1),     // 12: R0 += R1
+            asimv_inst(SUB, R1, R1, R2),     // 16: R1 -= 1
+            asimv_inst(JNZ, 0, R1, 0, 12),   // 20: 循环直到 R1 == 0
+            asimv_inst(HALT)};
+        load_and_run(program);
+        EXPECT_EQ(get_register_value(R0), 5050);
+        EXPECT_EQ(get_register_value(R1), 0);
+    }
+
+    // 寄存器在解码时校验，但错误只在执行到该指令时报告
+    TEST_F(ASIMOVVMTest, InvalidRegisterTrapsWhenExecuted)
+    {
+        std::vector<uint32_t> program = {
+            asimv_inst(MOVW, R0, 0, 0, 1),
+            asimv_inst(JMP, 0, 0, 0, 12),
+            asimv_inst(FADD, R0, R1, R2), // 从不执行的非法指令
+            asimv_inst(HALT)};
+        load_and_run(program);
+        EXPECT_EQ(get_register_value(R0), 1);
+
+        vm.load_program({asimv_inst(FADD, R0, R1, R2), asimv_inst(HALT)});
+        EXPECT_THROW(vm.run(0), std::runtime_error);
+    }
+
+    // 改写已解码的指令后执行新的指令
+    TEST_F(ASIMOVVMTest, SelfModifyingStore)
+    {
+        std::vector<uint32_t> program = {
+            asimv_inst(MOVD, R1),             // 0:  R1 = 新指令
+            asimv_inst(MOVW, R0, 0, 0, 2),    // 4:  MOVD 的数据字，运行前改写
+            asimv_inst(MOVW, R2, 0, 0, 20),   // 8:  R2 = 20
+            asimv_inst(STORE, R1, R2, 0, 0),  // 12: [20] = R1
+            asimv_inst(JMP, 0, 0, 0, 20),     // 16
+            asimv_inst(MOVW, R0, 0, 0, 1),    // 20: 被改写为 MOVW R0, 3
+            asimv_inst(HALT)};
+        vm.load_program(program);
+        write_memory(4, asimv_inst(MOVW, R0, 0, 0, 3));
+        vm.run(0);
+        EXPECT_EQ(get_register_value(R0), 3);
+
+        // 第二次运行时 [20] 已是新的指令，MOVD 数据字的改写同样生效
+        write_memory(4, asimv_inst(MOVW, R0, 0, 0, 4));
+        vm.run(0);
+        EXPECT_EQ(get_register_value(R0), 4);
+    }
+
+    // 融合的指令对：LOAD+ADD、ADD+STORE，以及跳进一对指令的中间
+    TEST_F(ASIMOVVMTest, FusedInstructionPairs)
+    {
+        std::vector<uint32_t> program = {
+            asimv_inst(MOVW, R1, 0, 0, 100), // 0:  R1 = 100（数据地址）
+            asimv_inst(LOAD, R2, R1, 0, 0),  // 4:  R2 = [100]
+            asimv_inst(ADD, R3, R2, R2),     // 8:  R3 = R2 + R2（与上一条融合）
+            asimv_inst(ADD, R4, R3, R2),     // 12: R4 = R3 + R2
+            asimv_inst(STORE, R4, R1, 0, 4), // 16: [104] = R4（与上一条融合）
+            asimv_inst(JZ, 0, R0, 0, 32),    // 20: R0 == 0 时跳到 32
+            asimv_inst(HALT),                // 24
+            asimv_inst(HALT),                // 28
+            asimv_inst(ADD, R0, R0, R4),     // 32: 第二次经过时 R0 != 0，落到 HALT
+            asimv_inst(JMP, 0, 0, 0, 8),     // 36: 跳进 LOAD+ADD 这一对的中间
+            asimv_inst(HALT)};
+        vm.load_program(program);
+        write_memory(100, 7);
+        vm.run(0);
+        EXPECT_EQ(get_register_value(R3), 14);
+        EXPECT_EQ(get_register_value(R4), 21);
+        EXPECT_EQ(get_register_value(R0), 21);
+        EXPECT_EQ(read_memory(104), 21u);
+    }
+
+    // 改写融合对的第二个字会让第一个字重新解码
+    TEST_F(ASIMOVVMTest, RewriteSecondHalfOfFusedPair)
+    {
+        std::vector<uint32_t> program = {
+            asimv_inst(MOVW, R1, 0, 0, 3),
+            asimv_inst(MOVW, R2, 0, 0, 1),
+            asimv_inst(SUB, R1, R1, R2),   // 8:  与下一条融合
+            asimv_inst(JNZ, 0, R1, 0, 8),  // 12
+            asimv_inst(HALT)};
+        load_and_run(program);
+        EXPECT_EQ(get_register_value(R1), 0);
+
+        write_memory(12, asimv_inst(HALT));
+        vm.run(0);
+        EXPECT_EQ(get_register_value(R1), 2);
+    }
+
+    // 非对齐访问按大端字节序拼接相邻的两个字
+    TEST(ASIMOVMemoryTest, UnalignedAccessIsBigEndian)
+    {
+        ASIMOVMemory memory(64);
+        memory.write(0, 0x11223344);
+        memory.write(4, 0x55667788);
+        EXPECT_EQ(memory.read(1), 0x22334455u);
+        EXPECT_EQ(memory.read(3), 0x44556677u);
+        EXPECT_EQ(memory.read_byte(0), 0x11);
+        EXPECT_EQ(memory.read_byte(6), 0x77);
+
+        memory.write(2, 0xAABBCCDD);
+        EXPECT_EQ(memory.read(0), 0x1122AABBu);
+        EXPECT_EQ(memory.read(4), 0xCCDD7788u);
+        EXPECT_FALSE(memory.in_range(61));
+        EXPECT_TRUE(memory.in_range(60));
+        EXPECT_FALSE(memory.in_range(0xFFFFFFFE));
+    }
+
+    // 大内存按页懒分配，未写过的页读出 0
+    TEST(ASIMOVMemoryTest, LargeMemoryIsPaged)
+    {
+        ASIMOVMemory memory(size_t(1) << 30);
+        EXPECT_TRUE(memory.paged());
+        EXPECT_EQ(memory.resident_bytes(), 0u);
+        EXPECT_EQ(memory.read(0x3FFFFFFC), 0u);
+        memory.write(0x3FFFFFFC, 42);
+        memory.write(ASIMOVMemory::PAGE_WORDS * 4 - 2, 0x01020304); // 跨两页
+        EXPECT_EQ(memory.read(0x3FFFFFFC), 42u);
+        EXPECT_EQ(memory.read(ASIMOVMemory::PAGE_WORDS * 4 - 2), 0x01020304u);
+        EXPECT_EQ(memory.resident_bytes(), 3 * ASIMOVMemory::PAGE_WORDS * 4);
+    }
+
+    // 在 1 GiB 地址空间的高处装载和运行程序，只分配用到的页
+    TEST_F(ASIMOVVMTest, RunsInLargeAddressSpace)
+    {
+        ASIMOVVM big(size_t(1) << 30);
+        const uint32_t code = 0x30000000;
+        std::vector<uint32_t> program = {
+            asimv_inst(MOVD, R1),
+            0x20000000,                       // R1 = 数据地址
+            asimv_inst(MOVW, R2, 0, 0, 1234), // R2 = 1234
+            asimv_inst(STORE, R2, R1, 0, 0),  // [R1] = R2
+            asimv_inst(LOAD, R3, R1, 0, 0),   // R3 = [R1]
+            asimv_inst(JMP, 0, 0, 0, 0x100),  // 跳到低地址上的 HALT
+        };
+        big.load_program(program, code);
+        big.load_program({asimv_inst(HALT)}, 0x100);
+        big.run(code);
+        EXPECT_EQ(register_value(big, R3), 1234);
+        EXPECT_LE(resident_bytes(big), 3 * ASIMOVMemory::PAGE_WORDS * 4);
+    }
+
+    // 剖析：指令数、按延迟计的周期、PC 命中、跳转统计和按标签的平面剖析
+    TEST_F(ASIMOVVMTest, ProfileCountsCyclesAndBranches)
+    {
+        std::vector<uint32_t> program = {
+            asimv_inst(MOVW, R1, 0, 0, 10),  // 0:  entry
+            asimv_inst(MOVW, R2, 0, 0, 1),   // 4
+            asimv_inst(MOVW, R0, 0, 0, 0),   // 8
+            asimv_inst(ADD, R0, R0, R1),     // 12: loop
+            asimv_inst(SUB, R1, R1, R2),     // 16
+            asimv_inst(JNZ, 0, R1, 0, 12),   // 20
+            asimv_inst(MUL, R3, R0, R0),     // 24: exit，3 周期
+            asimv_inst(STORE, R3, R2, 0, 99), // 28: [100] = R3，2 周期
+            asimv_inst(HALT)};                // 32
+        ASIMOVTargetInstInfo tii;
+        ASIMOVProfile profile(tii);
+        vm.set_profile(&profile);
+        load_and_run(program);
+        EXPECT_EQ(read_memory(100), 55u * 55u);
+
+        EXPECT_EQ(profile.instructions(), 36u);
+        EXPECT_EQ(profile.cycles(), 39u);
+        EXPECT_EQ(profile.opcode_count(ADD), 10u);
+        EXPECT_EQ(profile.opcode_count(JNZ), 10u);
+        EXPECT_EQ(profile.hits(12), 10u);
+        EXPECT_EQ(profile.hits(20), 10u);
+        EXPECT_EQ(profile.cycles_at(24), 3u);
+        EXPECT_EQ(profile.loads(), 0u);
+        EXPECT_EQ(profile.stores(), 1u);
+        ASSERT_EQ(profile.branches().count(20), 1u);
+        EXPECT_EQ(profile.branches().at(20).taken, 9u);
+        EXPECT_EQ(profile.branches().at(20).not_taken, 1u);
+
+        auto flat = profile.flat_profile({{0, "entry"}, {12, "loop"}, {24, "exit"}});
+        ASSERT_EQ(flat.size(), 3u);
+        EXPECT_EQ(flat[0].label, "loop");
+        EXPECT_EQ(flat[0].cycles, 30u);
+        EXPECT_EQ(flat[1].label, "exit");
+        EXPECT_EQ(flat[1].instructions, 3u);
+        EXPECT_EQ(flat[1].cycles, 6u);
+        EXPECT_EQ(flat[2].label, "entry");
+
+        // 关掉剖析后不再计数
+        vm.set_profile(nullptr);
+        vm.run(0);
+        EXPECT_EQ(profile.instructions(), 36u);
+    }
+
+    // 基本块标签按指令大小依次排布
+    TEST(ASIMOVProfileTest, BlockAddressesFollowLayout)
+    {
+        ASIMOVRegisterInfo tri;
+        ASIMOVTargetInstInfo tii;
+        MachineModule mm(nullptr);
+        mm.set_target_info(&tri, &tii);
+        MachineFunction *mf = mm.create_machine_function(nullptr);
+        auto *entry = mf->create_block("entry");
+        auto *exit = mf->create_block("exit");
+        for (int i = 0; i < 3; ++i)
+            entry->append(std::make_unique<MachineInst>(NOP));
+        exit->append(std::make_unique<MachineInst>(HALT));
+
+        ASIMOVLabelMap labels = block_addresses(*mf, 0x100);
+        ASSERT_EQ(labels.size(), 2u);
+        EXPECT_EQ(labels[0], std::make_pair(0x100u, std::string("entry")));
+        EXPECT_EQ(labels[1], std::make_pair(0x10Cu, std::string("exit")));
+    }
+
 } // namespace ASIMOV
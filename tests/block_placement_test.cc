@@ -0,0 +1,259 @@
+#include <gtest/gtest.h>
+
+#include "src/block_placement.h"
+#include "src/ir.h"
+#include "src/machine.h"
+#include "src/targets/asimov_target.h"
+#include "src/targets/riscv_target.h"
+
+namespace
+{
+    MOperand reg(unsigned r, bool def = false) { return MOperand::create_reg(r, def); }
+    MOperand imm(int64_t value) { return MOperand::create_imm(value); }
+    MOperand block(MachineBasicBlock *bb) { return MOperand::create_basic_block(bb); }
+
+    MachineInst *emit(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+    {
+        bb->append(std::make_unique<MachineInst>(opcode, ops));
+        return bb->instructions().back().get();
+    }
+
+    MachineInst *branch(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+    {
+        MachineInst *mi = emit(bb, opcode, ops);
+        mi->set_flag(MIFlag::Branch);
+        mi->set_flag(MIFlag::Terminator);
+        return mi;
+    }
+
+    std::vector<unsigned> opcodes(const MachineBasicBlock *mbb)
+    {
+        std::vector<unsigned> result;
+        for (const auto &mi : mbb->instructions())
+            result.push_back(mi->opcode());
+        return result;
+    }
+
+    std::vector<const MachineBasicBlock *> layout(const MachineFunction *mf)
+    {
+        std::vector<const MachineBasicBlock *> result;
+        for (const auto &mbb : mf->basic_blocks())
+            result.push_back(mbb.get());
+        return result;
+    }
+
+    template <typename RegisterInfo, typename InstInfo>
+    class PlacementTest : public ::testing::Test
+    {
+    protected:
+        RegisterInfo tri_;
+        InstInfo tii_;
+        Module module_;
+        MachineModule mm_{&module_};
+
+        void SetUp() override { mm_.set_target_info(&tri_, &tii_); }
+
+        MachineFunction *function(const std::string &name)
+        {
+            return mm_.create_machine_function(module_.create_function(name, module_.get_void_type(), {}));
+        }
+    };
+
+    using ASIMOVPlacementTest = PlacementTest<ASIMOV::ASIMOVRegisterInfo, ASIMOV::ASIMOVTargetInstInfo>;
+    using RISCVPlacementTest = PlacementTest<RISCV::RISCVRegisterInfo, RISCV::RISCVTargetInstInfo>;
+}
+
+TEST_F(ASIMOVPlacementTest, WeighsLoopsAndEarlyReturns)
+{
+    using namespace ASIMOV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *early = mf->create_block("early");
+    MachineBasicBlock *header = mf->create_block("header");
+    MachineBasicBlock *body = mf->create_block("body");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    branch(entry, JZ, {reg(R1), block(early)});
+    branch(entry, JMP, {block(header)});
+    emit(early, RET, {});
+    branch(header, JZ, {reg(R2), block(exit)});
+    emit(body, ADD, {reg(R3, true), reg(R3), reg(R3)});
+    branch(body, JMP, {block(header)});
+    emit(exit, RET, {});
+
+    auto freq = estimate_block_frequencies(*mf);
+    EXPECT_DOUBLE_EQ(freq.at(entry), 1.0);
+    EXPECT_DOUBLE_EQ(freq.at(early), 1.0 / 32);
+    EXPECT_DOUBLE_EQ(freq.at(header), 31.0);
+    EXPECT_DOUBLE_EQ(freq.at(body), 31.0 * 31 / 32);
+    EXPECT_DOUBLE_EQ(freq.at(exit), 31.0 / 32);
+}
+
+TEST_F(ASIMOVPlacementTest, FollowsProfileCountsWhereEveryBlockHasOne)
+{
+    using namespace ASIMOV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *early = mf->create_block("early");
+    MachineBasicBlock *header = mf->create_block("header");
+    MachineBasicBlock *body = mf->create_block("body");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    branch(entry, JZ, {reg(R1), block(early)});
+    branch(entry, JMP, {block(header)});
+    emit(early, RET, {});
+    branch(header, JZ, {reg(R2), block(exit)});
+    emit(body, ADD, {reg(R3, true), reg(R3), reg(R3)});
+    branch(body, JMP, {block(header)});
+    emit(exit, RET, {});
+
+    // The early return is the common case, and the loop runs 9 times
+    entry->set_profile_count(10);
+    early->set_profile_count(6);
+    header->set_profile_count(40);
+    body->set_profile_count(36);
+    exit->set_profile_count(4);
+    auto freq = estimate_block_frequencies(*mf);
+    EXPECT_DOUBLE_EQ(freq.at(entry), 1.0);
+    EXPECT_DOUBLE_EQ(freq.at(early), 0.6);
+    EXPECT_DOUBLE_EQ(freq.at(header), 4.0);
+    EXPECT_DOUBLE_EQ(freq.at(body), 3.6);
+    EXPECT_DOUBLE_EQ(freq.at(exit), 0.4);
+
+    // A block without a count leaves the whole function to the heuristics
+    MachineFunction *partial = function("g");
+    MachineBasicBlock *g_entry = partial->create_block("entry");
+    MachineBasicBlock *g_rest = partial->create_block("rest");
+    MachineBasicBlock *g_early = partial->create_block("early");
+    branch(g_entry, JZ, {reg(R1), block(g_early)});
+    emit(g_rest, RET, {});
+    emit(g_early, RET, {});
+    g_entry->set_profile_count(10);
+    g_early->set_profile_count(6);
+    freq = estimate_block_frequencies(*partial);
+    EXPECT_DOUBLE_EQ(freq.at(g_early), 0.5);
+}
+
+TEST_F(ASIMOVPlacementTest, RotatesLoopsSoTheBackEdgeFallsThrough)
+{
+    using namespace ASIMOV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *body = mf->create_block("body");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    MachineBasicBlock *header = mf->create_block("header");
+    branch(entry, JMP, {block(header)});
+    emit(body, ADD, {reg(R3, true), reg(R3), reg(R3)});
+    branch(body, JMP, {block(header)});
+    emit(exit, RET, {});
+    branch(header, JNZ, {reg(R1), block(body)});
+    branch(header, JMP, {block(exit)});
+
+    PlacementStats stats = place_blocks(*mf);
+    EXPECT_EQ(stats.moved_blocks, 2u);
+    EXPECT_EQ(stats.removed_jumps, 2u);
+    EXPECT_EQ(stats.inserted_jumps, 0u);
+    EXPECT_EQ(layout(mf), (std::vector<const MachineBasicBlock *>{entry, body, header, exit}));
+    EXPECT_EQ(opcodes(entry), (std::vector<unsigned>{JMP}));
+    EXPECT_EQ(opcodes(body), (std::vector<unsigned>{ADD}));
+    EXPECT_EQ(opcodes(header), (std::vector<unsigned>{JNZ}));
+
+    // Already laid out well, so nothing changes the second time
+    stats = place_blocks(*mf);
+    EXPECT_EQ(stats.moved_blocks + stats.removed_jumps + stats.inserted_jumps + stats.inverted_branches, 0u);
+}
+
+TEST_F(ASIMOVPlacementTest, MovesEarlyReturnsOutOfTheHotPath)
+{
+    using namespace ASIMOV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *early = mf->create_block("early");
+    MachineBasicBlock *rest = mf->create_block("rest");
+    MachineBasicBlock *more = mf->create_block("more");
+    MachineBasicBlock *done = mf->create_block("done");
+    branch(entry, JNZ, {reg(R1), block(early)});
+    branch(entry, JMP, {block(rest)});
+    emit(early, MOVW, {reg(R0, true), reg(R2)});
+    emit(early, RET, {});
+    branch(rest, JZ, {reg(R2), block(done)});
+    emit(more, ADD, {reg(R0, true), reg(R2), reg(R2)});
+    emit(done, RET, {});
+
+    PlacementStats stats = place_blocks(*mf);
+    EXPECT_EQ(stats.moved_blocks, 4u);
+    EXPECT_EQ(stats.removed_jumps, 1u);
+    EXPECT_EQ(layout(mf), (std::vector<const MachineBasicBlock *>{entry, rest, more, done, early}));
+    ASSERT_EQ(opcodes(entry), (std::vector<unsigned>{JNZ}));
+    EXPECT_EQ(entry->instructions()[0]->operands()[1].basic_block(), early);
+    EXPECT_EQ(opcodes(more), (std::vector<unsigned>{ADD}));
+}
+
+TEST_F(ASIMOVPlacementTest, AddsJumpsWhereFallThroughsMove)
+{
+    using namespace ASIMOV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    // Left behind by an earlier pass, it falls through into `exit`
+    MachineBasicBlock *dead = mf->create_block("dead");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    MachineBasicBlock *header = mf->create_block("header");
+    branch(entry, JMP, {block(header)});
+    emit(dead, LI, {reg(R0, true), imm(0)});
+    emit(exit, RET, {});
+    branch(header, JNZ, {reg(R1), block(header)});
+    branch(header, JMP, {block(exit)});
+
+    PlacementStats stats = place_blocks(*mf);
+    EXPECT_EQ(layout(mf), (std::vector<const MachineBasicBlock *>{entry, header, exit, dead}));
+    EXPECT_EQ(stats.removed_jumps, 2u);
+    EXPECT_EQ(stats.inserted_jumps, 1u);
+    EXPECT_TRUE(opcodes(entry).empty());
+    EXPECT_EQ(opcodes(header), (std::vector<unsigned>{JNZ}));
+    ASSERT_EQ(opcodes(dead), (std::vector<unsigned>{LI, JMP}));
+    EXPECT_EQ(dead->instructions()[1]->operands()[0].basic_block(), exit);
+    EXPECT_TRUE(dead->instructions()[1]->has_flag(MIFlag::Terminator));
+}
+
+TEST_F(RISCVPlacementTest, InvertsBranchesIntoTheLoopBody)
+{
+    using namespace RISCV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *header = mf->create_block("header");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    MachineBasicBlock *body = mf->create_block("body");
+    emit(entry, ADDI, {reg(A0, true), reg(ZERO), imm(0)});
+    branch(header, BLT, {reg(A0), reg(A1), block(body)});
+    emit(exit, RET, {});
+    emit(body, ADDI, {reg(A0, true), reg(A0), imm(1)});
+    branch(body, J, {block(header)});
+
+    PlacementStats stats = place_blocks(*mf);
+    EXPECT_EQ(stats.moved_blocks, 2u);
+    EXPECT_EQ(stats.inverted_branches, 1u);
+    EXPECT_EQ(layout(mf), (std::vector<const MachineBasicBlock *>{entry, header, body, exit}));
+    ASSERT_EQ(opcodes(header), (std::vector<unsigned>{BGE}));
+    const MachineInst &bge = *header->instructions()[0];
+    EXPECT_EQ(bge.operands()[0].reg(), A0);
+    EXPECT_EQ(bge.operands()[1].reg(), A1);
+    EXPECT_EQ(bge.operands()[2].basic_block(), exit);
+    EXPECT_TRUE(bge.has_flag(MIFlag::Terminator));
+    EXPECT_EQ(opcodes(body), (std::vector<unsigned>{ADDI, J}));
+}
+
+TEST_F(RISCVPlacementTest, LeavesUnanalyzableFunctionsAlone)
+{
+    using namespace RISCV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *cold = mf->create_block("cold");
+    MachineBasicBlock *hot = mf->create_block("hot");
+    // An indirect jump, whose targets aren't known
+    branch(entry, JALR, {reg(ZERO, true), reg(A0), imm(0)});
+    emit(cold, RET, {});
+    emit(hot, RET, {});
+
+    PlacementStats stats = place_blocks(*mf);
+    EXPECT_EQ(stats.moved_blocks, 0u);
+    EXPECT_EQ(layout(mf), (std::vector<const MachineBasicBlock *>{entry, cold, hot}));
+    EXPECT_TRUE(estimate_block_frequencies(*mf).empty());
+}
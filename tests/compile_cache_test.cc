@@ -0,0 +1,231 @@
+#include <filesystem>
+#include <sstream>
+
+#include "gtest/gtest.h"
+#include "src/compile_cache.h"
+#include "src/ir_binary.h"
+#include "src/ir_builder.h"
+#include "src/ir_generator.h"
+#include "src/ir_printer.h"
+#include "src/parser.h"
+#include "src/type_checker.h"
+
+namespace
+{
+    constexpr const char *SOURCE = R"(
+struct Point { x: i32, y: i32 }
+let scale: i32 = 3;
+fn norm(x: i32, y: i32) -> i32 { return x * x + y * y; }
+fn twice(n: i32) -> i32 { return n + n; }
+fn main() -> i32 {
+    let p: Point = Point { x: 1, y: 2 };
+    let i: i32 = 0;
+    while (i < 4) i = i + 1;
+    return norm(p.x, p.y) * scale + twice(i);
+}
+)";
+
+    class CompileCacheTest : public ::testing::Test
+    {
+    protected:
+        void SetUp() override
+        {
+            dir_ = std::filesystem::temp_directory_path() /
+                   ("mo_cache_" + std::string(::testing::UnitTest::GetInstance()->current_test_info()->name()));
+            std::filesystem::remove_all(dir_);
+            std::string err;
+            cache_ = CompilationCache::open(dir_.string(), &err);
+            ASSERT_TRUE(cache_) << err;
+        }
+
+        void TearDown() override { std::filesystem::remove_all(dir_); }
+
+        // Compiles `source` afresh, as a new build would, and prints its IR
+        std::string build(const std::string &source, CompilationCache *cache, ThreadPool *pool = nullptr)
+        {
+            Parser parser{Lexer(source)};
+            ast::Program program = parser.parse();
+            TypeChecker checker(&program);
+            EXPECT_TRUE(checker.check().ok);
+
+            Module module;
+            IRGenerator generator(&module);
+            generator.set_cache(cache);
+            generator.set_thread_pool(pool);
+            generator.generate(program);
+            std::ostringstream os;
+            IRPrinter::print_module(module, os);
+            return os.str();
+        }
+
+        std::filesystem::path dir_;
+        std::unique_ptr<CompilationCache> cache_;
+    };
+}
+
+TEST_F(CompileCacheTest, StoresAndReadsEntries)
+{
+    std::vector<uint8_t> bytes = {1, 2, 3, 4};
+    EXPECT_FALSE(cache_->lookup(42));
+    ASSERT_TRUE(cache_->store(42, bytes));
+    EXPECT_EQ(cache_->lookup(42), bytes);
+    EXPECT_FALSE(cache_->lookup(43));
+
+    // A damaged entry is a miss, not garbage
+    std::filesystem::path entry = *std::filesystem::directory_iterator(dir_);
+    std::filesystem::resize_file(entry, std::filesystem::file_size(entry) - 1);
+    EXPECT_FALSE(cache_->lookup(42));
+    EXPECT_EQ(cache_->hits(), 1u);
+    EXPECT_EQ(cache_->misses(), 3u);
+}
+
+TEST_F(CompileCacheTest, ReusesUnchangedFunctions)
+{
+    const std::string fresh = build(SOURCE, nullptr);
+    EXPECT_EQ(build(SOURCE, cache_.get()), fresh);
+    EXPECT_EQ(cache_->hits(), 0u);
+    EXPECT_EQ(cache_->stores(), 3u);
+
+    // A second build links every body back in and comes out the same
+    EXPECT_EQ(build(SOURCE, cache_.get()), fresh);
+    EXPECT_EQ(cache_->hits(), 3u);
+    EXPECT_EQ(cache_->stores(), 3u);
+}
+
+TEST_F(CompileCacheTest, WorkersShareTheCache)
+{
+    const std::string fresh = build(SOURCE, nullptr);
+    ThreadPool pool(4);
+    EXPECT_EQ(build(SOURCE, cache_.get(), &pool), fresh);
+    EXPECT_EQ(build(SOURCE, cache_.get(), &pool), fresh);
+    EXPECT_EQ(cache_->hits(), 3u);
+    EXPECT_EQ(cache_->stores(), 3u);
+}
+
+TEST_F(CompileCacheTest, RecompilesWhatChanged)
+{
+    build(SOURCE, cache_.get());
+
+    // Only the edited body misses
+    std::string edited = SOURCE;
+    edited.replace(edited.find("i < 4"), 5, "i < 5");
+    EXPECT_EQ(build(edited, cache_.get()), build(edited, nullptr));
+    EXPECT_EQ(cache_->hits(), 2u);
+    EXPECT_EQ(cache_->stores(), 4u);
+
+    // So does a function naming a struct whose members moved
+    std::string reordered = SOURCE;
+    reordered.replace(reordered.find("x: i32, y: i32"), 14, "y: i32, x: i32");
+    EXPECT_EQ(build(reordered, cache_.get()), build(reordered, nullptr));
+    EXPECT_EQ(cache_->hits(), 4u);
+    EXPECT_EQ(cache_->stores(), 5u);
+}
+
+TEST_F(CompileCacheTest, KeysFollowWhatTheBodyNames)
+{
+    auto keys_of = [](const std::string &source)
+    {
+        Parser parser{Lexer(source)};
+        ast::Program program = parser.parse();
+        TypeChecker checker(&program);
+        EXPECT_TRUE(checker.check().ok);
+        FunctionKeys keys(program);
+        std::vector<std::optional<uint64_t>> result;
+        for (const auto &func : program.functions)
+            result.push_back(keys.key(*func));
+        return result;
+    };
+
+    const auto base = keys_of(SOURCE);
+    ASSERT_EQ(base.size(), 3u);
+    for (const auto &key : base)
+        EXPECT_TRUE(key);
+    EXPECT_EQ(keys_of(SOURCE), base);
+
+    // Only `main` reads `scale`
+    std::string rescaled = SOURCE;
+    rescaled.replace(rescaled.find("= 3"), 3, "= 4");
+    auto keys = keys_of(rescaled);
+    EXPECT_EQ(keys[0], base[0]);
+    EXPECT_EQ(keys[1], base[1]);
+    EXPECT_NE(keys[2], base[2]);
+
+    // Callers don't see what a parameter is called
+    std::string renamed = SOURCE;
+    renamed.replace(renamed.find("twice(n: i32) -> i32 { return n + n; }"), 38, "twice(m: i32) -> i32 { return m + m; }");
+    keys = keys_of(renamed);
+    EXPECT_EQ(keys[0], base[0]);
+    EXPECT_NE(keys[1], base[1]);
+    EXPECT_EQ(keys[2], base[2]);
+
+    // Nor what they don't name
+    keys = keys_of(std::string(SOURCE) + "fn unused() -> i32 { return 0; }\n");
+    ASSERT_EQ(keys.size(), 4u);
+    keys.pop_back();
+    EXPECT_EQ(keys, base);
+}
+
+TEST_F(CompileCacheTest, EntriesOnlyLinkWhereTheyFit)
+{
+    Module module;
+    IntegerType *i32 = module.get_integer_type(32);
+    Function *callee = module.create_function("callee", i32, {{"x", i32}});
+    Function *caller = module.create_function("caller", i32, {{"y", i32}});
+    IRBuilder builder(&module);
+    builder.set_insert_point(caller->create_basic_block("entry"));
+    builder.create_ret(builder.create_call(callee, {caller->arg(0)}, "r"));
+    const std::vector<uint8_t> entry = serialize_function(*caller);
+
+    // Linking needs the declaration without a body
+    std::string err;
+    EXPECT_EQ(ModuleReader::link_function(entry, module, &err), nullptr);
+    EXPECT_NE(err.find("already has a body"), std::string::npos) << err;
+
+    Module other;
+    IntegerType *other_i32 = other.get_integer_type(32);
+    other.create_function("caller", other_i32, {{"y", other_i32}});
+    EXPECT_EQ(ModuleReader::link_function(entry, other, &err), nullptr);
+    EXPECT_NE(err.find("`callee`"), std::string::npos) << err;
+
+    Function *other_callee = other.create_function("callee", other_i32, {{"x", other_i32}});
+    Function *linked = ModuleReader::link_function(entry, other, &err);
+    ASSERT_NE(linked, nullptr) << err;
+    EXPECT_EQ(linked, other.get_function("caller"));
+    auto *call = static_cast<CallInst *>(linked->entry_block()->first_instruction());
+    EXPECT_EQ(call->called_function(), other_callee);
+    EXPECT_EQ(linked->arg(0)->name(), "y");
+}
+
+TEST_F(CompileCacheTest, OwnedGlobalsComeAlong)
+{
+    Module module;
+    IntegerType *i32 = module.get_integer_type(32);
+    GlobalVariable *counter = module.create_global_variable(module.get_pointer_type(i32), false,
+                                                            module.get_constant_int(i32, 0), "counter");
+    ConstantString *hello = module.get_constant_string("hello");
+    GlobalVariable *literal = module.create_global_variable(hello->type(), true, hello, "str");
+    Function *f = module.create_function("f", i32, {});
+    IRBuilder builder(&module);
+    builder.set_insert_point(f->create_basic_block("entry"));
+    builder.create_bitcast(literal, module.get_pointer_type(module.get_integer_type(8)), "str.cast");
+    builder.create_ret(builder.create_load(counter, "c"));
+    GlobalVariable *owned[] = {literal};
+    const std::vector<uint8_t> entry = serialize_function(*f, owned);
+
+    Module other;
+    IntegerType *other_i32 = other.get_integer_type(32);
+    other.create_function("f", other_i32, {});
+    std::string err;
+    EXPECT_EQ(ModuleReader::link_function(entry, other, &err), nullptr);
+    EXPECT_NE(err.find("`counter`"), std::string::npos) << err;
+
+    GlobalVariable *other_counter = other.create_global_variable(other.get_pointer_type(other_i32), false,
+                                                                 other.get_constant_int(other_i32, 5), "counter");
+    Function *linked = ModuleReader::link_function(entry, other, &err);
+    ASSERT_NE(linked, nullptr) << err;
+    auto *cast = linked->entry_block()->first_instruction();
+    EXPECT_EQ(cast->next()->operand(0), other_counter);
+    auto *copied = dynamic_cast<GlobalVariable *>(cast->operand(0));
+    ASSERT_NE(copied, nullptr);
+    EXPECT_EQ(copied->initializer(), other.get_constant_string("hello"));
+}
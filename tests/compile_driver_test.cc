@@ -0,0 +1,266 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "src/compile_driver.h"
+#include "src/vm/asimov_vm.h"
+
+namespace
+{
+    // 第 n 个文件有 n + 2 个函数，依次调用前一个
+    std::string chain_source(unsigned n)
+    {
+        std::string out = "fn step0(a: i32, b: i32) -> i32 { return a + b; }\n";
+        for (unsigned i = 1; i < n + 2; ++i)
+        {
+            out += "fn step" + std::to_string(i) + "(a: i32, b: i32) -> i32 {\n";
+            out += "    let t: i32 = a * " + std::to_string(i % 5 + 2) + " + b;\n";
+            out += "    while ((t = t - 1) > " + std::to_string(i) + ") t = t / 2;\n";
+            out += "    return step" + std::to_string(i - 1) + "(t, a);\n";
+            out += "}\n";
+        }
+        out += "fn main() -> i32 { return step" + std::to_string(n + 1) + "(1, 2); }\n";
+        return out;
+    }
+
+    std::vector<CompileInput> chain_inputs(unsigned count)
+    {
+        std::vector<CompileInput> inputs;
+        for (unsigned i = 0; i < count; ++i)
+            inputs.push_back({.path = "chain" + std::to_string(i) + ".mo", .source = chain_source(i), .output_path = ""});
+        return inputs;
+    }
+}
+
+// 输出与线程数和内存预算无关
+TEST(CompileDriverTest, ParallelRunMatchesSerial)
+{
+    const std::vector<CompileInput> inputs = chain_inputs(6);
+    for (unsigned opt_level : {0u, 1u, 2u})
+    {
+        DriverOptions serial_options{.opt_level = opt_level, .jobs = 1};
+        DriverOptions parallel_options{.opt_level = opt_level, .jobs = 4};
+        std::vector<CompileResult> serial = compile_files(inputs, serial_options);
+        std::vector<CompileResult> parallel = compile_files(inputs, parallel_options);
+
+        ASSERT_EQ(serial.size(), inputs.size());
+        ASSERT_EQ(parallel.size(), inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            ASSERT_TRUE(serial[i].ok) << serial[i].errors.front();
+            ASSERT_TRUE(parallel[i].ok) << parallel[i].errors.front();
+            EXPECT_EQ(parallel[i].path, inputs[i].path);
+            EXPECT_EQ(parallel[i].functions, i + 3);
+            EXPECT_FALSE(serial[i].output.empty());
+            EXPECT_EQ(serial[i].output, parallel[i].output) << "opt level " << opt_level << ", " << inputs[i].path;
+        }
+    }
+}
+
+// 每个阶段一个任务，选择阶段每个函数一个
+TEST(CompileDriverTest, SelectsEachFunctionAsItsOwnTask)
+{
+    const std::vector<CompileInput> inputs = chain_inputs(4);
+    DriverStats stats;
+    std::vector<CompileResult> results = compile_files(inputs, {.jobs = 3}, &stats);
+
+    size_t functions = 0;
+    for (const CompileResult &result : results)
+    {
+        ASSERT_TRUE(result.ok);
+        functions += result.functions;
+        EXPECT_GT(result.wall_seconds, 0.0);
+        EXPECT_GT(result.stage_seconds[static_cast<unsigned>(CompileStage::Codegen)], 0.0);
+    }
+    EXPECT_EQ(stats.tasks, 3 * inputs.size() + functions);
+    EXPECT_LE(stats.steals, stats.tasks);
+}
+
+// 报告里每个文件一行
+TEST(CompileDriverTest, TimingReportsListEveryFile)
+{
+    const std::vector<CompileInput> inputs = chain_inputs(2);
+    std::vector<CompileResult> results = compile_files(inputs, {.jobs = 2});
+
+    std::ostringstream table, json;
+    print_file_timings(results, table);
+    export_file_timings_to_json(results, json);
+    for (const CompileInput &input : inputs)
+    {
+        EXPECT_NE(table.str().find(input.path), std::string::npos);
+        EXPECT_NE(json.str().find("\"path\": \"" + input.path + "\""), std::string::npos);
+    }
+    EXPECT_NE(table.str().find("select"), std::string::npos);
+    EXPECT_NE(json.str().find("\"codegen\": "), std::string::npos);
+}
+
+// 预算容不下任何文件时一次只编一个，但总能编完
+TEST(CompileDriverTest, MemoryBudgetLimitsFilesInFlight)
+{
+    const std::vector<CompileInput> inputs = chain_inputs(5);
+    DriverStats stats;
+    std::vector<CompileResult> results = compile_files(inputs, {.jobs = 4, .memory_budget = 1}, &stats);
+    for (const CompileResult &result : results)
+        EXPECT_TRUE(result.ok);
+    EXPECT_EQ(stats.peak_files_in_flight, 1u);
+
+    compile_files(inputs, {.jobs = 4}, &stats);
+    EXPECT_GE(stats.peak_files_in_flight, 1u);
+    EXPECT_LE(stats.peak_files_in_flight, inputs.size());
+}
+
+// 出错的文件不影响其余文件，错误带上文件名
+TEST(CompileDriverTest, FailuresStayWithTheirFile)
+{
+    std::vector<CompileInput> inputs = chain_inputs(3);
+    inputs.insert(inputs.begin() + 1, {.path = "syntax.mo", .source = "fn main() -> i32 { return 1 +; }", .output_path = ""});
+    inputs.push_back({.path = "types.mo", .source = "fn main() -> i32 { return missing; }", .output_path = ""});
+    inputs.push_back({.path = "/nonexistent/dir/absent.mo", .source = std::nullopt, .output_path = ""});
+
+    std::vector<CompileResult> results = compile_files(inputs, {.jobs = 2});
+    ASSERT_EQ(results.size(), 6u);
+    EXPECT_TRUE(results[0].ok);
+    EXPECT_TRUE(results[2].ok);
+    EXPECT_TRUE(results[3].ok);
+    for (size_t i : {1u, 4u, 5u})
+    {
+        EXPECT_FALSE(results[i].ok) << inputs[i].path;
+        ASSERT_FALSE(results[i].errors.empty()) << inputs[i].path;
+        EXPECT_EQ(results[i].errors.front().rfind(inputs[i].path + ": ", 0), 0u) << results[i].errors.front();
+        EXPECT_TRUE(results[i].output.empty());
+    }
+    EXPECT_EQ(results[5].errors.front(), "/nonexistent/dir/absent.mo: cannot open file");
+}
+
+// 给了输出路径就写文件，读入也走文件
+TEST(CompileDriverTest, ReadsAndWritesFiles)
+{
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "mo_driver_files";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    {
+        std::ofstream source(dir / "prog.mo");
+        source << chain_source(2);
+    }
+
+    for (DriverTarget target : {DriverTarget::RISCV, DriverTarget::ASIMOV})
+    {
+        const std::string output = (dir / (target == DriverTarget::RISCV ? "prog.o" : "prog.img")).string();
+        // ASIMOV 的分支只判断是否为零，也不能从调用返回，chain_source 的比较和调用编不了
+        std::optional<std::string> source;
+        if (target == DriverTarget::ASIMOV)
+            source = "fn main() -> i32 { let a: i32 = 20; return a + 22; }";
+        const std::vector<CompileInput> inputs = {{.path = (dir / "prog.mo").string(), .source = source, .output_path = output}};
+
+        std::vector<CompileResult> results = compile_files(inputs, {.target = target});
+        ASSERT_TRUE(results[0].ok) << results[0].errors.front();
+        EXPECT_TRUE(results[0].output.empty());
+        ASSERT_TRUE(std::filesystem::exists(output));
+        EXPECT_GT(std::filesystem::file_size(output), 0u);
+    }
+
+    std::filesystem::remove_all(dir);
+}
+
+namespace
+{
+    // 把 ASIMOV 映像装进虚拟机从入口跑到停机，返回 R0
+    int32_t run_asimov(const std::vector<uint8_t> &bytes)
+    {
+        ASIMOV::ASIMOVImage image;
+        std::string err_msg;
+        EXPECT_TRUE(ASIMOV::ASIMOVImage::parse(bytes, image, &err_msg)) << err_msg;
+        ASIMOV::ASIMOVVM vm(64 * 1024);
+        vm.run(vm.load_image(image, 0));
+        return vm.registers()[ASIMOV::R0];
+    }
+}
+
+// 局部变量放在 R7 下方的栈帧里，各优化级别跑出同样的结果
+TEST(CompileDriverTest, ASIMOVImagesRunInTheVM)
+{
+    const std::string source = "fn main() -> i32 {\n"
+                               "    let a: i32 = 6;\n"
+                               "    let b: i32 = a * 7;\n"
+                               "    if (b == 42) return b;\n"
+                               "    return 0;\n"
+                               "}\n";
+    const std::vector<CompileInput> inputs = {{.path = "main.mo", .source = source, .output_path = ""}};
+    for (unsigned opt_level : {0u, 1u, 2u})
+    {
+        SCOPED_TRACE(opt_level);
+        std::vector<CompileResult> results = compile_files(inputs, {.target = DriverTarget::ASIMOV, .opt_level = opt_level});
+        ASSERT_TRUE(results[0].ok) << results[0].errors.front();
+        EXPECT_EQ(run_asimov(results[0].output), 42);
+    }
+}
+
+// 多个函数的映像：-O0 留下的调用报错，内联掉之后能跑
+TEST(CompileDriverTest, ASIMOVRejectsCallsItCannotReturnFrom)
+{
+    const std::string source = "fn add(a: i32, b: i32) -> i32 { return a + b; }\n"
+                               "fn thrice(a: i32) -> i32 { let t: i32 = a * 3; return t; }\n"
+                               "fn main() -> i32 {\n"
+                               "    let x: i32 = add(4, 3);\n"
+                               "    return add(thrice(x), 21);\n"
+                               "}\n";
+    const std::vector<CompileInput> inputs = {{.path = "calls.mo", .source = source, .output_path = ""}};
+
+    std::vector<CompileResult> unopt = compile_files(inputs, {.target = DriverTarget::ASIMOV, .opt_level = 0});
+    ASSERT_FALSE(unopt[0].ok);
+    ASSERT_FALSE(unopt[0].errors.empty());
+    EXPECT_NE(unopt[0].errors.front().find("is not supported on ASIMOV"), std::string::npos) << unopt[0].errors.front();
+    EXPECT_TRUE(unopt[0].output.empty());
+
+    for (unsigned opt_level : {1u, 2u})
+    {
+        SCOPED_TRACE(opt_level);
+        std::vector<CompileResult> results = compile_files(inputs, {.target = DriverTarget::ASIMOV, .opt_level = opt_level});
+        ASSERT_TRUE(results[0].ok) << results[0].errors.front();
+        EXPECT_EQ(run_asimov(results[0].output), 42);
+    }
+}
+
+// ASIMOV 只能按零/非零跳转：比大小的比较要报清楚
+TEST(CompileDriverTest, ASIMOVRejectsOrderingCompares)
+{
+    const std::string source = "fn less(a: i32, b: i32) -> i32 {\n"
+                               "    if (a < b) return 1;\n"
+                               "    return 0;\n"
+                               "}\n"
+                               "fn main() -> i32 { return 0; }\n";
+    const std::vector<CompileInput> inputs = {{.path = "less.mo", .source = source, .output_path = ""}};
+    for (unsigned opt_level : {0u, 2u})
+    {
+        SCOPED_TRACE(opt_level);
+        std::vector<CompileResult> results = compile_files(inputs, {.target = DriverTarget::ASIMOV, .opt_level = opt_level});
+        ASSERT_FALSE(results[0].ok);
+        ASSERT_FALSE(results[0].errors.empty());
+        EXPECT_NE(results[0].errors.front().find("`slt` compare"), std::string::npos) << results[0].errors.front();
+        EXPECT_NE(results[0].errors.front().find("not supported on ASIMOV"), std::string::npos);
+    }
+
+    // RISC-V has the branches for it
+    EXPECT_TRUE(compile_files(inputs, {})[0].ok);
+}
+
+// 给了入口就只编入口调用得到的函数
+TEST(CompileDriverTest, EntryPointsSkipUnreachedFunctions)
+{
+    const std::string source = chain_source(1) + "fn unused(a: i32) -> i32 { return step2(a, a) * 3; }\n";
+    const std::vector<CompileInput> inputs = {{.path = "lib.mo", .source = source, .output_path = ""}};
+
+    std::vector<CompileResult> all = compile_files(inputs, {});
+    std::vector<CompileResult> from_main = compile_files(inputs, {.entry_points = {"main"}});
+    std::vector<CompileResult> from_leaf = compile_files(inputs, {.entry_points = {"step0"}});
+    ASSERT_TRUE(all[0].ok);
+    ASSERT_TRUE(from_main[0].ok) << from_main[0].errors.front();
+    ASSERT_TRUE(from_leaf[0].ok) << from_leaf[0].errors.front();
+    EXPECT_EQ(all[0].functions, 5u);
+    EXPECT_EQ(from_main[0].functions, 4u);
+    EXPECT_EQ(from_leaf[0].functions, 1u);
+    EXPECT_LT(from_main[0].output.size(), all[0].output.size());
+}
@@ -0,0 +1,206 @@
+#include <gtest/gtest.h>
+
+#include "src/frame_packing.h"
+#include "src/ir.h"
+#include "src/machine.h"
+#include "src/targets/asimov_target.h"
+
+using namespace ASIMOV;
+
+namespace
+{
+    MOperand reg(unsigned r, bool def = false) { return MOperand::create_reg(r, def); }
+    MOperand block(MachineBasicBlock *bb) { return MOperand::create_basic_block(bb); }
+
+    MachineInst *emit(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+    {
+        bb->append(std::make_unique<MachineInst>(opcode, ops));
+        return bb->instructions().back().get();
+    }
+
+    MachineInst *terminator(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+    {
+        MachineInst *mi = emit(bb, opcode, ops);
+        if (opcode != RET)
+            mi->set_flag(MIFlag::Branch);
+        mi->set_flag(MIFlag::Terminator);
+        return mi;
+    }
+
+    // Frame indices the instructions of `mf` address, in order
+    std::vector<int> accessed_slots(const MachineFunction *mf)
+    {
+        std::vector<int> result;
+        for (const auto &mbb : mf->basic_blocks())
+        {
+            for (const auto &mi : mbb->instructions())
+            {
+                for (const auto &op : mi->operands())
+                {
+                    if (op.is_mem_fi())
+                        result.push_back(op.mem_fi().frame_index);
+                }
+            }
+        }
+        return result;
+    }
+
+    class FramePackingTest : public ::testing::Test
+    {
+    protected:
+        ASIMOVRegisterInfo tri_;
+        ASIMOVTargetInstInfo tii_;
+        Module module_;
+        MachineModule mm_{&module_};
+
+        void SetUp() override { mm_.set_target_info(&tri_, &tii_); }
+
+        MachineFunction *function(const std::string &name)
+        {
+            return mm_.create_machine_function(module_.create_function(name, module_.get_void_type(), {}));
+        }
+
+        void spill(MachineBasicBlock *bb, unsigned r, int slot) { tii_.insert_store_to_stack(*bb, bb->end(), r, slot, 0); }
+        void reload(MachineBasicBlock *bb, unsigned r, int slot) { tii_.insert_load_from_stack(*bb, bb->end(), r, slot, 0); }
+    };
+}
+
+TEST_F(FramePackingTest, SharesSlotsThatAreNeverLiveTogether)
+{
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    const int a = mf->frame()->create_spill_slot(GR32, 4, 4);
+    const int b = mf->frame()->create_spill_slot(GR32, 4, 4);
+    const int c = mf->frame()->create_spill_slot(GR32, 4, 4);
+    spill(entry, R1, a);
+    reload(entry, R1, a);
+    spill(entry, R2, b);
+    spill(entry, R3, c);
+    reload(entry, R2, b);
+    reload(entry, R3, c);
+    terminator(entry, RET, {});
+    mf->build_cfg();
+
+    FramePackingStats stats = pack_frame_objects(*mf);
+    EXPECT_EQ(stats.spill_slots, 3u);
+    EXPECT_EQ(stats.merged_slots, 1u);
+    EXPECT_EQ(stats.bytes_saved, 4);
+    // `b` and `c` overlap, so only one of them can take over `a`
+    const std::vector<int> slots = accessed_slots(mf);
+    EXPECT_EQ(slots[0], slots[1]);
+    EXPECT_NE(slots[2], slots[3]);
+    EXPECT_TRUE(slots[0] == slots[2] || slots[0] == slots[3]);
+    EXPECT_EQ(mf->frame()->objects().size(), 2u);
+    EXPECT_EQ(mf->frame()->get_total_frame_size(), 8u);
+}
+
+TEST_F(FramePackingTest, OnlySharesSlotsOfOneSize)
+{
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    const int word = mf->frame()->create_spill_slot(GR32, 4, 4);
+    const int dword = mf->frame()->create_spill_slot(GR32, 8, 8);
+    spill(entry, R1, word);
+    reload(entry, R1, word);
+    spill(entry, R2, dword);
+    reload(entry, R2, dword);
+    terminator(entry, RET, {});
+    mf->build_cfg();
+
+    EXPECT_EQ(pack_frame_objects(*mf).merged_slots, 0u);
+    EXPECT_EQ(accessed_slots(mf), (std::vector<int>{word, word, dword, dword}));
+}
+
+TEST_F(FramePackingTest, KeepsSlotsWhoseAddressIsTaken)
+{
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    const int a = mf->frame()->create_spill_slot(GR32, 4, 4);
+    const int b = mf->frame()->create_spill_slot(GR32, 4, 4);
+    spill(entry, R1, a);
+    reload(entry, R1, a);
+    emit(entry, MOVW, {reg(R2, true), MOperand::create_frame_index(b)});
+    spill(entry, R2, b);
+    reload(entry, R2, b);
+    terminator(entry, RET, {});
+    mf->build_cfg();
+
+    EXPECT_EQ(pack_frame_objects(*mf).merged_slots, 0u);
+    EXPECT_EQ(accessed_slots(mf), (std::vector<int>{a, a, b, b}));
+}
+
+TEST_F(FramePackingTest, FollowsValuesAcrossBlocks)
+{
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *loop = mf->create_block("loop");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    const int outer = mf->frame()->create_spill_slot(GR32, 4, 4);
+    const int inner = mf->frame()->create_spill_slot(GR32, 4, 4);
+    const int after = mf->frame()->create_spill_slot(GR32, 4, 4);
+    spill(entry, R1, outer);
+    // `outer` stays live around the loop, so `inner` can't share with it
+    spill(loop, R2, inner);
+    reload(loop, R2, inner);
+    terminator(loop, JNZ, {reg(R2), block(loop)});
+    reload(exit, R1, outer);
+    spill(exit, R3, after);
+    reload(exit, R3, after);
+    terminator(exit, RET, {});
+    mf->build_cfg();
+
+    FramePackingStats stats = pack_frame_objects(*mf);
+    EXPECT_EQ(stats.merged_slots, 1u);
+    const std::vector<int> slots = accessed_slots(mf);
+    // The loop slot is the hottest and keeps its index; `after` joins it
+    EXPECT_EQ(slots, (std::vector<int>{outer, inner, inner, outer, inner, inner}));
+    EXPECT_FALSE(mf->frame()->is_valid_index(after));
+    EXPECT_GT(mf->frame()->get_frame_object(inner)->access_weight,
+              mf->frame()->get_frame_object(outer)->access_weight);
+}
+
+TEST_F(FramePackingTest, GivesHotObjectsTheSmallOffsets)
+{
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *loop = mf->create_block("loop");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    const int local = mf->frame()->create_fixed_size(nullptr, 4, 4);
+    const int slot = mf->frame()->create_spill_slot(GR32, 4, 4);
+    emit(entry, STORE, {reg(R1), MOperand::create_mem_fi(local, 0)})->set_flag(MIFlag::MayStore);
+    spill(loop, R2, slot);
+    reload(loop, R2, slot);
+    terminator(loop, JNZ, {reg(R2), block(loop)});
+    terminator(exit, RET, {});
+    mf->build_cfg();
+
+    EXPECT_EQ(mf->frame()->get_frame_index_offset(local), 0u);
+    pack_frame_objects(*mf);
+    EXPECT_EQ(mf->frame()->get_frame_index_offset(slot), 0u);
+    EXPECT_EQ(mf->frame()->get_frame_index_offset(local), 4u);
+}
+
+TEST(MachineFrameLayout, FillsAlignmentPadding)
+{
+    MachineFrame frame;
+    const int byte = frame.create_fixed_size(nullptr, 1, 1);
+    const int dword = frame.create_fixed_size(nullptr, 8, 8);
+    const int word = frame.create_fixed_size(nullptr, 4, 4);
+    const int buffer = frame.create_variable_size(nullptr, 8);
+    frame.set_access_weight(byte, 10);
+    frame.set_access_weight(dword, 8);
+
+    EXPECT_EQ(frame.frame_layout(), (std::vector<int>{byte, dword, word, buffer}));
+    EXPECT_EQ(frame.get_frame_index_offset(byte), 0u);
+    EXPECT_EQ(frame.get_frame_index_offset(dword), 8u);
+    // Fits in the padding after `byte` instead of going after `dword`
+    EXPECT_EQ(frame.get_frame_index_offset(word), 4u);
+    EXPECT_EQ(frame.get_frame_index_offset(buffer), 16u);
+    EXPECT_EQ(frame.get_total_frame_size(), 16u);
+
+    // Objects that tie on everything are laid out by index
+    MachineFrame ties;
+    const int first = ties.create_fixed_size(nullptr, 4, 4);
+    const int second = ties.create_fixed_size(nullptr, 4, 4);
+    EXPECT_EQ(ties.frame_layout(), (std::vector<int>{first, second}));
+}
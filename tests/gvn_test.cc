@@ -0,0 +1,109 @@
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/gvn.h"
+#include "tests/ir_test_util.h"
+
+namespace
+{
+    using ir_test::count_opcode;
+
+    unsigned run_gvn(Function *f)
+    {
+        DominatorTree dom_tree(*f);
+        return eliminate_common_subexpressions(*f, dom_tree);
+    }
+}
+
+TEST(GVN, ReusesFieldAddressesAndLoads)
+{
+    // self.x + self.x * self.y, with every access rebuilt from `self`
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *point = m.get_struct_type("Point", {MemberInfo("x", i32), MemberInfo("y", i32)});
+    Function *f = m.create_function("f", i32, {{"self", m.get_pointer_type(point)}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    Value *self = f->arg(0);
+    Value *x1 = builder.create_load(builder.create_struct_gep(self, 0));
+    Value *x2 = builder.create_load(builder.create_struct_gep(self, 0));
+    Value *y = builder.create_load(builder.create_struct_gep(self, 1));
+    Value *product = builder.create_mul(x2, y);
+    Value *sum = builder.create_add(x1, product);
+    Value *swapped = builder.create_add(builder.create_mul(y, x1), x1); // same value, operands swapped
+    ReturnInst *ret = builder.create_ret(builder.create_sub(sum, swapped));
+
+    EXPECT_EQ(run_gvn(f), 4u);
+    EXPECT_EQ(count_opcode(f, Opcode::GetElementPtr), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::Mul), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Add), 1u);
+    auto *sub = dynamic_cast<BinaryInst *>(ret->value());
+    ASSERT_NE(sub, nullptr);
+    EXPECT_EQ(sub->left(), sub->right());
+}
+
+TEST(GVN, StoresAndCallsEndLoadReuse)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *callee = m.create_function("touch", m.get_void_type(), {});
+    Function *f = m.create_function("f", i32, {{"p", m.get_pointer_type(i32)}, {"v", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    Value *p = f->arg(0);
+    Value *before = builder.create_load(p);
+    builder.create_store(f->arg(1), p);
+    Value *forwarded = builder.create_load(p); // reads the stored value
+    builder.create_call(callee, {}, "");
+    Value *after_call = builder.create_load(p);
+    Value *sum = builder.create_add(builder.create_add(before, forwarded), after_call);
+    builder.create_ret(sum);
+
+    EXPECT_EQ(run_gvn(f), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 2u);
+    auto *outer = static_cast<BinaryInst *>(sum);
+    auto *inner = static_cast<BinaryInst *>(outer->left());
+    EXPECT_EQ(inner->right(), f->arg(1));
+    EXPECT_EQ(outer->right(), after_call);
+}
+
+TEST(GVN, ScopesFollowTheDominatorTree)
+{
+    // entry computes a+b; both arms compute it again, and so does each arm's
+    // own a*b, which must not leak into the other arm or the merge block
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}, {"a", i32}, {"b", i32}, {"p", m.get_pointer_type(i32)}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *then_bb = f->create_basic_block("then");
+    BasicBlock *else_bb = f->create_basic_block("else");
+    BasicBlock *merge = f->create_basic_block("merge");
+    Value *a = f->arg(1), *b = f->arg(2), *p = f->arg(3);
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    Value *sum = builder.create_add(a, b);
+    builder.create_load(p);
+    builder.create_cond_br(f->arg(0), then_bb, else_bb);
+    builder.set_insert_point(then_bb);
+    builder.create_add(b, a);
+    builder.create_mul(a, b);
+    builder.create_br(merge);
+    builder.set_insert_point(else_bb);
+    builder.create_add(a, b);
+    builder.create_mul(a, b);
+    builder.create_store(a, p);
+    builder.create_br(merge);
+    builder.set_insert_point(merge);
+    builder.create_mul(a, b);
+    Value *reload = builder.create_load(p); // else stored to p
+    builder.create_ret(builder.create_add(builder.create_add(sum, reload), a));
+
+    EXPECT_EQ(run_gvn(f), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::Mul), 3u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 2u);
+}
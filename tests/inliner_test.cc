@@ -0,0 +1,243 @@
+#include <algorithm>
+
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/inliner.h"
+#include "tests/ir_test_util.h"
+
+namespace
+{
+    using ir_test::count_opcode;
+
+    // The shape IRGenerator emits for `fn add1(x: i32) -> i32 { return x + 1; }`
+    Function *make_add1(Module &m)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        Function *f = m.create_function("add1", i32, {{"x", i32}});
+        IRBuilder builder(&m);
+        builder.set_insert_point(f->create_basic_block("entry"));
+        AllocaInst *slot = builder.create_alloca(i32, "x.addr");
+        builder.create_store(f->arg(0), slot);
+        builder.create_ret(builder.create_add(builder.create_load(slot), m.get_constant_int(i32, 1)));
+        return f;
+    }
+
+    // max(a, b) with a return on each arm
+    Function *make_max(Module &m)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        Function *f = m.create_function("max", i32, {{"a", i32}, {"b", i32}});
+        BasicBlock *entry = f->create_basic_block("entry");
+        BasicBlock *then_bb = f->create_basic_block("then");
+        BasicBlock *else_bb = f->create_basic_block("else");
+        IRBuilder builder(&m);
+        builder.set_insert_point(entry);
+        builder.create_cond_br(builder.create_icmp(ICmpInst::SGT, f->arg(0), f->arg(1)), then_bb, else_bb);
+        builder.set_insert_point(then_bb);
+        builder.create_ret(f->arg(0));
+        builder.set_insert_point(else_bb);
+        builder.create_ret(f->arg(1));
+        return f;
+    }
+}
+
+TEST(Inliner, InlinesStraightLineCallee)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *add1 = make_add1(m);
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_alloca(i32, "local");
+    CallInst *call = builder.create_call(add1, {f->arg(0)}, "r");
+    Value *product = builder.create_mul(call, f->arg(0));
+    builder.create_ret(product);
+
+    ASSERT_TRUE(is_inlinable(*call));
+    inline_call(call);
+
+    EXPECT_EQ(count_opcode(f, Opcode::Call), 0u);
+    // The callee's slot joins the caller's in the entry block
+    EXPECT_EQ(entry->first_instruction()->opcode(), Opcode::Alloca);
+    EXPECT_EQ(entry->first_instruction()->next()->opcode(), Opcode::Alloca);
+    auto *sum = dynamic_cast<Instruction *>(static_cast<BinaryInst *>(product)->left());
+    ASSERT_NE(sum, nullptr);
+    EXPECT_EQ(sum->opcode(), Opcode::Add);
+    ASSERT_EQ(f->basic_blocks().size(), 3u);
+    EXPECT_EQ(entry->successors(), std::vector<BasicBlock *>{f->basic_blocks()[2]});
+    // The callee is untouched
+    EXPECT_EQ(count_opcode(add1, Opcode::Add), 1u);
+}
+
+TEST(Inliner, ReturnsMergeIntoPhi)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *max = make_max(m);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}, {"x", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *call_bb = f->create_basic_block("call");
+    BasicBlock *join = f->create_basic_block("join");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_cond_br(f->arg(0), call_bb, join);
+    builder.set_insert_point(call_bb);
+    CallInst *call = builder.create_call(max, {f->arg(1), m.get_constant_int(i32, 3)}, "m");
+    builder.create_br(join);
+    builder.set_insert_point(join);
+    PhiInst *result = builder.create_phi(i32);
+    result->add_incoming(m.get_constant_int(i32, 0), entry);
+    result->add_incoming(call, call_bb);
+    builder.create_ret(result);
+
+    inline_call(call);
+
+    // call -> max.entry -> {then, else} -> call.cont -> join
+    ASSERT_EQ(f->basic_blocks().size(), 7u);
+    BasicBlock *rest = f->basic_blocks()[3];
+    EXPECT_EQ(rest->name(), "call.cont");
+    EXPECT_EQ(result->get_incoming_block(1), rest);
+    auto *returned = dynamic_cast<PhiInst *>(result->get_incoming_value(1));
+    ASSERT_NE(returned, nullptr);
+    EXPECT_EQ(returned->parent(), rest);
+    ASSERT_EQ(returned->num_incoming(), 2u);
+    std::vector<Value *> values{returned->get_incoming_value(0), returned->get_incoming_value(1)};
+    std::sort(values.begin(), values.end());
+    std::vector<Value *> expected{f->arg(1), m.get_constant_int(i32, 3)};
+    std::sort(expected.begin(), expected.end());
+    EXPECT_EQ(values, expected);
+    EXPECT_EQ(rest->predecessors().size(), 2u);
+    EXPECT_EQ(join->predecessors(), (std::vector<BasicBlock *>{entry, rest}));
+}
+
+TEST(Inliner, CostModelWeighsSizeHotnessAndRecursion)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *add1 = make_add1(m);
+    Function *rec = m.create_function("rec", i32, {{"n", i32}});
+    Function *f = m.create_function("f", i32, {{"a", i32}, {"c", m.get_boolean_type()}});
+    IRBuilder builder(&m);
+    builder.set_insert_point(rec->create_basic_block("entry"));
+    builder.create_ret(builder.create_call(rec, {rec->arg(0)}, "again"));
+
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *loop = f->create_basic_block("loop");
+    BasicBlock *exit = f->create_basic_block("exit");
+    builder.set_insert_point(entry);
+    CallInst *cold = builder.create_call(add1, {f->arg(0)}, "cold");
+    CallInst *recursive = builder.create_call(rec, {cold}, "rec");
+    builder.create_br(loop);
+    builder.set_insert_point(loop);
+    CallInst *hot = builder.create_call(add1, {m.get_constant_int(i32, 7)}, "hot");
+    builder.create_cond_br(f->arg(1), loop, exit);
+    builder.set_insert_point(exit);
+    builder.create_ret(builder.create_add(recursive, hot));
+
+    EXPECT_FALSE(is_inlinable(*recursive));
+    // add1 has four instructions; the call and its argument come off, and
+    // a constant argument takes off a bonus on top
+    InlineParams params;
+    EXPECT_EQ(inline_cost(*cold, params), 2);
+    EXPECT_EQ(inline_cost(*hot, params), 2 - params.constant_arg_bonus);
+
+    // Only sites inside loops clear a negative threshold
+    params.threshold = -100;
+    params.hot_threshold = 2;
+    AnalysisManager analyses;
+    EXPECT_EQ(inline_calls(m, analyses, params), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Call), 2u);
+    EXPECT_EQ(cold->parent(), entry);
+
+    // A hint makes any site hot
+    params.is_hot = [&](const CallInst &call) { return &call == cold; };
+    EXPECT_EQ(inline_calls(m, analyses, params), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Call), 1u);
+}
+
+TEST(Inliner, ProfileCountsDecideHotness)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *add1 = make_add1(m);
+    add1->entry_block()->set_profile_count(4000);
+    Function *f = m.create_function("f", i32, {{"a", i32}, {"c", m.get_boolean_type()}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *loop = f->create_basic_block("loop");
+    BasicBlock *exit = f->create_basic_block("exit");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    CallInst *never = builder.create_call(add1, {m.get_constant_int(i32, 7)}, "never");
+    builder.create_br(loop);
+    builder.set_insert_point(loop);
+    CallInst *rare = builder.create_call(add1, {f->arg(0)}, "rare");
+    builder.create_cond_br(f->arg(1), loop, exit);
+    builder.set_insert_point(exit);
+    CallInst *often = builder.create_call(add1, {rare}, "often");
+    builder.create_ret(often);
+    entry->set_profile_count(0);
+    loop->set_profile_count(3);
+    exit->set_profile_count(2000);
+
+    // `never` would clear the normal threshold and `rare` the hot one its
+    // loop gave it without counts
+    InlineParams params;
+    params.threshold = 1;
+    params.hot_threshold = 2;
+    params.cold_threshold = -20;
+    ASSERT_LE(inline_cost(*never, params), params.threshold);
+    AnalysisManager analyses;
+    EXPECT_EQ(inline_calls(m, analyses, params), 1u);
+    EXPECT_EQ(never->parent(), entry);
+    EXPECT_EQ(rare->parent(), loop);
+    EXPECT_EQ(count_opcode(f, Opcode::Call), 2u);
+
+    // The copy runs for this site's calls only, half of add1's
+    for (BasicBlock *bb : f->basic_blocks())
+    {
+        if (bb != entry && bb != loop && bb != exit)
+        {
+            EXPECT_EQ(bb->profile_count(), 2000u) << bb->name();
+        }
+    }
+}
+
+TEST(Inliner, PipelineReducesMethodCallToFieldLoad)
+{
+    // impl Point { fn x(self) -> i32 { return self.x; } }, called on `p`
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *point = m.get_struct_type("Point", {MemberInfo("x", i32), MemberInfo("y", i32)});
+    PointerType *point_ptr = m.get_pointer_type(point);
+    Function *getter = m.create_function("Point.x", i32, {{"this", point_ptr}});
+    getter->set_instance_method(true);
+    IRBuilder builder(&m);
+    builder.set_insert_point(getter->create_basic_block("entry"));
+    AllocaInst *this_slot = builder.create_alloca(point_ptr, "this.addr");
+    builder.create_store(getter->arg(0), this_slot);
+    builder.create_ret(builder.create_load(builder.create_struct_gep(builder.create_load(this_slot), 0)));
+
+    Function *f = m.create_function("f", i32, {{"p", point_ptr}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    builder.set_insert_point(entry);
+    Value *a = builder.create_call(getter, {f->arg(0)}, "a");
+    Value *b = builder.create_call(getter, {f->arg(0)}, "b");
+    builder.create_ret(builder.create_add(a, b));
+
+    PassManager pm;
+    add_inliner_passes(pm);
+    EXPECT_TRUE(pm.run(m));
+
+    // Both copies read the same field, so GVN leaves one load
+    ASSERT_EQ(f->basic_blocks().size(), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Call), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 1u);
+    auto *ret = dynamic_cast<ReturnInst *>(entry->last_instruction());
+    ASSERT_NE(ret, nullptr);
+    auto *sum = dynamic_cast<BinaryInst *>(ret->value());
+    ASSERT_NE(sum, nullptr);
+    EXPECT_EQ(sum->left(), sum->right());
+}
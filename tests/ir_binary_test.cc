@@ -0,0 +1,197 @@
+#include <sstream>
+
+#include "gtest/gtest.h"
+#include "src/ir_binary.h"
+#include "src/ir_builder.h"
+#include "src/ir_printer.h"
+
+namespace
+{
+    std::string print(const Module &m)
+    {
+        std::ostringstream os;
+        IRPrinter::print_module(m, os);
+        return os.str();
+    }
+
+    // Structs that hold and point at each other, globals with aggregate
+    // initializers, a loop with phis and a call between functions
+    void make_module(Module &m)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        IntegerType *i64 = m.get_integer_type(64);
+        FloatType *f64 = m.get_float_type(64);
+
+        StructType *node = m.get_struct_type("Node", {});
+        StructType *pair = m.get_struct_type("Pair", {{"x", i32}, {"y", f64}});
+        node->set_body({{"value", pair}, {"next", m.get_pointer_type(node)}});
+
+        ConstantStruct *origin = m.get_constant_struct(pair, {m.get_constant_int(i32, 7), m.get_constant_fp(f64, -0.0)});
+        GlobalVariable *g_origin = m.create_global_variable(m.get_pointer_type(pair), false, origin, "origin");
+        ArrayType *table = m.get_array_type(i64, 3);
+        m.create_global_variable(m.get_pointer_type(table), true,
+                                 m.get_constant_array(table, {m.get_constant_int(i64, 1), m.get_constant_int(i64, 2),
+                                                              m.get_constant_int(i64, uint64_t(-3))}),
+                                 "table");
+        m.create_global_variable(m.get_pointer_type(m.get_array_type(m.get_integer_type(8), 6)), true,
+                                 m.get_constant_string("hello"), "greeting");
+        m.create_global_variable(m.get_pointer_type(m.get_pointer_type(pair)), false, g_origin, "origin_ptr");
+
+        IRBuilder builder(&m);
+        Function *square = m.create_function("square", i32, {{"x", i32}});
+        square->set_internal(true);
+        builder.set_insert_point(square->create_basic_block("entry"));
+        builder.create_ret(builder.create_mul(square->arg(0), square->arg(0), "sq"));
+
+        // sum of square(i) for i < n
+        Function *sum = m.create_function("sum", i32, {{"n", i32}});
+        BasicBlock *entry = sum->create_basic_block("entry");
+        BasicBlock *loop = sum->create_basic_block("loop");
+        BasicBlock *exit = sum->create_basic_block("exit");
+        builder.set_insert_point(entry);
+        AllocaInst *slot = builder.create_alloca(pair, "slot");
+        Value *field = builder.create_struct_gep(slot, 0, "slot.x");
+        builder.create_store(sum->arg(0), field);
+        builder.create_br(loop);
+        builder.set_insert_point(loop);
+        PhiInst *i = builder.create_phi(i32, "i");
+        PhiInst *acc = builder.create_phi(i32, "acc");
+        CallInst *sq = builder.create_call(square, {i}, "s");
+        sq->set_tail_call(true);
+        Value *acc_next = builder.create_add(acc, sq, "acc.next");
+        Value *i_next = builder.create_add(i, builder.get_int32(1), "i.next");
+        Value *more = builder.create_icmp(ICmpInst::SLT, i_next, sum->arg(0), "more");
+        BranchInst *latch = builder.create_cond_br(more, loop, exit);
+        latch->set_branch_weights(90, 10);
+        i->add_incoming(builder.get_int32(0), entry);
+        i->add_incoming(i_next, loop);
+        acc->add_incoming(builder.get_int32(0), entry);
+        acc->add_incoming(acc_next, loop);
+        builder.set_insert_point(exit);
+        Value *wide = builder.create_sext(acc_next, i64, "wide");
+        builder.create_ret(builder.create_trunc(wide, i32, "narrow"));
+        loop->set_profile_count(100);
+
+        m.create_function("external", m.get_void_type(), {{"p", m.get_pointer_type(node)}});
+    }
+}
+
+TEST(IRBinary, RoundTripsAModule)
+{
+    Module m("demo");
+    make_module(m);
+    const std::vector<uint8_t> bytes = serialize_module(m);
+
+    std::string err;
+    std::unique_ptr<Module> loaded = ModuleReader::load_module(bytes, &err);
+    ASSERT_TRUE(loaded) << err;
+    EXPECT_EQ(loaded->name(), "demo");
+    EXPECT_EQ(print(*loaded), print(m));
+    // Nothing that isn't printed goes missing either
+    EXPECT_EQ(serialize_module(*loaded), bytes);
+
+    Function *sum = loaded->get_function("sum");
+    BasicBlock *loop = sum->basic_blocks()[1];
+    EXPECT_EQ(loop->profile_count(), 100u);
+    EXPECT_FALSE(sum->entry_block()->has_profile_count());
+    auto *latch = static_cast<BranchInst *>(loop->get_terminator());
+    EXPECT_EQ(latch->true_weight(), 90u);
+    EXPECT_EQ(latch->false_weight(), 10u);
+    EXPECT_EQ(loop->predecessors().size(), 2u);
+    EXPECT_TRUE(loaded->get_function("square")->is_internal());
+
+    StructType *node = loaded->try_get_named_global_type("Node");
+    ASSERT_NE(node, nullptr);
+    EXPECT_EQ(node->size(), m.try_get_named_global_type("Node")->size());
+    EXPECT_EQ(node->get_member_type(1), loaded->get_pointer_type(node));
+}
+
+TEST(IRBinary, LoadsBodiesOnFirstUse)
+{
+    Module m;
+    make_module(m);
+
+    std::string err;
+    std::unique_ptr<ModuleReader> reader = ModuleReader::parse(serialize_module(m), &err);
+    ASSERT_TRUE(reader) << err;
+    Module &loaded = reader->module();
+    ASSERT_EQ(loaded.functions().size(), 3u);
+    ASSERT_EQ(loaded.global_variables().size(), 4u);
+    for (Function *func : loaded.functions())
+        EXPECT_TRUE(func->basic_blocks().empty()) << func->name();
+    EXPECT_TRUE(reader->is_materialized(loaded.get_function("external")));
+
+    Function *square = reader->get_function("square", &err);
+    ASSERT_NE(square, nullptr) << err;
+    EXPECT_TRUE(reader->is_materialized(square));
+    EXPECT_EQ(square->basic_blocks().size(), 1u);
+    EXPECT_FALSE(reader->is_materialized(loaded.get_function("sum")));
+    EXPECT_TRUE(loaded.get_function("sum")->basic_blocks().empty());
+
+    // The call in `sum` refers to the function loaded before
+    Function *sum = reader->get_function("sum", &err);
+    ASSERT_NE(sum, nullptr) << err;
+    auto *call = static_cast<CallInst *>(sum->basic_blocks()[1]->first_non_phi());
+    EXPECT_EQ(call->called_function(), square);
+    EXPECT_TRUE(call->is_tail_call());
+    EXPECT_TRUE(reader->materialize(sum));
+    EXPECT_EQ(sum->basic_blocks().size(), 3u);
+}
+
+TEST(IRBinary, UsesBeforeDefinitionsInBlockOrder)
+{
+    // `late` dominates `early` but comes after it in the block list
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *early = f->create_basic_block("early");
+    BasicBlock *late = f->create_basic_block("late");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_br(late);
+    builder.set_insert_point(late);
+    Value *doubled = builder.create_add(f->arg(0), f->arg(0), "doubled");
+    builder.create_br(early);
+    builder.set_insert_point(early);
+    builder.create_ret(builder.create_mul(doubled, doubled, "squared"));
+
+    std::string err;
+    std::unique_ptr<Module> loaded = ModuleReader::load_module(serialize_module(m), &err);
+    ASSERT_TRUE(loaded) << err;
+    EXPECT_EQ(print(*loaded), print(m));
+    Function *g = loaded->get_function("f");
+    Instruction *squared = g->basic_blocks()[1]->first_instruction();
+    EXPECT_EQ(squared->operand(0), g->basic_blocks()[2]->first_instruction());
+}
+
+TEST(IRBinary, RejectsBrokenInput)
+{
+    Module m;
+    make_module(m);
+    std::vector<uint8_t> bytes = serialize_module(m);
+
+    std::string err;
+    EXPECT_FALSE(ModuleReader::parse({1, 2, 3}, &err));
+    EXPECT_EQ(err, "not a binary IR module");
+
+    std::vector<uint8_t> truncated(bytes.begin(), bytes.end() - 1);
+    EXPECT_FALSE(ModuleReader::parse(truncated, &err));
+    EXPECT_NE(err.find("binary IR"), std::string::npos);
+
+    // A broken body only shows once it is loaded, and leaves a declaration.
+    // The last two bytes are the operand count and operand of `ret narrow`
+    std::vector<uint8_t> corrupt = bytes;
+    corrupt[corrupt.size() - 2] = 0x7f;
+    std::unique_ptr<ModuleReader> bad = ModuleReader::parse(corrupt, &err);
+    ASSERT_TRUE(bad) << err;
+    EXPECT_TRUE(bad->materialize(bad->module().get_function("square")));
+    EXPECT_EQ(bad->get_function("sum", &err), nullptr);
+    EXPECT_NE(err.find("`sum`"), std::string::npos) << err;
+    EXPECT_TRUE(bad->module().get_function("sum")->basic_blocks().empty());
+    EXPECT_FALSE(bad->is_materialized(bad->module().get_function("sum")));
+
+    std::unique_ptr<ModuleReader> reader = ModuleReader::parse(bytes, &err);
+    ASSERT_TRUE(reader) << err;
+    EXPECT_TRUE(reader->materialize_all(&err)) << err;
+}
@@ -55,6 +55,75 @@ TEST(IRBuilder, ComplexTypeSupport)
     EXPECT_EQ(gep->type(), m.get_pointer_type(i32));
 }
 
+TEST(IRBuilder, FoldsConstantOperations)
+{
+    Module m;
+    IntegerType *i8 = m.get_integer_type(8);
+    IntegerType *i32 = m.get_integer_type(32);
+    FloatType *f64 = m.get_float_type(64);
+    Function *f = m.create_function("func", i32, {});
+    BasicBlock *bb = f->create_basic_block("bb");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(bb);
+    builder.set_folding(true);
+
+    EXPECT_EQ(builder.create_add(m.get_constant_int(i32, 1), m.get_constant_int(i32, 2)), m.get_constant_int(i32, 3));
+    // Results wrap to the type's width
+    EXPECT_EQ(builder.create_add(m.get_constant_int(i8, 127), m.get_constant_int(i8, 1)), m.get_constant_int(i8, -128));
+    EXPECT_EQ(builder.create_sdiv(m.get_constant_int(i32, -7), m.get_constant_int(i32, 2)), m.get_constant_int(i32, -3));
+    EXPECT_EQ(builder.create_fcmp(FCmpInst::OLT, m.get_constant_fp(f64, 1.5), m.get_constant_fp(f64, 2.0)), m.get_constant_bool(true));
+    EXPECT_EQ(builder.create_icmp(ICmpInst::SLT, m.get_constant_int(i32, -1), m.get_constant_int(i32, 1)), m.get_constant_bool(true));
+    EXPECT_EQ(builder.create_icmp(ICmpInst::ULT, m.get_constant_int(i32, -1), m.get_constant_int(i32, 1)), m.get_constant_bool(false));
+    EXPECT_EQ(builder.create_sext(m.get_constant_int(i8, -1), i32, "sext"), m.get_constant_int(i32, -1));
+    EXPECT_EQ(builder.create_sitofp(m.get_constant_int(i32, -2), f64, "conv"), m.get_constant_fp(f64, -2.0));
+    EXPECT_EQ(builder.create_fptosi(m.get_constant_fp(f64, 3.75), i32, "conv"), m.get_constant_int(i32, 3));
+    EXPECT_EQ(bb->first_instruction(), nullptr);
+
+    // Operations without a compile-time result are still emitted
+    Value *div = builder.create_sdiv(m.get_constant_int(i32, 1), m.get_constant_int(i32, 0));
+    EXPECT_EQ(div, bb->last_instruction());
+    Value *conv = builder.create_fptosi(m.get_constant_fp(f64, 1e20), i32, "conv");
+    EXPECT_EQ(conv, bb->last_instruction());
+}
+
+TEST(IRBuilder, SimplifiesIdentities)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    IntegerType *u32 = m.get_integer_type(32, true);
+    Function *f = m.create_function("func", i32, {{"x", i32}, {"u", u32}});
+    BasicBlock *bb = f->create_basic_block("bb");
+    Value *x = f->arg(0);
+    Value *u = f->arg(1);
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(bb);
+    builder.set_folding(true);
+
+    EXPECT_EQ(builder.create_add(x, m.get_constant_int(i32, 0)), x);
+    EXPECT_EQ(builder.create_add(m.get_constant_int(i32, 0), x), x);
+    EXPECT_EQ(builder.create_mul(x, m.get_constant_int(i32, 1)), x);
+    EXPECT_EQ(builder.create_mul(x, m.get_constant_int(i32, 0)), m.get_constant_int(i32, 0));
+    EXPECT_EQ(builder.create_sub(x, x), m.get_constant_int(i32, 0));
+    EXPECT_EQ(bb->first_instruction(), nullptr);
+
+    auto *shl = dynamic_cast<BinaryInst *>(builder.create_mul(m.get_constant_int(i32, 8), x));
+    ASSERT_TRUE(shl);
+    EXPECT_EQ(shl->opcode(), Opcode::Shl);
+    EXPECT_EQ(shl->left(), x);
+    EXPECT_EQ(shl->right(), m.get_constant_int(i32, 3));
+
+    auto *lshr = dynamic_cast<BinaryInst *>(builder.create_udiv(u, m.get_constant_int(u32, 16)));
+    ASSERT_TRUE(lshr);
+    EXPECT_EQ(lshr->opcode(), Opcode::LShr);
+
+    // Signed division by a power of two is not a shift
+    auto *sdiv = dynamic_cast<BinaryInst *>(builder.create_sdiv(x, m.get_constant_int(i32, 4)));
+    ASSERT_TRUE(sdiv);
+    EXPECT_EQ(sdiv->opcode(), Opcode::SDiv);
+}
+
 // TEST(BoundaryConditions, NullOperand) {
 //     Module m;
 //     IntegerType *i32 = m.get_integer_type( 32);
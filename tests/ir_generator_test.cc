@@ -2380,3 +2380,128 @@ TEST_F(IrGeneratorTest, NestedStructs)
     }
     EXPECT_EQ(gep_count, 4) << "Should have 4 GEPs for nested member access";
 }
+
+TEST_F(IrGeneratorTest, ParallelFunctionBodies)
+{
+    /*
+        fn f0(a: i32) -> i32 { return a + 1; }
+        fn f1(a: i32) -> i32 { return a + 2; }
+        ...
+    */
+    constexpr int num_functions = 32;
+    ast::Program program;
+    for (int i = 0; i < num_functions; ++i)
+    {
+        auto fn = create_test_function(ast::Type::create_int());
+        fn->name = "f" + std::to_string(i);
+        fn->add_param("a", ast::Type::create_int());
+        fn->body.push_back(std::make_unique<ast::ReturnStmt>(
+            std::make_unique<ast::BinaryExpr>(
+                TokenType::Plus,
+                std::make_unique<ast::VariableExpr>("a"),
+                std::make_unique<ast::IntegerLiteralExpr>(i + 1))));
+        program.functions.push_back(std::move(fn));
+    }
+
+    ThreadPool pool(4);
+    generator.set_thread_pool(&pool);
+    generate(program);
+    EXPECT_FALSE(module.is_concurrent());
+
+    ASSERT_EQ(module.functions().size(), num_functions);
+    for (int i = 0; i < num_functions; ++i)
+    {
+        Function *func = module.get_function("f" + std::to_string(i));
+        ASSERT_TRUE(func);
+        EXPECT_TRUE(find_return(func));
+
+        // Every parameter load reads the function's own alloca, and the shared
+        // constant is the uniqued one
+        EXPECT_TRUE(check_instruction(func, [&](const Instruction &inst)
+                                      {
+                                          auto *load = dynamic_cast<const LoadInst *>(&inst);
+                                          auto *addr = load ? dynamic_cast<Instruction *>(load->operand(0)) : nullptr;
+                                          return addr && addr->parent()->parent_function() == func; }));
+        EXPECT_TRUE(check_instruction(func, [&](const Instruction &inst)
+                                      { return inst.opcode() == Opcode::Add &&
+                                               inst.operand(1) == module.get_constant_int(32, i + 1); }));
+    }
+}
+
+TEST_F(IrGeneratorTest, EntryPointsLowerOnlyReachableBodies)
+{
+    /*
+        fn main() -> i32 { return a(1); }
+        fn a(x: i32) -> i32 { return b(x); }
+        fn b(x: i32) -> i32 { return a(x); }
+        fn lib(x: i32) -> i32 { return b(x); }
+        fn g0(x: i32) -> i32 { return x; }  // g0 to g7
+        fn lib2(x: i32) -> i32 { return g0(x) + ... + g7(x); }
+    */
+    auto call = [](const std::string &callee, ast::ExprPtr arg)
+    {
+        std::vector<ast::ExprPtr> args;
+        args.push_back(std::move(arg));
+        return std::make_unique<ast::CallExpr>(callee, std::move(args));
+    };
+    auto function = [](const std::string &name, ast::ExprPtr result, bool has_param = true)
+    {
+        auto fn = std::make_unique<ast::FunctionDecl>();
+        fn->name = name;
+        fn->return_type = ast::Type::create_int();
+        if (has_param)
+        {
+            fn->add_param("x", ast::Type::create_int());
+        }
+        fn->body.push_back(std::make_unique<ast::ReturnStmt>(std::move(result)));
+        return fn;
+    };
+
+    constexpr int num_leaves = 8;
+    ast::Program program;
+    program.functions.push_back(function("main", call("a", std::make_unique<ast::IntegerLiteralExpr>(1)), false));
+    program.functions.push_back(function("a", call("b", std::make_unique<ast::VariableExpr>("x"))));
+    program.functions.push_back(function("b", call("a", std::make_unique<ast::VariableExpr>("x"))));
+    program.functions.push_back(function("lib", call("b", std::make_unique<ast::VariableExpr>("x"))));
+    ast::ExprPtr sum = call("g0", std::make_unique<ast::VariableExpr>("x"));
+    for (int i = 0; i < num_leaves; ++i)
+    {
+        program.functions.push_back(function("g" + std::to_string(i), std::make_unique<ast::VariableExpr>("x")));
+        if (i > 0)
+        {
+            sum = std::make_unique<ast::BinaryExpr>(TokenType::Plus, std::move(sum),
+                                                    call("g" + std::to_string(i), std::make_unique<ast::VariableExpr>("x")));
+        }
+    }
+    program.functions.push_back(function("lib2", std::move(sum)));
+
+    // 从 main 出发：环里的 a、b 各降低一次，没人调用的 lib 只留声明
+    generator.set_entry_points({"main", "not_a_function"});
+    generate(program);
+    for (const char *name : {"main", "a", "b"})
+    {
+        ASSERT_TRUE(module.get_function(name)) << name;
+        EXPECT_TRUE(find_return(module.get_function(name))) << name;
+    }
+    EXPECT_TRUE(module.get_function("lib")->basic_blocks().empty());
+    EXPECT_TRUE(module.get_function("lib2")->basic_blocks().empty());
+    EXPECT_TRUE(module.get_function("g0")->basic_blocks().empty());
+
+    // 同一波里的 g0 到 g7 在线程池上降低
+    Module pooled;
+    IRGenerator pooled_generator(&pooled);
+    ThreadPool pool(4);
+    pooled_generator.set_thread_pool(&pool);
+    pooled_generator.set_entry_points({"lib2"});
+    pooled_generator.generate(program);
+    EXPECT_FALSE(pooled.is_concurrent());
+    EXPECT_TRUE(find_return(pooled.get_function("lib2")));
+    for (int i = 0; i < num_leaves; ++i)
+    {
+        EXPECT_TRUE(find_return(pooled.get_function("g" + std::to_string(i)))) << i;
+    }
+    for (const char *name : {"main", "a", "b", "lib"})
+    {
+        EXPECT_TRUE(pooled.get_function(name)->basic_blocks().empty()) << name;
+    }
+}
@@ -194,3 +194,68 @@ entry:
 )";
   EXPECT_EQ(os.str(), expected);
 }
+
+TEST(IRPrinterTest, JSONLines)
+{
+  Module module;
+  IRBuilder builder(&module);
+  auto *i32 = module.get_integer_type(32);
+  auto *func = module.create_function("inc", i32, {{"x", i32}});
+  builder.set_insert_point(func->create_basic_block("entry"));
+  auto *sum = builder.create_add(func->arg(0), builder.get_int32(1), "sum");
+  builder.create_ret(sum);
+  module.create_global_variable(module.get_pointer_type(i32), false, builder.get_int32(7), "say\"hi");
+
+  std::ostringstream os;
+  IRPrinter::print_module_json_lines(module, os);
+  std::string expected =
+      R"({"kind":"global","name":"say\"hi","constant":false,"type":"i32*","init":"7"}
+{"kind":"function","name":"inc","return":"i32","args":[{"name":"x","type":"i32"}],"blocks":1}
+{"kind":"block","function":"inc","name":"entry","preds":[]}
+{"kind":"inst","block":"entry","op":"add","name":"sum","type":"i32","operands":["%x","1"]}
+{"kind":"inst","block":"entry","op":"ret","operands":["%sum"]}
+)";
+  EXPECT_EQ(os.str(), expected);
+}
+
+TEST(IRPrinterTest, WriterReusesSpellings)
+{
+  Module module;
+  IRBuilder builder(&module);
+  auto *i32 = module.get_integer_type(32);
+  auto *arr = module.get_array_type(i32, 2);
+  auto *table = module.get_constant_array(arr, {builder.get_int32(1), builder.get_int32(2)});
+  module.create_global_variable(module.get_pointer_type(arr), true, table, "a");
+  module.create_global_variable(module.get_pointer_type(arr), true, table, "b");
+
+  std::ostringstream once;
+  IRPrinter::print_module(module, once);
+
+  // A writer kept across dumps spells each type and constant once, and
+  // prints what the one-shot printer does
+  std::ostringstream os;
+  IRWriter writer(os);
+  writer.write(module);
+  const size_t cached = writer.cached_names();
+  writer.write(module);
+  writer.flush();
+  EXPECT_EQ(writer.cached_names(), cached);
+  EXPECT_EQ(os.str(), once.str() + once.str());
+  EXPECT_EQ(writer.bytes_written(), os.str().size());
+}
+
+TEST(IRPrinterTest, OutputBufferFlushesInChunks)
+{
+  std::ostringstream os;
+  {
+    OutputBuffer out(os, 8);
+    out << "abc" << 42;
+    EXPECT_EQ(os.str(), "");
+    out << ' ' << -7;
+    EXPECT_EQ(os.str(), "abc42 -7");
+    out << 1.5 << ' ';
+    out.write_json_escaped("a\"\n\x01");
+    EXPECT_EQ(out.bytes_written(), 23u);
+  }
+  EXPECT_EQ(os.str(), "abc42 -71.5 a\\\"\\n\\u0001");
+}
@@ -243,6 +243,40 @@ TEST(Module, FunctionManagement)
     EXPECT_EQ(m.functions()[1], f2);
 }
 
+TEST(Module, LookupByName)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    std::vector<Function *> created;
+    for (int i = 0; i < 100; ++i)
+    {
+        created.push_back(m.create_function("f" + std::to_string(i), i32, {}));
+    }
+    Function *shadow = m.create_function("f3", i32, {});
+    for (int i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(m.get_function("f" + std::to_string(i)), created[i]);
+    }
+    EXPECT_NE(m.get_function("f3"), shadow); // the first definition wins
+    EXPECT_EQ(m.get_function("missing"), nullptr);
+
+    GlobalVariable *g = m.create_global_variable(i32, false, m.get_constant_int(i32, 1), "g");
+    EXPECT_EQ(m.get_global_variable("g"), g);
+    EXPECT_EQ(m.get_global_variable("h"), nullptr);
+
+    // Views follow creation order without copying
+    size_t index = 0;
+    for (Function *f : m.functions())
+    {
+        EXPECT_EQ(f, index < created.size() ? created[index] : shadow);
+        ++index;
+    }
+    EXPECT_EQ(index, 101u);
+    EXPECT_EQ(m.functions().back(), shadow);
+    EXPECT_EQ(m.global_variables().size(), 1u);
+    EXPECT_EQ(m.global_variables()[0], g);
+}
+
 TEST(Constant, ConstantInt)
 {
     Module m;
@@ -254,6 +288,75 @@ TEST(Constant, ConstantInt)
     EXPECT_EQ(c1, c2); // should be the same object
 }
 
+TEST(Constant, ManyConstantIntsAreUniqued)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    IntegerType *i64 = m.get_integer_type(64);
+    std::vector<ConstantInt *> first;
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        first.push_back(m.get_constant_int(i32, i));
+    }
+    for (uint64_t i = 0; i < 1000; ++i)
+    {
+        EXPECT_EQ(m.get_constant_int(i32, i), first[i]);
+        EXPECT_EQ(first[i]->value(), i);
+    }
+    // Same value, different type
+    EXPECT_NE(m.get_constant_int(i64, 7), first[7]);
+}
+
+TEST(Constant, ConstantFPKeepsSignedZeroApart)
+{
+    Module m;
+    ConstantFP *pos = m.get_constant_fp(64, 0.0);
+    ConstantFP *neg = m.get_constant_fp(64, -0.0);
+    EXPECT_NE(pos, neg);
+    EXPECT_EQ(m.get_constant_fp(64, 0.0), pos);
+    EXPECT_EQ(m.get_constant_fp(64, -0.0), neg);
+    EXPECT_NE(m.get_constant_fp(32, 0.0), pos);
+}
+
+TEST(Constant, AggregateConstantsAreUniqued)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    ArrayType *arr = m.get_array_type(i32, 2);
+    Constant *one = m.get_constant_int(i32, 1);
+    Constant *two = m.get_constant_int(i32, 2);
+
+    ConstantArray *a = m.get_constant_array(arr, {one, two});
+    EXPECT_EQ(m.get_constant_array(arr, {one, two}), a);
+    EXPECT_NE(m.get_constant_array(arr, {two, one}), a);
+
+    StructType *st = m.get_struct_type_anonymous({{"x", i32}, {"y", i32}});
+    ConstantStruct *s = m.get_constant_struct(st, {one, two});
+    EXPECT_EQ(m.get_constant_struct(st, {one, two}), s);
+
+    ConstantString *str = m.get_constant_string("hello");
+    EXPECT_EQ(m.get_constant_string("hello"), str);
+    EXPECT_NE(m.get_constant_string("hell"), str);
+
+    EXPECT_EQ(m.get_constant_aggregate_zero(arr), m.get_constant_aggregate_zero(arr));
+    EXPECT_EQ(m.get_constant_pointer_null(m.get_pointer_type(i32)),
+              m.get_constant_pointer_null(m.get_pointer_type(i32)));
+}
+
+TEST(Module, StructTypeLookup)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *anon = m.get_struct_type_anonymous({{"x", i32}});
+    EXPECT_EQ(m.get_struct_type_anonymous({{"x", i32}}), anon);
+    EXPECT_NE(m.get_struct_type_anonymous({{"y", i32}}), anon);
+
+    StructType *point = m.get_struct_type("Point", {{"x", i32}, {"y", i32}});
+    EXPECT_EQ(m.get_struct_type("Point", {{"x", i32}, {"y", i32}}), point);
+    EXPECT_EQ(m.try_get_named_global_type("Point"), point);
+    EXPECT_EQ(m.try_get_named_global_type("Missing"), nullptr);
+}
+
 TEST(InstructionSubclasses, PhiInst)
 {
     Module m;
@@ -314,6 +417,97 @@ TEST(InstructionSubclasses, MemoryOperations)
     EXPECT_EQ(store->pointer(), alloca);
 }
 
+TEST(ValueUser, UseListsAndReplaceAllUses)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("func", i32, {});
+    BasicBlock *bb = f->create_basic_block("bb");
+
+    AllocaInst *slot = AllocaInst::create(i32, bb);
+    LoadInst *a = LoadInst::create(slot, bb);
+    LoadInst *b = LoadInst::create(slot, bb);
+    BinaryInst *sum = BinaryInst::create(Opcode::Add, a, a, bb);
+    EXPECT_EQ(slot->users().size(), 2u);
+    EXPECT_EQ(a->users().size(), 2u); // one use per operand slot
+    for (User *user : a->users())
+    {
+        EXPECT_EQ(user, sum);
+    }
+
+    a->replace_all_uses_with(b);
+    EXPECT_FALSE(a->has_uses());
+    EXPECT_EQ(b->users().size(), 2u);
+    EXPECT_EQ(sum->left(), b);
+    EXPECT_EQ(sum->right(), b);
+
+    sum->set_operand(1, a);
+    EXPECT_EQ(a->users().size(), 1u);
+    EXPECT_EQ(b->users().size(), 1u);
+}
+
+TEST(ValueUser, ManyOperandsLeaveInlineStorage)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *callee = m.create_function("callee", i32, {{"a", i32}, {"b", i32}, {"c", i32}, {"d", i32}, {"e", i32}});
+    Function *f = m.create_function("func", i32, {});
+    BasicBlock *bb = f->create_basic_block("bb");
+
+    std::vector<Value *> args;
+    for (uint64_t i = 0; i < 5; ++i)
+    {
+        args.push_back(m.get_constant_int(i32, i));
+    }
+    CallInst *call = CallInst::create(callee, args, bb, "r");
+    ASSERT_EQ(call->num_operands(), 6u);
+    EXPECT_EQ(call->arguments(), args);
+    EXPECT_EQ(callee->users().size(), 1u);
+
+    Value *seven = m.get_constant_int(i32, 7);
+    args[4]->replace_all_uses_with(seven);
+    EXPECT_EQ(call->operand(5), seven);
+    EXPECT_FALSE(args[4]->has_uses());
+    EXPECT_EQ(*seven->users().begin(), call);
+}
+
+TEST(SlabAllocator, RecyclesBySizeClass)
+{
+    SlabAllocator slab;
+    void *a = slab.allocate(40);
+    void *b = slab.allocate(200);
+    EXPECT_NE(a, b);
+    EXPECT_EQ(slab.num_live_objects(), 2u);
+
+    SlabAllocator::release(a, 40);
+    EXPECT_EQ(slab.allocate(40), a); // same size class reuses the slot
+    SlabAllocator::release(b, 200);
+    EXPECT_NE(slab.allocate(40), b);
+
+    void *big = slab.allocate(2 * SlabAllocator::SLAB_SIZE);
+    EXPECT_NE(big, nullptr);
+    EXPECT_GE(slab.num_slabs(), 2u);
+}
+
+TEST(Function, IRObjectsLiveInFunctionSlab)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("func", i32, {{"x", i32}});
+    BasicBlock *bb = f->create_basic_block("bb");
+    EXPECT_EQ(f->allocator().num_live_objects(), 2u); // the argument and the block
+
+    const size_t before = f->allocator().num_live_objects();
+    Value *acc = f->arg(0);
+    for (int i = 0; i < 100; ++i)
+    {
+        acc = BinaryInst::create(Opcode::Add, acc, m.get_constant_int(i32, i), bb);
+    }
+    EXPECT_EQ(f->allocator().num_live_objects(), before + 100);
+    // Slabs double from 1 KB, so a hundred instructions take only a few
+    EXPECT_LE(f->allocator().num_slabs(), 6u);
+}
+
 TEST(InstructionSubclasses, GEPInstruction)
 {
     Module m;
@@ -0,0 +1,20 @@
+// ir_test_util.h - Helpers shared by the IR transform tests
+#pragma once
+
+#include "src/ir.h"
+
+namespace ir_test
+{
+    inline unsigned count_opcode(Function *f, Opcode opc)
+    {
+        unsigned count = 0;
+        for (BasicBlock *bb : f->basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                count += inst.opcode() == opc;
+            }
+        }
+        return count;
+    }
+} // namespace ir_test
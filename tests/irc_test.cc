@@ -0,0 +1,348 @@
+#include <gtest/gtest.h>
+
+#include "src/lra.h"
+#include "src/machine.h"
+#include "src/reg_alloc/irc.h"
+#include "src/reg_alloc/lsra.h"
+#include "src/reg_alloc/reg_alloc_factory.h"
+#include "src/targets/asimov_target.h"
+#include "src/targets/riscv_target.h"
+
+using namespace ASIMOV;
+
+class IRCFunction : public MachineFunction
+{
+public:
+    IRCFunction() : MachineFunction(nullptr, create_asimov_module()) {}
+
+    ~IRCFunction()
+    {
+        delete parent()->target_inst_info();
+        delete parent()->target_reg_info();
+        delete parent();
+    }
+
+    static MachineModule *create_asimov_module()
+    {
+        MachineModule *mm = new MachineModule(nullptr);
+        mm->set_target_info(new ASIMOVRegisterInfo(), new ASIMOVTargetInstInfo());
+        return mm;
+    }
+
+    unsigned vreg() { return create_vreg(GR32, 4, false); }
+
+    static void li(MachineBasicBlock *bb, unsigned rd, int64_t imm)
+    {
+        bb->append(std::make_unique<MachineInst>(MOVW, std::vector<MOperand>{MOperand::create_reg(rd, true), MOperand::create_imm(imm)}));
+    }
+    static void load(MachineBasicBlock *bb, unsigned rd, int offset)
+    {
+        auto mi = std::make_unique<MachineInst>(LOAD, std::vector<MOperand>{MOperand::create_reg(rd, true), MOperand::create_mem_ri(R7, offset)});
+        mi->set_flag(MIFlag::MayLoad);
+        bb->append(std::move(mi));
+    }
+    static void copy(MachineBasicBlock *bb, unsigned rd, unsigned rs)
+    {
+        bb->append(std::make_unique<MachineInst>(MOVW, std::vector<MOperand>{MOperand::create_reg(rd, true), MOperand::create_reg(rs)}));
+    }
+    static void add(MachineBasicBlock *bb, unsigned rd, unsigned rs1, unsigned rs2)
+    {
+        bb->append(std::make_unique<MachineInst>(ADD, std::vector<MOperand>{MOperand::create_reg(rd, true), MOperand::create_reg(rs1), MOperand::create_reg(rs2)}));
+    }
+    static void ret(MachineBasicBlock *bb)
+    {
+        auto mi = std::make_unique<MachineInst>(RET);
+        mi->set_flag(MIFlag::Terminator);
+        bb->append(std::move(mi));
+    }
+
+    unsigned count_copies() const
+    {
+        unsigned copies = 0;
+        for (const auto &bb : basic_blocks())
+        {
+            for (const auto &mi : bb->instructions())
+            {
+                unsigned dst, src;
+                copies += parent()->target_inst_info()->is_copy(*mi, dst, src);
+            }
+        }
+        return copies;
+    }
+};
+
+// Interfering registers must end up in different physical registers; pairs
+// joined by a copy may share one, since the copy is all that overlaps
+static void expect_valid_assignment(IRCFunction &mf, const RegisterAllocator &allocator)
+{
+    const auto &assignment = allocator.get_vreg_to_preg_map();
+    std::set<std::pair<unsigned, unsigned>> copies;
+    for (const auto &bb : mf.basic_blocks())
+    {
+        for (const auto &mi : bb->instructions())
+        {
+            unsigned dst, src;
+            if (mf.parent()->target_inst_info()->is_copy(*mi, dst, src))
+            {
+                copies.insert({dst, src});
+                copies.insert({src, dst});
+            }
+        }
+    }
+
+    LiveRangeAnalyzer lra(mf);
+    InterferenceGraph graph = lra.build_interference();
+    auto final_reg = [&](unsigned reg)
+    {
+        if (MachineFunction::is_physical_reg(reg))
+            return reg;
+        EXPECT_TRUE(assignment.count(reg)) << "vreg " << reg << " has no register";
+        return assignment.lookup(reg);
+    };
+    for (unsigned n = 0; n < graph.num_nodes(); ++n)
+    {
+        const unsigned reg = graph.reg(n);
+        for (unsigned m : graph.neighbors(n))
+        {
+            const unsigned other = graph.reg(m);
+            if (MachineFunction::is_physical_reg(reg) && MachineFunction::is_physical_reg(other))
+                continue;
+            if (copies.count({reg, other}))
+                continue;
+            EXPECT_NE(final_reg(reg), final_reg(other)) << reg << " and " << other << " interfere";
+        }
+    }
+}
+
+TEST(IRCTest, CoalescesCopiesIntoOneRegister)
+{
+    IRCFunction mf;
+    auto *bb = mf.create_block("entry");
+    unsigned a = mf.vreg(), b = mf.vreg(), c = mf.vreg(), d = mf.vreg();
+    IRCFunction::li(bb, a, 1);
+    IRCFunction::copy(bb, b, a);
+    IRCFunction::add(bb, c, b, b);
+    IRCFunction::copy(bb, d, c);
+    IRCFunction::copy(bb, R1, d); // 传入物理寄存器
+    IRCFunction::ret(bb);
+    mf.build_cfg();
+
+    IteratedCoalescingRegisterAllocator allocator(mf);
+    RegAllocResult result = allocator.allocate_registers();
+    ASSERT_TRUE(result.successful);
+    EXPECT_EQ(result.num_spills, 0u);
+    EXPECT_EQ(result.num_copies, 0u);
+    expect_valid_assignment(mf, allocator);
+
+    const auto &assignment = allocator.get_vreg_to_preg_map();
+    EXPECT_EQ(assignment.at(a), assignment.at(b));
+    EXPECT_EQ(assignment.at(c), (unsigned)R1);
+    EXPECT_EQ(assignment.at(d), (unsigned)R1);
+
+    allocator.apply();
+    EXPECT_EQ(mf.count_copies(), 0u);
+    EXPECT_EQ(bb->instructions().size(), 3u);
+}
+
+TEST(IRCTest, KeepsCopiesBetweenInterferingRegisters)
+{
+    IRCFunction mf;
+    auto *bb = mf.create_block("entry");
+    unsigned a = mf.vreg(), b = mf.vreg(), c = mf.vreg();
+    IRCFunction::li(bb, a, 1);
+    IRCFunction::copy(bb, b, a);
+    IRCFunction::li(bb, a, 2); // 重新定义 a，b 仍然活跃
+    IRCFunction::add(bb, c, a, b);
+    IRCFunction::copy(bb, R1, c);
+    IRCFunction::ret(bb);
+    mf.build_cfg();
+
+    IteratedCoalescingRegisterAllocator allocator(mf);
+    RegAllocResult result = allocator.allocate_registers();
+    ASSERT_TRUE(result.successful);
+    expect_valid_assignment(mf, allocator);
+    const auto &assignment = allocator.get_vreg_to_preg_map();
+    EXPECT_NE(assignment.at(a), assignment.at(b));
+    EXPECT_EQ(result.num_copies, 1u);
+}
+
+TEST(IRCTest, SpillsUnderPressureAndRetries)
+{
+    IRCFunction mf;
+    auto *bb = mf.create_block("entry");
+    // 十个同时活跃的值，只有五个可分配寄存器；值从内存读来，不能重算
+    std::vector<unsigned> values;
+    for (int i = 0; i < 10; ++i)
+    {
+        values.push_back(mf.vreg());
+        IRCFunction::load(bb, values.back(), 4 * i);
+    }
+    unsigned sum = mf.vreg();
+    IRCFunction::li(bb, sum, 0);
+    for (unsigned v : values)
+        IRCFunction::add(bb, sum, sum, v);
+    IRCFunction::copy(bb, R0, sum);
+    IRCFunction::ret(bb);
+    mf.build_cfg();
+
+    IteratedCoalescingRegisterAllocator allocator(mf);
+    RegAllocResult result = allocator.allocate_registers();
+    ASSERT_TRUE(result.successful) << result.error_message;
+    EXPECT_GT(result.num_spills, 0u);
+    EXPECT_LT(result.num_spills, values.size());
+    EXPECT_EQ(result.num_spills, allocator.get_vreg_to_spill_slot().size());
+    expect_valid_assignment(mf, allocator);
+
+    // 溢出的寄存器已被改写成短临时寄存器，代码中只剩分配过的寄存器
+    const auto &assignment = allocator.get_vreg_to_preg_map();
+    for (const auto &mi : bb->instructions())
+    {
+        for (unsigned reg : mi->uses())
+            EXPECT_TRUE(MachineFunction::is_physical_reg(reg) || assignment.count(reg)) << reg;
+        for (unsigned reg : mi->defs())
+            EXPECT_TRUE(MachineFunction::is_physical_reg(reg) || assignment.count(reg)) << reg;
+    }
+}
+
+// 常数不必溢出到栈上，用到的地方重新生成即可
+TEST(IRCTest, RematerializesConstantsInsteadOfSpilling)
+{
+    IRCFunction mf;
+    auto *bb = mf.create_block("entry");
+    std::vector<unsigned> values;
+    for (int i = 0; i < 10; ++i)
+    {
+        values.push_back(mf.vreg());
+        IRCFunction::li(bb, values.back(), i);
+    }
+    unsigned sum = mf.vreg();
+    IRCFunction::li(bb, sum, 0);
+    for (unsigned v : values)
+        IRCFunction::add(bb, sum, sum, v);
+    IRCFunction::copy(bb, R0, sum);
+    IRCFunction::ret(bb);
+    mf.build_cfg();
+
+    IteratedCoalescingRegisterAllocator allocator(mf);
+    RegAllocResult result = allocator.allocate_registers();
+    ASSERT_TRUE(result.successful) << result.error_message;
+    EXPECT_EQ(result.num_spills, 0u);
+    EXPECT_GT(result.num_remats, 0u);
+    EXPECT_TRUE(allocator.get_vreg_to_spill_slot().empty());
+    expect_valid_assignment(mf, allocator);
+    for (const auto &mi : bb->instructions())
+        EXPECT_TRUE(mi->opcode() != LOAD && mi->opcode() != STORE) << mi->opcode();
+}
+
+TEST(IRCTest, SpillsRISCVVectorsWithWholeRegisterAccesses)
+{
+    RISCV::RISCVRegisterInfo tri(RISCV::ABIVersion::LP64D, true);
+    RISCV::RISCVTargetInstInfo tii(RISCV::ABIVersion::LP64D, true);
+    MachineModule mm(nullptr);
+    mm.set_target_info(&tri, &tii);
+    MachineFunction mf(nullptr, &mm);
+    auto *bb = mf.create_block("entry");
+    const auto vector_op = [bb](unsigned opcode, std::vector<MOperand> ops)
+    {
+        bb->append(std::make_unique<MachineInst>(opcode, std::move(ops)));
+        bb->instructions().back()->set_implicit_uses({RISCV::VTYPE});
+    };
+    // 四十个同时活跃的向量，只有三十一个向量寄存器
+    std::vector<unsigned> values;
+    for (int i = 0; i < 40; ++i)
+    {
+        values.push_back(mf.create_vreg(RISCV::VR, 16, false));
+        vector_op(RISCV::VLE32_V, {MOperand::create_reg(values.back(), true), MOperand::create_mem_ri(RISCV::A0, 0)});
+    }
+    for (unsigned v : values)
+        vector_op(RISCV::VADD_VV, {MOperand::create_reg(values[0], true), MOperand::create_reg(values[0]),
+                                   MOperand::create_reg(v)});
+    vector_op(RISCV::VSE32_V, {MOperand::create_reg(values[0]), MOperand::create_mem_ri(RISCV::A0, 0)});
+    bb->append(std::make_unique<MachineInst>(RISCV::RET));
+    bb->instructions().back()->set_flag(MIFlag::Terminator);
+    mf.build_cfg();
+
+    IteratedCoalescingRegisterAllocator allocator(mf);
+    RegAllocResult result = allocator.allocate_registers();
+    ASSERT_TRUE(result.successful) << result.error_message;
+    EXPECT_GT(result.num_spills, 0u);
+    for (const auto &[vreg, preg] : allocator.get_vreg_to_preg_map())
+        EXPECT_TRUE(preg >= RISCV::V1 && preg <= RISCV::V31) << preg;
+
+    // 整寄存器访存没有偏移，槽位地址先算进 t2
+    unsigned reloads = 0;
+    for (size_t i = 0; i < bb->instructions().size(); ++i)
+    {
+        const MachineInst &mi = *bb->instructions()[i];
+        if (mi.opcode() != RISCV::VL1RE8_V && mi.opcode() != RISCV::VS1R_V)
+            continue;
+        reloads += mi.opcode() == RISCV::VL1RE8_V;
+        EXPECT_EQ(mi.operands()[1].mem_ri().base_reg, RISCV::T2);
+        ASSERT_GT(i, 0u);
+        const MachineInst &address = *bb->instructions()[i - 1];
+        EXPECT_EQ(address.opcode(), RISCV::ADDI);
+        EXPECT_TRUE(address.operands()[2].is_frame_index());
+    }
+    EXPECT_GT(reloads, 0u);
+}
+
+TEST(IRCTest, FactorySelectsByOptimizationLevel)
+{
+    IRCFunction mf;
+    EXPECT_NE(dynamic_cast<LinearScanRegisterAllocator *>(create_register_allocator(mf, 0).get()), nullptr);
+    EXPECT_NE(dynamic_cast<IteratedCoalescingRegisterAllocator *>(create_register_allocator(mf, 2).get()), nullptr);
+}
+
+// 溢出代码和改写都逐条报给活跃分析：分配的每一轮和 apply 之后的查询都只修补，不整体重算
+TEST(IRCTest, SpillCodeKeepsLivenessIncremental)
+{
+    for (unsigned opt_level : {0u, 2u})
+    {
+        SCOPED_TRACE(opt_level);
+        IRCFunction mf;
+        auto *entry = mf.create_block("entry");
+        auto *body = mf.create_block("body");
+        std::vector<unsigned> values;
+        for (int i = 0; i < 10; ++i)
+        {
+            values.push_back(mf.vreg());
+            IRCFunction::load(entry, values.back(), 4 * i);
+        }
+        unsigned sum = mf.vreg();
+        IRCFunction::li(body, sum, 0);
+        for (unsigned v : values)
+            IRCFunction::add(body, sum, sum, v);
+        IRCFunction::copy(body, R0, sum);
+        IRCFunction::ret(body);
+        mf.build_cfg();
+
+        size_t computes = 0;
+        LiveRangeAnalyzer *live = mf.live_range_analyzer();
+        live->set_compute_metric_counter(computes);
+        std::unique_ptr<RegisterAllocator> allocator = create_register_allocator(mf, opt_level);
+        RegAllocResult result = allocator->allocate_registers();
+        ASSERT_TRUE(result.successful) << result.error_message;
+        EXPECT_GT(result.num_spills, 0u);
+        EXPECT_EQ(computes, 1u);
+
+        allocator->apply();
+        live->compute();
+        EXPECT_EQ(computes, 1u);
+
+        LiveRangeAnalyzer fresh(mf);
+        fresh.compute();
+        ASSERT_EQ(live->get_all_live_ranges().size(), fresh.get_all_live_ranges().size());
+        for (const auto &[reg, expected] : fresh.get_all_live_ranges())
+        {
+            LiveRange *patched = live->get_live_range(reg);
+            ASSERT_NE(patched, nullptr) << "reg " << reg;
+            EXPECT_EQ(patched->to_string(), expected->to_string()) << "reg " << reg;
+            EXPECT_EQ(patched->occurrences().size(), expected->occurrences().size()) << "reg " << reg;
+        }
+        for (const auto &bb : mf.basic_blocks())
+        {
+            EXPECT_EQ(live->live_in(bb.get()), fresh.live_in(bb.get()));
+            EXPECT_EQ(live->live_out(bb.get()), fresh.live_out(bb.get()));
+        }
+    }
+}
@@ -0,0 +1,291 @@
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/targets/asimov_isel.h"
+#include "src/targets/riscv_isel.h"
+#include "src/thread_pool.h"
+
+namespace
+{
+    std::vector<unsigned> opcodes(const MachineBasicBlock *mbb)
+    {
+        std::vector<unsigned> result;
+        for (const auto &mi : mbb->instructions())
+        {
+            result.push_back(mi->opcode());
+        }
+        return result;
+    }
+
+    const MachineInst *find(const MachineFunction &mf, unsigned opcode)
+    {
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            for (const auto &mi : mbb->instructions())
+            {
+                if (mi->opcode() == opcode)
+                    return mi.get();
+            }
+        }
+        return nullptr;
+    }
+}
+
+TEST(ISel, ASIMOVMaterializesConstants)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"a", i32}, {"b", i32}});
+    IRBuilder builder(&m);
+    builder.set_insert_point(f->create_basic_block("entry"));
+    builder.create_ret(builder.create_mul(builder.create_add(f->arg(0), m.get_constant_int(i32, 5)), f->arg(1)));
+
+    ASIMOV::ASIMOVTargetInstInfo tii;
+    ASIMOV::ASIMOVISelInfo target(&tii);
+    MachineModule mm(&m);
+    MachineFunction *mf = mm.create_machine_function(f);
+    std::string err;
+    ASSERT_TRUE(select_function(target, *f, *mf, &err)) << err;
+
+    ASSERT_EQ(mf->basic_blocks().size(), 1u);
+    using namespace ASIMOV;
+    EXPECT_EQ(opcodes(mf->basic_blocks()[0].get()),
+              (std::vector<unsigned>{MOVW, MOVW, LI, ADD, MUL, MOVW, RET}));
+    const MachineInst *li = find(*mf, LI);
+    EXPECT_EQ(li->operands()[1].imm(), 5);
+    EXPECT_EQ(find(*mf, MOVW)->operands()[1].reg(), R0);
+    EXPECT_TRUE(find(*mf, RET)->has_flag(MIFlag::Terminator));
+}
+
+TEST(ISel, RISCVFoldsImmediates)
+{
+    Module m;
+    IntegerType *i64 = m.get_integer_type(64);
+    Function *f = m.create_function("f", m.get_boolean_type(), {{"a", i64}});
+    IRBuilder builder(&m);
+    builder.set_insert_point(f->create_basic_block("entry"));
+    Value *small = builder.create_sub(f->arg(0), m.get_constant_int(i64, 3));
+    Value *large = builder.create_add(small, m.get_constant_int(i64, 5000));
+    builder.create_ret(builder.create_icmp(ICmpInst::SGE, large, m.get_constant_int(i64, 0)));
+
+    RISCV::RISCVTargetInstInfo tii;
+    RISCV::RISCVISelInfo target(&tii);
+    MachineModule mm(&m);
+    MachineFunction *mf = mm.create_machine_function(f);
+    ASSERT_TRUE(select_function(target, *f, *mf));
+
+    using namespace RISCV;
+    // a - 3 as a + -3; 5000 does not fit in 12 bits; `>= 0` as `!(x < 0)`
+    EXPECT_EQ(opcodes(mf->basic_blocks()[0].get()),
+              (std::vector<unsigned>{ADD, ADDI, LI, ADD, SLTI, XORI, ADD, RET}));
+    EXPECT_EQ(find(*mf, ADDI)->operands()[2].imm(), -3);
+    EXPECT_EQ(find(*mf, LI)->operands()[1].imm(), 5000);
+    EXPECT_EQ(find(*mf, SLTI)->operands()[2].imm(), 0);
+}
+
+TEST(ISel, FramePointersFoldIntoMemoryOperands)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *pair = m.get_struct_type("Pair", {MemberInfo("x", i32), MemberInfo("y", i32)});
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    IRBuilder builder(&m);
+    builder.set_insert_point(f->create_basic_block("entry"));
+    AllocaInst *slot = builder.create_alloca(pair, "p");
+    Value *y = builder.create_struct_gep(slot, 1);
+    builder.create_store(f->arg(0), y);
+    builder.create_ret(builder.create_load(y));
+
+    RISCV::RISCVTargetInstInfo tii;
+    RISCV::RISCVISelInfo target(&tii);
+    MachineModule mm(&m);
+    MachineFunction *mf = mm.create_machine_function(f);
+    ASSERT_TRUE(select_function(target, *f, *mf));
+
+    using namespace RISCV;
+    // The GEP leaves no code behind
+    EXPECT_EQ(opcodes(mf->basic_blocks()[0].get()), (std::vector<unsigned>{ADD, SW, LW, ADD, RET}));
+    const MachineInst *store = find(*mf, SW);
+    ASSERT_TRUE(store->operands()[1].is_mem_fi());
+    const int fi = store->operands()[1].mem_fi().frame_index;
+    EXPECT_EQ(store->operands()[1].mem_fi().offset, 4);
+    EXPECT_TRUE(store->has_flag(MIFlag::MayStore));
+    EXPECT_TRUE(find(*mf, LW)->has_flag(MIFlag::MayLoad));
+
+    mf->frame()->create_fixed_size(nullptr, 8, 8);
+    resolve_frame_indices(*mf, SP);
+    const MOperand &mem = find(*mf, LW)->operands()[1];
+    ASSERT_TRUE(mem.is_mem_ri());
+    EXPECT_EQ(mem.mem_ri().base_reg, SP);
+    EXPECT_EQ(mem.mem_ri().offset, static_cast<int>(mf->frame()->get_frame_index_offset(fi)) + 4);
+}
+
+TEST(ISel, ComparesFoldIntoBranchesAndPhiEdgesSplit)
+{
+    Module m;
+    IntegerType *i64 = m.get_integer_type(64);
+    Function *f = m.create_function("f", i64, {{"a", i64}, {"b", i64}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *then_bb = f->create_basic_block("then");
+    BasicBlock *join = f->create_basic_block("join");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_cond_br(builder.create_icmp(ICmpInst::SGT, f->arg(0), f->arg(1)), then_bb, join);
+    builder.set_insert_point(then_bb);
+    Value *diff = builder.create_sub(f->arg(0), f->arg(1));
+    builder.create_br(join);
+    builder.set_insert_point(join);
+    PhiInst *phi = builder.create_phi(i64);
+    phi->add_incoming(m.get_constant_int(i64, 0), entry);
+    phi->add_incoming(diff, then_bb);
+    builder.create_ret(phi);
+
+    RISCV::RISCVTargetInstInfo tii;
+    RISCV::RISCVISelInfo target(&tii);
+    MachineModule mm(&m);
+    MachineFunction *mf = mm.create_machine_function(f);
+    ASSERT_TRUE(select_function(target, *f, *mf));
+
+    using namespace RISCV;
+    const auto &blocks = mf->basic_blocks();
+    ASSERT_EQ(blocks.size(), 4u);
+    MachineBasicBlock *edge = blocks[3].get();
+    EXPECT_EQ(edge->label(), "entry.join");
+    // `a > b` as `b < a`, straight into the branch
+    EXPECT_EQ(opcodes(blocks[0].get()), (std::vector<unsigned>{ADD, ADD, BLT, J}));
+    const MachineInst *blt = find(*mf, BLT);
+    EXPECT_EQ(blt->operands()[2].basic_block(), blocks[1].get());
+    EXPECT_EQ(blocks[0]->instructions().back()->operands()[0].basic_block(), edge);
+    EXPECT_EQ(blocks[0]->succ_size(), 2u);
+
+    // The phi's copies land on the edges; `then` falls through to `join`
+    EXPECT_EQ(opcodes(edge), (std::vector<unsigned>{ADD, J}));
+    EXPECT_EQ(edge->instructions().front()->operands()[1].reg(), static_cast<unsigned>(ZERO));
+    EXPECT_EQ(opcodes(blocks[1].get()), (std::vector<unsigned>{SUB, ADD}));
+    EXPECT_TRUE(blocks[1]->successors().count(blocks[2].get()));
+    EXPECT_EQ(blocks[2]->pred_size(), 2u);
+}
+
+TEST(ISel, SelectsModuleInParallel)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    IRBuilder builder(&m);
+    Function *callee = m.create_function("callee", i32, {{"x", i32}});
+    builder.set_insert_point(callee->create_basic_block("entry"));
+    builder.create_ret(builder.create_add(callee->arg(0), callee->arg(0)));
+    Function *caller = m.create_function("caller", i32, {{"y", i32}});
+    builder.set_insert_point(caller->create_basic_block("entry"));
+    builder.create_ret(builder.create_call(callee, {m.get_constant_int(i32, 7)}, "r"));
+    Function *bad = m.create_function("bad", m.get_float_type(32), {{"z", m.get_float_type(32)}});
+    builder.set_insert_point(bad->create_basic_block("entry"));
+    builder.create_ret(builder.create_fneg(bad->arg(0)));
+    m.create_function("external", i32, {});
+
+    ASIMOV::ASIMOVTargetInstInfo tii;
+    ASIMOV::ASIMOVISelInfo target(&tii);
+    MachineModule mm(&m);
+    ThreadPool pool(3);
+    std::vector<std::string> errors;
+    std::vector<MachineFunction *> mfs = select_module(target, m, mm, &pool, &errors);
+
+    ASSERT_EQ(mfs.size(), 3u);
+    ASSERT_EQ(errors.size(), 1u);
+    EXPECT_EQ(errors[0].rfind("bad: ", 0), 0u);
+
+    using namespace ASIMOV;
+    // Arguments go into place right before the call, the result comes out of R0
+    EXPECT_EQ(opcodes(mfs[1]->basic_blocks()[0].get()),
+              (std::vector<unsigned>{MOVW, LI, MOVW, CALL, MOVW, MOVW, RET}));
+    const MachineInst *call = find(*mfs[1], CALL);
+    EXPECT_TRUE(call->has_flag(MIFlag::Call));
+    EXPECT_STREQ(call->operands()[0].external_sym(), "callee");
+}
+
+TEST(ISel, InternalFunctionsUseTheFastConvention)
+{
+    // Five integer arguments: one more than C passes in registers on ASIMOV
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    IRBuilder builder(&m);
+    Function *callee = m.create_function("callee", i32, {{"a", i32}, {"b", i32}, {"c", i32}, {"d", i32}, {"e", i32}});
+    callee->set_internal(true);
+    builder.set_insert_point(callee->create_basic_block("entry"));
+    builder.create_ret(builder.create_add(callee->arg(0), callee->arg(4)));
+    Function *caller = m.create_function("caller", i32, {{"x", i32}});
+    builder.set_insert_point(caller->create_basic_block("entry"));
+    Value *x = caller->arg(0);
+    builder.create_ret(builder.create_call(callee, {x, x, x, x, x}, "r"));
+
+    ASIMOV::ASIMOVRegisterInfo tri;
+    ASIMOV::ASIMOVTargetInstInfo tii;
+    ASIMOV::ASIMOVISelInfo target(&tii);
+    MachineModule mm(&m);
+    mm.set_target_info(&tri, &tii);
+    std::vector<std::string> errors;
+    std::vector<MachineFunction *> mfs = select_module(target, m, mm, nullptr, &errors);
+    ASSERT_TRUE(errors.empty()) << errors[0];
+
+    using namespace ASIMOV;
+    EXPECT_EQ(mfs[0]->call_convention(), CallingConv::Fast);
+    EXPECT_EQ(mfs[1]->call_convention(), CallingConv::C);
+    EXPECT_EQ(mfs[0]->basic_blocks()[0]->instructions()[4]->operands()[1].reg(), R4);
+
+    // The call reads the argument registers and clobbers every caller-saved one
+    const MachineInst *call = find(*mfs[1], CALL);
+    EXPECT_EQ(call->implicit_uses(), (std::vector<unsigned>{R0, R1, R2, R3, R4}));
+    EXPECT_TRUE(call->defs().count(R0));
+    EXPECT_EQ(call->implicit_defs().size(), tri.get_caller_saved_regs(CallingConv::Fast).size());
+
+    // The same function exported has no register for `e`
+    callee->set_internal(false);
+    MachineModule c_mm(&m);
+    std::string err;
+    EXPECT_FALSE(select_function(target, *callee, *c_mm.create_machine_function(callee), &err));
+}
+
+TEST(ISel, RISCVSelectsVectorsWithTheVExtension)
+{
+    Module m;
+    VectorType *v4i32 = m.get_vector_type(m.get_integer_type(32), 4);
+    PointerType *ptr = m.get_pointer_type(v4i32);
+    Function *f = m.create_function("f", m.get_void_type(), {{"a", ptr}, {"b", ptr}});
+    IRBuilder builder(&m);
+    BasicBlock *entry = f->create_basic_block("entry");
+    builder.set_insert_point(entry);
+    // IRBuilder only does scalar arithmetic
+    auto *sum = BinaryInst::create(Opcode::Add, builder.create_load(f->arg(0)), builder.create_load(f->arg(1)), entry);
+    entry->append(sum);
+    builder.create_store(sum, f->arg(0));
+    builder.create_ret_void();
+
+    // Without the extension there is no register for a vector
+    RISCV::RISCVTargetInstInfo scalar_tii;
+    RISCV::RISCVISelInfo scalar(&scalar_tii);
+    MachineModule scalar_mm(&m);
+    EXPECT_FALSE(select_function(scalar, *f, *scalar_mm.create_machine_function(f)));
+
+    RISCV::RISCVTargetInstInfo tii(RISCV::ABIVersion::LP64D, true);
+    RISCV::RISCVISelInfo target(&tii);
+    MachineModule mm(&m);
+    MachineFunction *mf = mm.create_machine_function(f);
+    std::string err;
+    ASSERT_TRUE(select_function(target, *f, *mf, &err)) << err;
+
+    using namespace RISCV;
+    // Each vector instruction after the vsetivli for e32, m1; the
+    // peephole leaves only the first
+    EXPECT_EQ(opcodes(mf->basic_blocks()[0].get()),
+              (std::vector<unsigned>{ADD, ADD, VSETIVLI, VLE32_V, VSETIVLI, VLE32_V, VSETIVLI, VADD_VV, VSETIVLI,
+                                     VSE32_V, RET}));
+    const MachineInst *config = find(*mf, VSETIVLI);
+    EXPECT_EQ(config->operands()[1].imm(), 4);
+    EXPECT_EQ(config->operands()[2].imm(), 0xD0);
+    EXPECT_EQ(config->implicit_defs(), (std::vector<unsigned>{VTYPE}));
+    const MachineInst *add = find(*mf, VADD_VV);
+    EXPECT_TRUE(add->uses().count(VTYPE));
+    EXPECT_EQ(mf->get_vreg_info(add->operands()[0].reg()).register_class_id_, static_cast<unsigned>(VR));
+    const MachineInst *store = find(*mf, VSE32_V);
+    ASSERT_TRUE(store->operands()[1].is_mem_ri());
+    EXPECT_EQ(store->operands()[1].mem_ri().offset, 0);
+    EXPECT_TRUE(store->has_flag(MIFlag::MayStore));
+}
@@ -0,0 +1,109 @@
+#include "benchmark/benchmark.h"
+#include "src/lexer.h"
+#include <string>
+#include <unordered_map>
+
+// Identifier-heavy source, the shape where keyword recognition dominates the lexer
+static std::string make_identifier_heavy_source(size_t lines)
+{
+    std::string source;
+    for (size_t i = 0; i < lines; ++i)
+    {
+        source += "fn func_" + std::to_string(i) + "(x: i32, y: u64, p: *f32) -> i64 {\n";
+        source += "    let value_" + std::to_string(i) + ": i32 = cast<i32>(y) + x;\n";
+        source += "    if value_" + std::to_string(i) + " > counter { return sizeof(type_name); }\n";
+        source += "    while running { total = total + value; }\n";
+        source += "    return value_" + std::to_string(i) + ";\n}\n";
+    }
+    return source;
+}
+
+// Generated-header shape: long license/doc comments and indentation around few tokens
+static std::string make_comment_heavy_source(size_t lines)
+{
+    std::string source;
+    for (size_t i = 0; i < lines; ++i)
+    {
+        source += "/*\n * Generated declaration " + std::to_string(i) + ". Do not edit by hand.\n";
+        source += " * This block comment is deliberately long, as the ones emitted by our generators are.\n */\n";
+        source += "                // trailing line comment that also needs to be skipped quickly\n";
+        source += "let name_" + std::to_string(i) + ": string = \"a reasonably long string literal body\";\n";
+    }
+    return source;
+}
+
+static std::vector<std::string> make_words()
+{
+    std::vector<std::string> words;
+    for (const auto &kw : KEYWORDS)
+        words.emplace_back(kw.spelling);
+    for (const char *ident : {"value", "counter", "total", "running", "func_name", "x", "ptr", "index", "data", "len"})
+        words.emplace_back(ident);
+    return words;
+}
+
+// The previous implementation: a global std::unordered_map keyed by std::string
+static void BM_KeywordLookupUnorderedMap(benchmark::State &state)
+{
+    static const std::unordered_map<std::string, TokenType> map = []
+    {
+        std::unordered_map<std::string, TokenType> m;
+        for (const auto &kw : KEYWORDS)
+            m.emplace(std::string(kw.spelling), kw.type);
+        return m;
+    }();
+    const auto words = make_words();
+    for (auto _ : state)
+    {
+        for (const auto &word : words)
+        {
+            std::string_view view = word;
+            auto it = map.find(std::string(view)); // the lexer had to materialize a std::string first
+            benchmark::DoNotOptimize(it);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * words.size());
+}
+BENCHMARK(BM_KeywordLookupUnorderedMap);
+
+static void BM_KeywordLookupPerfectHash(benchmark::State &state)
+{
+    const auto words = make_words();
+    for (auto _ : state)
+    {
+        for (const auto &word : words)
+        {
+            benchmark::DoNotOptimize(lookup_keyword(word));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * words.size());
+}
+BENCHMARK(BM_KeywordLookupPerfectHash);
+
+static void BM_LexIdentifierHeavySource(benchmark::State &state)
+{
+    const std::string source = make_identifier_heavy_source(state.range(0));
+    size_t tokens = 0;
+    for (auto _ : state)
+    {
+        Lexer lexer = Lexer::borrowed(source);
+        while (lexer.next_token().type != TokenType::Eof)
+            ++tokens;
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+    state.counters["tokens"] = benchmark::Counter(static_cast<double>(tokens), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_LexIdentifierHeavySource)->Arg(100)->Arg(1000);
+
+static void BM_LexCommentHeavySource(benchmark::State &state)
+{
+    const std::string source = make_comment_heavy_source(state.range(0));
+    for (auto _ : state)
+    {
+        Lexer lexer = Lexer::borrowed(source);
+        while (lexer.next_token().type != TokenType::Eof)
+            ;
+    }
+    state.SetBytesProcessed(state.iterations() * source.size());
+}
+BENCHMARK(BM_LexCommentHeavySource)->Arg(100)->Arg(1000);
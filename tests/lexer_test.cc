@@ -236,3 +236,217 @@ TEST(LexerTest, TestEdgeCases)
     EXPECT_EQ(lexer_to_string(lexer), "<integer> <float> <integer> <integer> <eof>");
     EXPECT_TRUE(no_errors(lexer));
 }
+
+TEST(LexerTest, TestBorrowedBufferTokenText)
+{
+    const std::string source = "let foo = 0x1F + bar; \"s\\n\"";
+    Lexer lexer = Lexer::borrowed(source);
+
+    Token let = lexer.next_token();
+    EXPECT_EQ(let.text, "let");
+    EXPECT_EQ(let.text.data(), source.data());
+
+    Token foo = lexer.next_token();
+    EXPECT_EQ(foo.type, TokenType::Identifier);
+    EXPECT_EQ(foo.text, "foo");
+    EXPECT_EQ(foo.text.data(), source.data() + 4);
+    EXPECT_EQ(foo.symbol, NO_SYMBOL); // no symbol table attached
+
+    EXPECT_EQ(lexer.next_token().text, "=");
+    Token hex = lexer.next_token();
+    EXPECT_EQ(hex.text, "0x1F");
+    EXPECT_EQ(hex.lexeme, "0x1F");
+    EXPECT_EQ(lexer.next_token().text, "+");
+    EXPECT_EQ(lexer.next_token().text, "bar");
+    EXPECT_EQ(lexer.next_token().text, ";");
+
+    // String literals keep the decoded value in lexeme and the raw source in text
+    Token str = lexer.next_token();
+    EXPECT_EQ(str.lexeme, "s\n");
+    EXPECT_EQ(str.text, "\"s\\n\"");
+    EXPECT_EQ(lexer.next_token().type, TokenType::Eof);
+    EXPECT_TRUE(no_errors(lexer));
+}
+
+TEST(LexerTest, TestInternedIdentifiers)
+{
+    SymbolTable symbols;
+    const std::string source = "foo bar foo let bar";
+    Lexer lexer = Lexer::borrowed(source, &symbols);
+
+    Token foo1 = lexer.next_token();
+    Token bar1 = lexer.next_token();
+    Token foo2 = lexer.next_token();
+    Token let = lexer.next_token();
+    Token bar2 = lexer.next_token();
+
+    EXPECT_NE(foo1.symbol, NO_SYMBOL);
+    EXPECT_NE(foo1.symbol, bar1.symbol);
+    EXPECT_EQ(foo1.symbol, foo2.symbol);
+    EXPECT_EQ(bar1.symbol, bar2.symbol);
+    EXPECT_EQ(let.symbol, NO_SYMBOL); // keywords are not interned
+    EXPECT_EQ(symbols.size(), 2);
+    EXPECT_EQ(symbols.name(foo1.symbol), "foo");
+    EXPECT_EQ(symbols.lookup("bar"), bar1.symbol);
+    EXPECT_EQ(symbols.lookup("baz"), NO_SYMBOL);
+}
+
+TEST(LexerTest, TestCopiedSymbolTable)
+{
+    SymbolTable symbols;
+    const Symbol foo = symbols.intern("foo");
+    SymbolTable copy = symbols;
+    symbols = SymbolTable();
+
+    EXPECT_EQ(copy.lookup("foo"), foo);
+    EXPECT_EQ(copy.name(foo), "foo");
+    EXPECT_NE(copy.intern("bar"), foo);
+    EXPECT_EQ(copy.size(), 2);
+    EXPECT_EQ(symbols.lookup("foo"), NO_SYMBOL);
+}
+
+TEST(LexerTest, TestMovedLexerKeepsOwnedInput)
+{
+    Lexer lexer("a b");
+    EXPECT_EQ(lexer.next_token().text, "a");
+    Lexer moved(std::move(lexer));
+    EXPECT_EQ(moved.next_token().text, "b");
+    EXPECT_EQ(moved.next_token().type, TokenType::Eof);
+}
+
+TEST(LexerTest, TestNumericTypeKeywordsCarryBitWidth)
+{
+    Lexer lexer("int i8 u16 i32 u64 float f32 f64 i128 letter");
+    struct Expected
+    {
+        TokenType type;
+        uint8_t bit_width;
+        bool is_unsigned;
+    };
+    const Expected expected[] = {
+        {TokenType::Int, 32, false}, {TokenType::Int, 8, false}, {TokenType::Int, 16, true},
+        {TokenType::Int, 32, false}, {TokenType::Int, 64, true}, {TokenType::Float, 64, false},
+        {TokenType::Float, 32, false}, {TokenType::Float, 64, false}, {TokenType::Identifier, 0, false},
+        {TokenType::Identifier, 0, false},
+    };
+    for (const auto &e : expected)
+    {
+        Token token = lexer.next_token();
+        EXPECT_EQ(token.type, e.type) << token.lexeme;
+        EXPECT_EQ(token.bit_width, e.bit_width) << token.lexeme;
+        EXPECT_EQ(token.is_unsigned, e.is_unsigned) << token.lexeme;
+    }
+    EXPECT_EQ(lexer.next_token().type, TokenType::Eof);
+}
+
+TEST(LexerTest, TestKeywordTableCoversEveryKeyword)
+{
+    for (const auto &kw : KEYWORDS)
+    {
+        const KeywordInfo *found = lookup_keyword(kw.spelling);
+        ASSERT_NE(found, nullptr) << kw.spelling;
+        EXPECT_EQ(found->spelling, kw.spelling);
+    }
+    EXPECT_EQ(lookup_keyword("le"), nullptr);
+    EXPECT_EQ(lookup_keyword("lets"), nullptr);
+    EXPECT_EQ(lookup_keyword("x"), nullptr);
+    EXPECT_EQ(lookup_keyword(""), nullptr);
+}
+
+TEST(LexerTest, TestLongWhitespaceAndCommentRuns)
+{
+    // Runs longer than one vector width, with every kind of whitespace and a newline inside the comment
+    std::string source = std::string(37, ' ') + "\t\t\r\n\f\v" + std::string(19, ' ') + "a";
+    source += "/* " + std::string(70, '*') + "\n" + std::string(40, 'x') + " **/ b // " + std::string(50, '-') + "\n  c";
+    Lexer lexer(source);
+
+    Token a = lexer.next_token();
+    EXPECT_EQ(a.lexeme, "a");
+    EXPECT_EQ(a.start_line, 2);
+    EXPECT_EQ(a.start_col, 22); // after "\f\v" and 19 spaces on the second line
+
+    Token b = lexer.next_token();
+    EXPECT_EQ(b.lexeme, "b");
+    EXPECT_EQ(b.start_line, 3);
+    EXPECT_EQ(b.start_col, 46);
+
+    Token c = lexer.next_token();
+    EXPECT_EQ(c.lexeme, "c");
+    EXPECT_EQ(c.start_line, 4);
+    EXPECT_EQ(c.start_col, 3);
+    EXPECT_EQ(lexer.next_token().type, TokenType::Eof);
+    EXPECT_TRUE(no_errors(lexer));
+}
+
+TEST(LexerTest, TestLongStringLiteral)
+{
+    const std::string body = std::string(45, 'a') + "\\n" + std::string(20, 'b') + "\\\"" + std::string(33, 'c');
+    Lexer lexer("\"" + body + "\" x");
+
+    Token str = lexer.next_token();
+    EXPECT_EQ(str.type, TokenType::StringLiteral);
+    EXPECT_EQ(str.lexeme, std::string(45, 'a') + "\n" + std::string(20, 'b') + "\"" + std::string(33, 'c'));
+    EXPECT_EQ(str.end_col, static_cast<int>(body.size()) + 2);
+
+    Token x = lexer.next_token();
+    EXPECT_EQ(x.lexeme, "x");
+    EXPECT_EQ(x.start_col, static_cast<int>(body.size()) + 4);
+    EXPECT_TRUE(no_errors(lexer));
+}
+
+TEST(LexerTest, TestMultilineStringLiteralPositions)
+{
+    Lexer lexer("\"line1\nline2\" y");
+    Token str = lexer.next_token();
+    EXPECT_EQ(str.lexeme, "line1\nline2");
+    EXPECT_EQ(str.end_line, 2);
+    Token y = lexer.next_token();
+    EXPECT_EQ(y.start_line, 2);
+    EXPECT_EQ(y.start_col, 8);
+}
+
+TEST(LexerTest, TestUnclosedBlockCommentPosition)
+{
+    Lexer lexer("x\n  /* never closed " + std::string(40, '*'));
+    EXPECT_EQ(lexer_to_string(lexer), "<id> <eof>");
+    ASSERT_EQ(lexer.get_errors().size(), 1);
+    EXPECT_EQ(lexer.get_errors()[0].line, 2);
+    EXPECT_EQ(lexer.get_errors()[0].col, 3);
+}
+
+TEST(LexerTest, TestTokenStreamLookahead)
+{
+    TokenStream stream(Lexer("let x = 1;"));
+    ASSERT_EQ(stream.size(), 6); // let x = 1 ; <eof>
+    EXPECT_EQ(stream.previous().type, TokenType::Invalid);
+    EXPECT_EQ(stream.current().type, TokenType::Let);
+    EXPECT_EQ(stream.peek().type, TokenType::Identifier);
+    EXPECT_EQ(stream.peek(3).type, TokenType::IntegerLiteral);
+    EXPECT_EQ(stream.peek(100).type, TokenType::Eof);
+
+    const Token &let = stream.current();
+    stream.advance();
+    EXPECT_EQ(&stream.previous(), &let); // no copies, references stay valid
+    EXPECT_EQ(stream.current().lexeme, "x");
+
+    for (int i = 0; i < 10; ++i)
+        stream.advance();
+    EXPECT_EQ(stream.current().type, TokenType::Eof);
+    EXPECT_EQ(stream.previous().type, TokenType::Semicolon);
+}
+
+// A short input fits in the string's SSO buffer; token text must survive moving the stream
+TEST(LexerTest, TestMovedStreamKeepsTokenText)
+{
+    Lexer lexer(std::string("let x = 1;"));
+    Lexer moved_lexer(std::move(lexer));
+    TokenStream stream(std::move(moved_lexer));
+    TokenStream moved(std::move(stream));
+
+    std::vector<std::string> texts;
+    for (const Token &token : moved.tokens())
+        texts.emplace_back(token.text);
+    const std::vector<std::string> expected = {"let", "x", "=", "1", ";", ""};
+    EXPECT_EQ(texts, expected);
+    EXPECT_EQ(moved.lexer().input_size(), 10u);
+}
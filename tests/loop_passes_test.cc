@@ -0,0 +1,355 @@
+#include <functional>
+
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/licm.h"
+#include "src/transforms/loop_passes.h"
+#include "src/transforms/loop_simplify.h"
+#include "src/transforms/loop_strength_reduce.h"
+#include "src/transforms/loop_unroll.h"
+#include "tests/ir_test_util.h"
+
+namespace
+{
+    using ir_test::count_opcode;
+
+    // The shape IRGenerator gives `for (i = init; i < bound; i += step) body`
+    // after mem2reg: entry -> cond <-> body, cond -> exit
+    struct CountedLoop
+    {
+        BasicBlock *entry = nullptr;
+        BasicBlock *cond = nullptr;
+        BasicBlock *body = nullptr;
+        BasicBlock *exit = nullptr;
+        PhiInst *i = nullptr;
+    };
+
+    CountedLoop make_loop(Module &m, Function *f, IRBuilder &builder, Value *init, Value *bound, int64_t step,
+                          const std::function<void(PhiInst *)> &body, ICmpInst::Predicate pred = ICmpInst::SLT)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        CountedLoop loop;
+        loop.entry = f->basic_blocks().empty() ? f->create_basic_block("entry") : f->basic_blocks().back();
+        loop.cond = f->create_basic_block("for.cond");
+        loop.body = f->create_basic_block("for.body");
+        loop.exit = f->create_basic_block("for.end");
+
+        builder.set_insert_point(loop.entry);
+        builder.create_br(loop.cond);
+        builder.set_insert_point(loop.cond);
+        loop.i = builder.create_phi(i32, "i");
+        builder.create_cond_br(builder.create_icmp(pred, loop.i, bound), loop.body, loop.exit);
+        builder.set_insert_point(loop.body);
+        body(loop.i);
+        Value *next = builder.create_add(loop.i, m.get_constant_int(i32, static_cast<uint64_t>(step)), "i.next");
+        builder.create_br(loop.cond);
+        loop.i->add_incoming(init, loop.entry);
+        loop.i->add_incoming(next, loop.body);
+        builder.set_insert_point(loop.exit);
+        return loop;
+    }
+
+    const Loop &only_loop(AnalysisManager &analyses, Function *f)
+    {
+        const LoopInfo &loops = analyses.loop_info(*f);
+        EXPECT_EQ(loops.num_loops(), 1u);
+        return *loops.top_level().front();
+    }
+}
+
+TEST(LICM, HoistsInvariantArithmeticAddressesAndLoads)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *point = m.get_struct_type("point", {{"x", i32}, {"y", i32}});
+    Function *f = m.create_function("f", m.get_void_type(), {{"p", m.get_pointer_type(point)}, {"n", i32}});
+    IRBuilder builder(&m);
+
+    Value *field = nullptr, *y = nullptr, *scaled = nullptr, *third = nullptr, *ratio = nullptr;
+    CountedLoop loop = make_loop(m, f, builder, builder.get_int32(0), f->arg(1), 1, [&](PhiInst *i)
+                                 {
+                                     field = builder.create_struct_gep(f->arg(0), 1);
+                                     y = builder.create_load(field, "y");
+                                     scaled = builder.create_mul(f->arg(1), builder.get_int32(4), "scaled");
+                                     third = builder.create_sdiv(f->arg(1), builder.get_int32(3), "third");
+                                     // `n` may be 0 on a path that never enters the body
+                                     ratio = builder.create_sdiv(y, f->arg(1), "ratio");
+                                     builder.create_add(ratio, i); });
+    builder.create_ret_void();
+
+    AnalysisManager analyses;
+    EXPECT_TRUE(LICMPass().run(*f, analyses).preserved(AnalysisKind::DominatorTree));
+    EXPECT_EQ(static_cast<Instruction *>(field)->parent(), loop.entry);
+    EXPECT_EQ(static_cast<Instruction *>(scaled)->parent(), loop.entry);
+    EXPECT_EQ(static_cast<Instruction *>(third)->parent(), loop.entry);
+    EXPECT_EQ(static_cast<Instruction *>(ratio)->parent(), loop.body);
+    // Nothing in the loop writes memory, but `p` may not be valid to read
+    // when the body never runs
+    EXPECT_EQ(static_cast<Instruction *>(y)->parent(), loop.body);
+}
+
+TEST(LICM, HoistsLoadsOnlyFromMemoryTheLoopLeavesAlone)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", m.get_void_type(), {{"p", m.get_pointer_type(i32)}, {"n", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *a = builder.create_alloca(i32, "a");
+    AllocaInst *b = builder.create_alloca(i32, "b");
+    AllocaInst *c = builder.create_alloca(i32, "c");
+
+    LoadInst *from_a = nullptr, *from_c = nullptr, *from_p = nullptr;
+    make_loop(m, f, builder, builder.get_int32(0), f->arg(1), 1, [&](PhiInst *i)
+              {
+                  from_a = builder.create_load(a, "from.a");
+                  from_c = builder.create_load(c, "from.c");
+                  from_p = builder.create_load(f->arg(0), "from.p");
+                  builder.create_store(i, b);
+                  builder.create_store(from_a, c); });
+    builder.create_ret_void();
+
+    AnalysisManager analyses;
+    LICMPass().run(*f, analyses);
+    EXPECT_EQ(from_a->parent(), entry);
+    // Stored to in the loop
+    EXPECT_NE(from_c->parent(), entry);
+    // `p` may point at `b` or `c`
+    EXPECT_NE(from_p->parent(), entry);
+}
+
+TEST(LoopSimplify, GivesLoopsEnteredFromSeveralBlocksAPreheader)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *other = f->create_basic_block("other");
+    BasicBlock *cond = f->create_basic_block("cond");
+    BasicBlock *body = f->create_basic_block("body");
+    BasicBlock *exit = f->create_basic_block("exit");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_cond_br(builder.create_icmp(ICmpInst::SGT, f->arg(0), builder.get_int32(0)), cond, other);
+    builder.set_insert_point(other);
+    builder.create_br(cond);
+    builder.set_insert_point(cond);
+    PhiInst *i = builder.create_phi(i32, "i");
+    builder.create_cond_br(builder.create_icmp(ICmpInst::SLT, i, builder.get_int32(10)), body, exit);
+    builder.set_insert_point(body);
+    Value *next = builder.create_add(i, builder.get_int32(1));
+    builder.create_br(cond);
+    builder.set_insert_point(exit);
+    builder.create_ret(i);
+    i->add_incoming(builder.get_int32(0), entry);
+    i->add_incoming(builder.get_int32(1), other);
+    i->add_incoming(next, body);
+
+    AnalysisManager analyses;
+    EXPECT_EQ(loop_preheader(only_loop(analyses, f)), nullptr);
+    EXPECT_FALSE(LoopSimplifyPass().run(*f, analyses).preserved(AnalysisKind::DominatorTree));
+
+    BasicBlock *preheader = loop_preheader(only_loop(analyses, f));
+    ASSERT_NE(preheader, nullptr);
+    EXPECT_EQ(preheader->name(), "cond.preheader");
+    EXPECT_EQ(cond->predecessors().size(), 2u);
+    ASSERT_EQ(i->num_incoming(), 2u);
+    // The two starting values now meet in the preheader
+    auto *merged = dynamic_cast<PhiInst *>(preheader->first_instruction());
+    ASSERT_NE(merged, nullptr);
+    EXPECT_EQ(merged->num_incoming(), 2u);
+    EXPECT_EQ(i->get_incoming_value(0), next);
+    EXPECT_EQ(i->get_incoming_value(1), merged);
+
+    // Nothing left to do the second time
+    EXPECT_TRUE(LoopSimplifyPass().run(*f, analyses).preserved(AnalysisKind::DominatorTree));
+}
+
+TEST(LoopStrengthReduce, StepsAPointerInsteadOfIndexing)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", m.get_void_type(), {{"n", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *a = builder.create_alloca(m.get_array_type(i32, 16), "a");
+
+    CountedLoop loop = make_loop(m, f, builder, builder.get_int32(2), f->arg(0), 3, [&](PhiInst *i)
+                                 {
+                                     Value *elem = builder.create_load(builder.create_gep(a, {builder.get_int32(0), i}));
+                                     builder.create_store(builder.create_add(elem, i), builder.create_gep(a, {builder.get_int32(0), i})); });
+    builder.create_ret_void();
+
+    AnalysisManager analyses;
+    EXPECT_EQ(reduce_loop_strength(*f, analyses.loop_info(*f)), 2u);
+
+    // Both addresses share one pointer, set up in the preheader and moved
+    // by three elements in the latch
+    EXPECT_EQ(count_opcode(f, Opcode::GetElementPtr), 2u);
+    auto *pointer = dynamic_cast<PhiInst *>(loop.cond->first_instruction());
+    ASSERT_NE(pointer, nullptr);
+    ASSERT_EQ(pointer->num_incoming(), 2u);
+    auto *start = dynamic_cast<GetElementPtrInst *>(pointer->get_incoming_value(0));
+    ASSERT_NE(start, nullptr);
+    EXPECT_EQ(start->parent(), loop.entry);
+    EXPECT_EQ(start->operand(2), builder.get_int32(2));
+    auto *step = dynamic_cast<GetElementPtrInst *>(pointer->get_incoming_value(1));
+    ASSERT_NE(step, nullptr);
+    EXPECT_EQ(step->parent(), loop.body);
+    EXPECT_EQ(step->base_pointer(), pointer);
+    EXPECT_EQ(step->operand(1), builder.get_int32(3));
+    for (Instruction &inst : *loop.body)
+    {
+        if (auto *store = dynamic_cast<StoreInst *>(&inst))
+        {
+            EXPECT_EQ(store->pointer(), pointer);
+        }
+    }
+}
+
+TEST(LoopUnroll, CountsConstantTrips)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    IRBuilder builder(&m);
+    auto empty = [](PhiInst *) {};
+
+    Function *up = m.create_function("up", m.get_void_type(), {});
+    make_loop(m, up, builder, builder.get_int32(0), builder.get_int32(64), 1, empty);
+    builder.create_ret_void();
+    // i = 10; i > 0; i -= 2
+    Function *down = m.create_function("down", m.get_void_type(), {});
+    make_loop(m, down, builder, builder.get_int32(10), builder.get_int32(0), -2, empty, ICmpInst::SGT);
+    builder.create_ret_void();
+    Function *unknown = m.create_function("unknown", m.get_void_type(), {{"n", i32}});
+    make_loop(m, unknown, builder, builder.get_int32(0), unknown->arg(0), 1, empty);
+    builder.create_ret_void();
+    Function *never = m.create_function("never", m.get_void_type(), {});
+    make_loop(m, never, builder, builder.get_int32(5), builder.get_int32(5), 1, empty);
+    builder.create_ret_void();
+
+    AnalysisManager analyses;
+    EXPECT_EQ(constant_trip_count(only_loop(analyses, up)), 64u);
+    EXPECT_EQ(unroll_factor(only_loop(analyses, up)), 8u);
+    EXPECT_EQ(constant_trip_count(only_loop(analyses, down)), 5u);
+    EXPECT_EQ(unroll_factor(only_loop(analyses, down)), 5u);
+    EXPECT_EQ(constant_trip_count(only_loop(analyses, unknown)), 0u);
+    EXPECT_EQ(unroll_factor(only_loop(analyses, unknown)), 1u);
+    EXPECT_EQ(constant_trip_count(only_loop(analyses, never)), 0u);
+}
+
+TEST(LoopUnroll, FollowsTheProfile)
+{
+    Module m;
+    IRBuilder builder(&m);
+    Function *f = m.create_function("f", m.get_void_type(), {{"x", m.get_integer_type(32)}});
+    // 3 instructions in for.cond and 22 in for.body: a factor of 4 fits the
+    // normal budget and 8 the hot one
+    CountedLoop loop = make_loop(m, f, builder, builder.get_int32(0), builder.get_int32(1024), 1, [&](PhiInst *i)
+    {
+        Value *acc = f->arg(0);
+        for (unsigned k = 0; k < 20; ++k)
+            acc = builder.create_add(acc, i);
+    });
+    builder.create_ret_void();
+
+    AnalysisManager analyses;
+    EXPECT_EQ(unroll_factor(only_loop(analyses, f)), 4u);
+    loop.entry->set_profile_count(1);
+    loop.cond->set_profile_count(1025);
+    loop.body->set_profile_count(1024);
+    EXPECT_EQ(unroll_factor(only_loop(analyses, f)), 8u);
+    // Never entered, so not worth growing
+    loop.entry->set_profile_count(0);
+    EXPECT_EQ(unroll_factor(only_loop(analyses, f)), 1u);
+
+    loop.entry->set_profile_count(1);
+    auto *test = static_cast<BranchInst *>(loop.cond->get_terminator());
+    test->set_branch_weights(1024, 1);
+    analyses.invalidate(*f, LoopUnrollPass().run(*f, analyses));
+    ASSERT_EQ(count_opcode(f, Opcode::ICmp), 8u);
+    // Each copy of the body runs an eighth as often, the exit still once
+    EXPECT_EQ(loop.body->profile_count(), 128u);
+    EXPECT_EQ(loop.cond->profile_count(), 128u);
+    EXPECT_EQ(test->true_weight(), 128u);
+    EXPECT_EQ(test->false_weight(), 1u);
+    for (BasicBlock *bb : f->basic_blocks())
+    {
+        if (bb != loop.entry && bb != loop.exit)
+        {
+            EXPECT_EQ(bb->profile_count(), 128u) << bb->name();
+        }
+    }
+}
+
+TEST(LoopUnroll, CopiesTheBodyWithoutTheConditionsInBetween)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", m.get_void_type(), {{"p", m.get_pointer_type(i32)}});
+    IRBuilder builder(&m);
+    CountedLoop loop = make_loop(m, f, builder, builder.get_int32(0), builder.get_int32(12), 1, [&](PhiInst *i)
+                                 { builder.create_store(i, builder.create_gep(f->arg(0), {i})); });
+    builder.create_ret_void();
+
+    AnalysisManager analyses;
+    const PreservedAnalyses preserved = LoopUnrollPass().run(*f, analyses);
+    EXPECT_FALSE(preserved.preserved(AnalysisKind::DominatorTree));
+    analyses.invalidate(*f, preserved);
+
+    // 12 trips of 6 instructions; 8 copies would be too many to divide 12
+    EXPECT_EQ(count_opcode(f, Opcode::Store), 6u);
+    EXPECT_EQ(count_opcode(f, Opcode::ICmp), 6u);
+    EXPECT_EQ(count_opcode(f, Opcode::CondBr) + count_opcode(f, Opcode::Br), 13u);
+    const Loop &unrolled = only_loop(analyses, f);
+    EXPECT_EQ(unrolled.header(), loop.cond);
+    EXPECT_EQ(unrolled.blocks().size(), 12u);
+    ASSERT_EQ(unrolled.latches().size(), 1u);
+    EXPECT_EQ(unrolled.latches().front()->name(), "for.body.unroll5");
+    // The header still is the only way out
+    unsigned exits = 0;
+    for (BasicBlock *bb : unrolled.blocks())
+    {
+        for (BasicBlock *succ : bb->successors())
+            exits += !unrolled.contains(succ);
+    }
+    EXPECT_EQ(exits, 1u);
+    EXPECT_EQ(loop.i->get_incoming_block(1), unrolled.latches().front());
+    // `i` now comes back through a chain of adds, so it isn't unrolled again
+    EXPECT_EQ(unroll_factor(unrolled), 1u);
+}
+
+TEST(LoopPasses, ReduceAndUnrollAnArrayWalk)
+{
+    // int a[4]; for (i = 0; i < 4; i++) a[i] = i * n;
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", m.get_void_type(), {{"n", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *a = builder.create_alloca(m.get_array_type(i32, 4), "a");
+    make_loop(m, f, builder, builder.get_int32(0), builder.get_int32(4), 1, [&](PhiInst *i)
+              { builder.create_store(builder.create_mul(i, f->arg(0)), builder.create_gep(a, {builder.get_int32(0), i})); });
+    builder.create_ret_void();
+
+    PassManager pm;
+    add_loop_passes(pm);
+    EXPECT_TRUE(pm.run(m));
+
+    EXPECT_EQ(count_opcode(f, Opcode::Store), 4u);
+    for (BasicBlock *bb : f->basic_blocks())
+    {
+        for (Instruction &inst : *bb)
+        {
+            // No address is computed from `i` any more
+            if (auto *gep = dynamic_cast<GetElementPtrInst *>(&inst))
+            {
+                EXPECT_EQ(dynamic_cast<PhiInst *>(gep->operand(gep->num_operands() - 1)), nullptr);
+            }
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 
+#include "src/live_interval_union.h"
 #include "src/lra.h"
 #include "src/machine.h"
 #include "src/targets/riscv_target.h"
@@ -195,6 +196,94 @@ TEST(LiveRangeTest, NonAdjacentIntervalsRemainSeparate)
     EXPECT_EQ(40, range.intervals()[1].end());
 }
 
+TEST(LiveRangeTest, OccurrencesSortedByPosition)
+{
+    MachineInst def0(RISCV::ADDI), use0(RISCV::ADD), both(RISCV::ADDI);
+    LiveRange range(100);
+    range.add_interval(10, 20);
+    range.add_interval(30, 40);
+
+    range.add_occurrence(30, &both, true);
+    range.add_occurrence(10, &def0, true);
+    range.add_occurrence(15, &use0, false);
+    range.add_occurrence(30, &both, false);
+    range.add_occurrence(10, &def0, true); // 重复记录被忽略
+
+    std::vector<LiveOccurrence> expected{
+        {10, true, &def0}, {15, false, &use0}, {30, false, &both}, {30, true, &both}};
+    EXPECT_EQ(range.occurrences(), expected);
+    EXPECT_EQ(range.occurrences_in(range.intervals()[0]).size(), 2u);
+    auto second = range.occurrences_in(range.intervals()[1]);
+    ASSERT_EQ(second.size(), 2u);
+    EXPECT_FALSE(second[0].is_def); // 同一位置先读后写
+
+    range.remove_occurrences(30, &both);
+    EXPECT_EQ(range.occurrences().size(), 2u);
+    EXPECT_TRUE(range.occurrences_in(range.intervals()[1]).empty());
+}
+
+TEST(LiveRangeTest, InterferenceWithManyIntervals)
+{
+    LiveRange many(100);
+    for (unsigned i = 0; i < 100; ++i)
+        many.add_interval(10 * i, 10 * i + 5); // [0,5) [10,15) ... [990,995)
+
+    LiveRange gap(101);
+    gap.add_interval(445, 450);
+    EXPECT_FALSE(many.interferes_with(gap));
+    EXPECT_FALSE(gap.interferes_with(many));
+
+    LiveRange hit(102);
+    hit.add_interval(445, 450);
+    hit.add_interval(994, 1000);
+    EXPECT_TRUE(many.interferes_with(hit));
+    EXPECT_TRUE(hit.interferes_with(many));
+}
+
+TEST(LiveIntervalUnionTest, InsertRemoveAndQuery)
+{
+    LiveRange phys(200);
+    phys.add_interval(0, 10);
+    phys.add_interval(40, 50);
+    LiveRange assigned(100, {LiveInterval(20, 30)});
+
+    LiveIntervalUnion lu;
+    lu.insert(&phys);
+    lu.insert(&assigned);
+    EXPECT_EQ(lu.size(), 3u);
+
+    LiveRange between(101, {LiveInterval(10, 20)}); // 与两侧只相邻
+    EXPECT_EQ(lu.find_conflict(between), nullptr);
+    LiveRange inside(102, {LiveInterval(25, 26)});
+    EXPECT_EQ(lu.find_conflict(inside), &assigned);
+    LiveRange across(103, {LiveInterval(35, 60)});
+    EXPECT_EQ(lu.find_conflict(across), &phys);
+
+    lu.remove(&assigned);
+    EXPECT_EQ(lu.size(), 2u);
+    EXPECT_EQ(lu.find_conflict(inside), nullptr);
+}
+
+TEST(InterferenceGraphTest, CompactAdjacency)
+{
+    // 结点 0..3 对应寄存器 5, 7, 9, 11；边可重复、可双向给出
+    InterferenceGraph graph({5, 7, 9, 11}, {{0, 1}, {1, 0}, {2, 0}, {0, 1}});
+    EXPECT_EQ(graph.num_nodes(), 4u);
+    EXPECT_EQ(graph.num_edges(), 2u);
+    EXPECT_EQ(graph.node(9), 2u);
+    EXPECT_EQ(graph.node(8), InterferenceGraph::NO_NODE);
+    EXPECT_EQ(graph.degree(0), 2u);
+    EXPECT_EQ(graph.degree(3), 0u);
+    EXPECT_TRUE(graph.interferes(5, 9));
+    EXPECT_TRUE(graph.interferes(9, 5));
+    EXPECT_FALSE(graph.interferes(7, 9));
+    EXPECT_FALSE(graph.interferes(5, 8));
+
+    auto map = graph.to_map();
+    EXPECT_EQ(map.size(), 3u); // 11 没有边
+    EXPECT_EQ(map[5], (std::set<unsigned>{7, 9}));
+}
+
 class MockMachineFunction : public MachineFunction
 {
     MachineModule *mm_;
@@ -595,10 +684,11 @@ TEST_F(LiveRangeAnalyzerTest, ComputeAndRetrieve)
     const LiveRange &range = *lra->get_live_range(vreg0); // [0, 4)
     EXPECT_EQ(vreg0, range.vreg());
 
-    // 验证计算出的区间是否符合预期
+    // 验证计算出的区间是否符合预期：从第一条指令到最后一条指令之后
+    const MachineBasicBlock *bb = mf->basic_blocks()[0].get();
     ASSERT_EQ(1, range.intervals().size());
-    EXPECT_EQ(0, range.intervals()[0].start());
-    EXPECT_EQ(3, range.intervals()[0].end());
+    EXPECT_EQ(mf->get_global_instr_pos(bb->instructions()[0].get()), range.intervals()[0].start());
+    EXPECT_EQ(bb->global_end(), range.intervals()[0].end());
 
     // 测试获取不存在的寄存器
     EXPECT_FALSE(lra->get_live_range(-1)); // 空值
@@ -619,10 +709,13 @@ TEST_F(LiveRangeAnalyzerTest, LiveRangeOperations)
     EXPECT_FALSE(range.intervals().empty());
 
     // 测试区间操作
-    EXPECT_TRUE(range.live_at(0));  // 区间内的点
-    EXPECT_TRUE(range.live_at(1));  // 区间内的点
-    EXPECT_FALSE(range.live_at(4)); // 区间外的点
-    EXPECT_FALSE(range.live_at(5)); // 区间外的点
+    const MachineBasicBlock *bb = mf->basic_blocks()[0].get();
+    auto pos = [&](size_t i) { return mf->get_global_instr_pos(bb->instructions()[i].get()); };
+    EXPECT_TRUE(range.live_at(pos(0)));             // 区间内的点
+    EXPECT_TRUE(range.live_at(pos(1)));             // 区间内的点
+    EXPECT_TRUE(range.live_at(pos(1) + 1));         // 指令之间的空隙
+    EXPECT_FALSE(range.live_at(pos(0) - 1));        // 区间外的点
+    EXPECT_FALSE(range.live_at(bb->global_end()));  // 区间外的点
 }
 
 TEST_F(LiveRangeAnalyzerTest, Construction)
@@ -707,6 +800,29 @@ TEST_F(LiveRangeAnalyzerTest, RISCVRigorousConflict)
     EXPECT_FALSE(lra->has_conflict(Reg::ZERO, Reg::ZERO)); // zero自检
 }
 
+TEST_F(LiveRangeAnalyzerTest, InterferenceMatchesPairwiseConflicts)
+{
+    mf->setup_rigorous_riscv_conflict_case();
+    InterferenceGraph graph = lra->build_interference();
+
+    std::vector<unsigned> regs;
+    for (const auto &[reg, lr] : lra->get_all_live_ranges())
+        regs.push_back(reg);
+    ASSERT_EQ(graph.num_nodes(), regs.size());
+
+    size_t edges = 0;
+    for (unsigned reg1 : regs)
+    {
+        for (unsigned reg2 : regs)
+        {
+            EXPECT_EQ(graph.interferes(reg1, reg2), lra->has_conflict(reg1, reg2)) << reg1 << " " << reg2;
+            edges += reg1 < reg2 && lra->has_conflict(reg1, reg2);
+        }
+    }
+    EXPECT_EQ(graph.num_edges(), edges);
+    EXPECT_GT(edges, 0u);
+}
+
 TEST_F(LiveRangeAnalyzerTest, InterferenceGraphBuilding)
 {
     auto vregs = mf->setup_graph_scenario(); // 设置一个已知干涉图的场景
@@ -836,7 +952,7 @@ TEST_F(LiveRangeAnalyzerTest, ComplexScenario)
 
     const LiveRange &range2 = *lra->get_live_range(vreg1);
     MO_DEBUG("range2: %s", range2.to_string().c_str());
-    EXPECT_EQ(2, range2.intervals().size()); 
+    EXPECT_EQ(1, range2.intervals().size()); // 循环里先读后写，沿回边一直活跃
 
     // 验证冲突
     EXPECT_TRUE(lra->has_conflict(vreg0, vreg1));
@@ -849,3 +965,135 @@ TEST_F(LiveRangeAnalyzerTest, ComplexScenario)
     EXPECT_EQ(3, graph.size());        
     EXPECT_EQ(1, graph[vreg0].size()); 
 }
+
+TEST_F(LiveRangeAnalyzerTest, BlockLivenessSets)
+{
+    auto vregs = mf->setup_complex_scenario();
+    unsigned vreg0 = vregs[0], vreg1 = vregs[1], vreg2 = vregs[2];
+    const MachineBasicBlock *entry = mf->basic_blocks()[0].get();
+    const MachineBasicBlock *loop = mf->basic_blocks()[1].get();
+    const MachineBasicBlock *exit = mf->basic_blocks()[2].get();
+
+    EXPECT_TRUE(lra->is_live_out(vreg0, entry));
+    EXPECT_TRUE(lra->is_live_in(vreg0, loop));
+    EXPECT_TRUE(lra->is_live_out(vreg1, loop));
+    EXPECT_FALSE(lra->is_live_in(vreg2, exit));
+    EXPECT_EQ(lra->live_in(exit), std::vector<unsigned>{vreg1});
+    EXPECT_TRUE(lra->live_out(exit).empty());
+    EXPECT_EQ(lra->block_defs(exit), std::vector<unsigned>{vreg2});
+    EXPECT_FALSE(lra->is_live_in(12345u, loop));
+}
+
+TEST_F(LiveRangeAnalyzerTest, BlockLivenessAcrossManyRegisters)
+{
+    // Enough registers to span several bit vector words
+    auto *def_bb = mf->create_block("defs");
+    auto *use_bb = mf->create_block("uses");
+    def_bb->add_successor(use_bb);
+    std::vector<unsigned> vregs;
+    for (unsigned i = 0; i < 150; ++i)
+    {
+        unsigned vreg = mf->create_vreg(RegClass::GR32, 4, false);
+        vregs.push_back(vreg);
+        auto def = std::make_unique<MachineInst>(RISCV::ADDI);
+        def->add_operand(MOperand::create_reg(vreg, true));
+        def->add_operand(MOperand::create_reg(Reg::ZERO));
+        def->add_operand(MOperand::create_imm(i));
+        def_bb->append(std::move(def));
+    }
+    for (unsigned i = 0; i < vregs.size(); i += 2)
+    {
+        auto use = std::make_unique<MachineInst>(RISCV::SW);
+        use->add_operand(MOperand::create_reg(vregs[i]));
+        use->add_operand(MOperand::create_mem_ri(Reg::SP, 0));
+        use_bb->append(std::move(use));
+    }
+
+    std::vector<unsigned> expected;
+    for (unsigned i = 0; i < vregs.size(); i += 2)
+    {
+        expected.push_back(vregs[i]);
+    }
+    EXPECT_EQ(lra->live_out(def_bb), expected);
+    EXPECT_EQ(lra->live_in(use_bb), expected);
+    EXPECT_EQ(lra->live_in(def_bb), std::vector<unsigned>{Reg::ZERO});
+    EXPECT_FALSE(lra->is_live_out(vregs[149], def_bb));
+    EXPECT_TRUE(lra->is_live_out(vregs[148], def_bb));
+}
+
+TEST_F(LiveRangeAnalyzerTest, IncrementalEditsMatchFullRecompute)
+{
+    auto *def_bb = mf->create_block("defs");
+    auto *use_bb = mf->create_block("uses");
+    def_bb->add_successor(use_bb);
+    std::vector<unsigned> vregs;
+    for (unsigned i = 0; i < 40; ++i)
+    {
+        unsigned vreg = mf->create_vreg(RegClass::GR32, 4, false);
+        vregs.push_back(vreg);
+        auto def = std::make_unique<MachineInst>(RISCV::ADDI);
+        def->add_operand(MOperand::create_reg(vreg, true));
+        def->add_operand(MOperand::create_reg(Reg::ZERO));
+        def->add_operand(MOperand::create_imm(i));
+        def_bb->append(std::move(def));
+    }
+    for (unsigned i = 0; i < vregs.size(); i += 2)
+    {
+        auto use = std::make_unique<MachineInst>(RISCV::SW);
+        use->add_operand(MOperand::create_reg(vregs[i]));
+        use->add_operand(MOperand::create_mem_ri(Reg::SP, 0));
+        use_bb->append(std::move(use));
+    }
+
+    // The function's own analyzer is the one the blocks report edits to
+    LiveRangeAnalyzer *live = mf->live_range_analyzer();
+    live->set_compute_metric_counter(mf->compute_call_count);
+    live->compute();
+    ASSERT_EQ(1, mf->compute_call_count);
+
+    // A new register read from an odd one, which now lives across the edge,
+    // ahead of the first instruction of `uses`
+    unsigned tmp = mf->create_vreg(RegClass::GR32, 4, false);
+    auto mi = std::make_unique<MachineInst>(RISCV::ADDI);
+    mi->add_operand(MOperand::create_reg(tmp, true));
+    mi->add_operand(MOperand::create_reg(vregs[1]));
+    mi->add_operand(MOperand::create_imm(5));
+    use_bb->insert(use_bb->begin(), std::move(mi));
+    auto store = std::make_unique<MachineInst>(RISCV::SW);
+    store->add_operand(MOperand::create_reg(tmp));
+    store->add_operand(MOperand::create_mem_ri(Reg::SP, 4));
+    use_bb->append(std::move(store));
+    // The only use of vregs[2] goes, and everything after it moves up
+    use_bb->erase(std::next(use_bb->begin(), 2));
+    // A ZERO read at the start of `defs` moves every position
+    auto nop = std::make_unique<MachineInst>(RISCV::ADDI);
+    nop->add_operand(MOperand::create_reg(Reg::ZERO, true));
+    nop->add_operand(MOperand::create_reg(Reg::ZERO));
+    nop->add_operand(MOperand::create_imm(0));
+    def_bb->insert(def_bb->begin(), std::move(nop));
+
+    LiveRangeAnalyzer fresh(*mf);
+    fresh.compute();
+    ASSERT_EQ(live->get_all_live_ranges().size(), fresh.get_all_live_ranges().size());
+    for (const auto &[reg, expected] : fresh.get_all_live_ranges())
+    {
+        LiveRange *patched = live->get_live_range(reg);
+        ASSERT_NE(patched, nullptr) << "reg " << reg;
+        EXPECT_EQ(patched->to_string(), expected->to_string()) << "reg " << reg;
+        EXPECT_EQ(patched->occurrences(), expected->occurrences()) << "reg " << reg;
+    }
+    for (const auto &bb : mf->basic_blocks())
+    {
+        EXPECT_EQ(live->live_in(bb.get()), fresh.live_in(bb.get()));
+        EXPECT_EQ(live->live_out(bb.get()), fresh.live_out(bb.get()));
+    }
+    EXPECT_TRUE(live->is_live_out(vregs[1], def_bb));
+    EXPECT_FALSE(live->is_live_out(vregs[2], def_bb));
+    // All of it patched in place
+    EXPECT_EQ(1, mf->compute_call_count);
+
+    // A CFG edit still throws everything away
+    use_bb->add_successor(def_bb);
+    live->compute();
+    EXPECT_EQ(2, mf->compute_call_count);
+}
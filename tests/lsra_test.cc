@@ -115,7 +115,7 @@ public:
         bb->append(std::move(mi));
     }
 
-    void append_call(MachineBasicBlock *bb, const std::string &target)
+    void append_call(MachineBasicBlock *bb, const char *target)
     {
         auto mi = std::make_unique<MachineInst>(ASIMOV::CALL);
         mi->add_operand(MOperand::create_label(target));
@@ -254,17 +254,17 @@ TEST(LSRATest, Test)
     RegAllocResult result = allocator.allocate_registers();
     MO_DEBUG(result.to_string().c_str());
     EXPECT_TRUE(result.successful);
-    auto allocation = allocator.get_vreg_to_preg_map();
+    const auto &allocation = allocator.get_vreg_to_preg_map();
     for (auto [vreg, preg] : allocation)
     {
         MO_DEBUG("vreg: %u -> preg: %u", vreg, preg);
     }
-    auto tmp_allocation = allocator.get_vreg_to_tmp_preg_map();
+    const auto &tmp_allocation = allocator.get_vreg_to_tmp_preg_map();
     for (auto [vreg, preg] : tmp_allocation)
     {
         MO_DEBUG("vreg: %u -> preg: %u (tmp)", vreg, preg);
     }
-    auto spillslots = allocator.get_vreg_to_spill_slot();
+    const auto &spillslots = allocator.get_vreg_to_spill_slot();
     for (auto [vreg, slot] : spillslots)
     {
         MO_DEBUG("vreg: %u -> slot: %d", vreg, slot);
@@ -282,6 +282,156 @@ TEST(LSRATest, Test)
              ss_alloc.str().c_str());
 }
 
+static unsigned count_opcode(const MachineBasicBlock *bb, unsigned opcode)
+{
+    unsigned count = 0;
+    for (const auto &mi : bb->instructions())
+        count += mi->opcode() == opcode;
+    return count;
+}
+
+TEST(LSRATest, SplitsAroundHighPressureLoop)
+{
+    MockMachineFunction mf;
+    auto *entry = mf.create_block("entry");
+    auto *loop = mf.create_block("loop");
+    auto *exit = mf.create_block("exit");
+
+    // v 只在循环前后用到；循环里另外五个值同时活跃，占满全部寄存器。
+    // v 从内存读来，不能重算，只能溢出
+    unsigned v = mf.create_vreg(GR32, 4, false);
+    std::array<unsigned, 5> hot;
+    for (auto &reg : hot)
+        reg = mf.create_vreg(GR32, 4, false);
+    mf.append_inst(entry, LOAD, v, R7, 0, 8);
+    for (unsigned i = 0; i < hot.size(); ++i)
+        mf.append_inst(entry, MOVW, hot[i], 0, 0, i + 1);
+    mf.append_jump(entry, JMP, 0, loop);
+
+    mf.append_inst(loop, ADD, hot[0], hot[0], hot[1]);
+    mf.append_inst(loop, ADD, hot[2], hot[2], hot[3]);
+    mf.append_inst(loop, SUB, hot[4], hot[4], hot[1]);
+    mf.append_jump(loop, JNZ, hot[4], loop, 0);
+
+    mf.append_inst(exit, ADD, R0, v, hot[0]);
+    mf.append_ret(exit);
+    mf.build_cfg();
+
+    LinearScanRegisterAllocator allocator(mf);
+    RegAllocResult result = allocator.allocate_registers();
+    ASSERT_TRUE(result.successful) << result.error_message;
+    EXPECT_EQ(result.num_spills, 1u);
+
+    // 循环里的值都留在寄存器里，只有 v 被切开
+    const auto &assignment = allocator.get_vreg_to_preg_map();
+    for (unsigned reg : hot)
+        EXPECT_TRUE(assignment.count(reg)) << reg;
+    EXPECT_FALSE(assignment.count(v));
+    EXPECT_TRUE(allocator.get_vreg_to_spill_slot().count(v));
+
+    allocator.apply();
+    // 定义后写回一次，循环里没有溢出代码，循环后的使用之前装回一次
+    EXPECT_EQ(count_opcode(entry, STORE), 1u);
+    EXPECT_EQ(count_opcode(loop, LOAD) + count_opcode(loop, STORE), 0u);
+    EXPECT_EQ(count_opcode(exit, LOAD), 1u);
+    EXPECT_EQ(exit->instructions().front()->opcode(), (unsigned)LOAD);
+    for (const auto &bb : mf.basic_blocks())
+    {
+        for (const auto &mi : bb->instructions())
+        {
+            for (unsigned reg : mi->uses())
+                EXPECT_TRUE(MachineFunction::is_physical_reg(reg)) << reg;
+            for (unsigned reg : mi->defs())
+                EXPECT_TRUE(MachineFunction::is_physical_reg(reg)) << reg;
+        }
+    }
+}
+
+// 同样的压力下，v 是常数：不占栈槽，循环后重算一遍，没有任何访存
+TEST(LSRATest, RematerializesConstantsInsteadOfSpilling)
+{
+    MockMachineFunction mf;
+    auto *entry = mf.create_block("entry");
+    auto *loop = mf.create_block("loop");
+    auto *exit = mf.create_block("exit");
+
+    unsigned v = mf.create_vreg(GR32, 4, false);
+    std::array<unsigned, 5> hot;
+    for (auto &reg : hot)
+        reg = mf.create_vreg(GR32, 4, false);
+    mf.append_inst(entry, MOVW, v, 0, 0, 7);
+    for (unsigned i = 0; i < hot.size(); ++i)
+        mf.append_inst(entry, MOVW, hot[i], 0, 0, i + 1);
+    mf.append_jump(entry, JMP, 0, loop);
+
+    mf.append_inst(loop, ADD, hot[0], hot[0], hot[1]);
+    mf.append_inst(loop, ADD, hot[2], hot[2], hot[3]);
+    mf.append_inst(loop, SUB, hot[4], hot[4], hot[1]);
+    mf.append_jump(loop, JNZ, hot[4], loop, 0);
+
+    mf.append_inst(exit, ADD, R0, v, hot[0]);
+    mf.append_ret(exit);
+    mf.build_cfg();
+
+    LinearScanRegisterAllocator allocator(mf);
+    RegAllocResult result = allocator.allocate_registers();
+    ASSERT_TRUE(result.successful) << result.error_message;
+    EXPECT_EQ(result.num_spills, 0u);
+    EXPECT_EQ(result.num_remats, 1u);
+    EXPECT_TRUE(allocator.is_rematerialized(v));
+    EXPECT_FALSE(allocator.get_vreg_to_spill_slot().count(v));
+
+    allocator.apply();
+    for (const auto &bb : mf.basic_blocks())
+        EXPECT_EQ(count_opcode(bb.get(), LOAD) + count_opcode(bb.get(), STORE), 0u) << bb->label();
+    const MachineInst &remat = *exit->instructions().front();
+    ASSERT_EQ(remat.opcode(), (unsigned)MOVW);
+    EXPECT_TRUE(MachineFunction::is_physical_reg(remat.operands()[0].reg()));
+    EXPECT_EQ(remat.operands()[1].imm(), 7);
+    EXPECT_EQ(exit->instructions()[1]->operands()[1].reg(), remat.operands()[0].reg());
+}
+
+TEST(LSRATest, SpillCostGrowsWithLoopDepth)
+{
+    MockMachineFunction mf;
+    mf.setup_simple_loop();
+    mf.build_cfg();
+
+    LinearScanRegisterAllocator allocator(mf);
+    ASSERT_TRUE(allocator.allocate_registers().successful);
+
+    // 定义按两次计，循环里的每次引用放大十倍：tmp1 在入口定义、循环里用一次，
+    // 又是常数，能重算，代价减半；sum 入口定义，循环里定义三次、读两次，出口读一次
+    LiveRangeAnalyzer lra(mf);
+    const auto &entry = mf.basic_blocks().front()->instructions();
+    const unsigned sum = *std::next(entry.begin(), 1)->get()->defs().begin();
+    const unsigned tmp1 = *std::next(entry.begin(), 2)->get()->defs().begin();
+    const float weight = mf.parent()->target_reg_info()->get_reg_class_weight(GR32);
+    EXPECT_FLOAT_EQ(allocator.calculate_spill_cost(tmp1, *lra.get_live_range(tmp1)), (2.0f + 10.0f) * 0.5f * weight);
+    EXPECT_FLOAT_EQ(allocator.calculate_spill_cost(sum, *lra.get_live_range(sum)), (2.0f + 3 * 20.0f + 2 * 10.0f + 1.0f) * weight);
+}
+
+TEST(LSRATest, SpillCostFollowsProfileCounts)
+{
+    MockMachineFunction mf;
+    mf.setup_simple_loop();
+    mf.build_cfg();
+    // 入口和出口各跑一次，循环跑五次
+    for (const auto &bb : mf.basic_blocks())
+        bb->set_profile_count(bb->label() == "loop" ? 5 : 1);
+
+    LinearScanRegisterAllocator allocator(mf);
+    ASSERT_TRUE(allocator.allocate_registers().successful);
+
+    LiveRangeAnalyzer lra(mf);
+    const auto &entry = mf.basic_blocks().front()->instructions();
+    const unsigned sum = *std::next(entry.begin(), 1)->get()->defs().begin();
+    const unsigned tmp1 = *std::next(entry.begin(), 2)->get()->defs().begin();
+    const float weight = mf.parent()->target_reg_info()->get_reg_class_weight(GR32);
+    EXPECT_FLOAT_EQ(allocator.calculate_spill_cost(tmp1, *lra.get_live_range(tmp1)), (2.0f + 5.0f) * 0.5f * weight);
+    EXPECT_FLOAT_EQ(allocator.calculate_spill_cost(sum, *lra.get_live_range(sum)), (2.0f + 3 * 10.0f + 2 * 5.0f + 1.0f) * weight);
+}
+
 // TEST(LSRATest, Test)
 // {
 //     MockMachineFunction mf;
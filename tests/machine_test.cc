@@ -64,6 +64,54 @@ TEST(MachineFunctionTest, GlobalInstrPosition)
               mf.get_global_instr_pos((++bb->begin())->get()));
 }
 
+TEST(MachineFunctionTest, SlotIndexesLeaveGapsForInserts)
+{
+    MachineFunction mf(nullptr, nullptr);
+    auto *bb0 = mf.create_block();
+    auto *bb1 = mf.create_block();
+    for (unsigned i = 0; i < 3; ++i)
+        bb0->append(std::make_unique<MachineInst>(i));
+    bb1->append(std::make_unique<MachineInst>(3));
+
+    const SlotIndexes &slots = mf.slot_indexes();
+    std::vector<size_t> before;
+    for (const auto &mi : bb0->instructions())
+        before.push_back(mf.get_global_instr_pos(mi.get()));
+    const unsigned generation = slots.generation();
+    EXPECT_EQ(slots.next_index(bb0->instructions().back().get()), bb1->global_start());
+
+    // Inserts take the midpoint of their neighbours; nothing else moves
+    MachineInst *front = bb0->insert(bb0->begin(), std::make_unique<MachineInst>(4))->get();
+    MachineInst *middle = bb0->insert(bb0->begin() + 2, std::make_unique<MachineInst>(5))->get();
+    bb0->append(std::make_unique<MachineInst>(6));
+    MachineBasicBlock *bb2 = mf.create_block();
+    EXPECT_EQ(slots.generation(), generation);
+    EXPECT_EQ(mf.get_global_instr_pos(bb0->instructions()[1].get()), before[0]);
+    EXPECT_EQ(mf.get_global_instr_pos(bb0->instructions()[3].get()), before[1]);
+    EXPECT_EQ(mf.get_global_instr_pos(bb0->instructions()[4].get()), before[2]);
+    EXPECT_LT(mf.get_global_instr_pos(front), before[0]);
+    EXPECT_GT(mf.get_global_instr_pos(middle), before[0]);
+    EXPECT_EQ(bb0->locate(middle)->get(), middle);
+    EXPECT_EQ(slots.block_at(slots.block_start(bb2)), bb2);
+
+    // Inserting at the same spot over and over runs out of room
+    for (unsigned i = 0; i < 40; ++i)
+        bb0->insert(bb0->begin(), std::make_unique<MachineInst>(7));
+    EXPECT_NE(slots.generation(), generation);
+    size_t last = 0;
+    for (const auto &bb : mf.basic_blocks())
+    {
+        for (const auto &mi : bb->instructions())
+        {
+            size_t pos = mf.get_global_instr_pos(mi.get());
+            EXPECT_LT(last, pos);
+            EXPECT_EQ(slots.block_at(pos), bb.get());
+            last = pos;
+        }
+    }
+    EXPECT_EQ(slots.next_index(bb1->instructions().back().get()), slots.end());
+}
+
 TEST(MachineFunctionTest, FrameObjectLayout)
 {
     MachineFunction mf(nullptr, nullptr);
@@ -145,6 +193,141 @@ TEST(MachineInstTest, RegisterAnalysis)
     EXPECT_TRUE(uses.count(20));
 }
 
+// 紧凑编码：负数、浮点和缩放因子都原样取回
+TEST(MOperandTest, CompactEncodingRoundTrips)
+{
+    EXPECT_EQ(sizeof(MOperand), 16u);
+
+    auto fi = MOperand::create_frame_index(-3);
+    EXPECT_EQ(fi.frame_index(), -3);
+    auto mem_fi = MOperand::create_mem_fi(-2, -8);
+    EXPECT_EQ(mem_fi.mem_fi().frame_index, -2);
+    EXPECT_EQ(mem_fi.mem_fi().offset, -8);
+    auto rix = MOperand::create_mem_rix(1000, 1001, 8, -16).get_mem_rix();
+    EXPECT_EQ(rix.base_reg, 1000u);
+    EXPECT_EQ(rix.index_reg, 1001u);
+    EXPECT_EQ(rix.scale, 8);
+    EXPECT_EQ(rix.offset, -16);
+    EXPECT_EQ(MOperand::create_fp_imm(-0.5).fp_imm(), -0.5);
+    EXPECT_EQ(MOperand::create_imm(INT64_MIN).imm(), INT64_MIN);
+    EXPECT_FALSE(MOperand().is_valid());
+}
+
+// 同名符号只存一份，操作数指向模块里的那一份
+TEST(MachineModuleTest, InternsSymbolsOnce)
+{
+    MachineModule mm(nullptr);
+    const char *callee = mm.intern_symbol("callee");
+    EXPECT_EQ(mm.intern_symbol(std::string("call") + "ee"), callee);
+    EXPECT_NE(mm.intern_symbol("other"), callee);
+    EXPECT_STREQ(callee, "callee");
+
+    auto op = MOperand::create_external_sym(callee);
+    EXPECT_EQ(op.external_sym(), callee);
+    EXPECT_EQ(op.to_string(), "sym(callee)");
+}
+
+// 超过内联容量的操作数搬到堆上，顺序不变
+TEST(MachineInstTest, OperandsOutgrowInlineStorage)
+{
+    MachineInst inst(42, {MOperand::create_reg(1, true), MOperand::create_reg(2)});
+    for (int i = 0; i < 5; ++i)
+        inst.add_operand(MOperand::create_imm(i));
+    inst.insert_operand(1, MOperand::create_imm(100));
+    inst.remove_operand(0);
+
+    ASSERT_EQ(inst.operands().size(), 7u);
+    EXPECT_EQ(inst.operands()[0].imm(), 100);
+    EXPECT_EQ(inst.operands()[1].reg(), 2u);
+    for (int i = 0; i < 5; ++i)
+        EXPECT_EQ(inst.operand(2 + i).imm(), i);
+}
+
+// 按虚拟寄存器编号直接查表；NO_REG 和表外的寄存器保持不变
+TEST(MachineInstTest, RemapRegistersThroughDenseTable)
+{
+    MachineFunction mf(nullptr, nullptr);
+    unsigned v0 = mf.create_vreg(0);
+    unsigned v1 = mf.create_vreg(0);
+    unsigned v2 = mf.create_vreg(0);
+    unsigned v3 = mf.create_vreg(0);
+
+    MachineInst inst(42, {MOperand::create_reg(v0, true), MOperand::create_mem_rr(v1, v2),
+                          MOperand::create_mem_ri(v3, 4), MOperand::create_reg(5)});
+    std::vector<unsigned> map(3, MachineInst::NO_REG);
+    map[MachineFunction::vreg_index(v0)] = 7;
+    map[MachineFunction::vreg_index(v2)] = 8;
+    inst.remap_registers(map);
+
+    EXPECT_EQ(inst.operands()[0].reg(), 7u);
+    EXPECT_TRUE(inst.operands()[0].is_def());
+    EXPECT_EQ(inst.operands()[1].mem_rr().base_reg, v1);
+    EXPECT_EQ(inst.operands()[1].mem_rr().index_reg, 8u);
+    EXPECT_EQ(inst.operands()[2].mem_ri().base_reg, v3);
+    EXPECT_EQ(inst.operands()[2].mem_ri().offset, 4);
+    EXPECT_EQ(inst.operands()[3].reg(), 5u);
+}
+
+// 表按编号存取，遍历只给出记录过的项；空槽的值就是 NO_REG，可以直接交给 remap_registers
+TEST(VRegTableTest, DenseSlotsFeedRemap)
+{
+    MachineFunction mf(nullptr, nullptr);
+    unsigned v0 = mf.create_vreg(0, 8, true);
+    unsigned v1 = mf.clone_vreg(v0);
+    unsigned v2 = mf.create_vreg(1);
+    EXPECT_EQ(mf.num_vregs(), 3u);
+    EXPECT_EQ(mf.get_vreg_info(v1).size_, 8u);
+    EXPECT_TRUE(mf.get_vreg_info(v1).is_fp_);
+    EXPECT_EQ(mf.get_vreg_info(v2).register_class_id_, 1u);
+
+    VRegToPregTable table;
+    EXPECT_TRUE(table.empty());
+    table.set(v2, 6);
+    table.set(v0, 4);
+    EXPECT_EQ(table.size(), 2u);
+    EXPECT_TRUE(table.contains(v0));
+    EXPECT_FALSE(table.contains(v1));
+    EXPECT_FALSE(table.contains(3)); // 物理寄存器不在表里
+    EXPECT_EQ(table.lookup(v1), MachineInst::NO_REG);
+    EXPECT_THROW(table.at(v1), std::out_of_range);
+
+    std::vector<std::pair<unsigned, unsigned>> entries(table.begin(), table.end());
+    EXPECT_EQ(entries, (std::vector<std::pair<unsigned, unsigned>>{{v0, 4}, {v2, 6}}));
+
+    MachineInst inst(1, {MOperand::create_reg(v0, true), MOperand::create_reg(v1), MOperand::create_reg(v2)});
+    inst.remap_registers(table.slots());
+    EXPECT_EQ(inst.operands()[0].reg(), 4u);
+    EXPECT_EQ(inst.operands()[1].reg(), v1);
+    EXPECT_EQ(inst.operands()[2].reg(), 6u);
+
+    table.erase(v0);
+    table.erase(v1);
+    EXPECT_EQ(table.size(), 1u);
+    EXPECT_EQ((*table.begin()).first, v2);
+}
+
+// 作用域内新建的指令来自函数的池，删除后回到池里
+TEST(MachineFunctionTest, InstructionsComeFromFunctionPool)
+{
+    MachineFunction mf(nullptr, nullptr);
+    auto *bb = mf.create_block();
+    bb->append(std::make_unique<MachineInst>(1));
+    EXPECT_EQ(mf.inst_pool().num_live_objects(), 0u);
+    {
+        MachineInstPoolScope scope(mf);
+        EXPECT_EQ(MachineInstPoolScope::current(), &mf.inst_pool());
+        bb->append(std::make_unique<MachineInst>(2));
+        bb->append(std::make_unique<MachineInst>(3));
+    }
+    EXPECT_EQ(MachineInstPoolScope::current(), nullptr);
+    EXPECT_EQ(mf.inst_pool().num_live_objects(), 2u);
+
+    bb->erase(std::next(bb->begin()));
+    EXPECT_EQ(mf.inst_pool().num_live_objects(), 1u);
+    bb->erase(bb->begin());
+    EXPECT_EQ(mf.inst_pool().num_live_objects(), 1u);
+}
+
 TEST(MachineBasicBlockTest, CFGManagement)
 {
     MachineFunction mf(nullptr, nullptr);
@@ -188,3 +371,31 @@ TEST(MachineFunctionTest, FrameObjectManagement)
     EXPECT_EQ(retrieved->alignment, 4);
     EXPECT_EQ(retrieved->flags, FrameObjectMetadata::IsFixedSize);
 }
+
+TEST(TargetRegisterInfoTest, AllocationTablesFollowAliases)
+{
+    // 四个寄存器：0 保留，2 与 3 互为别名；两个类共用寄存器 2
+    class TestRegisterInfo : public TargetRegisterInfo
+    {
+    public:
+        TestRegisterInfo() : TargetRegisterInfo(4)
+        {
+            for (unsigned reg = 0; reg < 4; ++reg)
+                reg_descs_[reg] = {.spill_cost = 1, .is_reserved = reg == 0, .is_allocatable = true, .primary_rc_id = 0, .rc_mask = {}};
+            add_register_class({.id = 0, .name = "A", .regs = {0, 1, 2}, .copy_cost = 1, .weight = 1});
+            add_register_class({.id = 1, .name = "B", .regs = {2, 3}, .copy_cost = 1, .weight = 1});
+            add_alias(2, 3);
+        }
+    } tri;
+
+    auto order = tri.allocation_order(0);
+    EXPECT_EQ(std::vector<unsigned>(order.begin(), order.end()), (std::vector<unsigned>{1, 2}));
+    EXPECT_EQ(tri.allocation_order(1).size(), 2u);
+    EXPECT_EQ(tri.allocation_order(7).size(), 0u);
+
+    EXPECT_EQ(tri.alias_mask(1, 0), 0b01u);
+    EXPECT_EQ(tri.alias_mask(1, 1), 0u);
+    EXPECT_EQ(tri.alias_mask(2, 1), 0b11u);
+    EXPECT_EQ(tri.alias_mask(3, 0), 0b10u); // 3 不在类 A 里，但占住了别名 2
+    EXPECT_EQ(tri.alias_mask(0, 0), 0u);
+}
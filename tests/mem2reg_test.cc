@@ -0,0 +1,213 @@
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/mem2reg.h"
+#include "tests/ir_test_util.h"
+
+namespace
+{
+    using ir_test::count_opcode;
+
+    PhiInst *first_phi(BasicBlock *bb)
+    {
+        return dynamic_cast<PhiInst *>(bb->first_instruction());
+    }
+
+    Value *incoming_from(PhiInst *phi, BasicBlock *pred)
+    {
+        for (unsigned i = 0; i < phi->num_incoming(); ++i)
+        {
+            if (phi->get_incoming_block(i) == pred)
+                return phi->get_incoming_value(i);
+        }
+        return nullptr;
+    }
+}
+
+TEST(DominatorTree, DiamondAndLoop)
+{
+    // entry -> (then | else) -> merge -> loop <-> loop, loop -> exit
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *then_bb = f->create_basic_block("then");
+    BasicBlock *else_bb = f->create_basic_block("else");
+    BasicBlock *merge = f->create_basic_block("merge");
+    BasicBlock *loop = f->create_basic_block("loop");
+    BasicBlock *exit = f->create_basic_block("exit");
+    BasicBlock *dead = f->create_basic_block("dead");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_cond_br(f->arg(0), then_bb, else_bb);
+    builder.set_insert_point(then_bb);
+    builder.create_br(merge);
+    builder.set_insert_point(else_bb);
+    builder.create_br(merge);
+    builder.set_insert_point(merge);
+    builder.create_br(loop);
+    builder.set_insert_point(loop);
+    builder.create_cond_br(f->arg(0), loop, exit);
+    builder.set_insert_point(exit);
+    builder.create_ret(m.get_constant_int(i32, 0));
+    builder.set_insert_point(dead);
+    builder.create_br(exit);
+
+    DominatorTree dom_tree(*f);
+    EXPECT_EQ(dom_tree.root(), entry);
+    EXPECT_EQ(dom_tree.idom(entry), nullptr);
+    EXPECT_EQ(dom_tree.idom(then_bb), entry);
+    EXPECT_EQ(dom_tree.idom(merge), entry);
+    EXPECT_EQ(dom_tree.idom(exit), loop);
+    EXPECT_TRUE(dom_tree.dominates(merge, exit));
+    EXPECT_TRUE(dom_tree.dominates(loop, loop));
+    EXPECT_FALSE(dom_tree.dominates(then_bb, merge));
+    EXPECT_FALSE(dom_tree.is_reachable(dead));
+    EXPECT_EQ(dom_tree.reverse_post_order().size(), 6u);
+
+    DominanceFrontier frontier(dom_tree);
+    EXPECT_EQ(frontier.frontier(then_bb), std::vector<BasicBlock *>{merge});
+    EXPECT_EQ(frontier.frontier(loop), std::vector<BasicBlock *>{loop});
+    EXPECT_TRUE(frontier.frontier(entry).empty());
+    EXPECT_EQ(frontier.iterated({then_bb}), std::vector<BasicBlock *>{merge});
+}
+
+TEST(Mem2Reg, PromotesDiamond)
+{
+    // x = 1; if (c) x = 2; return x;
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *then_bb = f->create_basic_block("then");
+    BasicBlock *merge = f->create_basic_block("merge");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *x = builder.create_alloca(i32, "x");
+    builder.create_store(m.get_constant_int(i32, 1), x);
+    builder.create_cond_br(f->arg(0), then_bb, merge);
+    builder.set_insert_point(then_bb);
+    builder.create_store(m.get_constant_int(i32, 2), x);
+    builder.create_br(merge);
+    builder.set_insert_point(merge);
+    ReturnInst *ret = builder.create_ret(builder.create_load(x));
+
+    EXPECT_TRUE(is_alloca_promotable(x));
+    EXPECT_EQ(promote_allocas(*f), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Store), 0u);
+
+    PhiInst *phi = first_phi(merge);
+    ASSERT_NE(phi, nullptr);
+    EXPECT_EQ(ret->value(), phi);
+    EXPECT_EQ(phi->num_incoming(), 2u);
+    EXPECT_EQ(incoming_from(phi, entry), m.get_constant_int(i32, 1));
+    EXPECT_EQ(incoming_from(phi, then_bb), m.get_constant_int(i32, 2));
+}
+
+TEST(Mem2Reg, PromotesLoopCounter)
+{
+    // i = n; do { i = i - 1; } while (i > 0); return i;
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"n", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *loop = f->create_basic_block("loop");
+    BasicBlock *exit = f->create_basic_block("exit");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *i = builder.create_alloca(i32, "i");
+    builder.create_store(f->arg(0), i);
+    builder.create_br(loop);
+    builder.set_insert_point(loop);
+    Value *next = builder.create_sub(builder.create_load(i), m.get_constant_int(i32, 1));
+    builder.create_store(next, i);
+    Value *cond = builder.create_icmp(ICmpInst::SGT, builder.create_load(i), m.get_constant_int(i32, 0));
+    builder.create_cond_br(cond, loop, exit);
+    builder.set_insert_point(exit);
+    ReturnInst *ret = builder.create_ret(builder.create_load(i));
+
+    EXPECT_EQ(promote_allocas(*f), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load) + count_opcode(f, Opcode::Store), 0u);
+
+    // The loop header merges the argument with the decremented value; the
+    // exit needs no phi of its own, as only the loop reaches it
+    PhiInst *phi = first_phi(loop);
+    ASSERT_NE(phi, nullptr);
+    EXPECT_EQ(incoming_from(phi, entry), f->arg(0));
+    EXPECT_EQ(incoming_from(phi, loop), next);
+    auto *sub = dynamic_cast<BinaryInst *>(next);
+    ASSERT_NE(sub, nullptr);
+    EXPECT_EQ(sub->left(), phi);
+    EXPECT_EQ(first_phi(exit), nullptr);
+    EXPECT_EQ(ret->value(), next);
+    EXPECT_EQ(count_opcode(f, Opcode::Phi), 1u);
+}
+
+TEST(Mem2Reg, PrunesDeadPhisAndReadsZeroBeforeStore)
+{
+    // y is read before any store; t is stored on both arms but never read
+    // after the merge, so it needs no phi
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *then_bb = f->create_basic_block("then");
+    BasicBlock *else_bb = f->create_basic_block("else");
+    BasicBlock *merge = f->create_basic_block("merge");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *y = builder.create_alloca(i32, "y");
+    AllocaInst *t = builder.create_alloca(i32, "t");
+    Value *first = builder.create_load(y);
+    builder.create_cond_br(f->arg(0), then_bb, else_bb);
+    builder.set_insert_point(then_bb);
+    builder.create_store(m.get_constant_int(i32, 3), t);
+    builder.create_br(merge);
+    builder.set_insert_point(else_bb);
+    builder.create_store(m.get_constant_int(i32, 4), t);
+    builder.create_br(merge);
+    builder.set_insert_point(merge);
+    ReturnInst *ret = builder.create_ret(first);
+
+    EXPECT_EQ(promote_allocas(*f), 2u);
+    EXPECT_EQ(ret->value(), m.get_constant_int(i32, 0));
+    EXPECT_EQ(count_opcode(f, Opcode::Phi), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Store), 0u);
+}
+
+TEST(Mem2Reg, KeepsEscapingAndAggregateSlots)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *pair = m.get_struct_type("Pair", {MemberInfo("a", i32), MemberInfo("b", i32)});
+    Function *f = m.create_function("f", i32, {});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *escaped = builder.create_alloca(i32, "escaped");
+    AllocaInst *holder = builder.create_alloca(m.get_pointer_type(i32), "holder");
+    AllocaInst *agg = builder.create_alloca(pair, "agg");
+    AllocaInst *plain = builder.create_alloca(i32, "plain");
+    builder.create_store(escaped, holder);
+    builder.create_store(m.get_constant_int(i32, 7), plain);
+    Value *field = builder.create_struct_gep(agg, 0);
+    builder.create_store(builder.create_load(plain), field);
+    builder.create_ret(builder.create_load(builder.create_load(holder)));
+
+    EXPECT_FALSE(is_alloca_promotable(escaped));
+    EXPECT_FALSE(is_alloca_promotable(agg));
+    EXPECT_TRUE(is_alloca_promotable(holder));
+    EXPECT_TRUE(is_alloca_promotable(plain));
+
+    EXPECT_EQ(promote_allocas(*f), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 2u);
+    // The loads through the escaped slot and the store into the aggregate stay
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 1u);
+    EXPECT_EQ(count_opcode(f, Opcode::Store), 1u);
+}
@@ -0,0 +1,352 @@
+#include <gtest/gtest.h>
+#include <sstream>
+
+#include "src/ir_builder.h"
+#include "src/isel.h"
+#include "src/machine.h"
+#include "src/reg_alloc/module_allocator.h"
+#include "src/targets/asimov_target.h"
+#include "src/targets/riscv_isel.h"
+#include "src/targets/riscv_target.h"
+#include "src/thread_pool.h"
+
+using namespace ASIMOV;
+
+// 补全抽象接口，栈帧只按总大小算
+class TestFrameLowering : public ASIMOVFrameLowering
+{
+public:
+    int get_frame_index_offset(const MachineFunction &mf, int frame_index) const override
+    {
+        return static_cast<int>(mf.frame()->get_frame_index_offset(frame_index));
+    }
+    FrameLayout compute_frame_layout(const MachineFunction &mf) const override
+    {
+        return {static_cast<int>(mf.frame()->get_total_frame_size()), 0};
+    }
+    void emit_stack_protector(MachineFunction &, int) const override {}
+};
+
+class TestModule
+{
+public:
+    MachineModule mm{nullptr};
+    ASIMOVRegisterInfo tri;
+    ASIMOVTargetInstInfo tii;
+
+    // 函数 i 有 2 + i 个同时活跃的值，都从内存读来，后面的函数要溢出
+    explicit TestModule(unsigned num_functions)
+    {
+        mm.set_target_info(&tri, &tii);
+        for (unsigned i = 0; i < num_functions; ++i)
+        {
+            MachineFunction *mf = mm.create_machine_function(nullptr);
+            auto *bb = mf->create_block("entry");
+            std::vector<unsigned> values;
+            for (unsigned j = 0; j < 2 + i; ++j)
+            {
+                values.push_back(mf->create_vreg(GR32, 4, false));
+                auto load = std::make_unique<MachineInst>(LOAD, std::vector<MOperand>{MOperand::create_reg(values.back(), true), MOperand::create_mem_ri(R7, 4 * j)});
+                load->set_flag(MIFlag::MayLoad);
+                bb->append(std::move(load));
+            }
+            for (size_t j = 1; j < values.size(); ++j)
+            {
+                bb->append(std::make_unique<MachineInst>(ADD, std::vector<MOperand>{MOperand::create_reg(values[0], true), MOperand::create_reg(values[0]), MOperand::create_reg(values[j])}));
+            }
+            bb->append(std::make_unique<MachineInst>(MOVW, std::vector<MOperand>{MOperand::create_reg(R0, true), MOperand::create_reg(values[0])}));
+            auto ret = std::make_unique<MachineInst>(RET);
+            ret->set_flag(MIFlag::Terminator);
+            bb->append(std::move(ret));
+            mf->build_cfg();
+        }
+    }
+
+    std::vector<std::string> texts() const
+    {
+        std::vector<std::string> out;
+        for (const auto &mf : mm.functions())
+        {
+            std::ostringstream os;
+            mf->export_text(os);
+            out.push_back(os.str());
+        }
+        return out;
+    }
+};
+
+TEST(ModuleAllocatorTest, ParallelMatchesSerial)
+{
+    for (unsigned opt_level : {0u, 2u})
+    {
+        TestModule serial(12), parallel(12);
+        TestFrameLowering frame_lowering;
+        ThreadPool pool(4);
+
+        auto expected = allocate_module(serial.mm, opt_level, &frame_lowering);
+        auto actual = allocate_module(parallel.mm, opt_level, &frame_lowering, &pool);
+        ASSERT_EQ(actual.size(), 12u);
+        for (size_t i = 0; i < actual.size(); ++i)
+        {
+            EXPECT_EQ(actual[i].mf, parallel.mm.functions()[i].get());
+            EXPECT_TRUE(actual[i].regalloc.successful) << actual[i].regalloc.error_message;
+            EXPECT_EQ(actual[i].regalloc.num_spills, expected[i].regalloc.num_spills);
+            EXPECT_EQ(actual[i].frame_layout.stack_size, expected[i].frame_layout.stack_size);
+        }
+        EXPECT_EQ(parallel.texts(), serial.texts());
+
+        // 小函数不溢出，没有栈帧；最大的函数溢出后在入口分配栈空间
+        EXPECT_EQ(actual.front().frame_layout.stack_size, 0);
+        EXPECT_GT(actual.back().frame_layout.stack_size, 0);
+        const MachineInst &entry = *parallel.mm.functions().back()->basic_blocks().front()->instructions().front();
+        EXPECT_EQ(entry.opcode(), (unsigned)SUB);
+    }
+}
+
+TEST(ModuleAllocatorTest, CallsToFastFunctionsOnlyClobberWhatTheyUse)
+{
+    Module module;
+    IntegerType *i32 = module.get_integer_type(32);
+    Function *leaf_ir = module.create_function("leaf", i32, {{"a", i32}});
+    Function *caller_ir = module.create_function("caller", i32, {});
+    ASIMOVRegisterInfo tri;
+    ASIMOVTargetInstInfo tii;
+    MachineModule mm(&module);
+    mm.set_target_info(&tri, &tii);
+    auto emit = [](MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+    {
+        bb->append(std::make_unique<MachineInst>(opcode, ops));
+        return bb->instructions().back().get();
+    };
+    auto reg = [](unsigned r, bool def = false) { return MOperand::create_reg(r, def); };
+
+    // 调用者排在前面，分配时仍然先处理被调用的 leaf
+    MachineFunction *caller = mm.create_machine_function(caller_ir);
+    MachineFunction *leaf = mm.create_machine_function(leaf_ir);
+    leaf->set_call_convention(CallingConv::Fast);
+    {
+        MachineBasicBlock *bb = leaf->create_block("entry");
+        const unsigned a = leaf->create_vreg(GR32, 4, false);
+        emit(bb, MOVW, {reg(a, true), reg(R0)});
+        emit(bb, ADD, {reg(a, true), reg(a), reg(a)});
+        emit(bb, MOVW, {reg(R0, true), reg(a)});
+        emit(bb, RET, {})->set_flag(MIFlag::Terminator);
+        leaf->build_cfg();
+    }
+    MachineInst *call = nullptr;
+    {
+        // keep 跨过调用活跃
+        MachineBasicBlock *bb = caller->create_block("entry");
+        const unsigned keep = caller->create_vreg(GR32, 4, false);
+        const unsigned result = caller->create_vreg(GR32, 4, false);
+        emit(bb, MOVW, {reg(keep, true), MOperand::create_imm(7)});
+        emit(bb, MOVW, {reg(R0, true), MOperand::create_imm(1)});
+        call = emit(bb, CALL, {MOperand::create_external_sym("leaf")});
+        call->set_flag(MIFlag::Call);
+        call->set_implicit_uses({R0});
+        const std::set<unsigned> &caller_saved = tri.get_caller_saved_regs(CallingConv::Fast);
+        call->set_implicit_defs({caller_saved.begin(), caller_saved.end()});
+        emit(bb, MOVW, {reg(result, true), reg(R0)});
+        emit(bb, ADD, {reg(result, true), reg(result), reg(keep)});
+        emit(bb, MOVW, {reg(R0, true), reg(result)});
+        emit(bb, RET, {})->set_flag(MIFlag::Terminator);
+        caller->build_cfg();
+    }
+
+    auto results = allocate_module(mm, 2);
+    ASSERT_TRUE(results[0].regalloc.successful) << results[0].regalloc.error_message;
+    ASSERT_TRUE(results[1].regalloc.successful) << results[1].regalloc.error_message;
+
+    const std::set<unsigned> &used = results[1].clobbered_regs;
+    EXPECT_TRUE(used.count(R0));
+    EXPECT_LT(used.size(), tri.get_caller_saved_regs(CallingConv::Fast).size());
+    ASSERT_NE(mm.clobbered_regs("leaf"), nullptr);
+    EXPECT_EQ(*mm.clobbered_regs("leaf"), used);
+    EXPECT_EQ(std::set<unsigned>(call->implicit_defs().begin(), call->implicit_defs().end()), used);
+    // 调用者自己的集合包含 leaf 的
+    for (unsigned r : used)
+        EXPECT_TRUE(results[0].clobbered_regs.count(r));
+    // keep 留在 leaf 不碰的调用者保存寄存器里，不用溢出
+    EXPECT_EQ(results[0].regalloc.num_spills, 0u);
+    const unsigned keep_reg = caller->basic_blocks().front()->instructions().front()->operands()[0].reg();
+    EXPECT_TRUE(tri.is_caller_saved(CallingConv::Fast, keep_reg));
+    EXPECT_FALSE(used.count(keep_reg));
+}
+
+// 有调用的函数在序言里移动 sp、保存 ra 和用到的被调用者保存寄存器，每个返回前恢复；
+// 叶子函数没有栈帧
+TEST(ModuleAllocatorTest, RISCVFramesSaveReturnAddressAndCalleeSavedRegs)
+{
+    Module module;
+    IntegerType *i64 = module.get_integer_type(64);
+    Function *ext = module.create_function("ext", i64, {{"x", i64}});
+    Function *leaf = module.create_function("leaf", i64, {{"a", i64}});
+    Function *caller = module.create_function("caller", i64, {{"a", i64}});
+    IRBuilder builder(&module);
+    builder.set_insert_point(leaf->create_basic_block("entry"));
+    builder.create_ret(builder.create_add(leaf->arg(0), module.get_constant_int(i64, 1)));
+    // a 和 t 跨过调用活跃
+    builder.set_insert_point(caller->create_basic_block("entry"));
+    Value *t = builder.create_call(ext, {caller->arg(0)}, "t");
+    Value *u = builder.create_call(ext, {t}, "u");
+    builder.create_ret(builder.create_add(builder.create_add(t, u), caller->arg(0)));
+
+    RISCV::RISCVRegisterInfo tri;
+    RISCV::RISCVTargetInstInfo tii;
+    RISCV::RISCVISelInfo target(&tii);
+    RISCV::RISCVFrameLowering frame_lowering(&tii);
+    for (unsigned opt_level : {0u, 2u})
+    {
+        MachineModule mm(&module);
+        mm.set_target_info(&tri, &tii);
+        std::vector<MachineFunction *> mfs;
+        for (Function *func : {leaf, caller})
+        {
+            mfs.push_back(mm.create_machine_function(func));
+            std::string err;
+            ASSERT_TRUE(select_function(target, *func, *mfs.back(), &err)) << err;
+        }
+        auto results = allocate_module(mm, opt_level, &frame_lowering);
+        ASSERT_TRUE(results[0].regalloc.successful) << results[0].regalloc.error_message;
+        ASSERT_TRUE(results[1].regalloc.successful) << results[1].regalloc.error_message;
+        EXPECT_EQ(results[0].frame_layout.stack_size, 0);
+        EXPECT_GT(results[1].frame_layout.stack_size, 0);
+        for (MachineFunction *mf : mfs)
+            resolve_frame_indices(*mf, RISCV::SP);
+
+        EXPECT_NE(mfs[0]->basic_blocks().front()->instructions().front()->opcode(), (unsigned)RISCV::ADDI);
+
+        const MachineFunction &mf = *mfs[1];
+        const auto &entry = mf.basic_blocks().front()->instructions();
+        const MachineInst &adjust = *entry[0];
+        ASSERT_EQ(adjust.opcode(), (unsigned)RISCV::ADDI);
+        EXPECT_EQ(adjust.operands()[0].reg(), (unsigned)RISCV::SP);
+        EXPECT_EQ(adjust.operands()[1].reg(), (unsigned)RISCV::SP);
+        const int64_t size = -adjust.operands()[2].imm();
+        EXPECT_GT(size, 0);
+        EXPECT_EQ(size % 16, 0);
+
+        // 每个保存的寄存器在序言里存一次、在返回前按同一槽位取回
+        const std::vector<SavedRegister> &saved = mf.frame()->saved_registers();
+        ASSERT_FALSE(saved.empty());
+        EXPECT_EQ(saved.front().reg, (unsigned)RISCV::RA);
+        std::set<unsigned> written;
+        for (size_t i = 0; i < saved.size(); ++i)
+        {
+            const MachineInst &store = *entry[1 + i];
+            EXPECT_EQ(store.opcode(), (unsigned)RISCV::SD);
+            EXPECT_EQ(store.operands()[0].reg(), saved[i].reg);
+            EXPECT_EQ(store.operands()[1].mem_ri().base_reg, (unsigned)RISCV::SP);
+            EXPECT_LT(store.operands()[1].mem_ri().offset, size);
+        }
+        unsigned returns = 0;
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            const auto &insts = mbb->instructions();
+            for (size_t i = 0; i < insts.size(); ++i)
+            {
+                for (const MOperand &op : insts[i]->operands())
+                {
+                    if (op.is_reg() && op.is_def() && tri.is_callee_saved(CallingConv::C, op.reg()))
+                        written.insert(op.reg());
+                }
+                if (insts[i]->opcode() != RISCV::RET)
+                    continue;
+                ++returns;
+                ASSERT_GE(i, saved.size() + 1);
+                const MachineInst &release = *insts[i - 1];
+                EXPECT_EQ(release.opcode(), (unsigned)RISCV::ADDI);
+                EXPECT_EQ(release.operands()[0].reg(), (unsigned)RISCV::SP);
+                EXPECT_EQ(release.operands()[2].imm(), size);
+                for (size_t j = 0; j < saved.size(); ++j)
+                {
+                    const MachineInst &load = *insts[i - 1 - saved.size() + j];
+                    EXPECT_EQ(load.opcode(), (unsigned)RISCV::LD);
+                    EXPECT_EQ(load.operands()[0].reg(), saved[j].reg);
+                    EXPECT_EQ(load.operands()[1].mem_ri().offset, entry[1 + j]->operands()[1].mem_ri().offset);
+                }
+            }
+        }
+        EXPECT_EQ(returns, 1u);
+        // 写过的被调用者保存寄存器都保存了，ra 只出现在保存和恢复里
+        for (unsigned reg : written)
+        {
+            EXPECT_TRUE(std::any_of(saved.begin(), saved.end(), [&](const SavedRegister &save)
+                                    { return save.reg == reg; })) << reg;
+        }
+        for (const auto &mbb : mf.basic_blocks())
+        {
+            for (const auto &mi : mbb->instructions())
+            {
+                if (mi->opcode() == RISCV::SD || mi->opcode() == RISCV::LD)
+                    continue;
+                for (const MOperand &op : mi->operands())
+                    EXPECT_FALSE(op.is_reg() && op.reg() == RISCV::RA) << mi->opcode();
+            }
+        }
+    }
+}
+
+// 离 sp 超过 2 KiB 的槽位经 t2 寻址，其余照旧用 sp 加偏移
+TEST(ModuleAllocatorTest, RISCVReachesFarFrameSlotsThroughT2)
+{
+    Module module;
+    IntegerType *i32 = module.get_integer_type(32);
+    Function *func = module.create_function("far", i32, {{"a", i32}});
+    IRBuilder builder(&module);
+    builder.set_insert_point(func->create_basic_block("entry"));
+    AllocaInst *buffer = builder.create_alloca(module.get_array_type(i32, 2048), "buffer");
+    AllocaInst *near = builder.create_alloca(i32, "near");
+    Value *far = builder.create_gep(buffer, {builder.get_int32(0), builder.get_int32(1500)});
+    builder.create_store(func->arg(0), far);
+    builder.create_store(func->arg(0), near);
+    builder.create_ret(builder.create_add(builder.create_load(far), builder.create_load(near)));
+
+    RISCV::RISCVRegisterInfo tri;
+    RISCV::RISCVTargetInstInfo tii;
+    RISCV::RISCVISelInfo target(&tii);
+    RISCV::RISCVFrameLowering frame_lowering(&tii);
+    MachineModule mm(&module);
+    mm.set_target_info(&tri, &tii);
+    MachineFunction *mf = mm.create_machine_function(func);
+    std::string err;
+    ASSERT_TRUE(select_function(target, *func, *mf, &err)) << err;
+    auto results = allocate_module(mm, 0, &frame_lowering);
+    ASSERT_TRUE(results[0].regalloc.successful) << results[0].regalloc.error_message;
+    EXPECT_GT(results[0].frame_layout.stack_size, 2048);
+    resolve_frame_indices(*mf, RISCV::SP);
+    frame_lowering.legalize_frame_offsets(*mf);
+
+    unsigned through_t2 = 0;
+    for (const auto &mbb : mf->basic_blocks())
+    {
+        const auto &insts = mbb->instructions();
+        for (size_t i = 0; i < insts.size(); ++i)
+        {
+            const MachineInst &mi = *insts[i];
+            for (const MOperand &op : mi.operands())
+            {
+                // t2 只用作这里的地址
+                EXPECT_FALSE(op.is_reg() && op.reg() == RISCV::T2 && op.is_def() && mi.opcode() != RISCV::LI &&
+                             mi.opcode() != RISCV::ADD) << mi.opcode();
+                if (!op.is_mem_ri())
+                    continue;
+                if (op.mem_ri().base_reg == RISCV::SP)
+                {
+                    EXPECT_GE(op.mem_ri().offset, -2048);
+                    EXPECT_LE(op.mem_ri().offset, 2047);
+                }
+                else if (op.mem_ri().base_reg == RISCV::T2)
+                {
+                    ASSERT_GE(i, 2u);
+                    EXPECT_EQ(insts[i - 2]->opcode(), (unsigned)RISCV::LI);
+                    EXPECT_GT(insts[i - 2]->operands()[1].imm(), 2047);
+                    EXPECT_EQ(insts[i - 1]->opcode(), (unsigned)RISCV::ADD);
+                    EXPECT_EQ(insts[i - 1]->operands()[1].reg(), (unsigned)RISCV::SP);
+                    ++through_t2;
+                }
+            }
+        }
+    }
+    EXPECT_GT(through_t2, 0u);
+}
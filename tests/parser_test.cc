@@ -86,6 +86,13 @@ TEST(ParserTest, RelationalExpression)
     EXPECT_EQ(parse_and_normalize(input, true), expected);
 }
 
+TEST(ParserTest, GreaterEqualExpression)
+{
+    std::string input = "x >= y || y <= z";
+    std::string expected = "((x >= y) || (y <= z))";
+    EXPECT_EQ(parse_and_normalize(input, true), expected);
+}
+
 TEST(ParserTest, FunctionCallExpression)
 {
     std::string input = "foo(1, 2, 3)";
@@ -210,6 +217,12 @@ TEST(ParserTest, BasicVarDecl)
     EXPECT_EQ(parse_and_normalize(input), input);
 }
 
+TEST(ParserTest, UnsignedVarDecl)
+{
+    std::string input = "let x: u8 = 10;";
+    EXPECT_EQ(parse_and_normalize(input), input);
+}
+
 TEST(ParserTest, PointerVarDecl)
 {
     std::string input = "let ptr: *MyStruct = (malloc(sizeof(MyStruct)));";
@@ -314,3 +327,79 @@ TEST(ParserTest, MixedInitializerList)
     std::string input = "let data: Point[2] = [Point { x: 1.1, y: 2.2 }, Point { x: 3.3, y: 4.4 }];";
     EXPECT_EQ(parse_and_normalize(input), input);
 }
+
+TEST(ParserTest, ProgramNodesLiveInArena)
+{
+    ast::Program program;
+    {
+        Parser parser(Lexer("fn add(a: i32, b: i32) -> i32 { return a + b; } let x: i32 = add(1, 2);"));
+        program = parser.parse();
+    }
+
+    ASSERT_NE(program.arena, nullptr);
+    EXPECT_GT(program.arena->num_allocations(), 0u);
+    EXPECT_GE(program.arena->bytes_allocated(), program.arena->num_allocations());
+
+    // The program must stay usable after the parser that built it is gone
+    ASTPrinter printer;
+    EXPECT_EQ(normalize_whitespace(printer.print(program)),
+              "fn add(a: i32, b: i32) -> i32 { return (a + b); } let x: i32 = (add(1, 2));");
+}
+
+TEST(ParserTest, MoveAssignIntoPopulatedProgram)
+{
+    // The old nodes live in the old arena and must go before it does
+    ast::Program program = Parser(Lexer("struct P { x: i32 } fn f(p: P) -> i32 { return p.x * 2; }")).parse();
+    ASSERT_FALSE(program.functions.empty());
+    program = Parser(Lexer("fn g() -> i32 { return 1; }")).parse();
+
+    ASSERT_EQ(program.functions.size(), 1u);
+    EXPECT_TRUE(program.structs.empty());
+    ASTPrinter printer;
+    EXPECT_EQ(normalize_whitespace(printer.print(program)), "fn g() -> i32 { return 1; }");
+}
+
+TEST(ParserTest, IdentifiersCarryLexerSymbols)
+{
+    // Scopes key on these ids, so a declaration and its uses must share one
+    ast::Program program = Parser(Lexer("fn f(a: i32) -> i32 { let b: i32 = a; return b; }")).parse();
+    ASSERT_NE(program.symbols, nullptr);
+    ASSERT_EQ(program.functions.size(), 1u);
+    const auto &body = program.functions[0]->body;
+    ASSERT_EQ(body.size(), 2u);
+
+    const auto *decl = dynamic_cast<const ast::VarDeclStmt *>(body[0].get());
+    ASSERT_NE(decl, nullptr);
+    EXPECT_NE(decl->symbol, NO_SYMBOL);
+    EXPECT_EQ(decl->symbol, program.symbols->lookup("b"));
+    const auto *init = dynamic_cast<const ast::VariableExpr *>(decl->init_expr.get());
+    ASSERT_NE(init, nullptr);
+    EXPECT_EQ(init->symbol, program.symbols->lookup("a"));
+
+    const auto *ret = dynamic_cast<const ast::ReturnStmt *>(body[1].get());
+    ASSERT_NE(ret, nullptr);
+    const auto *use = dynamic_cast<const ast::VariableExpr *>(ret->value.get());
+    ASSERT_NE(use, nullptr);
+    EXPECT_EQ(use->symbol, decl->symbol);
+}
+
+TEST(ParserTest, HeapNodesOutsideArena)
+{
+    // Nodes created without an active arena come from the heap and can be freed individually
+    Parser parser(Lexer("a + b * c"));
+    auto expr = parser.parse_expr();
+    ASSERT_NE(expr, nullptr);
+    EXPECT_EQ(ast::ArenaScope::current(), nullptr);
+
+    ast::Arena arena;
+    ast::TypePtr arena_type;
+    {
+        ast::ArenaScope scope(&arena);
+        arena_type = ast::Type::create_int(32);
+    }
+    EXPECT_EQ(arena.num_allocations(), 1u);
+    ast::TypePtr heap_copy = arena_type->clone();
+    arena_type.reset();
+    EXPECT_EQ(heap_copy->to_string(), "i32");
+    EXPECT_EQ(arena.num_allocations(), 1u);
+}
@@ -0,0 +1,190 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+
+#include "src/ir_builder.h"
+#include "src/phase_stats.h"
+#include "src/transforms/mem2reg.h"
+#include "src/transforms/pass_manager.h"
+
+namespace
+{
+    // entry -> loop <-> loop -> exit, counting `i` down from n through a stack slot
+    Function *build_countdown(Module &m, const std::string &name)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        Function *f = m.create_function(name, i32, {{"n", i32}});
+        BasicBlock *entry = f->create_basic_block("entry");
+        BasicBlock *loop = f->create_basic_block("loop");
+        BasicBlock *exit = f->create_basic_block("exit");
+
+        IRBuilder builder(&m);
+        builder.set_insert_point(entry);
+        AllocaInst *i = builder.create_alloca(i32, "i");
+        builder.create_store(f->arg(0), i);
+        builder.create_br(loop);
+        builder.set_insert_point(loop);
+        Value *next = builder.create_sub(builder.create_load(i), m.get_constant_int(i32, 1));
+        builder.create_store(next, i);
+        builder.create_cond_br(builder.create_icmp(ICmpInst::SGT, next, m.get_constant_int(i32, 0)), loop, exit);
+        builder.set_insert_point(exit);
+        builder.create_ret(builder.create_load(i));
+        return f;
+    }
+
+    // Asks for every analysis and reports what it was told to
+    class QueryPass : public FunctionPass
+    {
+    public:
+        explicit QueryPass(PreservedAnalyses result) : result_(result) {}
+        const char *name() const override { return "query"; }
+        PreservedAnalyses run(Function &func, AnalysisManager &analyses) override
+        {
+            analyses.dominance_frontier(func);
+            analyses.loop_info(func);
+            analyses.liveness(func);
+            return result_;
+        }
+
+    private:
+        PreservedAnalyses result_;
+    };
+}
+
+TEST(LoopInfo, FindsNestedLoops)
+{
+    // entry -> outer -> inner <-> inner -> outer_latch -> outer | exit
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *outer = f->create_basic_block("outer");
+    BasicBlock *inner = f->create_basic_block("inner");
+    BasicBlock *outer_latch = f->create_basic_block("outer_latch");
+    BasicBlock *exit = f->create_basic_block("exit");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_br(outer);
+    builder.set_insert_point(outer);
+    builder.create_br(inner);
+    builder.set_insert_point(inner);
+    builder.create_cond_br(f->arg(0), inner, outer_latch);
+    builder.set_insert_point(outer_latch);
+    builder.create_cond_br(f->arg(0), outer, exit);
+    builder.set_insert_point(exit);
+    builder.create_ret(m.get_constant_int(i32, 0));
+
+    DominatorTree dom_tree(*f);
+    LoopInfo loops(dom_tree);
+    ASSERT_EQ(loops.num_loops(), 2u);
+    ASSERT_EQ(loops.top_level().size(), 1u);
+    Loop *outer_loop = loops.top_level()[0];
+    EXPECT_EQ(outer_loop->header(), outer);
+    EXPECT_EQ(outer_loop->blocks().size(), 3u);
+    ASSERT_EQ(outer_loop->children().size(), 1u);
+    Loop *inner_loop = outer_loop->children()[0];
+    EXPECT_EQ(inner_loop->header(), inner);
+    EXPECT_EQ(inner_loop->latches(), std::vector<BasicBlock *>{inner});
+    EXPECT_EQ(inner_loop->depth(), 2u);
+    EXPECT_EQ(loops.loop_for(inner), inner_loop);
+    EXPECT_EQ(loops.loop_for(outer_latch), outer_loop);
+    EXPECT_EQ(loops.loop_depth(exit), 0u);
+    EXPECT_TRUE(loops.is_loop_header(outer));
+    EXPECT_FALSE(inner_loop->contains(outer_latch));
+}
+
+TEST(Liveness, LoopCarriedValues)
+{
+    Module m;
+    Function *f = build_countdown(m, "f");
+    promote_allocas(*f);
+    BasicBlock *entry = f->basic_blocks()[0];
+    BasicBlock *loop = f->basic_blocks()[1];
+    BasicBlock *exit = f->basic_blocks()[2];
+    auto *phi = dynamic_cast<PhiInst *>(loop->first_instruction());
+    ASSERT_NE(phi, nullptr);
+    Value *next = phi->get_incoming_value(0) == f->arg(0) ? phi->get_incoming_value(1) : phi->get_incoming_value(0);
+
+    DominatorTree dom_tree(*f);
+    Liveness liveness(*f, dom_tree);
+    // The argument only feeds the phi, so it is live out of the entry and dead after
+    EXPECT_TRUE(liveness.is_live_out(f->arg(0), entry));
+    EXPECT_FALSE(liveness.is_live_in(f->arg(0), loop));
+    EXPECT_FALSE(liveness.is_live_in(phi, loop));
+    EXPECT_TRUE(liveness.is_live_out(next, loop));
+    EXPECT_TRUE(liveness.is_live_in(next, exit));
+    EXPECT_EQ(liveness.live_in(exit), std::vector<Value *>{next});
+}
+
+TEST(PassManager, CachesAnalysesUntilInvalidated)
+{
+    Module m;
+    Function *f = build_countdown(m, "f");
+    AnalysisManager analyses;
+
+    const DominatorTree *first = &analyses.dominator_tree(*f);
+    EXPECT_EQ(&analyses.dominator_tree(*f), first);
+    analyses.loop_info(*f);
+    analyses.liveness(*f);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::DominatorTree), 1u);
+
+    // Rewriting instructions keeps the CFG analyses but not liveness
+    analyses.invalidate(*f, PreservedAnalyses::cfg());
+    analyses.loop_info(*f);
+    analyses.liveness(*f);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::DominatorTree), 1u);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::LoopInfo), 1u);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::Liveness), 2u);
+
+    // Dropping the dominator tree drops what was built on it
+    analyses.invalidate(*f, PreservedAnalyses::all().intersect(PreservedAnalyses::none().preserve(AnalysisKind::LoopInfo)));
+    analyses.loop_info(*f);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::DominatorTree), 2u);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::LoopInfo), 2u);
+}
+
+TEST(PassManager, RunsPipelineUnderPhaseTimers)
+{
+    PhaseStats::global().reset();
+    PhaseStats::global().set_enabled(true);
+
+    Module m;
+    Function *f = build_countdown(m, "f");
+    Function *g = build_countdown(m, "g");
+    m.create_function("declared", m.get_integer_type(32), {});
+
+    PassManager pm;
+    pm.add(std::make_unique<QueryPass>(PreservedAnalyses::all()));
+    pm.add(std::make_unique<Mem2RegPass>());
+    pm.add(std::make_unique<QueryPass>(PreservedAnalyses::all()));
+    EXPECT_TRUE(pm.run(m));
+
+    // mem2reg keeps the CFG, so each function builds its tree once; liveness
+    // has to be recomputed after the rewrite
+    const AnalysisManager &analyses = pm.analyses();
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::DominatorTree), 2u);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::LoopInfo), 2u);
+    EXPECT_EQ(analyses.num_computed(AnalysisKind::Liveness), 4u);
+    for (Function *func : {f, g})
+    {
+        EXPECT_NE(dynamic_cast<PhiInst *>(func->basic_blocks()[1]->first_instruction()), nullptr);
+    }
+
+    auto phases = PhaseStats::global().phases();
+    auto find = [&](const std::string &name)
+    {
+        auto it = std::find_if(phases.begin(), phases.end(), [&](const auto &p)
+                               { return p.name == name; });
+        return it == phases.end() ? nullptr : &*it;
+    };
+    ASSERT_NE(find("mem2reg"), nullptr);
+    EXPECT_EQ(find("mem2reg")->runs, 1u);
+    ASSERT_EQ(find("mem2reg")->counters.size(), 1u);
+    EXPECT_EQ(find("mem2reg")->counters[0].second, 2u);
+    ASSERT_NE(find("domtree"), nullptr);
+    EXPECT_EQ(find("domtree")->runs, 2u);
+    EXPECT_EQ(find("query")->runs, 2u);
+
+    PhaseStats::global().set_enabled(false);
+    PhaseStats::global().reset();
+}
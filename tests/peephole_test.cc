@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+
+#include "src/ir.h"
+#include "src/machine.h"
+#include "src/targets/asimov_peephole.h"
+#include "src/targets/riscv_peephole.h"
+
+namespace
+{
+    MOperand reg(unsigned r, bool def = false) { return MOperand::create_reg(r, def); }
+    MOperand imm(int64_t value) { return MOperand::create_imm(value); }
+    MOperand mem(unsigned base, int offset) { return MOperand::create_mem_ri(base, offset); }
+    MOperand block(MachineBasicBlock *bb) { return MOperand::create_basic_block(bb); }
+
+    MachineInst *emit(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+    {
+        bb->append(std::make_unique<MachineInst>(opcode, ops));
+        return bb->instructions().back().get();
+    }
+
+    std::vector<unsigned> opcodes(const MachineBasicBlock *mbb)
+    {
+        std::vector<unsigned> result;
+        for (const auto &mi : mbb->instructions())
+            result.push_back(mi->opcode());
+        return result;
+    }
+
+    class PeepholeTest : public ::testing::Test
+    {
+    protected:
+        Module module_;
+        MachineModule mm_{&module_};
+
+        MachineFunction *function(const std::string &name)
+        {
+            return mm_.create_machine_function(module_.create_function(name, module_.get_void_type(), {}));
+        }
+    };
+}
+
+TEST_F(PeepholeTest, ASIMOVRemovesIdentityCopies)
+{
+    using namespace ASIMOV;
+    ASIMOVTargetInstInfo tii;
+    ASIMOVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    emit(bb, MOVW, {reg(R1, true), reg(R1)});
+    emit(bb, MOVW, {reg(R2, true), reg(R1)});
+    emit(bb, MOVW, {reg(R2, true), reg(R2)});
+    emit(bb, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.identity_copies, 2u);
+    EXPECT_EQ(opcodes(bb), (std::vector<unsigned>{MOVW, RET}));
+    EXPECT_EQ(bb->instructions()[0]->operands()[0].reg(), R2);
+}
+
+TEST_F(PeepholeTest, ASIMOVForwardsSpillReloads)
+{
+    using namespace ASIMOV;
+    ASIMOVTargetInstInfo tii;
+    ASIMOVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    // Reloaded into the same register: the load goes
+    emit(bb, STORE, {reg(R1), mem(R7, 4)});
+    emit(bb, LOAD, {reg(R1, true), mem(R7, 4)});
+    // Into another: a copy, even past a store to a different slot
+    emit(bb, STORE, {reg(R2), mem(R7, 8)});
+    emit(bb, STORE, {reg(R4), mem(R7, 12)});
+    emit(bb, LOAD, {reg(R3, true), mem(R7, 8)});
+    // A store through another base may write any slot
+    emit(bb, STORE, {reg(R4), mem(R5, 0)});
+    emit(bb, LOAD, {reg(R0, true), mem(R7, 4)});
+    // The stored register changed in between
+    emit(bb, STORE, {reg(R2), mem(R7, 16)});
+    emit(bb, ADD, {reg(R2, true), reg(R2), reg(R2)});
+    emit(bb, LOAD, {reg(R3, true), mem(R7, 16)});
+    // Calls may write memory
+    emit(bb, STORE, {reg(R6), mem(R7, 20)});
+    emit(bb, CALL, {MOperand::create_label("g")});
+    emit(bb, LOAD, {reg(R6, true), mem(R7, 20)});
+    emit(bb, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.forwarded_reloads, 2u);
+    EXPECT_EQ(opcodes(bb), (std::vector<unsigned>{STORE, STORE, STORE, MOVW, STORE, LOAD, STORE, ADD, LOAD, STORE,
+                                                  CALL, LOAD, RET}));
+    const MachineInst &copy = *bb->instructions()[3];
+    EXPECT_EQ(copy.operands()[0].reg(), R3);
+    EXPECT_EQ(copy.operands()[1].reg(), R2);
+}
+
+TEST_F(PeepholeTest, ASIMOVFoldsCompareAgainstZero)
+{
+    using namespace ASIMOV;
+    ASIMOVTargetInstInfo tii;
+    ASIMOVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *then = mf->create_block("then");
+    MachineBasicBlock *other = mf->create_block("other");
+    emit(entry, LI, {reg(R2, true), imm(0)});
+    emit(entry, CMP, {reg(R3, true), reg(R2), reg(R1)})->set_flag(MIFlag::IsCompare);
+    MachineInst *jz = emit(entry, JZ, {reg(R3), block(then)});
+    jz->set_flag(MIFlag::Branch);
+    jz->set_flag(MIFlag::Terminator);
+    emit(entry, JMP, {block(other)});
+    entry->add_successor(then);
+    entry->add_successor(other);
+    // R3 is overwritten on one path and dead at the return on the other
+    emit(then, MOVW, {reg(R3, true), imm(1)});
+    emit(then, MOVW, {reg(R0, true), reg(R3)});
+    emit(then, RET, {});
+    emit(other, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.compare_branches, 1u);
+    EXPECT_EQ(stats.dead_constants, 1u);
+    ASSERT_EQ(opcodes(entry), (std::vector<unsigned>{JZ, JMP}));
+    const MachineInst &branch = *entry->instructions()[0];
+    EXPECT_EQ(branch.operands()[0].reg(), R1);
+    EXPECT_EQ(branch.operands()[1].basic_block(), then);
+    EXPECT_TRUE(branch.has_flag(MIFlag::Terminator));
+}
+
+TEST_F(PeepholeTest, ASIMOVKeepsComparesStillLive)
+{
+    using namespace ASIMOV;
+    ASIMOVTargetInstInfo tii;
+    ASIMOVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    emit(entry, LI, {reg(R2, true), imm(0)});
+    emit(entry, CMP, {reg(R0, true), reg(R1), reg(R2)});
+    emit(entry, JNZ, {reg(R0), block(exit)});
+    // Against a register not known to be zero
+    emit(entry, CMP, {reg(R3, true), reg(R1), reg(R4)});
+    emit(entry, JNZ, {reg(R3), block(exit)});
+    entry->add_successor(exit);
+    // R0 is the return value
+    emit(exit, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.total(), 0u);
+    EXPECT_EQ(opcodes(entry), (std::vector<unsigned>{LI, CMP, JNZ, CMP, JNZ}));
+}
+
+TEST_F(PeepholeTest, RISCVFusesCompareAndBranch)
+{
+    using namespace RISCV;
+    RISCVTargetInstInfo tii;
+    RISCVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *entry = mf->create_block("entry");
+    MachineBasicBlock *next = mf->create_block("next");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    emit(entry, SLT, {reg(T0, true), reg(A0), reg(A1)});
+    emit(entry, BEQ, {reg(T0), reg(ZERO), block(exit)});
+    entry->add_successor(next);
+    entry->add_successor(exit);
+    emit(next, SUB, {reg(T1, true), reg(A2), reg(A3)});
+    emit(next, BNE, {reg(ZERO), reg(T1), block(exit)});
+    next->add_successor(exit);
+    emit(exit, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.compare_branches, 2u);
+    ASSERT_EQ(opcodes(entry), (std::vector<unsigned>{BGE}));
+    EXPECT_EQ(entry->instructions()[0]->operands()[0].reg(), A0);
+    EXPECT_EQ(entry->instructions()[0]->operands()[1].reg(), A1);
+    ASSERT_EQ(opcodes(next), (std::vector<unsigned>{BNE}));
+    EXPECT_EQ(next->instructions()[0]->operands()[0].reg(), A2);
+    EXPECT_EQ(next->instructions()[0]->operands()[1].reg(), A3);
+    EXPECT_EQ(next->instructions()[0]->operands()[2].basic_block(), exit);
+}
+
+TEST_F(PeepholeTest, RISCVFoldsConstantsIntoImmediateForms)
+{
+    using namespace RISCV;
+    RISCVTargetInstInfo tii;
+    RISCVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    emit(bb, LI, {reg(T0, true), imm(5)});
+    emit(bb, ADD, {reg(A1, true), reg(T0), reg(A1)});
+    emit(bb, LI, {reg(T1, true), imm(7)});
+    emit(bb, SUB, {reg(A2, true), reg(A2), reg(T1)});
+    // Too wide for 12 bits
+    emit(bb, LI, {reg(T2, true), imm(3000)});
+    emit(bb, AND, {reg(A3, true), reg(A3), reg(T2)});
+    // Still returned, so the constant stays
+    emit(bb, LI, {reg(A0, true), imm(1)});
+    emit(bb, OR, {reg(A4, true), reg(A4), reg(A0)});
+    emit(bb, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.folded_immediates, 3u);
+    EXPECT_EQ(stats.dead_constants, 2u);
+    ASSERT_EQ(opcodes(bb), (std::vector<unsigned>{ADDI, ADDI, LI, AND, LI, ORI, RET}));
+    EXPECT_EQ(bb->instructions()[0]->operands()[1].reg(), A1);
+    EXPECT_EQ(bb->instructions()[0]->operands()[2].imm(), 5);
+    EXPECT_EQ(bb->instructions()[1]->operands()[2].imm(), -7);
+    EXPECT_EQ(bb->instructions()[5]->operands()[2].imm(), 1);
+}
+
+TEST_F(PeepholeTest, RISCVForwardsOnlyFullWidthReloads)
+{
+    using namespace RISCV;
+    RISCVTargetInstInfo tii;
+    RISCVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    emit(bb, SD, {reg(S1), mem(SP, 8)});
+    emit(bb, LD, {reg(S2, true), mem(SP, 8)});
+    // LW sign-extends on RV64
+    emit(bb, SW, {reg(S3), mem(SP, 16)});
+    emit(bb, LW, {reg(S4, true), mem(SP, 16)});
+    // No plain copy between FP registers
+    emit(bb, FSD, {reg(F8), mem(SP, 24)});
+    emit(bb, FLD, {reg(F9, true), mem(SP, 24)});
+    emit(bb, FLD, {reg(F8, true), mem(SP, 24)});
+    emit(bb, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.forwarded_reloads, 2u);
+    EXPECT_EQ(opcodes(bb), (std::vector<unsigned>{SD, ADD, SW, LW, FSD, FLD, RET}));
+}
+
+TEST_F(PeepholeTest, RISCVSetsVectorTypeOncePerRun)
+{
+    using namespace RISCV;
+    RISCVTargetInstInfo tii(ABIVersion::LP64D, true);
+    RISCVPeepholeInfo target(&tii);
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    const auto setup = [bb](int64_t vtype)
+    { emit(bb, VSETIVLI, {reg(ZERO, true), imm(4), imm(vtype)})->set_implicit_defs({VTYPE}); };
+    const auto vector_op = [bb](unsigned opcode)
+    { emit(bb, opcode, {reg(V8, true), reg(V8), reg(V9)})->set_implicit_uses({VTYPE}); };
+    setup(0xD0);
+    vector_op(VADD_VV);
+    setup(0xD0);
+    vector_op(VMUL_VV);
+    // Another element type needs its own, and the first one again after it
+    setup(0xD8);
+    vector_op(VADD_VV);
+    setup(0xD0);
+    vector_op(VADD_VV);
+    // A call may change vl and vtype
+    emit(bb, CALL, {MOperand::create_external_sym("g")});
+    setup(0xD0);
+    vector_op(VADD_VV);
+    emit(bb, RET, {});
+
+    PeepholeStats stats = run_peephole(target, *mf);
+    EXPECT_EQ(stats.redundant_setups, 1u);
+    EXPECT_EQ(opcodes(bb), (std::vector<unsigned>{VSETIVLI, VADD_VV, VMUL_VV, VSETIVLI, VADD_VV, VSETIVLI, VADD_VV,
+                                                  CALL, VSETIVLI, VADD_VV, RET}));
+}
@@ -0,0 +1,118 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <sstream>
+
+#include "src/parser.h"
+#include "src/phase_stats.h"
+
+class PhaseStatsTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        PhaseStats::global().reset();
+        PhaseStats::global().set_enabled(true);
+    }
+
+    void TearDown() override
+    {
+        PhaseStats::global().set_enabled(false);
+        PhaseStats::global().reset();
+    }
+
+    static const PhaseStats::Phase *find_phase(const std::vector<PhaseStats::Phase> &phases, const std::string &name)
+    {
+        auto it = std::find_if(phases.begin(), phases.end(), [&](const auto &p)
+                               { return p.name == name; });
+        return it == phases.end() ? nullptr : &*it;
+    }
+
+    static uint64_t counter(const PhaseStats::Phase &phase, const std::string &name)
+    {
+        for (const auto &[key, value] : phase.counters)
+        {
+            if (key == name)
+                return value;
+        }
+        return 0;
+    }
+};
+
+TEST_F(PhaseStatsTest, DisabledRecordsNothing)
+{
+    PhaseStats::global().set_enabled(false);
+    {
+        PhaseTimer timer("lex");
+        timer.count("tokens", 3);
+    }
+    PhaseStats::global().add_count("lex", "tokens", 1);
+    EXPECT_TRUE(PhaseStats::global().phases().empty());
+}
+
+TEST_F(PhaseStatsTest, RunsAndCountersAccumulate)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        PhaseTimer timer("regalloc");
+        timer.count("spills", 2);
+    }
+    PhaseStats::global().add_count("liveness", "live_ranges", 5);
+
+    auto phases = PhaseStats::global().phases();
+    ASSERT_EQ(phases.size(), 2);
+    EXPECT_EQ(phases[0].name, "regalloc");
+    EXPECT_EQ(phases[0].runs, 3);
+    EXPECT_EQ(counter(phases[0], "spills"), 6);
+    EXPECT_GE(phases[0].wall_seconds, 0.0);
+    EXPECT_EQ(phases[1].name, "liveness");
+    EXPECT_EQ(phases[1].runs, 0);
+    EXPECT_EQ(counter(phases[1], "live_ranges"), 5);
+}
+
+TEST_F(PhaseStatsTest, AllocationsAreAttributed)
+{
+    {
+        PhaseTimer timer("irgen");
+        auto block = std::make_unique<char[]>(1000);
+        block[0] = 1;
+    }
+    auto phases = PhaseStats::global().phases();
+    ASSERT_EQ(phases.size(), 1);
+    EXPECT_GE(phases[0].allocations, 1);
+    EXPECT_GE(phases[0].allocated_bytes, 1000);
+}
+
+TEST_F(PhaseStatsTest, ParserReportsLexAndParse)
+{
+    Parser parser(Lexer("fn add(a: i32, b: i32) -> i32 { return a + b; }"));
+    parser.parse();
+
+    auto phases = PhaseStats::global().phases();
+    const auto *lex = find_phase(phases, "lex");
+    const auto *parse = find_phase(phases, "parse");
+    ASSERT_TRUE(lex);
+    ASSERT_TRUE(parse);
+    EXPECT_EQ(lex->runs, 1);
+    EXPECT_GT(counter(*lex, "tokens"), 10);
+    EXPECT_GT(counter(*parse, "ast_nodes"), 0);
+    EXPECT_GT(parse->allocations, 0);
+}
+
+TEST_F(PhaseStatsTest, TableAndJsonOutput)
+{
+    {
+        PhaseTimer timer("typecheck");
+        timer.count("functions", 4);
+    }
+
+    std::ostringstream table;
+    PhaseStats::global().print_table(table);
+    EXPECT_NE(table.str().find("typecheck"), std::string::npos);
+    EXPECT_NE(table.str().find("functions=4"), std::string::npos);
+
+    std::ostringstream json;
+    PhaseStats::global().export_to_json(json);
+    EXPECT_NE(json.str().find("\"name\": \"typecheck\""), std::string::npos);
+    EXPECT_NE(json.str().find("\"counters\": {\"functions\": 4}"), std::string::npos);
+}
@@ -0,0 +1,175 @@
+#include <sstream>
+
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/profile.h"
+#include "tests/ir_test_util.h"
+
+namespace
+{
+    using ir_test::count_opcode;
+
+    // `c ? a : a + b` with the true edge going straight to the join:
+    // entry -> join, entry -> else -> join
+    Function *make_select(Module &m)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        Function *f = m.create_function("select", i32, {{"a", i32}, {"b", i32}, {"c", m.get_boolean_type()}});
+        BasicBlock *entry = f->create_basic_block("entry");
+        BasicBlock *else_bb = f->create_basic_block("else");
+        BasicBlock *join = f->create_basic_block("join");
+        IRBuilder builder(&m);
+        builder.set_insert_point(entry);
+        builder.create_alloca(i32, "local");
+        builder.create_cond_br(f->arg(2), join, else_bb);
+        builder.set_insert_point(else_bb);
+        Value *sum = builder.create_add(f->arg(0), f->arg(1));
+        builder.create_br(join);
+        builder.set_insert_point(join);
+        PhiInst *phi = builder.create_phi(i32, "r");
+        phi->add_incoming(f->arg(0), entry);
+        phi->add_incoming(sum, else_bb);
+        builder.create_ret(phi);
+        return f;
+    }
+}
+
+TEST(Profile, InstrumentsBlocksAndTrueEdges)
+{
+    Module m;
+    Function *f = make_select(m);
+    m.create_function("external", m.get_void_type(), {});
+    const uint64_t checksum = cfg_checksum(*f);
+
+    const CounterLayout layout = instrument_module(m, 32);
+    ASSERT_EQ(layout.functions.size(), 1u);
+    EXPECT_EQ(layout.functions[0].name, "select");
+    EXPECT_EQ(layout.functions[0].checksum, checksum);
+    EXPECT_EQ(layout.functions[0].blocks, 3u);
+    EXPECT_EQ(layout.functions[0].branches, 1u);
+    EXPECT_EQ(layout.size, 4u);
+    ASSERT_NE(m.get_global_variable(PROFILE_COUNTERS), nullptr);
+
+    // One counter per block, and one on the new block of the true edge
+    ASSERT_EQ(f->basic_blocks().size(), 4u);
+    BasicBlock *entry = f->entry_block();
+    BasicBlock *taken = f->basic_blocks()[3];
+    BasicBlock *join = f->basic_blocks()[2];
+    EXPECT_EQ(taken->name(), "entry.taken");
+    EXPECT_EQ(count_opcode(f, Opcode::Store), 4u);
+    auto *branch = static_cast<BranchInst *>(entry->get_terminator());
+    EXPECT_EQ(branch->get_true_successor(), taken);
+    EXPECT_EQ(taken->successors(), std::vector<BasicBlock *>{join});
+    auto *phi = static_cast<PhiInst *>(join->first_instruction());
+    EXPECT_EQ(phi->get_incoming_block(0), taken);
+    // The counter goes after the allocas and the phis
+    EXPECT_EQ(entry->first_instruction()->opcode(), Opcode::Alloca);
+    EXPECT_EQ(phi->next()->opcode(), Opcode::GetElementPtr);
+}
+
+TEST(Profile, CountersApplyToTheSameCode)
+{
+    CounterLayout layout;
+    {
+        Module instrumented;
+        make_select(instrumented);
+        layout = instrument_module(instrumented);
+    }
+    // Ran 10 times, taking the true edge 6 times
+    const Profile profile = profile_from_counters(layout, {10, 4, 10, 6});
+    ASSERT_EQ(profile.functions.count("select"), 1u);
+    EXPECT_EQ(profile.functions.at("select").block_counts, (std::vector<uint64_t>{10, 4, 10}));
+    EXPECT_EQ(profile.functions.at("select").taken_counts, std::vector<uint64_t>{6});
+
+    Module m;
+    Function *f = make_select(m);
+    const ProfileStats stats = apply_profile(m, profile);
+    EXPECT_EQ(stats.applied, 1u);
+    EXPECT_EQ(f->entry_block()->profile_count(), 10u);
+    EXPECT_EQ(f->basic_blocks()[1]->profile_count(), 4u);
+    auto *branch = static_cast<BranchInst *>(f->entry_block()->get_terminator());
+    ASSERT_TRUE(branch->has_branch_weights());
+    EXPECT_EQ(branch->true_weight(), 6u);
+    EXPECT_EQ(branch->false_weight(), 4u);
+    EXPECT_EQ(branch->edge_weight(f->basic_blocks()[2]), 6u);
+
+    // Counters cut short leave the function out
+    EXPECT_TRUE(profile_from_counters(layout, {10, 4}).functions.empty());
+}
+
+TEST(Profile, DropsStaleAndMissingFunctions)
+{
+    Module profiled;
+    make_select(profiled);
+    const Profile profile = profile_from_counters(counter_layout(profiled), {1, 1, 1, 0});
+
+    Module m;
+    Function *f = make_select(m);
+    // One more block than was profiled
+    BasicBlock *join = f->basic_blocks()[2];
+    BasicBlock *extra = f->create_basic_block("extra");
+    static_cast<BranchInst *>(f->basic_blocks()[1]->get_terminator())->replace_successor(join, extra);
+    static_cast<PhiInst *>(join->first_instruction())->replace_incoming_block(f->basic_blocks()[1], extra);
+    extra->append(BranchInst::create(join, extra));
+    Function *other = m.create_function("other", m.get_void_type(), {});
+    IRBuilder builder(&m);
+    builder.set_insert_point(other->create_basic_block("entry"));
+    builder.create_ret_void();
+
+    const ProfileStats stats = apply_profile(m, profile);
+    EXPECT_EQ(stats.applied, 0u);
+    EXPECT_EQ(stats.stale, 1u);
+    EXPECT_EQ(stats.missing, 1u);
+    EXPECT_FALSE(f->entry_block()->has_profile_count());
+}
+
+TEST(Profile, WritesReadsAndMerges)
+{
+    Profile profile;
+    profile.functions["f"] = {42, {3, 1, 3}, {2}};
+    profile.functions["g"] = {7, {5}, {}};
+
+    std::stringstream text;
+    profile.write(text);
+    Profile read;
+    std::string err;
+    ASSERT_TRUE(Profile::read(text, read, &err)) << err;
+    ASSERT_EQ(read.functions.size(), 2u);
+    EXPECT_EQ(read.functions.at("f").checksum, 42u);
+    EXPECT_EQ(read.functions.at("f").block_counts, (std::vector<uint64_t>{3, 1, 3}));
+    EXPECT_EQ(read.functions.at("f").taken_counts, std::vector<uint64_t>{2});
+    EXPECT_TRUE(read.functions.at("g").taken_counts.empty());
+
+    const std::string path = ::testing::TempDir() + "profile_test.prof";
+    ASSERT_TRUE(profile.write_file(path, &err)) << err;
+    ASSERT_TRUE(Profile::read_file(path, read, &err)) << err;
+    EXPECT_EQ(read.functions.at("g").block_counts, std::vector<uint64_t>{5});
+
+    // Another run of the same code adds up; a different `g` is ignored
+    Profile run;
+    run.functions["f"] = {42, {1, 0, 1}, {1}};
+    run.functions["g"] = {8, {9}, {}};
+    run.functions["h"] = {1, {2}, {}};
+    read.merge(run);
+    EXPECT_EQ(read.functions.at("f").block_counts, (std::vector<uint64_t>{4, 1, 4}));
+    EXPECT_EQ(read.functions.at("f").taken_counts, std::vector<uint64_t>{3});
+    EXPECT_EQ(read.functions.at("g").block_counts, std::vector<uint64_t>{5});
+    EXPECT_EQ(read.functions.at("h").block_counts, std::vector<uint64_t>{2});
+
+    std::istringstream bad("# mo profile v1\nblocks 1\n");
+    EXPECT_FALSE(Profile::read(bad, read, &err));
+    EXPECT_NE(err.find("line 2"), std::string::npos) << err;
+    std::istringstream garbage("function f 1\n");
+    EXPECT_FALSE(Profile::read(garbage, read, &err));
+}
+
+TEST(Profile, ReadsRawCounterDumps)
+{
+    const std::vector<uint8_t> bytes{1, 0, 0, 0, 0x10, 0x02, 0, 0};
+    std::vector<uint64_t> counters;
+    ASSERT_TRUE(counters_from_bytes(bytes, 32, counters));
+    EXPECT_EQ(counters, (std::vector<uint64_t>{1, 0x210}));
+    ASSERT_TRUE(counters_from_bytes(bytes, 64, counters));
+    EXPECT_EQ(counters, std::vector<uint64_t>{0x0000021000000001ull});
+    EXPECT_FALSE(counters_from_bytes(std::span<const uint8_t>(bytes).first(6), 32, counters));
+}
@@ -0,0 +1,287 @@
+#include <gtest/gtest.h>
+
+#include "src/ir.h"
+#include "src/machine.h"
+#include "src/targets/riscv_emitter.h"
+#include "src/targets/riscv_target.h"
+
+namespace RISCV
+{
+    class RISCVEmitterTest : public ::testing::Test
+    {
+    protected:
+        RISCVRegisterInfo tri_;
+        RISCVTargetInstInfo tii_;
+        Module module_;
+        MachineModule mm_{&module_};
+
+        void SetUp() override { mm_.set_target_info(&tri_, &tii_); }
+
+        MachineFunction *function(const std::string &name)
+        {
+            return mm_.create_machine_function(module_.create_function(name, module_.get_void_type(), {}));
+        }
+
+        static void emit(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+        {
+            bb->append(std::make_unique<MachineInst>(opcode, ops));
+        }
+        static MOperand reg(unsigned r, bool def = false) { return MOperand::create_reg(r, def); }
+        static MOperand imm(int64_t value) { return MOperand::create_imm(value); }
+        static MOperand mem(unsigned base, int offset) { return MOperand::create_mem_ri(base, offset); }
+
+        static std::vector<uint8_t> bytes(std::initializer_list<uint8_t> list) { return list; }
+
+        static uint32_t read32(const std::vector<uint8_t> &data, size_t at)
+        {
+            return data[at] | data[at + 1] << 8 | data[at + 2] << 16 | uint32_t(data[at + 3]) << 24;
+        }
+
+        static uint16_t read16(const std::vector<uint8_t> &data, size_t at)
+        {
+            return static_cast<uint16_t>(data[at] | data[at + 1] << 8);
+        }
+    };
+
+    // Expected encodings are those of `llvm-mc -triple=riscv64 -mattr=+c,+d`
+    TEST_F(RISCVEmitterTest, PicksCompressedEncodings)
+    {
+        MachineBasicBlock *bb = function("f")->create_block("entry");
+        emit(bb, ADDI, {reg(SP, true), reg(SP), imm(-16)});
+        emit(bb, SD, {reg(RA), mem(SP, 8)});
+        emit(bb, ADD, {reg(A0, true), reg(A0), reg(A1)});
+        emit(bb, ADD, {reg(A0, true), reg(A1), reg(ZERO)});
+        emit(bb, LI, {reg(A0, true), imm(5)});
+        emit(bb, LW, {reg(A0, true), mem(A1, 4)});
+        emit(bb, SUB, {reg(S0, true), reg(S0), reg(A0)});
+        emit(bb, SRAI, {reg(A0, true), reg(A0), imm(3)});
+        emit(bb, ANDI, {reg(A1, true), reg(A1), imm(-4)});
+        emit(bb, LD, {reg(RA, true), mem(SP, 8)});
+        emit(bb, ADDI, {reg(A2, true), reg(SP), imm(32)});
+        emit(bb, FLD, {reg(F10, true), mem(A1, 16)});
+        emit(bb, FSD, {reg(F11), mem(SP, 24)});
+        emit(bb, ADDI, {reg(SP, true), reg(SP), imm(16)});
+        emit(bb, ADD, {reg(A0, true), reg(A1), reg(A2)});
+        emit(bb, RET, {});
+
+        RISCVObject object;
+        std::string err;
+        ASSERT_TRUE(emit_object(mm_, object, {}, &err)) << err;
+        EXPECT_EQ(object.text, bytes({0x41, 0x11, 0x06, 0xe4, 0x2e, 0x95, 0x2e, 0x85, 0x15, 0x45, 0xc8, 0x41,
+                                      0x09, 0x8c, 0x0d, 0x85, 0xf1, 0x99, 0xa2, 0x60, 0x10, 0x10, 0x88, 0x29,
+                                      0x2e, 0xac, 0x41, 0x01, 0x33, 0x85, 0xc5, 0x00, 0x82, 0x80}));
+        EXPECT_EQ(object.find_symbol("f")->size, object.text.size());
+
+        // Without RVC every instruction is a word; only the three-register ADD
+        // stays that wide with it
+        RISCVObject uncompressed;
+        ASSERT_TRUE(emit_object(mm_, uncompressed, {.compress = false}, &err)) << err;
+        EXPECT_EQ(uncompressed.text.size(), 16 * 4u);
+        EXPECT_EQ(read32(uncompressed.text, 0), 0xff010113u); // addi sp, sp, -16
+        EXPECT_EQ(read32(uncompressed.text, 4), 0x00113423u); // sd ra, 8(sp)
+        EXPECT_EQ(read32(uncompressed.text, 44), 0x0105b507u); // fld fa0, 16(a1)
+        EXPECT_EQ(read32(uncompressed.text, 60), 0x00008067u); // ret
+    }
+
+    TEST_F(RISCVEmitterTest, ExpandsLoadImmediate)
+    {
+        MachineBasicBlock *bb = function("f")->create_block("entry");
+        emit(bb, LI, {reg(A0, true), imm(0x12345678)});
+        emit(bb, LI, {reg(A0, true), imm(int64_t(1) << 32)});
+        emit(bb, LI, {reg(A0, true), imm(-1)});
+
+        RISCVObject object;
+        std::string err;
+        ASSERT_TRUE(emit_object(mm_, object, {}, &err)) << err;
+        // lui a0, 0x12345; addiw a0, a0, 0x678; c.li a0, 1; c.slli a0, 32; c.li a0, -1
+        EXPECT_EQ(object.text, bytes({0x37, 0x55, 0x34, 0x12, 0x1b, 0x05, 0x85, 0x67, 0x05, 0x45, 0x02, 0x15,
+                                      0x7d, 0x55}));
+    }
+
+    TEST_F(RISCVEmitterTest, RelaxesBranchesToTheShortestForm)
+    {
+        MachineFunction *mf = function("f");
+        MachineBasicBlock *entry = mf->create_block("entry");
+        MachineBasicBlock *mid = mf->create_block("mid");
+        MachineBasicBlock *far = mf->create_block("far");
+        MachineBasicBlock *exit = mf->create_block("exit");
+        emit(entry, BEQ, {reg(A0), reg(ZERO), MOperand::create_basic_block(mid)});
+        emit(entry, BNE, {reg(A0), reg(ZERO), MOperand::create_basic_block(far)});
+        emit(entry, BLT, {reg(A0), reg(A1), MOperand::create_basic_block(exit)});
+        emit(entry, J, {MOperand::create_basic_block(mid)});
+        for (int i = 0; i < 200; ++i)
+            emit(mid, NOP, {});
+        for (int i = 0; i < 2000; ++i)
+            emit(far, NOP, {});
+        emit(exit, RET, {});
+
+        RISCVObject object;
+        std::string err;
+        ASSERT_TRUE(emit_object(mm_, object, {}, &err)) << err;
+        // c.beqz reaches mid; bne reaches far (past ±256 bytes); blt to exit
+        // (past ±4 KiB) becomes bge over a jal; c.j reaches mid
+        const uint64_t mid_offset = object.find_symbol("f.mid")->offset;
+        const uint64_t far_offset = object.find_symbol("f.far")->offset;
+        EXPECT_EQ(mid_offset, 2 + 4 + 8 + 2u);
+        EXPECT_EQ(far_offset, mid_offset + 400);
+        EXPECT_EQ(object.find_symbol("f.exit")->offset, far_offset + 4000);
+        EXPECT_EQ(read16(object.text, 0), 0xc901);              // c.beqz a0, +16
+        EXPECT_EQ(read32(object.text, 2), 0x18051f63u);          // bne a0, zero, +414
+        EXPECT_EQ(read32(object.text, 6), 0x00b55463u);          // bge a0, a1, +8
+        EXPECT_EQ(read32(object.text, 10) & 0xFFF, 0x06Fu);      // jal zero, ...
+        EXPECT_EQ(read16(object.text, 14), 0xa009);              // c.j +2
+        EXPECT_TRUE(object.text_relocations.empty());
+
+        // A jump within a function cannot go past JAL, whose range is ±1 MiB
+        entry->instructions().back()->operand(0) = MOperand::create_basic_block(exit);
+        for (int i = 0; i < 300000; ++i)
+            emit(mid, NOP, {});
+        EXPECT_FALSE(emit_object(mm_, object, {.compress = false}, &err));
+        EXPECT_NE(err.find("beyond the range of JAL"), std::string::npos) << err;
+    }
+
+    TEST_F(RISCVEmitterTest, EmitsRelocatableELF)
+    {
+        IntegerType *i32 = module_.get_integer_type(32);
+        GlobalVariable *g = module_.create_global_variable(i32, false, module_.get_constant_int(i32, 7), "g");
+        module_.create_global_variable(module_.get_pointer_type(module_.get_pointer_type(i32)), false, g, "p");
+        MachineFunction *callee = function("callee");
+        emit(callee->create_block("entry"), RET, {});
+        MachineBasicBlock *bb = function("main")->create_block("entry");
+        emit(bb, LA, {reg(A0, true), MOperand::create_global(g)});
+        emit(bb, CALL, {MOperand::create_external_sym("callee")});
+        emit(bb, CALL, {MOperand::create_external_sym("puts")});
+        emit(bb, J, {MOperand::create_external_sym("exit")});
+
+        RISCVObject object;
+        std::string err;
+        ASSERT_TRUE(emit_object(mm_, object, {}, &err)) << err;
+        // ret; auipc+addi a0; jal ra, callee; auipc+jalr ra; auipc t1 + jr t1
+        ASSERT_EQ(object.text.size(), 2 + 8 + 4 + 8 + 8u);
+        EXPECT_EQ(read32(object.text, 10), 0xff7ff0efu); // jal ra, -10
+        EXPECT_EQ(read32(object.text, 22), 0x00000317u); // auipc t1, 0
+        EXPECT_EQ(read32(object.text, 26), 0x00030067u); // jr t1
+
+        ASSERT_EQ(object.text_relocations.size(), 4u);
+        const auto &hi = object.text_relocations[0];
+        const auto &lo = object.text_relocations[1];
+        EXPECT_EQ(hi.type, R_RISCV_PCREL_HI20);
+        EXPECT_EQ(object.symbols[hi.symbol].name, "g");
+        EXPECT_EQ(lo.type, R_RISCV_PCREL_LO12_I);
+        EXPECT_EQ(lo.offset, hi.offset + 4);
+        EXPECT_EQ(object.symbols[lo.symbol].kind, RISCVSymbolKind::Label);
+        EXPECT_EQ(object.symbols[lo.symbol].offset, hi.offset);
+        EXPECT_EQ(object.text_relocations[2].type, R_RISCV_CALL_PLT);
+        EXPECT_EQ(object.symbols[object.text_relocations[2].symbol].name, "puts");
+        EXPECT_EQ(object.symbols[object.text_relocations[3].symbol].kind, RISCVSymbolKind::Undefined);
+
+        ASSERT_EQ(object.data_relocations.size(), 1u);
+        EXPECT_EQ(object.data_relocations[0].type, R_RISCV_64);
+        EXPECT_EQ(object.data_relocations[0].offset, object.find_symbol("p")->offset);
+        EXPECT_EQ(object.data[object.find_symbol("g")->offset], 7);
+
+        const std::vector<uint8_t> elf = object.to_elf();
+        ASSERT_GE(elf.size(), 64u);
+        EXPECT_EQ(std::vector<uint8_t>(elf.begin(), elf.begin() + 4), bytes({0x7F, 'E', 'L', 'F'}));
+        EXPECT_EQ(elf[4], 2);                          // ELFCLASS64
+        EXPECT_EQ(read16(elf, 16), 1);                 // ET_REL
+        EXPECT_EQ(read16(elf, 18), 243);               // EM_RISCV
+        EXPECT_EQ(read32(elf, 48), 0x5u);              // RVC, double-float ABI
+        EXPECT_EQ(read16(elf, 60), 8);                 // sections
+        const uint64_t shoff = read32(elf, 40);
+        EXPECT_EQ(shoff + 8 * 64, elf.size());
+        // .symtab's sh_info is the first global: after the null symbol, the
+        // five blocks and labels
+        EXPECT_EQ(read32(elf, shoff + 5 * 64 + 44), 1 + 2 + 1u);
+
+        const std::string path = ::testing::TempDir() + "riscv_emitter_test.o";
+        ASSERT_TRUE(object.write_file(path, &err)) << err;
+        std::remove(path.c_str());
+    }
+
+    TEST_F(RISCVEmitterTest, TargetsRV32)
+    {
+        RISCVTargetInstInfo tii32(ABIVersion::ILP32);
+        mm_.set_target_info(&tri_, &tii32);
+        IntegerType *i32 = module_.get_integer_type(32);
+        GlobalVariable *g = module_.create_global_variable(i32, false, module_.get_constant_int(i32, 7), "g");
+        module_.create_global_variable(module_.get_pointer_type(module_.get_pointer_type(i32)), false, g, "p");
+        MachineFunction *callee = function("callee");
+        emit(callee->create_block("entry"), RET, {});
+        MachineBasicBlock *bb = function("main")->create_block("entry");
+        emit(bb, CALL, {MOperand::create_external_sym("callee")});
+        emit(bb, LI, {reg(A0, true), imm(0x7FFFF800)});
+        emit(bb, LI, {reg(A1, true), imm(0xFFFFFFFF)});
+
+        RISCVObject object;
+        std::string err;
+        ASSERT_TRUE(emit_object(mm_, object, {}, &err)) << err;
+        EXPECT_FALSE(object.rv64);
+        // c.jal -2 (RV32 only); lui a0, 0x80000; addi a0, a0, -2048; c.li a1, -1
+        EXPECT_EQ(read16(object.text, 2), 0x3ffd);
+        EXPECT_EQ(read32(object.text, 4), 0x80000537u);
+        EXPECT_EQ(read32(object.text, 8), 0x80050513u);
+        EXPECT_EQ(read16(object.text, 12), 0x55fd);
+        ASSERT_EQ(object.data_relocations.size(), 1u);
+        EXPECT_EQ(object.data_relocations[0].type, R_RISCV_32);
+
+        const std::vector<uint8_t> elf = object.to_elf();
+        EXPECT_EQ(elf[4], 1); // ELFCLASS32
+        EXPECT_EQ(read32(elf, 36), 0x1u); // RVC, soft-float ABI
+        EXPECT_EQ(read16(elf, 48), 8);    // sections
+
+        emit(bb, LD, {reg(A0, true), mem(SP, 0)});
+        EXPECT_FALSE(emit_object(mm_, object, {}, &err));
+        EXPECT_NE(err.find("RV64 only"), std::string::npos) << err;
+    }
+
+    TEST_F(RISCVEmitterTest, RejectsWhatCannotBeEncoded)
+    {
+        MachineFunction *mf = function("f");
+        MachineBasicBlock *bb = mf->create_block("entry");
+        emit(bb, ADD, {reg(mf->create_vreg(GR64), true), reg(A0), reg(A1)});
+
+        RISCVObject object;
+        std::string err;
+        EXPECT_FALSE(emit_object(mm_, object, {}, &err));
+        EXPECT_NE(err.find("virtual register"), std::string::npos) << err;
+
+        bb->instructions().back()->operand(0) = reg(A0, true);
+        emit(bb, ADDI, {reg(A0, true), reg(A0), imm(5000)});
+        EXPECT_FALSE(emit_object(mm_, object, {}, &err));
+        EXPECT_NE(err.find("out of range"), std::string::npos) << err;
+
+        bb->instructions().back()->operand(2) = imm(50);
+        emit(bb, ADD, {reg(A0, true), reg(A0), imm(1)});
+        EXPECT_FALSE(emit_object(mm_, object, {}, &err));
+        EXPECT_NE(err.find("three registers"), std::string::npos) << err;
+    }
+
+    TEST_F(RISCVEmitterTest, EncodesVectorInstructions)
+    {
+        MachineBasicBlock *bb = function("f")->create_block("entry");
+        emit(bb, VSETIVLI, {reg(ZERO, true), imm(4), imm(0xD0)});
+        emit(bb, VLE32_V, {reg(V8, true), mem(A0, 0)});
+        emit(bb, VADD_VV, {reg(V8, true), reg(V8), reg(V9)});
+        emit(bb, VS1R_V, {reg(V8), mem(SP, 0)});
+
+        RISCVObject object;
+        std::string err;
+        EXPECT_FALSE(emit_object(mm_, object, {}, &err));
+        EXPECT_NE(err.find("V extension"), std::string::npos) << err;
+
+        RISCVRegisterInfo tri(ABIVersion::LP64D, true);
+        RISCVTargetInstInfo tii(ABIVersion::LP64D, true);
+        mm_.set_target_info(&tri, &tii);
+        ASSERT_TRUE(emit_object(mm_, object, {}, &err)) << err;
+        // vsetivli zero, 4, e32, m1, ta, ma; vle32.v v8, (a0); vadd.vv v8, v8, v9; vs1r.v v8, (sp)
+        EXPECT_EQ(read32(object.text, 0), 0xcd027057u);
+        EXPECT_EQ(read32(object.text, 4), 0x02056407u);
+        EXPECT_EQ(read32(object.text, 8), 0x02848457u);
+        EXPECT_EQ(read32(object.text, 12), 0x02810427u);
+
+        emit(bb, VLE32_V, {reg(V8, true), mem(A0, 16)});
+        EXPECT_FALSE(emit_object(mm_, object, {}, &err));
+        EXPECT_NE(err.find("0(base)"), std::string::npos) << err;
+    }
+} // namespace RISCV
@@ -0,0 +1,217 @@
+#include <gtest/gtest.h>
+
+#include "src/ir.h"
+#include "src/machine.h"
+#include "src/scheduler.h"
+#include "src/targets/asimov_target.h"
+#include "src/targets/riscv_target.h"
+
+namespace
+{
+    MOperand reg(unsigned r, bool def = false) { return MOperand::create_reg(r, def); }
+    MOperand imm(int64_t value) { return MOperand::create_imm(value); }
+    MOperand mem(unsigned base, int offset) { return MOperand::create_mem_ri(base, offset); }
+
+    MachineInst *emit(MachineBasicBlock *bb, unsigned opcode, std::vector<MOperand> ops)
+    {
+        bb->append(std::make_unique<MachineInst>(opcode, ops));
+        return bb->instructions().back().get();
+    }
+
+    size_t position(const MachineBasicBlock *bb, const MachineInst *mi)
+    {
+        for (size_t i = 0; i < bb->instructions().size(); ++i)
+        {
+            if (bb->instructions()[i].get() == mi)
+                return i;
+        }
+        return bb->instructions().size();
+    }
+
+    // Virtual registers live at once, for blocks where every value is used once
+    unsigned max_live(const MachineBasicBlock *bb)
+    {
+        std::set<unsigned> live;
+        unsigned peak = 0;
+        for (const auto &mi : bb->instructions())
+        {
+            for (unsigned r : mi->uses())
+                live.erase(r);
+            for (unsigned r : mi->defs())
+            {
+                if (MachineFunction::is_virtual_reg(r))
+                    live.insert(r);
+            }
+            peak = std::max(peak, static_cast<unsigned>(live.size()));
+        }
+        return peak;
+    }
+
+    class RISCVSchedulerTest : public ::testing::Test
+    {
+    protected:
+        RISCV::RISCVRegisterInfo tri_;
+        RISCV::RISCVTargetInstInfo tii_;
+        Module module_;
+        MachineModule mm_{&module_};
+
+        void SetUp() override { mm_.set_target_info(&tri_, &tii_); }
+
+        MachineFunction *function(const std::string &name)
+        {
+            return mm_.create_machine_function(module_.create_function(name, module_.get_void_type(), {}));
+        }
+    };
+}
+
+TEST_F(RISCVSchedulerTest, FillsLoadLatency)
+{
+    using namespace RISCV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    MachineInst *load = emit(bb, LD, {reg(A0, true), mem(A2, 0)});
+    MachineInst *add = emit(bb, ADD, {reg(A1, true), reg(A0), reg(A0)});
+    MachineInst *first = emit(bb, ADDI, {reg(A3, true), reg(A3), imm(1)});
+    MachineInst *second = emit(bb, ADDI, {reg(A4, true), reg(A4), imm(1)});
+    MachineInst *ret = emit(bb, RET, {});
+
+    EXPECT_EQ(estimate_block_cycles(*bb, tii_), 7u);
+    ScheduleStats stats = schedule_function(*mf, ScheduleMode::PostRA);
+    EXPECT_EQ(stats.regions, 1u);
+    EXPECT_EQ(stats.reordered, 1u);
+    EXPECT_EQ(stats.cycles_before, 7u);
+    EXPECT_EQ(stats.cycles_after, 5u);
+    EXPECT_EQ(position(bb, load), 0u);
+    EXPECT_EQ(position(bb, first), 1u);
+    EXPECT_EQ(position(bb, second), 2u);
+    EXPECT_EQ(position(bb, add), 3u);
+    EXPECT_EQ(position(bb, ret), 4u);
+}
+
+TEST_F(RISCVSchedulerTest, KeepsAntiDependencesAfterAllocation)
+{
+    using namespace RISCV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    emit(bb, LD, {reg(A0, true), mem(A2, 0)});
+    MachineInst *add = emit(bb, ADD, {reg(A1, true), reg(A0), reg(A0)});
+    // Reuses A0, so it can't go ahead of the add that reads the load
+    MachineInst *reuse = emit(bb, ADDI, {reg(A0, true), reg(A3), imm(1)});
+    emit(bb, RET, {});
+
+    ScheduleStats stats = schedule_function(*mf, ScheduleMode::PostRA);
+    EXPECT_EQ(stats.reordered, 0u);
+    EXPECT_LT(position(bb, add), position(bb, reuse));
+}
+
+TEST_F(RISCVSchedulerTest, OrdersAccessesThatMayOverlap)
+{
+    using namespace RISCV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    // Different bases may point at the same bytes
+    MachineInst *store = emit(bb, SD, {reg(A0), mem(A1, 0)});
+    MachineInst *load = emit(bb, LD, {reg(A2, true), mem(A3, 0)});
+    emit(bb, ADD, {reg(A4, true), reg(A2), reg(A2)});
+    // Another slot off the same base can't
+    MachineInst *spill = emit(bb, SD, {reg(S1), mem(SP, 0)});
+    MachineInst *reload = emit(bb, LD, {reg(S2, true), mem(SP, 8)});
+    emit(bb, ADD, {reg(S3, true), reg(S2), reg(S2)});
+    emit(bb, RET, {});
+
+    schedule_function(*mf, ScheduleMode::PostRA);
+    EXPECT_LT(position(bb, store), position(bb, load));
+    EXPECT_LT(position(bb, reload), position(bb, spill));
+}
+
+TEST_F(RISCVSchedulerTest, HidesFloatingPointLatency)
+{
+    using namespace RISCV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    MachineInst *fld = emit(bb, FLD, {reg(F1, true), mem(A0, 0)});
+    MachineInst *fadd = emit(bb, FADD_D, {reg(F2, true), reg(F1), reg(F1)});
+    MachineInst *fsd = emit(bb, FSD, {reg(F2), mem(A0, 8)});
+    MachineInst *ld = emit(bb, LD, {reg(A1, true), mem(A0, 16)});
+    MachineInst *addi = emit(bb, ADDI, {reg(A2, true), reg(A1), imm(1)});
+    emit(bb, RET, {});
+
+    ScheduleStats stats = schedule_function(*mf, ScheduleMode::PostRA);
+    EXPECT_LT(stats.cycles_after, stats.cycles_before);
+    EXPECT_EQ(position(bb, fld), 0u);
+    EXPECT_EQ(position(bb, ld), 1u);
+    EXPECT_EQ(position(bb, fadd), 2u);
+    EXPECT_EQ(position(bb, addi), 3u);
+    EXPECT_EQ(position(bb, fsd), 4u);
+}
+
+TEST_F(RISCVSchedulerTest, LeavesCallsAndBranchesInPlace)
+{
+    using namespace RISCV;
+    MachineFunction *mf = function("f");
+    MachineBasicBlock *bb = mf->create_block("entry");
+    MachineBasicBlock *exit = mf->create_block("exit");
+    emit(bb, ADDI, {reg(S1, true), reg(S1), imm(1)});
+    MachineInst *call = emit(bb, CALL, {MOperand::create_label("g")});
+    MachineInst *ld = emit(bb, LD, {reg(S2, true), mem(SP, 0)});
+    MachineInst *branch = emit(bb, BEQ, {reg(S1), reg(ZERO), MOperand::create_basic_block(exit)});
+    emit(bb, ADD, {reg(S3, true), reg(S2), reg(S2)});
+    emit(exit, RET, {});
+
+    ScheduleStats stats = schedule_function(*mf, ScheduleMode::PostRA);
+    EXPECT_EQ(stats.regions, 0u);
+    EXPECT_EQ(position(bb, call), 1u);
+    EXPECT_EQ(position(bb, ld), 2u);
+    EXPECT_EQ(position(bb, branch), 3u);
+}
+
+// ASIMOV has five allocatable integer registers. The loads here would all
+// issue ahead of the slow multiply chain if only latency counted
+TEST(ASIMOVScheduler, StaysWithinTheRegistersBeforeAllocation)
+{
+    using namespace ASIMOV;
+    constexpr int count = 12;
+    auto build = [](MachineFunction *mf)
+    {
+        MachineBasicBlock *bb = mf->create_block("entry");
+        unsigned acc = mf->create_vreg(GR32, 4);
+        emit(bb, LI, {reg(acc, true), imm(1)});
+        for (int i = 0; i < count; ++i)
+        {
+            const unsigned value = mf->create_vreg(GR32, 4);
+            const unsigned product = mf->create_vreg(GR32, 4);
+            emit(bb, LOAD, {reg(value, true), mem(R7, 4 * i)});
+            emit(bb, MUL, {reg(product, true), reg(acc), reg(value)});
+            acc = product;
+        }
+        emit(bb, MOVW, {reg(R0, true), reg(acc)});
+        emit(bb, RET, {});
+        return bb;
+    };
+
+    ASIMOVRegisterInfo tri;
+    ASIMOVTargetInstInfo tii;
+    const unsigned regs = static_cast<unsigned>(tri.allocation_order(GR32).size());
+    ASSERT_EQ(regs, 5u);
+
+    Module unlimited_module;
+    MachineModule unlimited(&unlimited_module);
+    unlimited.set_target_info(nullptr, &tii);
+    MachineFunction *greedy = unlimited.create_machine_function(
+        unlimited_module.create_function("f", unlimited_module.get_void_type(), {}));
+    MachineBasicBlock *greedy_bb = build(greedy);
+    schedule_function(*greedy, ScheduleMode::PreRA);
+    EXPECT_GT(max_live(greedy_bb), regs);
+
+    Module module;
+    MachineModule mm(&module);
+    mm.set_target_info(&tri, &tii);
+    MachineFunction *mf = mm.create_machine_function(module.create_function("f", module.get_void_type(), {}));
+    MachineBasicBlock *bb = build(mf);
+    const uint64_t before = estimate_block_cycles(*bb, tii);
+    ScheduleStats stats = schedule_function(*mf, ScheduleMode::PreRA);
+    EXPECT_EQ(stats.pressure_rejects, 0u);
+    EXPECT_EQ(stats.reordered, 1u);
+    EXPECT_LE(max_live(bb), regs);
+    EXPECT_LT(stats.cycles_after, before);
+}
@@ -0,0 +1,208 @@
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/dce.h"
+#include "src/transforms/mem2reg.h"
+#include "src/transforms/simplify_cfg.h"
+
+namespace
+{
+    unsigned count_instructions(Function *f)
+    {
+        unsigned count = 0;
+        for (BasicBlock *bb : f->basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                (void)inst;
+                ++count;
+            }
+        }
+        return count;
+    }
+}
+
+TEST(DeadCodeElimination, RemovesUnusedValuesAndWriteOnlySlots)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"a", i32}, {"b", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    Value *used = builder.create_add(f->arg(0), f->arg(1));
+    Value *unused = builder.create_mul(f->arg(0), f->arg(1));
+    builder.create_sub(unused, f->arg(0)); // only feeds itself into nothing
+    StructType *pair = m.get_struct_type("Pair", {MemberInfo("x", i32), MemberInfo("y", i32)});
+    AllocaInst *scratch = builder.create_alloca(pair, "scratch");
+    builder.create_store(used, builder.create_struct_gep(scratch, 1));
+    AllocaInst *kept = builder.create_alloca(i32, "kept");
+    builder.create_store(used, kept);
+    builder.create_ret(builder.create_load(kept));
+
+    EXPECT_EQ(count_instructions(f), 10u);
+    EXPECT_EQ(eliminate_dead_code(*f), 5u);
+    EXPECT_EQ(count_instructions(f), 5u);
+    EXPECT_EQ(entry->first_instruction(), used);
+    EXPECT_EQ(eliminate_dead_code(*f), 0u);
+}
+
+TEST(DeadCodeElimination, RemovesDeadPhiCycles)
+{
+    // A loop-carried value that nothing outside the loop reads
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *loop = f->create_basic_block("loop");
+    BasicBlock *exit = f->create_basic_block("exit");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_br(loop);
+    builder.set_insert_point(loop);
+    PhiInst *phi = builder.create_phi(i32);
+    Value *next = builder.create_add(phi, m.get_constant_int(i32, 1));
+    phi->add_incoming(m.get_constant_int(i32, 0), entry);
+    phi->add_incoming(next, loop);
+    builder.create_cond_br(f->arg(0), loop, exit);
+    builder.set_insert_point(exit);
+    builder.create_ret(m.get_constant_int(i32, 0));
+
+    EXPECT_EQ(eliminate_dead_code(*f), 2u);
+    EXPECT_NE(dynamic_cast<BranchInst *>(loop->first_instruction()), nullptr);
+    EXPECT_EQ(count_instructions(f), 3u);
+}
+
+TEST(SimplifyCFG, FoldsConstantBranchesAndMergesBlocks)
+{
+    // entry: br true, then, else; then: br merge; else: br merge;
+    // merge: phi [1, then], [2, else]; ret
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *then_bb = f->create_basic_block("then");
+    BasicBlock *else_bb = f->create_basic_block("else");
+    BasicBlock *merge = f->create_basic_block("merge");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_cond_br(m.get_constant_bool(true), then_bb, else_bb);
+    builder.set_insert_point(then_bb);
+    builder.create_br(merge);
+    builder.set_insert_point(else_bb);
+    builder.create_br(merge);
+    builder.set_insert_point(merge);
+    PhiInst *phi = builder.create_phi(i32);
+    phi->add_incoming(m.get_constant_int(i32, 1), then_bb);
+    phi->add_incoming(m.get_constant_int(i32, 2), else_bb);
+    ReturnInst *ret = builder.create_ret(phi);
+
+    EXPECT_TRUE(simplify_cfg(*f));
+    ASSERT_EQ(f->basic_blocks().size(), 1u);
+    EXPECT_EQ(f->basic_blocks()[0], entry);
+    EXPECT_EQ(entry->first_instruction(), ret);
+    EXPECT_EQ(ret->value(), m.get_constant_int(i32, 1));
+    EXPECT_TRUE(entry->successors().empty());
+    EXPECT_FALSE(simplify_cfg(*f));
+}
+
+TEST(SimplifyCFG, BypassesForwardingBlocksAndDropsPlaceholders)
+{
+    // entry: br c, a, b; a: br join; b: br join; join: ret v;
+    // dead: unreachable
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"c", m.get_boolean_type()}, {"v", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *a = f->create_basic_block("a");
+    BasicBlock *b = f->create_basic_block("b");
+    BasicBlock *join = f->create_basic_block("join");
+    BasicBlock *dead = f->create_basic_block("dead");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_cond_br(f->arg(0), a, b);
+    builder.set_insert_point(a);
+    builder.create_br(join);
+    builder.set_insert_point(b);
+    builder.create_br(join);
+    builder.set_insert_point(join);
+    builder.create_ret(f->arg(1));
+    builder.set_insert_point(dead);
+    builder.create_unreachable();
+
+    EXPECT_TRUE(simplify_cfg(*f));
+    // Both arms end up on `join`, so the branch folds and `join` merges in
+    ASSERT_EQ(f->basic_blocks().size(), 1u);
+    EXPECT_EQ(entry->first_instruction()->opcode(), Opcode::Ret);
+}
+
+TEST(SimplifyCFG, KeepsLoopsAndRewiresPhis)
+{
+    // entry -> pre -> loop <-> loop -> exit; `pre` merges into entry and the
+    // loop phi has to name entry as its incoming block afterwards
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {{"n", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *pre = f->create_basic_block("pre");
+    BasicBlock *loop = f->create_basic_block("loop");
+    BasicBlock *exit = f->create_basic_block("exit");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    builder.create_br(pre);
+    builder.set_insert_point(pre);
+    Value *start = builder.create_add(f->arg(0), m.get_constant_int(i32, 3));
+    builder.create_br(loop);
+    builder.set_insert_point(loop);
+    PhiInst *phi = builder.create_phi(i32);
+    Value *next = builder.create_sub(phi, m.get_constant_int(i32, 1));
+    phi->add_incoming(start, pre);
+    phi->add_incoming(next, loop);
+    builder.create_cond_br(builder.create_icmp(ICmpInst::SGT, next, m.get_constant_int(i32, 0)), loop, exit);
+    builder.set_insert_point(exit);
+    builder.create_ret(next);
+
+    EXPECT_TRUE(simplify_cfg(*f));
+    EXPECT_EQ(f->basic_blocks(), (std::vector<BasicBlock *>{entry, loop, exit}));
+    EXPECT_EQ(phi->get_incoming_block(0), entry);
+    EXPECT_EQ(loop->predecessors().size(), 2u);
+    EXPECT_EQ(static_cast<Instruction *>(start)->parent(), entry);
+}
+
+TEST(SimplifyCFG, PipelineCleansUpGeneratedShape)
+{
+    // The shape IRGenerator emits for `x = 1; if (false) { x = 2; } return x;`
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *f = m.create_function("f", i32, {});
+    BasicBlock *entry = f->create_basic_block("entry");
+    BasicBlock *then_bb = f->create_basic_block("if.then");
+    BasicBlock *merge = f->create_basic_block("if.merge");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *x = builder.create_alloca(i32, "x");
+    builder.create_store(m.get_constant_int(i32, 1), x);
+    builder.create_cond_br(m.get_constant_bool(false), then_bb, merge);
+    builder.set_insert_point(then_bb);
+    builder.create_store(m.get_constant_int(i32, 2), x);
+    builder.create_br(merge);
+    builder.set_insert_point(merge);
+    builder.create_ret(builder.create_load(x));
+
+    PassManager pm;
+    pm.add(std::make_unique<SimplifyCFGPass>());
+    pm.add(std::make_unique<Mem2RegPass>());
+    pm.add(std::make_unique<DeadCodeEliminationPass>());
+    EXPECT_TRUE(pm.run(m));
+
+    ASSERT_EQ(f->basic_blocks().size(), 1u);
+    ASSERT_EQ(count_instructions(f), 1u);
+    auto *ret = dynamic_cast<ReturnInst *>(entry->first_instruction());
+    ASSERT_NE(ret, nullptr);
+    EXPECT_EQ(ret->value(), m.get_constant_int(i32, 1));
+}
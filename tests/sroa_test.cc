@@ -0,0 +1,181 @@
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/mem2reg.h"
+#include "src/transforms/sroa.h"
+#include "tests/ir_test_util.h"
+
+using ir_test::count_opcode;
+
+TEST(SROA, SplitsStructsIntoScalars)
+{
+    // struct { i8 tag; i32 x; i64 y; } p; p.x = a; p.y = 7; return p.x;
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *point = m.get_struct_type("point", {{"tag", m.get_integer_type(8)}, {"x", i32}, {"y", m.get_integer_type(64)}});
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *p = builder.create_alloca(point, "p");
+    builder.create_store(f->arg(0), builder.create_struct_gep(p, 1));
+    builder.create_store(m.get_constant_int(64, 7), builder.create_struct_gep(p, 2));
+    ReturnInst *ret = builder.create_ret(builder.create_load(builder.create_struct_gep(p, 1)));
+
+    EXPECT_TRUE(is_alloca_splittable(p));
+    EXPECT_EQ(split_aggregate_allocas(*f), 1u);
+    // `tag` is never addressed, so it gets no slot
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::GetElementPtr), 0u);
+
+    EXPECT_EQ(promote_allocas(*f), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 0u);
+    EXPECT_EQ(ret->value(), f->arg(0));
+}
+
+TEST(SROA, SplitsNestedAggregates)
+{
+    // struct { i32 n; i32 v[4]; } s; s.v[2] = a; s.n = 1; return s.v[2] + s.n;
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *vec = m.get_struct_type("vec", {{"n", i32}, {"v", m.get_array_type(i32, 4)}});
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *s = builder.create_alloca(vec, "s");
+    builder.create_store(f->arg(0), builder.create_gep(s, {builder.get_int32(0), builder.get_int32(1), builder.get_int32(2)}));
+    Value *v = builder.create_struct_gep(s, 1);
+    builder.create_store(builder.get_int32(1), builder.create_struct_gep(s, 0));
+    Value *elem = builder.create_load(builder.create_gep(v, {builder.get_int32(0), builder.get_int32(2)}));
+    builder.create_ret(builder.create_add(elem, builder.create_load(builder.create_struct_gep(s, 0))));
+
+    // The struct, then its array
+    EXPECT_EQ(split_aggregate_allocas(*f), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::GetElementPtr), 0u);
+    EXPECT_EQ(promote_allocas(*f), 2u);
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 0u);
+}
+
+TEST(SROA, KeepsAggregatesWhoseFieldsEscape)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    ArrayType *array = m.get_array_type(i32, 4);
+    Function *f = m.create_function("f", i32, {{"i", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    // Indexed with a value, so any element may be read
+    AllocaInst *dynamic = builder.create_alloca(array, "dynamic");
+    builder.create_load(builder.create_gep(dynamic, {builder.get_int32(0), f->arg(0)}));
+    // An element address moved to the next one
+    AllocaInst *stepped = builder.create_alloca(array, "stepped");
+    Value *first = builder.create_gep(stepped, {builder.get_int32(0), builder.get_int32(0)});
+    builder.create_load(builder.create_gep(first, {builder.get_int32(1)}));
+    // A field address stored away
+    AllocaInst *stored = builder.create_alloca(array, "stored");
+    AllocaInst *holder = builder.create_alloca(m.get_pointer_type(i32), "holder");
+    builder.create_store(builder.create_gep(stored, {builder.get_int32(0), builder.get_int32(1)}), holder);
+    // Too many elements to be worth a slot each
+    AllocaInst *large = builder.create_alloca(m.get_array_type(i32, MAX_SROA_ELEMENTS + 1), "large");
+    builder.create_load(builder.create_gep(large, {builder.get_int32(0), builder.get_int32(1)}));
+    builder.create_ret(builder.get_int32(0));
+
+    EXPECT_FALSE(is_alloca_splittable(dynamic));
+    EXPECT_FALSE(is_alloca_splittable(stepped));
+    EXPECT_FALSE(is_alloca_splittable(stored));
+    EXPECT_FALSE(is_alloca_splittable(large));
+    EXPECT_EQ(split_aggregate_allocas(*f), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 5u);
+}
+
+TEST(SROA, LowersAggregateCopiesToFieldCopies)
+{
+    // struct { i32 x; i32 v[2]; } t, s; t.x = a; t.v[1] = 2; s = t; return s.x + s.v[1];
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *pair = m.get_struct_type("pair", {{"x", i32}, {"v", m.get_array_type(i32, 2)}});
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *t = builder.create_alloca(pair, "t");
+    AllocaInst *s = builder.create_alloca(pair, "s");
+    builder.create_store(f->arg(0), builder.create_struct_gep(t, 0));
+    builder.create_store(builder.get_int32(2), builder.create_gep(t, {builder.get_int32(0), builder.get_int32(1), builder.get_int32(1)}));
+    builder.create_store(builder.create_load(t, "t.val"), s);
+    Value *x = builder.create_load(builder.create_struct_gep(s, 0));
+    Value *v1 = builder.create_load(builder.create_gep(s, {builder.get_int32(0), builder.get_int32(1), builder.get_int32(1)}));
+    builder.create_ret(builder.create_add(x, v1));
+
+    // The whole-struct copy keeps both slots from splitting
+    EXPECT_FALSE(is_alloca_splittable(s));
+    EXPECT_EQ(lower_aggregate_copies(*f), 1u);
+    // One load and store per scalar: x, v[0], v[1]
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 5u);
+    EXPECT_EQ(count_opcode(f, Opcode::Store), 5u);
+
+    EXPECT_TRUE(is_alloca_splittable(t));
+    EXPECT_TRUE(is_alloca_splittable(s));
+    split_aggregate_allocas(*f);
+    promote_allocas(*f);
+    EXPECT_EQ(count_opcode(f, Opcode::Alloca), 0u);
+    EXPECT_EQ(count_opcode(f, Opcode::Load), 0u);
+}
+
+TEST(SROA, KeepsAggregateCopiesAcrossWrites)
+{
+    // The source is written between the load and the store, so reading the
+    // fields at the store would see the new value
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    StructType *box = m.get_struct_type("box", {{"x", i32}});
+    Function *f = m.create_function("f", i32, {{"a", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    AllocaInst *t = builder.create_alloca(box, "t");
+    AllocaInst *s = builder.create_alloca(box, "s");
+    Value *copy = builder.create_load(t, "t.val");
+    builder.create_store(f->arg(0), builder.create_struct_gep(t, 0));
+    builder.create_store(copy, s);
+    builder.create_ret(builder.create_load(builder.create_struct_gep(s, 0)));
+
+    EXPECT_EQ(lower_aggregate_copies(*f), 0u);
+}
+
+TEST(StructLayout, ReordersFieldsOnlyWhenAsked)
+{
+    // { i8, i64, i16, i32 }
+    auto build = [](Module &m)
+    {
+        return m.get_struct_type("s", {{"a", m.get_integer_type(8)},
+                                       {"b", m.get_integer_type(64)},
+                                       {"c", m.get_integer_type(16)},
+                                       {"d", m.get_integer_type(32)}});
+    };
+
+    Module declared;
+    StructType *plain = build(declared);
+    EXPECT_EQ(plain->size(), 24u);
+    EXPECT_EQ(plain->get_member_offset(1), 8u);
+    EXPECT_EQ(plain->get_member_offset(3), 20u);
+
+    Module packed;
+    packed.set_reorder_struct_fields(true);
+    StructType *sorted = build(packed);
+    EXPECT_EQ(sorted->size(), 16u);
+    EXPECT_EQ(sorted->get_member_offset(0), 14u);
+    EXPECT_EQ(sorted->get_member_offset(1), 0u);
+    EXPECT_EQ(sorted->get_member_offset(2), 12u);
+    EXPECT_EQ(sorted->get_member_offset(3), 8u);
+    // Indices still follow the declaration
+    EXPECT_EQ(sorted->get_member_type(0), packed.get_integer_type(8));
+    EXPECT_EQ(sorted->get_member_index("c"), 2u);
+}
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <sstream>
+
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/ir_printer.h"
+#include "src/targets/asimov_isel.h"
+#include "src/targets/riscv_isel.h"
+#include "src/transforms/tail_calls.h"
+
+namespace
+{
+    // Only the prologue and epilogue are under test
+    class FrameLowering : public ASIMOV::ASIMOVFrameLowering
+    {
+    public:
+        int get_frame_index_offset(const MachineFunction &mf, int frame_index) const override
+        {
+            return static_cast<int>(mf.frame()->get_frame_index_offset(frame_index));
+        }
+        FrameLayout compute_frame_layout(const MachineFunction &mf) const override
+        {
+            return {static_cast<int>(mf.frame()->get_total_frame_size()), 0};
+        }
+        void emit_stack_protector(MachineFunction &, int) const override {}
+    };
+
+    std::vector<unsigned> opcodes(const MachineBasicBlock *mbb)
+    {
+        std::vector<unsigned> result;
+        for (const auto &mi : mbb->instructions())
+        {
+            result.push_back(mi->opcode());
+        }
+        return result;
+    }
+
+    // sum(n, acc) = n == 0 ? acc : sum(n - 1, acc + n)
+    struct Sum
+    {
+        Function *f;
+        CallInst *call;
+    };
+
+    Sum build_sum(Module &m)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        Function *f = m.create_function("sum", i32, {{"n", i32}, {"acc", i32}});
+        BasicBlock *entry = f->create_basic_block("entry");
+        BasicBlock *done = f->create_basic_block("done");
+        BasicBlock *recurse = f->create_basic_block("recurse");
+
+        IRBuilder builder(&m);
+        builder.set_insert_point(entry);
+        builder.create_cond_br(builder.create_icmp(ICmpInst::EQ, f->arg(0), builder.get_int32(0)), done, recurse);
+        builder.set_insert_point(done);
+        builder.create_ret(f->arg(1));
+        builder.set_insert_point(recurse);
+        CallInst *call = builder.create_call(f, {builder.create_sub(f->arg(0), builder.get_int32(1)),
+                                                 builder.create_add(f->arg(1), f->arg(0))},
+                                             "r");
+        builder.create_ret(call);
+        return {f, call};
+    }
+}
+
+TEST(TailCalls, MarksCallsInTailPosition)
+{
+    Module m;
+    Sum sum = build_sum(m);
+    EXPECT_TRUE(is_tail_call_candidate(*sum.call));
+    EXPECT_EQ(mark_tail_calls(m), 1u);
+    EXPECT_TRUE(sum.call->is_tail_call());
+
+    std::ostringstream os;
+    IRPrinter::print_module(m, os);
+    EXPECT_NE(os.str().find("= tail call i32 @sum("), std::string::npos);
+}
+
+TEST(TailCalls, KeepsCallsThatNeedTheFrame)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    Function *g = m.create_function("g", i32, {{"p", m.get_pointer_type(i32)}});
+    Function *h = m.create_function("h", i32, {{"a", i32}});
+    IRBuilder builder(&m);
+
+    // The result is used after the call
+    Function *used = m.create_function("used", i32, {{"a", i32}});
+    builder.set_insert_point(used->create_basic_block("entry"));
+    CallInst *then_add = builder.create_call(h, {used->arg(0)}, "r");
+    builder.create_ret(builder.create_add(then_add, builder.get_int32(1)));
+
+    // The callee gets a pointer into our frame
+    Function *escaped = m.create_function("escaped", i32, {{"a", i32}});
+    builder.set_insert_point(escaped->create_basic_block("entry"));
+    AllocaInst *slot = builder.create_alloca(i32, "slot");
+    builder.create_store(escaped->arg(0), slot);
+    CallInst *with_pointer = builder.create_call(g, {slot}, "r");
+    builder.create_ret(with_pointer);
+
+    // A local that is only loaded and stored doesn't stop it
+    Function *local = m.create_function("local", i32, {{"a", i32}});
+    builder.set_insert_point(local->create_basic_block("entry"));
+    AllocaInst *tmp = builder.create_alloca(i32, "tmp");
+    builder.create_store(local->arg(0), tmp);
+    CallInst *after_load = builder.create_call(h, {builder.create_load(tmp)}, "r");
+    builder.create_ret(after_load);
+
+    EXPECT_EQ(mark_tail_calls(m), 1u);
+    EXPECT_FALSE(then_add->is_tail_call());
+    EXPECT_FALSE(with_pointer->is_tail_call());
+    EXPECT_TRUE(after_load->is_tail_call());
+}
+
+TEST(TailCalls, ASIMOVJumpsToTheCallee)
+{
+    Module m;
+    Sum sum = build_sum(m);
+    mark_tail_calls(m);
+
+    ASIMOV::ASIMOVRegisterInfo tri;
+    ASIMOV::ASIMOVTargetInstInfo tii;
+    ASIMOV::ASIMOVISelInfo target(&tii);
+    MachineModule mm(&m);
+    mm.set_target_info(&tri, &tii);
+    MachineFunction *mf = mm.create_machine_function(sum.f);
+    std::string err;
+    ASSERT_TRUE(select_function(target, *sum.f, *mf, &err)) << err;
+
+    using namespace ASIMOV;
+    const MachineBasicBlock *recurse = mf->basic_blocks().back().get();
+    const std::vector<unsigned> ops = opcodes(recurse);
+    EXPECT_EQ(std::count(ops.begin(), ops.end(), CALL), 0);
+    EXPECT_EQ(std::count(ops.begin(), ops.end(), RET), 0);
+    const MachineInst &jump = *recurse->instructions().back();
+    EXPECT_EQ(jump.opcode(), JMP);
+    EXPECT_TRUE(jump.is_tail_call());
+    EXPECT_STREQ(jump.operands()[0].external_sym(), "sum");
+
+    mf->build_cfg();
+    EXPECT_TRUE(recurse->successors().empty());
+
+    // Both ways out release the frame
+    mf->frame()->create_fixed_size(nullptr, 4, 4);
+    FrameLowering lowering;
+    lowering.emit_prologue(*mf);
+    lowering.emit_epilogue(*mf);
+    for (const auto &mbb : mf->basic_blocks())
+    {
+        const auto &insts = mbb->instructions();
+        if (mbb.get() == mf->basic_blocks().front().get())
+            continue;
+        ASSERT_GE(insts.size(), 2u);
+        EXPECT_EQ(insts[insts.size() - 2]->opcode(), ADD);
+    }
+}
+
+TEST(TailCalls, RISCVJumpsToTheCallee)
+{
+    Module m;
+    Sum sum = build_sum(m);
+    mark_tail_calls(m);
+
+    RISCV::RISCVRegisterInfo tri;
+    RISCV::RISCVTargetInstInfo tii;
+    RISCV::RISCVISelInfo target(&tii);
+    MachineModule mm(&m);
+    mm.set_target_info(&tri, &tii);
+    MachineFunction *mf = mm.create_machine_function(sum.f);
+    std::string err;
+    ASSERT_TRUE(select_function(target, *sum.f, *mf, &err)) << err;
+
+    const MachineInst &jump = *mf->basic_blocks().back()->instructions().back();
+    EXPECT_EQ(jump.opcode(), RISCV::J);
+    EXPECT_TRUE(jump.is_tail_call());
+    mf->build_cfg();
+    EXPECT_TRUE(mf->basic_blocks().back()->successors().empty());
+}
+
+TEST(TailCalls, CallsWithoutTheMarkStayCalls)
+{
+    Module m;
+    Sum sum = build_sum(m);
+
+    ASIMOV::ASIMOVRegisterInfo tri;
+    ASIMOV::ASIMOVTargetInstInfo tii;
+    ASIMOV::ASIMOVISelInfo target(&tii);
+    MachineModule mm(&m);
+    mm.set_target_info(&tri, &tii);
+    MachineFunction *mf = mm.create_machine_function(sum.f);
+    ASSERT_TRUE(select_function(target, *sum.f, *mf));
+
+    using namespace ASIMOV;
+    const std::vector<unsigned> ops = opcodes(mf->basic_blocks().back().get());
+    EXPECT_EQ(std::count(ops.begin(), ops.end(), CALL), 1);
+    EXPECT_EQ(ops.back(), RET);
+}
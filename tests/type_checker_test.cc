@@ -75,6 +75,76 @@ TEST_F(TypeCheckerTest, ResolveAlias)
     EXPECT_TRUE(types_equal(*resolved, *Type::create_int()));
 }
 
+TEST_F(TypeCheckerTest, InternedTypesAreShared)
+{
+    TypeContext &types = *program_->types;
+
+    const Type *i32 = types.get_int();
+    EXPECT_EQ(types.intern(*Type::create_int()), i32);
+    EXPECT_NE(types.get_int(32, true), i32);
+    EXPECT_NE(types.get_int(64), i32);
+
+    auto ptr_ptr = Type::create_pointer(Type::create_pointer(Type::create_int()));
+    const Type *canonical = types.intern(*ptr_ptr);
+    EXPECT_EQ(canonical, types.get_pointer(types.get_pointer(i32)));
+    EXPECT_EQ(types.intern(*canonical), canonical);
+    EXPECT_EQ(&canonical->as_pointer()->pointee(), types.get_pointer(i32));
+
+    const size_t count = types.size();
+    std::vector<TypePtr> params;
+    params.push_back(ptr_ptr->clone());
+    auto fn = Type::create_function(Type::create_int(), std::move(params));
+    EXPECT_EQ(types.intern(*fn), types.intern(*fn->clone()));
+    EXPECT_EQ(types.size(), count + 1);
+
+    // Handles to interned types neither copy nor own them
+    {
+        TypePtr handle = canonical->clone();
+        EXPECT_EQ(handle.get(), canonical);
+    }
+    EXPECT_EQ(canonical->to_string(), "**i32");
+    EXPECT_TRUE(types_equal(*canonical, *types.intern(*ptr_ptr)));
+    EXPECT_FALSE(types_equal(*canonical, *types.get_pointer(i32)));
+}
+
+TEST_F(TypeCheckerTest, InternedStructs)
+{
+    TypeContext &types = *program_->types;
+
+    auto point = Type::create_struct("Point", {{"x", Type::create_int()}, {"y", Type::create_int()}});
+    auto renamed = Type::create_struct("Point", {{"x", Type::create_int()}, {"z", Type::create_int()}});
+
+    const Type *canonical = types.intern(*point);
+    EXPECT_EQ(types.intern(*point->clone()), canonical);
+    EXPECT_NE(types.intern(*renamed), canonical);
+    EXPECT_EQ(canonical->as_struct()->find_member("y"), types.get_int());
+}
+
+TEST_F(TypeCheckerTest, CheckedExpressionsShareTypes)
+{
+    /*
+        fn main(argc: i32, argv: **i8) -> i32 {
+            let a: i32 = 1;
+            let b = a + argc;
+        }
+    */
+    program_->functions.push_back(std::make_unique<FunctionDecl>(
+        FunctionDecl::create_main_function()));
+    auto &body = program_->functions.back()->body;
+    body.push_back(std::make_unique<VarDeclStmt>(false, "a", Type::create_int(), std::make_unique<IntegerLiteralExpr>(1)));
+    auto sum = std::make_unique<BinaryExpr>(TokenType::Plus, std::make_unique<VariableExpr>("a"), std::make_unique<VariableExpr>("argc"));
+    auto *sum_ptr = sum.get();
+    body.push_back(std::make_unique<VarDeclStmt>(false, "b", nullptr, std::move(sum)));
+
+    EXPECT_TRUE(no_error(check()));
+
+    const Type *i32 = program_->types->get_int();
+    EXPECT_EQ(sum_ptr->type.get(), i32);
+    EXPECT_EQ(sum_ptr->left->type.get(), i32);
+    EXPECT_EQ(sum_ptr->right->type.get(), i32);
+    EXPECT_EQ(static_cast<VarDeclStmt &>(*body.back()).type.get(), i32);
+}
+
 TEST_F(TypeCheckerTest, FindStruct)
 {
     StructDecl structDecl("MyStruct", {});
@@ -86,38 +156,66 @@ TEST_F(TypeCheckerTest, FindStruct)
 
 TEST_F(TypeCheckerTest, FindAndInsert)
 {
-    Scope globalScope(nullptr);
+    Scope globalScope;
     auto IntegerType = Type::create_int();
 
-    EXPECT_TRUE(globalScope.insert_variable("x", IntegerType->clone()));
+    EXPECT_TRUE(globalScope.insert_variable("x", IntegerType.get()));
     EXPECT_TRUE(types_equal(*globalScope.resolve_variable("x"), *IntegerType));
     EXPECT_EQ(globalScope.resolve_variable("y"), nullptr);
 }
 
 TEST_F(TypeCheckerTest, NestedScope)
 {
-    Scope globalScope(nullptr);
-    Scope localScope(&globalScope);
+    Scope scope;
 
     auto IntegerType = Type::create_int();
     auto floatType = Type::create_float();
 
-    globalScope.insert_variable("x", IntegerType->clone());
-    localScope.insert_variable("y", floatType->clone());
+    scope.insert_variable("x", IntegerType.get());
+    scope.push();
+    scope.insert_variable("y", floatType.get());
+
+    EXPECT_EQ(scope.depth(), 1u);
+    EXPECT_TRUE(types_equal(*scope.resolve_variable("x"), *IntegerType));
+    EXPECT_TRUE(types_equal(*scope.resolve_variable("y"), *floatType));
+    EXPECT_EQ(scope.resolve_variable("z"), nullptr);
 
-    EXPECT_TRUE(types_equal(*localScope.resolve_variable("x"), *IntegerType));
-    EXPECT_TRUE(types_equal(*localScope.resolve_variable("y"), *floatType));
-    EXPECT_EQ(localScope.resolve_variable("z"), nullptr);
+    scope.pop();
+    EXPECT_TRUE(scope.is_global());
+    EXPECT_EQ(scope.resolve_variable("y"), nullptr);
+}
+
+TEST_F(TypeCheckerTest, ShadowingInNestedScopes)
+{
+    Scope scope;
+    auto IntegerType = Type::create_int();
+    auto floatType = Type::create_float();
+
+    EXPECT_TRUE(scope.insert_type("T", IntegerType.get()));
+    scope.push();
+    EXPECT_TRUE(scope.insert_type("T", floatType.get()));
+    EXPECT_EQ(scope.resolve_type("T"), floatType.get());
+    EXPECT_FALSE(scope.insert_variable("T", IntegerType.get()));
+    EXPECT_TRUE(scope.insert_variable("v", IntegerType.get()));
+    EXPECT_FALSE(scope.insert_variable("v", floatType.get()));
+    scope.push();
+    EXPECT_TRUE(scope.insert_variable("v", floatType.get()));
+    EXPECT_EQ(scope.resolve_variable("v"), floatType.get());
+    scope.pop();
+    EXPECT_EQ(scope.resolve_variable("v"), IntegerType.get());
+    scope.pop();
+    EXPECT_EQ(scope.resolve_type("T"), IntegerType.get());
+    EXPECT_EQ(scope.resolve_variable("v"), nullptr);
 }
 
 TEST_F(TypeCheckerTest, PushAndPopScope)
 {
     push_scope();
-    current_scope_->insert_variable("x", (Type::create_int()));
-    EXPECT_NE(current_scope_->resolve_variable("x"), nullptr);
+    scope_.insert_variable("x", types_->get_int());
+    EXPECT_NE(scope_.resolve_variable("x"), nullptr);
 
     pop_scope();
-    EXPECT_EQ(current_scope_->resolve_variable("x"), nullptr);
+    EXPECT_EQ(scope_.resolve_variable("x"), nullptr);
 }
 
 TEST_F(TypeCheckerTest, ValidBreakContinue)
@@ -569,3 +667,59 @@ TEST_F(TypeCheckerTest, SizeofExprTypeInference)
     EXPECT_TRUE(types_equal(*stmt.expr->type, *Type::create_int(64, true)));
     EXPECT_EQ(stmt.expr->expr_category, Expr::Category::RValue);
 }
+
+TEST_F(TypeCheckerTest, ForwardCallsResolve)
+{
+    /*
+        fn main() -> i32 { foo(3.14); }
+        fn foo(x: f32) -> i32 {}
+    */
+    std::vector<ExprPtr> args;
+    args.push_back(std::make_unique<FloatLiteralExpr>(3.14f));
+    program_->functions.push_back(std::make_unique<FunctionDecl>(
+        FunctionDecl::create_main_function()));
+    program_->functions.back()->body.push_back(
+        std::make_unique<ExprStmt>(std::make_unique<CallExpr>("foo", std::move(args))));
+
+    auto func_decl = std::make_unique<FunctionDecl>();
+    func_decl->name = "foo";
+    func_decl->return_type = Type::create_int();
+    func_decl->params.push_back({"x", Type::create_float()});
+    program_->functions.push_back(std::move(func_decl));
+
+    EXPECT_TRUE(no_error(check()));
+}
+
+TEST_F(TypeCheckerTest, ParallelBodiesReportErrorsInSourceOrder)
+{
+    /*
+        fn f0(x: i32) { missing0; }
+        fn f1(x: i32) { missing1; }
+        ...
+    */
+    constexpr int num_functions = 32;
+    for (int i = 0; i < num_functions; ++i)
+    {
+        auto func_decl = std::make_unique<FunctionDecl>();
+        func_decl->name = "f" + std::to_string(i);
+        func_decl->return_type = Type::create_void();
+        func_decl->params.push_back({"x", Type::create_int()});
+        func_decl->body.push_back(std::make_unique<ExprStmt>(
+            std::make_unique<VariableExpr>("missing" + std::to_string(i))));
+        func_decl->body.push_back(std::make_unique<ExprStmt>(
+            std::make_unique<VariableExpr>("x")));
+        program_->functions.push_back(std::move(func_decl));
+    }
+
+    ThreadPool pool(4);
+    set_thread_pool(&pool);
+    auto result = check();
+
+    ASSERT_EQ(result.errors.size(), num_functions);
+    for (int i = 0; i < num_functions; ++i)
+    {
+        EXPECT_EQ(result.errors[i], "Undefined symbol 'missing" + std::to_string(i) + "'");
+        auto &stmt = static_cast<ExprStmt &>(*program_->functions[i]->body.back());
+        EXPECT_TRUE(types_equal(*stmt.expr->type, *types_->get_int()));
+    }
+}
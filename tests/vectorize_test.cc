@@ -0,0 +1,287 @@
+#include <functional>
+
+#include "gtest/gtest.h"
+#include "src/ir_builder.h"
+#include "src/transforms/loop_simplify.h"
+#include "src/transforms/vectorize.h"
+
+namespace
+{
+    constexpr unsigned VECTOR_BYTES = 16;
+
+    unsigned count_if(Function *f, const std::function<bool(const Instruction &)> &pred)
+    {
+        unsigned count = 0;
+        for (BasicBlock *bb : f->basic_blocks())
+        {
+            for (Instruction &inst : *bb)
+            {
+                count += pred(inst);
+            }
+        }
+        return count;
+    }
+
+    unsigned count_vector(Function *f, Opcode opc)
+    {
+        return count_if(f, [&](const Instruction &inst)
+                        {
+                            const Value *value = opc == Opcode::Store ? inst.operand(0) : &inst;
+                            return inst.opcode() == opc && value->type()->is_vector(); });
+    }
+
+    unsigned count_scalar(Function *f, Opcode opc)
+    {
+        return count_if(f, [&](const Instruction &inst)
+                        { return inst.opcode() == opc && !inst.operand(0)->type()->is_vector(); });
+    }
+
+    BasicBlock *find_block(Function *f, const std::string &name)
+    {
+        for (BasicBlock *bb : f->basic_blocks())
+        {
+            if (bb->name() == name)
+                return bb;
+        }
+        return nullptr;
+    }
+
+    GlobalVariable *make_array(Module &m, Type *element, uint64_t size, const std::string &name)
+    {
+        ArrayType *type = m.get_array_type(element, size);
+        return m.create_global_variable(m.get_pointer_type(type), false, m.get_constant_aggregate_zero(type), name);
+    }
+
+    // `for (i = 0; i < n; i++) body` after mem2reg: entry -> for.cond <->
+    // for.body, for.cond -> for.end
+    Loop &make_loop(Module &m, Function *f, IRBuilder &builder, AnalysisManager &analyses, Value *bound,
+                    const std::function<void(PhiInst *)> &body)
+    {
+        IntegerType *i32 = m.get_integer_type(32);
+        BasicBlock *entry = f->create_basic_block("entry");
+        BasicBlock *cond = f->create_basic_block("for.cond");
+        BasicBlock *loop_body = f->create_basic_block("for.body");
+        BasicBlock *exit = f->create_basic_block("for.end");
+
+        builder.set_insert_point(entry);
+        builder.create_br(cond);
+        builder.set_insert_point(cond);
+        PhiInst *i = builder.create_phi(i32, "i");
+        builder.create_cond_br(builder.create_icmp(ICmpInst::SLT, i, bound), loop_body, exit);
+        builder.set_insert_point(loop_body);
+        body(i);
+        Value *next = builder.create_add(i, builder.get_int32(1), "i.next");
+        builder.create_br(cond);
+        i->add_incoming(builder.get_int32(0), entry);
+        i->add_incoming(next, loop_body);
+        builder.set_insert_point(exit);
+        builder.create_ret_void();
+
+        const LoopInfo &loops = analyses.loop_info(*f);
+        EXPECT_EQ(loops.num_loops(), 1u);
+        return *loops.top_level().front();
+    }
+}
+
+TEST(LoopVectorize, WidensAccessesToGlobalArraysWithoutRangeChecks)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    GlobalVariable *a = make_array(m, i32, 64, "a");
+    GlobalVariable *b = make_array(m, i32, 64, "b");
+    GlobalVariable *c = make_array(m, i32, 64, "c");
+    Function *f = m.create_function("f", m.get_void_type(), {{"n", i32}});
+    IRBuilder builder(&m);
+    AnalysisManager analyses;
+
+    Loop &loop = make_loop(m, f, builder, analyses, f->arg(0), [&](PhiInst *i)
+                           {
+                               Value *x = builder.create_load(builder.create_gep(a, {builder.get_int32(0), i}), "x");
+                               Value *y = builder.create_load(builder.create_gep(b, {builder.get_int32(0), i}), "y");
+                               builder.create_store(builder.create_add(x, y, "sum"),
+                                                    builder.create_gep(c, {builder.get_int32(0), i})); });
+    EXPECT_EQ(vectorization_factor(loop, VECTOR_BYTES), 4u);
+    EXPECT_EQ(vectorization_factor(loop, 4), 1u);
+    ASSERT_TRUE(vectorize_loop(loop, VECTOR_BYTES));
+
+    BasicBlock *body = find_block(f, "for.cond.vec.body");
+    ASSERT_NE(body, nullptr);
+    ASSERT_NE(find_block(f, "for.cond.vec.check"), nullptr);
+    ASSERT_NE(find_block(f, "for.cond.scalar.ph"), nullptr);
+    EXPECT_EQ(count_vector(f, Opcode::Load), 2u);
+    EXPECT_EQ(count_vector(f, Opcode::Add), 1u);
+    EXPECT_EQ(count_vector(f, Opcode::Store), 1u);
+    // The scalar loop is still there for the rest
+    EXPECT_EQ(count_scalar(f, Opcode::Store), 1u);
+    // Distinct globals never overlap
+    EXPECT_EQ(count_if(f, [](const Instruction &inst)
+                       { return inst.opcode() == Opcode::ICmp &&
+                                static_cast<const ICmpInst &>(inst).predicate() == ICmpInst::ULE; }),
+              0u);
+
+    // The vector loop branches back to itself and out to the scalar loop
+    analyses.invalidate(*f, PreservedAnalyses::none());
+    const LoopInfo &loops = analyses.loop_info(*f);
+    EXPECT_EQ(loops.num_loops(), 2u);
+}
+
+TEST(LoopVectorize, ChecksPointerRangesAndBroadcastsInvariants)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    PointerType *ptr = m.get_pointer_type(i32);
+    Function *f = m.create_function("f", m.get_void_type(), {{"p", ptr}, {"q", ptr}, {"k", i32}, {"n", i32}});
+    IRBuilder builder(&m);
+    AnalysisManager analyses;
+
+    Loop &loop = make_loop(m, f, builder, analyses, f->arg(3), [&](PhiInst *i)
+                           {
+                               Value *x = builder.create_load(builder.create_gep(f->arg(1), {i}), "x");
+                               builder.create_store(builder.create_mul(x, f->arg(2), "scaled"),
+                                                    builder.create_gep(f->arg(0), {i})); });
+    ASSERT_TRUE(vectorize_loop(loop, VECTOR_BYTES));
+
+    // p and q may be the same array: [p, p + n) and [q, q + n) are compared
+    EXPECT_EQ(count_if(f, [](const Instruction &inst)
+                       { return inst.opcode() == Opcode::ICmp &&
+                                static_cast<const ICmpInst &>(inst).predicate() == ICmpInst::ULE; }),
+              2u);
+    // k goes into every lane once, before the vector loop
+    EXPECT_EQ(count_if(f, [](const Instruction &inst)
+                       { return inst.opcode() == Opcode::Alloca; }),
+              1u);
+    EXPECT_EQ(f->entry_block()->first_instruction()->opcode(), Opcode::Alloca);
+    EXPECT_EQ(count_vector(f, Opcode::Mul), 1u);
+    BasicBlock *scalar_ph = find_block(f, "for.cond.scalar.ph");
+    ASSERT_NE(scalar_ph, nullptr);
+    EXPECT_EQ(scalar_ph->first_instruction()->opcode(), Opcode::Phi);
+    EXPECT_EQ(static_cast<PhiInst *>(scalar_ph->first_instruction())->num_incoming(), 2u);
+}
+
+TEST(LoopVectorize, LeavesLoopsWithOtherShapesAlone)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    IntegerType *i16 = m.get_integer_type(16);
+    GlobalVariable *a = make_array(m, i32, 64, "a");
+    GlobalVariable *s = make_array(m, i16, 64, "s");
+    Function *g = m.create_function("g", i32, {{"x", i32}});
+
+    {
+        // a[i] = a[i + 1]: the address doesn't step with i alone
+        Function *f = m.create_function("shifted", m.get_void_type(), {{"n", i32}});
+        IRBuilder builder(&m);
+        AnalysisManager analyses;
+        Loop &loop = make_loop(m, f, builder, analyses, f->arg(0), [&](PhiInst *i)
+                               {
+                                   Value *j = builder.create_add(i, builder.get_int32(1), "j");
+                                   Value *x = builder.create_load(builder.create_gep(a, {builder.get_int32(0), j}), "x");
+                                   builder.create_store(x, builder.create_gep(a, {builder.get_int32(0), i})); });
+        EXPECT_EQ(vectorization_factor(loop, VECTOR_BYTES), 1u);
+        EXPECT_FALSE(vectorize_loop(loop, VECTOR_BYTES));
+    }
+    {
+        // A call in the body
+        Function *f = m.create_function("calls", m.get_void_type(), {{"n", i32}});
+        IRBuilder builder(&m);
+        AnalysisManager analyses;
+        Loop &loop = make_loop(m, f, builder, analyses, f->arg(0), [&](PhiInst *i)
+                               {
+                                   Value *x = builder.create_call(g, {i}, "x");
+                                   builder.create_store(x, builder.create_gep(a, {builder.get_int32(0), i})); });
+        EXPECT_FALSE(vectorize_loop(loop, VECTOR_BYTES));
+    }
+    {
+        // Lanes of different sizes
+        Function *f = m.create_function("mixed", m.get_void_type(), {{"n", i32}});
+        IRBuilder builder(&m);
+        AnalysisManager analyses;
+        Loop &loop = make_loop(m, f, builder, analyses, f->arg(0), [&](PhiInst *i)
+                               {
+                                   Value *x = builder.create_load(builder.create_gep(s, {builder.get_int32(0), i}), "x");
+                                   builder.create_store(x, builder.create_gep(s, {builder.get_int32(0), i}));
+                                   builder.create_store(builder.get_int32(0), builder.create_gep(a, {builder.get_int32(0), i})); });
+        EXPECT_FALSE(vectorize_loop(loop, VECTOR_BYTES));
+    }
+}
+
+TEST(SLPVectorize, KeepsLoadsFromMovingPastTheStores)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    GlobalVariable *a = make_array(m, i32, 8, "a");
+    GlobalVariable *b = make_array(m, i32, 8, "b");
+    Function *f = m.create_function("f", m.get_void_type(), {{"k", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    // a[j] = b[j] * k + a[j] for j = 0..3, stored out of order
+    for (int j : {2, 0, 3, 1})
+    {
+        Value *x = builder.create_load(builder.create_gep(b, {builder.get_int32(0), builder.get_int32(j)}), "x");
+        Value *y = builder.create_load(builder.create_gep(a, {builder.get_int32(0), builder.get_int32(j)}), "y");
+        Value *sum = builder.create_add(builder.create_mul(x, f->arg(0), "scaled"), y, "sum");
+        builder.create_store(sum, builder.create_gep(a, {builder.get_int32(0), builder.get_int32(j)}));
+    }
+    builder.create_ret_void();
+
+    // a[2] is stored before a[0] is loaded, so the first group can't move
+    // its loads past it; b is never stored to
+    EXPECT_EQ(vectorize_slp(*f, VECTOR_BYTES), 0u);
+}
+
+TEST(SLPVectorize, ReplacesIsomorphicLanesWithOneVectorStore)
+{
+    Module m;
+    IntegerType *i32 = m.get_integer_type(32);
+    GlobalVariable *a = make_array(m, i32, 8, "a");
+    GlobalVariable *b = make_array(m, i32, 8, "b");
+    GlobalVariable *c = make_array(m, i32, 8, "c");
+    Function *f = m.create_function("f", m.get_void_type(), {{"k", i32}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    auto at = [&](GlobalVariable *array, int j)
+    { return builder.create_gep(array, {builder.get_int32(0), builder.get_int32(j)}); };
+    // c[j] = a[j] * k + b[j] for j = 0..4; c[4] has no lanes to go with
+    for (int j = 0; j < 5; ++j)
+    {
+        Value *x = builder.create_load(at(a, j), "x");
+        Value *y = builder.create_load(at(b, j), "y");
+        builder.create_store(builder.create_add(builder.create_mul(x, f->arg(0), "scaled"), y, "sum"), at(c, j));
+    }
+    // Not the same shape in every lane
+    builder.create_store(builder.create_load(at(a, 0), "x"), at(b, 4));
+    builder.create_store(builder.get_int32(7), at(b, 5));
+    builder.create_store(builder.create_load(at(a, 2), "x"), at(b, 6));
+    builder.create_store(builder.get_int32(7), at(b, 7));
+    builder.create_ret_void();
+
+    EXPECT_EQ(vectorize_slp(*f, VECTOR_BYTES), 1u);
+    EXPECT_EQ(count_vector(f, Opcode::Store), 1u);
+    EXPECT_EQ(count_vector(f, Opcode::Load), 3u); // a, b and the broadcast k
+    EXPECT_EQ(count_vector(f, Opcode::Mul), 1u);
+    EXPECT_EQ(count_vector(f, Opcode::Add), 1u);
+    EXPECT_EQ(count_scalar(f, Opcode::Store), 5u + 4u); // c[4], b[4..7] and the lanes of k
+}
+
+TEST(SLPVectorize, TwoLanesOfEightBytes)
+{
+    Module m;
+    IntegerType *i64 = m.get_integer_type(64);
+    PointerType *ptr = m.get_pointer_type(i64);
+    Function *f = m.create_function("f", m.get_void_type(), {{"p", ptr}, {"q", ptr}});
+    BasicBlock *entry = f->create_basic_block("entry");
+    IRBuilder builder(&m);
+    builder.set_insert_point(entry);
+    Value *q0 = builder.create_load(builder.create_gep(f->arg(1), {builder.get_int32(0)}), "q0");
+    Value *q1 = builder.create_load(builder.create_gep(f->arg(1), {builder.get_int32(1)}), "q1");
+    builder.create_store(q0, builder.create_gep(f->arg(0), {builder.get_int32(0)}));
+    builder.create_store(q1, builder.create_gep(f->arg(0), {builder.get_int32(1)}));
+    builder.create_ret_void();
+
+    // Both loads come before the first store, even though p may be q
+    EXPECT_EQ(vectorize_slp(*f, VECTOR_BYTES), 1u);
+    EXPECT_EQ(count_vector(f, Opcode::Store), 1u);
+    EXPECT_EQ(count_vector(f, Opcode::Load), 1u);
+}
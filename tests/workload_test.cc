@@ -0,0 +1,26 @@
+#include <string>
+#include <vector>
+
+#include "bench/workload.h"
+#include "gtest/gtest.h"
+#include "src/compile_driver.h"
+
+// 基准测试生成的每种程序都能在各优化级别下编出 RISC-V 目标文件
+TEST(WorkloadTest, EveryShapeCompiles)
+{
+    for (WorkloadShape shape : ALL_WORKLOAD_SHAPES)
+    {
+        SCOPED_TRACE(workload_shape_name(shape));
+        EXPECT_EQ(parse_workload_shape(workload_shape_name(shape)), shape);
+        const std::vector<CompileInput> inputs = {
+            {.path = std::string(workload_shape_name(shape)) + ".mo", .source = generate_workload(shape, 64), .output_path = ""}};
+
+        for (unsigned opt_level : {0u, 1u, 2u})
+        {
+            SCOPED_TRACE(opt_level);
+            std::vector<CompileResult> results = compile_files(inputs, {.opt_level = opt_level});
+            ASSERT_TRUE(results[0].ok) << results[0].errors.front();
+            EXPECT_FALSE(results[0].output.empty());
+        }
+    }
+}